@@ -5,8 +5,12 @@
  */
 
 #include "berrystreamcam-source.hpp"
+#include "discovery/capability-probe.hpp"
 #include <util/platform.h>
 #include <graphics/image-file.h>
+#include <algorithm>
+#include <cctype>
+#include <cstring>
 
 namespace berrystreamcam {
 
@@ -81,17 +85,44 @@ static void berrystreamcam_get_defaults(obs_data_t *settings)
 BerryStreamCamSource::BerryStreamCamSource(obs_data_t *settings, obs_source_t *source)
     : source_(source)
     , texture_(nullptr)
-    , active_(false)
+    , discovery_subscription_(0)
+    , decode_lane_(0)
+    , budget_id_(0)
+    , session_member_(0)
+    , session_changed_(false)
+    , sharing_(false)
+    , shared_dropped_(0)
+    , fec_transport_(nullptr)
+    , shm_transport_(nullptr)
+    , local_relay_(true)
+    , relay_transport_(nullptr)
+    , restream_(false)
+    , restream_lan_(false)
+    , restream_port_(RestreamServer::DEFAULT_PORT)
+    , restream_stream_(0)
+    , restream_failed_(false)
     , streaming_(false)
     , stream_state_(StreamState::STOPPED)
+    , swap_requested_(false)
     , width_(1920)
     , height_(1080)
+    , on_program_(false)
+    , showing_(false)
+    , priority_override_(-1)
     , frame_buffer_(nullptr)
     , frame_buffer_size_(0)
+    , layout_()
     , last_protocol_(ProtocolType::HTTP_RAW_H264)
-    , fallback_protocol_(ProtocolType::WEBSOCKET_OBS_DROID)
-    , connection_failed_(false)
-    , connection_retry_count_(0)
+    , active_protocol_(ProtocolType::UNKNOWN)
+    , failover_count_(0)
+    , last_recovery_ms_(-1)
+    , corrupt_dropped_(0)
+    , lifecycle_({
+          [this]() { return start_streaming(); },
+          [this]() { stop_streaming(); },
+          [this]() { pause_streaming(); },
+          [this]() { resume_streaming(); },
+          [this]() { return swap_transport(); } })
 {
     BLOG_INFO("Creating BerryStreamCam source");
 
@@ -99,23 +130,67 @@ BerryStreamCamSource::BerryStreamCamSource(obs_data_t *settings, obs_source_t *s
     frame_buffer_size_ = FRAME_BUFFER_SIZE;
     frame_buffer_ = new uint8_t[frame_buffer_size_];
 
-    // Initialize discovery
-    discovery_ = std::make_unique<DeviceDiscovery>();
+    // Share the process-wide discovery; the table arrives through the subscription
+    discovery_ = DiscoveryService::acquire();
+    discovery_subscription_ = discovery_->subscribe([this](const DeviceTable& table) {
+        std::lock_guard<std::mutex> lock(device_mutex_);
+        discovered_devices_ = table.devices;
+    });
 
-    // Initialize decoder
+    // Initialize decoder; it runs on the shared decode pool, one job at a time
     decoder_ = std::make_unique<H264Decoder>();
     decoder_->initialize();
+    decode_pool_ = DecodePool::acquire();
+    decode_lane_ = decode_pool_->open_lane(DecodePriority::HIDDEN);
+    decode_budget_ = DecodeBudget::acquire();
+    budget_id_ = decode_budget_->add();
+
+    // Another source already streaming the same device hands us its pictures
+    sessions_ = DeviceSessionManager::acquire();
+    session_member_ = sessions_->join(
+        [this](const PictureRef& picture) { receive_shared_picture(picture); },
+        [this]() {
+            session_changed_ = true;
+            wake_streaming_thread();
+        });
 
     // Initialize handlers in main thread (Qt requirement)
     ws_handler_ = std::make_unique<WebSocketHandler>();
     http_handler_ = std::make_unique<HttpHandler>();
-    // rtsp_handler_ = std::make_unique<RtspHandler>();  // Coming soon
-
-    // Set active flag so discovery thread runs
-    active_ = true;
+    mjpeg_handler_ = std::make_unique<HttpHandler>();
+    rtsp_handler_ = std::make_unique<RtspUdpHandler>();
+    dash_handler_ = std::make_unique<DashHandler>();
+    srt_handler_ = std::make_unique<SrtHandler>();
+
+    transports_.push_back(std::make_unique<WebSocketTransport>(*ws_handler_));
+    transports_.push_back(std::make_unique<RtspTransport>(*rtsp_handler_));
+    transports_.push_back(std::make_unique<HttpTransport>(*http_handler_, ProtocolType::HTTP_RAW_H264));
+    transports_.push_back(std::make_unique<HttpTransport>(*mjpeg_handler_, ProtocolType::HTTP_MJPEG));
+    transports_.push_back(std::make_unique<DashTransport>(*dash_handler_));
+    transports_.push_back(std::make_unique<SrtTransport>(*srt_handler_));
+
+    // Plain UDP with parity and NACKs, for devices that offer it
+    auto fec = std::make_unique<UdpFecTransport>();
+    fec_transport_ = fec.get();
+    transports_.push_back(std::move(fec));
+
+    // A producer on this computer, writing into shared memory
+    auto shm = std::make_unique<ShmIngestTransport>();
+    shm_transport_ = shm.get();
+    transports_.push_back(std::move(shm));
+
+    // Reads what another OBS process on this host receives from the device
+    auto relay = std::make_unique<RelayTransport>();
+    relay_transport_ = relay.get();
+    transports_.push_back(std::move(relay));
+
+    // Let scripts and the websocket API poll network quality
+    if (source_) {
+        proc_handler_t *ph = obs_source_get_proc_handler(source_);
+        proc_handler_add(ph, "void get_stats(out string stats)", get_stats_proc, this);
+    }
 
-    // Start discovery thread
-    discovery_thread_ = std::thread(&BerryStreamCamSource::discovery_thread_func, this);
+    lifecycle_.set_active(true);
 
     update(settings);
 }
@@ -125,18 +200,15 @@ BerryStreamCamSource::~BerryStreamCamSource()
 {
     BLOG_INFO("Destroying BerryStreamCam source");
 
-    // Stop streaming first
-    stop_streaming();
+    // Stop streaming first; waits for a transition still in progress
+    lifecycle_.shutdown();
 
-    // Stop discovery thread
-    active_ = false;
-    if (discovery_thread_.joinable()) {
-        try {
-            discovery_thread_.join();
-        } catch (const std::exception& e) {
-            BLOG_WARNING("Exception while joining discovery thread: %s", e.what());
-        }
-    }
+    // Leave discovery; the last source to go stops the scan thread
+    discovery_->unsubscribe(discovery_subscription_);
+    discovery_.reset();
+
+    // Transports only point at the handlers
+    transports_.clear();
 
     // Clean up handlers explicitly to prevent crashes
     try {
@@ -147,6 +219,7 @@ BerryStreamCamSource::~BerryStreamCamSource()
 
     try {
         http_handler_.reset();
+        mjpeg_handler_.reset();
     } catch (...) {
         BLOG_WARNING("Exception cleaning up HTTP handler");
     }
@@ -157,6 +230,28 @@ BerryStreamCamSource::~BerryStreamCamSource()
         BLOG_WARNING("Exception cleaning up RTSP handler");
     }
 
+    try {
+        dash_handler_.reset();
+    } catch (...) {
+        BLOG_WARNING("Exception cleaning up DASH handler");
+    }
+
+    try {
+        srt_handler_.reset();
+    } catch (...) {
+        BLOG_WARNING("Exception cleaning up SRT handler");
+    }
+
+    // No other source hands us pictures from here on
+    sessions_->leave(session_member_);
+    sessions_.reset();
+
+    // No decode job is running or will run once the lane is closed
+    decode_pool_->close_lane(decode_lane_);
+    decode_pool_.reset();
+    decode_budget_->remove(budget_id_);
+    decode_budget_.reset();
+
     // Clean up decoder
     if (decoder_) {
         try {
@@ -189,6 +284,46 @@ void BerryStreamCamSource::update(obs_data_t *settings)
     const char *device_ip = obs_data_get_string(settings, "device_ip");
     const char *manual_ip = obs_data_get_string(settings, "manual_ip");
     const char *protocol = obs_data_get_string(settings, "protocol");
+    const char *priority = obs_data_get_string(settings, "decode_priority");
+
+    {
+        std::lock_guard<std::mutex> lock(frame_mutex_);
+        layout_.crop_left = static_cast<uint32_t>(obs_data_get_int(settings, "crop_left"));
+        layout_.crop_top = static_cast<uint32_t>(obs_data_get_int(settings, "crop_top"));
+        layout_.crop_right = static_cast<uint32_t>(obs_data_get_int(settings, "crop_right"));
+        layout_.crop_bottom = static_cast<uint32_t>(obs_data_get_int(settings, "crop_bottom"));
+        layout_.scale_width = static_cast<uint32_t>(obs_data_get_int(settings, "scale_width"));
+        layout_.scale_height = static_cast<uint32_t>(obs_data_get_int(settings, "scale_height"));
+    }
+
+    if (strcmp(priority, "program") == 0) {
+        priority_override_ = static_cast<int>(DecodePriority::PROGRAM);
+    } else if (strcmp(priority, "preview") == 0) {
+        priority_override_ = static_cast<int>(DecodePriority::PREVIEW);
+    } else if (strcmp(priority, "hidden") == 0) {
+        priority_override_ = static_cast<int>(DecodePriority::HIDDEN);
+    } else {
+        priority_override_ = -1;
+    }
+    apply_decode_priority();
+
+    // Moves onto, or off, another process's relay without a gap
+    bool local_relay = obs_data_get_bool(settings, "local_relay");
+    if (local_relay_.exchange(local_relay) != local_relay) {
+        lifecycle_.request_swap();
+    }
+
+    // Reopened with the new settings on the next keyframe
+    const char *restream = obs_data_get_string(settings, "restream");
+    bool restream_lan = restream && strcmp(restream, "lan") == 0;
+    bool restream_on = restream_lan || (restream && strcmp(restream, "localhost") == 0);
+    int restream_port = static_cast<int>(obs_data_get_int(settings, "restream_port"));
+    bool restream_changed = restream_.exchange(restream_on) != restream_on;
+    restream_changed |= restream_lan_.exchange(restream_lan) != restream_lan;
+    restream_changed |= restream_port_.exchange(restream_port) != restream_port;
+    if (restream_changed) {
+        stop_restream();
+    }
 
     // Use manual IP if device_ip is empty or is the placeholder
     std::string ip_to_use;
@@ -198,59 +333,128 @@ void BerryStreamCamSource::update(obs_data_t *settings)
         ip_to_use = device_ip;
     }
 
+    // A producer on this computer is named rather than addressed
+    if (strcmp(protocol, "shm") == 0) {
+        const char *shm_name = obs_data_get_string(settings, "shm_name");
+        ip_to_use = std::string("shm:") + (shm_name && strlen(shm_name) > 0 ? shm_name : "default");
+    }
+
+    // So is an SRT sender, by its URL; it is rarely on this network
+    if (strcmp(protocol, "srt") == 0) {
+        const char *srt_url = obs_data_get_string(settings, "srt_url");
+        ip_to_use = srt_url && strlen(srt_url) > 0 ? std::string("srt:") + srt_url : std::string();
+    }
+
     if (!ip_to_use.empty()) {
-        config_.device_ip = ip_to_use;
+        // Edit a copy; the lifecycle thread may be reading config_ to connect
+        StreamConfig config = config_;
+        config.device_ip = ip_to_use;
 
         // Store old protocol to detect changes
-        ProtocolType old_protocol = config_.protocol;
+        ProtocolType old_protocol = config.protocol;
 
         // Determine protocol type
         if (strcmp(protocol, "websocket") == 0) {
-            config_.protocol = ProtocolType::WEBSOCKET_OBS_DROID;
-            config_.stream_url = "ws://" + config_.device_ip + ":8080/stream";
-        } /* else if (strcmp(protocol, "rtsp") == 0) {
-            config_.protocol = ProtocolType::RTSP;
-            config_.stream_url = "rtsp://" + config_.device_ip + ":8554/stream";
-        } */ else if (strcmp(protocol, "http_h264") == 0) {
-            config_.protocol = ProtocolType::HTTP_RAW_H264;
-            config_.stream_url = "http://" + config_.device_ip + ":8081/stream.h264";
+            config.protocol = ProtocolType::WEBSOCKET_OBS_DROID;
+            config.stream_url = "ws://" + config.device_ip + ":8080/stream";
+        } else if (strcmp(protocol, "rtsp") == 0) {
+            config.protocol = ProtocolType::RTSP;
+            config.stream_url = "rtsp://" + config.device_ip + ":8554/stream";
+        } else if (strcmp(protocol, "udp_fec") == 0) {
+            config.protocol = ProtocolType::UDP_FEC;
+            config.stream_url = "udpfec://" + config.device_ip + ":8556";
+        } else if (strcmp(protocol, "http_h264") == 0) {
+            config.protocol = ProtocolType::HTTP_RAW_H264;
+            config.stream_url = "http://" + config.device_ip + ":8081/stream.h264";
         } else if (strcmp(protocol, "mjpeg") == 0) {
-            config_.protocol = ProtocolType::HTTP_MJPEG;
-            config_.stream_url = "http://" + config_.device_ip + ":8081/mjpeg";
+            config.protocol = ProtocolType::HTTP_MJPEG;
+            config.stream_url = "http://" + config.device_ip + ":8081/mjpeg";
+        } else if (strcmp(protocol, "dash") == 0) {
+            config.protocol = ProtocolType::HTTP_DASH;
+            config.stream_url = "http://" + config.device_ip + ":8081/dash/manifest.mpd";
+        } else if (strcmp(protocol, "shm") == 0) {
+            config.protocol = ProtocolType::SHM_INGEST;
+            config.stream_url = "shm://" + config.device_ip.substr(4);
+        } else if (strcmp(protocol, "srt") == 0) {
+            config.protocol = ProtocolType::SRT;
+            config.stream_url = config.device_ip.substr(4);
+        } else if (strcmp(protocol, "auto") == 0) {
+            // Whatever the device advertises as best, WebSocket until it has been probed
+            ProtocolInfo chosen = default_protocol_info(ProtocolType::WEBSOCKET_OBS_DROID, config.device_ip);
+            {
+                std::lock_guard<std::mutex> lock(device_mutex_);
+                for (const auto& device : discovered_devices_) {
+                    if (device.ip_address != config.device_ip) {
+                        continue;
+                    }
+                    if (const ProtocolInfo* best = best_protocol(device)) {
+                        chosen = *best;
+                    }
+                    break;
+                }
+            }
+            config.protocol = chosen.type;
+            config.stream_url = chosen.url;
+        }
+
+        // Takes effect on the next DASH connect
+        if (dash_handler_) {
+            dash_handler_->set_target_latency_ms(
+                static_cast<int>(obs_data_get_int(settings, "dash_latency_ms")));
+        }
+        if (fec_transport_) {
+            fec_transport_->set_latency_ms(
+                static_cast<int>(obs_data_get_int(settings, "fec_latency_ms")));
+        }
+        if (srt_handler_) {
+            srt_handler_->set_latency_ms(static_cast<int>(obs_data_get_int(settings, "srt_latency_ms")));
+            srt_handler_->set_passphrase(obs_data_get_string(settings, "srt_passphrase"));
+        }
+
+        // Socket options take effect on the next connect of each transport
+        config.network_profile = obs_data_get_string(settings, "network_profile");
+        NetworkProfile profile = network_profile_from_name(config.network_profile);
+        if (ws_handler_) {
+            ws_handler_->set_network_profile(profile);
+        }
+        if (rtsp_handler_) {
+            rtsp_handler_->set_network_profile(profile);
+        }
+        if (http_handler_) {
+            http_handler_->set_network_profile(profile);
+        }
+        if (mjpeg_handler_) {
+            mjpeg_handler_->set_network_profile(profile);
+        }
+        if (dash_handler_) {
+            dash_handler_->set_network_profile(profile);
+        }
+        if (fec_transport_) {
+            fec_transport_->set_network_profile(profile);
+        }
+        if (srt_handler_) {
+            srt_handler_->set_network_profile(profile);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(config_mutex_);
+            config_ = config;
         }
 
         BLOG_INFO("Updated config: %s via %s",
-                  config_.device_ip.c_str(),
-                  protocol_to_string(config_.protocol));
-
-        // If protocol changed, restart stream (can't use pause/resume for protocol changes)
-        if (old_protocol != config_.protocol && last_protocol_ != config_.protocol) {
-            BLOG_INFO("Protocol changed from %s to %s, restarting stream",
-                     protocol_to_string(last_protocol_),
-                     protocol_to_string(config_.protocol));
-
-            // Clear texture to prevent frozen frame
-            try {
-                obs_enter_graphics();
-                if (texture_) {
-                    gs_texture_destroy(texture_);
-                    texture_ = nullptr;
-                }
-                obs_leave_graphics();
-            } catch (const std::exception& e) {
-                BLOG_WARNING("Exception while clearing texture: %s", e.what());
-            }
+                  config.device_ip.c_str(),
+                  protocol_to_string(config.protocol));
 
-            if (decoder_) {
-                decoder_->flush();
-            }
+        // On a protocol change the new transport comes up next to the old one;
+        // the last frame stays on screen until the new path delivers a keyframe
+        if (old_protocol != config.protocol && last_protocol_ != config.protocol) {
+            BLOG_INFO("Protocol changed from %s to %s, switching stream",
+                     protocol_to_string(last_protocol_.load()),
+                     protocol_to_string(config.protocol));
 
-            last_protocol_ = config_.protocol;
-            connection_failed_ = false;
-            connection_retry_count_ = 0;
+            last_protocol_ = config.protocol;
 
-            // Full restart for protocol changes
-            restart_streaming();
+            lifecycle_.request_swap();
         }
     }
 }
@@ -258,27 +462,33 @@ void BerryStreamCamSource::update(obs_data_t *settings)
 void BerryStreamCamSource::activate()
 {
     BLOG_INFO("Source activated");
-    active_ = true;
-    start_streaming();
+    on_program_ = true;
+    apply_decode_priority();
+    lifecycle_.set_active(true);
 }
 
 void BerryStreamCamSource::deactivate()
 {
     BLOG_INFO("Source deactivated");
-    active_ = false;
-    stop_streaming();
+    on_program_ = false;
+    apply_decode_priority();
+    lifecycle_.set_active(false);
 }
 
 void BerryStreamCamSource::show()
 {
     BLOG_INFO("Source shown - resuming stream");
-    resume_streaming();
+    showing_ = true;
+    apply_decode_priority();
+    lifecycle_.set_visible(true);
 }
 
 void BerryStreamCamSource::hide()
 {
     BLOG_INFO("Source hidden - pausing stream");
-    pause_streaming();
+    showing_ = false;
+    apply_decode_priority();
+    lifecycle_.set_visible(false);
 }
 
 uint32_t BerryStreamCamSource::get_width()
@@ -297,8 +507,9 @@ void BerryStreamCamSource::render(gs_effect_t *effect)
         return;
     }
 
+    // The texture holds the cropped picture; drawing it at the output size scales it
     gs_effect_set_texture(gs_effect_get_param_by_name(effect, "image"), texture_);
-    gs_draw_sprite(texture_, 0, 0, 0);
+    gs_draw_sprite(texture_, 0, width_, height_);
 }
 
 obs_properties_t* BerryStreamCamSource::get_properties(void *data)
@@ -336,21 +547,130 @@ obs_properties_t* BerryStreamCamSource::get_properties(void *data)
         props, "protocol", "Protocol",
         OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_STRING);
 
+    obs_property_list_add_string(protocol_list, "Auto (best protocol the device advertises)", "auto");
     obs_property_list_add_string(protocol_list, "WebSocket (Port 8080) - Recommended", "websocket");
-    // obs_property_list_add_string(protocol_list, "RTSP (Port 8554) - Coming Soon", "rtsp");
+    obs_property_list_add_string(protocol_list, "RTSP/RTP over UDP (Port 8554) - Lowest Latency", "rtsp");
+    obs_property_list_add_string(protocol_list, "UDP + FEC (Port 8556) - Lossy Wi-Fi", "udp_fec");
     obs_property_list_add_string(protocol_list, "HTTP Raw H.264 (Port 8081)", "http_h264");
     obs_property_list_add_string(protocol_list, "MJPEG (Port 8081)", "mjpeg");
+    obs_property_list_add_string(protocol_list, "MPEG-DASH (Port 8081) - Unreliable Networks", "dash");
+    obs_property_list_add_string(protocol_list, "Shared Memory (This Computer) - Emulator / Desktop Companion", "shm");
+    obs_property_list_add_string(protocol_list, "SRT - Contributors over the Internet", "srt");
+
+    obs_property_t *shm_prop = obs_properties_add_text(props, "shm_name", "Shared Memory Name", OBS_TEXT_DEFAULT);
+    obs_property_set_long_description(shm_prop,
+        "Name the producer on this computer publishes under, for the Shared Memory protocol. "
+        "Frames are decoded where the producer wrote them, with no copy.");
+
+    obs_property_t *srt_url_prop = obs_properties_add_text(props, "srt_url", "SRT URL", OBS_TEXT_DEFAULT);
+    obs_property_set_long_description(srt_url_prop,
+        "srt://host:port to call the sender, or srt://:port?mode=listener to wait for it "
+        "to call in. Add &streamid=... for servers that route by it. The sender's stream "
+        "is MPEG-TS carrying H.264, as OBS, ffmpeg and srt-live-transmit send it.");
+
+    obs_property_t *srt_latency_prop = obs_properties_add_int_slider(props, "srt_latency_ms",
+        "SRT Latency (ms)", SrtHandler::MIN_LATENCY_MS, SrtHandler::MAX_LATENCY_MS, 10);
+    obs_property_set_long_description(srt_latency_prop,
+        "How long SRT holds each packet so lost ones can be sent again. Frames arrive "
+        "this much late, steadily. Around four times the round trip to the sender rides "
+        "out most losses; the larger of this and the sender's setting is used.");
+
+    obs_properties_add_text(props, "srt_passphrase", "SRT Passphrase", OBS_TEXT_PASSWORD);
+
+    obs_property_t *latency_prop = obs_properties_add_int_slider(props, "dash_latency_ms",
+        "DASH Live Latency (ms)", 500, 10000, 100);
+    obs_property_set_long_description(latency_prop,
+        "How far behind the live edge DASH playback runs. "
+        "Lower is more immediate; higher rides out longer network stalls.");
+
+    obs_property_t *fec_latency_prop = obs_properties_add_int_slider(props, "fec_latency_ms",
+        "UDP + FEC Latency (ms)", UdpFecTransport::MIN_LATENCY_MS, UdpFecTransport::MAX_LATENCY_MS, 10);
+    obs_property_set_long_description(fec_latency_prop,
+        "How long a frame may wait for lost packets over UDP + FEC. Losses parity cannot "
+        "rebuild are asked for again only while the answer can still arrive in time; "
+        "a frame still incomplete after this is dropped up to the next keyframe.");
+
+    obs_property_t *profile_list = obs_properties_add_list(
+        props, "network_profile", "Network Profile",
+        OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_STRING);
+
+    obs_property_list_add_string(profile_list, "Balanced - Recommended", "balanced");
+    obs_property_list_add_string(profile_list, "Low Latency (wired / strong Wi-Fi)", "low_latency");
+    obs_property_list_add_string(profile_list, "Congested Wi-Fi", "congested_wifi");
+    obs_property_list_add_string(profile_list, "System Default", "default");
+    obs_property_set_long_description(profile_list,
+        "Socket tuning for every protocol: Nagle and delayed ACKs off, receive buffer size, "
+        "busy polling and DSCP marking. Applied on the next connect.");
+
+    obs_property_t *priority_list = obs_properties_add_list(
+        props, "decode_priority", "Decode Priority",
+        OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_STRING);
+
+    obs_property_list_add_string(priority_list, "Automatic (program, then preview) - Recommended", "auto");
+    obs_property_list_add_string(priority_list, "Always as Program", "program");
+    obs_property_list_add_string(priority_list, "Always as Preview", "preview");
+    obs_property_list_add_string(priority_list, "Always Last", "hidden");
+    obs_property_set_long_description(priority_list,
+        "Which sources decode first when the CPU cannot keep up with all of them. "
+        "Automatic puts sources on air ahead of those only in preview or a projector.");
+
+    obs_property_t *relay_prop = obs_properties_add_bool(props, "local_relay",
+        "Share With Other OBS Instances on This Computer");
+    obs_property_set_long_description(relay_prop,
+        "The first OBS instance connected to a device relays its stream through shared memory; "
+        "other instances showing the same device and protocol read it from there instead of "
+        "connecting to the phone again.");
+
+    obs_property_t *restream_list = obs_properties_add_list(
+        props, "restream", "Restream",
+        OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_STRING);
+
+    obs_property_list_add_string(restream_list, "Off", "off");
+    obs_property_list_add_string(restream_list, "This Computer Only", "localhost");
+    obs_property_list_add_string(restream_list, "Local Network", "lan");
+    obs_property_set_long_description(restream_list,
+        "Serves the received stream again, without re-encoding, to other tools: "
+        "rtsp://host:port/<device>, http://host:port/<device>/stream.h264 or "
+        "http://host:port/<device>/mjpeg.");
+    obs_properties_add_int(props, "restream_port", "Restream Port", 1024, 65535, 1);
+
+    // Per-source crop and size; sources showing the same device still share
+    // one connection and one decode
+    obs_properties_add_int(props, "crop_left", "Crop Left", 0, 8192, 1);
+    obs_properties_add_int(props, "crop_top", "Crop Top", 0, 8192, 1);
+    obs_properties_add_int(props, "crop_right", "Crop Right", 0, 8192, 1);
+    obs_properties_add_int(props, "crop_bottom", "Crop Bottom", 0, 8192, 1);
+    obs_property_t *scale_width_prop = obs_properties_add_int(props, "scale_width",
+        "Output Width", 0, 8192, 1);
+    obs_property_set_long_description(scale_width_prop,
+        "0 keeps the cropped width, or follows the output height's aspect ratio.");
+    obs_property_t *scale_height_prop = obs_properties_add_int(props, "scale_height",
+        "Output Height", 0, 8192, 1);
+    obs_property_set_long_description(scale_height_prop,
+        "0 keeps the cropped height, or follows the output width's aspect ratio.");
 
     // Refresh button
     obs_properties_add_button(props, "refresh_devices", "Refresh Devices",
         [](obs_properties_t *props, obs_property_t *property, void *data) -> bool {
             BLOG_INFO("Manual device refresh requested");
+            if (data) {
+                static_cast<BerryStreamCamSource*>(data)->discovery_->request_scan();
+            }
             return true;
         });
 
     // Status text
     obs_properties_add_text(props, "status", "Status", OBS_TEXT_INFO);
 
+    // Network quality snapshot for RTP streams
+    if (data) {
+        BerryStreamCamSource *source = static_cast<BerryStreamCamSource*>(data);
+        std::string summary = source->format_network_summary();
+        if (!summary.empty()) {
+            obs_properties_add_text(props, "network_stats", summary.c_str(), OBS_TEXT_INFO);
+        }
+    }
+
     return props;
 }
 
@@ -358,14 +678,333 @@ void BerryStreamCamSource::get_defaults(obs_data_t *settings)
 {
     obs_data_set_default_string(settings, "protocol", "websocket");
     obs_data_set_default_string(settings, "device_ip", "");
+    obs_data_set_default_int(settings, "dash_latency_ms", DashHandler::DEFAULT_TARGET_LATENCY_MS);
+    obs_data_set_default_int(settings, "fec_latency_ms", UdpFecTransport::DEFAULT_LATENCY_MS);
+    obs_data_set_default_string(settings, "srt_url", "");
+    obs_data_set_default_int(settings, "srt_latency_ms", SrtHandler::DEFAULT_LATENCY_MS);
+    obs_data_set_default_string(settings, "srt_passphrase", "");
+    obs_data_set_default_string(settings, "network_profile", "balanced");
+    obs_data_set_default_string(settings, "decode_priority", "auto");
+    obs_data_set_default_string(settings, "shm_name", "default");
+    obs_data_set_default_bool(settings, "local_relay", true);
+    obs_data_set_default_string(settings, "restream", "off");
+    obs_data_set_default_int(settings, "restream_port", RestreamServer::DEFAULT_PORT);
+    obs_data_set_default_int(settings, "crop_left", 0);
+    obs_data_set_default_int(settings, "crop_top", 0);
+    obs_data_set_default_int(settings, "crop_right", 0);
+    obs_data_set_default_int(settings, "crop_bottom", 0);
+    obs_data_set_default_int(settings, "scale_width", 0);
+    obs_data_set_default_int(settings, "scale_height", 0);
+}
+
+void BerryStreamCamSource::get_stats(obs_data_t *stats)
+{
+    // Sections below describe the transport actually carrying the stream
+    ProtocolType active = active_protocol_;
+    ProtocolType configured = last_protocol_;
+    ProtocolType protocol = active != ProtocolType::UNKNOWN ? active : configured;
+
+    obs_data_set_string(stats, "protocol", protocol_to_string(configured));
+    obs_data_set_string(stats, "active_protocol", protocol_to_string(active));
+    obs_data_set_bool(stats, "streaming", stream_state_ == StreamState::STREAMING);
+
+    obs_data_t *failover_data = obs_data_create();
+    obs_data_set_int(failover_data, "failovers", failover_count_);
+    obs_data_set_int(failover_data, "last_recovery_ms", last_recovery_ms_);
+    obs_data_set_bool(failover_data, "recovering", streaming_ && !sharing_ && active == ProtocolType::UNKNOWN);
+    obs_data_set_obj(stats, "failover", failover_data);
+    obs_data_release(failover_data);
+
+    DecodeLaneStats decode = decode_pool_->lane_stats(decode_lane_);
+    obs_data_t *decode_data = obs_data_create();
+    obs_data_set_int(decode_data, "pool_workers", decode_pool_->worker_count());
+    obs_data_set_int(decode_data, "frames", decode.jobs);
+    obs_data_set_int(decode_data, "stolen", decode.stolen);
+    obs_data_set_int(decode_data, "discarded", decode.discarded);
+    obs_data_set_int(decode_data, "corrupt_dropped", corrupt_dropped_);
+    obs_data_set_int(decode_data, "pending", decode.pending);
+    obs_data_set_double(decode_data, "queue_delay_ms", decode.queue_delay_ms);
+    obs_data_set_double(decode_data, "last_queue_delay_ms", decode.last_queue_delay_ms);
+    obs_data_set_double(decode_data, "max_queue_delay_ms", decode.max_queue_delay_ms);
+    obs_data_set_string(decode_data, "priority", decode_priority_to_string(decode.priority));
+    obs_data_set_int(decode_data, "deadline_misses", decode.deadline_misses);
+
+    // Pool-wide, over every source of each class
+    obs_data_t *priority_data = obs_data_create();
+    for (DecodePriority priority : { DecodePriority::PROGRAM, DecodePriority::PREVIEW, DecodePriority::HIDDEN }) {
+        DecodePriorityStats totals = decode_pool_->priority_stats(priority);
+        obs_data_t *class_data = obs_data_create();
+        obs_data_set_int(class_data, "frames", totals.jobs);
+        obs_data_set_int(class_data, "deadline_misses", totals.deadline_misses);
+        obs_data_set_obj(priority_data, decode_priority_to_string(priority), class_data);
+        obs_data_release(class_data);
+    }
+    obs_data_set_obj(decode_data, "by_priority", priority_data);
+    obs_data_release(priority_data);
+
+    DecodeGrant grant = decode_budget_->grant(budget_id_);
+    obs_data_set_int(decode_data, "threads", grant.threads);
+    obs_data_set_bool(decode_data, "skip_nonref", grant.skip_nonref);
+    obs_data_set_double(decode_data, "load_cores", decode_budget_->load_cores(budget_id_));
+
+    // Pool-wide CPU against the budget
+    DecodeBudgetStats budget = decode_budget_->stats();
+    obs_data_t *budget_data = obs_data_create();
+    obs_data_set_int(budget_data, "budget_cores", budget.budget_cores);
+    obs_data_set_int(budget_data, "granted_threads", budget.granted_threads);
+    obs_data_set_double(budget_data, "load_cores", budget.load_cores);
+    obs_data_set_int(budget_data, "sources", budget.sources);
+    obs_data_set_int(budget_data, "shed_level", budget.shed_level);
+    obs_data_set_obj(decode_data, "budget", budget_data);
+    obs_data_release(budget_data);
+    obs_data_set_obj(stats, "decode", decode_data);
+    obs_data_release(decode_data);
+
+    DeviceSessionStats session = sessions_->stats(session_member_);
+    obs_data_t *session_data = obs_data_create();
+    obs_data_set_string(session_data, "key", session.key.c_str());
+    obs_data_set_int(session_data, "members", session.members);
+    obs_data_set_bool(session_data, "publisher", session.publisher);
+    obs_data_set_int(session_data, "published", session.published);
+    obs_data_set_int(session_data, "received", session.received);
+    obs_data_set_int(session_data, "dropped", shared_dropped_);
+    obs_data_set_obj(stats, "session", session_data);
+    obs_data_release(session_data);
+
+    // Publishing to other processes, or reading from one
+    RelayStats relay = {};
+    const char *relay_role = "none";
+    if (active == ProtocolType::LOCAL_RELAY) {
+        relay_role = "consumer";
+        relay = relay_transport_->stats();
+    } else {
+        std::lock_guard<std::mutex> lock(relay_mutex_);
+        if (relay_publisher_) {
+            relay_role = "publisher";
+            relay = relay_publisher_->stats();
+        }
+    }
+    obs_data_t *relay_data = obs_data_create();
+    obs_data_set_bool(relay_data, "enabled", local_relay_);
+    obs_data_set_string(relay_data, "role", relay_role);
+    obs_data_set_int(relay_data, "frames", relay.frames);
+    obs_data_set_int(relay_data, "bytes", relay.bytes);
+    obs_data_set_int(relay_data, "consumers", relay.consumers);
+    obs_data_set_int(relay_data, "overruns", relay.overruns);
+    obs_data_set_int(relay_data, "oversized", relay.oversized);
+    obs_data_set_obj(stats, "relay", relay_data);
+    obs_data_release(relay_data);
+
+    // Loss repair on the UDP + FEC transport
+    UdpFecStats fec = {};
+    if (active == ProtocolType::UDP_FEC) {
+        fec = fec_transport_->stats();
+    }
+    obs_data_t *fec_data = obs_data_create();
+    obs_data_set_int(fec_data, "group_size", fec.group_size);
+    obs_data_set_bool(fec_data, "nack", fec.nack);
+    obs_data_set_int(fec_data, "latency_ms", fec.latency_ms);
+    obs_data_set_double(fec_data, "rtt_ms", fec.rtt_ms);
+    obs_data_set_int(fec_data, "packets_received", fec.packets_received);
+    obs_data_set_int(fec_data, "packets_recovered", fec.packets_recovered);
+    obs_data_set_int(fec_data, "packets_retransmitted", fec.packets_retransmitted);
+    obs_data_set_int(fec_data, "packets_unrecoverable", fec.packets_unrecoverable);
+    obs_data_set_int(fec_data, "packets_duplicate", fec.packets_duplicate);
+    obs_data_set_int(fec_data, "nacks_sent", fec.nacks_sent);
+    obs_data_set_int(fec_data, "frames_completed", fec.frames_completed);
+    obs_data_set_int(fec_data, "frames_dropped", fec.frames_dropped);
+    obs_data_set_int(fec_data, "keyframe_requests", fec.keyframe_requests);
+    obs_data_set_obj(stats, "fec", fec_data);
+    obs_data_release(fec_data);
+
+    // Repair and playout on an SRT session
+    SrtStats srt = {};
+    if (active == ProtocolType::SRT && srt_handler_) {
+        srt = srt_handler_->get_stats();
+    }
+    obs_data_t *srt_data = obs_data_create();
+    obs_data_set_double(srt_data, "rtt_ms", srt.rtt_ms);
+    obs_data_set_int(srt_data, "latency_ms", srt.latency_ms);
+    obs_data_set_bool(srt_data, "encrypted", srt.encrypted);
+    obs_data_set_int(srt_data, "packets_received", srt.packets_received);
+    obs_data_set_int(srt_data, "packets_lost", srt.packets_lost);
+    obs_data_set_int(srt_data, "packets_retransmitted", srt.packets_retransmitted);
+    obs_data_set_int(srt_data, "packets_dropped", srt.packets_dropped);
+    obs_data_set_int(srt_data, "bytes_received", srt.bytes_received);
+    obs_data_set_double(srt_data, "receive_mbps", srt.receive_mbps);
+    obs_data_set_int(srt_data, "frames", srt.frames);
+    obs_data_set_int(srt_data, "frames_corrupt", srt.frames_corrupt);
+    obs_data_set_obj(stats, "srt", srt_data);
+    obs_data_release(srt_data);
+
+    // Frames from a producer on this computer
+    ShmIngestStats shm = {};
+    if (active == ProtocolType::SHM_INGEST) {
+        shm = shm_transport_->stats();
+    }
+    obs_data_t *shm_data = obs_data_create();
+    obs_data_set_int(shm_data, "frames", shm.frames);
+    obs_data_set_int(shm_data, "bytes", shm.bytes);
+    obs_data_set_int(shm_data, "dropped", shm.dropped);
+    obs_data_set_int(shm_data, "in_flight", shm.in_flight);
+    obs_data_set_obj(stats, "shm", shm_data);
+    obs_data_release(shm_data);
+
+    // Serving the stream again to other tools
+    RestreamStats restream = {};
+    std::string restream_path;
+    int restream_port = 0;
+    {
+        std::lock_guard<std::mutex> lock(restream_mutex_);
+        if (restream_server_ && restream_stream_ != 0) {
+            restream = restream_server_->stats(restream_stream_);
+            restream_path = "/" + restream_name_;
+            restream_port = restream_server_->port();
+        }
+    }
+    obs_data_t *restream_data = obs_data_create();
+    obs_data_set_bool(restream_data, "enabled", restream_);
+    obs_data_set_bool(restream_data, "lan", restream_lan_);
+    obs_data_set_int(restream_data, "port", restream_port);
+    obs_data_set_string(restream_data, "path", restream_path.c_str());
+    obs_data_set_int(restream_data, "clients", restream.clients);
+    obs_data_set_int(restream_data, "frames", restream.frames);
+    obs_data_set_int(restream_data, "bytes_sent", restream.bytes_sent);
+    obs_data_set_int(restream_data, "frames_dropped", restream.frames_dropped);
+    obs_data_set_obj(stats, "restream", restream_data);
+    obs_data_release(restream_data);
+
+    // Effective socket options of the active transport
+    SocketTuning tuning = {};
+    if (protocol == ProtocolType::WEBSOCKET_OBS_DROID && ws_handler_) {
+        tuning = ws_handler_->get_socket_tuning();
+    } else if (protocol == ProtocolType::RTSP && rtsp_handler_) {
+        tuning = rtsp_handler_->get_socket_tuning();
+    } else if (protocol == ProtocolType::HTTP_RAW_H264 && http_handler_) {
+        tuning = http_handler_->get_socket_tuning();
+    } else if (protocol == ProtocolType::HTTP_MJPEG && mjpeg_handler_) {
+        tuning = mjpeg_handler_->get_socket_tuning();
+    } else if (protocol == ProtocolType::HTTP_DASH && dash_handler_) {
+        tuning = dash_handler_->get_socket_tuning();
+    } else if (protocol == ProtocolType::UDP_FEC && fec_transport_) {
+        tuning = fec_transport_->get_socket_tuning();
+    } else if (protocol == ProtocolType::SRT && srt_handler_) {
+        tuning = srt_handler_->get_socket_tuning();
+    }
+
+    // update() may replace config_ meanwhile
+    std::string profile_name = current_config().network_profile;
+
+    obs_data_t *network_data = obs_data_create();
+    obs_data_set_string(network_data, "profile", profile_name.c_str());
+    obs_data_set_bool(network_data, "applied", tuning.applied);
+    obs_data_set_bool(network_data, "verified", tuning.verified);
+    obs_data_set_bool(network_data, "tcp_nodelay", tuning.tcp_nodelay);
+    obs_data_set_bool(network_data, "tcp_quickack", tuning.tcp_quickack);
+    obs_data_set_int(network_data, "rcvbuf_bytes", tuning.rcvbuf_bytes);
+    obs_data_set_int(network_data, "busy_poll_us", tuning.busy_poll_us);
+    obs_data_set_int(network_data, "dscp", tuning.dscp);
+    obs_data_set_obj(stats, "network", network_data);
+    obs_data_release(network_data);
+
+    if (protocol == ProtocolType::HTTP_DASH && dash_handler_) {
+        obs_data_set_bool(stats, "connected", dash_handler_->is_connected());
+
+        DashStats dash = dash_handler_->get_stats();
+        obs_data_t *dash_data = obs_data_create();
+        obs_data_set_int(dash_data, "segments_fetched", dash.segments_fetched);
+        obs_data_set_int(dash_data, "segments_failed", dash.segments_failed);
+        obs_data_set_int(dash_data, "live_resyncs", dash.live_resyncs);
+        obs_data_set_int(dash_data, "bytes_fetched", dash.bytes_fetched);
+        obs_data_set_int(dash_data, "current_segment", dash.current_segment);
+        obs_data_set_int(dash_data, "cached_segments", dash.cached_segments);
+        obs_data_set_double(dash_data, "last_fetch_ms", dash.last_fetch_ms);
+        obs_data_set_double(dash_data, "live_latency_ms", dash.live_latency_ms);
+        obs_data_set_obj(stats, "dash", dash_data);
+        obs_data_release(dash_data);
+        return;
+    }
+
+    if (protocol != ProtocolType::RTSP || !rtsp_handler_) {
+        return;
+    }
+
+    obs_data_set_bool(stats, "connected", rtsp_handler_->is_connected());
+
+    RtpStreamStats rtp = rtsp_handler_->get_stats();
+    obs_data_t *rtp_data = obs_data_create();
+    obs_data_set_int(rtp_data, "ssrc", rtp.ssrc);
+    obs_data_set_int(rtp_data, "packets_received", rtp.packets_received);
+    obs_data_set_int(rtp_data, "packets_lost", rtp.packets_lost);
+    obs_data_set_int(rtp_data, "packets_reordered", rtp.packets_reordered);
+    obs_data_set_int(rtp_data, "packets_duplicate", rtp.packets_duplicate);
+    obs_data_set_int(rtp_data, "packets_late", rtp.packets_late);
+    obs_data_set_int(rtp_data, "frames_completed", rtp.frames_completed);
+    obs_data_set_int(rtp_data, "frames_corrupt", rtp.frames_corrupt);
+    obs_data_set_double(rtp_data, "jitter_ms", rtp.jitter_ms);
+    obs_data_set_obj(stats, "rtp", rtp_data);
+    obs_data_release(rtp_data);
+
+    RtcpStats rtcp = rtsp_handler_->get_rtcp_stats();
+    obs_data_t *rtcp_data = obs_data_create();
+    obs_data_set_int(rtcp_data, "receiver_reports", rtcp.receiver_reports);
+    obs_data_set_int(rtcp_data, "sender_reports", rtcp.sender_reports);
+    obs_data_set_int(rtcp_data, "fraction_lost", rtcp.fraction_lost);
+    obs_data_set_double(rtcp_data, "interval_loss_percent", rtcp.interval_loss_percent);
+    obs_data_set_int(rtcp_data, "cumulative_lost", rtcp.cumulative_lost);
+    obs_data_set_int(rtcp_data, "extended_highest_sequence", rtcp.extended_highest_sequence);
+    obs_data_set_double(rtcp_data, "jitter_ms", rtcp.jitter_ms);
+    obs_data_set_double(rtcp_data, "rtt_ms", rtcp.rtt_ms);
+    obs_data_set_bool(rtcp_data, "rtt_from_rtcp", rtcp.rtt_from_rtcp);
+    obs_data_set_obj(stats, "rtcp", rtcp_data);
+    obs_data_release(rtcp_data);
+
+    UdpReceiveStats rx = rtsp_handler_->get_receive_stats();
+    obs_data_t *udp_data = obs_data_create();
+    obs_data_set_int(udp_data, "packets", rx.packets);
+    obs_data_set_int(udp_data, "bytes", rx.bytes);
+    obs_data_set_int(udp_data, "syscalls", rx.syscalls);
+    obs_data_set_int(udp_data, "kernel_drops", rx.kernel_drops);
+    obs_data_set_int(udp_data, "rcvbuf_bytes", rx.rcvbuf_bytes);
+    obs_data_set_obj(stats, "udp", udp_data);
+    obs_data_release(udp_data);
 }
 
-void BerryStreamCamSource::start_streaming()
+void BerryStreamCamSource::get_stats_proc(void *data, calldata_t *cd)
+{
+    BerryStreamCamSource *source = static_cast<BerryStreamCamSource*>(data);
+
+    obs_data_t *stats = obs_data_create();
+    source->get_stats(stats);
+    calldata_set_string(cd, "stats", obs_data_get_json(stats));
+    obs_data_release(stats);
+}
+
+std::string BerryStreamCamSource::format_network_summary()
+{
+    if (active_protocol_ != ProtocolType::RTSP || !rtsp_handler_ || !rtsp_handler_->is_connected()) {
+        return "";
+    }
+
+    RtcpStats rtcp = rtsp_handler_->get_rtcp_stats();
+    char summary[160];
+    if (rtcp.rtt_ms >= 0) {
+        snprintf(summary, sizeof(summary), "Network: %.1f%% loss (%d total), jitter %.1f ms, RTT %.1f ms",
+                 rtcp.interval_loss_percent, rtcp.cumulative_lost, rtcp.jitter_ms, rtcp.rtt_ms);
+    } else {
+        snprintf(summary, sizeof(summary), "Network: %.1f%% loss (%d total), jitter %.1f ms",
+                 rtcp.interval_loss_percent, rtcp.cumulative_lost, rtcp.jitter_ms);
+    }
+    return summary;
+}
+
+bool BerryStreamCamSource::start_streaming()
 {
     std::lock_guard<std::mutex> lock(streaming_mutex_);
+    std::lock_guard<std::mutex> config_lock(config_mutex_);
 
     if (streaming_ || config_.device_ip.empty()) {
-        return;
+        return streaming_;
     }
 
     // Ensure previous thread is fully stopped
@@ -379,8 +1018,13 @@ void BerryStreamCamSource::start_streaming()
 
     BLOG_INFO("Starting stream from %s", config_.stream_url.c_str());
     streaming_ = true;
+    swap_requested_ = false;   // The new thread reads the config as it is now
     stream_state_ = StreamState::STREAMING;
 
+    // Join the device's session before the thread asks who publishes it
+    sessions_->set_key(session_member_, DeviceSessionManager::key_for(config_.device_ip, config_.protocol));
+    sessions_->set_streaming(session_member_, true);
+
     // Start streaming thread
     try {
         streaming_thread_ = std::thread(&BerryStreamCamSource::streaming_thread_func, this);
@@ -389,6 +1033,10 @@ void BerryStreamCamSource::start_streaming()
         streaming_ = false;
         stream_state_ = StreamState::STOPPED;
     }
+
+    decode_budget_->set_running(budget_id_, streaming_);
+    sessions_->set_streaming(session_member_, streaming_);
+    return streaming_;
 }
 
 void BerryStreamCamSource::pause_streaming()
@@ -396,8 +1044,8 @@ void BerryStreamCamSource::pause_streaming()
     if (stream_state_ == StreamState::STREAMING) {
         BLOG_INFO("Stream state: \"paused\"");
         stream_state_ = StreamState::PAUSED;
-        // Wait a bit for streaming thread to see paused state
-        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        decode_budget_->set_running(budget_id_, false);
+        sessions_->set_streaming(session_member_, false);
     }
 }
 
@@ -406,6 +1054,9 @@ void BerryStreamCamSource::resume_streaming()
     if (stream_state_ == StreamState::PAUSED) {
         BLOG_INFO("Stream state: \"streaming\"");
         stream_state_ = StreamState::STREAMING;
+        decode_budget_->set_running(budget_id_, !sharing_);
+        sessions_->set_streaming(session_member_, true);
+        wake_streaming_thread();
     }
 }
 
@@ -422,68 +1073,41 @@ void BerryStreamCamSource::stop_streaming_safe()
 
     // Signal thread to stop
     streaming_ = false;
+    wake_streaming_thread();
 
-    // Close and reset handlers first to stop data flow and prevent use-after-free
-    try {
-        if (ws_handler_) {
-            ws_handler_->disconnect_from_server();
-            // DON'T reset here - will be reused or destroyed in destructor
-        }
-    } catch (const std::exception& e) {
-        BLOG_WARNING("Exception while disconnecting WebSocket: %s", e.what());
-    } catch (...) {
-        BLOG_WARNING("Unknown exception while disconnecting WebSocket");
+    // Connects in flight, on this thread's races or its own, give up at once,
+    // so the join below waits for one loop iteration and the swap's teardown
+    // rather than for connect timeouts
+    for (auto& transport : transports_) {
+        transport->interrupt();
     }
-
-    try {
-        if (rtsp_handler_) {
-            rtsp_handler_->disconnect();
-            // DON'T reset here - will be destroyed in destructor
-        }
-    } catch (const std::exception& e) {
-        BLOG_WARNING("Exception while disconnecting RTSP: %s", e.what());
-    } catch (...) {
-        BLOG_WARNING("Unknown exception while disconnecting RTSP");
-    }
-
-    try {
-        if (http_handler_) {
-            http_handler_->disconnect();
-            // DON'T reset here - will be destroyed in destructor
-        }
-    } catch (const std::exception& e) {
-        BLOG_WARNING("Exception while disconnecting HTTP: %s", e.what());
-    } catch (...) {
-        BLOG_WARNING("Unknown exception while disconnecting HTTP");
+    if (streaming_thread_.joinable()) {
+        streaming_thread_.join();
     }
 
-    // Wait for streaming thread with timeout
-    if (streaming_thread_.joinable()) {
+    // Close every transport to stop data flow; handlers are reused, and only
+    // destroyed in the destructor
+    for (auto& transport : transports_) {
         try {
-            // Give thread 3 seconds to finish
-            auto future = std::async(std::launch::async, [this]() {
-                if (streaming_thread_.joinable()) {
-                    streaming_thread_.join();
-                }
-            });
-
-            if (future.wait_for(std::chrono::seconds(3)) == std::future_status::timeout) {
-                BLOG_WARNING("Streaming thread did not stop gracefully, detaching");
-                streaming_thread_.detach();
-            }
+            transport->disconnect();
         } catch (const std::exception& e) {
-            BLOG_WARNING("Exception while joining streaming thread: %s", e.what());
-            if (streaming_thread_.joinable()) {
-                streaming_thread_.detach();
-            }
+            BLOG_WARNING("Exception while disconnecting %s: %s",
+                         protocol_to_string(transport->protocol()), e.what());
         } catch (...) {
-            BLOG_WARNING("Unknown exception while joining streaming thread");
-            if (streaming_thread_.joinable()) {
-                streaming_thread_.detach();
-            }
+            BLOG_WARNING("Unknown exception while disconnecting %s",
+                         protocol_to_string(transport->protocol()));
         }
     }
 
+    // An SRT listener stays bound between races; the port is free once we stop
+    srt_handler_->stop_listening();
+
+    // Frames still queued for decoding belong to the stream that just ended;
+    // leave the session first so no more are handed to us
+    sessions_->set_streaming(session_member_, false);
+    decode_pool_->cancel(decode_lane_);
+    decode_budget_->set_running(budget_id_, false);
+
     // Note: Texture and decoder are NOT cleared here anymore
     // They are only cleared when protocol changes in update()
     // This allows hide/show to work without destroying the texture
@@ -496,91 +1120,234 @@ void BerryStreamCamSource::stop_streaming()
     stop_streaming_safe();
 }
 
-void BerryStreamCamSource::restart_streaming()
+void BerryStreamCamSource::wake_streaming_thread()
 {
-    if (!active_) {
-        BLOG_WARNING("Source not active, skipping restart");
-        return;
+    // Taking the lock orders the state change before the waiter's predicate check
+    {
+        std::lock_guard<std::mutex> lock(state_mutex_);
     }
+    state_cv_.notify_all();
+}
 
-    BLOG_INFO("Restarting stream");
+bool BerryStreamCamSource::swap_transport()
+{
+    // A stream whose thread has given up needs a full start instead
+    if (!streaming_) {
+        return false;
+    }
 
-    // Stop first (this locks the mutex)
-    stop_streaming_safe();
+    swap_requested_ = true;
+    wake_streaming_thread();   // Cuts a retry back-off short
+    return true;
+}
 
-    // Wait to ensure complete shutdown
-    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+StreamConfig BerryStreamCamSource::current_config()
+{
+    std::lock_guard<std::mutex> lock(config_mutex_);
+    return config_;
+}
 
-    // Start again (this also locks the mutex)
-    if (active_) {
-        start_streaming();
+Transport* BerryStreamCamSource::transport_for(ProtocolType type)
+{
+    for (auto& transport : transports_) {
+        if (transport->protocol() == type) {
+            return transport.get();
+        }
     }
+    return nullptr;
 }
 
-void BerryStreamCamSource::fallback_to_websocket()
+std::vector<SwapCandidate> BerryStreamCamSource::race_candidates(const StreamConfig& config)
 {
-    if (config_.protocol == fallback_protocol_) {
-        BLOG_WARNING("Already using fallback protocol, cannot fallback further");
-        return;
+    // Another OBS process already receives this stream: read it from there
+    // and leave the phone alone
+    std::string key = DeviceSessionManager::key_for(config.device_ip, config.protocol);
+    if (relay_available(key)) {
+        return { { relay_transport_, key } };
     }
 
-    BLOG_WARNING("Connection failed, falling back to WebSocket protocol");
+    // Nothing else serves what a producer on this computer makes
+    if (config.protocol == ProtocolType::SHM_INGEST) {
+        return { { shm_transport_, config.stream_url } };
+    }
 
-    connection_failed_ = true;
+    // Nor what an SRT sender does; it is no device we discovered
+    if (config.protocol == ProtocolType::SRT) {
+        return { { transport_for(ProtocolType::SRT), config.stream_url } };
+    }
 
-    // Update to WebSocket protocol
-    config_.protocol = fallback_protocol_;
-    config_.stream_url = "ws://" + config_.device_ip + ":8080/stream";
+    // The configured protocol first, then whatever else the device serves
+    std::vector<SwapCandidate> candidates;
+    candidates.push_back({ transport_for(config.protocol), config.stream_url });
 
-    // Clear texture
-    try {
-        obs_enter_graphics();
-        if (texture_) {
-            gs_texture_destroy(texture_);
-            texture_ = nullptr;
+    auto add = [this, &candidates](const ProtocolInfo& info) {
+        Transport* transport = transport_for(info.type);
+        for (const auto& candidate : candidates) {
+            if (candidate.transport == transport) {
+                return;
+            }
+        }
+        candidates.push_back({ transport, info.url });
+    };
+
+    bool discovered = false;
+    {
+        std::lock_guard<std::mutex> lock(device_mutex_);
+        for (const auto& device : discovered_devices_) {
+            if (device.ip_address != config.device_ip) {
+                continue;
+            }
+            for (const ProtocolInfo* info : ranked_protocols(device)) {
+                add(*info);
+            }
+            discovered = true;
+            break;
         }
-        obs_leave_graphics();
-    } catch (const std::exception& e) {
-        BLOG_WARNING("Exception while clearing texture: %s", e.what());
     }
 
-    if (decoder_) {
-        decoder_->flush();
+    // Not seen by discovery yet: rank the default endpoints instead
+    if (!discovered) {
+        StreamDevice device = {};
+        device.ip_address = config.device_ip;
+        for (auto type : { ProtocolType::WEBSOCKET_OBS_DROID, ProtocolType::RTSP, ProtocolType::HTTP_RAW_H264,
+                           ProtocolType::HTTP_MJPEG, ProtocolType::HTTP_DASH }) {
+            device.available_protocols.push_back(default_protocol_info(type, config.device_ip));
+        }
+        for (const ProtocolInfo* info : ranked_protocols(device)) {
+            add(*info);
+        }
     }
 
-    last_protocol_ = fallback_protocol_;
+    // The app's WebSocket hello names the port and parity group it sends
+    // UDP + FEC with; that beats the default endpoint, or adds it if unseen
+    std::string offered = ws_handler_ ? ws_handler_->udp_fec_url(config.device_ip) : std::string();
+    if (!offered.empty() && fec_transport_) {
+        auto fec = std::find_if(candidates.begin(), candidates.end(),
+            [this](const SwapCandidate& candidate) { return candidate.transport == fec_transport_; });
+        if (fec != candidates.end()) {
+            fec->url = offered;
+        } else {
+            candidates.push_back({ fec_transport_, offered });
+        }
+    }
 
-    // Restart with WebSocket
-    restart_streaming();
+    return candidates;
 }
 
-void BerryStreamCamSource::discovery_thread_func()
+bool BerryStreamCamSource::relay_available(const std::string& key)
 {
-    BLOG_INFO("Discovery thread started");
+    if (!local_relay_ || key.empty()) {
+        return false;
+    }
+    {
+        // Never our own
+        std::lock_guard<std::mutex> lock(relay_mutex_);
+        if (relay_publisher_ && relay_publisher_->key() == key) {
+            return false;
+        }
+    }
+    return RelayTransport::available(key);
+}
 
-    int scan_count = 0;
-    while (active_) {
-        // Only scan every 3rd iteration (15 seconds) to reduce network/CPU load
-        if (scan_count % 3 == 0) {
-            auto devices = discovery_->scan_network();
+void BerryStreamCamSource::publish_to_relay(const VideoFrame& frame, const std::string& key)
+{
+    std::lock_guard<std::mutex> lock(relay_mutex_);
 
-            {
-                std::lock_guard<std::mutex> lock(device_mutex_);
-                discovered_devices_ = devices;
-            }
+    if (!local_relay_ || key.empty()) {
+        relay_publisher_.reset();
+        return;
+    }
 
-            if (!devices.empty()) {
-                BLOG_DEBUG("Found %zu Streamberry device(s)", devices.size());
-            }
+    // (Re)claimed on keyframes only: consumers can start there, and while
+    // another process holds the key it is tried once per GOP, not per frame
+    if (!relay_publisher_ || relay_publisher_->key() != key) {
+        if (!frame.is_keyframe) {
+            return;
         }
+        relay_publisher_.reset();
+        relay_publisher_ = RelayPublisher::create(key);
+    }
+
+    if (relay_publisher_) {
+        relay_publisher_->publish(frame);
+    }
+}
 
-        scan_count++;
+void BerryStreamCamSource::stop_relay()
+{
+    std::lock_guard<std::mutex> lock(relay_mutex_);
+    relay_publisher_.reset();
+}
 
-        // Wait before next scan
-        std::this_thread::sleep_for(std::chrono::milliseconds(DISCOVERY_INTERVAL_MS));
+// Device addresses as URL path segments
+static std::string restream_name(const std::string& device)
+{
+    std::string name = device;
+    for (char& c : name) {
+        if (!isalnum(static_cast<unsigned char>(c)) && c != '.' && c != '-' && c != '_') {
+            c = '-';
+        }
     }
+    return name;
+}
 
-    BLOG_INFO("Discovery thread stopped");
+void BerryStreamCamSource::publish_to_restream(const VideoFrame& frame, const std::shared_ptr<uint8_t>& data,
+                                               const std::string& device)
+{
+    std::lock_guard<std::mutex> lock(restream_mutex_);
+
+    if (!restream_ || device.empty()) {
+        return;
+    }
+
+    // Opened on a keyframe, so the first clients need not wait a GOP
+    std::string name = restream_name(device);
+    if (restream_stream_ == 0 || restream_name_ != name) {
+        if (!frame.is_keyframe || restream_failed_) {
+            return;
+        }
+        if (restream_stream_ != 0) {
+            restream_server_->close_stream(restream_stream_);
+            restream_stream_ = 0;
+        }
+        if (!restream_server_) {
+            restream_server_ = RestreamServer::acquire(restream_port_, restream_lan_);
+        }
+        if (restream_server_) {
+            restream_stream_ = restream_server_->open_stream(name);
+        }
+        if (restream_stream_ == 0) {
+            BLOG_WARNING("Not restreaming %s until the restream settings change", device.c_str());
+            restream_server_.reset();
+            restream_failed_ = true;
+            return;
+        }
+        restream_name_ = name;
+    }
+
+    restream_server_->publish(restream_stream_, frame, data);
+}
+
+void BerryStreamCamSource::stop_restream()
+{
+    std::lock_guard<std::mutex> lock(restream_mutex_);
+
+    if (restream_server_ && restream_stream_ != 0) {
+        restream_server_->close_stream(restream_stream_);
+    }
+    restream_server_.reset();
+    restream_stream_ = 0;
+    restream_name_.clear();
+    restream_failed_ = false;
+}
+
+// Frame data received from a transport, shared from here on between the
+// decode job and restream clients
+static std::shared_ptr<uint8_t> adopt_frame_data(VideoFrame& frame)
+{
+    std::shared_ptr<uint8_t> data(frame.data, std::default_delete<uint8_t[]>());
+    frame.data = nullptr;
+    return data;
 }
 
 void BerryStreamCamSource::streaming_thread_func()
@@ -602,78 +1369,19 @@ void BerryStreamCamSource::streaming_thread_func()
 
 void BerryStreamCamSource::streaming_thread_impl()
 {
-    bool connection_success = false;
-    ProtocolType attempted_protocol = config_.protocol;
-
-    // Connect using appropriate handler based on protocol
-    // Handlers are already created in main thread (constructor)
-    try {
-        switch (config_.protocol) {
-            case ProtocolType::WEBSOCKET_OBS_DROID:
-                if (ws_handler_) {
-                    if (!ws_handler_->connect_to_server(config_.stream_url)) {
-                        BLOG_ERROR("Failed to connect via WebSocket");
-                    } else {
-                        connection_success = true;
-                    }
-                } else {
-                    BLOG_ERROR("WebSocket handler not initialized");
-                }
-                break;
-
-            /* RTSP - Coming Soon
-            case ProtocolType::RTSP:
-                if (rtsp_handler_) {
-                    if (!rtsp_handler_->connect(config_.stream_url)) {
-                        BLOG_ERROR("Failed to connect via RTSP");
-                    } else {
-                        connection_success = true;
-                    }
-                } else {
-                    BLOG_ERROR("RTSP handler not initialized");
-                }
-                break;
-            */
-
-            case ProtocolType::HTTP_RAW_H264:
-            case ProtocolType::HTTP_MJPEG:
-                if (http_handler_) {
-                    if (!http_handler_->connect(config_.stream_url, config_.protocol)) {
-                        BLOG_ERROR("Failed to connect via HTTP");
-                    } else {
-                        connection_success = true;
-                    }
-                } else {
-                    BLOG_ERROR("HTTP handler not initialized");
-                }
-                break;
-
-            default:
-                BLOG_ERROR("Unsupported protocol");
-                break;
-        }
-    } catch (const std::exception& e) {
-        BLOG_ERROR("Exception during connection: %s", e.what());
-        connection_success = false;
-    }
+    StreamConfig config = current_config();
+    std::string key = DeviceSessionManager::key_for(config.device_ip, config.protocol);
+    Transport* current = nullptr;   // nullptr until a race has been won
 
-    // If connection failed and not already using WebSocket, fallback
-    if (!connection_success) {
-        streaming_ = false;
-        connection_retry_count_++;
-
-        if (attempted_protocol != fallback_protocol_ && connection_retry_count_ <= 3) {
-            BLOG_WARNING("Connection failed (attempt %d/3), will fallback to WebSocket",
-                        connection_retry_count_.load());
-            // Schedule fallback (do it from main thread to avoid issues)
-            // For now, just stop - user can manually switch or we trigger on next attempt
-        }
-        return;
-    }
+    // Handlers are already created in main thread (constructor); the race
+    // connects them on helper threads so this loop never blocks on one
+    TransportSwap swap;
+    FrameGate gate;
 
-    BLOG_INFO("Connected to stream");
-    connection_retry_count_ = 0;
-    connection_failed_ = false;
+    auto outage_start = std::chrono::steady_clock::now();   // Also the last frame while streaming
+    auto retry_at = outage_start;
+    int backoff_ms = RETRY_BACKOFF_MS;
+    active_protocol_ = ProtocolType::UNKNOWN;
 
     // Main streaming loop
     StreamState last_state = StreamState::STREAMING;
@@ -683,115 +1391,345 @@ void BerryStreamCamSource::streaming_thread_impl()
 
         // Handle state transitions
         if (current_state == StreamState::PAUSED && last_state == StreamState::STREAMING) {
-            // Transitioning to PAUSED - disconnect handlers from streaming thread
+            // Transitioning to PAUSED - disconnect from streaming thread
             BLOG_INFO("Disconnecting handlers (paused)");
-            if (ws_handler_ && ws_handler_->is_connected()) {
-                ws_handler_->disconnect_from_server();
-            }
-            if (http_handler_ && http_handler_->is_connected()) {
-                http_handler_->disconnect();
+            swap.cancel();
+            if (current) {
+                current->disconnect();
+                current = nullptr;
             }
+            stop_relay();
+            stop_restream();
+            active_protocol_ = ProtocolType::UNKNOWN;
             last_state = StreamState::PAUSED;
         }
         else if (current_state == StreamState::STREAMING && last_state == StreamState::PAUSED) {
-            // Transitioning back to STREAMING - reconnect with current protocol
+            // Transitioning back to STREAMING - race again with the latest config,
+            // which also covers a protocol change made while hidden
             BLOG_INFO("Reconnecting handlers (resumed)");
+            swap.settle();
+            swap_requested_ = false;
+
+            config = current_config();
+            key = DeviceSessionManager::key_for(config.device_ip, config.protocol);
+            sessions_->set_key(session_member_, key);
+            outage_start = std::chrono::steady_clock::now();
+            retry_at = outage_start;
+            backoff_ms = RETRY_BACKOFF_MS;
+            last_state = StreamState::STREAMING;
+        }
 
-            std::string url = config_.device_ip.empty() ? "192.168.110.10" : config_.device_ip;
+        // If paused, wait for resume or stop
+        if (current_state == StreamState::PAUSED) {
+            std::unique_lock<std::mutex> lock(state_mutex_);
+            state_cv_.wait(lock, [this]() {
+                return !streaming_ || stream_state_ != StreamState::PAUSED;
+            });
+            continue;
+        }
 
-            if (config_.protocol == ProtocolType::WEBSOCKET_OBS_DROID) {
-                if (ws_handler_ && !ws_handler_->is_connected()) {
-                    std::string ws_url = "ws://" + url + ":8080/stream";
-                    if (!ws_handler_->connect_to_server(ws_url)) {
-                        BLOG_ERROR("Failed to reconnect WebSocket");
-                    }
-                } else if (!ws_handler_) {
-                    BLOG_ERROR("WebSocket handler not initialized");
+        // Protocol change: bring the new transport up beside the current one
+        if (swap_requested_.exchange(false)) {
+            config = current_config();
+            key = DeviceSessionManager::key_for(config.device_ip, config.protocol);
+            sessions_->set_key(session_member_, key);
+            Transport* wanted = transport_for(config.protocol);
+            std::string url = config.stream_url;
+            if (relay_available(key)) {
+                wanted = relay_transport_;
+                url = key;
+            }
+            if (!current) {
+                // Nothing to keep on screen; race again with the new preference
+                swap.cancel();
+                retry_at = std::chrono::steady_clock::now();
+                backoff_ms = RETRY_BACKOFF_MS;
+            } else if (!wanted || wanted == current) {
+                swap.cancel();
+            } else if (wanted != swap.incoming()) {
+                BLOG_INFO("Bringing up %s next to %s",
+                          protocol_to_string(wanted->protocol()),
+                          protocol_to_string(current->protocol()));
+                swap.begin(wanted, url);
+            }
+        }
+
+        // Another source already streams this device: show its pictures rather
+        // than connect and decode a second time. Whoever streams it next after
+        // that source stops takes over.
+        session_changed_ = false;
+        if (!sessions_->is_publisher(session_member_)) {
+            if (!sharing_) {
+                BLOG_INFO("Sharing the stream from %s with another source", config.device_ip.c_str());
+                swap.cancel();
+                if (current) {
+                    current->disconnect();
+                    current = nullptr;
                 }
-            } else if (config_.protocol == ProtocolType::HTTP_RAW_H264) {
-                if (http_handler_ && !http_handler_->is_connected()) {
-                    std::string http_url = "http://" + url + ":8081/stream.h264";
-                    if (!http_handler_->connect(http_url, ProtocolType::HTTP_RAW_H264)) {
-                        BLOG_ERROR("Failed to reconnect HTTP");
+                stop_relay();
+                stop_restream();
+                active_protocol_ = ProtocolType::UNKNOWN;
+                decode_budget_->set_running(budget_id_, false);
+                sharing_ = true;
+            }
+            std::unique_lock<std::mutex> lock(state_mutex_);
+            state_cv_.wait(lock, [this]() {
+                return !streaming_ || stream_state_ != StreamState::STREAMING ||
+                       swap_requested_ || session_changed_;
+            });
+            continue;
+        }
+        if (sharing_) {
+            BLOG_INFO("Taking over the connection to %s", config.device_ip.c_str());
+            decode_budget_->set_running(budget_id_, true);
+            sharing_ = false;
+            outage_start = std::chrono::steady_clock::now();
+            retry_at = outage_start;
+            backoff_ms = RETRY_BACKOFF_MS;
+        }
+
+        // No working transport: race every candidate, backing off between rounds
+        if (!current && !swap.in_progress()) {
+            if (std::chrono::steady_clock::now() < retry_at) {
+                std::unique_lock<std::mutex> lock(state_mutex_);
+                state_cv_.wait_until(lock, retry_at, [this]() {
+                    return !streaming_ || stream_state_ != StreamState::STREAMING || swap_requested_;
+                });
+                continue;
+            }
+
+            std::vector<SwapCandidate> candidates = race_candidates(config);
+            BLOG_INFO("Racing %zu transports to %s, preferring %s",
+                      candidates.size(), config.device_ip.c_str(), protocol_to_string(config.protocol));
+            swap.begin(candidates);
+        }
+
+        if (swap.in_progress()) {
+            Transport* incoming = swap.incoming();
+            VideoFrame keyframe = {};
+            switch (swap.poll(keyframe)) {
+                case TransportSwap::Progress::CUTOVER: {
+                    Transport* winner = swap.winner();
+                    auto now = std::chrono::steady_clock::now();
+                    if (current) {
+                        BLOG_INFO("Cut over from %s to %s on keyframe",
+                                  protocol_to_string(current->protocol()),
+                                  protocol_to_string(winner->protocol()));
+                        swap.retire(current);
+                    } else {
+                        last_recovery_ms_ = std::chrono::duration_cast<std::chrono::milliseconds>(
+                            now - outage_start).count();
+                        BLOG_INFO("Streaming via %s after %lld ms",
+                                  protocol_to_string(winner->protocol()),
+                                  static_cast<long long>(last_recovery_ms_.load()));
                     }
-                } else if (!http_handler_) {
-                    BLOG_ERROR("HTTP handler not initialized");
-                }
-            } else if (config_.protocol == ProtocolType::HTTP_MJPEG) {
-                if (http_handler_ && !http_handler_->is_connected()) {
-                    std::string mjpeg_url = "http://" + url + ":8081/mjpeg";
-                    if (!http_handler_->connect(mjpeg_url, ProtocolType::HTTP_MJPEG)) {
-                        BLOG_ERROR("Failed to reconnect MJPEG");
+                    current = winner;
+                    active_protocol_ = winner->protocol();
+                    backoff_ms = RETRY_BACKOFF_MS;
+                    outage_start = now;
+
+                    // Relay what we receive from the device, never what we read from a relay
+                    if (current == relay_transport_) {
+                        stop_relay();
+                    } else {
+                        publish_to_relay(keyframe, key);
                     }
-                } else if (!http_handler_) {
-                    BLOG_ERROR("HTTP handler not initialized");
+
+                    // Reference frames from the old path belong to another stream
+                    std::shared_ptr<uint8_t> data = adopt_frame_data(keyframe);
+                    publish_to_restream(keyframe, data, config.device_ip);
+                    submit_decode(keyframe, std::move(data), true);
+                    gate.reset();
+                    break;
                 }
+                case TransportSwap::Progress::FAILED:
+                    if (current) {
+                        BLOG_WARNING("%s did not deliver a keyframe, staying on %s",
+                                     protocol_to_string(incoming->protocol()),
+                                     protocol_to_string(current->protocol()));
+                    } else {
+                        BLOG_WARNING("No transport to %s delivered a keyframe, retrying in %d ms",
+                                     config.device_ip.c_str(), backoff_ms);
+                        retry_at = std::chrono::steady_clock::now() + std::chrono::milliseconds(backoff_ms);
+                        backoff_ms = std::min(backoff_ms * 2, RETRY_BACKOFF_MAX_MS);
+                    }
+                    break;
+                default:
+                    break;
             }
-            last_state = StreamState::STREAMING;
         }
 
-        // If paused, sleep and continue
-        if (current_state == StreamState::PAUSED) {
-            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        if (!current) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            continue;
+        }
+
+        // Decoding is behind: leave frames with the transport, which drops
+        // the oldest, rather than queue them here. Not a stall.
+        if (decode_pool_->pending(decode_lane_) >= MAX_DECODE_BACKLOG) {
+            outage_start = std::chrono::steady_clock::now();
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
             continue;
         }
 
         VideoFrame frame = {};
+        std::shared_ptr<uint8_t> data;
 
-        // Receive frame from active handler based on current protocol
+        // Receive frame from the current transport, which may lend its own buffer
         // Note: No need to call process_events() - WebSocket now uses dedicated thread
-        bool got_frame = false;
-        if (config_.protocol == ProtocolType::WEBSOCKET_OBS_DROID && ws_handler_) {
-            got_frame = ws_handler_->receive_frame(frame);
-        } /* else if (config_.protocol == ProtocolType::RTSP && rtsp_handler_) {
-            got_frame = rtsp_handler_->receive_frame(frame);
-        } */ else if ((config_.protocol == ProtocolType::HTTP_RAW_H264 ||
-                      config_.protocol == ProtocolType::HTTP_MJPEG) && http_handler_) {
-            got_frame = http_handler_->receive_frame(frame);
-        }
-
-        if (got_frame) {
-            process_video_frame(frame);
-            // Free frame data after processing to prevent memory leak
-            delete[] frame.data;
-            frame.data = nullptr;
-        } else {
-            // Brief sleep to avoid busy-waiting
-            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        if (current->receive_shared(frame, data)) {
+            outage_start = std::chrono::steady_clock::now();
+
+            // Nobody downstream can use a frame built on a damaged picture
+            if (!gate.admit(frame)) {
+                corrupt_dropped_++;
+                continue;
+            }
+
+            if (current != relay_transport_) {
+                publish_to_relay(frame, key);
+            }
+            publish_to_restream(frame, data, config.device_ip);
+            submit_decode(frame, std::move(data), false);
+            continue;
+        }
+
+        // A transport that went quiet is dropped and raced against the rest;
+        // the last frame stays on screen meanwhile
+        auto silent_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - outage_start).count();
+        if (!swap.in_progress() && silent_ms >= STALL_TIMEOUT_MS) {
+            BLOG_WARNING("%s stalled for %lld ms, failing over",
+                         protocol_to_string(current->protocol()), static_cast<long long>(silent_ms));
+            failover_count_++;
+            swap.retire(current);
+            current = nullptr;
+            active_protocol_ = ProtocolType::UNKNOWN;
+            retry_at = std::chrono::steady_clock::now();
+            continue;
+        }
+
+        // Brief sleep to avoid busy-waiting
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    stop_relay();
+    stop_restream();
+    active_protocol_ = ProtocolType::UNKNOWN;
+    sharing_ = false;
+}
+
+// Due within one OBS frame; a late frame is still shown but counts as a miss
+static int frame_deadline_ms()
+{
+    return std::max(static_cast<int>(obs_get_frame_interval_ns() / 1000000), 1);
+}
+
+void BerryStreamCamSource::submit_decode(const VideoFrame& frame, std::shared_ptr<uint8_t> data, bool flush_first)
+{
+    // The job holds the encoded data as long as it needs it, also if it is discarded
+    VideoFrame queued = frame;
+    queued.data = data.get();
+
+    decode_pool_->submit(decode_lane_, [this, queued, data, flush_first]() {
+        if (flush_first) {
+            decoder_->flush();
         }
+        process_video_frame(queued);
+    }, frame_deadline_ms());
+}
+
+void BerryStreamCamSource::apply_decode_priority()
+{
+    DecodePriority priority = DecodePriority::HIDDEN;
+    int forced = priority_override_;
+    if (forced >= 0) {
+        priority = static_cast<DecodePriority>(forced);
+    } else if (on_program_) {
+        priority = DecodePriority::PROGRAM;
+    } else if (showing_) {
+        priority = DecodePriority::PREVIEW;
     }
+    decode_pool_->set_lane_priority(decode_lane_, priority);
+    decode_budget_->set_priority(budget_id_, priority);
 }
 
 void BerryStreamCamSource::process_video_frame(const VideoFrame& frame)
 {
+    // Threads and frame skipping as the budget allows right now
+    DecodeGrant grant = decode_budget_->grant(budget_id_);
+    decoder_->set_threads(grant.threads);
+    decoder_->set_skip_nonref(grant.skip_nonref);
+
     // Decode H.264 frame
     uint8_t *decoded_data = nullptr;
     int decoded_width = 0, decoded_height = 0;
 
-    if (!decoder_->decode_frame(frame.data, frame.size,
-                                 &decoded_data, &decoded_width, &decoded_height)) {
+    auto decode_start = std::chrono::steady_clock::now();
+    bool decoded = decoder_->decode_frame(frame.data, frame.size,
+                                          &decoded_data, &decoded_width, &decoded_height);
+    decode_budget_->record(budget_id_, std::chrono::steady_clock::now() - decode_start);
+    if (!decoded) {
+        return;
+    }
+    decode_budget_->set_format(budget_id_, decoded_width, decoded_height);
+
+    // Other sources showing this device get the picture instead of decoding it again
+    if (sessions_->audience(session_member_) > 0) {
+        size_t size = static_cast<size_t>(decoded_width) * decoded_height * 4;
+        auto picture = std::make_shared<DecodedPicture>();
+        picture->rgba.reset(new uint8_t[size]);
+        memcpy(picture->rgba.get(), decoded_data, size);
+        picture->width = decoded_width;
+        picture->height = decoded_height;
+        sessions_->publish(session_member_, picture);
+    }
+
+    present_picture(decoded_data, decoded_width, decoded_height);
+}
+
+void BerryStreamCamSource::receive_shared_picture(const PictureRef& picture)
+{
+    // Runs in the publishing source's decode job; upload on our own lane, so
+    // our priority applies and a slow upload here does not hold up the rest
+    if (decode_pool_->pending(decode_lane_) >= MAX_DECODE_BACKLOG) {
+        shared_dropped_++;
         return;
     }
+    decode_pool_->submit(decode_lane_, [this, picture]() {
+        present_picture(picture->rgba.get(), picture->width, picture->height);
+    }, frame_deadline_ms());
+}
+
+void BerryStreamCamSource::present_picture(const uint8_t *rgba, uint32_t width, uint32_t height)
+{
+    PictureRegion region;
+    {
+        std::lock_guard<std::mutex> lock(frame_mutex_);
+        region = layout_picture(layout_, width, height);
+    }
 
     // Update dimensions
-    width_ = decoded_width;
-    height_ = decoded_height;
+    width_ = region.output_width;
+    height_ = region.output_height;
+
+    // Upload only the cropped rectangle; rows keep the full picture's stride
+    const uint8_t *origin = rgba + (static_cast<size_t>(region.y) * width + region.x) * 4;
 
-    // Upload to GPU texture
     obs_enter_graphics();
 
-    if (!texture_ || gs_texture_get_width(texture_) != width_ ||
-        gs_texture_get_height(texture_) != height_) {
+    if (!texture_ || gs_texture_get_width(texture_) != region.width ||
+        gs_texture_get_height(texture_) != region.height) {
 
         if (texture_) {
             gs_texture_destroy(texture_);
         }
 
-        texture_ = gs_texture_create(width_, height_, GS_RGBA, 1, nullptr, GS_DYNAMIC);
+        texture_ = gs_texture_create(region.width, region.height, GS_RGBA, 1, nullptr, GS_DYNAMIC);
     }
 
     if (texture_) {
-        gs_texture_set_image(texture_, decoded_data, width_ * 4, false);
+        gs_texture_set_image(texture_, origin, width * 4, false);
     }
 
     obs_leave_graphics();
@@ -5,13 +5,26 @@
 #include <atomic>
 #include <mutex>
 #include <thread>
-#include <future>
+#include <condition_variable>
 #include "common.hpp"
-#include "discovery/device-discovery.hpp"
+#include "source-lifecycle.hpp"
+#include "device-session.hpp"
+#include "discovery/discovery-service.hpp"
 #include "protocols/websocket-handler.hpp"
-#include "protocols/rtsp-handler.hpp"
+#include "protocols/rtsp-udp-handler.hpp"
 #include "protocols/http-handler.hpp"
+#include "protocols/dash-handler.hpp"
+#include "protocols/srt-handler.hpp"
+#include "protocols/transport.hpp"
+#include "protocols/transport-swap.hpp"
+#include "protocols/local-relay.hpp"
+#include "protocols/shm-ingest.hpp"
+#include "protocols/udp-fec.hpp"
+#include "protocols/restream-server.hpp"
 #include "decoder/h264-decoder.hpp"
+#include "decoder/decode-pool.hpp"
+#include "decoder/decode-budget.hpp"
+#include "decoder/frame-gate.hpp"
 
 namespace berrystreamcam {
 
@@ -34,30 +47,81 @@ public:
     static obs_properties_t* get_properties(void *data);
     static void get_defaults(obs_data_t *settings);
 
+    // Statistics, also exposed as the "get_stats" proc on the source
+    void get_stats(obs_data_t *stats);
+
 private:
-    void start_streaming();
+    bool start_streaming();
     void stop_streaming();
     void stop_streaming_safe();
     void pause_streaming();
     void resume_streaming();
-    void restart_streaming();
-    void fallback_to_websocket();
-    void update_devices();
+    bool swap_transport();
+    void wake_streaming_thread();
+    StreamConfig current_config();
+    Transport* transport_for(ProtocolType type);
+    std::vector<SwapCandidate> race_candidates(const StreamConfig& config);
+    bool relay_available(const std::string& key);
+    void publish_to_relay(const VideoFrame& frame, const std::string& key);
+    void stop_relay();
+    void publish_to_restream(const VideoFrame& frame, const std::shared_ptr<uint8_t>& data,
+                             const std::string& device);
+    void stop_restream();
+    void submit_decode(const VideoFrame& frame, std::shared_ptr<uint8_t> data, bool flush_first);
+    void apply_decode_priority();
     void process_video_frame(const VideoFrame& frame);
+    void receive_shared_picture(const PictureRef& picture);
+    void present_picture(const uint8_t *rgba, uint32_t width, uint32_t height);
     void process_audio_frame(const AudioFrame& frame);
 
-    void discovery_thread_func();
+    static void get_stats_proc(void *data, calldata_t *cd);
+    std::string format_network_summary();
+
     void streaming_thread_func();
     void streaming_thread_impl();
 
     obs_source_t *source_;
     gs_texture_t *texture_;
 
-    std::unique_ptr<DeviceDiscovery> discovery_;
+    std::shared_ptr<DiscoveryService> discovery_;
+    DiscoveryService::SubscriptionId discovery_subscription_;
     std::unique_ptr<WebSocketHandler> ws_handler_;
-    std::unique_ptr<RtspHandler> rtsp_handler_;
+    std::unique_ptr<RtspUdpHandler> rtsp_handler_;
     std::unique_ptr<HttpHandler> http_handler_;
-    std::unique_ptr<H264Decoder> decoder_;
+    std::unique_ptr<HttpHandler> mjpeg_handler_;   // Own handler so H.264 <-> MJPEG can overlap
+    std::unique_ptr<DashHandler> dash_handler_;
+    std::unique_ptr<SrtHandler> srt_handler_;
+    std::unique_ptr<H264Decoder> decoder_;          // Only touched by jobs on decode_lane_
+    std::shared_ptr<DecodePool> decode_pool_;
+    DecodePool::LaneId decode_lane_;
+    std::shared_ptr<DecodeBudget> decode_budget_;
+    DecodeBudget::ConsumerId budget_id_;
+
+    // Sources showing the same device share one connection and decoder
+    std::shared_ptr<DeviceSessionManager> sessions_;
+    DeviceSessionManager::MemberId session_member_;
+    std::atomic<bool> session_changed_;   // Our session's publisher may have changed
+    std::atomic<bool> sharing_;           // Showing another source's pictures
+    std::atomic<uint64_t> shared_dropped_;
+    std::vector<std::unique_ptr<Transport>> transports_;   // One per protocol, over the handlers above
+    UdpFecTransport* fec_transport_;                       // In transports_
+    ShmIngestTransport* shm_transport_;                    // In transports_
+
+    // Other OBS processes on this host share our stream, or we theirs
+    std::atomic<bool> local_relay_;
+    RelayTransport* relay_transport_;                  // In transports_
+    std::unique_ptr<RelayPublisher> relay_publisher_;  // While we receive from the device
+    std::mutex relay_mutex_;                           // relay_publisher_
+
+    // Received streams served again over RTSP and HTTP, for other tools
+    std::atomic<bool> restream_;
+    std::atomic<bool> restream_lan_;
+    std::atomic<int> restream_port_;
+    std::shared_ptr<RestreamServer> restream_server_;
+    RestreamServer::StreamId restream_stream_;
+    std::string restream_name_;
+    bool restream_failed_;      // Not retried until the settings change
+    std::mutex restream_mutex_; // restream_server_ to restream_failed_
 
     StreamConfig config_;
     std::vector<StreamDevice> discovered_devices_;
@@ -68,25 +132,48 @@ private:
         STREAMING
     };
 
-    std::atomic<bool> active_;
     std::atomic<bool> streaming_;
     std::atomic<StreamState> stream_state_;
+    std::atomic<bool> swap_requested_;   // Streaming thread moves to the current config
     std::atomic<uint32_t> width_;
     std::atomic<uint32_t> height_;
 
-    std::thread discovery_thread_;
+    // Decode priority: on air, showing elsewhere, or the user's choice
+    std::atomic<bool> on_program_;
+    std::atomic<bool> showing_;
+    std::atomic<int> priority_override_;   // DecodePriority, -1 to follow OBS
+
     std::thread streaming_thread_;
     std::mutex device_mutex_;
-    std::mutex frame_mutex_;
+    std::mutex frame_mutex_;             // layout_
     std::mutex streaming_mutex_;
+    std::mutex config_mutex_;            // config_ writes vs. the lifecycle thread
+    std::mutex state_mutex_;
+    std::condition_variable state_cv_;   // Wakes a paused streaming thread
 
     uint8_t *frame_buffer_;
     size_t frame_buffer_size_;
 
-    ProtocolType last_protocol_;
-    ProtocolType fallback_protocol_;
-    std::atomic<bool> connection_failed_;
-    std::atomic<int> connection_retry_count_;
+    PictureLayout layout_;   // This source's crop and output size
+
+    // Failover: a stream that stalls this long is raced again
+    static constexpr int STALL_TIMEOUT_MS = 2000;
+    static constexpr int RETRY_BACKOFF_MS = 1000;
+    static constexpr int RETRY_BACKOFF_MAX_MS = 10000;
+
+    // Frames queued for decoding before the streaming thread stops reading;
+    // the transport's own queue absorbs the rest
+    static constexpr size_t MAX_DECODE_BACKLOG = 3;
+
+    std::atomic<ProtocolType> last_protocol_;     // Written by update(), read by get_stats()
+    std::atomic<ProtocolType> active_protocol_;   // UNKNOWN while (re)connecting
+    std::atomic<uint32_t> failover_count_;
+    std::atomic<int64_t> last_recovery_ms_;       // Outage to first keyframe, -1 before the first
+    std::atomic<uint64_t> corrupt_dropped_;       // Corrupt frames and those depending on them
+
+    // Runs start/stop/pause/resume so the OBS callbacks never block; last
+    // member so it is built after, and torn down before, what it drives
+    SourceLifecycle lifecycle_;
 };
 
 void register_berrystreamcam_source();
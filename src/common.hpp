@@ -24,6 +24,10 @@ enum class ProtocolType {
     HTTP_MJPEG,            // Port 8081 - MJPEG stream
     HTTP_RAW_H264,         // Port 8081 - Raw H.264
     RTSP,                  // Port 8554 - RTSP/RTP
+    UDP_FEC,               // Port 8556 - Plain UDP with parity and NACKs
+    SRT,                   // Contributors over the internet; ARQ within a latency window
+    SHM_INGEST,            // A producer on this host writing into shared memory
+    LOCAL_RELAY,           // Another process on this host relaying one of the above
     UNKNOWN
 };
 
@@ -43,6 +47,12 @@ struct StreamDevice {
     std::vector<ProtocolInfo> available_protocols;
     bool is_active;
     int64_t last_seen;
+    bool capabilities_known;          // Filled from the /health capability document
+    std::vector<std::string> codecs;  // e.g. "h264", "mjpeg"
+    int width;
+    int height;
+    int fps;
+    int connected_clients;
 };
 
 // Video frame data
@@ -53,6 +63,7 @@ struct VideoFrame {
     int64_t pts;
     int64_t dts;
     bool is_keyframe;
+    bool is_corrupt;      // Assembled across a packet loss
     int width;
     int height;
 };
@@ -71,6 +82,7 @@ struct StreamConfig {
     ProtocolType protocol;
     std::string device_ip;
     std::string stream_url;
+    std::string network_profile;
     int video_width;
     int video_height;
     int video_fps;
@@ -82,6 +94,7 @@ struct StreamConfig {
 constexpr int WEBSOCKET_PORT = 8080;
 constexpr int HTTP_PORT = 8081;
 constexpr int RTSP_PORT = 8554;
+constexpr int UDP_FEC_PORT = 8556;
 constexpr int DISCOVERY_INTERVAL_MS = 5000;
 constexpr int CONNECTION_TIMEOUT_MS = 10000;
 constexpr int FRAME_BUFFER_SIZE = 1920 * 1080 * 3; // Max frame size
@@ -99,6 +112,14 @@ inline const char* protocol_to_string(ProtocolType type) {
             return "HTTP Raw H.264";
         case ProtocolType::RTSP:
             return "RTSP";
+        case ProtocolType::UDP_FEC:
+            return "UDP + FEC";
+        case ProtocolType::SRT:
+            return "SRT";
+        case ProtocolType::SHM_INGEST:
+            return "Shared Memory";
+        case ProtocolType::LOCAL_RELAY:
+            return "Local Relay";
         default:
             return "Unknown";
     }
@@ -0,0 +1,254 @@
+#include "decode-budget.hpp"
+#include <algorithm>
+#include <thread>
+
+namespace berrystreamcam {
+
+namespace {
+
+std::mutex instance_mutex;
+std::weak_ptr<DecodeBudget> instance;
+
+constexpr int FALLBACK_CORES = 2;            // hardware_concurrency() may not know
+constexpr double DEFAULT_FPS = 30.0;         // Until the first window is measured
+constexpr double RELEASE_LOAD = 0.75;        // Of the budget, before shedding is undone
+constexpr int MAX_SHED_LEVEL = 2;
+
+// Weight of a pixel by priority when spare threads are handed out
+double priority_weight(DecodePriority priority)
+{
+    switch (priority) {
+        case DecodePriority::PROGRAM: return 4.0;
+        case DecodePriority::PREVIEW: return 2.0;
+        case DecodePriority::HIDDEN: return 1.0;
+    }
+    return 1.0;
+}
+
+} // namespace
+
+std::shared_ptr<DecodeBudget> DecodeBudget::acquire()
+{
+    std::lock_guard<std::mutex> lock(instance_mutex);
+
+    std::shared_ptr<DecodeBudget> budget = instance.lock();
+    if (!budget) {
+        int cores = static_cast<int>(std::thread::hardware_concurrency());
+        budget = std::make_shared<DecodeBudget>(cores > 0 ? cores : FALLBACK_CORES);
+        instance = budget;
+    }
+    return budget;
+}
+
+DecodeBudget::DecodeBudget(int cores, int load_window_ms)
+    : budget_cores_(std::max(cores, 1))
+    , load_window_(load_window_ms)
+    , next_id_(1)
+    , shed_level_(0)
+    , rebalances_(0)
+    , window_start_(std::chrono::steady_clock::now())
+{
+}
+
+DecodeBudget::ConsumerId DecodeBudget::add()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    ConsumerId id = next_id_++;
+    Consumer& consumer = consumers_[id];
+    consumer.running = false;
+    consumer.priority = DecodePriority::HIDDEN;
+    consumer.width = 0;
+    consumer.height = 0;
+    consumer.busy_ms = 0.0;
+    consumer.frames = 0;
+    consumer.fps = 0.0;
+    consumer.load_cores = 0.0;
+    consumer.grant = { 1, false };
+    return id;
+}
+
+void DecodeBudget::remove(ConsumerId id)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (consumers_.erase(id) > 0) {
+        rebalance();
+    }
+}
+
+void DecodeBudget::set_running(ConsumerId id, bool running)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto it = consumers_.find(id);
+    if (it == consumers_.end() || it->second.running == running) {
+        return;
+    }
+    it->second.running = running;
+    if (!running) {
+        it->second.busy_ms = 0.0;
+        it->second.frames = 0;
+        it->second.fps = 0.0;
+        it->second.load_cores = 0.0;
+    }
+    rebalance();
+}
+
+void DecodeBudget::set_priority(ConsumerId id, DecodePriority priority)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto it = consumers_.find(id);
+    if (it == consumers_.end() || it->second.priority == priority) {
+        return;
+    }
+    it->second.priority = priority;
+    rebalance();
+}
+
+void DecodeBudget::set_format(ConsumerId id, int width, int height)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto it = consumers_.find(id);
+    if (it == consumers_.end() || (it->second.width == width && it->second.height == height)) {
+        return;
+    }
+    BLOG_DEBUG("Decode budget: source %llu now %dx%d",
+               static_cast<unsigned long long>(id), width, height);
+    it->second.width = width;
+    it->second.height = height;
+    rebalance();
+}
+
+void DecodeBudget::record(ConsumerId id, std::chrono::steady_clock::duration busy)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto it = consumers_.find(id);
+    if (it == consumers_.end()) {
+        return;
+    }
+    it->second.busy_ms += std::chrono::duration<double, std::milli>(busy).count();
+    it->second.frames++;
+
+    auto now = std::chrono::steady_clock::now();
+    if (now - window_start_ >= load_window_) {
+        close_window(now);
+    }
+}
+
+DecodeGrant DecodeBudget::grant(ConsumerId id) const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto it = consumers_.find(id);
+    return it != consumers_.end() ? it->second.grant : DecodeGrant{ 1, false };
+}
+
+double DecodeBudget::load_cores(ConsumerId id) const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto it = consumers_.find(id);
+    return it != consumers_.end() ? it->second.load_cores : 0.0;
+}
+
+DecodeBudgetStats DecodeBudget::stats() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    DecodeBudgetStats stats = {};
+    stats.budget_cores = budget_cores_;
+    stats.shed_level = shed_level_;
+    stats.rebalances = rebalances_;
+    for (const auto& entry : consumers_) {
+        if (entry.second.running) {
+            stats.sources++;
+            stats.granted_threads += entry.second.grant.threads;
+            stats.load_cores += entry.second.load_cores;
+        }
+    }
+    return stats;
+}
+
+void DecodeBudget::close_window(std::chrono::steady_clock::time_point now)
+{
+    double elapsed_ms = std::chrono::duration<double, std::milli>(now - window_start_).count();
+    window_start_ = now;
+
+    double total = 0.0;
+    for (auto& entry : consumers_) {
+        Consumer& consumer = entry.second;
+        // Slice threads work while the job waits, so wall time alone undercounts
+        consumer.load_cores = consumer.busy_ms * consumer.grant.threads / elapsed_ms;
+        consumer.fps = consumer.frames * 1000.0 / elapsed_ms;
+        consumer.busy_ms = 0.0;
+        consumer.frames = 0;
+        if (consumer.running) {
+            total += consumer.load_cores;
+        }
+    }
+
+    // One step per window, so the effect of the last one is measured first
+    int shed_level = shed_level_;
+    if (total > budget_cores_ && shed_level < MAX_SHED_LEVEL) {
+        shed_level++;
+    } else if (total < budget_cores_ * RELEASE_LOAD && shed_level > 0) {
+        shed_level--;
+    }
+
+    if (shed_level != shed_level_) {
+        BLOG_INFO("Decode load %.1f of %d cores, shed level %d -> %d",
+                  total, budget_cores_, shed_level_, shed_level);
+        shed_level_ = shed_level;
+    }
+    rebalance();
+}
+
+void DecodeBudget::rebalance()
+{
+    rebalances_++;
+
+    // Every running source holds the pool job it decodes on
+    int spare = budget_cores_;
+    for (auto& entry : consumers_) {
+        Consumer& consumer = entry.second;
+        consumer.grant.threads = 1;
+        // Shed level 1 reaches HIDDEN, level 2 PREVIEW as well
+        consumer.grant.skip_nonref = shed_level_ > 0 &&
+            static_cast<int>(consumer.priority) > MAX_SHED_LEVEL - shed_level_;
+        if (consumer.running) {
+            spare--;
+        }
+    }
+
+    // Spare cores one at a time to the source with the most weighted pixels
+    // per thread, up to what its resolution can use
+    while (spare > 0) {
+        Consumer* best = nullptr;
+        double best_share = 0.0;
+        for (auto& entry : consumers_) {
+            Consumer& consumer = entry.second;
+            int cap = std::min(consumer.height / ROWS_PER_THREAD, MAX_THREADS_PER_SOURCE);
+            if (!consumer.running || consumer.grant.skip_nonref || consumer.grant.threads >= cap) {
+                continue;
+            }
+            double fps = consumer.fps > 0.0 ? consumer.fps : DEFAULT_FPS;
+            double share = static_cast<double>(consumer.width) * consumer.height * fps *
+                           priority_weight(consumer.priority) / consumer.grant.threads;
+            if (!best || share > best_share) {
+                best = &consumer;
+                best_share = share;
+            }
+        }
+        if (!best) {
+            break;
+        }
+        best->grant.threads++;
+        spare--;
+    }
+}
+
+} // namespace berrystreamcam
@@ -0,0 +1,115 @@
+#pragma once
+
+#include "../common.hpp"
+#include "decode-pool.hpp"
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+
+namespace berrystreamcam {
+
+/**
+ * What one source may spend on decoding right now.
+ */
+struct DecodeGrant {
+    int threads;          // Decoder slice threads; conversion reuses them after decode
+    bool skip_nonref;     // Drop non-reference frames to get back under budget
+};
+
+/**
+ * The whole process's decoding against its budget.
+ */
+struct DecodeBudgetStats {
+    int budget_cores;
+    int granted_threads;   // Summed over running sources
+    double load_cores;     // Decode time per second times threads granted, an upper bound
+    size_t sources;        // Running
+    int shed_level;        // 0 none, 1 hidden sources skip frames, 2 preview ones too
+    uint64_t rebalances;
+};
+
+/**
+ * Process-wide governor for decoder threads.
+ *
+ * Every running source holds one thread, its job on the DecodePool. Cores
+ * left over go to the sources with the most pixels per second, scaled by
+ * their priority, up to what their resolution can use. Grants are
+ * recomputed whenever a source starts, stops, changes priority or changes
+ * resolution, so a tenth camera takes its core from the extra threads of
+ * the first nine rather than from their frame deadlines.
+ *
+ * Sources report the time every frame takes; once a second the governor
+ * compares the total with the budget. While it runs over, hidden and then
+ * preview sources are told to skip non-reference frames; program sources
+ * never are.
+ */
+class DecodeBudget {
+public:
+    using ConsumerId = uint64_t;
+
+    static constexpr int MAX_THREADS_PER_SOURCE = 8;
+    static constexpr int ROWS_PER_THREAD = 240;        // Fewer rows per slice thread do not pay off
+    static constexpr int LOAD_WINDOW_MS = 1000;
+
+    /**
+     * The shared governor, budgeted at one core per hardware thread.
+     */
+    static std::shared_ptr<DecodeBudget> acquire();
+
+    explicit DecodeBudget(int cores, int load_window_ms = LOAD_WINDOW_MS);
+
+    DecodeBudget(const DecodeBudget&) = delete;
+    DecodeBudget& operator=(const DecodeBudget&) = delete;
+
+    /**
+     * A new source, stopped until set_running().
+     */
+    ConsumerId add();
+    void remove(ConsumerId id);
+
+    void set_running(ConsumerId id, bool running);
+    void set_priority(ConsumerId id, DecodePriority priority);
+
+    /**
+     * Resolution of the frames the source decodes. Cheap when unchanged.
+     */
+    void set_format(ConsumerId id, int width, int height);
+
+    /**
+     * Time spent decoding and converting one frame.
+     */
+    void record(ConsumerId id, std::chrono::steady_clock::duration busy);
+
+    DecodeGrant grant(ConsumerId id) const;
+    double load_cores(ConsumerId id) const;
+    DecodeBudgetStats stats() const;
+
+private:
+    struct Consumer {
+        bool running;
+        DecodePriority priority;
+        int width;
+        int height;
+        double busy_ms;       // In the current window
+        uint64_t frames;      // In the current window
+        double fps;           // Over the last window
+        double load_cores;    // Over the last window
+        DecodeGrant grant;
+    };
+
+    void rebalance();
+    void close_window(std::chrono::steady_clock::time_point now);
+
+    const int budget_cores_;
+    const std::chrono::milliseconds load_window_;
+
+    mutable std::mutex mutex_;
+    std::map<ConsumerId, Consumer> consumers_;
+    ConsumerId next_id_;
+    int shed_level_;
+    uint64_t rebalances_;
+    std::chrono::steady_clock::time_point window_start_;
+};
+
+} // namespace berrystreamcam
@@ -0,0 +1,355 @@
+#include "decode-pool.hpp"
+#include <algorithm>
+#include <exception>
+
+namespace berrystreamcam {
+
+namespace {
+
+std::mutex instance_mutex;
+std::weak_ptr<DecodePool> instance;
+
+constexpr size_t FALLBACK_WORKERS = 2;   // hardware_concurrency() may not know
+constexpr double DELAY_SMOOTHING = 16.0; // Same weight as RTP interarrival jitter
+
+} // namespace
+
+std::shared_ptr<DecodePool> DecodePool::acquire()
+{
+    std::lock_guard<std::mutex> lock(instance_mutex);
+
+    std::shared_ptr<DecodePool> pool = instance.lock();
+    if (!pool) {
+        size_t workers = std::thread::hardware_concurrency();
+        pool = std::make_shared<DecodePool>(workers > 0 ? workers : FALLBACK_WORKERS);
+        instance = pool;
+    }
+    return pool;
+}
+
+DecodePool::DecodePool(size_t worker_count)
+    : running_(true)
+    , next_lane_(1)
+    , next_home_(0)
+    , priority_stats_()
+{
+    worker_count = std::max<size_t>(worker_count, 1);
+    for (size_t i = 0; i < worker_count; i++) {
+        workers_.push_back(std::make_unique<Worker>());
+    }
+    for (size_t i = 0; i < worker_count; i++) {
+        threads_.emplace_back(&DecodePool::worker_loop, this, i);
+    }
+
+    BLOG_INFO("Decode pool started with %zu workers", worker_count);
+}
+
+DecodePool::~DecodePool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        running_ = false;
+        for (auto& worker : workers_) {
+            worker->wake.notify_all();
+        }
+    }
+
+    for (auto& thread : threads_) {
+        if (thread.get_id() == std::this_thread::get_id()) {
+            thread.detach();   // Last reference dropped by a job
+        } else if (thread.joinable()) {
+            thread.join();
+        }
+    }
+
+    BLOG_INFO("Decode pool stopped");
+}
+
+DecodePool::LaneId DecodePool::open_lane(DecodePriority priority)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    LaneId id = next_lane_++;
+    Lane& lane = lanes_[id];
+    lane.home = next_home_++ % workers_.size();
+    lane.ready = false;
+    lane.running = false;
+    lane.closed = false;
+    lane.priority = priority;
+    lane.stats = {};
+    return id;
+}
+
+void DecodePool::set_lane_priority(LaneId id, DecodePriority priority)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto it = lanes_.find(id);
+    if (it != lanes_.end()) {
+        it->second.priority = priority;
+    }
+}
+
+bool DecodePool::submit(LaneId id, Job job, int deadline_ms)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto it = lanes_.find(id);
+    if (it == lanes_.end() || it->second.closed) {
+        return false;
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    it->second.tasks.push_back({ std::move(job), now, now + std::chrono::milliseconds(deadline_ms) });
+    make_ready(id, it->second, false);
+    return true;
+}
+
+void DecodePool::cancel(LaneId id)
+{
+    std::deque<Task> discarded;   // Destroyed outside the lock
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    auto it = lanes_.find(id);
+    if (it == lanes_.end()) {
+        return;
+    }
+
+    discarded.swap(it->second.tasks);
+    it->second.stats.discarded += discarded.size();
+    unqueue(id, it->second);
+
+    if (it->second.running && it->second.runner != std::this_thread::get_id()) {
+        idle_cv_.wait(lock, [this, id]() {
+            auto lane = lanes_.find(id);
+            return lane == lanes_.end() || !lane->second.running;
+        });
+    }
+}
+
+void DecodePool::close_lane(LaneId id)
+{
+    std::deque<Task> discarded;
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    auto it = lanes_.find(id);
+    if (it == lanes_.end()) {
+        return;
+    }
+
+    discarded.swap(it->second.tasks);
+    it->second.closed = true;
+    unqueue(id, it->second);
+
+    if (it->second.running) {
+        // The worker running it erases it afterwards
+        if (it->second.runner == std::this_thread::get_id()) {
+            return;
+        }
+        idle_cv_.wait(lock, [this, id]() { return lanes_.find(id) == lanes_.end(); });
+        return;
+    }
+
+    lanes_.erase(it);
+}
+
+size_t DecodePool::pending(LaneId id) const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto it = lanes_.find(id);
+    return it != lanes_.end() ? it->second.tasks.size() : 0;
+}
+
+DecodeLaneStats DecodePool::lane_stats(LaneId id) const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto it = lanes_.find(id);
+    if (it == lanes_.end()) {
+        return {};
+    }
+    DecodeLaneStats stats = it->second.stats;
+    stats.pending = it->second.tasks.size();
+    stats.priority = it->second.priority;
+    return stats;
+}
+
+DecodePriorityStats DecodePool::priority_stats(DecodePriority priority) const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return priority_stats_[static_cast<int>(priority)];
+}
+
+size_t DecodePool::worker_count() const
+{
+    return workers_.size();
+}
+
+void DecodePool::make_ready(LaneId id, Lane& lane, bool by_home)
+{
+    if (lane.ready || lane.running || lane.tasks.empty()) {
+        return;
+    }
+
+    lane.ready = true;
+    Worker& home = *workers_[lane.home];
+    home.ready.push_back(id);
+
+    // The home worker if it is free, otherwise any idle one to steal it. The
+    // home worker requeueing a lane takes it next itself unless others wait.
+    if (home.idle) {
+        home.wake.notify_one();
+        return;
+    }
+    if (by_home && home.ready.size() == 1) {
+        return;
+    }
+    for (auto& worker : workers_) {
+        if (worker->idle) {
+            worker->wake.notify_one();
+            return;
+        }
+    }
+}
+
+void DecodePool::unqueue(LaneId id, Lane& lane)
+{
+    if (!lane.ready) {
+        return;
+    }
+    for (auto& worker : workers_) {
+        auto queued = std::find(worker->ready.begin(), worker->ready.end(), id);
+        if (queued != worker->ready.end()) {
+            worker->ready.erase(queued);
+            break;
+        }
+    }
+    lane.ready = false;
+}
+
+bool DecodePool::runs_before(LaneId id, LaneId other) const
+{
+    const Lane& a = lanes_.at(id);
+    const Lane& b = lanes_.at(other);
+    if (a.priority != b.priority) {
+        return a.priority < b.priority;
+    }
+    return a.tasks.front().deadline < b.tasks.front().deadline;
+}
+
+bool DecodePool::take(size_t index, LaneId& id, bool& stolen)
+{
+    // Queued lanes always have work: cancel() and close_lane() unqueue them.
+    // The most important class first and, within it, the earliest deadline;
+    // the worker's own lanes win a tie of class so warm decoders stay put.
+    Worker* owner = nullptr;
+    std::deque<LaneId>::iterator best;
+    Worker* thief_owner = nullptr;
+    std::deque<LaneId>::iterator thief_best;
+
+    for (size_t i = 0; i < workers_.size(); i++) {
+        Worker* worker = workers_[i].get();
+        for (auto queued = worker->ready.begin(); queued != worker->ready.end(); ++queued) {
+            if (i == index) {
+                if (!owner || runs_before(*queued, *best)) {
+                    owner = worker;
+                    best = queued;
+                }
+            } else if (!thief_owner || runs_before(*queued, *thief_best)) {
+                thief_owner = worker;
+                thief_best = queued;
+            }
+        }
+    }
+
+    stolen = false;
+    if (thief_owner && (!owner || lanes_.at(*thief_best).priority < lanes_.at(*best).priority)) {
+        owner = thief_owner;
+        best = thief_best;
+        stolen = true;
+    }
+    if (!owner) {
+        return false;
+    }
+
+    id = *best;
+    owner->ready.erase(best);
+    lanes_[id].ready = false;
+    return true;
+}
+
+void DecodePool::worker_loop(size_t index)
+{
+    Worker& self = *workers_[index];
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    while (true) {
+        LaneId id = 0;
+        bool stolen = false;
+        while (running_ && !take(index, id, stolen)) {
+            self.idle = true;
+            self.wake.wait(lock);
+            self.idle = false;
+        }
+        if (!running_) {
+            break;
+        }
+
+        Lane& lane = lanes_[id];
+        Task task = std::move(lane.tasks.front());
+        lane.tasks.pop_front();
+        lane.running = true;
+        lane.runner = std::this_thread::get_id();
+
+        auto now = std::chrono::steady_clock::now();
+        double delay_ms = std::chrono::duration<double, std::milli>(now - task.submitted).count();
+        DecodeLaneStats& stats = lane.stats;
+        stats.queue_delay_ms = stats.jobs == 0 ? delay_ms
+            : stats.queue_delay_ms + (delay_ms - stats.queue_delay_ms) / DELAY_SMOOTHING;
+        stats.last_queue_delay_ms = delay_ms;
+        stats.max_queue_delay_ms = std::max(stats.max_queue_delay_ms, delay_ms);
+        stats.jobs++;
+        if (stolen) {
+            stats.stolen++;
+        }
+
+        // The decoder's state is warm here now
+        lane.home = index;
+
+        lock.unlock();
+        try {
+            task.job();
+        } catch (const std::exception& e) {
+            BLOG_ERROR("Exception in decode job: %s", e.what());
+        } catch (...) {
+            BLOG_ERROR("Unknown exception in decode job");
+        }
+        task.job = nullptr;
+        bool missed = std::chrono::steady_clock::now() > task.deadline;
+        lock.lock();
+
+        // Lane references do not survive the unlock
+        auto it = lanes_.find(id);
+        if (it != lanes_.end()) {
+            DecodePriorityStats& by_priority = priority_stats_[static_cast<int>(it->second.priority)];
+            by_priority.jobs++;
+            if (missed) {
+                it->second.stats.deadline_misses++;
+                by_priority.deadline_misses++;
+            }
+
+            it->second.running = false;
+            if (it->second.closed) {
+                lanes_.erase(it);
+            } else {
+                // Its next job is due later than those that waited, so one busy
+                // source cannot starve the rest of its class
+                make_ready(id, it->second, true);
+            }
+        }
+        idle_cv_.notify_all();
+    }
+}
+
+} // namespace berrystreamcam
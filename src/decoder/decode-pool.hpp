@@ -0,0 +1,168 @@
+#pragma once
+
+#include "../common.hpp"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace berrystreamcam {
+
+/**
+ * How much a source's frames matter right now. Lower runs first.
+ */
+enum class DecodePriority {
+    PROGRAM,   // On air
+    PREVIEW,   // Showing somewhere else: preview, projector, multiview
+    HIDDEN
+};
+
+inline const char* decode_priority_to_string(DecodePriority priority) {
+    switch (priority) {
+        case DecodePriority::PROGRAM: return "program";
+        case DecodePriority::PREVIEW: return "preview";
+        case DecodePriority::HIDDEN: return "hidden";
+    }
+    return "hidden";
+}
+
+/**
+ * Jobs run by the pool for one priority class, summed over its lanes.
+ */
+struct DecodePriorityStats {
+    uint64_t jobs;
+    uint64_t deadline_misses;     // Finished after their deadline
+};
+
+/**
+ * Decode work of one source as seen by the pool.
+ */
+struct DecodeLaneStats {
+    uint64_t jobs;                // Run so far
+    uint64_t stolen;              // Run by a worker other than the lane's home
+    uint64_t discarded;           // Dropped by cancel() before they ran
+    size_t pending;
+    double queue_delay_ms;        // Submit to start, smoothed
+    double last_queue_delay_ms;
+    double max_queue_delay_ms;
+    uint64_t deadline_misses;     // Finished after their deadline
+    DecodePriority priority;
+};
+
+/**
+ * Process-wide work-stealing executor for video decoding.
+ *
+ * Every source opens a lane and submits its decode jobs to it. Jobs of
+ * one lane run one at a time and in order, because a decoder carries
+ * state from frame to frame, but different lanes run in parallel on a
+ * fixed set of workers sized to the machine. A lane that has work is
+ * queued on its home worker, the one that ran it last, so the decoder's
+ * state stays in that core's cache; a worker with nothing of its own
+ * steals ready lanes from the busiest other worker, so a busy source can
+ * use cores that quiet ones leave idle.
+ *
+ * Every job carries a deadline, normally the time its frame is due on
+ * screen. A worker always picks from the most important priority class
+ * that has work anywhere in the pool, and within that class the lane
+ * whose next job is due first, preferring its own queue over stealing.
+ * A saturated pool therefore delays hidden sources before preview ones
+ * and preview ones before the program.
+ */
+class DecodePool {
+public:
+    using Job = std::function<void()>;
+    using LaneId = uint64_t;
+
+    // Deadline of a job submitted without one: a frame at 30 fps
+    static constexpr int DEFAULT_DEADLINE_MS = 33;
+
+    /**
+     * The shared pool, one worker per hardware thread. Workers stop when
+     * the last holder drops its reference.
+     */
+    static std::shared_ptr<DecodePool> acquire();
+
+    explicit DecodePool(size_t worker_count);
+    ~DecodePool();
+
+    DecodePool(const DecodePool&) = delete;
+    DecodePool& operator=(const DecodePool&) = delete;
+
+    LaneId open_lane(DecodePriority priority = DecodePriority::PROGRAM);
+
+    /**
+     * Move a lane to another priority class; queued jobs follow it.
+     */
+    void set_lane_priority(LaneId lane, DecodePriority priority);
+
+    /**
+     * Queue job behind the lane's earlier jobs, due deadline_ms from now.
+     * Returns false for a lane that is not open.
+     */
+    bool submit(LaneId lane, Job job, int deadline_ms = DEFAULT_DEADLINE_MS);
+
+    /**
+     * Drop the lane's queued jobs and wait for the running one; the lane
+     * stays open. Called from one of the lane's own jobs it does not wait.
+     */
+    void cancel(LaneId lane);
+
+    /**
+     * cancel() and forget the lane.
+     */
+    void close_lane(LaneId lane);
+
+    size_t pending(LaneId lane) const;
+    DecodeLaneStats lane_stats(LaneId lane) const;
+    DecodePriorityStats priority_stats(DecodePriority priority) const;
+    size_t worker_count() const;
+
+private:
+    struct Task {
+        Job job;
+        std::chrono::steady_clock::time_point submitted;
+        std::chrono::steady_clock::time_point deadline;
+    };
+
+    struct Lane {
+        std::deque<Task> tasks;
+        size_t home;              // Worker whose ready queue it joins
+        bool ready;               // In some worker's ready queue
+        bool running;
+        bool closed;              // close_lane() from its own job; erased after it
+        std::thread::id runner;
+        DecodePriority priority;
+        DecodeLaneStats stats;
+    };
+
+    struct Worker {
+        std::deque<LaneId> ready;
+        std::condition_variable wake;
+        bool idle = false;
+    };
+
+    void worker_loop(size_t index);
+    bool take(size_t index, LaneId& lane, bool& stolen);
+    bool runs_before(LaneId id, LaneId other) const;
+    void make_ready(LaneId id, Lane& lane, bool by_home);
+    void unqueue(LaneId id, Lane& lane);
+
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::vector<std::thread> threads_;
+    bool running_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable idle_cv_;    // cancel() waits out a running job
+    std::map<LaneId, Lane> lanes_;
+    LaneId next_lane_;
+    size_t next_home_;
+    DecodePriorityStats priority_stats_[3];   // Indexed by DecodePriority
+};
+
+} // namespace berrystreamcam
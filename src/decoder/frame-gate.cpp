@@ -0,0 +1,33 @@
+#include "frame-gate.hpp"
+
+namespace berrystreamcam {
+
+FrameGate::FrameGate()
+    : waiting_(false)
+{
+}
+
+bool FrameGate::admit(const VideoFrame& frame)
+{
+    if (frame.is_corrupt) {
+        if (!waiting_) {
+            BLOG_DEBUG("Corrupt frame, dropping until the next intact keyframe");
+        }
+        waiting_ = true;
+        return false;
+    }
+
+    if (waiting_ && !frame.is_keyframe) {
+        return false;
+    }
+
+    waiting_ = false;
+    return true;
+}
+
+void FrameGate::reset()
+{
+    waiting_ = false;
+}
+
+} // namespace berrystreamcam
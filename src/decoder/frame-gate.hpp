@@ -0,0 +1,36 @@
+#pragma once
+
+#include "../common.hpp"
+
+namespace berrystreamcam {
+
+/**
+ * Keeps frames that depend on a damaged picture away from the decoder.
+ *
+ * Once a frame arrives with is_corrupt set, it and every frame after it
+ * are refused until an intact keyframe: predicted frames reference the
+ * broken picture and would carry its damage forward until the next IDR.
+ *
+ * Not thread-safe; the streaming thread owns it.
+ */
+class FrameGate {
+public:
+    FrameGate();
+
+    /**
+     * Whether frame may go on to be decoded.
+     */
+    bool admit(const VideoFrame& frame);
+
+    /**
+     * The stream starts over, e.g. on a cutover keyframe.
+     */
+    void reset();
+
+    bool waiting_for_keyframe() const { return waiting_; }
+
+private:
+    bool waiting_;
+};
+
+} // namespace berrystreamcam
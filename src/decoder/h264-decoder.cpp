@@ -1,8 +1,56 @@
 #include "h264-decoder.hpp"
+#include <algorithm>
 #include <cstring>
 
 namespace berrystreamcam {
 
+namespace {
+
+// Whether an H.264 access unit brings its own SPS, so a fresh decoder can
+// start on it
+bool carries_sps(const uint8_t* data, size_t size)
+{
+    for (size_t i = 0; i + 3 < size; i++) {
+        if (data[i] != 0x00 || data[i + 1] != 0x00 || data[i + 2] != 0x01) {
+            continue;
+        }
+        uint8_t type = data[i + 3] & 0x1F;
+        if (type == 7) {
+            return true;
+        }
+        if (type >= 1 && type <= 5) {
+            return false;   // Slices come after the parameter sets
+        }
+        i += 2;
+    }
+    return false;
+}
+
+SwsContext* create_scaler(int width, int height, AVPixelFormat format, int threads)
+{
+    SwsContext* scaler = sws_alloc_context();
+    if (!scaler) {
+        return nullptr;
+    }
+
+    av_opt_set_int(scaler, "srcw", width, 0);
+    av_opt_set_int(scaler, "srch", height, 0);
+    av_opt_set_int(scaler, "src_format", format, 0);
+    av_opt_set_int(scaler, "dstw", width, 0);
+    av_opt_set_int(scaler, "dsth", height, 0);
+    av_opt_set_int(scaler, "dst_format", AV_PIX_FMT_RGBA, 0);
+    av_opt_set_int(scaler, "sws_flags", SWS_FAST_BILINEAR, 0);
+    av_opt_set_int(scaler, "threads", threads, 0);   // Unknown before FFmpeg 5; ignored there
+
+    if (sws_init_context(scaler, nullptr, nullptr) < 0) {
+        sws_freeContext(scaler);
+        return nullptr;
+    }
+    return scaler;
+}
+
+} // namespace
+
 H264Decoder::H264Decoder()
     : codec_(nullptr)
     , codec_context_(nullptr)
@@ -13,6 +61,11 @@ H264Decoder::H264Decoder()
     , rgba_buffer_size_(0)
     , last_width_(0)
     , last_height_(0)
+    , threads_(1)
+    , codec_threads_(1)
+    , scaler_threads_(1)
+    , skip_nonref_(false)
+    , rgba_frame_(nullptr)
 {
 }
 
@@ -29,29 +82,7 @@ bool H264Decoder::initialize()
     av_log_set_level(AV_LOG_QUIET);
 
     // Start with H.264 decoder (will auto-switch to MJPEG if needed)
-    codec_ = avcodec_find_decoder(AV_CODEC_ID_H264);
-    if (!codec_) {
-        BLOG_ERROR("H.264 decoder not found");
-        return false;
-    }
-
-    // Create codec context
-    codec_context_ = avcodec_alloc_context3(codec_);
-    if (!codec_context_) {
-        BLOG_ERROR("Failed to allocate codec context");
-        return false;
-    }
-
-    // Configure codec context for low latency
-    codec_context_->flags |= AV_CODEC_FLAG_LOW_DELAY;
-    codec_context_->flags2 |= AV_CODEC_FLAG2_FAST;
-    codec_context_->thread_count = 4;
-    codec_context_->thread_type = FF_THREAD_SLICE;
-
-    // Open codec
-    if (avcodec_open2(codec_context_, codec_, nullptr) < 0) {
-        BLOG_ERROR("Failed to open codec");
-        avcodec_free_context(&codec_context_);
+    if (!open_codec(AV_CODEC_ID_H264)) {
         return false;
     }
 
@@ -63,10 +94,19 @@ bool H264Decoder::initialize()
         return false;
     }
 
+    rgba_frame_ = av_frame_alloc();
+    if (!rgba_frame_) {
+        BLOG_ERROR("Failed to allocate RGBA frame");
+        av_frame_free(&frame_);
+        avcodec_free_context(&codec_context_);
+        return false;
+    }
+
     // Allocate packet
     packet_ = av_packet_alloc();
     if (!packet_) {
         BLOG_ERROR("Failed to allocate packet");
+        av_frame_free(&rgba_frame_);
         av_frame_free(&frame_);
         avcodec_free_context(&codec_context_);
         return false;
@@ -97,6 +137,10 @@ void H264Decoder::shutdown()
         av_frame_free(&frame_);
     }
 
+    if (rgba_frame_) {
+        av_frame_free(&rgba_frame_);
+    }
+
     if (codec_context_) {
         avcodec_free_context(&codec_context_);
     }
@@ -114,6 +158,54 @@ void H264Decoder::flush()
     }
 }
 
+void H264Decoder::set_threads(int threads)
+{
+    threads_ = std::max(threads, 1);
+}
+
+void H264Decoder::set_skip_nonref(bool skip)
+{
+    skip_nonref_ = skip;
+}
+
+bool H264Decoder::open_codec(AVCodecID codec_id)
+{
+    if (codec_context_) {
+        avcodec_free_context(&codec_context_);
+    }
+
+    codec_ = avcodec_find_decoder(codec_id);
+    if (!codec_) {
+        BLOG_ERROR("%s decoder not found", avcodec_get_name(codec_id));
+        return false;
+    }
+
+    codec_context_ = avcodec_alloc_context3(codec_);
+    if (!codec_context_) {
+        BLOG_ERROR("Failed to allocate %s codec context", avcodec_get_name(codec_id));
+        return false;
+    }
+
+    // Configure codec context for low latency
+    codec_context_->flags |= AV_CODEC_FLAG_LOW_DELAY;
+    codec_context_->flags2 |= AV_CODEC_FLAG2_FAST;
+    // Threads come from the DecodeBudget, which counts the DecodePool job this
+    // decoder runs on as the first. Slice threads only: frame threads would
+    // each hold back a frame.
+    codec_context_->thread_count = threads_;
+    codec_context_->thread_type = FF_THREAD_SLICE;
+
+    if (avcodec_open2(codec_context_, codec_, nullptr) < 0) {
+        BLOG_ERROR("Failed to open %s codec", avcodec_get_name(codec_id));
+        avcodec_free_context(&codec_context_);
+        return false;
+    }
+
+    codec_threads_ = threads_;
+    BLOG_DEBUG("Opened %s decoder with %d threads", avcodec_get_name(codec_id), codec_threads_);
+    return true;
+}
+
 bool H264Decoder::decode_frame(const uint8_t* encoded_data, size_t encoded_size,
                               uint8_t** decoded_data, int* width, int* height)
 {
@@ -128,67 +220,27 @@ bool H264Decoder::decode_frame(const uint8_t* encoded_data, size_t encoded_size,
                     (encoded_data[2] == 0x00 || encoded_data[2] == 0x01));
 
     if (is_mjpeg && codec_context_->codec_id != AV_CODEC_ID_MJPEG) {
-        // Switch to MJPEG decoder
         BLOG_INFO("Detected MJPEG stream, switching decoder");
-
-        // Close current codec
-        avcodec_free_context(&codec_context_);
-
-        // Open MJPEG decoder
-        codec_ = avcodec_find_decoder(AV_CODEC_ID_MJPEG);
-        if (!codec_) {
-            BLOG_ERROR("MJPEG decoder not found");
+        if (!open_codec(AV_CODEC_ID_MJPEG)) {
             return false;
         }
-
-        codec_context_ = avcodec_alloc_context3(codec_);
-        if (!codec_context_) {
-            BLOG_ERROR("Failed to allocate MJPEG codec context");
-            return false;
-        }
-
-        codec_context_->flags |= AV_CODEC_FLAG_LOW_DELAY;
-        codec_context_->flags2 |= AV_CODEC_FLAG2_FAST;
-
-        if (avcodec_open2(codec_context_, codec_, nullptr) < 0) {
-            BLOG_ERROR("Failed to open MJPEG codec");
-            avcodec_free_context(&codec_context_);
-            return false;
-        }
-
         BLOG_INFO("Switched to MJPEG decoder");
     } else if (is_h264 && codec_context_->codec_id != AV_CODEC_ID_H264) {
-        // Switch to H.264 decoder
         BLOG_INFO("Detected H.264 stream, switching decoder");
-
-        // Close current codec
-        avcodec_free_context(&codec_context_);
-
-        // Open H.264 decoder
-        codec_ = avcodec_find_decoder(AV_CODEC_ID_H264);
-        if (!codec_) {
-            BLOG_ERROR("H.264 decoder not found");
-            return false;
-        }
-
-        codec_context_ = avcodec_alloc_context3(codec_);
-        if (!codec_context_) {
-            BLOG_ERROR("Failed to allocate H.264 codec context");
+        if (!open_codec(AV_CODEC_ID_H264)) {
             return false;
         }
-
-        codec_context_->flags |= AV_CODEC_FLAG_LOW_DELAY;
-        codec_context_->flags2 |= AV_CODEC_FLAG2_FAST;
-
-        if (avcodec_open2(codec_context_, codec_, nullptr) < 0) {
-            BLOG_ERROR("Failed to open H.264 codec");
-            avcodec_free_context(&codec_context_);
+        BLOG_INFO("Switched to H.264 decoder");
+    } else if (threads_ != codec_threads_ &&
+               (codec_context_->codec_id == AV_CODEC_ID_MJPEG || carries_sps(encoded_data, encoded_size))) {
+        // Nothing before this frame is needed again, so a new thread count is free
+        if (!open_codec(codec_context_->codec_id)) {
             return false;
         }
-
-        BLOG_INFO("Switched to H.264 decoder");
     }
 
+    codec_context_->skip_frame = skip_nonref_ ? AVDISCARD_NONREF : AVDISCARD_DEFAULT;
+
     // Prepare packet
     packet_->data = const_cast<uint8_t*>(encoded_data);
     packet_->size = encoded_size;
@@ -225,17 +277,16 @@ bool H264Decoder::decode_frame(const uint8_t* encoded_data, size_t encoded_size,
     // Check if we need to recreate swscale context
     if (!sws_context_ ||
         frame_->width != last_width_ ||
-        frame_->height != last_height_) {
+        frame_->height != last_height_ ||
+        threads_ != scaler_threads_) {
 
         if (sws_context_) {
             sws_freeContext(sws_context_);
         }
 
-        sws_context_ = sws_getContext(
-            frame_->width, frame_->height, static_cast<AVPixelFormat>(frame_->format),
-            frame_->width, frame_->height, AV_PIX_FMT_RGBA,
-            SWS_FAST_BILINEAR, nullptr, nullptr, nullptr
-        );
+        // Conversion follows decoding in the same job, so it reuses the threads
+        sws_context_ = create_scaler(frame_->width, frame_->height,
+                                     static_cast<AVPixelFormat>(frame_->format), threads_);
 
         if (!sws_context_) {
             BLOG_ERROR("Failed to create swscale context");
@@ -244,9 +295,31 @@ bool H264Decoder::decode_frame(const uint8_t* encoded_data, size_t encoded_size,
 
         last_width_ = frame_->width;
         last_height_ = frame_->height;
+        scaler_threads_ = threads_;
     }
 
     // Convert YUV to RGBA
+#if LIBSWSCALE_VERSION_MAJOR >= 6
+    if (scaler_threads_ > 1) {
+        // Only the frame API converts slices in parallel; the frame borrows rgba_buffer_
+        rgba_frame_->format = AV_PIX_FMT_RGBA;
+        rgba_frame_->width = frame_->width;
+        rgba_frame_->height = frame_->height;
+        rgba_frame_->data[0] = rgba_buffer_;
+        rgba_frame_->linesize[0] = frame_->width * 4;
+        rgba_frame_->buf[0] = av_buffer_create(rgba_buffer_, rgba_buffer_size_,
+                                               [](void*, uint8_t*) {}, nullptr, 0);
+        int ret = rgba_frame_->buf[0] ? sws_scale_frame(sws_context_, rgba_frame_, frame_)
+                                      : AVERROR(ENOMEM);
+        av_frame_unref(rgba_frame_);
+        if (ret < 0) {
+            return false;
+        }
+        *decoded_data = rgba_buffer_;
+        return true;
+    }
+#endif
+
     uint8_t* dst_data[1] = { rgba_buffer_ };
     int dst_linesize[1] = { frame_->width * 4 };
 
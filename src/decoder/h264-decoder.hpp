@@ -5,6 +5,7 @@
 extern "C" {
 #include <libavcodec/avcodec.h>
 #include <libavutil/imgutils.h>
+#include <libavutil/opt.h>
 #include <libswscale/swscale.h>
 }
 
@@ -19,10 +20,23 @@ public:
     void shutdown();
     void flush();
 
+    /**
+     * Threads to decode and convert with, as granted by the DecodeBudget.
+     * A new count takes effect at the next keyframe.
+     */
+    void set_threads(int threads);
+
+    /**
+     * Drop frames no other frame refers to, for a source over budget.
+     */
+    void set_skip_nonref(bool skip);
+
     bool decode_frame(const uint8_t* encoded_data, size_t encoded_size,
                      uint8_t** decoded_data, int* width, int* height);
 
 private:
+    bool open_codec(AVCodecID codec_id);
+
     const AVCodec* codec_;
     AVCodecContext* codec_context_;
     AVFrame* frame_;
@@ -34,6 +48,12 @@ private:
 
     int last_width_;
     int last_height_;
+
+    int threads_;            // Wanted
+    int codec_threads_;      // The open codec's
+    int scaler_threads_;     // The scaler's
+    bool skip_nonref_;
+    AVFrame* rgba_frame_;    // Wraps rgba_buffer_ for threaded conversion
 };
 
 } // namespace berrystreamcam
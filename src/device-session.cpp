@@ -0,0 +1,243 @@
+#include "device-session.hpp"
+#include <algorithm>
+
+namespace berrystreamcam {
+
+namespace {
+
+std::mutex instance_mutex;
+std::weak_ptr<DeviceSessionManager> instance;
+
+} // namespace
+
+PictureRegion layout_picture(const PictureLayout& layout, uint32_t width, uint32_t height)
+{
+    PictureRegion region = { 0, 0, width, height, width, height };
+
+    uint64_t crop_x = static_cast<uint64_t>(layout.crop_left) + layout.crop_right;
+    uint64_t crop_y = static_cast<uint64_t>(layout.crop_top) + layout.crop_bottom;
+    if (crop_x < width && crop_y < height) {
+        region.x = layout.crop_left;
+        region.y = layout.crop_top;
+        region.width = width - static_cast<uint32_t>(crop_x);
+        region.height = height - static_cast<uint32_t>(crop_y);
+    }
+
+    region.output_width = region.width;
+    region.output_height = region.height;
+    if (layout.scale_width > 0 && layout.scale_height > 0) {
+        region.output_width = layout.scale_width;
+        region.output_height = layout.scale_height;
+    } else if (layout.scale_width > 0) {
+        region.output_width = layout.scale_width;
+        region.output_height = std::max<uint32_t>(1,
+            static_cast<uint32_t>(static_cast<uint64_t>(region.height) * layout.scale_width / region.width));
+    } else if (layout.scale_height > 0) {
+        region.output_height = layout.scale_height;
+        region.output_width = std::max<uint32_t>(1,
+            static_cast<uint32_t>(static_cast<uint64_t>(region.width) * layout.scale_height / region.height));
+    }
+    return region;
+}
+
+std::shared_ptr<DeviceSessionManager> DeviceSessionManager::acquire()
+{
+    std::lock_guard<std::mutex> lock(instance_mutex);
+
+    std::shared_ptr<DeviceSessionManager> manager = instance.lock();
+    if (!manager) {
+        manager = std::make_shared<DeviceSessionManager>();
+        instance = manager;
+    }
+    return manager;
+}
+
+std::string DeviceSessionManager::key_for(const std::string& device_ip, ProtocolType protocol)
+{
+    if (device_ip.empty()) {
+        return std::string();
+    }
+    return device_ip + "/" + protocol_to_string(protocol);
+}
+
+DeviceSessionManager::DeviceSessionManager()
+    : next_member_(1)
+    , next_since_(1)
+{
+}
+
+DeviceSessionManager::MemberId DeviceSessionManager::join(PictureSink sink, RoleListener on_role)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    MemberId id = next_member_++;
+    Member& member = members_[id];
+    member.streaming = false;
+    member.since = 0;
+    member.published = 0;
+    member.received = 0;
+    member.sink = std::move(sink);
+    member.on_role = std::move(on_role);
+    return id;
+}
+
+void DeviceSessionManager::leave(MemberId id)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto it = members_.find(id);
+    if (it == members_.end()) {
+        return;
+    }
+    std::string key = it->second.key;
+    MemberId before = publisher_of(key);
+    members_.erase(it);
+    notify(key, before);
+}
+
+void DeviceSessionManager::set_key(MemberId id, const std::string& key)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto it = members_.find(id);
+    if (it == members_.end() || it->second.key == key) {
+        return;
+    }
+
+    std::string old_key = it->second.key;
+    MemberId old_before = publisher_of(old_key);
+    MemberId new_before = publisher_of(key);
+
+    it->second.key = key;
+    if (it->second.streaming) {
+        it->second.since = next_since_++;   // Joins the new session last
+    }
+
+    notify(old_key, old_before);
+    notify(key, new_before);
+}
+
+void DeviceSessionManager::set_streaming(MemberId id, bool streaming)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto it = members_.find(id);
+    if (it == members_.end() || it->second.streaming == streaming) {
+        return;
+    }
+
+    MemberId before = publisher_of(it->second.key);
+    it->second.streaming = streaming;
+    if (streaming) {
+        it->second.since = next_since_++;
+    }
+    notify(it->second.key, before);
+}
+
+bool DeviceSessionManager::is_publisher(MemberId id) const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto it = members_.find(id);
+    if (it == members_.end()) {
+        return false;
+    }
+    // Without a device there is nothing to share
+    return it->second.key.empty() || publisher_of(it->second.key) == id;
+}
+
+size_t DeviceSessionManager::audience(MemberId id) const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto it = members_.find(id);
+    if (it == members_.end() || it->second.key.empty()) {
+        return 0;
+    }
+
+    size_t count = 0;
+    for (const auto& entry : members_) {
+        if (entry.first != id && entry.second.streaming && entry.second.key == it->second.key) {
+            count++;
+        }
+    }
+    return count;
+}
+
+void DeviceSessionManager::publish(MemberId id, const PictureRef& picture)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto it = members_.find(id);
+    if (it == members_.end() || it->second.key.empty() || publisher_of(it->second.key) != id) {
+        return;
+    }
+
+    it->second.published++;
+    for (auto& entry : members_) {
+        Member& member = entry.second;
+        if (entry.first != id && member.streaming && member.key == it->second.key) {
+            member.received++;
+            if (member.sink) {
+                member.sink(picture);
+            }
+        }
+    }
+}
+
+DeviceSessionStats DeviceSessionManager::stats(MemberId id) const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    DeviceSessionStats stats = {};
+    auto it = members_.find(id);
+    if (it == members_.end()) {
+        return stats;
+    }
+
+    stats.key = it->second.key;
+    stats.publisher = !stats.key.empty() && publisher_of(stats.key) == id;
+    stats.published = it->second.published;
+    stats.received = it->second.received;
+    for (const auto& entry : members_) {
+        if (entry.second.streaming && !stats.key.empty() && entry.second.key == stats.key) {
+            stats.members++;
+        }
+    }
+    return stats;
+}
+
+DeviceSessionManager::MemberId DeviceSessionManager::publisher_of(const std::string& key) const
+{
+    if (key.empty()) {
+        return 0;
+    }
+
+    MemberId publisher = 0;
+    uint64_t earliest = 0;
+    for (const auto& entry : members_) {
+        const Member& member = entry.second;
+        if (member.streaming && member.key == key && (publisher == 0 || member.since < earliest)) {
+            publisher = entry.first;
+            earliest = member.since;
+        }
+    }
+    return publisher;
+}
+
+void DeviceSessionManager::notify(const std::string& key, MemberId before)
+{
+    if (key.empty() || publisher_of(key) == before) {
+        return;
+    }
+
+    BLOG_DEBUG("Session %s now published by member %llu", key.c_str(),
+               static_cast<unsigned long long>(publisher_of(key)));
+    for (auto& entry : members_) {
+        if (entry.second.key == key && entry.second.on_role) {
+            entry.second.on_role();
+        }
+    }
+}
+
+} // namespace berrystreamcam
@@ -0,0 +1,142 @@
+#pragma once
+
+#include "common.hpp"
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace berrystreamcam {
+
+/**
+ * One decoded RGBA frame, shared read-only by every source showing it.
+ */
+struct DecodedPicture {
+    std::unique_ptr<uint8_t[]> rgba;
+    uint32_t width;
+    uint32_t height;
+};
+
+using PictureRef = std::shared_ptr<const DecodedPicture>;
+
+/**
+ * Crop in pixels and output size one source applies to a shared picture.
+ * A zero output dimension follows the other one's aspect; both zero keep
+ * the cropped size.
+ */
+struct PictureLayout {
+    uint32_t crop_left;
+    uint32_t crop_top;
+    uint32_t crop_right;
+    uint32_t crop_bottom;
+    uint32_t scale_width;
+    uint32_t scale_height;
+};
+
+/**
+ * Where a layout lands on a width x height picture: the rectangle to upload
+ * and the size to draw it at.
+ */
+struct PictureRegion {
+    uint32_t x;
+    uint32_t y;
+    uint32_t width;
+    uint32_t height;
+    uint32_t output_width;
+    uint32_t output_height;
+};
+
+/**
+ * A crop that leaves nothing is ignored rather than drawing an empty source.
+ */
+PictureRegion layout_picture(const PictureLayout& layout, uint32_t width, uint32_t height);
+
+/**
+ * A source's view of the session it belongs to.
+ */
+struct DeviceSessionStats {
+    std::string key;
+    size_t members;           // Sources streaming this device and protocol
+    bool publisher;           // This source holds the connection
+    uint64_t published;       // Pictures this source shared with the others
+    uint64_t received;        // Pictures it was given by another source
+};
+
+/**
+ * Process-wide registry of device sessions, so several OBS sources showing
+ * the same phone share one connection and one decoder.
+ *
+ * Sources join once and tag themselves with a key naming the device and
+ * protocol they stream. Of the members of one key that are streaming, the
+ * one that started first is the publisher: it alone connects and decodes,
+ * and hands every decoded picture to the others, which only upload it. When
+ * the publisher pauses, stops or moves to another key, the next streaming
+ * member takes over and connects itself.
+ *
+ * Sinks and role listeners run under the registry's lock; they must be
+ * quick and must not call back into it.
+ */
+class DeviceSessionManager {
+public:
+    using MemberId = uint64_t;
+    using PictureSink = std::function<void(const PictureRef&)>;
+    using RoleListener = std::function<void()>;   // The member's publisher may have changed
+
+    static std::shared_ptr<DeviceSessionManager> acquire();
+
+    static std::string key_for(const std::string& device_ip, ProtocolType protocol);
+
+    DeviceSessionManager();
+
+    DeviceSessionManager(const DeviceSessionManager&) = delete;
+    DeviceSessionManager& operator=(const DeviceSessionManager&) = delete;
+
+    /**
+     * A new member, without a key and not streaming.
+     */
+    MemberId join(PictureSink sink, RoleListener on_role);
+
+    /**
+     * Once this returns the member's sink and listener do not run again.
+     */
+    void leave(MemberId id);
+
+    void set_key(MemberId id, const std::string& key);
+    void set_streaming(MemberId id, bool streaming);
+
+    bool is_publisher(MemberId id) const;
+
+    /**
+     * Other streaming members that would receive a published picture.
+     */
+    size_t audience(MemberId id) const;
+
+    /**
+     * Hand picture to the rest of the session. Ignored unless id publishes.
+     */
+    void publish(MemberId id, const PictureRef& picture);
+
+    DeviceSessionStats stats(MemberId id) const;
+
+private:
+    struct Member {
+        std::string key;
+        bool streaming;
+        uint64_t since;       // Order in which it started streaming
+        uint64_t published;
+        uint64_t received;
+        PictureSink sink;
+        RoleListener on_role;
+    };
+
+    MemberId publisher_of(const std::string& key) const;
+    void notify(const std::string& key, MemberId before);
+
+    mutable std::mutex mutex_;
+    std::map<MemberId, Member> members_;
+    MemberId next_member_;
+    uint64_t next_since_;
+};
+
+} // namespace berrystreamcam
@@ -0,0 +1,213 @@
+#include "capability-probe.hpp"
+#include <QByteArray>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <algorithm>
+
+namespace berrystreamcam {
+
+namespace {
+
+// Lowest latency first; UDP with FEC rides out the losses RTSP shows
+const ProtocolType PROTOCOL_PREFERENCE[] = {
+    ProtocolType::UDP_FEC,
+    ProtocolType::RTSP,
+    ProtocolType::WEBSOCKET_OBS_DROID,
+    ProtocolType::HTTP_RAW_H264,
+    ProtocolType::HTTP_DASH,
+    ProtocolType::HTTP_MJPEG,
+};
+
+bool carries_h264(ProtocolType type)
+{
+    return type != ProtocolType::HTTP_MJPEG;
+}
+
+const char* url_scheme(ProtocolType type)
+{
+    switch (type) {
+        case ProtocolType::WEBSOCKET_OBS_DROID:
+            return "ws";
+        case ProtocolType::RTSP:
+            return "rtsp";
+        case ProtocolType::UDP_FEC:
+            return "udpfec";
+        default:
+            return "http";
+    }
+}
+
+int default_port(ProtocolType type)
+{
+    switch (type) {
+        case ProtocolType::WEBSOCKET_OBS_DROID:
+            return WEBSOCKET_PORT;
+        case ProtocolType::RTSP:
+            return RTSP_PORT;
+        case ProtocolType::UDP_FEC:
+            return UDP_FEC_PORT;
+        case ProtocolType::HTTP_RAW_H264:
+        case ProtocolType::HTTP_MJPEG:
+        case ProtocolType::HTTP_DASH:
+            return HTTP_PORT;
+        default:
+            return 0;
+    }
+}
+
+const char* default_path(ProtocolType type)
+{
+    switch (type) {
+        case ProtocolType::HTTP_RAW_H264:
+            return "/stream.h264";
+        case ProtocolType::HTTP_MJPEG:
+            return "/mjpeg";
+        case ProtocolType::HTTP_DASH:
+            return "/dash/manifest.mpd";
+        case ProtocolType::UDP_FEC:
+            return "";
+        default:
+            return "/stream";
+    }
+}
+
+std::string protocol_url(ProtocolType type, const std::string& ip, int port, const std::string& path)
+{
+    return std::string(url_scheme(type)) + "://" + ip + ":" + std::to_string(port) + path;
+}
+
+} // namespace
+
+ProtocolType protocol_from_name(const std::string& name)
+{
+    if (name == "websocket") {
+        return ProtocolType::WEBSOCKET_OBS_DROID;
+    } else if (name == "rtsp") {
+        return ProtocolType::RTSP;
+    } else if (name == "http_h264") {
+        return ProtocolType::HTTP_RAW_H264;
+    } else if (name == "mjpeg") {
+        return ProtocolType::HTTP_MJPEG;
+    } else if (name == "dash") {
+        return ProtocolType::HTTP_DASH;
+    } else if (name == "udp_fec") {
+        return ProtocolType::UDP_FEC;
+    }
+    return ProtocolType::UNKNOWN;
+}
+
+ProtocolInfo default_protocol_info(ProtocolType type, const std::string& ip)
+{
+    ProtocolInfo proto;
+    proto.type = type;
+    proto.port = default_port(type);
+    proto.url = protocol_url(type, ip, proto.port, default_path(type));
+    proto.is_available = proto.port != 0;
+    proto.connected_clients = 0;
+    return proto;
+}
+
+bool parse_capability_document(const std::string& json, const std::string& ip, StreamDevice& device)
+{
+    if (json.empty() || json.size() > MAX_CAPABILITY_DOCUMENT_BYTES) {
+        return false;
+    }
+
+    QJsonParseError error;
+    QJsonDocument doc = QJsonDocument::fromJson(
+        QByteArray(json.data(), static_cast<int>(json.size())), &error);
+    if (error.error != QJsonParseError::NoError || !doc.isObject()) {
+        return false;
+    }
+
+    QJsonObject root = doc.object();
+    if (!root["protocols"].isArray()) {
+        return false;
+    }
+
+    std::vector<ProtocolInfo> protocols;
+    for (const auto& value : root["protocols"].toArray()) {
+        QJsonObject entry = value.toObject();
+        ProtocolType type = protocol_from_name(entry["type"].toString().toStdString());
+        if (type == ProtocolType::UNKNOWN) {
+            continue;
+        }
+
+        // Keep the first entry of each type
+        bool duplicate = std::any_of(protocols.begin(), protocols.end(),
+            [type](const ProtocolInfo& p) { return p.type == type; });
+        if (duplicate) {
+            continue;
+        }
+
+        int port = entry["port"].toInt(default_port(type));
+        if (port <= 0 || port > 65535) {
+            port = default_port(type);
+        }
+        std::string path = entry["path"].toString().toStdString();
+        if (path.empty() || path[0] != '/') {
+            path = default_path(type);
+        }
+
+        ProtocolInfo proto;
+        proto.type = type;
+        proto.port = port;
+        proto.url = protocol_url(type, ip, port, path);
+        proto.is_available = true;
+        proto.connected_clients = std::max(0, entry["clients"].toInt(0));
+        protocols.push_back(proto);
+    }
+
+    std::vector<std::string> codecs;
+    for (const auto& value : root["codecs"].toArray()) {
+        std::string codec = value.toString().toLower().toStdString();
+        if (!codec.empty()) {
+            codecs.push_back(codec);
+        }
+    }
+
+    QString name = root["name"].toString();
+    device.name = name.isEmpty() ? "Streamberry-" + ip : name.toStdString();
+    device.ip_address = ip;
+    device.available_protocols = protocols;
+    device.is_active = !protocols.empty();
+    device.capabilities_known = true;
+    device.codecs = codecs;
+    device.width = std::max(0, root["width"].toInt(0));
+    device.height = std::max(0, root["height"].toInt(0));
+    device.fps = std::max(0, root["fps"].toInt(0));
+    device.connected_clients = std::max(0, root["clients"].toInt(0));
+
+    return true;
+}
+
+const ProtocolInfo* best_protocol(const StreamDevice& device)
+{
+    auto ranked = ranked_protocols(device);
+    return ranked.empty() ? nullptr : ranked.front();
+}
+
+std::vector<const ProtocolInfo*> ranked_protocols(const StreamDevice& device)
+{
+    std::vector<const ProtocolInfo*> ranked;
+
+    bool h264 = device.codecs.empty() ||
+        std::find(device.codecs.begin(), device.codecs.end(), "h264") != device.codecs.end();
+
+    for (ProtocolType type : PROTOCOL_PREFERENCE) {
+        if (!h264 && carries_h264(type)) {
+            continue;
+        }
+        for (const auto& proto : device.available_protocols) {
+            if (proto.type == type && proto.is_available) {
+                ranked.push_back(&proto);
+                break;
+            }
+        }
+    }
+
+    return ranked;
+}
+
+} // namespace berrystreamcam
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "../common.hpp"
+#include <string>
+#include <vector>
+
+namespace berrystreamcam {
+
+/**
+ * Upper bound on the /health body; anything larger is not a capability
+ * document.
+ */
+constexpr size_t MAX_CAPABILITY_DOCUMENT_BYTES = 64 * 1024;
+
+/**
+ * Parse the capability document served at http://<ip>:8080/health:
+ *
+ *   {
+ *     "name": "Pixel 8",
+ *     "codecs": ["h264", "mjpeg"],
+ *     "width": 1920, "height": 1080, "fps": 30,
+ *     "clients": 1,
+ *     "protocols": [
+ *       { "type": "rtsp", "port": 8554, "path": "/stream", "clients": 0 },
+ *       { "type": "websocket", "clients": 1 },
+ *       ...
+ *     ]
+ *   }
+ *
+ * Protocol types use the same names as the source's protocol setting
+ * (websocket, rtsp, udp_fec, http_h264, mjpeg, dash); port and path fall
+ * back to the defaults for the type and unknown types are skipped. Fills
+ * device and returns true if json is such a document, otherwise leaves
+ * device untouched and returns false (older app builds answer /health
+ * with plain text).
+ */
+bool parse_capability_document(const std::string& json, const std::string& ip, StreamDevice& device);
+
+/**
+ * Map a protocol setting name to its type; UNKNOWN if not recognised.
+ */
+ProtocolType protocol_from_name(const std::string& name);
+
+/**
+ * ProtocolInfo for type on its default port and path.
+ */
+ProtocolInfo default_protocol_info(ProtocolType type, const std::string& ip);
+
+/**
+ * The protocol to use for device without trying each one: the lowest
+ * latency transport it advertises, RTSP first, then WebSocket, HTTP
+ * H.264, DASH and MJPEG. H.264 transports are skipped when the device
+ * lists codecs without h264. Returns nullptr if nothing is usable.
+ */
+const ProtocolInfo* best_protocol(const StreamDevice& device);
+
+/**
+ * Every usable protocol of device in the order best_protocol() prefers
+ * them, for trying the next one when the first fails.
+ */
+std::vector<const ProtocolInfo*> ranked_protocols(const StreamDevice& device);
+
+} // namespace berrystreamcam
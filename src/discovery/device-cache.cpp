@@ -0,0 +1,163 @@
+#include "device-cache.hpp"
+#include <algorithm>
+#include <climits>
+
+namespace berrystreamcam {
+
+namespace {
+
+std::vector<ProtocolType> protocol_types(const StreamDevice& device)
+{
+    std::vector<ProtocolType> types;
+    for (const auto& proto : device.available_protocols) {
+        types.push_back(proto.type);
+    }
+    return types;
+}
+
+} // namespace
+
+DeviceCache::DeviceCache()
+    : scan_interval_ms_(INITIAL_SCAN_INTERVAL_MS)
+{
+}
+
+std::vector<std::string> DeviceCache::due_for_probe(const std::vector<std::string>& candidates,
+                                                    int64_t now_ms) const
+{
+    std::vector<std::string> due;
+
+    for (const auto& ip : candidates) {
+        if (addresses_.find(ip) == addresses_.end() &&
+            std::find(due.begin(), due.end(), ip) == due.end()) {
+            due.push_back(ip);
+        }
+    }
+
+    for (const auto& entry : addresses_) {
+        if (entry.second.next_probe_ms <= now_ms) {
+            due.push_back(entry.first);
+        }
+    }
+
+    return due;
+}
+
+void DeviceCache::expedite(const std::string& ip, int64_t now_ms)
+{
+    auto it = addresses_.find(ip);
+    if (it != addresses_.end()) {
+        it->second.probe_interval_ms = MIN_PROBE_INTERVAL_MS;
+        it->second.next_probe_ms = now_ms;
+    }
+}
+
+bool DeviceCache::record_probe(const std::string& ip, bool found, const StreamDevice& device, int64_t now_ms)
+{
+    auto before = devices();
+
+    bool is_new = addresses_.find(ip) == addresses_.end();
+    CachedAddress& entry = addresses_[ip];
+    if (is_new) {
+        entry.device = StreamDevice{};
+        entry.device.ip_address = ip;
+        entry.device.is_active = false;
+        entry.device.last_seen = 0;
+        entry.last_seen_ms = 0;
+        entry.probe_interval_ms = MIN_PROBE_INTERVAL_MS;
+        entry.failures = 0;
+    }
+
+    bool was_device = entry.device.is_active;
+    auto previous_types = protocol_types(entry.device);
+
+    if (found) {
+        // Protocols that answered are healthy; the others get a strike
+        std::vector<ProtocolInfo> visible = device.available_protocols;
+        for (const auto& proto : visible) {
+            entry.protocol_failures[proto.type] = 0;
+        }
+        for (const auto& proto : entry.device.available_protocols) {
+            bool answered = std::any_of(visible.begin(), visible.end(),
+                [&proto](const ProtocolInfo& p) { return p.type == proto.type; });
+            if (!answered && ++entry.protocol_failures[proto.type] < PROTOCOL_FAILURE_LIMIT) {
+                visible.push_back(proto);
+            }
+        }
+
+        entry.device = device;
+        entry.device.available_protocols = visible;
+        entry.device.is_active = true;
+        entry.last_seen_ms = now_ms;
+        entry.failures = 0;
+    } else {
+        entry.failures++;
+        if (entry.failures >= DEVICE_FAILURE_LIMIT) {
+            entry.device.is_active = false;
+        }
+    }
+
+    // Stable answers (or stable silence from a non-device) back off; anything else re-checks soon
+    bool unchanged = found ? (was_device && protocol_types(entry.device) == previous_types)
+                           : (!was_device && !is_new);
+    if (unchanged) {
+        entry.probe_interval_ms = std::min(entry.probe_interval_ms * 2, MAX_PROBE_INTERVAL_MS);
+    } else {
+        entry.probe_interval_ms = MIN_PROBE_INTERVAL_MS;
+    }
+    entry.next_probe_ms = now_ms + entry.probe_interval_ms;
+
+    auto after = devices();
+    if (before.size() != after.size()) {
+        return true;
+    }
+    for (size_t i = 0; i < before.size(); i++) {
+        if (before[i].ip_address != after[i].ip_address ||
+            protocol_types(before[i]) != protocol_types(after[i])) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void DeviceCache::record_scan(bool changed)
+{
+    if (changed) {
+        scan_interval_ms_ = std::max(scan_interval_ms_ / 2, MIN_SCAN_INTERVAL_MS);
+    } else {
+        scan_interval_ms_ = std::min(scan_interval_ms_ * 2, MAX_SCAN_INTERVAL_MS);
+    }
+}
+
+std::vector<StreamDevice> DeviceCache::devices() const
+{
+    std::vector<StreamDevice> result;
+    for (const auto& entry : addresses_) {
+        if (entry.second.device.is_active) {
+            result.push_back(entry.second.device);
+        }
+    }
+    return result;
+}
+
+int64_t DeviceCache::scan_interval_ms() const
+{
+    return scan_interval_ms_;
+}
+
+int64_t DeviceCache::next_probe_ms() const
+{
+    int64_t next = INT64_MAX;
+    for (const auto& entry : addresses_) {
+        next = std::min(next, entry.second.next_probe_ms);
+    }
+    return next;
+}
+
+const CachedAddress* DeviceCache::find(const std::string& ip) const
+{
+    auto it = addresses_.find(ip);
+    return it == addresses_.end() ? nullptr : &it->second;
+}
+
+} // namespace berrystreamcam
@@ -0,0 +1,90 @@
+#pragma once
+
+#include "../common.hpp"
+#include <map>
+#include <string>
+#include <vector>
+
+namespace berrystreamcam {
+
+/**
+ * Probe history of one address, device or not. Times are milliseconds on
+ * a monotonic clock.
+ */
+struct CachedAddress {
+    StreamDevice device;                 // Last good probe; protocols filtered by health
+    int64_t last_seen_ms;                // Last probe that found a device, 0 if never
+    int64_t next_probe_ms;
+    int64_t probe_interval_ms;
+    int failures;                        // Consecutive probes that found nothing
+    std::map<ProtocolType, int> protocol_failures;   // Consecutive misses per protocol
+};
+
+/**
+ * Incremental view of the devices on the network.
+ *
+ * Each address is re-probed on its own timer instead of the whole table
+ * being rebuilt every scan. The timer doubles whenever a probe finds the
+ * device unchanged, up to MAX_PROBE_INTERVAL_MS. It drops back to
+ * MIN_PROBE_INTERVAL_MS for new addresses, changed devices and failed
+ * probes. A protocol is hidden after PROTOCOL_FAILURE_LIMIT misses in a
+ * row, and a device after DEVICE_FAILURE_LIMIT. Addresses that answered
+ * but are not Streamberry devices back off the same way, so they are not
+ * probed again on every sweep.
+ *
+ * The sweep for new addresses adapts to churn as well. Every quiet sweep
+ * doubles the interval up to MAX_SCAN_INTERVAL_MS, and any change halves
+ * it down to MIN_SCAN_INTERVAL_MS.
+ */
+class DeviceCache {
+public:
+    static constexpr int64_t MIN_PROBE_INTERVAL_MS = 5000;
+    static constexpr int64_t MAX_PROBE_INTERVAL_MS = 5 * 60 * 1000;
+    static constexpr int64_t MIN_SCAN_INTERVAL_MS = 5000;
+    static constexpr int64_t INITIAL_SCAN_INTERVAL_MS = 15000;
+    static constexpr int64_t MAX_SCAN_INTERVAL_MS = 5 * 60 * 1000;
+    static constexpr int PROTOCOL_FAILURE_LIMIT = 2;
+    static constexpr int DEVICE_FAILURE_LIMIT = 3;
+
+    DeviceCache();
+
+    /**
+     * Addresses to probe now: candidates not seen before plus known
+     * addresses whose timer has run out.
+     */
+    std::vector<std::string> due_for_probe(const std::vector<std::string>& candidates,
+                                           int64_t now_ms) const;
+
+    /**
+     * Make a known address due now with the shortest interval, e.g. when
+     * it has just announced itself over mDNS.
+     */
+    void expedite(const std::string& ip, int64_t now_ms);
+
+    /**
+     * Record a probe. found is false when no protocol answered. Returns
+     * true if the visible device list changed.
+     */
+    bool record_probe(const std::string& ip, bool found, const StreamDevice& device, int64_t now_ms);
+
+    /**
+     * Feed back the outcome of a sweep to adapt scan_interval_ms().
+     */
+    void record_scan(bool changed);
+
+    std::vector<StreamDevice> devices() const;
+    int64_t scan_interval_ms() const;
+
+    /**
+     * Earliest time a known address is due, or INT64_MAX.
+     */
+    int64_t next_probe_ms() const;
+
+    const CachedAddress* find(const std::string& ip) const;
+
+private:
+    std::map<std::string, CachedAddress> addresses_;
+    int64_t scan_interval_ms_;
+};
+
+} // namespace berrystreamcam
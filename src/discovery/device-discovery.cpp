@@ -1,34 +1,71 @@
 #include "device-discovery.hpp"
 #include "mdns-scanner.hpp"
-#include <curl/curl.h>
+#include "subnet-scanner.hpp"
+#include "capability-probe.hpp"
+#include "http-prober.hpp"
+#include <algorithm>
+#include <arpa/inet.h>
 #include <thread>
 #include <chrono>
-#include <unistd.h>
 
 namespace berrystreamcam {
 
+namespace {
+
+StreamDevice blank_device(const std::string& ip_address)
+{
+    StreamDevice device;
+    device.ip_address = ip_address;
+    device.name = "Streamberry-" + ip_address;
+    device.is_active = false;
+    device.last_seen = std::chrono::system_clock::now().time_since_epoch().count();
+    device.capabilities_known = false;
+    device.width = 0;
+    device.height = 0;
+    device.fps = 0;
+    device.connected_clients = 0;
+    return device;
+}
+
+} // namespace
+
 DeviceDiscovery::DeviceDiscovery()
+    : mdns_(std::make_unique<MdnsScanner>())
+    , http_(std::make_unique<HttpProber>())
 {
+    http_->set_stop_signal(&stop_);
     BLOG_INFO("Device discovery initialized");
-    curl_global_init(CURL_GLOBAL_ALL);
 }
 
 DeviceDiscovery::~DeviceDiscovery()
 {
-    curl_global_cleanup();
+    mdns_.reset();
+    http_.reset();
+}
+
+void DeviceDiscovery::cancel()
+{
+    stop_.stop();
+    mdns_->cancel();
+}
+
+void DeviceDiscovery::set_change_callback(std::function<void()> callback)
+{
+    mdns_->set_change_callback(std::move(callback));
+}
+
+std::vector<std::string> DeviceDiscovery::announced_devices()
+{
+    return mdns_->scan();
 }
 
 std::vector<StreamDevice> DeviceDiscovery::scan_network()
 {
     std::vector<StreamDevice> devices;
 
-    // Try mDNS discovery first (faster and more reliable)
-    MdnsScanner mdns;
-    auto mdns_devices = mdns.scan();
-
-    for (const auto& ip : mdns_devices) {
-        StreamDevice device;
-        if (probe_device(ip, device)) {
+    // Devices announced over mDNS (cached by the browse thread)
+    for (const auto& device : probe_devices(announced_devices())) {
+        if (device.is_active) {
             devices.push_back(device);
         }
     }
@@ -36,11 +73,8 @@ std::vector<StreamDevice> DeviceDiscovery::scan_network()
     // If no devices found via mDNS, try subnet scanning
     if (devices.empty()) {
         BLOG_DEBUG("No devices found via mDNS, trying subnet scan");
-        auto subnet_ips = get_local_subnet_ips();
-
-        for (const auto& ip : subnet_ips) {
-            StreamDevice device;
-            if (probe_device(ip, device)) {
+        for (const auto& device : probe_devices(get_local_subnet_ips())) {
+            if (device.is_active) {
                 devices.push_back(device);
             }
         }
@@ -51,142 +85,106 @@ std::vector<StreamDevice> DeviceDiscovery::scan_network()
 
 bool DeviceDiscovery::probe_device(const std::string& ip_address, StreamDevice& device)
 {
-    device.ip_address = ip_address;
-    device.name = "Streamberry-" + ip_address;
-    device.is_active = false;
-    device.last_seen = std::chrono::system_clock::now().time_since_epoch().count();
-    device.available_protocols.clear();
-
-    BLOG_DEBUG("Probing device at %s", ip_address.c_str());
-
-    // Probe WebSocket port (8080)
-    ProtocolInfo ws_proto;
-    probe_websocket_port(ip_address, ws_proto);
-    if (ws_proto.is_available) {
-        device.available_protocols.push_back(ws_proto);
-        device.is_active = true;
-    }
+    device = probe_devices({ ip_address }).front();
+    return device.is_active;
+}
 
-    // Probe HTTP port (8081)
-    std::vector<ProtocolInfo> http_protos;
-    probe_http_port(ip_address, http_protos);
-    if (!http_protos.empty()) {
-        device.available_protocols.insert(device.available_protocols.end(),
-                                         http_protos.begin(), http_protos.end());
-        device.is_active = true;
+std::vector<StreamDevice> DeviceDiscovery::probe_devices(const std::vector<std::string>& ip_addresses)
+{
+    std::vector<StreamDevice> devices;
+    if (ip_addresses.empty()) {
+        return devices;
     }
 
-    // Probe RTSP port (8554)
-    ProtocolInfo rtsp_proto;
-    probe_rtsp_port(ip_address, rtsp_proto);
-    if (rtsp_proto.is_available) {
-        device.available_protocols.push_back(rtsp_proto);
-        device.is_active = true;
-    }
+    BLOG_DEBUG("Probing %zu address(es)", ip_addresses.size());
 
-    if (device.is_active) {
-        BLOG_INFO("✓ Found Streamberry device at %s with %zu protocol(s)",
-                  ip_address.c_str(), device.available_protocols.size());
+    // One GET of the capability document per device, all at once
+    std::vector<HttpProbe> health;
+    for (const auto& ip : ip_addresses) {
+        devices.push_back(blank_device(ip));
+        health.push_back({ "http://" + ip + ":8080/health", false, false, 0, "" });
     }
-
-    return device.is_active;
-}
-
-void DeviceDiscovery::probe_websocket_port(const std::string& ip, ProtocolInfo& proto)
-{
-    proto.type = ProtocolType::WEBSOCKET_OBS_DROID;
-    proto.port = WEBSOCKET_PORT;
-    proto.url = "ws://" + ip + ":8080/stream";
-    proto.is_available = false;
-    proto.connected_clients = 0;
-
-    // Try to connect to WebSocket health endpoint
-    CURL *curl = curl_easy_init();
-    if (curl) {
-        std::string health_url = "http://" + ip + ":8080/health";
-        curl_easy_setopt(curl, CURLOPT_URL, health_url.c_str());
-        curl_easy_setopt(curl, CURLOPT_NOBODY, 1L);
-        curl_easy_setopt(curl, CURLOPT_TIMEOUT, 2L);
-        curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, 2L);
-
-        CURLcode res = curl_easy_perform(curl);
-        if (res == CURLE_OK) {
-            long response_code;
-            curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &response_code);
-            if (response_code == 200) {
-                proto.is_available = true;
-                BLOG_DEBUG("  ✓ WebSocket (OBS Droid) available at %s", proto.url.c_str());
+    http_->run(health);
+
+    // Older app builds answer /health with plain text; probe each port instead
+    std::vector<size_t> legacy;
+    for (size_t i = 0; i < devices.size(); i++) {
+        StreamDevice& device = devices[i];
+        if (health[i].status == 200 &&
+            parse_capability_document(health[i].body, device.ip_address, device)) {
+            if (device.is_active) {
+                BLOG_INFO("✓ Found Streamberry device %s at %s: %zu protocol(s), %dx%d@%d, %d client(s)",
+                          device.name.c_str(), device.ip_address.c_str(), device.available_protocols.size(),
+                          device.width, device.height, device.fps, device.connected_clients);
             }
+            continue;
         }
 
-        curl_easy_cleanup(curl);
+        if (health[i].status == 200) {
+            device.available_protocols.push_back(
+                default_protocol_info(ProtocolType::WEBSOCKET_OBS_DROID, device.ip_address));
+            device.is_active = true;
+            BLOG_DEBUG("  ✓ WebSocket (OBS Droid) available at %s",
+                       device.available_protocols.back().url.c_str());
+        }
+        legacy.push_back(i);
     }
-}
 
-void DeviceDiscovery::probe_http_port(const std::string& ip, std::vector<ProtocolInfo>& protos)
-{
-    // Check if HTTP server is running
-    CURL *curl = curl_easy_init();
-    if (!curl) return;
-
-    std::string base_url = "http://" + ip + ":8081/";
-    curl_easy_setopt(curl, CURLOPT_URL, base_url.c_str());
-    curl_easy_setopt(curl, CURLOPT_NOBODY, 1L);
-    curl_easy_setopt(curl, CURLOPT_TIMEOUT, 2L);
-    curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, 2L);
-
-    CURLcode res = curl_easy_perform(curl);
-    curl_easy_cleanup(curl);
+    if (!legacy.empty()) {
+        probe_legacy_ports(devices, legacy);
+    }
 
-    if (res != CURLE_OK) {
-        return;
+    for (size_t i : legacy) {
+        if (devices[i].is_active) {
+            BLOG_INFO("✓ Found Streamberry device at %s with %zu protocol(s)",
+                      devices[i].ip_address.c_str(), devices[i].available_protocols.size());
+        }
     }
 
-    // HTTP server is running, add all HTTP-based protocols
-
-    // Raw H.264
-    ProtocolInfo h264_proto;
-    h264_proto.type = ProtocolType::HTTP_RAW_H264;
-    h264_proto.port = HTTP_PORT;
-    h264_proto.url = "http://" + ip + ":8081/stream.h264";
-    h264_proto.is_available = true;
-    h264_proto.connected_clients = 0;
-    protos.push_back(h264_proto);
-    BLOG_DEBUG("  ✓ HTTP Raw H.264 available at %s", h264_proto.url.c_str());
-
-    // MJPEG
-    ProtocolInfo mjpeg_proto;
-    mjpeg_proto.type = ProtocolType::HTTP_MJPEG;
-    mjpeg_proto.port = HTTP_PORT;
-    mjpeg_proto.url = "http://" + ip + ":8081/mjpeg";
-    mjpeg_proto.is_available = true;
-    mjpeg_proto.connected_clients = 0;
-    protos.push_back(mjpeg_proto);
-    BLOG_DEBUG("  ✓ MJPEG available at %s", mjpeg_proto.url.c_str());
-
-    // MPEG-DASH
-    ProtocolInfo dash_proto;
-    dash_proto.type = ProtocolType::HTTP_DASH;
-    dash_proto.port = HTTP_PORT;
-    dash_proto.url = "http://" + ip + ":8081/dash/manifest.mpd";
-    dash_proto.is_available = true;
-    dash_proto.connected_clients = 0;
-    protos.push_back(dash_proto);
-    BLOG_DEBUG("  ✓ MPEG-DASH available at %s", dash_proto.url.c_str());
+    return devices;
 }
 
-void DeviceDiscovery::probe_rtsp_port(const std::string& ip, ProtocolInfo& proto)
+void DeviceDiscovery::probe_legacy_ports(std::vector<StreamDevice>& devices, const std::vector<size_t>& indices)
 {
-    proto.type = ProtocolType::RTSP;
-    proto.port = RTSP_PORT;
-    proto.url = "rtsp://" + ip + ":8554/stream";
-    proto.is_available = false;
-    proto.connected_clients = 0;
-
-    // Simple TCP connection test
-    if (ping_host(ip, RTSP_PORT)) {
-        proto.is_available = true;
-        BLOG_DEBUG("  ✓ RTSP available at %s", proto.url.c_str());
+    // HTTP server on 8081 serves the H.264, MJPEG and DASH endpoints
+    std::vector<HttpProbe> http;
+    for (size_t i : indices) {
+        http.push_back({ "http://" + devices[i].ip_address + ":8081/", true, false, 0, "" });
+    }
+    http_->run(http);
+
+    // RTSP does not speak HTTP; a TCP connect is enough
+    std::vector<uint32_t> hosts;
+    for (size_t i : indices) {
+        in_addr addr;
+        if (inet_pton(AF_INET, devices[i].ip_address.c_str(), &addr) == 1) {
+            hosts.push_back(ntohl(addr.s_addr));
+        }
+    }
+    SubnetScanner scanner;
+    scanner.set_stop_signal(&stop_);
+    auto rtsp_hits = scanner.scan(hosts, { RTSP_PORT });
+
+    for (size_t n = 0; n < indices.size(); n++) {
+        StreamDevice& device = devices[indices[n]];
+
+        if (http[n].reachable) {
+            for (ProtocolType type : { ProtocolType::HTTP_RAW_H264, ProtocolType::HTTP_MJPEG,
+                                       ProtocolType::HTTP_DASH }) {
+                device.available_protocols.push_back(default_protocol_info(type, device.ip_address));
+                BLOG_DEBUG("  ✓ %s available at %s", protocol_to_string(type),
+                           device.available_protocols.back().url.c_str());
+            }
+            device.is_active = true;
+        }
+
+        bool rtsp_open = std::any_of(rtsp_hits.begin(), rtsp_hits.end(),
+            [&device](const ScanHit& hit) { return ipv4_to_string(hit.address) == device.ip_address; });
+        if (rtsp_open) {
+            device.available_protocols.push_back(default_protocol_info(ProtocolType::RTSP, device.ip_address));
+            device.is_active = true;
+            BLOG_DEBUG("  ✓ RTSP available at %s", device.available_protocols.back().url.c_str());
+        }
     }
 }
 
@@ -194,58 +192,32 @@ std::vector<std::string> DeviceDiscovery::get_local_subnet_ips()
 {
     std::vector<std::string> ips;
 
-    // Scan common local network IP ranges
-    // This is a basic implementation that checks common private IP ranges
-    BLOG_DEBUG("Scanning common local network IP ranges");
-
-    // Get the system's hostname to determine likely subnet
-    char hostname[256];
-    if (gethostname(hostname, sizeof(hostname)) == 0) {
-        BLOG_DEBUG("Hostname: %s", hostname);
+    auto interfaces = enumerate_interfaces();
+    if (interfaces.empty()) {
+        BLOG_WARNING("No usable IPv4 interface for subnet scan");
+        return ips;
     }
 
-    // Try common router/gateway IPs to determine subnet
-    // Reduced to most common subnets
-    std::vector<std::string> common_subnets = {
-        "192.168.1.",
-        "192.168.0.",
-        "10.0.0."
-    };
-
-    // For each subnet, check a range of IPs (e.g., .1 to .254)
-    // But to avoid too many requests, only check likely device IPs
-    // Reduced from 11 to 6 IPs per subnet for faster scanning
-    std::vector<int> likely_ips = {1, 2, 10, 100, 101, 150};
-
-    for (const auto& subnet : common_subnets) {
-        for (int ip_suffix : likely_ips) {
-            ips.push_back(subnet + std::to_string(ip_suffix));
+    auto neighbors = read_neighbor_table();
+    auto candidates = build_scan_candidates(interfaces, neighbors, SubnetScanner::DEFAULT_MAX_SUBNETS);
+    BLOG_DEBUG("Sweeping %zu hosts (%zu known neighbours) on %zu interface(s)",
+               candidates.size(), neighbors.size(), interfaces.size());
+
+    // Only hosts with a Streamberry port open go on to the HTTP probes
+    SubnetScanner scanner;
+    scanner.set_stop_signal(&stop_);
+    auto hits = scanner.scan(candidates, { WEBSOCKET_PORT, HTTP_PORT, RTSP_PORT });
+
+    for (const auto& hit : hits) {
+        std::string ip = ipv4_to_string(hit.address);
+        if (std::find(ips.begin(), ips.end(), ip) == ips.end()) {
+            ips.push_back(ip);
         }
     }
 
-    BLOG_DEBUG("Generated %zu IPs to scan", ips.size());
+    BLOG_DEBUG("Subnet scan found %zu host(s) with open ports", ips.size());
 
     return ips;
 }
 
-bool DeviceDiscovery::ping_host(const std::string& ip, int port)
-{
-    // Simple TCP connection test
-    // In a real implementation, you'd use socket APIs to test connectivity
-
-    CURL *curl = curl_easy_init();
-    if (!curl) return false;
-
-    std::string url = "http://" + ip + ":" + std::to_string(port);
-    curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
-    curl_easy_setopt(curl, CURLOPT_NOBODY, 1L);
-    curl_easy_setopt(curl, CURLOPT_TIMEOUT, 1L);
-    curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, 1L);
-
-    CURLcode res = curl_easy_perform(curl);
-    curl_easy_cleanup(curl);
-
-    return (res == CURLE_OK);
-}
-
 } // namespace berrystreamcam
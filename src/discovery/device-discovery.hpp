@@ -1,11 +1,17 @@
 #pragma once
 
 #include "../common.hpp"
+#include "stop-signal.hpp"
 #include <vector>
 #include <string>
+#include <memory>
+#include <functional>
 
 namespace berrystreamcam {
 
+class MdnsScanner;
+class HttpProber;
+
 class DeviceDiscovery {
 public:
     DeviceDiscovery();
@@ -14,16 +20,33 @@ public:
     // Scan network for Streamberry devices
     std::vector<StreamDevice> scan_network();
 
-    // Check if specific device is available
+    // Check if specific device is available, from its capability document
+    // when it serves one
     bool probe_device(const std::string& ip_address, StreamDevice& device);
 
-private:
-    void probe_websocket_port(const std::string& ip, ProtocolInfo& proto);
-    void probe_http_port(const std::string& ip, std::vector<ProtocolInfo>& protos);
-    void probe_rtsp_port(const std::string& ip, ProtocolInfo& proto);
+    // Probe several addresses concurrently; is_active marks the devices
+    std::vector<StreamDevice> probe_devices(const std::vector<std::string>& ip_addresses);
+
+    // Called from the mDNS browse thread when announced devices change
+    void set_change_callback(std::function<void()> callback);
+
+    // Addresses currently announced over mDNS (no network traffic)
+    std::vector<std::string> announced_devices();
 
+    // Hosts on the local /24s with a Streamberry port open
     std::vector<std::string> get_local_subnet_ips();
-    bool ping_host(const std::string& ip, int port);
+
+    // Abort in-flight sweeps, probes and mDNS waits for shutdown; every
+    // later call returns at once with nothing found
+    void cancel();
+
+private:
+    // Port checks for app builds without a capability document
+    void probe_legacy_ports(std::vector<StreamDevice>& devices, const std::vector<size_t>& indices);
+
+    StopSignal stop_;
+    std::unique_ptr<MdnsScanner> mdns_;   // Browses for the lifetime of discovery
+    std::unique_ptr<HttpProber> http_;    // Keeps connections to devices alive between probes
 };
 
 } // namespace berrystreamcam
@@ -0,0 +1,218 @@
+#include "discovery-service.hpp"
+#include "device-discovery.hpp"
+#include <algorithm>
+#include <chrono>
+
+namespace berrystreamcam {
+
+namespace {
+
+std::mutex instance_mutex;
+std::weak_ptr<DiscoveryService> instance;
+
+int64_t steady_ms()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+bool same_devices(const std::vector<StreamDevice>& a, const std::vector<StreamDevice>& b)
+{
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < a.size(); i++) {
+        // Client counts change all the time and are not worth a new version
+        if (a[i].ip_address != b[i].ip_address || a[i].name != b[i].name ||
+            a[i].codecs != b[i].codecs || a[i].width != b[i].width ||
+            a[i].height != b[i].height || a[i].fps != b[i].fps ||
+            a[i].available_protocols.size() != b[i].available_protocols.size()) {
+            return false;
+        }
+        for (size_t j = 0; j < a[i].available_protocols.size(); j++) {
+            if (a[i].available_protocols[j].type != b[i].available_protocols[j].type ||
+                a[i].available_protocols[j].url != b[i].available_protocols[j].url) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+std::shared_ptr<DiscoveryService> DiscoveryService::acquire()
+{
+    std::lock_guard<std::mutex> lock(instance_mutex);
+
+    std::shared_ptr<DiscoveryService> service = instance.lock();
+    if (!service) {
+        service.reset(new DiscoveryService());
+        instance = service;
+    }
+    return service;
+}
+
+DiscoveryService::DiscoveryService()
+    : discovery_(std::make_unique<DeviceDiscovery>())
+    , running_(true)
+    , scan_requested_(true)
+    , table_{ 0, {} }
+    , next_subscription_(1)
+{
+    BLOG_INFO("Discovery service started");
+
+    // Announcements and goodbyes show up without waiting for the interval
+    discovery_->set_change_callback([this]() { request_scan(); });
+
+    scan_thread_ = std::thread(&DiscoveryService::scan_loop, this);
+}
+
+DiscoveryService::~DiscoveryService()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        running_ = false;
+    }
+    cv_.notify_all();
+
+    // Cut short whatever sweep or probe batch the scan thread is in
+    discovery_->cancel();
+
+    if (scan_thread_.joinable()) {
+        try {
+            scan_thread_.join();
+        } catch (const std::exception& e) {
+            BLOG_WARNING("Exception while joining discovery thread: %s", e.what());
+        }
+    }
+
+    // Stop the mDNS browser before the members its callback touches go away
+    discovery_.reset();
+
+    BLOG_INFO("Discovery service stopped");
+}
+
+DiscoveryService::SubscriptionId DiscoveryService::subscribe(Listener listener)
+{
+    std::lock_guard<std::mutex> lock(listeners_mutex_);
+    SubscriptionId id = next_subscription_++;
+
+    DeviceTable current = snapshot();
+    if (current.version > 0) {
+        listener(current);
+    }
+
+    listeners_[id] = std::move(listener);
+    return id;
+}
+
+void DiscoveryService::unsubscribe(SubscriptionId id)
+{
+    std::lock_guard<std::mutex> lock(listeners_mutex_);
+    listeners_.erase(id);
+}
+
+DeviceTable DiscoveryService::snapshot() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return table_;
+}
+
+void DiscoveryService::request_scan()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        scan_requested_ = true;
+    }
+    cv_.notify_all();
+}
+
+void DiscoveryService::scan_loop()
+{
+    BLOG_INFO("Discovery thread started");
+
+    int64_t next_sweep_ms = 0;
+
+    while (true) {
+        bool sweep = false;
+        {
+            // Sleep until the next sweep or the next re-probe, whichever is first
+            int64_t wake_ms = std::min(next_sweep_ms, cache_.next_probe_ms());
+            int64_t wait_ms = std::max<int64_t>(0, wake_ms - steady_ms());
+            std::unique_lock<std::mutex> lock(mutex_);
+            cv_.wait_for(lock, std::chrono::milliseconds(wait_ms),
+                         [this]() { return !running_ || scan_requested_; });
+            if (!running_) {
+                break;
+            }
+            sweep = scan_requested_ || steady_ms() >= next_sweep_ms;
+            scan_requested_ = false;
+        }
+
+        std::vector<std::string> candidates;
+        if (sweep) {
+            // Newly announced addresses skip their back-off
+            auto announced = discovery_->announced_devices();
+            for (const auto& ip : announced) {
+                if (std::find(last_announced_.begin(), last_announced_.end(), ip) == last_announced_.end()) {
+                    cache_.expedite(ip, steady_ms());
+                }
+            }
+            last_announced_ = announced;
+            candidates = announced;
+
+            // The connect sweep is only needed where mDNS is silent
+            if (announced.empty()) {
+                auto swept = discovery_->get_local_subnet_ips();
+                candidates.insert(candidates.end(), swept.begin(), swept.end());
+            }
+        }
+
+        // Every due address is probed at once over the shared connections
+        bool changed = false;
+        auto due = cache_.due_for_probe(candidates, steady_ms());
+        size_t probes = due.size();
+        if (!due.empty() && running_) {
+            auto probed = discovery_->probe_devices(due);
+            for (size_t i = 0; i < due.size(); i++) {
+                changed = cache_.record_probe(due[i], probed[i].is_active, probed[i], steady_ms()) || changed;
+            }
+        }
+
+        if (sweep) {
+            cache_.record_scan(changed);
+            next_sweep_ms = steady_ms() + cache_.scan_interval_ms();
+            BLOG_DEBUG("Discovery sweep: %zu probe(s), next in %lld s", probes,
+                       static_cast<long long>(cache_.scan_interval_ms() / 1000));
+        }
+
+        publish(cache_.devices());
+    }
+
+    BLOG_INFO("Discovery thread stopped");
+}
+
+void DiscoveryService::publish(std::vector<StreamDevice> devices)
+{
+    DeviceTable table;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (table_.version > 0 && same_devices(table_.devices, devices)) {
+            return;
+        }
+        table_.version++;
+        table_.devices = std::move(devices);
+        table = table_;
+    }
+
+    BLOG_DEBUG("Device table v%llu: %zu Streamberry device(s)",
+               static_cast<unsigned long long>(table.version), table.devices.size());
+
+    std::lock_guard<std::mutex> lock(listeners_mutex_);
+    for (const auto& entry : listeners_) {
+        entry.second(table);
+    }
+}
+
+} // namespace berrystreamcam
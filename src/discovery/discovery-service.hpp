@@ -0,0 +1,96 @@
+#pragma once
+
+#include "../common.hpp"
+#include "device-cache.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace berrystreamcam {
+
+class DeviceDiscovery;
+
+/**
+ * Devices found by the last scan. version increases whenever the set of
+ * devices or their protocols changes; 0 means no scan has finished yet.
+ */
+struct DeviceTable {
+    uint64_t version;
+    std::vector<StreamDevice> devices;
+};
+
+/**
+ * Process-wide device discovery shared by every source and widget.
+ *
+ * The first acquire() creates the service and starts one scan thread; it
+ * stops when the last holder drops its reference. Subscribers are told
+ * about each new table version instead of scanning themselves.
+ *
+ * Known addresses are re-probed on their own back-off schedule from the
+ * DeviceCache. The sweep for new addresses runs at the cache's adaptive
+ * interval, or immediately on an mDNS change or request_scan().
+ *
+ * Dropping the last reference cancels any sweep or probe in flight, so it
+ * returns at once instead of waiting out network timeouts.
+ */
+class DiscoveryService {
+public:
+    using Listener = std::function<void(const DeviceTable&)>;
+    using SubscriptionId = uint64_t;
+
+    static std::shared_ptr<DiscoveryService> acquire();
+
+    ~DiscoveryService();
+
+    DiscoveryService(const DiscoveryService&) = delete;
+    DiscoveryService& operator=(const DiscoveryService&) = delete;
+
+    /**
+     * Register a listener for new table versions, called on the scan
+     * thread. If a scan has already finished it is also called right away
+     * on the caller's thread. Listeners must not call subscribe() or
+     * unsubscribe() themselves.
+     */
+    SubscriptionId subscribe(Listener listener);
+
+    /**
+     * Remove a listener. Once this returns the listener is not running and
+     * will not run again.
+     */
+    void unsubscribe(SubscriptionId id);
+
+    DeviceTable snapshot() const;
+
+    /**
+     * Rescan now instead of waiting for the next interval.
+     */
+    void request_scan();
+
+private:
+    DiscoveryService();
+
+    void scan_loop();
+    void publish(std::vector<StreamDevice> devices);
+
+    std::unique_ptr<DeviceDiscovery> discovery_;
+    DeviceCache cache_;                          // Scan thread only
+    std::vector<std::string> last_announced_;    // Scan thread only
+    std::thread scan_thread_;
+    std::atomic<bool> running_;
+
+    mutable std::mutex mutex_;           // table_ and scan_requested_
+    std::condition_variable cv_;
+    bool scan_requested_;
+    DeviceTable table_;
+
+    std::mutex listeners_mutex_;         // Held while listeners run
+    std::map<SubscriptionId, Listener> listeners_;
+    SubscriptionId next_subscription_;
+};
+
+} // namespace berrystreamcam
@@ -0,0 +1,181 @@
+#include "http-prober.hpp"
+
+namespace berrystreamcam {
+
+namespace {
+
+constexpr int POLL_INTERVAL_MS = 100;
+
+std::once_flag curl_global_once;
+
+size_t body_write_callback(char* data, size_t size, size_t nmemb, void* userp)
+{
+    HttpProbe* probe = static_cast<HttpProbe*>(userp);
+    size_t bytes = size * nmemb;
+    if (probe->body.size() + bytes > HttpProber::MAX_BODY_BYTES) {
+        return 0;   // Aborts the transfer with CURLE_WRITE_ERROR
+    }
+    probe->body.append(data, bytes);
+    return bytes;
+}
+
+} // namespace
+
+HttpProber::HttpProber()
+    : multi_(nullptr)
+    , share_(nullptr)
+    , stop_(nullptr)
+{
+    // Never cleaned up: the protocol handlers use curl for the plugin's lifetime
+    std::call_once(curl_global_once, [] { curl_global_init(CURL_GLOBAL_ALL); });
+
+    multi_ = curl_multi_init();
+    if (!multi_) {
+        BLOG_ERROR("Failed to create curl multi handle for discovery");
+        return;
+    }
+    curl_multi_setopt(multi_, CURLMOPT_MAXCONNECTS, MAX_CACHED_CONNECTIONS);
+
+    share_ = curl_share_init();
+    if (share_) {
+        curl_share_setopt(share_, CURLSHOPT_LOCKFUNC, lock_share);
+        curl_share_setopt(share_, CURLSHOPT_UNLOCKFUNC, unlock_share);
+        curl_share_setopt(share_, CURLSHOPT_USERDATA, this);
+        curl_share_setopt(share_, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+        curl_share_setopt(share_, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+    } else {
+        BLOG_WARNING("Failed to create curl share handle; discovery will not reuse connections");
+    }
+}
+
+HttpProber::~HttpProber()
+{
+    // Easy handles first: the share refuses to go while handles still use it
+    for (CURL* handle : idle_handles_) {
+        curl_easy_cleanup(handle);
+    }
+    idle_handles_.clear();
+
+    if (multi_) {
+        curl_multi_cleanup(multi_);
+    }
+    if (share_) {
+        curl_share_cleanup(share_);
+    }
+}
+
+void HttpProber::set_stop_signal(const StopSignal* stop)
+{
+    stop_ = stop;
+}
+
+void HttpProber::lock_share(CURL*, curl_lock_data data, curl_lock_access, void* userp)
+{
+    static_cast<HttpProber*>(userp)->share_mutexes_[data].lock();
+}
+
+void HttpProber::unlock_share(CURL*, curl_lock_data data, void* userp)
+{
+    static_cast<HttpProber*>(userp)->share_mutexes_[data].unlock();
+}
+
+CURL* HttpProber::take_handle()
+{
+    if (idle_handles_.empty()) {
+        return curl_easy_init();
+    }
+    CURL* handle = idle_handles_.back();
+    idle_handles_.pop_back();
+    curl_easy_reset(handle);
+    return handle;
+}
+
+void HttpProber::release_handle(CURL* handle)
+{
+    if (idle_handles_.size() < static_cast<size_t>(MAX_CACHED_CONNECTIONS)) {
+        idle_handles_.push_back(handle);
+    } else {
+        curl_easy_cleanup(handle);
+    }
+}
+
+void HttpProber::run(std::vector<HttpProbe>& probes, long timeout_ms)
+{
+    std::lock_guard<std::mutex> lock(run_mutex_);
+
+    std::vector<CURL*> active;
+    for (auto& probe : probes) {
+        probe.reachable = false;
+        probe.status = 0;
+        probe.body.clear();
+
+        bool stopped = stop_ && stop_->stopped();
+        CURL* handle = multi_ && !stopped ? take_handle() : nullptr;
+        if (!handle) {
+            continue;
+        }
+
+        curl_easy_setopt(handle, CURLOPT_URL, probe.url.c_str());
+        curl_easy_setopt(handle, CURLOPT_NOBODY, probe.head ? 1L : 0L);
+        curl_easy_setopt(handle, CURLOPT_WRITEFUNCTION, body_write_callback);
+        curl_easy_setopt(handle, CURLOPT_WRITEDATA, &probe);
+        curl_easy_setopt(handle, CURLOPT_PRIVATE, &probe);
+        curl_easy_setopt(handle, CURLOPT_TIMEOUT_MS, timeout_ms);
+        curl_easy_setopt(handle, CURLOPT_CONNECTTIMEOUT_MS, timeout_ms);
+        curl_easy_setopt(handle, CURLOPT_NOSIGNAL, 1L);
+        if (share_) {
+            curl_easy_setopt(handle, CURLOPT_SHARE, share_);
+        }
+
+        if (curl_multi_add_handle(multi_, handle) != CURLM_OK) {
+            release_handle(handle);
+            continue;
+        }
+        active.push_back(handle);
+    }
+
+    if (active.empty()) {
+        return;
+    }
+
+    int running = 0;
+    do {
+        curl_multi_perform(multi_, &running);
+
+        CURLMsg* msg;
+        int queued = 0;
+        while ((msg = curl_multi_info_read(multi_, &queued))) {
+            if (msg->msg != CURLMSG_DONE) {
+                continue;
+            }
+
+            char* priv = nullptr;
+            curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, &priv);
+            HttpProbe* probe = reinterpret_cast<HttpProbe*>(priv);
+
+            // A write error means an oversized body, but the server did answer
+            CURLcode result = msg->data.result;
+            if (result == CURLE_OK || result == CURLE_WRITE_ERROR) {
+                curl_easy_getinfo(msg->easy_handle, CURLINFO_RESPONSE_CODE, &probe->status);
+                probe->reachable = true;
+                if (result == CURLE_WRITE_ERROR) {
+                    probe->body.clear();
+                }
+            }
+        }
+
+        if (running > 0) {
+            // The stop pipe wakes the poll as soon as a stop is requested
+            struct curl_waitfd stop_fd = { stop_ ? stop_->fd() : -1, CURL_WAIT_POLLIN, 0 };
+            unsigned int extra = stop_fd.fd >= 0 ? 1 : 0;
+            curl_multi_poll(multi_, extra ? &stop_fd : nullptr, extra, POLL_INTERVAL_MS, nullptr);
+        }
+    } while (running > 0 && !(stop_ && stop_->stopped()));
+
+    for (CURL* handle : active) {
+        curl_multi_remove_handle(multi_, handle);
+        release_handle(handle);
+    }
+}
+
+} // namespace berrystreamcam
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "../common.hpp"
+#include "stop-signal.hpp"
+#include <curl/curl.h>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace berrystreamcam {
+
+/**
+ * One request in a probe batch.
+ */
+struct HttpProbe {
+    std::string url;
+    bool head;              // HEAD instead of GET
+    bool reachable;         // The server answered at all
+    long status;            // HTTP status, 0 if unreachable
+    std::string body;       // GET only; empty if it exceeded MAX_BODY_BYTES
+};
+
+/**
+ * Runs batches of discovery requests concurrently on one long-lived curl
+ * multi handle.
+ *
+ * Connections and resolved names live in a curl share object, so a device
+ * that keeps its connection alive is re-probed without a new TCP handshake,
+ * and easy handles are recycled between batches. curl's global state is
+ * initialised once per process instead of once per owner.
+ */
+class HttpProber {
+public:
+    static constexpr long DEFAULT_TIMEOUT_MS = 2000;
+    static constexpr size_t MAX_BODY_BYTES = 64 * 1024;
+    static constexpr long MAX_CACHED_CONNECTIONS = 64;
+
+    HttpProber();
+    ~HttpProber();
+
+    HttpProber(const HttpProber&) = delete;
+    HttpProber& operator=(const HttpProber&) = delete;
+
+    /**
+     * Run every probe at once and return when all of them have answered or
+     * timed out. Batches from different threads run one after the other.
+     */
+    void run(std::vector<HttpProbe>& probes, long timeout_ms = DEFAULT_TIMEOUT_MS);
+
+    /**
+     * Abandon run() as soon as stop is signalled; unfinished probes come
+     * back unreachable. stop must outlive the prober.
+     */
+    void set_stop_signal(const StopSignal* stop);
+
+private:
+    static void lock_share(CURL* handle, curl_lock_data data, curl_lock_access access, void* userp);
+    static void unlock_share(CURL* handle, curl_lock_data data, void* userp);
+
+    CURL* take_handle();
+    void release_handle(CURL* handle);
+
+    CURLM* multi_;
+    CURLSH* share_;
+    const StopSignal* stop_;
+    std::mutex share_mutexes_[CURL_LOCK_DATA_LAST];
+    std::vector<CURL*> idle_handles_;
+    std::mutex run_mutex_;                   // One batch at a time on the multi handle
+};
+
+} // namespace berrystreamcam
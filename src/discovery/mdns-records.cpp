@@ -0,0 +1,316 @@
+#include "mdns-records.hpp"
+#include <algorithm>
+#include <cctype>
+
+namespace berrystreamcam {
+
+namespace {
+
+constexpr size_t DNS_HEADER_SIZE = 12;
+constexpr uint16_t DNS_FLAG_RESPONSE = 0x8000;
+constexpr uint16_t DNS_CLASS_IN = 1;
+constexpr int MAX_COMPRESSION_JUMPS = 16;
+constexpr size_t MAX_NAME_LENGTH = 255;
+
+uint16_t read_u16(const uint8_t* p)
+{
+    return static_cast<uint16_t>((p[0] << 8) | p[1]);
+}
+
+uint32_t read_u32(const uint8_t* p)
+{
+    return (static_cast<uint32_t>(p[0]) << 24) | (static_cast<uint32_t>(p[1]) << 16) |
+           (static_cast<uint32_t>(p[2]) << 8) | p[3];
+}
+
+std::string to_lower(std::string text)
+{
+    std::transform(text.begin(), text.end(), text.begin(),
+                   [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    return text;
+}
+
+/**
+ * Decode a possibly compressed name at offset. end is set to the first
+ * byte after the name as it appears at offset.
+ */
+bool read_name(const uint8_t* data, size_t size, size_t offset, std::string& name, size_t& end)
+{
+    name.clear();
+    bool jumped = false;
+    int jumps = 0;
+    size_t pos = offset;
+
+    while (true) {
+        if (pos >= size) {
+            return false;
+        }
+
+        uint8_t length = data[pos];
+        if ((length & 0xC0) == 0xC0) {
+            if (pos + 1 >= size || ++jumps > MAX_COMPRESSION_JUMPS) {
+                return false;
+            }
+            if (!jumped) {
+                end = pos + 2;
+                jumped = true;
+            }
+            pos = (static_cast<size_t>(length & 0x3F) << 8) | data[pos + 1];
+            continue;
+        }
+        if (length & 0xC0) {
+            return false;  // Reserved label types
+        }
+        if (length == 0) {
+            if (!jumped) {
+                end = pos + 1;
+            }
+            return true;
+        }
+        if (pos + 1 + length > size) {
+            return false;
+        }
+
+        if (!name.empty()) {
+            name += '.';
+        }
+        for (size_t i = 0; i < length; i++) {
+            name += static_cast<char>(std::tolower(data[pos + 1 + i]));
+        }
+        if (name.size() > MAX_NAME_LENGTH) {
+            return false;
+        }
+        pos += 1 + length;
+    }
+}
+
+bool same_services(const std::vector<MdnsService>& a, const std::vector<MdnsService>& b)
+{
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < a.size(); i++) {
+        if (a[i].instance != b[i].instance || a[i].address != b[i].address || a[i].port != b[i].port) {
+            return false;
+        }
+    }
+    return true;
+}
+
+template <typename Map>
+void erase_expired(Map& entries, int64_t now_ms)
+{
+    for (auto it = entries.begin(); it != entries.end();) {
+        if (it->second.expires_ms <= now_ms) {
+            it = entries.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+} // namespace
+
+bool parse_mdns_response(const uint8_t* data, size_t size, std::vector<MdnsRecord>& records)
+{
+    if (size < DNS_HEADER_SIZE || !(read_u16(data + 2) & DNS_FLAG_RESPONSE)) {
+        return false;
+    }
+
+    uint16_t questions = read_u16(data + 4);
+    size_t record_count = static_cast<size_t>(read_u16(data + 6)) + read_u16(data + 8) + read_u16(data + 10);
+    size_t pos = DNS_HEADER_SIZE;
+    std::string name;
+
+    for (uint16_t i = 0; i < questions; i++) {
+        if (!read_name(data, size, pos, name, pos) || pos + 4 > size) {
+            return true;
+        }
+        pos += 4;
+    }
+
+    for (size_t i = 0; i < record_count; i++) {
+        MdnsRecord record = {};
+        if (!read_name(data, size, pos, record.name, pos) || pos + 10 > size) {
+            break;
+        }
+
+        record.type = read_u16(data + pos);
+        uint16_t rclass = read_u16(data + pos + 2) & 0x7FFF;   // Top bit is cache-flush
+        record.ttl = read_u32(data + pos + 4);
+        uint16_t rdlength = read_u16(data + pos + 8);
+        size_t rdata = pos + 10;
+        pos = rdata + rdlength;
+        if (pos > size) {
+            break;
+        }
+        if (rclass != DNS_CLASS_IN) {
+            continue;
+        }
+
+        size_t name_end = 0;
+        switch (record.type) {
+            case MDNS_TYPE_A:
+                if (rdlength != 4) {
+                    continue;
+                }
+                record.address = read_u32(data + rdata);
+                break;
+            case MDNS_TYPE_PTR:
+                if (!read_name(data, size, rdata, record.target, name_end)) {
+                    continue;
+                }
+                break;
+            case MDNS_TYPE_SRV:
+                // priority, weight, port, target
+                if (rdlength < 7 || !read_name(data, size, rdata + 6, record.target, name_end)) {
+                    continue;
+                }
+                record.port = read_u16(data + rdata + 4);
+                break;
+            default:
+                continue;
+        }
+
+        records.push_back(record);
+    }
+
+    return true;
+}
+
+std::vector<uint8_t> build_mdns_query(const std::string& service)
+{
+    // ID 0, standard query, one question
+    std::vector<uint8_t> packet = { 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0 };
+
+    size_t start = 0;
+    while (start < service.size()) {
+        size_t dot = service.find('.', start);
+        if (dot == std::string::npos) {
+            dot = service.size();
+        }
+        size_t length = std::min<size_t>(dot - start, 63);
+        packet.push_back(static_cast<uint8_t>(length));
+        packet.insert(packet.end(), service.begin() + start, service.begin() + start + length);
+        start = dot + 1;
+    }
+    packet.push_back(0);
+
+    packet.push_back(0);
+    packet.push_back(MDNS_TYPE_PTR);
+    packet.push_back(0);
+    packet.push_back(DNS_CLASS_IN);
+    return packet;
+}
+
+MdnsServiceTable::MdnsServiceTable(const std::string& service)
+    : service_(to_lower(service))
+{
+}
+
+bool MdnsServiceTable::apply(const std::vector<MdnsRecord>& records, uint32_t source_address, int64_t now_ms)
+{
+    const std::string suffix = "." + service_;
+
+    for (const auto& record : records) {
+        int64_t expires = now_ms + static_cast<int64_t>(record.ttl) * 1000;
+
+        if (record.type == MDNS_TYPE_PTR && record.name == service_) {
+            if (record.ttl == 0) {
+                instances_.erase(record.target);
+            } else {
+                InstanceEntry& entry = instances_[record.target];
+                entry.received_ms = now_ms;
+                entry.expires_ms = expires;
+                entry.refresh_ms = now_ms + (expires - now_ms) * 80 / 100;
+            }
+        } else if (record.type == MDNS_TYPE_SRV && record.name.size() > suffix.size() &&
+                   record.name.compare(record.name.size() - suffix.size(), suffix.size(), suffix) == 0) {
+            if (record.ttl == 0) {
+                srv_.erase(record.name);
+            } else {
+                SrvEntry& entry = srv_[record.name];
+                entry.received_ms = now_ms;
+                entry.expires_ms = expires;
+                entry.host = record.target;
+                entry.port = record.port;
+                entry.source_address = source_address;
+            }
+        } else if (record.type == MDNS_TYPE_A) {
+            if (record.ttl == 0) {
+                addresses_.erase(record.name);
+            } else {
+                AddressEntry& entry = addresses_[record.name];
+                entry.received_ms = now_ms;
+                entry.expires_ms = expires;
+                entry.address = record.address;
+            }
+        }
+    }
+
+    return update_reported(now_ms);
+}
+
+bool MdnsServiceTable::expire(int64_t now_ms)
+{
+    erase_expired(instances_, now_ms);
+    erase_expired(srv_, now_ms);
+    erase_expired(addresses_, now_ms);
+    return update_reported(now_ms);
+}
+
+bool MdnsServiceTable::update_reported(int64_t now_ms)
+{
+    auto current = services(now_ms);
+    if (same_services(reported_, current)) {
+        return false;
+    }
+    reported_ = std::move(current);
+    return true;
+}
+
+std::vector<MdnsService> MdnsServiceTable::services(int64_t now_ms) const
+{
+    std::vector<MdnsService> result;
+
+    for (const auto& instance : instances_) {
+        if (instance.second.expires_ms <= now_ms) {
+            continue;
+        }
+        auto srv = srv_.find(instance.first);
+        if (srv == srv_.end() || srv->second.expires_ms <= now_ms) {
+            continue;
+        }
+
+        MdnsService service;
+        service.instance = instance.first;
+        service.host = srv->second.host;
+        service.port = srv->second.port;
+        service.address = srv->second.source_address;
+
+        auto address = addresses_.find(srv->second.host);
+        if (address != addresses_.end() && address->second.expires_ms > now_ms) {
+            service.address = address->second.address;
+        }
+        if (service.address != 0) {
+            result.push_back(service);
+        }
+    }
+
+    return result;
+}
+
+bool MdnsServiceTable::take_refresh(int64_t now_ms)
+{
+    bool due = false;
+    for (auto& instance : instances_) {
+        InstanceEntry& entry = instance.second;
+        if (now_ms >= entry.refresh_ms && now_ms < entry.expires_ms) {
+            entry.refresh_ms += (entry.expires_ms - entry.received_ms) * 5 / 100;
+            due = true;
+        }
+    }
+    return due;
+}
+
+} // namespace berrystreamcam
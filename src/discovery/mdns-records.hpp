@@ -0,0 +1,106 @@
+#pragma once
+
+#include "../common.hpp"
+#include <map>
+#include <string>
+#include <vector>
+
+namespace berrystreamcam {
+
+constexpr uint16_t MDNS_TYPE_A = 1;
+constexpr uint16_t MDNS_TYPE_PTR = 12;
+constexpr uint16_t MDNS_TYPE_TXT = 16;
+constexpr uint16_t MDNS_TYPE_SRV = 33;
+
+/**
+ * One resource record from an mDNS response. Names are lowercased and
+ * carry no trailing dot.
+ */
+struct MdnsRecord {
+    std::string name;
+    uint16_t type;
+    uint32_t ttl;           // Seconds; 0 is a goodbye
+    std::string target;     // PTR instance name or SRV host name
+    uint16_t port;          // SRV
+    uint32_t address;       // A, host byte order
+};
+
+/**
+ * A resolved service instance.
+ */
+struct MdnsService {
+    std::string instance;   // e.g. "streamberry-192.168.1.20._streamberry._tcp.local"
+    std::string host;
+    uint32_t address;
+    uint16_t port;
+};
+
+/**
+ * Parse the answer, authority and additional sections of an mDNS
+ * response. Questions and malformed records are skipped; returns false
+ * only for something that is not a DNS response at all.
+ */
+bool parse_mdns_response(const uint8_t* data, size_t size, std::vector<MdnsRecord>& records);
+
+/**
+ * One-question PTR query for service (e.g. "_streamberry._tcp.local").
+ */
+std::vector<uint8_t> build_mdns_query(const std::string& service);
+
+/**
+ * Cache of PTR, SRV and A records for one service type.
+ *
+ * Every record expires after its own TTL and a goodbye (TTL 0) removes it
+ * at once. When the SRV target has no A record yet, the address the SRV
+ * arrived from stands in. Times are in milliseconds on any monotonic clock.
+ */
+class MdnsServiceTable {
+public:
+    explicit MdnsServiceTable(const std::string& service);
+
+    /**
+     * Merge records; returns true if the set of resolved services changed.
+     */
+    bool apply(const std::vector<MdnsRecord>& records, uint32_t source_address, int64_t now_ms);
+
+    /**
+     * Drop expired records; returns true if the set of resolved services changed.
+     */
+    bool expire(int64_t now_ms);
+
+    std::vector<MdnsService> services(int64_t now_ms) const;
+
+    /**
+     * Whether a known instance should be queried again before it lapses.
+     * Fires at 80, 85, 90 and 95% of each PTR lifetime (RFC 6762 5.2);
+     * each call that returns true consumes one of those points.
+     */
+    bool take_refresh(int64_t now_ms);
+
+private:
+    struct Entry {
+        int64_t received_ms;
+        int64_t expires_ms;
+    };
+    struct InstanceEntry : Entry {
+        int64_t refresh_ms;
+    };
+    struct SrvEntry : Entry {
+        std::string host;
+        uint16_t port;
+        uint32_t source_address;
+    };
+    struct AddressEntry : Entry {
+        uint32_t address;
+    };
+
+    std::string service_;
+    std::map<std::string, InstanceEntry> instances_;
+    std::map<std::string, SrvEntry> srv_;
+    std::map<std::string, AddressEntry> addresses_;
+    std::vector<MdnsService> reported_;   // Service set as of the last apply()/expire()
+
+    bool update_reported(int64_t now_ms);
+};
+
+} // namespace berrystreamcam
@@ -1,73 +1,328 @@
 #include "mdns-scanner.hpp"
-#include <thread>
+#include "subnet-scanner.hpp"
+#include <algorithm>
 #include <chrono>
+#include <cstring>
 
-// Platform-specific includes for mDNS
-#ifdef _WIN32
-    #include <winsock2.h>
-    #include <ws2tcpip.h>
-    #include <iphlpapi.h>
-#elif defined(__APPLE__)
-    #include <dns_sd.h>
-#else
-    // Linux - would use Avahi
-    #include <sys/socket.h>
-    #include <netinet/in.h>
-    #include <arpa/inet.h>
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <errno.h>
 #endif
 
 namespace berrystreamcam {
 
+namespace {
+
+constexpr const char* MDNS_GROUP = "224.0.0.251";
+constexpr int INITIAL_QUERY_INTERVAL_MS = 1000;
+constexpr int MAX_POLL_MS = 250;   // Bounds how late an expiry or refresh is noticed
+
+int64_t steady_ms()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+} // namespace
+
 MdnsScanner::MdnsScanner()
-    : mdns_handle_(nullptr)
+    : socket_fd_(-1)
+    , passive_(false)
+    , running_(false)
+    , cancelled_(false)
+    , table_(SERVICE_TYPE)
 {
     BLOG_DEBUG("mDNS scanner initialized");
 }
 
 MdnsScanner::~MdnsScanner()
 {
-    // Clean up platform-specific resources
+    stop();
+}
+
+bool MdnsScanner::start()
+{
+    std::lock_guard<std::mutex> lock(lifecycle_mutex_);
+    if (running_) {
+        return true;
+    }
+    if (cancelled_) {
+        return false;
+    }
+
+#ifdef _WIN32
+    // The browser is built on POSIX multicast sockets; on Windows devices
+    // are found by the subnet sweep alone
+    BLOG_DEBUG("mDNS browsing not available on Windows");
+    return false;
+#else
+    if (!open_socket()) {
+        return false;
+    }
+
+    stop_signal_.reset();
+    running_ = true;
+    browse_thread_ = std::thread(&MdnsScanner::browse_loop, this);
+
+    BLOG_INFO("Browsing %s (%s)", SERVICE_TYPE, passive_ ? "passive" : "query replies only");
+    return true;
+#endif
+}
+
+void MdnsScanner::stop()
+{
+    std::lock_guard<std::mutex> lock(lifecycle_mutex_);
+    running_ = false;
+    stop_signal_.stop();
+    if (browse_thread_.joinable()) {
+        browse_thread_.join();
+    }
+
+#ifndef _WIN32
+    if (socket_fd_ >= 0) {
+        close(socket_fd_);
+        socket_fd_ = -1;
+    }
+#endif
+}
+
+void MdnsScanner::cancel()
+{
+    cancelled_ = true;
+    stop();
+
+    // Wake a scan() still waiting for the first answers
+    std::lock_guard<std::mutex> lock(table_mutex_);
+    table_cv_.notify_all();
+}
+
+bool MdnsScanner::is_running() const
+{
+    return running_;
+}
+
+std::vector<MdnsService> MdnsScanner::services() const
+{
+    std::lock_guard<std::mutex> lock(table_mutex_);
+    return table_.services(steady_ms());
 }
 
 std::vector<std::string> MdnsScanner::scan()
 {
     std::vector<std::string> found_ips;
 
-    BLOG_DEBUG("Scanning for Streamberry devices via mDNS...");
+    bool first = !running_;
+    if (!start()) {
+        return found_ips;
+    }
 
-    // The Android app registers with service name pattern: Streamberry-<IP>
-    // Service type: _streamberry._tcp.local
+    std::unique_lock<std::mutex> lock(table_mutex_);
+    if (first) {
+        // Give the startup query a moment to be answered
+        table_cv_.wait_for(lock, std::chrono::milliseconds(INITIAL_WAIT_MS),
+                           [this]() { return cancelled_ || !table_.services(steady_ms()).empty(); });
+    }
 
-#ifdef __APPLE__
-    // Use Bonjour on macOS
-    // This is a simplified version - full implementation would use DNSServiceBrowse
-    BLOG_DEBUG("Using Bonjour for device discovery (macOS)");
+    for (const auto& service : table_.services(steady_ms())) {
+        std::string ip = ipv4_to_string(service.address);
+        if (std::find(found_ips.begin(), found_ips.end(), ip) == found_ips.end()) {
+            found_ips.push_back(ip);
+        }
+    }
 
-    // TODO: Implement Bonjour service browsing
-    // DNSServiceRef service_ref;
-    // DNSServiceBrowse(&service_ref, 0, 0, "_streamberry._tcp", NULL, browse_callback, NULL);
+    BLOG_DEBUG("Found %zu device(s) via mDNS", found_ips.size());
 
-#elif defined(_WIN32)
-    // Use DNS-SD API on Windows
-    BLOG_DEBUG("Using DNS-SD for device discovery (Windows)");
+    return found_ips;
+}
 
-    // TODO: Implement Windows DNS-SD browsing
+void MdnsScanner::set_change_callback(std::function<void()> callback)
+{
+    change_callback_ = std::move(callback);
+}
 
-#else
-    // Use Avahi on Linux
-    BLOG_DEBUG("Using Avahi for device discovery (Linux)");
+#ifndef _WIN32
 
-    // TODO: Implement Avahi service browsing
-    // For now, we'll use the subnet scanning fallback
+bool MdnsScanner::open_socket()
+{
+    socket_fd_ = socket(AF_INET, SOCK_DGRAM, 0);
+    if (socket_fd_ < 0) {
+        BLOG_ERROR("Failed to create mDNS socket: %s", strerror(errno));
+        return false;
+    }
 
+    // Share 5353 with avahi-daemon / mDNSResponder
+    int one = 1;
+    setsockopt(socket_fd_, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+#ifdef SO_REUSEPORT
+    setsockopt(socket_fd_, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one));
 #endif
+    fcntl(socket_fd_, F_SETFD, FD_CLOEXEC);
 
-    // Fallback: Check known ports on local network
-    // This would be replaced with actual mDNS discovery
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(MDNS_PORT);
 
-    BLOG_DEBUG("Found %zu device(s) via mDNS", found_ips.size());
+    passive_ = bind(socket_fd_, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) == 0;
+    if (!passive_) {
+        BLOG_WARNING("mDNS port %d in use (%s), falling back to query replies",
+                     MDNS_PORT, strerror(errno));
+        addr.sin_port = 0;
+        if (bind(socket_fd_, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) != 0) {
+            BLOG_ERROR("Failed to bind mDNS socket: %s", strerror(errno));
+            close(socket_fd_);
+            socket_fd_ = -1;
+            return false;
+        }
+    }
 
-    return found_ips;
+    int ttl = 255;   // RFC 6762 section 11
+    setsockopt(socket_fd_, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl));
+
+    return true;
+}
+
+void MdnsScanner::join_groups()
+{
+    // Repeated joins fail harmlessly; new interfaces get picked up
+    struct ip_mreq request;
+    memset(&request, 0, sizeof(request));
+    inet_pton(AF_INET, MDNS_GROUP, &request.imr_multiaddr);
+
+    auto interfaces = enumerate_interfaces();
+    if (interfaces.empty()) {
+        request.imr_interface.s_addr = htonl(INADDR_ANY);
+        setsockopt(socket_fd_, IPPROTO_IP, IP_ADD_MEMBERSHIP, &request, sizeof(request));
+        return;
+    }
+
+    for (const auto& iface : interfaces) {
+        request.imr_interface.s_addr = htonl(iface.address);
+        setsockopt(socket_fd_, IPPROTO_IP, IP_ADD_MEMBERSHIP, &request, sizeof(request));
+    }
+}
+
+void MdnsScanner::send_query()
+{
+    if (passive_) {
+        join_groups();
+    }
+
+    std::vector<uint8_t> query = build_mdns_query(SERVICE_TYPE);
+
+    struct sockaddr_in group;
+    memset(&group, 0, sizeof(group));
+    group.sin_family = AF_INET;
+    group.sin_port = htons(MDNS_PORT);
+    inet_pton(AF_INET, MDNS_GROUP, &group.sin_addr);
+
+    auto interfaces = enumerate_interfaces();
+    if (interfaces.empty()) {
+        sendto(socket_fd_, query.data(), query.size(), 0,
+               reinterpret_cast<struct sockaddr*>(&group), sizeof(group));
+        return;
+    }
+
+    // Ask on every link; a phone may sit on a different interface than the default route
+    for (const auto& iface : interfaces) {
+        struct in_addr local;
+        local.s_addr = htonl(iface.address);
+        setsockopt(socket_fd_, IPPROTO_IP, IP_MULTICAST_IF, &local, sizeof(local));
+        sendto(socket_fd_, query.data(), query.size(), 0,
+               reinterpret_cast<struct sockaddr*>(&group), sizeof(group));
+    }
 }
 
+void MdnsScanner::browse_loop()
+{
+    uint8_t buffer[9000];   // Jumbo-frame sized; mDNS packets may exceed 1500 bytes
+    int64_t query_interval_ms = INITIAL_QUERY_INTERVAL_MS;
+    int64_t next_query_ms = steady_ms();
+
+    while (running_) {
+        int64_t now = steady_ms();
+
+        // Continuous querying: 1 s, 2 s, 4 s ... then only TTL refreshes
+        bool query = false;
+        bool changed = false;
+        if (now >= next_query_ms) {
+            query = true;
+            next_query_ms = now + query_interval_ms;
+            query_interval_ms = std::min<int64_t>(query_interval_ms * 2, MAX_QUERY_INTERVAL_MS);
+        }
+        {
+            std::lock_guard<std::mutex> lock(table_mutex_);
+            query = table_.take_refresh(now) || query;
+            if (table_.expire(now)) {
+                BLOG_INFO("mDNS: device record expired, %zu device(s) announced",
+                          table_.services(now).size());
+                table_cv_.notify_all();
+                changed = true;
+            }
+        }
+        if (query) {
+            send_query();
+        }
+        if (changed && change_callback_) {
+            change_callback_();
+        }
+
+        // The stop pipe ends the wait as soon as stop() is called
+        struct pollfd fds[2] = { { socket_fd_, POLLIN, 0 }, { stop_signal_.fd(), POLLIN, 0 } };
+        nfds_t nfds = stop_signal_.fd() >= 0 ? 2 : 1;
+        int timeout = static_cast<int>(std::min<int64_t>(next_query_ms - now, MAX_POLL_MS));
+        if (poll(fds, nfds, std::max(timeout, 0)) <= 0 || !(fds[0].revents & POLLIN)) {
+            continue;
+        }
+
+        while (running_) {
+            struct sockaddr_in source;
+            socklen_t source_len = sizeof(source);
+            ssize_t received = recvfrom(socket_fd_, buffer, sizeof(buffer), MSG_DONTWAIT,
+                                        reinterpret_cast<struct sockaddr*>(&source), &source_len);
+            if (received <= 0) {
+                break;
+            }
+
+            std::vector<MdnsRecord> records;
+            if (!parse_mdns_response(buffer, static_cast<size_t>(received), records) || records.empty()) {
+                continue;   // Queries from other hosts, or unrelated traffic
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(table_mutex_);
+                int64_t arrival = steady_ms();
+                if (!table_.apply(records, ntohl(source.sin_addr.s_addr), arrival)) {
+                    continue;
+                }
+                auto current = table_.services(arrival);
+                BLOG_INFO("mDNS: %zu device(s) announced", current.size());
+                for (const auto& service : current) {
+                    BLOG_DEBUG("  %s -> %s:%u", service.instance.c_str(),
+                               ipv4_to_string(service.address).c_str(), service.port);
+                }
+                table_cv_.notify_all();
+            }
+            if (change_callback_) {
+                change_callback_();
+            }
+        }
+    }
+}
+
+#else
+
+bool MdnsScanner::open_socket() { return false; }
+void MdnsScanner::join_groups() {}
+void MdnsScanner::send_query() {}
+void MdnsScanner::browse_loop() {}
+
+#endif
+
 } // namespace berrystreamcam
@@ -1,21 +1,88 @@
 #pragma once
 
 #include "../common.hpp"
+#include "mdns-records.hpp"
+#include "stop-signal.hpp"
 #include <vector>
 #include <string>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <functional>
 
 namespace berrystreamcam {
 
+/**
+ * Native multicast DNS browser for _streamberry._tcp.local.
+ *
+ * Listens on 224.0.0.251:5353 alongside any system responder and keeps a
+ * table of announced instances, each expiring with its record TTLs. Apart
+ * from the startup queries (1 s, 2 s, 4 s ... capped at one hour) and
+ * refreshes as a record nears the end of its TTL, it sends nothing; the
+ * table follows the phones' own announcements and goodbyes.
+ *
+ * If port 5353 cannot be shared, queries go out from an ephemeral port
+ * and only the unicast replies to them are seen.
+ */
 class MdnsScanner {
 public:
+    static constexpr const char* SERVICE_TYPE = "_streamberry._tcp.local";
+    static constexpr uint16_t MDNS_PORT = 5353;
+    static constexpr int INITIAL_WAIT_MS = 250;
+    static constexpr int MAX_QUERY_INTERVAL_MS = 60 * 60 * 1000;
+
     MdnsScanner();
     ~MdnsScanner();
 
-    // Scan for Streamberry devices via mDNS/Bonjour
+    /**
+     * Open the socket and start the browse thread. Idempotent.
+     */
+    bool start();
+    void stop();
+    bool is_running() const;
+
+    /**
+     * Stop for good: wakes a scan() waiting for first answers, and later
+     * calls to start() or scan() return at once. Used on shutdown.
+     */
+    void cancel();
+
+    /**
+     * Currently announced instances.
+     */
+    std::vector<MdnsService> services() const;
+
+    /**
+     * Addresses of the announced devices. Starts browsing on first use and
+     * then waits INITIAL_WAIT_MS for the first answers.
+     */
     std::vector<std::string> scan();
 
+    /**
+     * Called on the browse thread whenever the set of announced devices
+     * changes. Set it before start().
+     */
+    void set_change_callback(std::function<void()> callback);
+
 private:
-    void* mdns_handle_;
+    bool open_socket();
+    void join_groups();
+    void send_query();
+    void browse_loop();
+
+    int socket_fd_;
+    bool passive_;                       // Bound to 5353 and hearing announcements
+    std::atomic<bool> running_;
+    std::atomic<bool> cancelled_;
+    StopSignal stop_signal_;             // Wakes the browse thread's poll on stop()
+    std::mutex lifecycle_mutex_;         // start() against stop() and cancel()
+    std::thread browse_thread_;
+
+    MdnsServiceTable table_;
+    mutable std::mutex table_mutex_;
+    std::condition_variable table_cv_;   // Signalled when the service set changes
+    std::function<void()> change_callback_;
 };
 
 } // namespace berrystreamcam
@@ -0,0 +1,86 @@
+#include "stop-signal.hpp"
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <errno.h>
+
+namespace berrystreamcam {
+
+StopSignal::StopSignal()
+    : read_fd_(-1)
+    , write_fd_(-1)
+    , stopped_(false)
+{
+    int fds[2];
+    if (pipe(fds) != 0) {
+        BLOG_WARNING("Failed to create stop pipe: %s", strerror(errno));
+        return;
+    }
+
+    for (int fd : fds) {
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+    }
+    read_fd_ = fds[0];
+    write_fd_ = fds[1];
+}
+
+StopSignal::~StopSignal()
+{
+    if (read_fd_ >= 0) {
+        close(read_fd_);
+    }
+    if (write_fd_ >= 0) {
+        close(write_fd_);
+    }
+}
+
+void StopSignal::stop()
+{
+    if (stopped_.exchange(true)) {
+        return;
+    }
+
+    if (write_fd_ >= 0) {
+        char byte = 1;
+        ssize_t written = write(write_fd_, &byte, 1);
+        (void)written;   // A full pipe is readable anyway
+    }
+}
+
+bool StopSignal::stopped() const
+{
+    return stopped_;
+}
+
+int StopSignal::wait(int fd, short events, int timeout_ms) const
+{
+    if (stopped_) {
+        return -1;
+    }
+
+    struct pollfd fds[2] = { { fd, events, 0 }, { read_fd_, POLLIN, 0 } };
+    int ready = poll(fds, read_fd_ >= 0 ? 2 : 1, timeout_ms);
+    if (stopped_ || ready < 0) {
+        return -1;
+    }
+    return fds[0].revents != 0 ? 1 : 0;
+}
+
+void StopSignal::reset()
+{
+    if (read_fd_ >= 0) {
+        char buffer[64];
+        while (read(read_fd_, buffer, sizeof(buffer)) > 0) {
+        }
+    }
+    stopped_ = false;
+}
+
+int StopSignal::fd() const
+{
+    return read_fd_;
+}
+
+} // namespace berrystreamcam
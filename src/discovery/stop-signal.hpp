@@ -0,0 +1,50 @@
+#pragma once
+
+#include "../common.hpp"
+#include <atomic>
+
+namespace berrystreamcam {
+
+/**
+ * Stop request that a blocking loop can poll alongside its sockets.
+ *
+ * After stop() the descriptor from fd() stays readable until reset(), so
+ * any poll()/epoll_wait() that includes it returns at once instead of
+ * running out its timeout.
+ */
+class StopSignal {
+public:
+    StopSignal();
+    ~StopSignal();
+
+    StopSignal(const StopSignal&) = delete;
+    StopSignal& operator=(const StopSignal&) = delete;
+
+    void stop();
+    bool stopped() const;
+
+    /**
+     * poll() one descriptor alongside the stop pipe. Returns 1 once fd is
+     * ready, 0 on timeout, and -1 if stopped (before or during the wait)
+     * or if poll() fails.
+     */
+    int wait(int fd, short events, int timeout_ms) const;
+
+    /**
+     * Clear a previous stop() so the owner can be started again.
+     */
+    void reset();
+
+    /**
+     * Readable once stopped; -1 if no pipe could be created, in which case
+     * callers only see stopped().
+     */
+    int fd() const;
+
+private:
+    int read_fd_;
+    int write_fd_;
+    std::atomic<bool> stopped_;
+};
+
+} // namespace berrystreamcam
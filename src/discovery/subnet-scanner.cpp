@@ -0,0 +1,400 @@
+#include "subnet-scanner.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <set>
+#include <sstream>
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <net/if.h>
+#include <ifaddrs.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#else
+#include <poll.h>
+#endif
+
+namespace berrystreamcam {
+
+namespace {
+
+constexpr uint32_t SUBNET_24_MASK = 0xFFFFFF00u;
+constexpr uint32_t STOP_EVENT = UINT32_MAX;   // epoll tag of the stop pipe
+
+struct Probe {
+    int fd;
+    uint32_t address;
+    uint16_t port;
+    std::chrono::steady_clock::time_point deadline;
+};
+
+/**
+ * Start a non-blocking connect. Returns the socket, or -1 with errno set
+ * (EMFILE/ENFILE when out of descriptors, anything else for a host that
+ * failed immediately).
+ */
+int start_connect(uint32_t address, uint16_t port, bool& connected)
+{
+    connected = false;
+
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+
+    int flags = fcntl(fd, F_GETFL, 0);
+    fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(address);
+
+    if (connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) == 0) {
+        connected = true;
+        return fd;
+    }
+    if (errno == EINPROGRESS) {
+        return fd;
+    }
+
+    int saved_errno = errno;
+    close(fd);
+    errno = saved_errno;
+    return -1;
+}
+
+bool connect_succeeded(int fd)
+{
+    int error = 0;
+    socklen_t len = sizeof(error);
+    return getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &len) == 0 && error == 0;
+}
+
+} // namespace
+
+std::string ipv4_to_string(uint32_t address)
+{
+    struct in_addr addr;
+    addr.s_addr = htonl(address);
+    char buffer[INET_ADDRSTRLEN];
+    if (!inet_ntop(AF_INET, &addr, buffer, sizeof(buffer))) {
+        return "";
+    }
+    return buffer;
+}
+
+std::vector<LocalInterface> enumerate_interfaces()
+{
+    std::vector<LocalInterface> interfaces;
+
+    struct ifaddrs* list = nullptr;
+    if (getifaddrs(&list) != 0) {
+        BLOG_WARNING("getifaddrs failed: %s", strerror(errno));
+        return interfaces;
+    }
+
+    for (struct ifaddrs* entry = list; entry; entry = entry->ifa_next) {
+        if (!entry->ifa_addr || entry->ifa_addr->sa_family != AF_INET || !entry->ifa_netmask) {
+            continue;
+        }
+        // VPN tunnels and loopback never carry a phone on the local network
+        if (!(entry->ifa_flags & IFF_UP) || (entry->ifa_flags & (IFF_LOOPBACK | IFF_POINTOPOINT))) {
+            continue;
+        }
+
+        LocalInterface iface;
+        iface.name = entry->ifa_name ? entry->ifa_name : "";
+        iface.address = ntohl(reinterpret_cast<struct sockaddr_in*>(entry->ifa_addr)->sin_addr.s_addr);
+        iface.netmask = ntohl(reinterpret_cast<struct sockaddr_in*>(entry->ifa_netmask)->sin_addr.s_addr);
+        interfaces.push_back(iface);
+
+        BLOG_DEBUG("Interface %s: %s/%s", iface.name.c_str(),
+                   ipv4_to_string(iface.address).c_str(), ipv4_to_string(iface.netmask).c_str());
+    }
+
+    freeifaddrs(list);
+    return interfaces;
+}
+
+std::vector<uint32_t> parse_arp_table(const std::string& content)
+{
+    std::vector<uint32_t> neighbors;
+    std::istringstream stream(content);
+    std::string line;
+
+    // Header: IP address  HW type  Flags  HW address  Mask  Device
+    std::getline(stream, line);
+
+    while (std::getline(stream, line)) {
+        std::istringstream fields(line);
+        std::string ip, hw_type, flags;
+        if (!(fields >> ip >> hw_type >> flags)) {
+            continue;
+        }
+
+        // ATF_COM (0x2): the MAC was actually resolved
+        if ((std::strtoul(flags.c_str(), nullptr, 16) & 0x2) == 0) {
+            continue;
+        }
+
+        struct in_addr addr;
+        if (inet_pton(AF_INET, ip.c_str(), &addr) == 1) {
+            neighbors.push_back(ntohl(addr.s_addr));
+        }
+    }
+
+    return neighbors;
+}
+
+std::vector<uint32_t> read_neighbor_table()
+{
+    std::ifstream file("/proc/net/arp");
+    if (!file) {
+        return {};
+    }
+    std::stringstream content;
+    content << file.rdbuf();
+    return parse_arp_table(content.str());
+}
+
+std::vector<uint32_t> build_scan_candidates(const std::vector<LocalInterface>& interfaces,
+                                            const std::vector<uint32_t>& neighbors,
+                                            size_t max_subnets)
+{
+    std::vector<uint32_t> candidates;
+    std::set<uint32_t> seen;
+    std::vector<uint32_t> subnets;
+
+    for (const auto& iface : interfaces) {
+        seen.insert(iface.address);
+    }
+
+    auto add_subnet = [&](uint32_t address) {
+        uint32_t subnet = address & SUBNET_24_MASK;
+        if (subnets.size() < max_subnets &&
+            std::find(subnets.begin(), subnets.end(), subnet) == subnets.end()) {
+            subnets.push_back(subnet);
+        }
+    };
+
+    for (const auto& iface : interfaces) {
+        add_subnet(iface.address);
+    }
+
+    // Resolved neighbours are live hosts: probe them first
+    for (uint32_t neighbor : neighbors) {
+        for (const auto& iface : interfaces) {
+            if ((neighbor & iface.netmask) != (iface.address & iface.netmask)) {
+                continue;
+            }
+            if (seen.insert(neighbor).second) {
+                candidates.push_back(neighbor);
+            }
+            add_subnet(neighbor);
+            break;
+        }
+    }
+
+    for (uint32_t subnet : subnets) {
+        for (uint32_t host = 1; host < 255; host++) {
+            uint32_t address = subnet | host;
+            if (seen.insert(address).second) {
+                candidates.push_back(address);
+            }
+        }
+    }
+
+    return candidates;
+}
+
+SubnetScanner::SubnetScanner(size_t max_in_flight, int connect_timeout_ms)
+    : max_in_flight_(std::max<size_t>(1, max_in_flight))
+    , connect_timeout_ms_(connect_timeout_ms)
+    , stop_(nullptr)
+{
+}
+
+void SubnetScanner::set_stop_signal(const StopSignal* stop)
+{
+    stop_ = stop;
+}
+
+std::vector<ScanHit> SubnetScanner::scan(const std::vector<uint32_t>& hosts,
+                                         const std::vector<uint16_t>& ports)
+{
+    std::vector<ScanHit> hits;
+    if (hosts.empty() || ports.empty()) {
+        return hits;
+    }
+
+#ifdef __linux__
+    int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd < 0) {
+        BLOG_ERROR("epoll_create1 failed: %s", strerror(errno));
+        return hits;
+    }
+    std::vector<struct epoll_event> events(max_in_flight_ + 1);
+
+    // The stop pipe sits in the same set so a stop wakes the wait at once
+    if (stop_ && stop_->fd() >= 0) {
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN;
+        ev.data.u32 = STOP_EVENT;
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, stop_->fd(), &ev);
+    }
+#endif
+
+    // Fixed slot table; free slots have fd == -1
+    std::vector<Probe> slots(max_in_flight_, Probe{ -1, 0, 0, {} });
+    std::vector<size_t> free_slots;
+    for (size_t i = slots.size(); i > 0; i--) {
+        free_slots.push_back(i - 1);
+    }
+
+    // Port-major order spreads each host's probes out instead of bursting one device
+    const size_t total = hosts.size() * ports.size();
+    size_t next = 0;
+    size_t in_flight = 0;
+    auto start = std::chrono::steady_clock::now();
+
+    auto finish = [&](size_t index, bool success) {
+        Probe& probe = slots[index];
+        if (success) {
+            hits.push_back({ probe.address, probe.port });
+        }
+        close(probe.fd);   // Also removes it from the epoll set
+        probe.fd = -1;
+        free_slots.push_back(index);
+        in_flight--;
+    };
+
+    while (next < total || in_flight > 0) {
+        if (stop_ && stop_->stopped()) {
+            for (size_t i = 0; i < slots.size(); i++) {
+                if (slots[i].fd >= 0) {
+                    finish(i, false);
+                }
+            }
+            break;
+        }
+
+        // Fill every free slot
+        while (next < total && !free_slots.empty()) {
+            uint32_t address = hosts[next % hosts.size()];
+            uint16_t port = ports[next / hosts.size()];
+
+            bool connected = false;
+            int fd = start_connect(address, port, connected);
+            if (fd < 0) {
+                if ((errno == EMFILE || errno == ENFILE) && in_flight > 0) {
+                    break;  // Out of descriptors; retry once some probes finish
+                }
+                next++;
+                continue;
+            }
+            next++;
+
+            if (connected) {
+                hits.push_back({ address, port });
+                close(fd);
+                continue;
+            }
+
+            size_t index = free_slots.back();
+            free_slots.pop_back();
+            slots[index] = { fd, address, port,
+                             std::chrono::steady_clock::now() +
+                                 std::chrono::milliseconds(connect_timeout_ms_) };
+            in_flight++;
+
+#ifdef __linux__
+            struct epoll_event ev;
+            memset(&ev, 0, sizeof(ev));
+            ev.events = EPOLLOUT;
+            ev.data.u32 = static_cast<uint32_t>(index);
+            if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+                finish(index, false);
+            }
+#endif
+        }
+
+        if (in_flight == 0) {
+            continue;
+        }
+
+        // Sleep until the earliest deadline at most
+        auto now = std::chrono::steady_clock::now();
+        auto earliest = now + std::chrono::milliseconds(connect_timeout_ms_);
+        for (const auto& probe : slots) {
+            if (probe.fd >= 0 && probe.deadline < earliest) {
+                earliest = probe.deadline;
+            }
+        }
+        int wait_ms = static_cast<int>(std::max<int64_t>(0,
+            std::chrono::duration_cast<std::chrono::milliseconds>(earliest - now).count() + 1));
+
+#ifdef __linux__
+        int ready = epoll_wait(epoll_fd, events.data(), static_cast<int>(events.size()), wait_ms);
+        for (int i = 0; i < ready; i++) {
+            if (events[i].data.u32 == STOP_EVENT) {
+                continue;
+            }
+            size_t index = events[i].data.u32;
+            if (slots[index].fd >= 0) {
+                finish(index, connect_succeeded(slots[index].fd));
+            }
+        }
+#else
+        std::vector<struct pollfd> fds;
+        std::vector<size_t> fd_slots;
+        for (size_t i = 0; i < slots.size(); i++) {
+            if (slots[i].fd >= 0) {
+                fds.push_back({ slots[i].fd, POLLOUT, 0 });
+                fd_slots.push_back(i);
+            }
+        }
+        size_t socket_count = fds.size();
+        if (stop_ && stop_->fd() >= 0) {
+            fds.push_back({ stop_->fd(), POLLIN, 0 });
+        }
+        int ready = poll(fds.data(), fds.size(), wait_ms);
+        for (size_t i = 0; ready > 0 && i < socket_count; i++) {
+            if (fds[i].revents) {
+                finish(fd_slots[i], connect_succeeded(fds[i].fd));
+            }
+        }
+#endif
+
+        // Silence from a LAN address this long means nobody is there
+        now = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < slots.size(); i++) {
+            if (slots[i].fd >= 0 && slots[i].deadline <= now) {
+                finish(i, false);
+            }
+        }
+    }
+
+#ifdef __linux__
+    close(epoll_fd);
+#endif
+
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - start).count();
+    BLOG_DEBUG("Subnet scan: %zu probes, %zu open, %lld ms",
+               total, hits.size(), static_cast<long long>(elapsed));
+
+    return hits;
+}
+
+} // namespace berrystreamcam
@@ -0,0 +1,93 @@
+#pragma once
+
+#include "../common.hpp"
+#include "stop-signal.hpp"
+#include <vector>
+#include <string>
+
+namespace berrystreamcam {
+
+/**
+ * An up IPv4 interface; addresses are in host byte order.
+ */
+struct LocalInterface {
+    std::string name;
+    uint32_t address;
+    uint32_t netmask;
+};
+
+/**
+ * A host that accepted a TCP connection on port.
+ */
+struct ScanHit {
+    uint32_t address;
+    uint16_t port;
+};
+
+std::string ipv4_to_string(uint32_t address);
+
+/**
+ * Non-loopback, non-point-to-point IPv4 interfaces from getifaddrs().
+ */
+std::vector<LocalInterface> enumerate_interfaces();
+
+/**
+ * Resolved neighbour addresses from /proc/net/arp content.
+ * Incomplete entries (flags 0x0) are skipped.
+ */
+std::vector<uint32_t> parse_arp_table(const std::string& content);
+
+/**
+ * Kernel neighbour table; empty where /proc/net/arp is unavailable.
+ */
+std::vector<uint32_t> read_neighbor_table();
+
+/**
+ * Hosts to probe, best first.
+ *
+ * Neighbours the kernel already resolved on one of the interfaces come
+ * first, followed by every host of the /24 around each interface address
+ * and around each neighbour, so a /16 show network is swept where devices
+ * actually are rather than across 65k addresses. Our own addresses and the
+ * .0/.255 of each /24 are excluded.
+ */
+std::vector<uint32_t> build_scan_candidates(const std::vector<LocalInterface>& interfaces,
+                                            const std::vector<uint32_t>& neighbors,
+                                            size_t max_subnets);
+
+/**
+ * TCP connect sweep.
+ *
+ * Keeps up to max_in_flight non-blocking connect() calls outstanding and
+ * waits on all of them with one epoll instance (poll() off Linux). A probe
+ * that neither completes nor fails within connect_timeout_ms is dropped,
+ * so a /24 across three ports costs about three timeouts in total.
+ */
+class SubnetScanner {
+public:
+    static constexpr size_t DEFAULT_MAX_IN_FLIGHT = 256;
+    static constexpr int DEFAULT_CONNECT_TIMEOUT_MS = 500;
+    static constexpr size_t DEFAULT_MAX_SUBNETS = 4;
+
+    explicit SubnetScanner(size_t max_in_flight = DEFAULT_MAX_IN_FLIGHT,
+                           int connect_timeout_ms = DEFAULT_CONNECT_TIMEOUT_MS);
+
+    /**
+     * Probe every host on every port. Hits are returned in completion order.
+     */
+    std::vector<ScanHit> scan(const std::vector<uint32_t>& hosts,
+                              const std::vector<uint16_t>& ports);
+
+    /**
+     * Abandon scan() as soon as stop is signalled, returning the hits so
+     * far. stop must outlive the scanner.
+     */
+    void set_stop_signal(const StopSignal* stop);
+
+private:
+    size_t max_in_flight_;
+    int connect_timeout_ms_;
+    const StopSignal* stop_;
+};
+
+} // namespace berrystreamcam
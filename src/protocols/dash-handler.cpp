@@ -0,0 +1,659 @@
+#include "dash-handler.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <strings.h>
+
+namespace berrystreamcam {
+
+namespace {
+
+constexpr int HTTP_TIMEOUT_S = 5;
+constexpr int IO_BUFFER_SIZE = 32768;
+constexpr int64_t RETRY_INTERVAL_MS = 100;
+constexpr uint64_t LIVE_RESYNC_SEGMENTS = 3;   // Jump forward when this far behind the edge
+
+} // namespace
+
+DashHandler::DashHandler()
+    : target_latency_ms_(DEFAULT_TARGET_LATENCY_MS)
+    , segment_duration_ms_(0)
+    , clock_offset_ms_(0)
+    , connected_(false)
+    , running_(false)
+    , interrupted_(false)
+    , next_fetch_number_(0)
+    , read_number_(0)
+    , read_offset_(0)
+    , init_offset_(0)
+    , format_context_(nullptr)
+    , io_context_(nullptr)
+    , bsf_context_(nullptr)
+    , video_stream_index_(-1)
+    , profile_(network_profile_from_name("balanced"))
+    , tuning_{}
+    , stats_{}
+{
+    BLOG_DEBUG("DASH handler created");
+}
+
+DashHandler::~DashHandler()
+{
+    disconnect();
+}
+
+void DashHandler::set_target_latency_ms(int latency_ms)
+{
+    target_latency_ms_ = std::max(0, latency_ms);
+}
+
+bool DashHandler::connect(const std::string& manifest_url)
+{
+    // Threads of a previous session must be joined before new ones start
+    close_session();
+    if (interrupted_) {
+        return false;
+    }
+
+    BLOG_INFO("Connecting to DASH: %s", manifest_url.c_str());
+    manifest_url_ = manifest_url;
+
+    CURL* curl = curl_easy_init();
+    if (!curl) {
+        BLOG_ERROR("Failed to create curl handle");
+        return false;
+    }
+
+    running_ = true;
+
+    // Manifest first; its Date header also gives us the server's clock
+    std::vector<uint8_t> body;
+    FetchContext context = { this, curl, nullptr, &body, 0 };
+    long response_code = 0;
+    if (!fetch_url(curl, manifest_url, context, response_code) || response_code != 200) {
+        BLOG_ERROR("Failed to fetch DASH manifest (HTTP %ld)", response_code);
+        curl_easy_cleanup(curl);
+        running_ = false;
+        return false;
+    }
+
+    if (!parse_dash_manifest(std::string(body.begin(), body.end()), manifest_url, manifest_)) {
+        curl_easy_cleanup(curl);
+        running_ = false;
+        return false;
+    }
+
+    clock_offset_ms_ = 0;
+    if (context.server_date_ms > 0) {
+        int64_t offset = context.server_date_ms - wall_clock_ms();
+        // Date has one-second resolution; only correct real skew
+        if (std::abs(offset) > 1000) {
+            clock_offset_ms_ = offset;
+            BLOG_INFO("DASH server clock differs by %lld ms, compensating",
+                      static_cast<long long>(offset));
+        }
+    }
+
+    segment_duration_ms_ = dash_segment_duration_ms(manifest_);
+
+    std::vector<uint8_t> init;
+    context = { this, curl, nullptr, &init, 0 };
+    if (!manifest_.initialization.empty()) {
+        if (!fetch_url(curl, dash_init_url(manifest_), context, response_code) || response_code != 200) {
+            BLOG_ERROR("Failed to fetch DASH init segment (HTTP %ld)", response_code);
+            curl_easy_cleanup(curl);
+            running_ = false;
+            return false;
+        }
+    }
+    curl_easy_cleanup(curl);
+
+    int latency_ms = target_latency_ms_;
+    {
+        std::lock_guard<std::mutex> lock(cache_mutex_);
+        init_segment_ = std::move(init);
+        init_offset_ = 0;
+        segments_.clear();
+        read_number_ = dash_live_edge_number(manifest_, wall_clock_ms(), latency_ms);
+        next_fetch_number_ = read_number_;
+        read_offset_ = 0;
+        stats_ = {};
+        stats_.current_segment = read_number_;
+    }
+
+    BLOG_INFO("DASH %s stream: representation %s (%dx%d, %lld bps), %lld ms segments, "
+              "starting at segment %llu (%d ms behind live)",
+              manifest_.is_dynamic ? "live" : "static",
+              manifest_.representation_id.c_str(), manifest_.width, manifest_.height,
+              static_cast<long long>(manifest_.bandwidth),
+              static_cast<long long>(segment_duration_ms_),
+              static_cast<unsigned long long>(read_number_), latency_ms);
+
+    frame_queue_.clear();
+    connected_ = true;
+
+    for (size_t i = 0; i < DEFAULT_PREFETCH_WORKERS; i++) {
+        workers_.emplace_back(&DashHandler::fetch_worker, this);
+    }
+    demux_thread_ = std::thread(&DashHandler::demux_loop, this);
+
+    return true;
+}
+
+void DashHandler::disconnect()
+{
+    close_session();
+    interrupted_ = false;
+}
+
+void DashHandler::interrupt()
+{
+    interrupted_ = true;
+}
+
+void DashHandler::close_session()
+{
+    bool was_connected = connected_.exchange(false);
+    running_ = false;
+    cache_cv_.notify_all();
+
+    for (auto& worker : workers_) {
+        if (worker.joinable()) {
+            try {
+                worker.join();
+            } catch (...) {
+                BLOG_WARNING("Exception while joining DASH fetch worker");
+            }
+        }
+    }
+    workers_.clear();
+
+    if (demux_thread_.joinable()) {
+        try {
+            demux_thread_.join();
+        } catch (...) {
+            BLOG_WARNING("Exception while joining DASH demux thread");
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(cache_mutex_);
+        segments_.clear();
+        init_segment_.clear();
+
+        if (was_connected) {
+            BLOG_INFO("Disconnecting DASH: %llu segments fetched, %llu failed, %llu live resyncs",
+                      static_cast<unsigned long long>(stats_.segments_fetched),
+                      static_cast<unsigned long long>(stats_.segments_failed),
+                      static_cast<unsigned long long>(stats_.live_resyncs));
+        }
+    }
+
+    frame_queue_.clear();
+}
+
+bool DashHandler::is_connected() const
+{
+    return connected_;
+}
+
+bool DashHandler::receive_frame(VideoFrame& frame)
+{
+    return frame_queue_.pop(frame);
+}
+
+DashStats DashHandler::get_stats() const
+{
+    std::lock_guard<std::mutex> lock(cache_mutex_);
+    DashStats stats = stats_;
+    stats.cached_segments = static_cast<uint32_t>(segments_.size());
+    stats.current_segment = read_number_;
+    if (manifest_.is_dynamic && manifest_.availability_start_ms != 0) {
+        stats.live_latency_ms = static_cast<double>(wall_clock_ms() - segment_start_ms(read_number_));
+    }
+    return stats;
+}
+
+void DashHandler::set_network_profile(const NetworkProfile& profile)
+{
+    std::lock_guard<std::mutex> lock(tuning_mutex_);
+    profile_ = profile;
+}
+
+SocketTuning DashHandler::get_socket_tuning() const
+{
+    std::lock_guard<std::mutex> lock(tuning_mutex_);
+    return tuning_;
+}
+
+int64_t DashHandler::wall_clock_ms() const
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count() + clock_offset_ms_;
+}
+
+int64_t DashHandler::segment_start_ms(uint64_t number) const
+{
+    return manifest_.availability_start_ms +
+           static_cast<int64_t>(number - manifest_.start_number) * segment_duration_ms_;
+}
+
+bool DashHandler::wait_locked(std::unique_lock<std::mutex>& lock, int64_t timeout_ms)
+{
+    cache_cv_.wait_for(lock, std::chrono::milliseconds(timeout_ms), [this]() { return !running_; });
+    return running_;
+}
+
+void DashHandler::fetch_worker()
+{
+    CURL* curl = curl_easy_init();
+    if (!curl) {
+        BLOG_ERROR("DASH fetch worker could not create a curl handle");
+        return;
+    }
+
+    while (running_) {
+        std::shared_ptr<Segment> segment;
+        {
+            std::unique_lock<std::mutex> lock(cache_mutex_);
+            cache_cv_.wait(lock, [this]() {
+                return !running_ ||
+                       (segments_.size() < MAX_CACHED_SEGMENTS &&
+                        next_fetch_number_ < read_number_ + MAX_CACHED_SEGMENTS);
+            });
+            if (!running_) {
+                break;
+            }
+
+            // Don't ask for a live segment before the camera has started producing it
+            if (manifest_.is_dynamic && manifest_.availability_start_ms != 0) {
+                int64_t available_ms = segment_start_ms(next_fetch_number_) -
+                                       manifest_.availability_offset_ms;
+                int64_t wait_ms = available_ms - wall_clock_ms();
+                if (wait_ms > 0) {
+                    wait_locked(lock, std::min(wait_ms, segment_duration_ms_));
+                    continue;
+                }
+            }
+
+            segment = std::make_shared<Segment>();
+            segment->number = next_fetch_number_++;
+            segment->complete = false;
+            segment->failed = false;
+            segments_[segment->number] = segment;
+        }
+
+        fetch_segment(curl, segment);
+    }
+
+    curl_easy_cleanup(curl);
+}
+
+bool DashHandler::fetch_segment(CURL* curl, const std::shared_ptr<Segment>& segment)
+{
+    std::string url = dash_segment_url(manifest_, segment->number);
+    auto start = std::chrono::steady_clock::now();
+
+    // A live segment can 404 until the encoder finishes it; retry for two durations
+    int64_t give_up_ms = std::max<int64_t>(2 * segment_duration_ms_, 2000);
+
+    while (running_) {
+        FetchContext context = { this, curl, segment, nullptr, 0 };
+        long response_code = 0;
+        bool ok = fetch_url(curl, url, context, response_code);
+
+        std::unique_lock<std::mutex> lock(cache_mutex_);
+
+        if (ok && response_code == 200) {
+            segment->complete = true;
+            stats_.segments_fetched++;
+            stats_.bytes_fetched += segment->data.size();
+            stats_.last_fetch_ms = std::chrono::duration<double, std::milli>(
+                std::chrono::steady_clock::now() - start).count();
+            cache_cv_.notify_all();
+            return true;
+        }
+
+        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - start).count();
+        bool retry = (response_code == 404 || response_code == 0) &&
+                     segment->data.empty() && elapsed < give_up_ms;
+        if (!retry) {
+            BLOG_WARNING("DASH segment %llu failed (HTTP %ld)",
+                         static_cast<unsigned long long>(segment->number), response_code);
+            break;
+        }
+
+        wait_locked(lock, RETRY_INTERVAL_MS);
+    }
+
+    std::lock_guard<std::mutex> lock(cache_mutex_);
+    segment->failed = true;
+    if (running_) {
+        stats_.segments_failed++;
+    }
+    cache_cv_.notify_all();
+    return false;
+}
+
+bool DashHandler::fetch_url(CURL* curl, const std::string& url, FetchContext& context, long& response_code)
+{
+    curl_easy_reset(curl);
+    curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+    curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, 2L);
+    curl_easy_setopt(curl, CURLOPT_LOW_SPEED_LIMIT, 1L);
+    curl_easy_setopt(curl, CURLOPT_LOW_SPEED_TIME, static_cast<long>(HTTP_TIMEOUT_S));
+    curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+    curl_easy_setopt(curl, CURLOPT_SOCKOPTFUNCTION, &DashHandler::sockopt_callback);
+    curl_easy_setopt(curl, CURLOPT_SOCKOPTDATA, &context);
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, &DashHandler::write_callback);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &context);
+    curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, &DashHandler::header_callback);
+    curl_easy_setopt(curl, CURLOPT_HEADERDATA, &context);
+    curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, &DashHandler::progress_callback);
+    curl_easy_setopt(curl, CURLOPT_XFERINFODATA, &context);
+    curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
+
+    CURLcode res = curl_easy_perform(curl);
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &response_code);
+
+    if (res != CURLE_OK && running_) {
+        BLOG_DEBUG("DASH fetch %s: %s", url.c_str(), curl_easy_strerror(res));
+    }
+    return res == CURLE_OK;
+}
+
+size_t DashHandler::write_callback(char* ptr, size_t size, size_t nmemb, void* userdata)
+{
+    FetchContext* context = static_cast<FetchContext*>(userdata);
+    size_t bytes = size * nmemb;
+
+    // Error bodies (404 while a live segment is pending) are not media
+    long response_code = 0;
+    curl_easy_getinfo(context->curl, CURLINFO_RESPONSE_CODE, &response_code);
+    if (response_code != 200) {
+        return bytes;
+    }
+
+    if (context->buffer) {
+        context->buffer->insert(context->buffer->end(), ptr, ptr + bytes);
+        return bytes;
+    }
+
+    // Make chunked CMAF data visible to the demuxer as it arrives
+    DashHandler* handler = context->handler;
+    {
+        std::lock_guard<std::mutex> lock(handler->cache_mutex_);
+        context->segment->data.insert(context->segment->data.end(), ptr, ptr + bytes);
+    }
+    handler->cache_cv_.notify_all();
+    return bytes;
+}
+
+size_t DashHandler::header_callback(char* ptr, size_t size, size_t nmemb, void* userdata)
+{
+    FetchContext* context = static_cast<FetchContext*>(userdata);
+    size_t bytes = size * nmemb;
+
+    if (bytes > 5 && strncasecmp(ptr, "Date:", 5) == 0) {
+        std::string value(ptr + 5, bytes - 5);
+        time_t date = curl_getdate(value.c_str(), nullptr);
+        if (date > 0) {
+            context->server_date_ms = static_cast<int64_t>(date) * 1000;
+        }
+    }
+
+    return bytes;
+}
+
+int DashHandler::progress_callback(void* userdata, curl_off_t, curl_off_t, curl_off_t, curl_off_t)
+{
+    // Abort transfers promptly on disconnect or interrupt
+    FetchContext* context = static_cast<FetchContext*>(userdata);
+    return context->handler->running_ && !context->handler->interrupted_ ? 0 : 1;
+}
+
+int DashHandler::sockopt_callback(void* userdata, curl_socket_t fd, curlsocktype purpose)
+{
+    if (purpose != CURLSOCKTYPE_IPCXN) {
+        return CURL_SOCKOPT_OK;
+    }
+
+    // Only new connections get here; keep-alive reuse keeps earlier tuning
+    FetchContext* context = static_cast<FetchContext*>(userdata);
+    DashHandler* handler = context->handler;
+    std::lock_guard<std::mutex> lock(handler->tuning_mutex_);
+    handler->tuning_ = apply_network_profile(static_cast<int>(fd), handler->profile_, true);
+    return CURL_SOCKOPT_OK;
+}
+
+void DashHandler::resync_to_live_edge_locked()
+{
+    uint64_t edge = dash_live_edge_number(manifest_, wall_clock_ms(), target_latency_ms_);
+    if (edge <= read_number_ + LIVE_RESYNC_SEGMENTS) {
+        return;
+    }
+
+    BLOG_WARNING("DASH playback %llu segments behind live, jumping to segment %llu",
+                 static_cast<unsigned long long>(edge - read_number_),
+                 static_cast<unsigned long long>(edge));
+
+    // In-flight fetches of older segments finish into orphaned entries
+    segments_.erase(segments_.begin(), segments_.lower_bound(edge));
+    read_number_ = edge;
+    read_offset_ = 0;
+    next_fetch_number_ = std::max(next_fetch_number_, edge);
+    stats_.live_resyncs++;
+    cache_cv_.notify_all();
+}
+
+int DashHandler::read_callback(void* opaque, uint8_t* buf, int size)
+{
+    return static_cast<DashHandler*>(opaque)->read_media(buf, size);
+}
+
+int DashHandler::read_media(uint8_t* buf, int size)
+{
+    std::unique_lock<std::mutex> lock(cache_mutex_);
+
+    // The init segment (ftyp/moov) precedes the media segments
+    if (init_offset_ < init_segment_.size()) {
+        size_t count = std::min(static_cast<size_t>(size), init_segment_.size() - init_offset_);
+        memcpy(buf, init_segment_.data() + init_offset_, count);
+        init_offset_ += count;
+        return static_cast<int>(count);
+    }
+
+    while (running_) {
+        auto it = segments_.find(read_number_);
+        if (it == segments_.end()) {
+            wait_locked(lock, RETRY_INTERVAL_MS);
+            continue;
+        }
+
+        Segment& segment = *it->second;
+        if (read_offset_ < segment.data.size()) {
+            size_t count = std::min(static_cast<size_t>(size), segment.data.size() - read_offset_);
+            memcpy(buf, segment.data.data() + read_offset_, count);
+            read_offset_ += count;
+            return static_cast<int>(count);
+        }
+
+        if (!segment.complete && !segment.failed) {
+            wait_locked(lock, RETRY_INTERVAL_MS);
+            continue;
+        }
+
+        // Segment consumed (or given up on); release it and move to the next
+        segments_.erase(it);
+        read_number_++;
+        read_offset_ = 0;
+        cache_cv_.notify_all();
+
+        if (manifest_.is_dynamic && manifest_.availability_start_ms != 0) {
+            resync_to_live_edge_locked();
+        }
+    }
+
+    return AVERROR_EOF;
+}
+
+bool DashHandler::open_demuxer()
+{
+    uint8_t* buffer = static_cast<uint8_t*>(av_malloc(IO_BUFFER_SIZE));
+    if (!buffer) {
+        return false;
+    }
+
+    io_context_ = avio_alloc_context(buffer, IO_BUFFER_SIZE, 0, this,
+                                     &DashHandler::read_callback, nullptr, nullptr);
+    format_context_ = avformat_alloc_context();
+    if (!io_context_ || !format_context_) {
+        BLOG_ERROR("Failed to allocate DASH demuxer");
+        if (!io_context_) {
+            av_free(buffer);
+        }
+        return false;
+    }
+
+    format_context_->pb = io_context_;
+    format_context_->flags |= AVFMT_FLAG_CUSTOM_IO;
+    // The moov box already describes the stream; don't wait on extra segments
+    format_context_->probesize = IO_BUFFER_SIZE * 4;
+    format_context_->max_analyze_duration = AV_TIME_BASE / 2;
+
+    int ret = avformat_open_input(&format_context_, nullptr, nullptr, nullptr);
+    if (ret < 0) {
+        char errbuf[AV_ERROR_MAX_STRING_SIZE];
+        av_strerror(ret, errbuf, sizeof(errbuf));
+        BLOG_ERROR("Failed to open DASH stream: %s", errbuf);
+        return false;
+    }
+
+    ret = avformat_find_stream_info(format_context_, nullptr);
+    if (ret < 0) {
+        BLOG_WARNING("DASH stream info incomplete, continuing with init segment data");
+    }
+
+    video_stream_index_ = av_find_best_stream(format_context_, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+    if (video_stream_index_ < 0) {
+        BLOG_ERROR("No video stream found in DASH representation");
+        return false;
+    }
+
+    // fMP4 carries length-prefixed NAL units; the decoder expects Annex-B
+    AVCodecParameters* codecpar = format_context_->streams[video_stream_index_]->codecpar;
+    const char* filter_name = nullptr;
+    if (codecpar->codec_id == AV_CODEC_ID_H264) {
+        filter_name = "h264_mp4toannexb";
+    } else if (codecpar->codec_id == AV_CODEC_ID_HEVC) {
+        filter_name = "hevc_mp4toannexb";
+    }
+
+    if (filter_name) {
+        const AVBitStreamFilter* filter = av_bsf_get_by_name(filter_name);
+        if (!filter || av_bsf_alloc(filter, &bsf_context_) < 0) {
+            BLOG_ERROR("Failed to create %s filter", filter_name);
+            return false;
+        }
+        avcodec_parameters_copy(bsf_context_->par_in, codecpar);
+        bsf_context_->time_base_in = format_context_->streams[video_stream_index_]->time_base;
+        if (av_bsf_init(bsf_context_) < 0) {
+            BLOG_ERROR("Failed to initialise %s filter", filter_name);
+            return false;
+        }
+    }
+
+    BLOG_INFO("DASH demuxer opened (%s)", avcodec_get_name(codecpar->codec_id));
+    return true;
+}
+
+void DashHandler::close_demuxer()
+{
+    if (bsf_context_) {
+        av_bsf_free(&bsf_context_);
+    }
+
+    if (format_context_) {
+        avformat_close_input(&format_context_);
+    }
+
+    // Custom IO is not freed by avformat_close_input
+    if (io_context_) {
+        av_freep(&io_context_->buffer);
+        avio_context_free(&io_context_);
+    }
+
+    video_stream_index_ = -1;
+}
+
+void DashHandler::demux_loop()
+{
+    BLOG_INFO("DASH demux thread started");
+
+    if (!open_demuxer()) {
+        close_demuxer();
+        connected_ = false;
+        BLOG_INFO("DASH demux thread stopped");
+        return;
+    }
+
+    AVPacket* packet = av_packet_alloc();
+    auto push_packet = [this](const AVPacket* pkt) {
+        VideoFrame frame = {};
+        frame.size = pkt->size;
+        frame.data = new uint8_t[frame.size];
+        memcpy(frame.data, pkt->data, frame.size);
+        frame.timestamp = pkt->pts;
+        frame.pts = pkt->pts;
+        frame.dts = pkt->dts;
+        frame.is_keyframe = (pkt->flags & AV_PKT_FLAG_KEY) != 0;
+        frame_queue_.push(std::move(frame));
+    };
+
+    while (running_ && packet) {
+        int ret = av_read_frame(format_context_, packet);
+        if (ret < 0) {
+            if (ret == AVERROR_EOF || !running_) {
+                if (running_) {
+                    BLOG_WARNING("DASH stream ended");
+                    connected_ = false;
+                }
+                break;
+            }
+            char errbuf[AV_ERROR_MAX_STRING_SIZE];
+            av_strerror(ret, errbuf, sizeof(errbuf));
+            BLOG_WARNING("Error reading DASH frame: %s", errbuf);
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            continue;
+        }
+
+        if (packet->stream_index != video_stream_index_) {
+            av_packet_unref(packet);
+            continue;
+        }
+
+        if (!bsf_context_) {
+            push_packet(packet);
+            av_packet_unref(packet);
+            continue;
+        }
+
+        if (av_bsf_send_packet(bsf_context_, packet) < 0) {
+            av_packet_unref(packet);
+            continue;
+        }
+        while (av_bsf_receive_packet(bsf_context_, packet) == 0) {
+            push_packet(packet);
+            av_packet_unref(packet);
+        }
+    }
+
+    av_packet_free(&packet);
+    close_demuxer();
+    BLOG_INFO("DASH demux thread stopped");
+}
+
+} // namespace berrystreamcam
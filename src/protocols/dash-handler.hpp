@@ -0,0 +1,161 @@
+#pragma once
+
+#include "../common.hpp"
+#include "frame-queue.hpp"
+#include "dash-manifest.hpp"
+#include "socket-tuning.hpp"
+#include <string>
+#include <memory>
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <vector>
+#include <curl/curl.h>
+
+extern "C" {
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+#include <libavcodec/bsf.h>
+}
+
+namespace berrystreamcam {
+
+/**
+ * DASH ingest counters.
+ */
+struct DashStats {
+    uint64_t segments_fetched;
+    uint64_t segments_failed;     // Gave up after retries; playback skipped them
+    uint64_t live_resyncs;        // Jumps back to the live edge after falling behind
+    uint64_t bytes_fetched;
+    uint64_t current_segment;
+    uint32_t cached_segments;
+    double last_fetch_ms;         // Request to last byte of the newest segment
+    double live_latency_ms;       // Wall clock minus the playing segment's start
+};
+
+/**
+ * MPEG-DASH / CMAF client for live SegmentTemplate streams.
+ *
+ * Several fetch workers download upcoming segments concurrently, each on
+ * its own keep-alive connection, into a bounded cache keyed by segment
+ * number. Bytes are appended as they arrive, so a CMAF segment served with
+ * chunked transfer can be demuxed before it is complete. The demux thread
+ * reads the init segment followed by media segments in order through a
+ * custom FFmpeg AVIO context and converts H.264 to Annex-B.
+ *
+ * Playback starts target_latency_ms behind the live edge computed from
+ * availabilityStartTime. A segment that cannot be fetched is skipped, and
+ * if playback drifts more than a few segments behind the edge it jumps
+ * forward rather than accumulating delay.
+ */
+class DashHandler {
+public:
+    static constexpr int DEFAULT_TARGET_LATENCY_MS = 3000;
+    static constexpr size_t DEFAULT_PREFETCH_WORKERS = 3;
+    static constexpr size_t MAX_CACHED_SEGMENTS = 8;
+
+    DashHandler();
+    ~DashHandler();
+
+    /**
+     * Distance behind the live edge; applied on the next connect().
+     */
+    void set_target_latency_ms(int latency_ms);
+
+    bool connect(const std::string& manifest_url);
+    void disconnect();
+    bool is_connected() const;
+
+    /**
+     * Abort connect()'s fetches; never blocks. Cleared by disconnect().
+     */
+    void interrupt();
+
+    bool receive_frame(VideoFrame& frame);
+
+    DashStats get_stats() const;
+
+    /**
+     * Applied to every new fetch connection through curl's socket
+     * callback; reports the last connection opened.
+     */
+    void set_network_profile(const NetworkProfile& profile);
+    SocketTuning get_socket_tuning() const;
+
+private:
+    struct Segment {
+        uint64_t number;
+        std::vector<uint8_t> data;
+        bool complete;
+        bool failed;
+    };
+
+    struct FetchContext {
+        DashHandler* handler;
+        CURL* curl;
+        std::shared_ptr<Segment> segment;   // Streamed into the cache, or
+        std::vector<uint8_t>* buffer;       // collected for manifest and init
+        int64_t server_date_ms;
+    };
+
+    void close_session();
+    void fetch_worker();
+    bool fetch_segment(CURL* curl, const std::shared_ptr<Segment>& segment);
+    bool fetch_url(CURL* curl, const std::string& url, FetchContext& context, long& response_code);
+    static size_t write_callback(char* ptr, size_t size, size_t nmemb, void* userdata);
+    static size_t header_callback(char* ptr, size_t size, size_t nmemb, void* userdata);
+    static int progress_callback(void* userdata, curl_off_t, curl_off_t, curl_off_t, curl_off_t);
+    static int sockopt_callback(void* userdata, curl_socket_t fd, curlsocktype purpose);
+
+    void demux_loop();
+    bool open_demuxer();
+    void close_demuxer();
+    static int read_callback(void* opaque, uint8_t* buf, int size);
+    int read_media(uint8_t* buf, int size);
+
+    int64_t wall_clock_ms() const;
+    int64_t segment_start_ms(uint64_t number) const;
+    bool wait_locked(std::unique_lock<std::mutex>& lock, int64_t timeout_ms);
+    void resync_to_live_edge_locked();
+
+    std::string manifest_url_;
+    DashManifest manifest_;
+    std::atomic<int> target_latency_ms_;   // Set from the UI thread, read by the demuxer
+    int64_t segment_duration_ms_;
+    int64_t clock_offset_ms_;     // Server clock minus ours, from the manifest's Date header
+
+    std::atomic<bool> connected_;
+    std::atomic<bool> running_;
+    std::atomic<bool> interrupted_;
+    std::vector<std::thread> workers_;
+    std::thread demux_thread_;
+
+    // Segment cache, shared by fetch workers and the demux reader
+    std::map<uint64_t, std::shared_ptr<Segment>> segments_;
+    uint64_t next_fetch_number_;
+    uint64_t read_number_;
+    size_t read_offset_;
+    std::vector<uint8_t> init_segment_;
+    size_t init_offset_;
+    mutable std::mutex cache_mutex_;
+    std::condition_variable cache_cv_;
+
+    // FFmpeg components, owned by the demux thread
+    AVFormatContext* format_context_;
+    AVIOContext* io_context_;
+    AVBSFContext* bsf_context_;
+    int video_stream_index_;
+
+    FrameQueue frame_queue_;
+
+    NetworkProfile profile_;
+    SocketTuning tuning_;
+    mutable std::mutex tuning_mutex_;   // Fetch workers tune concurrently
+
+    DashStats stats_;
+};
+
+} // namespace berrystreamcam
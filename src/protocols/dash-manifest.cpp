@@ -0,0 +1,403 @@
+#include "dash-manifest.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace berrystreamcam {
+
+namespace {
+
+struct Tag {
+    std::string name;
+    std::string attrs;
+    bool closing;
+    bool self_closing;
+};
+
+struct Template {
+    std::string initialization;
+    std::string media;
+    uint64_t timescale = 1;
+    uint64_t duration = 0;
+    uint64_t start_number = 1;
+    int64_t availability_offset_ms = 0;
+    bool has_timeline = false;
+};
+
+// Next element tag at or after pos; skips declarations and comments
+bool next_tag(const std::string& xml, size_t& pos, Tag& tag)
+{
+    while (true) {
+        size_t open = xml.find('<', pos);
+        if (open == std::string::npos) {
+            return false;
+        }
+
+        if (xml.compare(open, 4, "<!--") == 0) {
+            size_t end = xml.find("-->", open);
+            pos = end == std::string::npos ? xml.size() : end + 3;
+            continue;
+        }
+
+        size_t close = xml.find('>', open);
+        if (close == std::string::npos) {
+            return false;
+        }
+        pos = close + 1;
+
+        if (xml[open + 1] == '?' || xml[open + 1] == '!') {
+            continue;
+        }
+
+        tag.closing = xml[open + 1] == '/';
+        tag.self_closing = xml[close - 1] == '/';
+
+        size_t name_start = open + (tag.closing ? 2 : 1);
+        size_t name_end = xml.find_first_of(" \t\r\n/>", name_start);
+        tag.name = xml.substr(name_start, name_end - name_start);
+
+        // Drop any namespace prefix (e.g. "mpd:SegmentTemplate")
+        size_t colon = tag.name.find(':');
+        if (colon != std::string::npos) {
+            tag.name = tag.name.substr(colon + 1);
+        }
+
+        tag.attrs = xml.substr(name_end, close - name_end);
+        return true;
+    }
+}
+
+bool attribute(const std::string& attrs, const char* name, std::string& value)
+{
+    size_t name_length = strlen(name);
+    size_t pos = 0;
+    while ((pos = attrs.find(name, pos)) != std::string::npos) {
+        bool starts_word = pos > 0 && isspace(static_cast<unsigned char>(attrs[pos - 1]));
+        size_t eq = pos + name_length;
+        if (starts_word && eq + 1 < attrs.size() && attrs[eq] == '=' &&
+            (attrs[eq + 1] == '"' || attrs[eq + 1] == '\'')) {
+            char quote = attrs[eq + 1];
+            size_t end = attrs.find(quote, eq + 2);
+            if (end == std::string::npos) {
+                return false;
+            }
+            value = attrs.substr(eq + 2, end - eq - 2);
+            return true;
+        }
+        pos = eq;
+    }
+    return false;
+}
+
+// xs:duration such as "PT2S", "PT1M30.5S" or "P0Y0M0DT0H0M4.000S"
+int64_t parse_duration_ms(const std::string& text)
+{
+    size_t t = text.find('T');
+    if (t == std::string::npos) {
+        return 0;
+    }
+
+    double total_s = 0.0;
+    const char* p = text.c_str() + t + 1;
+    while (*p) {
+        char* end = nullptr;
+        double value = strtod(p, &end);
+        if (end == p || !*end) {
+            break;
+        }
+        switch (*end) {
+        case 'H': total_s += value * 3600.0; break;
+        case 'M': total_s += value * 60.0; break;
+        case 'S': total_s += value; break;
+        default: break;
+        }
+        p = end + 1;
+    }
+
+    return static_cast<int64_t>(total_s * 1000.0 + 0.5);
+}
+
+// Days since 1970-01-01 for a proleptic Gregorian date
+int64_t days_from_civil(int64_t y, unsigned m, unsigned d)
+{
+    y -= m <= 2;
+    int64_t era = (y >= 0 ? y : y - 399) / 400;
+    unsigned yoe = static_cast<unsigned>(y - era * 400);
+    unsigned doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + static_cast<int64_t>(doe) - 719468;
+}
+
+// xs:dateTime such as "2024-05-01T12:00:00Z" or "2024-05-01T12:00:00.250+02:00"
+int64_t parse_datetime_ms(const std::string& text)
+{
+    int year, month, day, hour, minute;
+    double second;
+    int consumed = 0;
+    if (sscanf(text.c_str(), "%d-%d-%dT%d:%d:%lf%n",
+               &year, &month, &day, &hour, &minute, &second, &consumed) < 6) {
+        return 0;
+    }
+
+    int64_t ms = days_from_civil(year, month, day) * 86400000LL +
+                 (hour * 3600LL + minute * 60LL) * 1000LL +
+                 static_cast<int64_t>(second * 1000.0 + 0.5);
+
+    const char* zone = text.c_str() + consumed;
+    if (*zone == '+' || *zone == '-') {
+        int zone_hour = 0, zone_minute = 0;
+        sscanf(zone + 1, "%d:%d", &zone_hour, &zone_minute);
+        int64_t offset = (zone_hour * 60LL + zone_minute) * 60000LL;
+        ms += *zone == '+' ? -offset : offset;
+    }
+
+    return ms;
+}
+
+void parse_template(const std::string& attrs, Template& tmpl)
+{
+    std::string value;
+    if (attribute(attrs, "initialization", value)) tmpl.initialization = value;
+    if (attribute(attrs, "media", value)) tmpl.media = value;
+    if (attribute(attrs, "timescale", value)) tmpl.timescale = strtoull(value.c_str(), nullptr, 10);
+    if (attribute(attrs, "duration", value)) tmpl.duration = strtoull(value.c_str(), nullptr, 10);
+    if (attribute(attrs, "startNumber", value)) tmpl.start_number = strtoull(value.c_str(), nullptr, 10);
+    if (attribute(attrs, "availabilityTimeOffset", value) && value != "INF") {
+        tmpl.availability_offset_ms = static_cast<int64_t>(strtod(value.c_str(), nullptr) * 1000.0);
+    }
+    if (tmpl.timescale == 0) {
+        tmpl.timescale = 1;
+    }
+}
+
+std::string resolve_url(const std::string& base, const std::string& relative)
+{
+    if (relative.compare(0, 7, "http://") == 0 || relative.compare(0, 8, "https://") == 0) {
+        return relative;
+    }
+
+    if (!relative.empty() && relative[0] == '/') {
+        // Host-relative: keep scheme://host[:port]
+        size_t host = base.find("://");
+        size_t path = host == std::string::npos ? std::string::npos : base.find('/', host + 3);
+        return base.substr(0, path) + relative;
+    }
+
+    return base + relative;
+}
+
+std::string directory_of(const std::string& url)
+{
+    size_t query = url.find('?');
+    size_t slash = url.rfind('/', query);
+    return slash == std::string::npos ? url + "/" : url.substr(0, slash + 1);
+}
+
+// Expand $RepresentationID$, $Bandwidth$, $Number$ and $Number%0Nd$
+std::string expand_template(const std::string& tmpl, const DashManifest& manifest, uint64_t number)
+{
+    std::string out;
+    size_t pos = 0;
+    while (pos < tmpl.size()) {
+        size_t start = tmpl.find('$', pos);
+        if (start == std::string::npos) {
+            out += tmpl.substr(pos);
+            break;
+        }
+        out += tmpl.substr(pos, start - pos);
+
+        size_t end = tmpl.find('$', start + 1);
+        if (end == std::string::npos) {
+            out += tmpl.substr(start);
+            break;
+        }
+
+        std::string identifier = tmpl.substr(start + 1, end - start - 1);
+        size_t format = identifier.find('%');
+        std::string name = identifier.substr(0, format);
+        std::string width = format == std::string::npos ? "" : identifier.substr(format);
+
+        char buffer[32];
+        if (identifier.empty()) {
+            out += '$';
+        } else if (name == "RepresentationID") {
+            out += manifest.representation_id;
+        } else if (name == "Number" || name == "Bandwidth") {
+            unsigned long long value = name == "Number"
+                ? static_cast<unsigned long long>(number)
+                : static_cast<unsigned long long>(manifest.bandwidth);
+            if (!width.empty() && width.back() == 'd') {
+                int digits = atoi(width.c_str() + 1);
+                snprintf(buffer, sizeof(buffer), "%0*llu", digits, value);
+            } else {
+                snprintf(buffer, sizeof(buffer), "%llu", value);
+            }
+            out += buffer;
+        } else {
+            out += tmpl.substr(start, end - start + 1);
+        }
+
+        pos = end + 1;
+    }
+    return out;
+}
+
+} // namespace
+
+bool parse_dash_manifest(const std::string& xml, const std::string& manifest_url,
+                         DashManifest& manifest)
+{
+    manifest = DashManifest();
+    manifest.base_url = directory_of(manifest_url);
+
+    Template period_template, set_template, rep_template;
+    bool in_set = false, in_rep = false, set_is_video = false, rep_is_video = false;
+    bool in_base_url = false, saw_timeline_only = false;
+    size_t base_url_start = 0;
+
+    DashManifest rep;
+    bool found = false;
+
+    // Keep the best video representation seen so far
+    auto finish_representation = [&]() {
+        if (!rep_is_video || rep_template.media.empty()) {
+            return;
+        }
+        if (rep_template.duration == 0) {
+            saw_timeline_only = saw_timeline_only || rep_template.has_timeline;
+            return;
+        }
+        if (!found || rep.bandwidth > manifest.bandwidth) {
+            manifest.representation_id = rep.representation_id;
+            manifest.bandwidth = rep.bandwidth;
+            manifest.width = rep.width;
+            manifest.height = rep.height;
+            manifest.initialization = rep_template.initialization;
+            manifest.media = rep_template.media;
+            manifest.timescale = rep_template.timescale;
+            manifest.duration = rep_template.duration;
+            manifest.start_number = rep_template.start_number;
+            manifest.availability_offset_ms = rep_template.availability_offset_ms;
+            found = true;
+        }
+    };
+
+    size_t pos = 0;
+    Tag tag;
+    while (next_tag(xml, pos, tag)) {
+        std::string value;
+
+        if (tag.name == "BaseURL") {
+            if (!tag.closing) {
+                in_base_url = true;
+                base_url_start = pos;
+            } else if (in_base_url) {
+                in_base_url = false;
+                std::string text = xml.substr(base_url_start, pos - base_url_start);
+                text = text.substr(0, text.rfind("</"));
+                // Only MPD and Period level; per-representation BaseURL is not used
+                if (!in_set && !text.empty()) {
+                    manifest.base_url = resolve_url(manifest.base_url, text);
+                    if (manifest.base_url.back() != '/') {
+                        manifest.base_url = directory_of(manifest.base_url);
+                    }
+                }
+            }
+            continue;
+        }
+
+        if (tag.closing) {
+            if (tag.name == "AdaptationSet") {
+                in_set = false;
+            } else if (tag.name == "Representation" && in_rep) {
+                in_rep = false;
+                finish_representation();
+            }
+            continue;
+        }
+
+        if (tag.name == "MPD") {
+            if (attribute(tag.attrs, "type", value)) {
+                manifest.is_dynamic = value == "dynamic";
+            }
+            if (attribute(tag.attrs, "availabilityStartTime", value)) {
+                manifest.availability_start_ms = parse_datetime_ms(value);
+            }
+            if (attribute(tag.attrs, "suggestedPresentationDelay", value)) {
+                manifest.suggested_delay_ms = parse_duration_ms(value);
+            }
+        } else if (tag.name == "AdaptationSet") {
+            in_set = true;
+            set_template = period_template;
+            set_is_video = (attribute(tag.attrs, "contentType", value) && value == "video") ||
+                           (attribute(tag.attrs, "mimeType", value) && value.compare(0, 6, "video/") == 0);
+        } else if (tag.name == "SegmentTemplate") {
+            Template& target = in_rep ? rep_template : (in_set ? set_template : period_template);
+            parse_template(tag.attrs, target);
+        } else if (tag.name == "SegmentTimeline") {
+            if (in_rep) rep_template.has_timeline = true;
+            else if (in_set) set_template.has_timeline = true;
+            else period_template.has_timeline = true;
+        } else if (tag.name == "Representation") {
+            in_rep = !tag.self_closing;
+            rep_template = set_template;
+            rep = DashManifest();
+            attribute(tag.attrs, "id", rep.representation_id);
+            if (attribute(tag.attrs, "bandwidth", value)) rep.bandwidth = atoll(value.c_str());
+            if (attribute(tag.attrs, "width", value)) rep.width = atoi(value.c_str());
+            if (attribute(tag.attrs, "height", value)) rep.height = atoi(value.c_str());
+            rep_is_video = set_is_video ||
+                           (attribute(tag.attrs, "mimeType", value) && value.compare(0, 6, "video/") == 0);
+            if (tag.self_closing) {
+                finish_representation();
+            }
+        }
+    }
+
+    if (!found) {
+        if (saw_timeline_only) {
+            BLOG_ERROR("DASH manifest uses SegmentTimeline addressing, which is not supported");
+        } else {
+            BLOG_ERROR("DASH manifest has no video representation with a SegmentTemplate");
+        }
+        return false;
+    }
+
+    return true;
+}
+
+std::string dash_init_url(const DashManifest& manifest)
+{
+    return resolve_url(manifest.base_url, expand_template(manifest.initialization, manifest, 0));
+}
+
+std::string dash_segment_url(const DashManifest& manifest, uint64_t number)
+{
+    return resolve_url(manifest.base_url, expand_template(manifest.media, manifest, number));
+}
+
+int64_t dash_segment_duration_ms(const DashManifest& manifest)
+{
+    if (manifest.timescale == 0) {
+        return 0;
+    }
+    return static_cast<int64_t>(manifest.duration * 1000 / manifest.timescale);
+}
+
+uint64_t dash_live_edge_number(const DashManifest& manifest, int64_t now_ms, int64_t latency_ms)
+{
+    if (!manifest.is_dynamic || manifest.availability_start_ms == 0 || manifest.duration == 0) {
+        return manifest.start_number;
+    }
+
+    // Presentation time we want to be playing, in timescale units
+    int64_t position_ms = now_ms - manifest.availability_start_ms - latency_ms;
+    if (position_ms <= 0) {
+        return manifest.start_number;
+    }
+
+    uint64_t ticks = static_cast<uint64_t>(position_ms) * manifest.timescale / 1000;
+    return manifest.start_number + ticks / manifest.duration;
+}
+
+} // namespace berrystreamcam
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "../common.hpp"
+#include <string>
+
+namespace berrystreamcam {
+
+/**
+ * The parts of an MPEG-DASH MPD needed to follow a live
+ * SegmentTemplate stream: one video representation and its addressing.
+ */
+struct DashManifest {
+    bool is_dynamic;
+    int64_t availability_start_ms;    // Unix ms; 0 when the MPD has none
+    int64_t suggested_delay_ms;       // suggestedPresentationDelay, 0 if absent
+    int64_t availability_offset_ms;   // availabilityTimeOffset (CMAF chunked early access)
+
+    std::string representation_id;
+    int64_t bandwidth;
+    int width;
+    int height;
+
+    std::string base_url;             // Absolute, ends with '/'
+    std::string initialization;       // Template, relative to base_url
+    std::string media;
+    uint64_t timescale;
+    uint64_t duration;                // Segment duration in timescale units
+    uint64_t start_number;
+};
+
+/**
+ * Parse an MPD, picking the highest-bandwidth video representation.
+ * Only SegmentTemplate with $Number$ addressing is supported.
+ */
+bool parse_dash_manifest(const std::string& xml, const std::string& manifest_url,
+                         DashManifest& manifest);
+
+/**
+ * Absolute URL of the initialization segment.
+ */
+std::string dash_init_url(const DashManifest& manifest);
+
+/**
+ * Absolute URL of media segment number.
+ */
+std::string dash_segment_url(const DashManifest& manifest, uint64_t number);
+
+/**
+ * Segment holding the presentation time now_ms - latency_ms.
+ * Static manifests, or live ones without availabilityStartTime, start at startNumber.
+ */
+uint64_t dash_live_edge_number(const DashManifest& manifest, int64_t now_ms, int64_t latency_ms);
+
+/**
+ * Segment duration in milliseconds.
+ */
+int64_t dash_segment_duration_ms(const DashManifest& manifest);
+
+} // namespace berrystreamcam
@@ -0,0 +1,162 @@
+#include "fd-handoff.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <unistd.h>
+#include <errno.h>
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+namespace berrystreamcam {
+
+namespace {
+
+constexpr char HANDSHAKE_BYTE = 'R';
+
+#ifdef __linux__
+socklen_t abstract_address(const std::string& name, sockaddr_un& addr)
+{
+    size_t length = std::min(name.size(), sizeof(addr.sun_path) - 1);
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    memcpy(addr.sun_path + 1, name.data(), length);
+    return static_cast<socklen_t>(offsetof(sockaddr_un, sun_path) + 1 + length);
+}
+#endif
+
+} // namespace
+
+int listen_abstract(const std::string& name)
+{
+#ifdef __linux__
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+
+    sockaddr_un addr;
+    socklen_t length = abstract_address(name, addr);
+    if (bind(fd, reinterpret_cast<sockaddr*>(&addr), length) != 0 || listen(fd, SOMAXCONN) != 0) {
+        int error = errno;
+        close(fd);
+        errno = error;
+        return -1;
+    }
+    return fd;
+#else
+    (void)name;
+    errno = ENOTSUP;
+    return -1;
+#endif
+}
+
+int connect_abstract(const std::string& name)
+{
+#ifdef __linux__
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+
+    sockaddr_un addr;
+    socklen_t length = abstract_address(name, addr);
+    if (::connect(fd, reinterpret_cast<sockaddr*>(&addr), length) != 0 || !peer_is_same_user(fd)) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+#else
+    (void)name;
+    return -1;
+#endif
+}
+
+bool peer_is_same_user(int socket)
+{
+#ifdef __linux__
+    struct ucred peer;
+    socklen_t length = sizeof(peer);
+    if (getsockopt(socket, SOL_SOCKET, SO_PEERCRED, &peer, &length) != 0) {
+        return false;
+    }
+    return peer.uid == getuid();
+#else
+    (void)socket;
+    return false;
+#endif
+}
+
+bool send_fd(int socket, int fd)
+{
+#ifdef __linux__
+    char byte = HANDSHAKE_BYTE;
+    iovec iov = { &byte, 1 };
+
+    char control[CMSG_SPACE(sizeof(int))];
+    memset(control, 0, sizeof(control));
+
+    msghdr message = {};
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    cmsghdr* header = CMSG_FIRSTHDR(&message);
+    header->cmsg_level = SOL_SOCKET;
+    header->cmsg_type = SCM_RIGHTS;
+    header->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(header), &fd, sizeof(int));
+
+    return sendmsg(socket, &message, MSG_NOSIGNAL) == 1;
+#else
+    (void)socket;
+    (void)fd;
+    return false;
+#endif
+}
+
+int receive_fd(int socket, int timeout_ms)
+{
+#ifdef __linux__
+    pollfd pfd = { socket, POLLIN, 0 };
+    if (poll(&pfd, 1, timeout_ms) <= 0) {
+        return -1;
+    }
+
+    char byte = 0;
+    iovec iov = { &byte, 1 };
+
+    char control[CMSG_SPACE(sizeof(int))];
+    msghdr message = {};
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    if (recvmsg(socket, &message, MSG_CMSG_CLOEXEC) != 1 || byte != HANDSHAKE_BYTE) {
+        return -1;
+    }
+
+    cmsghdr* header = CMSG_FIRSTHDR(&message);
+    if (!header || header->cmsg_level != SOL_SOCKET || header->cmsg_type != SCM_RIGHTS ||
+        header->cmsg_len != CMSG_LEN(sizeof(int))) {
+        return -1;
+    }
+
+    int fd = -1;
+    memcpy(&fd, CMSG_DATA(header), sizeof(int));
+    return fd;
+#else
+    (void)socket;
+    (void)timeout_ms;
+    return -1;
+#endif
+}
+
+} // namespace berrystreamcam
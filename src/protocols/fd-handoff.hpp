@@ -0,0 +1,42 @@
+#pragma once
+
+#include "../common.hpp"
+#include <string>
+
+namespace berrystreamcam {
+
+/**
+ * Passing a file descriptor to another process on this host over an
+ * abstract Unix socket, as the local relay and shared-memory ingest hand
+ * out their rings. Abstract names need no file and vanish with the
+ * socket, also on a crash.
+ *
+ * Linux only; elsewhere every call fails.
+ */
+
+/**
+ * A non-blocking socket listening on name, or -1 with errno set
+ * (EADDRINUSE if another process already listens on it).
+ */
+int listen_abstract(const std::string& name);
+
+/**
+ * A socket connected to name, or -1 if nobody listens there or the
+ * listener runs as another user.
+ */
+int connect_abstract(const std::string& name);
+
+/**
+ * Any local user can reach an abstract socket; true if the peer is us.
+ */
+bool peer_is_same_user(int socket);
+
+bool send_fd(int socket, int fd);
+
+/**
+ * Wait up to timeout_ms for a descriptor sent with send_fd(); -1 if none
+ * comes. The caller owns the result.
+ */
+int receive_fd(int socket, int timeout_ms);
+
+} // namespace berrystreamcam
@@ -0,0 +1,96 @@
+#include "frame-pool.hpp"
+#include <algorithm>
+#include <new>
+
+namespace berrystreamcam {
+
+FramePool::FramePool()
+    : allocations_(0)
+    , reuses_(0)
+{
+}
+
+FramePool::~FramePool()
+{
+    // Lent buffers hold a reference, so only idle ones are left
+    for (uint8_t* data : idle_) {
+        delete[] data;
+    }
+}
+
+uint8_t* FramePool::acquire(size_t min_capacity, size_t& capacity)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    // The smallest idle buffer that fits
+    auto best = idle_.end();
+    for (auto it = idle_.begin(); it != idle_.end(); ++it) {
+        size_t size = capacity_[*it];
+        if (size >= min_capacity && (best == idle_.end() || size < capacity_[*best])) {
+            best = it;
+        }
+    }
+    if (best != idle_.end()) {
+        uint8_t* data = *best;
+        idle_.erase(best);
+        capacity = capacity_[data];
+        reuses_++;
+        return data;
+    }
+
+    // None fits: the stream has grown, so the smallest idle one goes
+    if (!idle_.empty()) {
+        auto smallest = std::min_element(idle_.begin(), idle_.end(), [this](uint8_t* a, uint8_t* b) {
+            return capacity_[a] < capacity_[b];
+        });
+        capacity_.erase(*smallest);
+        delete[] *smallest;
+        idle_.erase(smallest);
+    }
+
+    size_t size = std::max(min_capacity, MIN_CAPACITY);
+    uint8_t* data = new (std::nothrow) uint8_t[size];
+    if (!data) {
+        BLOG_ERROR("Failed to allocate a %zu byte frame buffer", size);
+        return nullptr;
+    }
+    capacity_[data] = size;
+    allocations_++;
+    capacity = size;
+    return data;
+}
+
+void FramePool::release(uint8_t* data)
+{
+    if (!data) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (idle_.size() < MAX_IDLE) {
+        idle_.push_back(data);
+        return;
+    }
+    capacity_.erase(data);
+    delete[] data;
+}
+
+std::shared_ptr<uint8_t> FramePool::lend(uint8_t* data)
+{
+    std::shared_ptr<FramePool> self = shared_from_this();
+    return std::shared_ptr<uint8_t>(data, [self](uint8_t* buffer) { self->release(buffer); });
+}
+
+FramePoolStats FramePool::stats() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    FramePoolStats stats = {};
+    stats.allocations = allocations_;
+    stats.reuses = reuses_;
+    stats.idle = idle_.size();
+    stats.lent = capacity_.size() - idle_.size();
+    return stats;
+}
+
+} // namespace berrystreamcam
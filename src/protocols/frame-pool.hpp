@@ -0,0 +1,67 @@
+#pragma once
+
+#include "../common.hpp"
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace berrystreamcam {
+
+struct FramePoolStats {
+    uint64_t allocations;   // Buffers made because none idle was large enough
+    uint64_t reuses;        // Buffers handed out again
+    size_t idle;
+    size_t lent;
+};
+
+/**
+ * Recycles frame buffers between a producer and the frames it hands out.
+ *
+ * The producer fills a buffer from acquire() in place and passes it on as
+ * a frame's data; whoever ends up with it gives it back with release(), or
+ * through the deleter of lend(). A steady stream allocates nothing once
+ * its first few frames have gone round. At most MAX_IDLE buffers are kept
+ * idle; the rest are freed on release.
+ *
+ * Thread-safe. Create it with std::make_shared: lent buffers keep the pool
+ * alive until they come back.
+ */
+class FramePool : public std::enable_shared_from_this<FramePool> {
+public:
+    static constexpr size_t MAX_IDLE = 8;
+    static constexpr size_t MIN_CAPACITY = 256 * 1024;
+
+    FramePool();
+    ~FramePool();
+
+    FramePool(const FramePool&) = delete;
+    FramePool& operator=(const FramePool&) = delete;
+
+    /**
+     * A buffer of at least min_capacity bytes; capacity is set to its size.
+     * Returns nullptr if it cannot be allocated.
+     */
+    uint8_t* acquire(size_t min_capacity, size_t& capacity);
+
+    /**
+     * Back to the pool. Only for buffers from acquire().
+     */
+    void release(uint8_t* data);
+
+    /**
+     * data for as long as anyone holds a reference, released then.
+     */
+    std::shared_ptr<uint8_t> lend(uint8_t* data);
+
+    FramePoolStats stats() const;
+
+private:
+    std::vector<uint8_t*> idle_;
+    std::unordered_map<uint8_t*, size_t> capacity_;   // Every buffer the pool made, idle or out
+    uint64_t allocations_;
+    uint64_t reuses_;
+    mutable std::mutex mutex_;
+};
+
+} // namespace berrystreamcam
@@ -3,6 +3,12 @@
 namespace berrystreamcam {
 
 FrameQueue::FrameQueue()
+    : FrameQueue([](uint8_t* data) { delete[] data; })
+{
+}
+
+FrameQueue::FrameQueue(ReleaseFn release)
+    : release_(std::move(release))
 {
     BLOG_DEBUG("FrameQueue created");
 }
@@ -21,7 +27,7 @@ void FrameQueue::push(VideoFrame&& frame)
     while (queue_.size() >= MAX_SIZE) {
         VideoFrame& old_frame = queue_.front();
         if (old_frame.data) {
-            delete[] old_frame.data;
+            release_(old_frame.data);
             old_frame.data = nullptr;
         }
         queue_.pop();
@@ -53,7 +59,7 @@ void FrameQueue::clear()
     while (!queue_.empty()) {
         VideoFrame& frame = queue_.front();
         if (frame.data) {
-            delete[] frame.data;
+            release_(frame.data);
             frame.data = nullptr;
         }
         queue_.pop();
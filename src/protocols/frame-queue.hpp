@@ -3,6 +3,7 @@
 #include "../common.hpp"
 #include <queue>
 #include <mutex>
+#include <functional>
 
 namespace berrystreamcam {
 
@@ -12,7 +13,15 @@ namespace berrystreamcam {
  */
 class FrameQueue {
 public:
+    using ReleaseFn = std::function<void(uint8_t* data)>;
+
     FrameQueue();
+
+    /**
+     * For frames whose data is not delete[]-owned, e.g. FramePool buffers.
+     * release frees the data of frames dropped on overflow or clear().
+     */
+    explicit FrameQueue(ReleaseFn release);
     ~FrameQueue();
 
     // Disable copy and move
@@ -31,7 +40,8 @@ public:
     /**
      * Pop a frame from the queue.
      * Returns true if a frame was available, false if queue is empty.
-     * Caller takes ownership of frame.data and must delete it.
+     * Caller takes ownership of frame.data and must free it the way the
+     * queue would have.
      */
     bool pop(VideoFrame& frame);
 
@@ -56,6 +66,7 @@ public:
 private:
     static constexpr size_t MAX_SIZE = 30;
 
+    ReleaseFn release_;
     std::queue<VideoFrame> queue_;
     mutable std::mutex mutex_;
 };
@@ -1,16 +1,50 @@
 #include "http-handler.hpp"
+#include <chrono>
 #include <cstring>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <errno.h>
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
 
 namespace berrystreamcam {
 
+namespace {
+
+constexpr int HTTP_IO_TIMEOUT_MS = 5000;
+constexpr size_t READ_BUFFER_SIZE = 64 * 1024;
+
+// Reads per wake-up before giving the worker back; the socket stays armed
+constexpr int MAX_READS_PER_WAKE = 8;
+
+int remaining_ms(std::chrono::steady_clock::time_point deadline)
+{
+    auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+        deadline - std::chrono::steady_clock::now()).count();
+    return left > 0 ? static_cast<int>(left) : 0;
+}
+
+} // namespace
+
 HttpHandler::HttpHandler()
-    : connected_(false)
-    , running_(false)
-    , protocol_type_(ProtocolType::UNKNOWN)
-    , format_context_(nullptr)
-    , video_stream_index_(-1)
+    : protocol_type_(ProtocolType::UNKNOWN)
+    , socket_(-1)
+    , connected_(false)
+    , reactor_(NetworkReactor::acquire())
+    , watch_(0)
+    , read_buffer_(READ_BUFFER_SIZE)
+    , profile_(network_profile_from_name("balanced"))
+    , active_profile_(profile_)
+    , tuning_{}
 {
-    BLOG_DEBUG("HTTP handler created (FFmpeg-based)");
+    BLOG_DEBUG("HTTP handler created");
 }
 
 HttpHandler::~HttpHandler()
@@ -20,128 +54,95 @@ HttpHandler::~HttpHandler()
 
 bool HttpHandler::connect(const std::string& url, ProtocolType type)
 {
+    std::lock_guard<std::mutex> lock(control_mutex_);
+
     BLOG_INFO("Connecting to HTTP: %s", url.c_str());
 
     url_ = url;
     protocol_type_ = type;
 
-    try {
-        // Allocate format context
-        format_context_ = avformat_alloc_context();
-        if (!format_context_) {
-            BLOG_ERROR("Failed to allocate AVFormatContext");
-            return false;
-        }
+    if (type != ProtocolType::HTTP_RAW_H264 && type != ProtocolType::HTTP_MJPEG) {
+        BLOG_ERROR("HTTP handler cannot carry %s", protocol_to_string(type));
+        return false;
+    }
 
-        // Set HTTP options
-        AVDictionary* options = nullptr;
-        av_dict_set(&options, "timeout", "5000000", 0);  // 5 second timeout
-        av_dict_set(&options, "reconnect", "1", 0);      // Auto-reconnect
-        av_dict_set(&options, "reconnect_streamed", "1", 0);
-        av_dict_set(&options, "reconnect_delay_max", "2", 0);
-
-        // Open HTTP stream
-        int ret = avformat_open_input(&format_context_, url.c_str(), nullptr, &options);
-        av_dict_free(&options);
-
-        if (ret < 0) {
-            char errbuf[AV_ERROR_MAX_STRING_SIZE];
-            av_strerror(ret, errbuf, sizeof(errbuf));
-            BLOG_ERROR("Failed to open HTTP stream: %s", errbuf);
-            avformat_free_context(format_context_);
-            format_context_ = nullptr;
-            return false;
-        }
+    std::string host, path;
+    int port = 0;
+    if (!split_http_url(url, host, port, path)) {
+        BLOG_ERROR("Invalid HTTP URL format");
+        return false;
+    }
 
-        // Find stream information
-        ret = avformat_find_stream_info(format_context_, nullptr);
-        if (ret < 0) {
-            char errbuf[AV_ERROR_MAX_STRING_SIZE];
-            av_strerror(ret, errbuf, sizeof(errbuf));
-            BLOG_ERROR("Failed to find stream info: %s", errbuf);
-            avformat_close_input(&format_context_);
-            return false;
-        }
+    if (!open_socket(host, port)) {
+        close_socket();
+        return false;
+    }
 
-        // Find video stream
-        video_stream_index_ = -1;
-        for (unsigned int i = 0; i < format_context_->nb_streams; i++) {
-            if (format_context_->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_VIDEO) {
-                video_stream_index_ = i;
-                BLOG_INFO("Found video stream at index %d", i);
-                break;
-            }
-        }
+    frame_queue_.clear();
+    parser_ = std::make_unique<HttpStreamParser>(type, [this](VideoFrame&& frame) {
+        // Raw elementary streams carry no timing; stamp the arrival
+        frame.timestamp = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+        frame_queue_.push(std::move(frame));
+    });
 
-        if (video_stream_index_ == -1) {
-            BLOG_ERROR("No video stream found in HTTP stream");
-            avformat_close_input(&format_context_);
-            return false;
-        }
+    if (!send_request(host, port, path) || !read_headers()) {
+        close_socket();
+        return false;
+    }
 
-        connected_ = true;
-        running_ = true;
+    connected_ = true;
+    NetworkReactor::Id watch = reactor_->add(socket_, [this]() { on_readable(); });
+    if (watch == 0) {
+        connected_ = false;
+        close_socket();
+        return false;
+    }
+    watch_ = watch;
 
-        // Start streaming thread
-        streaming_thread_ = std::thread(&HttpHandler::stream_loop, this);
+    BLOG_INFO("HTTP connection established successfully");
+    return true;
+}
 
-        BLOG_INFO("HTTP connection established successfully");
-        return true;
+void HttpHandler::set_network_profile(const NetworkProfile& profile)
+{
+    std::lock_guard<std::mutex> lock(tuning_mutex_);
+    profile_ = profile;
+}
 
-    } catch (const std::exception& e) {
-        BLOG_ERROR("Exception during HTTP connection: %s", e.what());
-        if (format_context_) {
-            avformat_close_input(&format_context_);
-        }
-        return false;
-    } catch (...) {
-        BLOG_ERROR("Unknown exception during HTTP connection");
-        if (format_context_) {
-            avformat_close_input(&format_context_);
-        }
-        return false;
-    }
+SocketTuning HttpHandler::get_socket_tuning() const
+{
+    std::lock_guard<std::mutex> lock(tuning_mutex_);
+    return tuning_;
 }
 
 void HttpHandler::disconnect()
 {
-    BLOG_INFO("Disconnecting HTTP (FFmpeg)");
-
-    connected_ = false;
-    running_ = false;
-
-    // Wait for streaming thread
-    if (streaming_thread_.joinable()) {
-        try {
-            streaming_thread_.join();
-        } catch (...) {
-            BLOG_WARNING("Exception while joining HTTP streaming thread");
-        }
+    // A connect() holding the lock gives up instead of running out its timeouts
+    connect_stop_.stop();
+    std::lock_guard<std::mutex> lock(control_mutex_);
+    connect_stop_.reset();
+
+    // No callback is running or will run once this returns
+    NetworkReactor::Id watch = watch_.exchange(0);
+    if (watch != 0) {
+        reactor_->remove(watch);
     }
 
-    // Close format context
-    if (format_context_) {
-        try {
-            avformat_close_input(&format_context_);
-            format_context_ = nullptr;
-        } catch (...) {
-            BLOG_WARNING("Exception while closing HTTP stream");
-            format_context_ = nullptr;
-        }
+    connected_ = false;
+    if (socket_ >= 0) {
+        BLOG_INFO("Disconnecting HTTP (%llu frames, %llu dropped)",
+                  static_cast<unsigned long long>(parser_ ? parser_->frames() : 0),
+                  static_cast<unsigned long long>(parser_ ? parser_->frames_dropped() : 0));
     }
 
-    video_stream_index_ = -1;
+    close_socket();
+    frame_queue_.clear();
+}
 
-    // Clear frame queue
-    {
-        std::lock_guard<std::mutex> lock(queue_mutex_);
-        while (!frame_queue_.empty()) {
-            if (frame_queue_.front().data) {
-                delete[] frame_queue_.front().data;
-            }
-            frame_queue_.pop();
-        }
-    }
+void HttpHandler::interrupt()
+{
+    connect_stop_.stop();
 }
 
 bool HttpHandler::is_connected() const
@@ -151,105 +152,172 @@ bool HttpHandler::is_connected() const
 
 bool HttpHandler::receive_frame(VideoFrame& frame)
 {
-    std::lock_guard<std::mutex> lock(queue_mutex_);
+    return frame_queue_.pop(frame);
+}
 
-    if (frame_queue_.empty()) {
+bool HttpHandler::open_socket(const std::string& host, int port)
+{
+    // Devices may be given by name (phone.local) as well as by address
+    addrinfo hints = {};
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* address = nullptr;
+    if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &address) != 0 || !address) {
+        BLOG_ERROR("Cannot resolve HTTP server %s", host.c_str());
         return false;
     }
 
-    frame = frame_queue_.front();
-    frame_queue_.pop();
+    struct sockaddr_in server_addr;
+    memcpy(&server_addr, address->ai_addr, sizeof(server_addr));
+    freeaddrinfo(address);
 
-    static int frame_count = 0;
-    if (++frame_count % 100 == 0) {
-        BLOG_DEBUG("HTTP received %d frames (queue size: %zu)", frame_count, frame_queue_.size());
+    socket_ = socket(AF_INET, SOCK_STREAM, 0);
+    if (socket_ < 0) {
+        BLOG_ERROR("Failed to create HTTP socket");
+        return false;
+    }
+
+    // Non-blocking from here on: the connect is bounded and the reactor never blocks
+    int flags = fcntl(socket_, F_GETFL, 0);
+    fcntl(socket_, F_SETFL, flags | O_NONBLOCK);
+    fcntl(socket_, F_SETFD, FD_CLOEXEC);
+
+    int ret = ::connect(socket_, reinterpret_cast<struct sockaddr*>(&server_addr), sizeof(server_addr));
+    if (ret < 0 && errno != EINPROGRESS) {
+        BLOG_ERROR("Failed to connect to HTTP server: %s", strerror(errno));
+        return false;
+    }
+
+    if (ret < 0) {
+        int ready = connect_stop_.wait(socket_, POLLOUT, HTTP_IO_TIMEOUT_MS);
+        if (ready <= 0) {
+            if (ready == 0) {
+                BLOG_ERROR("HTTP connection timeout");
+            }
+            return false;
+        }
+
+        int error = 0;
+        socklen_t len = sizeof(error);
+        getsockopt(socket_, SOL_SOCKET, SO_ERROR, &error, &len);
+        if (error != 0) {
+            BLOG_ERROR("Failed to connect to HTTP server: %s", strerror(error));
+            return false;
+        }
     }
 
+    std::lock_guard<std::mutex> lock(tuning_mutex_);
+    active_profile_ = profile_;
+    tuning_ = apply_network_profile(socket_, active_profile_, true);
     return true;
 }
 
-void HttpHandler::stream_loop()
+bool HttpHandler::send_request(const std::string& host, int port, const std::string& path)
 {
-    BLOG_INFO("HTTP streaming thread started");
-
-    AVPacket* packet = av_packet_alloc();
-    if (!packet) {
-        BLOG_ERROR("Failed to allocate AVPacket");
-        running_ = false;
-        return;
-    }
-
-    while (running_ && connected_) {
-        try {
-            // Read frame from stream
-            int ret = av_read_frame(format_context_, packet);
-
-            if (ret < 0) {
-                if (ret == AVERROR_EOF) {
-                    BLOG_WARNING("HTTP stream ended (EOF)");
-                    connected_ = false;
-                    break;
-                } else if (ret == AVERROR(EAGAIN)) {
-                    // Would block, try again
-                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
-                    continue;
-                } else {
-                    char errbuf[AV_ERROR_MAX_STRING_SIZE];
-                    av_strerror(ret, errbuf, sizeof(errbuf));
-                    BLOG_WARNING("Error reading HTTP frame: %s", errbuf);
-                    std::this_thread::sleep_for(std::chrono::milliseconds(10));
-                    continue;
-                }
-            }
+    std::string request = "GET " + path + " HTTP/1.1\r\n"
+                          "Host: " + host + ":" + std::to_string(port) + "\r\n"
+                          "User-Agent: BerryStreamCam\r\n"
+                          "Accept: */*\r\n"
+                          "Connection: keep-alive\r\n\r\n";
+
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(HTTP_IO_TIMEOUT_MS);
+    size_t sent = 0;
+    while (sent < request.size()) {
+        ssize_t written = send(socket_, request.data() + sent, request.size() - sent, MSG_NOSIGNAL);
+        if (written > 0) {
+            sent += written;
+            continue;
+        }
+        if (written < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+            BLOG_ERROR("Failed to send HTTP request: %s", strerror(errno));
+            return false;
+        }
+        if (connect_stop_.wait(socket_, POLLOUT, remaining_ms(deadline)) <= 0) {
+            BLOG_ERROR("HTTP request timeout");
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool HttpHandler::read_headers()
+{
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(HTTP_IO_TIMEOUT_MS);
 
-            // Check if this is a video packet
-            if (packet->stream_index != video_stream_index_) {
-                av_packet_unref(packet);
+    // Body bytes that arrive with the headers go through the parser as well
+    while (!parser_->headers_complete()) {
+        if (connect_stop_.wait(socket_, POLLIN, remaining_ms(deadline)) <= 0) {
+            BLOG_ERROR("HTTP response timeout");
+            return false;
+        }
+
+        ssize_t received = recv(socket_, read_buffer_.data(), read_buffer_.size(), MSG_DONTWAIT);
+        if (received == 0) {
+            BLOG_ERROR("HTTP server closed the connection before responding");
+            return false;
+        }
+        if (received < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
                 continue;
             }
+            BLOG_ERROR("Failed to read HTTP response: %s", strerror(errno));
+            return false;
+        }
 
-            // Copy packet data to VideoFrame
-            VideoFrame video_frame;
-            video_frame.size = packet->size;
-            video_frame.data = new uint8_t[video_frame.size];
-            memcpy(video_frame.data, packet->data, video_frame.size);
-            video_frame.timestamp = packet->pts;
-
-            // Add to queue
-            {
-                std::lock_guard<std::mutex> lock(queue_mutex_);
-
-                // Limit queue size to prevent memory buildup
-                if (frame_queue_.size() >= 30) {
-                    // Drop oldest frame
-                    if (frame_queue_.front().data) {
-                        delete[] frame_queue_.front().data;
-                    }
-                    frame_queue_.pop();
-                }
-
-                frame_queue_.push(video_frame);
-
-                static int push_count = 0;
-                if (++push_count % 100 == 0) {
-                    BLOG_DEBUG("HTTP pushed %d frames (packet size: %d, queue size: %zu)",
-                               push_count, packet->size, frame_queue_.size());
-                }
+        if (!parser_->feed(read_buffer_.data(), static_cast<size_t>(received))) {
+            BLOG_ERROR("HTTP stream rejected: %s", parser_->error().c_str());
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void HttpHandler::on_readable()
+{
+    int i = 0;
+    for (; i < MAX_READS_PER_WAKE; i++) {
+        ssize_t received = recv(socket_, read_buffer_.data(), read_buffer_.size(), MSG_DONTWAIT);
+
+        if (received > 0) {
+            rearm_quickack(socket_, active_profile_);
+            if (!parser_->feed(read_buffer_.data(), static_cast<size_t>(received))) {
+                BLOG_WARNING("HTTP stream broken: %s", parser_->error().c_str());
+                break;
             }
+            continue;
+        }
 
-            av_packet_unref(packet);
+        if (received == 0) {
+            BLOG_WARNING("HTTP stream ended (EOF)");
+            parser_->finish();
+            break;
+        }
 
-        } catch (const std::exception& e) {
-            BLOG_ERROR("Exception in HTTP streaming loop: %s", e.what());
-            std::this_thread::sleep_for(std::chrono::milliseconds(100));
-        } catch (...) {
-            BLOG_ERROR("Unknown exception in HTTP streaming loop");
-            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+            return;
         }
+        BLOG_WARNING("Error reading HTTP stream: %s", strerror(errno));
+        break;
+    }
+
+    if (i == MAX_READS_PER_WAKE) {
+        return;   // More to read; the reactor re-arms the socket
     }
 
-    av_packet_free(&packet);
-    BLOG_INFO("HTTP streaming thread stopped");
+    // End of stream: stop watching, the source notices through is_connected().
+    // watch_ stays set so disconnect() still waits for this callback to return.
+    connected_ = false;
+    reactor_->remove(watch_);
+}
+
+void HttpHandler::close_socket()
+{
+    if (socket_ >= 0) {
+        close(socket_);
+        socket_ = -1;
+    }
 }
 
 } // namespace berrystreamcam
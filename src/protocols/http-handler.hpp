@@ -1,21 +1,27 @@
 #pragma once
 
 #include "../common.hpp"
+#include "frame-queue.hpp"
+#include "http-stream-parser.hpp"
+#include "network-reactor.hpp"
+#include "socket-tuning.hpp"
+#include "../discovery/stop-signal.hpp"
 #include <string>
 #include <memory>
 #include <atomic>
-#include <queue>
 #include <mutex>
-#include <thread>
-#include <functional>
-
-extern "C" {
-#include <libavformat/avformat.h>
-#include <libavcodec/avcodec.h>
-}
+#include <vector>
 
 namespace berrystreamcam {
 
+/**
+ * Client for the raw H.264 and MJPEG streams on the HTTP port.
+ *
+ * connect() opens the socket, sends the GET and waits for the response
+ * headers on the calling thread. From then on the shared NetworkReactor
+ * reads the socket and HttpStreamParser cuts the body into frames, so an
+ * open stream costs no thread of its own.
+ */
 class HttpHandler {
 public:
     HttpHandler();
@@ -25,24 +31,47 @@ public:
     void disconnect();
     bool is_connected() const;
 
+    /**
+     * Make connect() give up; never blocks. Cleared by disconnect().
+     */
+    void interrupt();
+
     bool receive_frame(VideoFrame& frame);
 
+    /**
+     * Socket options for the next connect(), read back from the socket
+     * once it is connected.
+     */
+    void set_network_profile(const NetworkProfile& profile);
+    SocketTuning get_socket_tuning() const;
+
 private:
-    void stream_loop();
+    bool open_socket(const std::string& host, int port);
+    bool send_request(const std::string& host, int port, const std::string& path);
+    bool read_headers();
+    void on_readable();
+    void close_socket();
 
     std::string url_;
     ProtocolType protocol_type_;
+    int socket_;
 
     std::atomic<bool> connected_;
-    std::atomic<bool> running_;
-    std::queue<VideoFrame> frame_queue_;
-    std::mutex queue_mutex_;
+    std::mutex control_mutex_;           // connect() vs. disconnect()
+    StopSignal connect_stop_;            // Wakes connect()'s waits, see interrupt()
+
+    std::shared_ptr<NetworkReactor> reactor_;
+    std::atomic<NetworkReactor::Id> watch_;   // Its callback also removes it at end of stream
 
-    std::thread streaming_thread_;
+    // connect(), then the reactor callback only
+    std::unique_ptr<HttpStreamParser> parser_;
+    std::vector<uint8_t> read_buffer_;
+    FrameQueue frame_queue_;
 
-    // FFmpeg components
-    AVFormatContext* format_context_;
-    int video_stream_index_;
+    NetworkProfile profile_;             // Next connect (guarded by tuning_mutex_)
+    NetworkProfile active_profile_;      // Current connection
+    SocketTuning tuning_;
+    mutable std::mutex tuning_mutex_;
 };
 
 } // namespace berrystreamcam
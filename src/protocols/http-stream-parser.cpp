@@ -0,0 +1,497 @@
+#include "http-stream-parser.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <regex>
+
+namespace berrystreamcam {
+
+namespace {
+
+constexpr size_t NOT_FOUND = static_cast<size_t>(-1);
+constexpr size_t MAX_CHUNK_LINE = 64;
+
+const uint8_t START_CODE[4] = { 0x00, 0x00, 0x00, 0x01 };
+
+// First "00 00 01" at or after from
+size_t find_start_code(const std::vector<uint8_t>& buffer, size_t from)
+{
+    size_t size = buffer.size();
+    size_t i = from;
+    while (i + 2 < size) {
+        const void* one = memchr(&buffer[i + 2], 0x01, size - (i + 2));
+        if (!one) {
+            return NOT_FOUND;
+        }
+        size_t at = static_cast<const uint8_t*>(one) - buffer.data();
+        if (buffer[at - 1] == 0x00 && buffer[at - 2] == 0x00) {
+            return at - 2;
+        }
+        i = at - 1;
+    }
+    return NOT_FOUND;
+}
+
+std::string lowercase(std::string text)
+{
+    std::transform(text.begin(), text.end(), text.begin(),
+                   [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    return text;
+}
+
+bool is_standalone_marker(uint8_t marker)
+{
+    // SOI, TEM and RST0-7 carry no length field
+    return marker == 0xD8 || marker == 0x01 || (marker >= 0xD0 && marker <= 0xD7);
+}
+
+} // namespace
+
+HttpStreamParser::HttpStreamParser(ProtocolType type, FrameCallback on_frame)
+    : type_(type)
+    , on_frame_(std::move(on_frame))
+{
+    reset();
+}
+
+void HttpStreamParser::reset()
+{
+    state_ = State::HEADERS;
+    header_.clear();
+    line_.clear();
+    chunk_remaining_ = 0;
+    status_ = 0;
+    chunked_ = false;
+    error_.clear();
+
+    body_.clear();
+    scan_pos_ = 0;
+
+    nal_start_ = 0;
+    have_nal_ = false;
+    au_.clear();
+    au_has_vcl_ = false;
+    au_keyframe_ = false;
+
+    in_image_ = false;
+    in_scan_ = false;
+
+    frames_ = 0;
+    frames_dropped_ = 0;
+}
+
+bool HttpStreamParser::feed(const uint8_t* data, size_t size)
+{
+    size_t pos = 0;
+
+    while (pos < size && state_ != State::FAILED && state_ != State::DONE) {
+        switch (state_) {
+            case State::HEADERS: {
+                size_t before = header_.size();
+                header_.append(reinterpret_cast<const char*>(data + pos), size - pos);
+                size_t end = header_.find("\r\n\r\n", before >= 3 ? before - 3 : 0);
+                if (end == std::string::npos) {
+                    if (header_.size() > MAX_HEADER_BYTES) {
+                        return fail("response header too large");
+                    }
+                    pos = size;
+                    break;
+                }
+                pos += end + 4 - before;
+                header_.resize(end + 4);
+                if (!parse_headers()) {
+                    return false;
+                }
+                state_ = chunked_ ? State::CHUNK_SIZE : State::BODY;
+                break;
+            }
+
+            case State::CHUNK_SIZE:
+            case State::CHUNK_END: {
+                char c = static_cast<char>(data[pos++]);
+                if (c != '\n') {
+                    line_ += c;
+                    if (line_.size() > MAX_CHUNK_LINE) {
+                        return fail("malformed chunk header");
+                    }
+                    break;
+                }
+                if (!line_.empty() && line_.back() == '\r') {
+                    line_.pop_back();
+                }
+
+                if (state_ == State::CHUNK_END) {
+                    if (!line_.empty()) {
+                        return fail("malformed chunk trailer");
+                    }
+                    line_.clear();
+                    state_ = State::CHUNK_SIZE;
+                    break;
+                }
+
+                // Extensions after ';' are allowed and ignored
+                std::string digits = line_.substr(0, line_.find(';'));
+                char* end = nullptr;
+                unsigned long length = strtoul(digits.c_str(), &end, 16);
+                if (digits.empty() || end == digits.c_str()) {
+                    return fail("malformed chunk size");
+                }
+                line_.clear();
+                chunk_remaining_ = length;
+                state_ = length == 0 ? State::DONE : State::CHUNK_DATA;
+                break;
+            }
+
+            case State::CHUNK_DATA: {
+                size_t take = std::min(chunk_remaining_, size - pos);
+                consume_body(data + pos, take);
+                pos += take;
+                chunk_remaining_ -= take;
+                if (chunk_remaining_ == 0) {
+                    state_ = State::CHUNK_END;
+                }
+                break;
+            }
+
+            case State::BODY:
+                consume_body(data + pos, size - pos);
+                pos = size;
+                break;
+
+            default:
+                break;
+        }
+    }
+
+    return state_ != State::FAILED;
+}
+
+void HttpStreamParser::finish()
+{
+    if (type_ != ProtocolType::HTTP_MJPEG) {
+        scan_annexb(true);
+    }
+}
+
+bool HttpStreamParser::headers_complete() const
+{
+    return state_ != State::HEADERS && status_ != 0;
+}
+
+int HttpStreamParser::status() const
+{
+    return status_;
+}
+
+const std::string& HttpStreamParser::error() const
+{
+    return error_;
+}
+
+uint64_t HttpStreamParser::frames() const
+{
+    return frames_;
+}
+
+uint64_t HttpStreamParser::frames_dropped() const
+{
+    return frames_dropped_;
+}
+
+bool HttpStreamParser::parse_headers()
+{
+    size_t line_end = header_.find("\r\n");
+    std::string status_line = header_.substr(0, line_end);
+
+    int major = 0, minor = 0, status = 0;
+    if (sscanf(status_line.c_str(), "HTTP/%d.%d %d", &major, &minor, &status) != 3) {
+        return fail("not an HTTP response");
+    }
+    status_ = status;
+    if (status != 200) {
+        return fail("HTTP status " + std::to_string(status));
+    }
+
+    size_t pos = line_end + 2;
+    while (pos < header_.size()) {
+        size_t end = header_.find("\r\n", pos);
+        if (end == std::string::npos || end == pos) {
+            break;
+        }
+        std::string line = header_.substr(pos, end - pos);
+        pos = end + 2;
+
+        size_t colon = line.find(':');
+        if (colon == std::string::npos) {
+            continue;
+        }
+        std::string name = lowercase(line.substr(0, colon));
+        std::string value = lowercase(line.substr(colon + 1));
+        if (name == "transfer-encoding" && value.find("chunked") != std::string::npos) {
+            chunked_ = true;
+        }
+    }
+
+    return true;
+}
+
+bool HttpStreamParser::fail(const std::string& reason)
+{
+    state_ = State::FAILED;
+    error_ = reason;
+    return false;
+}
+
+void HttpStreamParser::consume_body(const uint8_t* data, size_t size)
+{
+    body_.insert(body_.end(), data, data + size);
+
+    if (type_ == ProtocolType::HTTP_MJPEG) {
+        scan_jpeg();
+    } else {
+        scan_annexb(false);
+    }
+}
+
+void HttpStreamParser::scan_annexb(bool at_end)
+{
+    size_t start;
+    while ((start = find_start_code(body_, scan_pos_)) != NOT_FOUND) {
+        if (have_nal_) {
+            // Zeros before a start code are trailing_zero_8bits or a 4-byte start code
+            size_t end = start;
+            while (end > nal_start_ && body_[end - 1] == 0x00) {
+                end--;
+            }
+            handle_nal(body_.data() + nal_start_, end - nal_start_);
+        }
+        nal_start_ = start + 3;
+        have_nal_ = true;
+        scan_pos_ = nal_start_;
+    }
+
+    if (at_end) {
+        if (have_nal_) {
+            handle_nal(body_.data() + nal_start_, body_.size() - nal_start_);
+        }
+        emit_access_unit();
+        body_.clear();
+        have_nal_ = false;
+        nal_start_ = 0;
+        scan_pos_ = 0;
+        return;
+    }
+
+    // Keep the NAL still open, or the two bytes that may begin a split start code
+    size_t keep_from = have_nal_ ? nal_start_ : (body_.size() >= 2 ? body_.size() - 2 : 0);
+    body_.erase(body_.begin(), body_.begin() + keep_from);
+    nal_start_ = 0;
+    scan_pos_ = body_.size() >= 2 ? body_.size() - 2 : 0;
+
+    if (body_.size() > MAX_FRAME_BYTES) {
+        BLOG_WARNING("H.264 NAL unit over %zu bytes, dropping it", MAX_FRAME_BYTES);
+        body_.clear();
+        have_nal_ = false;
+        scan_pos_ = 0;
+        au_.clear();
+        au_has_vcl_ = false;
+        au_keyframe_ = false;
+        frames_dropped_++;
+    }
+}
+
+void HttpStreamParser::handle_nal(const uint8_t* nal, size_t size)
+{
+    if (size == 0) {
+        return;
+    }
+
+    uint8_t type = nal[0] & 0x1F;
+    bool vcl = type == 1 || type == 5;
+
+    // A new access unit starts with an AUD, SEI, SPS, PPS or prefix NAL after
+    // slices, or with a slice whose first_mb_in_slice is 0 (ue(v) bit "1")
+    if (au_has_vcl_) {
+        bool non_vcl_start = type == 6 || type == 7 || type == 8 || type == 9 ||
+                             (type >= 14 && type <= 18);
+        bool first_slice = vcl && size > 1 && (nal[1] & 0x80) != 0;
+        if (non_vcl_start || first_slice) {
+            emit_access_unit();
+        }
+    }
+
+    if (au_.size() + sizeof(START_CODE) + size > MAX_FRAME_BYTES) {
+        BLOG_WARNING("H.264 access unit over %zu bytes, dropping it", MAX_FRAME_BYTES);
+        au_.clear();
+        au_has_vcl_ = false;
+        au_keyframe_ = false;
+        frames_dropped_++;
+        return;
+    }
+
+    au_.insert(au_.end(), START_CODE, START_CODE + sizeof(START_CODE));
+    au_.insert(au_.end(), nal, nal + size);
+    au_has_vcl_ = au_has_vcl_ || vcl;
+    au_keyframe_ = au_keyframe_ || type == 5;
+}
+
+void HttpStreamParser::emit_access_unit()
+{
+    // Parameter sets without a slice yet wait for the picture they belong to
+    if (!au_has_vcl_) {
+        return;
+    }
+
+    VideoFrame frame = {};
+    frame.data = new uint8_t[au_.size()];
+    frame.size = au_.size();
+    memcpy(frame.data, au_.data(), au_.size());
+    frame.is_keyframe = au_keyframe_;
+
+    au_.clear();
+    au_has_vcl_ = false;
+    au_keyframe_ = false;
+    frames_++;
+
+    on_frame_(std::move(frame));
+}
+
+void HttpStreamParser::scan_jpeg()
+{
+    while (true) {
+        if (!in_image_) {
+            // Skip multipart boundaries and part headers up to the next SOI
+            size_t soi = NOT_FOUND;
+            for (size_t i = scan_pos_; i + 1 < body_.size(); i++) {
+                if (body_[i] == 0xFF && body_[i + 1] == 0xD8) {
+                    soi = i;
+                    break;
+                }
+            }
+            if (soi == NOT_FOUND) {
+                size_t keep = (!body_.empty() && body_.back() == 0xFF) ? 1 : 0;
+                body_.erase(body_.begin(), body_.end() - keep);
+                scan_pos_ = 0;
+                return;
+            }
+            body_.erase(body_.begin(), body_.begin() + soi);
+            in_image_ = true;
+            in_scan_ = false;
+            scan_pos_ = 2;
+        }
+
+        // Walk the marker segments; lengths skip over embedded thumbnails,
+        // so only the real EOI ends the image
+        size_t size = body_.size();
+        size_t pos = scan_pos_;
+        bool broken = false;
+        bool more = false;
+
+        while (!broken && !more) {
+            if (pos >= size) {
+                more = true;
+            } else if (in_scan_) {
+                // In entropy-coded data 0xFF is followed by a stuffed 0x00 or an RST
+                const void* ff = memchr(&body_[pos], 0xFF, size - pos);
+                if (!ff) {
+                    pos = size;
+                    continue;
+                }
+                pos = static_cast<const uint8_t*>(ff) - body_.data();
+                if (pos + 1 >= size) {
+                    more = true;
+                    continue;
+                }
+                uint8_t next = body_[pos + 1];
+                if (next == 0x00 || (next >= 0xD0 && next <= 0xD7)) {
+                    pos += 2;
+                } else if (next == 0xFF) {
+                    pos += 1;
+                } else {
+                    in_scan_ = false;
+                }
+            } else if (pos + 2 > size) {
+                more = true;
+            } else if (body_[pos] != 0xFF) {
+                broken = true;
+            } else {
+                uint8_t marker = body_[pos + 1];
+                if (marker == 0xFF) {
+                    pos += 1;   // Fill byte
+                } else if (marker == 0xD9) {
+                    emit_jpeg(pos + 2);
+                    break;
+                } else if (is_standalone_marker(marker)) {
+                    pos += 2;
+                } else if (pos + 4 > size) {
+                    more = true;
+                } else {
+                    size_t length = (static_cast<size_t>(body_[pos + 2]) << 8) | body_[pos + 3];
+                    if (length < 2) {
+                        broken = true;
+                        continue;
+                    }
+                    pos += 2 + length;
+                    in_scan_ = marker == 0xDA;
+                }
+            }
+        }
+
+        if (!in_image_) {
+            continue;   // Emitted; look for the next one
+        }
+
+        if (broken) {
+            // Not a JPEG after all; resync on the next SOI
+            in_image_ = false;
+            body_.erase(body_.begin(), body_.begin() + 2);
+            scan_pos_ = 0;
+            frames_dropped_++;
+            continue;
+        }
+
+        scan_pos_ = pos;
+        if (body_.size() > MAX_FRAME_BYTES) {
+            BLOG_WARNING("JPEG image over %zu bytes, dropping it", MAX_FRAME_BYTES);
+            body_.clear();
+            in_image_ = false;
+            scan_pos_ = 0;
+            frames_dropped_++;
+        }
+        return;
+    }
+}
+
+void HttpStreamParser::emit_jpeg(size_t size)
+{
+    VideoFrame frame = {};
+    frame.data = new uint8_t[size];
+    frame.size = size;
+    memcpy(frame.data, body_.data(), size);
+    frame.is_keyframe = true;   // Every JPEG is one
+
+    body_.erase(body_.begin(), body_.begin() + size);
+    in_image_ = false;
+    in_scan_ = false;
+    scan_pos_ = 0;
+    frames_++;
+
+    on_frame_(std::move(frame));
+}
+
+bool split_http_url(const std::string& url, std::string& host, int& port, std::string& path)
+{
+    std::regex url_regex(R"(http://([^:/]+)(?::(\d+))?(/.*)?)");
+    std::smatch matches;
+    if (!std::regex_match(url, matches, url_regex)) {
+        return false;
+    }
+
+    host = matches[1].str();
+    port = matches[2].matched ? std::stoi(matches[2].str()) : 80;
+    path = matches[3].matched ? matches[3].str() : "/";
+    return true;
+}
+
+} // namespace berrystreamcam
@@ -0,0 +1,108 @@
+#pragma once
+
+#include "../common.hpp"
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace berrystreamcam {
+
+/**
+ * Incremental parser for a long-lived HTTP/1.1 video response.
+ *
+ * Socket reads are fed in as they arrive, in pieces of any size. The
+ * parser checks the status line, reads the headers, undoes chunked
+ * transfer encoding and cuts the body into frames: H.264 access units in
+ * Annex-B form for HTTP_RAW_H264, whole JPEG images for HTTP_MJPEG (any
+ * multipart boundaries between them are skipped). Frames are delivered
+ * through the callback on the feeding thread.
+ *
+ * Not thread-safe; feed it from one thread.
+ */
+class HttpStreamParser {
+public:
+    using FrameCallback = std::function<void(VideoFrame&& frame)>;
+
+    static constexpr size_t MAX_HEADER_BYTES = 16384;
+    static constexpr size_t MAX_FRAME_BYTES = FRAME_BUFFER_SIZE;
+
+    HttpStreamParser(ProtocolType type, FrameCallback on_frame);
+
+    /**
+     * Returns false once the response is unusable (not 200, malformed
+     * headers or chunking); error() says why. An oversized frame is
+     * dropped and counted instead.
+     */
+    bool feed(const uint8_t* data, size_t size);
+
+    /**
+     * The connection closed: hand over the access unit still open.
+     */
+    void finish();
+
+    void reset();
+
+    bool headers_complete() const;
+    int status() const;
+    const std::string& error() const;
+
+    uint64_t frames() const;
+    uint64_t frames_dropped() const;
+
+private:
+    enum class State {
+        HEADERS,
+        CHUNK_SIZE,
+        CHUNK_DATA,
+        CHUNK_END,
+        BODY,
+        DONE,
+        FAILED
+    };
+
+    bool parse_headers();
+    bool fail(const std::string& reason);
+    void consume_body(const uint8_t* data, size_t size);
+
+    void scan_annexb(bool at_end);
+    void handle_nal(const uint8_t* nal, size_t size);
+    void emit_access_unit();
+
+    void scan_jpeg();
+    void emit_jpeg(size_t size);
+
+    ProtocolType type_;
+    FrameCallback on_frame_;
+
+    State state_;
+    std::string header_;
+    std::string line_;            // Chunk size line under assembly
+    size_t chunk_remaining_;
+    int status_;
+    bool chunked_;
+    std::string error_;
+
+    std::vector<uint8_t> body_;   // Unconsumed body bytes
+    size_t scan_pos_;             // Where to resume scanning body_
+
+    // H.264: NAL start within body_ and the access unit under assembly
+    size_t nal_start_;
+    bool have_nal_;
+    std::vector<uint8_t> au_;
+    bool au_has_vcl_;
+    bool au_keyframe_;
+
+    // MJPEG: position in the image that starts body_
+    bool in_image_;
+    bool in_scan_;
+
+    uint64_t frames_;
+    uint64_t frames_dropped_;
+};
+
+/**
+ * Split http://host[:port]/path. Returns false for anything else.
+ */
+bool split_http_url(const std::string& url, std::string& host, int& port, std::string& path);
+
+} // namespace berrystreamcam
@@ -0,0 +1,278 @@
+#include "local-relay.hpp"
+#include "fd-handoff.hpp"
+#include <cstring>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <errno.h>
+
+namespace berrystreamcam {
+
+namespace {
+
+constexpr const char* SOCKET_PREFIX = "berrystreamcam-relay/";
+constexpr int HANDSHAKE_TIMEOUT_MS = 1000;
+
+} // namespace
+
+std::unique_ptr<RelayPublisher> RelayPublisher::create(const std::string& key)
+{
+#ifdef __linux__
+    int fd = listen_abstract(SOCKET_PREFIX + key);
+    if (fd < 0) {
+        if (errno == EADDRINUSE) {
+            BLOG_DEBUG("Another process already relays %s", key.c_str());
+        } else {
+            BLOG_WARNING("Failed to listen on relay socket for %s: %s", key.c_str(), strerror(errno));
+        }
+        return nullptr;
+    }
+
+    std::unique_ptr<ShmRing> ring = ShmRing::create(SOCKET_PREFIX + key);
+    if (!ring) {
+        close(fd);
+        return nullptr;
+    }
+
+    std::unique_ptr<RelayPublisher> publisher(new RelayPublisher(key, fd, std::move(ring)));
+    publisher->listen_watch_ = publisher->reactor_->add(fd, [raw = publisher.get()]() { raw->on_accept(); });
+    if (publisher->listen_watch_ == 0) {
+        return nullptr;
+    }
+
+    BLOG_INFO("Relaying %s to other processes on this host", key.c_str());
+    return publisher;
+#else
+    BLOG_DEBUG("Local relay is not supported on this platform (%s)", key.c_str());
+    return nullptr;
+#endif
+}
+
+RelayPublisher::RelayPublisher(const std::string& key, int listen_fd, std::unique_ptr<ShmRing> ring)
+    : key_(key)
+    , listen_fd_(listen_fd)
+    , ring_(std::move(ring))
+    , reactor_(NetworkReactor::acquire())
+    , listen_watch_(0)
+{
+}
+
+RelayPublisher::~RelayPublisher()
+{
+    // Consumers notice through the ring and fail over
+    ring_->close();
+
+    if (listen_watch_ != 0) {
+        reactor_->remove(listen_watch_);
+    }
+    close(listen_fd_);
+
+    // Taken out under the lock; removed outside it, since a running callback wants the lock
+    std::map<int, NetworkReactor::Id> consumers;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        consumers.swap(consumers_);
+    }
+    for (const auto& consumer : consumers) {
+        reactor_->remove(consumer.second);
+        close(consumer.first);
+    }
+
+    BLOG_INFO("Stopped relaying %s", key_.c_str());
+}
+
+const std::string& RelayPublisher::key() const
+{
+    return key_;
+}
+
+void RelayPublisher::publish(const VideoFrame& frame)
+{
+    ring_->write(frame);
+}
+
+RelayStats RelayPublisher::stats() const
+{
+    ShmRingStats ring = ring_->stats();
+
+    RelayStats stats = {};
+    stats.frames = ring.frames;
+    stats.bytes = ring.bytes;
+    stats.oversized = ring.oversized;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats.consumers = consumers_.size();
+    return stats;
+}
+
+void RelayPublisher::on_accept()
+{
+#ifdef __linux__
+    for (;;) {
+        int fd = accept4(listen_fd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                BLOG_WARNING("Relay accept failed: %s", strerror(errno));
+            }
+            return;
+        }
+
+        if (!peer_is_same_user(fd) || !send_fd(fd, ring_->fd())) {
+            close(fd);
+            continue;
+        }
+
+        // Watched only to notice the consumer hang up
+        std::lock_guard<std::mutex> lock(mutex_);
+        NetworkReactor::Id watch = reactor_->add(fd, [this, fd]() { on_consumer(fd); });
+        if (watch == 0) {
+            close(fd);
+            continue;
+        }
+        consumers_[fd] = watch;
+        BLOG_DEBUG("Process attached to relay %s (%zu now)", key_.c_str(), consumers_.size());
+    }
+#endif
+}
+
+void RelayPublisher::on_consumer(int fd)
+{
+    char buffer[64];
+    for (;;) {
+        ssize_t received = recv(fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+        if (received > 0) {
+            continue;   // Consumers have nothing to say
+        }
+        if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+            return;
+        }
+        break;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = consumers_.find(fd);
+    if (it == consumers_.end()) {
+        return;   // The destructor has it
+    }
+    reactor_->remove(it->second);
+    consumers_.erase(it);
+    close(fd);
+    BLOG_DEBUG("Process detached from relay %s (%zu left)", key_.c_str(), consumers_.size());
+}
+
+RelayTransport::RelayTransport()
+    : socket_(-1)
+    , cursor_{}
+    , bytes_(0)
+{
+}
+
+RelayTransport::~RelayTransport()
+{
+    disconnect();
+}
+
+bool RelayTransport::available(const std::string& key)
+{
+#ifdef __linux__
+    int fd = connect_abstract(SOCKET_PREFIX + key);
+    if (fd < 0) {
+        return false;
+    }
+    close(fd);
+    return true;
+#else
+    return false;
+#endif
+}
+
+ProtocolType RelayTransport::protocol() const
+{
+    return ProtocolType::LOCAL_RELAY;
+}
+
+bool RelayTransport::connect(const std::string& url)
+{
+#ifdef __linux__
+    int fd = connect_abstract(SOCKET_PREFIX + url);
+    if (fd < 0) {
+        BLOG_DEBUG("No local relay for %s", url.c_str());
+        return false;
+    }
+
+    std::unique_ptr<ShmRing> ring = ShmRing::attach(receive_fd(fd, HANDSHAKE_TIMEOUT_MS));
+    if (!ring) {
+        BLOG_WARNING("Local relay for %s did not hand over its ring", url.c_str());
+        close(fd);
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (socket_ >= 0) {
+        close(socket_);
+    }
+    socket_ = fd;
+    cursor_ = ring->start_at_keyframe();
+    ring_ = std::move(ring);
+    bytes_ = 0;
+
+    BLOG_INFO("Attached to local relay for %s", url.c_str());
+    return true;
+#else
+    BLOG_DEBUG("Local relay is not supported on this platform (%s)", url.c_str());
+    return false;
+#endif
+}
+
+void RelayTransport::disconnect()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (ring_) {
+        BLOG_INFO("Detaching from local relay (%llu frames, %llu overruns)",
+                  static_cast<unsigned long long>(cursor_.frames),
+                  static_cast<unsigned long long>(cursor_.overruns));
+    }
+    ring_.reset();
+    if (socket_ >= 0) {
+        close(socket_);
+        socket_ = -1;
+    }
+}
+
+bool RelayTransport::is_connected() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return ring_ && !ring_->closed();
+}
+
+bool RelayTransport::receive_frame(VideoFrame& frame)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (!ring_) {
+        return false;
+    }
+
+    // Sleep on the ring briefly rather than leave a new frame to the next poll
+    bool received = ring_->read(cursor_, frame);
+    if (!received && !ring_->closed() && ring_->wait(cursor_, RECEIVE_WAIT_MS)) {
+        received = ring_->read(cursor_, frame);
+    }
+    if (received) {
+        bytes_ += frame.size;
+    }
+    return received;
+}
+
+RelayStats RelayTransport::stats() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    RelayStats stats = {};
+    stats.frames = cursor_.frames;
+    stats.bytes = bytes_;
+    stats.overruns = cursor_.overruns;
+    return stats;
+}
+
+} // namespace berrystreamcam
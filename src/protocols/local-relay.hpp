@@ -0,0 +1,105 @@
+#pragma once
+
+#include "../common.hpp"
+#include "network-reactor.hpp"
+#include "shm-ring.hpp"
+#include "transport.hpp"
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace berrystreamcam {
+
+struct RelayStats {
+    uint64_t frames;          // Published, or received by this consumer
+    uint64_t bytes;
+    uint64_t consumers;       // Other processes attached to this publisher
+    uint64_t overruns;        // Times this consumer fell behind and skipped ahead
+    uint64_t oversized;       // Frames too large for the ring, skipped
+};
+
+/**
+ * Lets other OBS processes on this host take a stream this one already
+ * receives, instead of each opening its own connection to the phone.
+ *
+ * The publisher writes every compressed frame it receives into a ShmRing
+ * and listens on an abstract Unix socket named after key. Whoever
+ * connects, if it runs as the same user, is handed the ring's file
+ * descriptor and from then on reads frames straight from shared memory.
+ * The ring is closed when the publisher goes away.
+ *
+ * create() fails when another process already publishes key, which is
+ * how the first instance to connect to a phone ends up serving the rest.
+ */
+class RelayPublisher {
+public:
+    static std::unique_ptr<RelayPublisher> create(const std::string& key);
+
+    ~RelayPublisher();
+
+    RelayPublisher(const RelayPublisher&) = delete;
+    RelayPublisher& operator=(const RelayPublisher&) = delete;
+
+    const std::string& key() const;
+
+    /**
+     * Copy frame into the ring. Only one thread may publish.
+     */
+    void publish(const VideoFrame& frame);
+
+    RelayStats stats() const;
+
+private:
+    RelayPublisher(const std::string& key, int listen_fd, std::unique_ptr<ShmRing> ring);
+
+    void on_accept();
+    void on_consumer(int fd);
+
+    std::string key_;
+    int listen_fd_;
+    std::unique_ptr<ShmRing> ring_;
+    std::shared_ptr<NetworkReactor> reactor_;
+    NetworkReactor::Id listen_watch_;
+
+    mutable std::mutex mutex_;
+    std::map<int, NetworkReactor::Id> consumers_;   // Socket -> its watch
+};
+
+/**
+ * Reads a stream another process publishes with RelayPublisher. The URL
+ * is the publisher's key. Starts at the newest keyframe in the ring, so a
+ * race against network transports is won at once.
+ *
+ * Unlike the other transports this one owns what it reads from.
+ */
+class RelayTransport : public Transport {
+public:
+    // How long receive_frame() sleeps on the ring for the next frame
+    static constexpr int RECEIVE_WAIT_MS = 1;
+
+    RelayTransport();
+    ~RelayTransport() override;
+
+    /**
+     * Whether some process publishes key right now.
+     */
+    static bool available(const std::string& key);
+
+    ProtocolType protocol() const override;
+    bool connect(const std::string& url) override;
+    void disconnect() override;
+    bool is_connected() const override;
+    bool receive_frame(VideoFrame& frame) override;
+
+    RelayStats stats() const;
+
+private:
+    mutable std::mutex mutex_;
+    int socket_;              // Held open so the publisher counts us
+    std::unique_ptr<ShmRing> ring_;
+    ShmCursor cursor_;
+    uint64_t bytes_;
+};
+
+} // namespace berrystreamcam
@@ -0,0 +1,386 @@
+#include "network-reactor.hpp"
+#include <algorithm>
+#include <cstring>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#else
+#include <poll.h>
+#endif
+
+namespace berrystreamcam {
+
+namespace {
+
+std::mutex instance_mutex;
+std::weak_ptr<NetworkReactor> instance;
+
+constexpr NetworkReactor::Id WAKE_TAG = 0;   // Registration ids start at 1
+constexpr int MAX_EVENTS = 4;                // Small, so ready sockets spread over the workers
+
+} // namespace
+
+std::shared_ptr<NetworkReactor> NetworkReactor::acquire()
+{
+    std::lock_guard<std::mutex> lock(instance_mutex);
+
+    std::shared_ptr<NetworkReactor> reactor = instance.lock();
+    if (!reactor) {
+        reactor = std::shared_ptr<NetworkReactor>(new NetworkReactor(), &NetworkReactor::release);
+        instance = reactor;
+    }
+    return reactor;
+}
+
+void NetworkReactor::release(NetworkReactor* reactor)
+{
+    // The destructor joins every worker; the worker dropping the last
+    // reference finishes its callback while another thread waits for it
+    for (const auto& worker : reactor->workers_) {
+        if (worker.get_id() == std::this_thread::get_id()) {
+            std::thread([reactor]() { delete reactor; }).detach();
+            return;
+        }
+    }
+    delete reactor;
+}
+
+NetworkReactor::NetworkReactor()
+    : epoll_fd_(-1)
+    , wake_read_fd_(-1)
+    , wake_write_fd_(-1)
+    , running_(true)
+    , next_id_(1)
+    , dispatches_(0)
+{
+    int fds[2];
+    if (pipe(fds) == 0) {
+        for (int fd : fds) {
+            fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+            fcntl(fd, F_SETFD, FD_CLOEXEC);
+        }
+        wake_read_fd_ = fds[0];
+        wake_write_fd_ = fds[1];
+    } else {
+        BLOG_ERROR("Failed to create reactor wake pipe: %s", strerror(errno));
+    }
+
+#ifdef __linux__
+    epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd_ < 0) {
+        BLOG_ERROR("epoll_create1 failed: %s", strerror(errno));
+    } else if (wake_read_fd_ >= 0) {
+        // Level-triggered and never one-shot: after shutdown it wakes every worker
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN;
+        ev.data.u64 = WAKE_TAG;
+        epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wake_read_fd_, &ev);
+    }
+#endif
+
+    for (size_t i = 0; i < WORKER_COUNT; i++) {
+        workers_.emplace_back(&NetworkReactor::worker_loop, this);
+    }
+
+    BLOG_INFO("Network reactor started with %zu workers", WORKER_COUNT);
+}
+
+NetworkReactor::~NetworkReactor()
+{
+    running_ = false;
+    wake();
+
+    // Never on a worker, see release()
+    for (auto& worker : workers_) {
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+
+    if (!registrations_.empty()) {
+        BLOG_WARNING("Network reactor stopped with %zu registrations left", registrations_.size());
+    }
+
+#ifdef __linux__
+    if (epoll_fd_ >= 0) {
+        close(epoll_fd_);
+    }
+#endif
+    if (wake_read_fd_ >= 0) {
+        close(wake_read_fd_);
+    }
+    if (wake_write_fd_ >= 0) {
+        close(wake_write_fd_);
+    }
+
+    BLOG_INFO("Network reactor stopped");
+}
+
+NetworkReactor::Id NetworkReactor::add(int fd, Callback on_readable)
+{
+    if (fd < 0) {
+        return 0;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    Id id = next_id_++;
+    registrations_[id] = { fd, 0, {}, std::move(on_readable), false, false, {} };
+
+    if (!watch(id, fd, true)) {
+        registrations_.erase(id);
+        return 0;
+    }
+#ifndef __linux__
+    wake();   // The worker rebuilds its poll set
+#endif
+
+    return id;
+}
+
+NetworkReactor::Id NetworkReactor::add_timer(int interval_ms, Callback on_tick)
+{
+    interval_ms = std::max(interval_ms, 1);
+
+    Id id;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        id = next_id_++;
+        auto due = std::chrono::steady_clock::now() + std::chrono::milliseconds(interval_ms);
+        registrations_[id] = { -1, interval_ms, due, std::move(on_tick), false, false, {} };
+    }
+
+    // Workers may be waiting with no timeout at all
+    wake();
+    return id;
+}
+
+void NetworkReactor::remove(Id id)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    auto it = registrations_.find(id);
+    if (it == registrations_.end()) {
+        return;
+    }
+
+    it->second.removed = true;
+#ifdef __linux__
+    if (it->second.fd >= 0) {
+        epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, it->second.fd, nullptr);
+    }
+#endif
+
+    if (!it->second.busy) {
+        registrations_.erase(it);
+        return;
+    }
+
+    // The worker running it erases it afterwards
+    if (it->second.runner == std::this_thread::get_id()) {
+        return;
+    }
+    idle_cv_.wait(lock, [this, id]() { return registrations_.find(id) == registrations_.end(); });
+}
+
+size_t NetworkReactor::worker_count() const
+{
+    return workers_.size();
+}
+
+size_t NetworkReactor::registration_count() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return registrations_.size();
+}
+
+uint64_t NetworkReactor::dispatch_count() const
+{
+    return dispatches_;
+}
+
+void NetworkReactor::worker_loop()
+{
+#ifdef __linux__
+    struct epoll_event events[MAX_EVENTS];
+
+    while (running_) {
+        int ready = epoll_wait(epoll_fd_, events, MAX_EVENTS, next_timeout_ms());
+        if (ready < 0 && errno != EINTR) {
+            BLOG_ERROR("Reactor epoll_wait failed: %s", strerror(errno));
+            break;
+        }
+
+        for (int i = 0; i < ready && running_; i++) {
+            if (events[i].data.u64 == WAKE_TAG) {
+                // Left readable at shutdown so every worker sees it
+                char buffer[64];
+                while (running_ && read(wake_read_fd_, buffer, sizeof(buffer)) > 0) {
+                }
+                continue;
+            }
+            run(events[i].data.u64, false);
+        }
+
+        run_due_timers();
+    }
+#else
+    std::vector<struct pollfd> fds;
+    std::vector<Id> ids;
+
+    while (running_) {
+        fds.clear();
+        ids.clear();
+        fds.push_back({ wake_read_fd_, POLLIN, 0 });
+        ids.push_back(WAKE_TAG);
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (const auto& entry : registrations_) {
+                if (entry.second.fd >= 0 && !entry.second.removed) {
+                    fds.push_back({ entry.second.fd, POLLIN, 0 });
+                    ids.push_back(entry.first);
+                }
+            }
+        }
+
+        int ready = poll(fds.data(), fds.size(), next_timeout_ms());
+        if (ready < 0 && errno != EINTR) {
+            BLOG_ERROR("Reactor poll failed: %s", strerror(errno));
+            break;
+        }
+
+        for (size_t i = 0; i < fds.size() && ready > 0 && running_; i++) {
+            if (!(fds[i].revents & (POLLIN | POLLHUP | POLLERR))) {
+                continue;
+            }
+            if (ids[i] == WAKE_TAG) {
+                char buffer[64];
+                while (running_ && read(wake_read_fd_, buffer, sizeof(buffer)) > 0) {
+                }
+                continue;
+            }
+            run(ids[i], false);
+        }
+
+        run_due_timers();
+    }
+#endif
+}
+
+int NetworkReactor::next_timeout_ms()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto now = std::chrono::steady_clock::now();
+    int timeout = -1;
+    for (const auto& entry : registrations_) {
+        const Registration& reg = entry.second;
+        if (reg.fd >= 0 || reg.busy || reg.removed) {
+            continue;
+        }
+        // Rounded up, or the worker wakes just short of the deadline and spins
+        auto wait = std::chrono::ceil<std::chrono::milliseconds>(reg.due - now).count();
+        int wait_ms = static_cast<int>(std::max<int64_t>(wait, 0));
+        timeout = timeout < 0 ? wait_ms : std::min(timeout, wait_ms);
+    }
+    return timeout;
+}
+
+void NetworkReactor::run(Id id, bool timer)
+{
+    Callback* callback;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = registrations_.find(id);
+        if (it == registrations_.end() || it->second.removed || it->second.busy ||
+            (it->second.fd < 0) != timer) {
+            return;
+        }
+        it->second.busy = true;
+        it->second.runner = std::this_thread::get_id();
+        callback = &it->second.callback;   // Map nodes stay put; erase waits for busy
+    }
+
+    try {
+        (*callback)();
+    } catch (const std::exception& e) {
+        BLOG_ERROR("Exception in reactor callback: %s", e.what());
+    } catch (...) {
+        BLOG_ERROR("Unknown exception in reactor callback");
+    }
+    dispatches_++;
+
+    bool erased = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = registrations_.find(id);
+        it->second.busy = false;
+        it->second.runner = std::thread::id();
+        if (it->second.removed) {
+            registrations_.erase(it);
+            erased = true;
+        } else if (it->second.fd >= 0) {
+            watch(id, it->second.fd, false);
+        }
+    }
+
+    if (erased) {
+        idle_cv_.notify_all();
+    }
+}
+
+void NetworkReactor::run_due_timers()
+{
+    std::vector<Id> due;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto now = std::chrono::steady_clock::now();
+        for (auto& entry : registrations_) {
+            Registration& reg = entry.second;
+            if (reg.fd >= 0 || reg.busy || reg.removed || reg.due > now) {
+                continue;
+            }
+            // Ticks missed while busy are dropped rather than run back to back
+            reg.due = now + std::chrono::milliseconds(reg.interval_ms);
+            due.push_back(entry.first);
+        }
+    }
+
+    for (Id id : due) {
+        run(id, true);
+    }
+}
+
+bool NetworkReactor::watch(Id id, int fd, bool first)
+{
+#ifdef __linux__
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT;
+    ev.data.u64 = id;
+    if (epoll_ctl(epoll_fd_, first ? EPOLL_CTL_ADD : EPOLL_CTL_MOD, fd, &ev) != 0) {
+        BLOG_WARNING("Failed to %s descriptor %d: %s", first ? "watch" : "re-arm", fd, strerror(errno));
+        return false;
+    }
+#else
+    (void)id;
+    (void)fd;
+    (void)first;
+#endif
+    return true;
+}
+
+void NetworkReactor::wake()
+{
+    if (wake_write_fd_ >= 0) {
+        char byte = 1;
+        ssize_t written = write(wake_write_fd_, &byte, 1);
+        (void)written;   // A full pipe is readable anyway
+    }
+}
+
+} // namespace berrystreamcam
@@ -0,0 +1,108 @@
+#pragma once
+
+#include "../common.hpp"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace berrystreamcam {
+
+/**
+ * Process-wide socket reactor shared by every protocol handler.
+ *
+ * A fixed set of worker threads waits on one epoll instance (a single
+ * worker with poll() off Linux) and runs the callback of whichever
+ * descriptor turns readable. Descriptors are armed one-shot, so a
+ * callback never runs on two workers at once and is re-armed when it
+ * returns. Callbacks must read until EAGAIN and must not block. Timers
+ * run on the same workers.
+ *
+ * The first acquire() starts the workers and they stop when the last
+ * holder drops its reference, so the thread count does not grow with
+ * the number of sources. A reference dropped last inside a callback is
+ * released on a thread of its own, since a worker cannot join itself.
+ */
+class NetworkReactor {
+public:
+    using Callback = std::function<void()>;
+    using Id = uint64_t;
+
+#ifdef __linux__
+    static constexpr size_t WORKER_COUNT = 2;
+#else
+    static constexpr size_t WORKER_COUNT = 1;
+#endif
+
+    static std::shared_ptr<NetworkReactor> acquire();
+
+    ~NetworkReactor();
+
+    NetworkReactor(const NetworkReactor&) = delete;
+    NetworkReactor& operator=(const NetworkReactor&) = delete;
+
+    /**
+     * Run on_readable whenever fd has data or hangs up. Reads in it must
+     * not block, and fd must stay open until remove() returns. Returns 0
+     * if fd could not be watched.
+     */
+    Id add(int fd, Callback on_readable);
+
+    /**
+     * Run on_tick every interval_ms, the first time one interval from now.
+     */
+    Id add_timer(int interval_ms, Callback on_tick);
+
+    /**
+     * Stop calling back. Once this returns the callback is not running
+     * and will not run again; called from the callback itself it only
+     * prevents later runs.
+     */
+    void remove(Id id);
+
+    size_t worker_count() const;
+    size_t registration_count() const;
+    uint64_t dispatch_count() const;   // Callbacks run so far
+
+private:
+    NetworkReactor();
+
+    // shared_ptr deleter; never destroys the reactor on one of its workers
+    static void release(NetworkReactor* reactor);
+
+    struct Registration {
+        int fd;                  // -1 for a timer
+        int interval_ms;
+        std::chrono::steady_clock::time_point due;
+        Callback callback;
+        bool busy;
+        bool removed;
+        std::thread::id runner;
+    };
+
+    void worker_loop();
+    int next_timeout_ms();
+    void run(Id id, bool timer);
+    void run_due_timers();
+    bool watch(Id id, int fd, bool first);
+    void wake();
+
+    int epoll_fd_;               // -1 off Linux
+    int wake_read_fd_;
+    int wake_write_fd_;
+    std::atomic<bool> running_;
+    std::vector<std::thread> workers_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable idle_cv_;    // remove() waits out a running callback
+    std::map<Id, Registration> registrations_;
+    Id next_id_;
+    std::atomic<uint64_t> dispatches_;
+};
+
+} // namespace berrystreamcam
@@ -0,0 +1,903 @@
+#include "restream-server.hpp"
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <random>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+namespace berrystreamcam {
+
+namespace {
+
+std::mutex instance_mutex;
+std::map<std::pair<int, bool>, std::weak_ptr<RestreamServer>> instances;
+
+constexpr size_t MAX_REQUEST_SIZE = 16 * 1024;
+constexpr size_t IOV_BATCH = 256;              // Below IOV_MAX everywhere
+constexpr uint8_t RTP_PAYLOAD_TYPE = 96;
+constexpr uint8_t NAL_FU_A = 28;
+constexpr const char* MJPEG_BOUNDARY = "berrystreamcam";
+constexpr const char CRLF[] = "\r\n";
+
+bool set_nonblocking(int fd)
+{
+    int flags = fcntl(fd, F_GETFL, 0);
+    return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0 &&
+        fcntl(fd, F_SETFD, FD_CLOEXEC) == 0;
+}
+
+std::string lowercase(std::string text)
+{
+    std::transform(text.begin(), text.end(), text.begin(),
+                   [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    return text;
+}
+
+std::string trim(const std::string& text)
+{
+    size_t begin = text.find_first_not_of(" \t");
+    if (begin == std::string::npos) {
+        return "";
+    }
+    size_t end = text.find_last_not_of(" \t\r");
+    return text.substr(begin, end - begin + 1);
+}
+
+// "/<name>/..." of a URI, also of an absolute one as RTSP clients send
+std::string uri_path(const std::string& uri)
+{
+    std::string path = uri;
+    size_t scheme = path.find("://");
+    if (scheme != std::string::npos) {
+        size_t slash = path.find('/', scheme + 3);
+        path = slash == std::string::npos ? "/" : path.substr(slash);
+    }
+    size_t query = path.find('?');
+    if (query != std::string::npos) {
+        path.erase(query);
+    }
+    return path.empty() ? "/" : path;
+}
+
+// 90 kHz, the RTP clock for video
+uint32_t rtp_timestamp()
+{
+    auto now = std::chrono::steady_clock::now().time_since_epoch();
+    return static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::microseconds>(now).count() * 9 / 100);
+}
+
+void put_u16(uint8_t* out, uint16_t value)
+{
+    out[0] = static_cast<uint8_t>(value >> 8);
+    out[1] = static_cast<uint8_t>(value);
+}
+
+void put_u32(uint8_t* out, uint32_t value)
+{
+    out[0] = static_cast<uint8_t>(value >> 24);
+    out[1] = static_cast<uint8_t>(value >> 16);
+    out[2] = static_cast<uint8_t>(value >> 8);
+    out[3] = static_cast<uint8_t>(value);
+}
+
+// Offset and length of each NAL unit in an Annex-B access unit, start codes excluded
+std::vector<std::pair<size_t, size_t>> split_nal_units(const uint8_t* data, size_t size)
+{
+    std::vector<std::pair<size_t, size_t>> units;
+    size_t start = SIZE_MAX;
+    size_t i = 0;
+    while (i + 3 <= size) {
+        if (data[i] == 0 && data[i + 1] == 0 && data[i + 2] == 1) {
+            if (start != SIZE_MAX) {
+                size_t end = i;
+                if (end > start && data[end - 1] == 0) {
+                    end--;   // Leading zero of a four-byte start code
+                }
+                units.emplace_back(start, end - start);
+            }
+            start = i + 3;
+            i += 3;
+        } else {
+            i++;
+        }
+    }
+
+    if (start == SIZE_MAX) {
+        if (size > 0) {
+            units.emplace_back(0, size);   // No start code; send it whole
+        }
+    } else if (start < size) {
+        units.emplace_back(start, size - start);
+    }
+    return units;
+}
+
+} // namespace
+
+struct RestreamServer::Frame {
+    struct Packet {
+        uint8_t header[14];        // RTP, then the FU-A indicator and header if fragmented
+        uint8_t header_size;
+        size_t offset;             // Payload, a slice of data
+        size_t length;
+    };
+
+    std::shared_ptr<const uint8_t> data;
+    size_t size;
+    bool keyframe;
+    bool jpeg;
+    std::string part_header;       // MJPEG multipart headers
+    std::vector<Packet> packets;   // RTP, built only while an RTSP client plays
+};
+
+struct RestreamServer::Client {
+    int fd;
+    NetworkReactor::Id watch;
+    ClientKind kind;
+    bool playing;
+    bool close_when_flushed;
+    StreamId stream;
+    std::string request;           // Received, not yet parsed
+    std::string control;           // Responses, written between frames
+    size_t control_sent;
+    std::deque<FrameRef> queue;
+    size_t queued_bytes;
+    size_t head_sent;              // Of the queue's first frame
+    bool need_keyframe;
+    int channel;                   // RTSP interleaved RTP channel
+    std::string session;
+};
+
+std::shared_ptr<RestreamServer> RestreamServer::acquire(int port, bool lan)
+{
+    std::lock_guard<std::mutex> lock(instance_mutex);
+
+    std::weak_ptr<RestreamServer>& instance = instances[std::make_pair(port, lan)];
+    std::shared_ptr<RestreamServer> server = instance.lock();
+    if (!server) {
+        server = create(port, lan);
+        instance = server;
+    }
+    return server;
+}
+
+std::shared_ptr<RestreamServer> RestreamServer::create(int port, bool lan)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0 || !set_nonblocking(fd)) {
+        BLOG_WARNING("Failed to create restream socket: %s", strerror(errno));
+        if (fd >= 0) {
+            close(fd);
+        }
+        return nullptr;
+    }
+
+    int reuse = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(lan ? INADDR_ANY : INADDR_LOOPBACK);
+    addr.sin_port = htons(static_cast<uint16_t>(port));
+    if (bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || listen(fd, SOMAXCONN) != 0) {
+        BLOG_WARNING("Failed to listen for restream clients on port %d: %s", port, strerror(errno));
+        close(fd);
+        return nullptr;
+    }
+
+    socklen_t length = sizeof(addr);
+    getsockname(fd, reinterpret_cast<sockaddr*>(&addr), &length);
+
+    std::shared_ptr<RestreamServer> server(new RestreamServer(fd, ntohs(addr.sin_port)));
+    server->listen_watch_ = server->reactor_->add(fd, [raw = server.get()]() { raw->on_accept(); });
+    server->flush_timer_ = server->reactor_->add_timer(FLUSH_INTERVAL_MS, [raw = server.get()]() { raw->flush_all(); });
+    if (server->listen_watch_ == 0 || server->flush_timer_ == 0) {
+        return nullptr;
+    }
+
+    BLOG_INFO("Restream server listening on %s:%d", lan ? "0.0.0.0" : "127.0.0.1", server->port_);
+    return server;
+}
+
+RestreamServer::RestreamServer(int listen_fd, int port)
+    : listen_fd_(listen_fd)
+    , port_(port)
+    , reactor_(NetworkReactor::acquire())
+    , listen_watch_(0)
+    , flush_timer_(0)
+    , next_stream_(1)
+    , next_session_(std::random_device()())
+{
+}
+
+RestreamServer::~RestreamServer()
+{
+    if (listen_watch_ != 0) {
+        reactor_->remove(listen_watch_);
+    }
+    if (flush_timer_ != 0) {
+        reactor_->remove(flush_timer_);
+    }
+    close(listen_fd_);
+
+    Dead dead;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto& entry : clients_) {
+            dead.push_back(std::move(entry.second));
+        }
+        clients_.clear();
+    }
+    reap(dead);
+
+    BLOG_INFO("Restream server on port %d stopped", port_);
+}
+
+int RestreamServer::port() const
+{
+    return port_;
+}
+
+RestreamServer::StreamId RestreamServer::open_stream(const std::string& name)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (find_stream(name) != 0) {
+        BLOG_WARNING("Another source already restreams %s", name.c_str());
+        return 0;
+    }
+
+    std::random_device random;
+    StreamId id = next_stream_++;
+    Stream& stream = streams_[id];
+    stream.name = name;
+    stream.sequence = static_cast<uint16_t>(random());
+    stream.ssrc = random();
+    stream.frames = 0;
+    stream.bytes_sent = 0;
+    stream.frames_dropped = 0;
+
+    BLOG_INFO("Restreaming %s at rtsp://<host>:%d/%s", name.c_str(), port_, name.c_str());
+    return id;
+}
+
+void RestreamServer::close_stream(StreamId id)
+{
+    Dead dead;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (streams_.erase(id) == 0) {
+            return;
+        }
+
+        std::vector<int> watching;
+        for (const auto& entry : clients_) {
+            if (entry.second->stream == id) {
+                watching.push_back(entry.first);
+            }
+        }
+        for (int fd : watching) {
+            drop_client(fd, dead);
+        }
+    }
+    reap(dead);
+}
+
+void RestreamServer::publish(StreamId id, const VideoFrame& frame, std::shared_ptr<const uint8_t> data)
+{
+    if (!data || frame.size == 0) {
+        return;
+    }
+
+    Dead dead;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        auto it = streams_.find(id);
+        if (it == streams_.end()) {
+            return;
+        }
+        Stream& stream = it->second;
+
+        auto shared = std::make_shared<Frame>();
+        const uint8_t* bytes = data.get();
+        shared->data = std::move(data);
+        shared->size = frame.size;
+        shared->jpeg = frame.size >= 2 && bytes[0] == 0xFF && bytes[1] == 0xD8;
+        shared->keyframe = frame.is_keyframe || shared->jpeg;   // Every JPEG stands alone
+        if (shared->jpeg) {
+            shared->part_header = std::string("--") + MJPEG_BOUNDARY + "\r\nContent-Type: image/jpeg\r\n"
+                "Content-Length: " + std::to_string(frame.size) + "\r\n\r\n";
+        }
+
+        bool rtsp = std::any_of(clients_.begin(), clients_.end(), [id](const auto& entry) {
+            const Client& client = *entry.second;
+            return client.stream == id && client.playing && client.kind == ClientKind::RTSP;
+        });
+        if (rtsp && !shared->jpeg) {
+            packetize(*shared, stream);
+        }
+        stream.frames++;
+
+        FrameRef ref = shared;
+        std::vector<int> failed;
+        for (auto& entry : clients_) {
+            Client& client = *entry.second;
+            if (client.stream != id || !client.playing ||
+                shared->jpeg != (client.kind == ClientKind::HTTP_MJPEG)) {
+                continue;
+            }
+
+            // Too far behind: forget the backlog, bar a frame half written, and start over
+            if (client.queue.size() >= MAX_CLIENT_BACKLOG_FRAMES ||
+                client.queued_bytes >= MAX_CLIENT_BACKLOG_BYTES) {
+                size_t keep = client.head_sent > 0 ? 1 : 0;
+                while (client.queue.size() > keep) {
+                    client.queued_bytes -= client.queue.back()->size;
+                    client.queue.pop_back();
+                    stream.frames_dropped++;
+                }
+                client.need_keyframe = true;
+            }
+
+            if (client.need_keyframe && !shared->keyframe) {
+                stream.frames_dropped++;
+                continue;
+            }
+            client.need_keyframe = false;
+
+            client.queue.push_back(ref);
+            client.queued_bytes += shared->size;
+            if (!flush(client)) {
+                failed.push_back(entry.first);
+            }
+        }
+        for (int fd : failed) {
+            drop_client(fd, dead);
+        }
+    }
+    reap(dead);
+}
+
+RestreamStats RestreamServer::stats(StreamId id) const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    RestreamStats stats = {};
+    auto it = streams_.find(id);
+    if (it == streams_.end()) {
+        return stats;
+    }
+    stats.frames = it->second.frames;
+    stats.bytes_sent = it->second.bytes_sent;
+    stats.frames_dropped = it->second.frames_dropped;
+    for (const auto& entry : clients_) {
+        if (entry.second->stream == id && entry.second->playing) {
+            stats.clients++;
+        }
+    }
+    return stats;
+}
+
+void RestreamServer::on_accept()
+{
+    for (;;) {
+        int fd = accept(listen_fd_, nullptr, nullptr);
+        if (fd < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                BLOG_WARNING("Restream accept failed: %s", strerror(errno));
+            }
+            return;
+        }
+        if (!set_nonblocking(fd)) {
+            close(fd);
+            continue;
+        }
+
+        int nodelay = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+
+        auto client = std::make_unique<Client>();
+        client->fd = fd;
+        client->kind = ClientKind::REQUEST;
+        client->playing = false;
+        client->close_when_flushed = false;
+        client->stream = 0;
+        client->control_sent = 0;
+        client->queued_bytes = 0;
+        client->head_sent = 0;
+        client->need_keyframe = true;
+        client->channel = 0;
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        client->watch = reactor_->add(fd, [this, fd]() { on_readable(fd); });
+        if (client->watch == 0) {
+            close(fd);
+            continue;
+        }
+        clients_[fd] = std::move(client);
+    }
+}
+
+void RestreamServer::on_readable(int fd)
+{
+    Dead dead;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        auto it = clients_.find(fd);
+        if (it == clients_.end()) {
+            return;   // Dropped meanwhile
+        }
+        Client& client = *it->second;
+
+        bool closed = false;
+        char buffer[4096];
+        for (;;) {
+            ssize_t received = recv(fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+            if (received > 0) {
+                client.request.append(buffer, static_cast<size_t>(received));
+                if (client.request.size() > MAX_REQUEST_SIZE) {
+                    closed = true;
+                    break;
+                }
+                continue;
+            }
+            if (received < 0 && errno == EINTR) {
+                continue;
+            }
+            closed = received == 0 || (errno != EAGAIN && errno != EWOULDBLOCK);
+            break;
+        }
+
+        while (!closed) {
+            std::string& request = client.request;
+
+            // RTCP the client interleaves, which we have no use for
+            if (!request.empty() && request[0] == '$') {
+                if (request.size() < 4) {
+                    break;
+                }
+                size_t length = (static_cast<uint8_t>(request[2]) << 8) | static_cast<uint8_t>(request[3]);
+                if (request.size() < 4 + length) {
+                    break;
+                }
+                request.erase(0, 4 + length);
+                continue;
+            }
+
+            size_t end = request.find("\r\n\r\n");
+            if (end == std::string::npos) {
+                break;
+            }
+            std::string head = request.substr(0, end);
+            request.erase(0, end + 4);
+            handle_request(client, head);
+        }
+
+        if (closed || !flush(client)) {
+            drop_client(fd, dead);
+        }
+    }
+    reap(dead);
+}
+
+void RestreamServer::flush_all()
+{
+    Dead dead;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        std::vector<int> failed;
+        for (auto& entry : clients_) {
+            Client& client = *entry.second;
+            if ((!client.queue.empty() || !client.control.empty() || client.close_when_flushed) &&
+                !flush(client)) {
+                failed.push_back(entry.first);
+            }
+        }
+        for (int fd : failed) {
+            drop_client(fd, dead);
+        }
+    }
+    reap(dead);
+}
+
+void RestreamServer::reap(Dead& dead)
+{
+    for (const auto& client : dead) {
+        reactor_->remove(client->watch);
+        close(client->fd);
+    }
+    dead.clear();
+}
+
+void RestreamServer::handle_request(Client& client, const std::string& head)
+{
+    size_t line_end = head.find("\r\n");
+    std::string line = head.substr(0, line_end);
+
+    size_t first = line.find(' ');
+    size_t second = first == std::string::npos ? std::string::npos : line.find(' ', first + 1);
+    if (second == std::string::npos) {
+        client.close_when_flushed = true;
+        return;
+    }
+    std::string method = line.substr(0, first);
+    std::string uri = line.substr(first + 1, second - first - 1);
+    std::string version = line.substr(second + 1);
+
+    std::map<std::string, std::string> headers;
+    size_t position = line_end;
+    while (position != std::string::npos && position < head.size()) {
+        size_t next = head.find("\r\n", position + 2);
+        std::string field = head.substr(position + 2, next == std::string::npos ? std::string::npos : next - position - 2);
+        size_t colon = field.find(':');
+        if (colon != std::string::npos) {
+            headers[lowercase(trim(field.substr(0, colon)))] = trim(field.substr(colon + 1));
+        }
+        position = next;
+    }
+
+    if (version.compare(0, 5, "RTSP/") == 0) {
+        handle_rtsp(client, method, uri, headers);
+    } else {
+        handle_http(client, method, uri);
+    }
+}
+
+void RestreamServer::handle_http(Client& client, const std::string& method, const std::string& uri)
+{
+    if (client.kind != ClientKind::REQUEST) {
+        return;   // One stream per connection; anything after it is ignored
+    }
+
+    auto respond = [&client](const std::string& status, const std::string& type, const std::string& body) {
+        client.control += "HTTP/1.1 " + status + "\r\nContent-Type: " + type +
+            "\r\nContent-Length: " + std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n" + body;
+        client.close_when_flushed = true;
+    };
+
+    if (method != "GET") {
+        respond("405 Method Not Allowed", "text/plain", "");
+        return;
+    }
+
+    std::string path = uri_path(uri);
+    if (path == "/") {
+        std::string body;
+        for (const auto& entry : streams_) {
+            const std::string& name = entry.second.name;
+            body += "/" + name + "/stream.h264\n/" + name + "/mjpeg\nrtsp: /" + name + "\n";
+        }
+        respond("200 OK", "text/plain", body);
+        return;
+    }
+
+    size_t slash = path.find('/', 1);
+    StreamId id = slash == std::string::npos ? 0 : find_stream(path.substr(1, slash - 1));
+    std::string format = slash == std::string::npos ? "" : path.substr(slash + 1);
+
+    std::string type;
+    if (id != 0 && format == "stream.h264") {
+        client.kind = ClientKind::HTTP_H264;
+        type = "video/h264";
+    } else if (id != 0 && format == "mjpeg") {
+        client.kind = ClientKind::HTTP_MJPEG;
+        type = std::string("multipart/x-mixed-replace; boundary=") + MJPEG_BOUNDARY;
+    } else {
+        respond("404 Not Found", "text/plain", "");
+        return;
+    }
+
+    // No Content-Length; the stream runs until either side closes
+    client.control += "HTTP/1.1 200 OK\r\nContent-Type: " + type +
+        "\r\nCache-Control: no-cache\r\nConnection: close\r\n\r\n";
+    client.stream = id;
+    client.playing = true;
+    client.need_keyframe = true;
+    BLOG_INFO("Restreaming %s to an HTTP client (%s)", streams_[id].name.c_str(), format.c_str());
+}
+
+void RestreamServer::handle_rtsp(Client& client, const std::string& method, const std::string& uri,
+                                 const std::map<std::string, std::string>& headers)
+{
+    if (client.kind != ClientKind::REQUEST && client.kind != ClientKind::RTSP) {
+        return;
+    }
+    client.kind = ClientKind::RTSP;
+
+    auto header = [&headers](const char* name) {
+        auto it = headers.find(name);
+        return it == headers.end() ? std::string() : it->second;
+    };
+    std::string cseq = header("cseq");
+
+    auto reply = [&client, &cseq](const std::string& status, const std::string& extra, const std::string& body) {
+        client.control += "RTSP/1.0 " + status + "\r\nCSeq: " + (cseq.empty() ? "0" : cseq) + "\r\n" + extra;
+        if (!body.empty()) {
+            client.control += "Content-Length: " + std::to_string(body.size()) + "\r\n";
+        }
+        client.control += "\r\n" + body;
+    };
+
+    // Track URIs append "/track1" to the stream's
+    std::string path = uri_path(uri);
+    size_t slash = path.find('/', 1);
+    std::string name = path.substr(1, slash == std::string::npos ? std::string::npos : slash - 1);
+
+    if (method == "OPTIONS") {
+        reply("200 OK", "Public: OPTIONS, DESCRIBE, SETUP, PLAY, TEARDOWN, GET_PARAMETER, SET_PARAMETER\r\n", "");
+    } else if (method == "DESCRIBE") {
+        if (find_stream(name) == 0) {
+            reply("404 Not Found", "", "");
+            return;
+        }
+        std::string base = uri;
+        if (!base.empty() && base.back() == '/') {
+            base.pop_back();
+        }
+        std::string sdp =
+            "v=0\r\n"
+            "o=- 0 0 IN IP4 0.0.0.0\r\n"
+            "s=BerryStreamCam " + name + "\r\n"
+            "c=IN IP4 0.0.0.0\r\n"
+            "t=0 0\r\n"
+            "a=control:*\r\n"
+            "m=video 0 RTP/AVP 96\r\n"
+            "a=rtpmap:96 H264/90000\r\n"
+            "a=fmtp:96 packetization-mode=1\r\n"
+            "a=control:track1\r\n";
+        reply("200 OK", "Content-Base: " + base + "/\r\nContent-Type: application/sdp\r\n", sdp);
+    } else if (method == "SETUP") {
+        StreamId id = find_stream(name);
+        if (id == 0) {
+            reply("404 Not Found", "", "");
+            return;
+        }
+
+        // Interleaved over this connection only; UDP would need a socket per client
+        std::string transport = header("transport");
+        size_t interleaved = transport.find("interleaved=");
+        if (transport.find("TCP") == std::string::npos && interleaved == std::string::npos) {
+            reply("461 Unsupported Transport", "", "");
+            return;
+        }
+        client.channel = interleaved == std::string::npos ? 0 : atoi(transport.c_str() + interleaved + 12);
+        client.stream = id;
+        if (client.session.empty()) {
+            char session[17];
+            snprintf(session, sizeof(session), "%016llx",
+                     static_cast<unsigned long long>(next_session_++ * 0x9E3779B97F4A7C15ull));
+            client.session = session;
+        }
+        reply("200 OK", "Transport: RTP/AVP/TCP;unicast;interleaved=" + std::to_string(client.channel) + "-" +
+              std::to_string(client.channel + 1) + "\r\nSession: " + client.session + ";timeout=60\r\n", "");
+    } else if (method == "PLAY") {
+        if (client.session.empty() || streams_.count(client.stream) == 0) {
+            reply("455 Method Not Valid in This State", "", "");
+            return;
+        }
+        client.playing = true;
+        client.need_keyframe = true;
+        reply("200 OK", "Session: " + client.session + "\r\nRange: npt=0.000-\r\n", "");
+        BLOG_INFO("Restreaming %s to an RTSP client", streams_[client.stream].name.c_str());
+    } else if (method == "TEARDOWN") {
+        client.playing = false;
+        size_t keep = client.head_sent > 0 ? 1 : 0;
+        while (client.queue.size() > keep) {
+            client.queued_bytes -= client.queue.back()->size;
+            client.queue.pop_back();
+        }
+        client.close_when_flushed = true;
+        reply("200 OK", client.session.empty() ? "" : "Session: " + client.session + "\r\n", "");
+    } else if (method == "GET_PARAMETER" || method == "SET_PARAMETER") {
+        // Keep-alives
+        reply("200 OK", client.session.empty() ? "" : "Session: " + client.session + "\r\n", "");
+    } else {
+        reply("501 Not Implemented", "", "");
+    }
+}
+
+RestreamServer::StreamId RestreamServer::find_stream(const std::string& name) const
+{
+    for (const auto& entry : streams_) {
+        if (entry.second.name == name) {
+            return entry.first;
+        }
+    }
+    return 0;
+}
+
+void RestreamServer::packetize(Frame& frame, Stream& stream) const
+{
+    const uint8_t* data = frame.data.get();
+    uint32_t timestamp = rtp_timestamp();
+    auto units = split_nal_units(data, frame.size);
+
+    auto add = [&](size_t offset, size_t length, const uint8_t* fu, bool marker) {
+        Frame::Packet packet;
+        packet.header[0] = 0x80;   // Version 2
+        packet.header[1] = static_cast<uint8_t>((marker ? 0x80 : 0) | RTP_PAYLOAD_TYPE);
+        put_u16(packet.header + 2, stream.sequence++);
+        put_u32(packet.header + 4, timestamp);
+        put_u32(packet.header + 8, stream.ssrc);
+        packet.header_size = 12;
+        if (fu) {
+            packet.header[12] = fu[0];
+            packet.header[13] = fu[1];
+            packet.header_size = 14;
+        }
+        packet.offset = offset;
+        packet.length = length;
+        frame.packets.push_back(packet);
+    };
+
+    for (size_t i = 0; i < units.size(); i++) {
+        size_t offset = units[i].first;
+        size_t length = units[i].second;
+        bool last = i + 1 == units.size();
+
+        if (length <= RTP_PAYLOAD_SIZE) {
+            add(offset, length, nullptr, last);
+            continue;
+        }
+
+        // FU-A: the NAL header moves into the indicator and fragment header
+        uint8_t nal = data[offset];
+        for (size_t position = 1; position < length;) {
+            size_t chunk = std::min(RTP_PAYLOAD_SIZE - 2, length - position);
+            bool start = position == 1;
+            bool end = position + chunk == length;
+            uint8_t fu[2] = {
+                static_cast<uint8_t>((nal & 0xE0) | NAL_FU_A),
+                static_cast<uint8_t>((start ? 0x80 : 0) | (end ? 0x40 : 0) | (nal & 0x1F)),
+            };
+            add(offset + position, chunk, fu, last && end);
+            position += chunk;
+        }
+    }
+}
+
+bool RestreamServer::flush(Client& client)
+{
+    auto stream = streams_.find(client.stream);
+    std::vector<iovec> iov;
+    std::vector<uint8_t> prefixes;
+
+    for (;;) {
+        // Responses go out between frames, never inside one
+        if (client.head_sent == 0 && !client.control.empty()) {
+            ssize_t sent = send(client.fd, client.control.data() + client.control_sent,
+                                client.control.size() - client.control_sent, MSG_NOSIGNAL);
+            if (sent < 0) {
+                return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+            }
+            client.control_sent += static_cast<size_t>(sent);
+            if (client.control_sent < client.control.size()) {
+                return true;
+            }
+            client.control.clear();
+            client.control_sent = 0;
+            continue;
+        }
+
+        if (client.queue.empty()) {
+            break;
+        }
+
+        const Frame& frame = *client.queue.front();
+        gather(frame, client, iov, prefixes);
+
+        size_t skip = client.head_sent;
+        size_t first = 0;
+        while (first < iov.size() && skip >= iov[first].iov_len) {
+            skip -= iov[first].iov_len;
+            first++;
+        }
+        if (first < iov.size()) {
+            iov[first].iov_base = static_cast<uint8_t*>(iov[first].iov_base) + skip;
+            iov[first].iov_len -= skip;
+        }
+
+        while (first < iov.size()) {
+            msghdr message = {};
+            message.msg_iov = &iov[first];
+            message.msg_iovlen = std::min(IOV_BATCH, iov.size() - first);
+            ssize_t sent = sendmsg(client.fd, &message, MSG_NOSIGNAL);
+            if (sent < 0) {
+                return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+            }
+
+            client.head_sent += static_cast<size_t>(sent);
+            if (stream != streams_.end()) {
+                stream->second.bytes_sent += static_cast<uint64_t>(sent);
+            }
+
+            size_t left = static_cast<size_t>(sent);
+            while (left > 0 && first < iov.size()) {
+                if (left >= iov[first].iov_len) {
+                    left -= iov[first].iov_len;
+                    first++;
+                } else {
+                    iov[first].iov_base = static_cast<uint8_t*>(iov[first].iov_base) + left;
+                    iov[first].iov_len -= left;
+                    left = 0;
+                }
+            }
+        }
+
+        client.queued_bytes -= frame.size;
+        client.queue.pop_front();
+        client.head_sent = 0;
+    }
+
+    // Everything written; a client that asked to go is let go now
+    return !client.close_when_flushed;
+}
+
+size_t RestreamServer::gather(const Frame& frame, const Client& client, std::vector<iovec>& iov,
+                              std::vector<uint8_t>& prefixes) const
+{
+    uint8_t* data = const_cast<uint8_t*>(frame.data.get());
+    iov.clear();
+
+    switch (client.kind) {
+    case ClientKind::HTTP_H264:
+        iov.push_back({ data, frame.size });
+        return frame.size;
+
+    case ClientKind::HTTP_MJPEG:
+        iov.push_back({ const_cast<char*>(frame.part_header.data()), frame.part_header.size() });
+        iov.push_back({ data, frame.size });
+        iov.push_back({ const_cast<char*>(CRLF), 2 });
+        return frame.part_header.size() + frame.size + 2;
+
+    case ClientKind::RTSP: {
+        // Each packet: "$", channel, length, then the RTP header and its slice of the frame
+        prefixes.resize(frame.packets.size() * 4);
+        size_t total = 0;
+        for (size_t i = 0; i < frame.packets.size(); i++) {
+            const Frame::Packet& packet = frame.packets[i];
+            uint8_t* prefix = &prefixes[i * 4];
+            prefix[0] = '$';
+            prefix[1] = static_cast<uint8_t>(client.channel);
+            put_u16(prefix + 2, static_cast<uint16_t>(packet.header_size + packet.length));
+            iov.push_back({ prefix, 4 });
+            iov.push_back({ const_cast<uint8_t*>(packet.header), packet.header_size });
+            iov.push_back({ data + packet.offset, packet.length });
+            total += 4 + packet.header_size + packet.length;
+        }
+        return total;
+    }
+
+    case ClientKind::REQUEST:
+        break;
+    }
+    return 0;
+}
+
+void RestreamServer::drop_client(int fd, Dead& dead)
+{
+    auto it = clients_.find(fd);
+    if (it == clients_.end()) {
+        return;
+    }
+    dead.push_back(std::move(it->second));
+    clients_.erase(it);
+}
+
+} // namespace berrystreamcam
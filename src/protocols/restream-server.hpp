@@ -0,0 +1,136 @@
+#pragma once
+
+#include "../common.hpp"
+#include "network-reactor.hpp"
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <sys/uio.h>
+#include <vector>
+
+namespace berrystreamcam {
+
+struct RestreamStats {
+    uint64_t clients;          // Connected and receiving
+    uint64_t frames;           // Published into the stream
+    uint64_t bytes_sent;       // To every client together
+    uint64_t frames_dropped;   // Skipped for clients that fell behind
+};
+
+/**
+ * Serves the compressed streams sources receive to other tools on this
+ * host or the LAN, so one phone connection can feed a multiviewer, a
+ * tally system and a recorder as well.
+ *
+ * One TCP port answers both protocols, told apart by the request line:
+ *
+ *   rtsp://host:port/<name>              H.264, RTP interleaved over TCP
+ *   http://host:port/<name>/stream.h264  H.264 Annex-B
+ *   http://host:port/<name>/mjpeg        multipart JPEG
+ *
+ * Published frames are never copied: every client's queue holds a
+ * reference to the buffer the source received, and RTP packets are
+ * written as headers plus slices of it. A client whose queue grows past
+ * its backlog loses what it has queued and resumes at the next keyframe,
+ * so a slow client never holds up the others or the source.
+ *
+ * Sockets are served by the shared NetworkReactor; queued data is
+ * written as the client's socket drains, on a reactor timer.
+ */
+class RestreamServer {
+public:
+    using StreamId = uint64_t;
+
+    static constexpr int DEFAULT_PORT = 8590;
+    static constexpr size_t MAX_CLIENT_BACKLOG_FRAMES = 30;
+    static constexpr size_t MAX_CLIENT_BACKLOG_BYTES = 4 * 1024 * 1024;
+    static constexpr size_t RTP_PAYLOAD_SIZE = 1400;
+    static constexpr int FLUSH_INTERVAL_MS = 5;
+
+    /**
+     * The process-wide server on port, listening on the loopback
+     * interface only unless lan. nullptr if the port cannot be bound.
+     */
+    static std::shared_ptr<RestreamServer> acquire(int port, bool lan);
+
+    /**
+     * A server of its own; port 0 picks a free one.
+     */
+    static std::shared_ptr<RestreamServer> create(int port, bool lan);
+
+    ~RestreamServer();
+
+    RestreamServer(const RestreamServer&) = delete;
+    RestreamServer& operator=(const RestreamServer&) = delete;
+
+    int port() const;
+
+    /**
+     * Serve a stream under name. 0 if another source already serves it.
+     */
+    StreamId open_stream(const std::string& name);
+
+    /**
+     * Stop serving; its clients are disconnected.
+     */
+    void close_stream(StreamId id);
+
+    /**
+     * Queue frame for every client of id. data is the frame's buffer and
+     * is shared, not copied; frame.data is not used.
+     */
+    void publish(StreamId id, const VideoFrame& frame, std::shared_ptr<const uint8_t> data);
+
+    RestreamStats stats(StreamId id) const;
+
+private:
+    enum class ClientKind { REQUEST, HTTP_H264, HTTP_MJPEG, RTSP };
+
+    struct Frame;
+    struct Client;
+
+    struct Stream {
+        std::string name;
+        uint16_t sequence;         // RTP, shared by the stream's clients
+        uint32_t ssrc;
+        uint64_t frames;
+        uint64_t bytes_sent;
+        uint64_t frames_dropped;
+    };
+
+    using FrameRef = std::shared_ptr<const Frame>;
+    using Dead = std::vector<std::unique_ptr<Client>>;
+
+    RestreamServer(int listen_fd, int port);
+
+    void on_accept();
+    void on_readable(int fd);
+    void flush_all();
+    void reap(Dead& dead);
+
+    void handle_request(Client& client, const std::string& head);
+    void handle_http(Client& client, const std::string& method, const std::string& uri);
+    void handle_rtsp(Client& client, const std::string& method, const std::string& uri,
+                     const std::map<std::string, std::string>& headers);
+    StreamId find_stream(const std::string& name) const;
+    void packetize(Frame& frame, Stream& stream) const;
+    bool flush(Client& client);
+    size_t gather(const Frame& frame, const Client& client, std::vector<iovec>& iov,
+                  std::vector<uint8_t>& prefixes) const;
+    void drop_client(int fd, Dead& dead);
+
+    int listen_fd_;
+    int port_;
+    std::shared_ptr<NetworkReactor> reactor_;
+    NetworkReactor::Id listen_watch_;
+    NetworkReactor::Id flush_timer_;
+
+    mutable std::mutex mutex_;
+    std::map<StreamId, Stream> streams_;
+    std::map<int, std::unique_ptr<Client>> clients_;   // By socket
+    StreamId next_stream_;
+    uint64_t next_session_;
+};
+
+} // namespace berrystreamcam
@@ -0,0 +1,284 @@
+#include "rtcp-session.hpp"
+#include <algorithm>
+#include <cstring>
+#include <random>
+
+namespace berrystreamcam {
+
+namespace {
+
+constexpr uint8_t RTCP_SR = 200;
+constexpr uint8_t RTCP_RR = 201;
+constexpr uint8_t RTCP_SDES = 202;
+constexpr uint8_t RTCP_BYE = 203;
+constexpr uint8_t RTCP_XR = 207;
+
+constexpr uint8_t SDES_CNAME = 1;
+constexpr size_t MAX_CNAME_LENGTH = 64;  // Keeps a full report within MAX_REPORT_SIZE
+constexpr uint8_t XR_RRTR = 4;
+constexpr uint8_t XR_DLRR = 5;
+
+// Seconds between the NTP epoch (1900) and the Unix epoch
+constexpr uint64_t NTP_UNIX_OFFSET = 2208988800ULL;
+
+uint32_t read32(const uint8_t* p)
+{
+    return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | p[3];
+}
+
+void write32(uint8_t* p, uint32_t value)
+{
+    p[0] = static_cast<uint8_t>(value >> 24);
+    p[1] = static_cast<uint8_t>(value >> 16);
+    p[2] = static_cast<uint8_t>(value >> 8);
+    p[3] = static_cast<uint8_t>(value);
+}
+
+void write_header(uint8_t* p, uint8_t count, uint8_t type, size_t length_bytes)
+{
+    p[0] = static_cast<uint8_t>(0x80 | (count & 0x1F));
+    p[1] = type;
+    uint16_t words = static_cast<uint16_t>(length_bytes / 4 - 1);
+    p[2] = static_cast<uint8_t>(words >> 8);
+    p[3] = static_cast<uint8_t>(words);
+}
+
+void to_ntp(int64_t now_us, uint32_t& seconds, uint32_t& fraction)
+{
+    seconds = static_cast<uint32_t>(now_us / 1000000 + NTP_UNIX_OFFSET);
+    fraction = static_cast<uint32_t>((uint64_t(now_us % 1000000) << 32) / 1000000);
+}
+
+// Middle 32 bits of the 64-bit NTP timestamp, in 1/65536 s
+uint32_t ntp_middle(int64_t now_us)
+{
+    uint32_t seconds, fraction;
+    to_ntp(now_us, seconds, fraction);
+    return (seconds << 16) | (fraction >> 16);
+}
+
+} // namespace
+
+RtcpSession::RtcpSession(const std::string& cname)
+    : cname_(cname.substr(0, MAX_CNAME_LENGTH))
+    , local_ssrc_(0)
+    , last_sr_ntp_(0)
+    , last_sr_arrival_us_(0)
+    , source_ssrc_(0)
+    , expected_prior_(0)
+    , received_prior_(0)
+    , stats_{}
+{
+    std::random_device rd;
+    local_ssrc_ = rd();
+    stats_.rtt_ms = -1.0;
+}
+
+RtcpSession::~RtcpSession()
+{
+}
+
+void RtcpSession::reset()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    last_sr_ntp_ = 0;
+    last_sr_arrival_us_ = 0;
+    source_ssrc_ = 0;
+    expected_prior_ = 0;
+    received_prior_ = 0;
+    stats_ = {};
+    stats_.rtt_ms = -1.0;
+}
+
+bool RtcpSession::process_packet(const uint8_t* data, size_t size, int64_t now_us)
+{
+    if (size < 8 || (data[0] >> 6) != 2) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    // Walk the compound packet; each part carries its own length
+    size_t offset = 0;
+    while (offset + 4 <= size) {
+        const uint8_t* packet = data + offset;
+        size_t length = (size_t((packet[2] << 8) | packet[3]) + 1) * 4;
+        if ((packet[0] >> 6) != 2 || offset + length > size) {
+            break;
+        }
+
+        switch (packet[1]) {
+        case RTCP_SR:
+            handle_sender_report(packet, length, now_us);
+            break;
+        case RTCP_XR:
+            handle_extended_report(packet, length, now_us);
+            break;
+        case RTCP_BYE:
+            if (!stats_.bye_received) {
+                BLOG_INFO("RTCP BYE received from camera");
+            }
+            stats_.bye_received = true;
+            break;
+        default:
+            break;
+        }
+
+        offset += length;
+    }
+
+    return true;
+}
+
+void RtcpSession::handle_sender_report(const uint8_t* packet, size_t size, int64_t now_us)
+{
+    if (size < 28) {
+        return;
+    }
+
+    uint32_t ntp_seconds = read32(packet + 8);
+    uint32_t ntp_fraction = read32(packet + 12);
+
+    last_sr_ntp_ = (ntp_seconds << 16) | (ntp_fraction >> 16);
+    last_sr_arrival_us_ = now_us;
+    stats_.sender_reports++;
+}
+
+void RtcpSession::handle_extended_report(const uint8_t* packet, size_t size, int64_t now_us)
+{
+    size_t offset = 8;
+    while (offset + 4 <= size) {
+        uint8_t block_type = packet[offset];
+        size_t block_length = (size_t((packet[offset + 2] << 8) | packet[offset + 3]) + 1) * 4;
+        if (offset + block_length > size) {
+            break;
+        }
+
+        if (block_type == XR_DLRR) {
+            // Sub-blocks of SSRC, last RR time, delay since last RR
+            for (size_t sub = offset + 4; sub + 12 <= offset + block_length; sub += 12) {
+                uint32_t ssrc = read32(packet + sub);
+                uint32_t lrr = read32(packet + sub + 4);
+                uint32_t dlrr = read32(packet + sub + 8);
+                if (ssrc != local_ssrc_ || lrr == 0) {
+                    continue;
+                }
+
+                int32_t rtt = static_cast<int32_t>(ntp_middle(now_us) - lrr - dlrr);
+                if (rtt >= 0) {
+                    stats_.rtt_ms = rtt * 1000.0 / 65536.0;
+                    stats_.rtt_from_rtcp = true;
+                }
+            }
+        }
+
+        offset += block_length;
+    }
+}
+
+size_t RtcpSession::build_receiver_report(const RtpStreamStats& rtp, int64_t now_us,
+                                          uint8_t* out, size_t capacity)
+{
+    if (capacity < MAX_REPORT_SIZE) {
+        return 0;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    bool have_source = rtp.packets_received > 0;
+    if (have_source && rtp.ssrc != source_ssrc_) {
+        // Restarted sender; loss intervals and its SR timing start over
+        if (source_ssrc_ != 0) {
+            last_sr_ntp_ = 0;
+        }
+        source_ssrc_ = rtp.ssrc;
+        expected_prior_ = 0;
+        received_prior_ = 0;
+    }
+
+    // Receiver report with at most one report block
+    size_t rr_length = have_source ? 32 : 8;
+    write_header(out, have_source ? 1 : 0, RTCP_RR, rr_length);
+    write32(out + 4, local_ssrc_);
+
+    if (have_source) {
+        uint32_t expected = rtp.extended_highest_sequence - rtp.base_sequence + 1;
+        int64_t lost = int64_t(expected) - int64_t(rtp.packets_received);
+        lost = std::max<int64_t>(-0x800000, std::min<int64_t>(0x7FFFFF, lost));
+
+        uint32_t expected_interval = expected - expected_prior_;
+        int64_t received_interval = int64_t(rtp.packets_received - received_prior_);
+        int64_t lost_interval = int64_t(expected_interval) - received_interval;
+        expected_prior_ = expected;
+        received_prior_ = rtp.packets_received;
+
+        uint8_t fraction = 0;
+        if (expected_interval != 0 && lost_interval > 0) {
+            fraction = static_cast<uint8_t>(std::min<int64_t>(255, (lost_interval << 8) / expected_interval));
+        }
+
+        uint32_t dlsr = 0;
+        if (last_sr_ntp_ != 0) {
+            dlsr = static_cast<uint32_t>((now_us - last_sr_arrival_us_) * 65536 / 1000000);
+        }
+
+        uint8_t* block = out + 8;
+        write32(block, rtp.ssrc);
+        write32(block + 4, (uint32_t(fraction) << 24) | (static_cast<uint32_t>(lost) & 0xFFFFFF));
+        write32(block + 8, rtp.extended_highest_sequence);
+        write32(block + 12, rtp.jitter);
+        write32(block + 16, last_sr_ntp_);
+        write32(block + 20, dlsr);
+
+        stats_.fraction_lost = fraction;
+        stats_.interval_loss_percent = fraction * 100.0 / 256.0;
+        stats_.cumulative_lost = static_cast<int32_t>(lost);
+        stats_.extended_highest_sequence = rtp.extended_highest_sequence;
+        stats_.jitter = rtp.jitter;
+        stats_.jitter_ms = rtp.jitter_ms;
+    }
+
+    // SDES CNAME is mandatory in every compound packet; pad with at least one null
+    uint8_t* sdes = out + rr_length;
+    size_t item_length = 2 + cname_.size();
+    size_t sdes_length = 8 + ((item_length + 1 + 3) & ~size_t(3));
+    memset(sdes, 0, sdes_length);
+    write_header(sdes, 1, RTCP_SDES, sdes_length);
+    write32(sdes + 4, local_ssrc_);
+    sdes[8] = SDES_CNAME;
+    sdes[9] = static_cast<uint8_t>(cname_.size());
+    memcpy(sdes + 10, cname_.data(), cname_.size());
+
+    // XR receiver reference time so the sender can return DLRR for our RTT
+    size_t xr_length = 20;
+    uint8_t* xr = out + rr_length + sdes_length;
+    uint32_t ntp_seconds, ntp_fraction;
+    to_ntp(now_us, ntp_seconds, ntp_fraction);
+    write_header(xr, 0, RTCP_XR, xr_length);
+    write32(xr + 4, local_ssrc_);
+    xr[8] = XR_RRTR;
+    xr[9] = 0;
+    xr[10] = 0;
+    xr[11] = 2;
+    write32(xr + 12, ntp_seconds);
+    write32(xr + 16, ntp_fraction);
+
+    stats_.receiver_reports++;
+    return rr_length + sdes_length + xr_length;
+}
+
+void RtcpSession::set_fallback_rtt(double rtt_ms)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!stats_.rtt_from_rtcp) {
+        stats_.rtt_ms = rtt_ms;
+    }
+}
+
+RtcpStats RtcpSession::get_stats() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+} // namespace berrystreamcam
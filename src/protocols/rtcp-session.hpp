@@ -0,0 +1,90 @@
+#pragma once
+
+#include "../common.hpp"
+#include "rtp-depacketizer.hpp"
+#include <string>
+#include <mutex>
+
+namespace berrystreamcam {
+
+/**
+ * Receiver-side RTCP view of one RTP stream.
+ */
+struct RtcpStats {
+    uint64_t sender_reports;      // SRs received from the camera
+    uint64_t receiver_reports;    // RRs we sent
+    uint8_t fraction_lost;        // Last report interval, in 1/256 units
+    double interval_loss_percent; // fraction_lost as a percentage
+    int32_t cumulative_lost;      // Expected minus received since the stream started
+    uint32_t extended_highest_sequence;
+    uint32_t jitter;              // RFC 3550 interarrival jitter, RTP timestamp units
+    double jitter_ms;
+    double rtt_ms;                // Round trip, or -1 until one has been measured
+    bool rtt_from_rtcp;           // XR DLRR answer rather than RTSP keepalive timing
+    bool bye_received;
+};
+
+/**
+ * RTCP receiver for a single RTP source (RFC 3550 section 6.4.2).
+ *
+ * Parses compound packets from the sender: SR timestamps feed the LSR/DLSR
+ * fields of our reports, BYE is noted, and XR DLRR blocks (RFC 3611) answer
+ * the receiver reference time we attach, which is how a pure receiver
+ * learns its round-trip time. build_receiver_report() writes an RR with
+ * interval loss fraction, cumulative loss, extended highest sequence and
+ * jitter taken from the depacketizer, followed by SDES CNAME and XR RRTR.
+ *
+ * Times are wall-clock microseconds (UdpBatchReceiver::now_us()).
+ */
+class RtcpSession {
+public:
+    static constexpr size_t MAX_REPORT_SIZE = 128;
+
+    explicit RtcpSession(const std::string& cname = "berrystreamcam");
+    ~RtcpSession();
+
+    void reset();
+
+    /**
+     * Feed one received RTCP datagram (may be compound).
+     * Returns false if it is not valid RTCP.
+     */
+    bool process_packet(const uint8_t* data, size_t size, int64_t now_us);
+
+    /**
+     * Write a compound RR + SDES + XR packet into out.
+     * Returns its length, or 0 if capacity is below MAX_REPORT_SIZE.
+     */
+    size_t build_receiver_report(const RtpStreamStats& rtp, int64_t now_us,
+                                 uint8_t* out, size_t capacity);
+
+    /**
+     * Round trip measured outside RTCP, used until the sender answers XR.
+     */
+    void set_fallback_rtt(double rtt_ms);
+
+    uint32_t local_ssrc() const { return local_ssrc_; }
+
+    RtcpStats get_stats() const;
+
+private:
+    void handle_sender_report(const uint8_t* packet, size_t size, int64_t now_us);
+    void handle_extended_report(const uint8_t* packet, size_t size, int64_t now_us);
+
+    std::string cname_;
+    uint32_t local_ssrc_;
+
+    // Last sender report, for LSR/DLSR
+    uint32_t last_sr_ntp_;
+    int64_t last_sr_arrival_us_;
+
+    // Interval loss accounting (RFC 3550 appendix A.3)
+    uint32_t source_ssrc_;
+    uint32_t expected_prior_;
+    uint64_t received_prior_;
+
+    RtcpStats stats_;
+    mutable std::mutex mutex_;
+};
+
+} // namespace berrystreamcam
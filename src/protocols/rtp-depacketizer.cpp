@@ -0,0 +1,589 @@
+#include "rtp-depacketizer.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+namespace berrystreamcam {
+
+// Declared in the header so process_packet() can take it
+struct RtpHeader {
+    uint16_t sequence;
+    uint32_t timestamp;
+    uint32_t ssrc;
+    bool marker;
+    size_t payload_offset;
+    size_t payload_size;
+};
+
+namespace {
+
+constexpr size_t RTP_HEADER_SIZE = 12;
+constexpr size_t RTP_SLOT_SIZE = 2048;
+constexpr size_t MAX_RING_SIZE = 32768;
+
+constexpr uint8_t NAL_IDR = 5;
+constexpr uint8_t NAL_SPS = 7;
+constexpr uint8_t NAL_STAP_A = 24;
+constexpr uint8_t NAL_FU_A = 28;
+
+const uint8_t START_CODE[4] = { 0x00, 0x00, 0x00, 0x01 };
+
+// Validate an RTP datagram and locate its payload (RFC 3550 section 5.1)
+bool parse_rtp_header(const uint8_t* data, size_t size, RtpHeader& header)
+{
+    if (size < RTP_HEADER_SIZE || (data[0] >> 6) != 2) {
+        return false;
+    }
+
+    bool padding = (data[0] & 0x20) != 0;
+    bool extension = (data[0] & 0x10) != 0;
+    size_t csrc_count = data[0] & 0x0F;
+
+    header.marker = (data[1] & 0x80) != 0;
+    header.sequence = static_cast<uint16_t>((data[2] << 8) | data[3]);
+    header.timestamp = (uint32_t(data[4]) << 24) | (uint32_t(data[5]) << 16) |
+                       (uint32_t(data[6]) << 8) | uint32_t(data[7]);
+    header.ssrc = (uint32_t(data[8]) << 24) | (uint32_t(data[9]) << 16) |
+                  (uint32_t(data[10]) << 8) | uint32_t(data[11]);
+
+    size_t offset = RTP_HEADER_SIZE + csrc_count * 4;
+    if (extension) {
+        if (offset + 4 > size) {
+            return false;
+        }
+        size_t ext_words = (data[offset + 2] << 8) | data[offset + 3];
+        offset += 4 + ext_words * 4;
+    }
+
+    size_t end = size;
+    if (padding) {
+        size_t pad = data[size - 1];
+        if (pad == 0 || pad > end) {
+            return false;
+        }
+        end -= pad;
+    }
+
+    if (offset >= end) {
+        return false;
+    }
+
+    header.payload_offset = offset;
+    header.payload_size = end - offset;
+    return true;
+}
+
+} // namespace
+
+RtpDepacketizer::RtpDepacketizer(FrameCallback on_frame, size_t reorder_depth, int64_t max_delay_us,
+                                 std::shared_ptr<FramePool> pool)
+    : on_frame_(std::move(on_frame))
+    , reorder_depth_(reorder_depth > 0 ? reorder_depth : 1)
+    , max_delay_us_(max_delay_us)
+    , pool_(std::move(pool))
+    , mask_(0)
+    , next_sequence_(0)
+    , highest_sequence_(0)
+    , buffered_(0)
+    , started_(false)
+    , au_data_(nullptr)
+    , au_size_(0)
+    , au_capacity_(0)
+    , au_timestamp_(0)
+    , au_open_(false)
+    , au_keyframe_(false)
+    , au_has_sps_(false)
+    , au_corrupt_(false)
+    , fragment_open_(false)
+    , fragment_start_(0)
+    , loss_pending_(false)
+    , jitter_(0.0)
+    , last_transit_(0)
+    , have_transit_(false)
+    , stats_{}
+{
+    // Ring must cover the reorder depth with headroom; keep it a power of two
+    size_t ring_size = 64;
+    while (ring_size < reorder_depth_ * 2 && ring_size < MAX_RING_SIZE) {
+        ring_size <<= 1;
+    }
+    reorder_depth_ = std::min(reorder_depth_, ring_size / 2);
+    mask_ = static_cast<uint16_t>(ring_size - 1);
+
+    slots_.resize(ring_size);
+    for (auto& slot : slots_) {
+        slot.data.resize(RTP_SLOT_SIZE);
+        slot.size = 0;
+        slot.arrival_us = 0;
+        slot.sequence = 0;
+        slot.used = false;
+    }
+
+    if (!pool_) {
+        pool_ = std::make_shared<FramePool>();
+    }
+
+    BLOG_DEBUG("RTP depacketizer created (ring=%zu, depth=%zu, max_delay=%lldus)",
+               ring_size, reorder_depth_, static_cast<long long>(max_delay_us_));
+}
+
+RtpDepacketizer::~RtpDepacketizer()
+{
+    pool_->release(au_data_);
+}
+
+int64_t RtpDepacketizer::now_us()
+{
+    // Same clock as the kernel timestamps UdpBatchReceiver hands us
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+void RtpDepacketizer::push_packet(const uint8_t* data, size_t size, int64_t arrival_us)
+{
+    RtpHeader header;
+    if (!parse_rtp_header(data, size, header)) {
+        return;
+    }
+
+    if (arrival_us == 0) {
+        arrival_us = now_us();
+    }
+
+    std::vector<VideoFrame> ready;
+    {
+        std::lock_guard<std::mutex> lock(stats_mutex_);
+        process_packet(header, data, size, arrival_us);
+        ready.swap(ready_);
+    }
+    deliver(ready);
+}
+
+void RtpDepacketizer::process_packet(const RtpHeader& header, const uint8_t* data, size_t size,
+                                     int64_t arrival_us)
+{
+    // A new SSRC means the sender restarted; resynchronise on it
+    if (started_ && header.ssrc != stats_.ssrc) {
+        BLOG_INFO("RTP SSRC changed (%08x -> %08x), resynchronising",
+                  stats_.ssrc, header.ssrc);
+        emit_access_unit();
+        for (auto& slot : slots_) {
+            slot.used = false;
+        }
+        buffered_ = 0;
+        started_ = false;
+        have_transit_ = false;
+    }
+
+    if (!started_) {
+        started_ = true;
+        next_sequence_ = header.sequence;
+        highest_sequence_ = header.sequence;
+        stats_.ssrc = header.ssrc;
+        stats_.base_sequence = header.sequence;
+        stats_.extended_highest_sequence = header.sequence;
+    }
+
+    stats_.packets_received++;
+    update_jitter(header.timestamp, arrival_us);
+
+    int16_t offset = static_cast<int16_t>(header.sequence - next_sequence_);
+
+    // In-order fast path: nothing is waiting, depacketize without a copy
+    if (offset == 0 && buffered_ == 0) {
+        next_sequence_++;
+        advance_highest(header.sequence);
+        depacketize(data + header.payload_offset, header.payload_size,
+                    header.timestamp, header.marker);
+        return;
+    }
+
+    insert(header.sequence, data, size, arrival_us);
+    drain(arrival_us);
+}
+
+void RtpDepacketizer::poll(int64_t now)
+{
+    std::vector<VideoFrame> ready;
+    {
+        std::lock_guard<std::mutex> lock(stats_mutex_);
+        drain(now != 0 ? now : now_us());
+        ready.swap(ready_);
+    }
+    deliver(ready);
+}
+
+void RtpDepacketizer::deliver(std::vector<VideoFrame>& frames)
+{
+    // Outside stats_mutex_, so the callback may call get_stats() and its
+    // queue push does not hold up stats readers
+    for (auto& frame : frames) {
+        on_frame_(std::move(frame));
+    }
+}
+
+void RtpDepacketizer::update_jitter(uint32_t rtp_timestamp, int64_t arrival_us)
+{
+    // Relative transit time in RTP units; only differences matter, so the
+    // arrival clock's epoch and 32-bit wrap of the RTP timestamp cancel out
+    // 90 kHz is 9/100 of a tick per microsecond; arrival_us * CLOCK_RATE
+    // would overflow on wall-clock times
+    static_assert(CLOCK_RATE == 90000, "arrival scaling assumes a 90 kHz clock");
+    int64_t arrival_units = arrival_us * 9 / 100;
+    uint32_t transit = static_cast<uint32_t>(arrival_units) - rtp_timestamp;
+
+    if (have_transit_) {
+        int32_t d = static_cast<int32_t>(transit - last_transit_);
+        jitter_ += (std::abs(static_cast<double>(d)) - jitter_) / 16.0;
+    }
+
+    last_transit_ = transit;
+    have_transit_ = true;
+
+    stats_.jitter = static_cast<uint32_t>(jitter_);
+    stats_.jitter_ms = jitter_ * 1000.0 / CLOCK_RATE;
+}
+
+void RtpDepacketizer::advance_highest(uint16_t sequence)
+{
+    // Count 16-bit wraps so receiver reports carry the extended sequence
+    if (sequence < highest_sequence_) {
+        stats_.extended_highest_sequence += 0x10000;
+    }
+    highest_sequence_ = sequence;
+    stats_.extended_highest_sequence =
+        (stats_.extended_highest_sequence & 0xFFFF0000u) | sequence;
+}
+
+void RtpDepacketizer::insert(uint16_t sequence, const uint8_t* data, size_t size, int64_t arrival_us)
+{
+    int16_t offset = static_cast<int16_t>(sequence - next_sequence_);
+
+    if (offset < 0) {
+        // Behind the release point: either a duplicate or too late to use
+        stats_.packets_late++;
+        return;
+    }
+
+    if (static_cast<size_t>(offset) > mask_) {
+        // Jump past the whole ring: release what we have, count the rest lost
+        BLOG_DEBUG("RTP sequence jump of %d packets", static_cast<int>(offset));
+        while (buffered_ > 0) {
+            Slot& slot = slots_[next_sequence_ & mask_];
+            if (slot.used && slot.sequence == next_sequence_) {
+                release(slot.data.data(), slot.size);
+                slot.used = false;
+                buffered_--;
+            } else {
+                declare_lost();
+                stats_.packets_lost++;
+            }
+            next_sequence_++;
+        }
+        stats_.packets_lost += static_cast<uint16_t>(sequence - next_sequence_);
+        loss_pending_ = true;
+        next_sequence_ = sequence;
+        advance_highest(sequence);
+    }
+
+    Slot& slot = slots_[sequence & mask_];
+    if (slot.used) {
+        stats_.packets_duplicate++;
+        return;
+    }
+
+    if (size > slot.data.size()) {
+        slot.data.resize(size);
+    }
+    memcpy(slot.data.data(), data, size);
+    slot.size = size;
+    slot.arrival_us = arrival_us;
+    slot.sequence = sequence;
+    slot.used = true;
+    buffered_++;
+
+    if (static_cast<int16_t>(sequence - highest_sequence_) > 0) {
+        advance_highest(sequence);
+    } else if (sequence != highest_sequence_) {
+        stats_.packets_reordered++;
+    }
+}
+
+void RtpDepacketizer::drain(int64_t now)
+{
+    while (buffered_ > 0) {
+        Slot& slot = slots_[next_sequence_ & mask_];
+        if (slot.used && slot.sequence == next_sequence_) {
+            release(slot.data.data(), slot.size);
+            slot.used = false;
+            buffered_--;
+            next_sequence_++;
+            continue;
+        }
+
+        // Gap at next_sequence_: wait unless it is too deep or too old
+        uint16_t span = static_cast<uint16_t>(highest_sequence_ - next_sequence_);
+        bool too_deep = span >= reorder_depth_;
+
+        bool too_old = false;
+        if (!too_deep) {
+            for (uint16_t seq = next_sequence_ + 1; seq != static_cast<uint16_t>(highest_sequence_ + 1); seq++) {
+                const Slot& waiting = slots_[seq & mask_];
+                if (waiting.used && waiting.sequence == seq) {
+                    too_old = now - waiting.arrival_us > max_delay_us_;
+                    break;
+                }
+            }
+        }
+
+        if (!too_deep && !too_old) {
+            break;
+        }
+
+        declare_lost();
+        stats_.packets_lost++;
+        next_sequence_++;
+    }
+}
+
+void RtpDepacketizer::release(const uint8_t* packet, size_t size)
+{
+    RtpHeader header;
+    if (!parse_rtp_header(packet, size, header)) {
+        return;
+    }
+
+    depacketize(packet + header.payload_offset, header.payload_size,
+                header.timestamp, header.marker);
+}
+
+void RtpDepacketizer::declare_lost()
+{
+    if (fragment_open_) {
+        discard_fragment();
+    }
+
+    if (au_open_) {
+        au_corrupt_ = true;
+    } else {
+        // Lost between access units; taint whichever one comes next
+        loss_pending_ = true;
+    }
+}
+
+void RtpDepacketizer::depacketize(const uint8_t* payload, size_t size, uint32_t timestamp, bool marker)
+{
+    // A new timestamp closes the previous access unit even if its marker was lost
+    if (au_open_ && timestamp != au_timestamp_) {
+        emit_access_unit();
+    }
+
+    if (!au_open_) {
+        au_open_ = true;
+        au_timestamp_ = timestamp;
+        au_keyframe_ = false;
+        au_has_sps_ = false;
+        au_corrupt_ = loss_pending_;
+        loss_pending_ = false;
+        au_size_ = 0;
+    }
+
+    uint8_t nal_type = payload[0] & 0x1F;
+
+    if (nal_type >= 1 && nal_type <= 23) {
+        append_nal(payload, size);
+    } else if (nal_type == NAL_STAP_A) {
+        size_t pos = 1;
+        while (pos + 2 <= size) {
+            size_t nal_size = (payload[pos] << 8) | payload[pos + 1];
+            pos += 2;
+            if (nal_size == 0 || pos + nal_size > size) {
+                BLOG_DEBUG("Malformed STAP-A aggregation unit");
+                au_corrupt_ = true;
+                break;
+            }
+            append_nal(payload + pos, nal_size);
+            pos += nal_size;
+        }
+    } else if (nal_type == NAL_FU_A) {
+        if (size < 2) {
+            au_corrupt_ = true;
+        } else {
+            uint8_t indicator = payload[0];
+            uint8_t fu_header = payload[1];
+            bool start = (fu_header & 0x80) != 0;
+            bool end = (fu_header & 0x40) != 0;
+            uint8_t original_type = fu_header & 0x1F;
+
+            if (start) {
+                if (fragment_open_) {
+                    // Previous fragment never saw its end bit
+                    discard_fragment();
+                }
+                uint8_t nal_header = (indicator & 0xE0) | original_type;
+                begin_nal(nal_header);
+                fragment_start_ = au_size_;
+                fragment_open_ = true;
+                if (!au_append(START_CODE, 4) || !au_append(&nal_header, 1)) {
+                    discard_fragment();
+                }
+            }
+
+            if (fragment_open_) {
+                if (!au_append(payload + 2, size - 2)) {
+                    discard_fragment();
+                } else if (end) {
+                    fragment_open_ = false;
+                }
+            } else {
+                // Middle or end fragment without its start: unusable
+                au_corrupt_ = true;
+            }
+        }
+    } else {
+        stats_.nals_unsupported++;
+    }
+
+    if (marker) {
+        emit_access_unit();
+    }
+}
+
+void RtpDepacketizer::append_nal(const uint8_t* nal, size_t size)
+{
+    begin_nal(nal[0]);
+
+    size_t start = au_size_;
+    if (!au_append(START_CODE, 4) || !au_append(nal, size)) {
+        au_size_ = start;
+        au_corrupt_ = true;
+    }
+}
+
+void RtpDepacketizer::begin_nal(uint8_t nal_header)
+{
+    uint8_t type = nal_header & 0x1F;
+    if (type == NAL_SPS) {
+        au_has_sps_ = true;
+    }
+    if (type != NAL_IDR) {
+        return;
+    }
+    au_keyframe_ = true;
+
+    // SDP parameter sets go in front of an IDR slice that came without them
+    if (!au_has_sps_ && !parameter_sets_.empty() &&
+        au_append(parameter_sets_.data(), parameter_sets_.size())) {
+        au_has_sps_ = true;
+    }
+}
+
+bool RtpDepacketizer::au_append(const uint8_t* data, size_t size)
+{
+    if (size == 0) {
+        return true;
+    }
+
+    if (au_size_ + size > au_capacity_) {
+        // Grow into a larger pool buffer; rare once the pool has seen a keyframe
+        size_t capacity = 0;
+        uint8_t* grown = pool_->acquire(std::max(au_size_ + size, au_capacity_ * 2), capacity);
+        if (!grown) {
+            return false;
+        }
+        if (au_size_ > 0) {
+            memcpy(grown, au_data_, au_size_);
+        }
+        pool_->release(au_data_);
+        au_data_ = grown;
+        au_capacity_ = capacity;
+    }
+
+    memcpy(au_data_ + au_size_, data, size);
+    au_size_ += size;
+    return true;
+}
+
+void RtpDepacketizer::discard_fragment()
+{
+    au_size_ = fragment_start_;
+    fragment_open_ = false;
+    au_corrupt_ = true;
+}
+
+void RtpDepacketizer::emit_access_unit()
+{
+    if (!au_open_) {
+        return;
+    }
+
+    if (fragment_open_) {
+        discard_fragment();
+    }
+
+    au_open_ = false;
+
+    if (au_size_ == 0) {
+        // Nothing survived; the loss carries over to the next access unit
+        loss_pending_ = loss_pending_ || au_corrupt_;
+        return;
+    }
+
+    // The buffer the access unit was assembled in is the frame's; the next
+    // one starts in another from the pool
+    VideoFrame frame = {};
+    frame.data = au_data_;
+    frame.size = au_size_;
+    frame.timestamp = au_timestamp_;
+    frame.pts = au_timestamp_;
+    frame.dts = au_timestamp_;
+    frame.is_keyframe = au_keyframe_;
+    frame.is_corrupt = au_corrupt_;
+
+    stats_.frames_completed++;
+    if (au_corrupt_) {
+        stats_.frames_corrupt++;
+    }
+
+    au_data_ = nullptr;
+    au_size_ = 0;
+    au_capacity_ = 0;
+    ready_.push_back(frame);
+}
+
+void RtpDepacketizer::set_parameter_sets(const std::vector<uint8_t>& annexb)
+{
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    parameter_sets_ = annexb;
+}
+
+void RtpDepacketizer::reset()
+{
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+
+    for (auto& slot : slots_) {
+        slot.used = false;
+    }
+    buffered_ = 0;
+    started_ = false;
+
+    au_size_ = 0;
+    au_open_ = false;
+    au_corrupt_ = false;
+    fragment_open_ = false;
+    loss_pending_ = false;
+
+    jitter_ = 0.0;
+    have_transit_ = false;
+
+    stats_ = {};
+}
+
+RtpStreamStats RtpDepacketizer::get_stats() const
+{
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    return stats_;
+}
+
+} // namespace berrystreamcam
@@ -0,0 +1,162 @@
+#pragma once
+
+#include "../common.hpp"
+#include "frame-pool.hpp"
+#include <memory>
+#include <vector>
+#include <mutex>
+#include <functional>
+
+namespace berrystreamcam {
+
+struct RtpHeader;
+
+/**
+ * Per-stream RTP reception statistics.
+ */
+struct RtpStreamStats {
+    uint32_t ssrc;
+    uint64_t packets_received;
+    uint64_t packets_lost;        // Gaps declared lost by the reorder buffer
+    uint64_t packets_reordered;   // Arrived out of order but in time
+    uint64_t packets_duplicate;
+    uint64_t packets_late;        // Arrived after their slot was declared lost
+    uint64_t frames_completed;
+    uint64_t frames_corrupt;      // Emitted with is_corrupt set
+    uint64_t nals_unsupported;    // STAP-B, MTAP and FU-B payloads
+    uint32_t base_sequence;       // First sequence number seen
+    uint32_t extended_highest_sequence;  // Highest sequence plus 16-bit wrap cycles
+    uint32_t jitter;              // RFC 3550 interarrival jitter, RTP timestamp units
+    double jitter_ms;
+};
+
+/**
+ * RFC 6184 H.264 depacketizer with a sequence-ordered reorder buffer.
+ *
+ * Packets are pushed in arrival order. They are released to the NAL
+ * assembler strictly in RTP sequence order; a gap is declared lost once
+ * the buffer holds more than reorder_depth packets past it or the oldest
+ * waiting packet exceeds max_delay_us. Single NAL units, STAP-A and FU-A
+ * are written straight into a FramePool buffer in Annex-B form, and that
+ * buffer becomes the frame's data: give it back with pool()->release()
+ * rather than delete[]. Access units touched by a loss are emitted with
+ * is_corrupt set.
+ * Frames are delivered through the callback on the pushing thread, once
+ * the internal lock is released.
+ *
+ * Not thread-safe except for get_stats(); feed it from one thread.
+ */
+class RtpDepacketizer {
+public:
+    using FrameCallback = std::function<void(VideoFrame&& frame)>;
+
+    static constexpr size_t DEFAULT_REORDER_DEPTH = 64;
+    static constexpr int64_t DEFAULT_MAX_DELAY_US = 20000;
+
+    explicit RtpDepacketizer(FrameCallback on_frame,
+                             size_t reorder_depth = DEFAULT_REORDER_DEPTH,
+                             int64_t max_delay_us = DEFAULT_MAX_DELAY_US,
+                             std::shared_ptr<FramePool> pool = nullptr);
+    ~RtpDepacketizer();
+
+    RtpDepacketizer(const RtpDepacketizer&) = delete;
+    RtpDepacketizer& operator=(const RtpDepacketizer&) = delete;
+
+    /**
+     * Push one RTP datagram.
+     * arrival_us is the CLOCK_REALTIME arrival time, as UdpBatchReceiver
+     * stamps it; 0 means "now".
+     */
+    void push_packet(const uint8_t* data, size_t size, int64_t arrival_us = 0);
+
+    static constexpr int CLOCK_RATE = 90000;
+
+    /**
+     * Release packets whose reorder deadline has passed.
+     * Call periodically when no packets arrive.
+     */
+    void poll(int64_t now_us = 0);
+
+    /**
+     * SPS/PPS from SDP sprop-parameter-sets, in Annex-B form.
+     * Inserted ahead of the IDR slice in access units that do not carry
+     * them in-band.
+     */
+    void set_parameter_sets(const std::vector<uint8_t>& annexb);
+
+    void reset();
+
+    RtpStreamStats get_stats() const;
+
+    /**
+     * Where emitted frame data comes from and goes back to.
+     */
+    std::shared_ptr<FramePool> pool() const { return pool_; }
+
+private:
+    struct Slot {
+        std::vector<uint8_t> data;
+        size_t size;
+        int64_t arrival_us;
+        uint16_t sequence;
+        bool used;
+    };
+
+    void process_packet(const RtpHeader& header, const uint8_t* data, size_t size, int64_t arrival_us);
+    void deliver(std::vector<VideoFrame>& frames);
+    void insert(uint16_t sequence, const uint8_t* data, size_t size, int64_t arrival_us);
+    void drain(int64_t now_us);
+    void release(const uint8_t* packet, size_t size);
+    void declare_lost();
+    void advance_highest(uint16_t sequence);
+
+    void depacketize(const uint8_t* payload, size_t size, uint32_t timestamp, bool marker);
+    void append_nal(const uint8_t* nal, size_t size);
+    void begin_nal(uint8_t nal_header);
+    bool au_append(const uint8_t* data, size_t size);
+    void emit_access_unit();
+    void discard_fragment();
+
+    void update_jitter(uint32_t rtp_timestamp, int64_t arrival_us);
+
+    static int64_t now_us();
+
+    FrameCallback on_frame_;
+    size_t reorder_depth_;
+    int64_t max_delay_us_;
+    std::shared_ptr<FramePool> pool_;
+
+    // Reorder ring, indexed by sequence & mask; slot storage is preallocated
+    std::vector<Slot> slots_;
+    uint16_t mask_;
+    uint16_t next_sequence_;
+    uint16_t highest_sequence_;
+    size_t buffered_;
+    bool started_;
+
+    // Access unit under assembly
+    uint8_t* au_data_;       // From pool_; handed out as the frame's data
+    size_t au_size_;
+    size_t au_capacity_;
+    uint32_t au_timestamp_;
+    bool au_open_;
+    bool au_keyframe_;
+    bool au_has_sps_;
+    bool au_corrupt_;
+    bool fragment_open_;
+    size_t fragment_start_;
+    bool loss_pending_;
+
+    std::vector<uint8_t> parameter_sets_;
+    std::vector<VideoFrame> ready_;   // Emitted under stats_mutex_, delivered after it
+
+    // Interarrival jitter state (RFC 3550 appendix A.8)
+    double jitter_;
+    uint32_t last_transit_;
+    bool have_transit_;
+
+    RtpStreamStats stats_;
+    mutable std::mutex stats_mutex_;
+};
+
+} // namespace berrystreamcam
@@ -0,0 +1,786 @@
+#include "rtsp-udp-handler.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <chrono>
+#include <regex>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <errno.h>
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+namespace berrystreamcam {
+
+namespace {
+
+constexpr int RTSP_IO_TIMEOUT_MS = 5000;
+constexpr int RTP_PORT_BASE = 50000;
+constexpr int RTP_PORT_ATTEMPTS = 500;
+constexpr size_t RTCP_MAX_DATAGRAM = 2048;
+
+// Well under RFC 3550's 5% bandwidth share at any video bitrate we carry
+constexpr int RTCP_REPORT_INTERVAL_MS = 1000;
+
+// Reorder-buffer flush and session upkeep, well inside the 20 ms reorder deadline
+constexpr int RTP_TICK_MS = 10;
+
+std::vector<uint8_t> decode_base64(const std::string& in)
+{
+    static const std::string alphabet =
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+    std::vector<uint8_t> out;
+    uint32_t accum = 0;
+    int bits = 0;
+
+    for (char c : in) {
+        size_t value = alphabet.find(c);
+        if (value == std::string::npos) {
+            continue;  // Skip padding and whitespace
+        }
+        accum = (accum << 6) | static_cast<uint32_t>(value);
+        bits += 6;
+        if (bits >= 8) {
+            bits -= 8;
+            out.push_back(static_cast<uint8_t>((accum >> bits) & 0xFF));
+        }
+    }
+
+    return out;
+}
+
+std::string header_value(const std::string& response, const char* name)
+{
+    std::string key = std::string("\r\n") + name + ":";
+    size_t pos = response.find(key);
+    if (pos == std::string::npos) {
+        return "";
+    }
+    pos += key.size();
+    while (pos < response.size() && response[pos] == ' ') {
+        pos++;
+    }
+    size_t end = response.find("\r\n", pos);
+    return response.substr(pos, end == std::string::npos ? std::string::npos : end - pos);
+}
+
+} // namespace
+
+RtspUdpHandler::RtspUdpHandler()
+    : port_(RTSP_PORT)
+    , cseq_(1)
+    , session_timeout_s_(60)
+    , rtsp_socket_(-1)
+    , rtp_socket_(-1)
+    , rtcp_socket_(-1)
+    , client_rtp_port_(0)
+    , server_rtcp_port_(0)
+    , server_addr_{}
+    , connected_(false)
+    , reactor_(NetworkReactor::acquire())
+    , rtp_watch_(0)
+    , rtcp_watch_(0)
+    , control_watch_(0)
+    , tick_timer_(0)
+    , keepalive_pending_(false)
+    , profile_(network_profile_from_name("balanced"))
+    , active_profile_(profile_)
+    , tuning_{}
+    , frame_pool_(std::make_shared<FramePool>())
+    , frame_queue_([this](uint8_t* data) { frame_pool_->release(data); })
+{
+    depacketizer_ = std::make_unique<RtpDepacketizer>([this](VideoFrame&& frame) {
+        frame_queue_.push(std::move(frame));
+    }, RtpDepacketizer::DEFAULT_REORDER_DEPTH, RtpDepacketizer::DEFAULT_MAX_DELAY_US, frame_pool_);
+    udp_receiver_ = std::make_unique<UdpBatchReceiver>();
+    rtcp_session_ = std::make_unique<RtcpSession>();
+
+    BLOG_DEBUG("RTSP/UDP handler created");
+}
+
+RtspUdpHandler::~RtspUdpHandler()
+{
+    disconnect();
+}
+
+bool RtspUdpHandler::connect(const std::string& url)
+{
+    std::lock_guard<std::mutex> lock(control_mutex_);
+
+    BLOG_INFO("Connecting to RTSP (UDP): %s", url.c_str());
+    url_ = url;
+    control_url_ = url;
+    session_id_.clear();
+    cseq_ = 1;
+    server_rtcp_port_ = 0;
+
+    // Parse RTSP URL (rtsp://ip[:port]/path)
+    std::regex url_regex(R"(rtsp://([^:/]+)(?::(\d+))?(/.*)?)");
+    std::smatch matches;
+    if (!std::regex_match(url, matches, url_regex)) {
+        BLOG_ERROR("Invalid RTSP URL format");
+        return false;
+    }
+
+    host_ = matches[1].str();
+    port_ = matches[2].matched ? std::stoi(matches[2].str()) : RTSP_PORT;
+    path_ = matches[3].matched ? matches[3].str() : "/";
+
+    if (!open_control_connection()) {
+        close_sockets();
+        return false;
+    }
+
+    if (!bind_media_sockets()) {
+        BLOG_ERROR("Failed to bind RTP/RTCP ports");
+        close_sockets();
+        return false;
+    }
+
+    {
+        std::lock_guard<std::mutex> tuning_lock(tuning_mutex_);
+
+        // Control channel: Nagle off, quick ACKs, DSCP
+        active_profile_ = profile_;
+        tuning_ = apply_network_profile(rtsp_socket_, active_profile_, true);
+
+        // Media: batch receiver sizes the buffer; the profile adds busy-poll and DSCP
+        NetworkProfile media_profile = active_profile_;
+        udp_receiver_->attach(rtp_socket_, std::max(active_profile_.rcvbuf_bytes,
+                                                    UdpBatchReceiver::DEFAULT_RCVBUF_BYTES));
+        media_profile.rcvbuf_bytes = 0;
+        SocketTuning media = apply_network_profile(rtp_socket_, media_profile, false);
+        apply_network_profile(rtcp_socket_, media_profile, false);
+
+        tuning_.rcvbuf_bytes = media.rcvbuf_bytes;
+        tuning_.busy_poll_us = media.busy_poll_us;
+    }
+
+    if (!send_options() || !send_describe() || !send_setup() || !send_play()) {
+        BLOG_ERROR("RTSP handshake failed");
+        close_sockets();
+        return false;
+    }
+
+    depacketizer_->reset();
+    rtcp_session_->reset();
+    frame_queue_.clear();
+
+    last_keepalive_ = std::chrono::steady_clock::now();
+    last_report_ = last_keepalive_;
+    keepalive_sent_ = last_keepalive_;
+    keepalive_pending_ = false;
+
+    connected_ = true;
+    rtp_watch_ = reactor_->add(rtp_socket_, [this]() { on_rtp_readable(); });
+    rtcp_watch_ = reactor_->add(rtcp_socket_, [this]() { on_rtcp_readable(); });
+    control_watch_ = reactor_->add(rtsp_socket_, [this]() { on_control_readable(); });
+    tick_timer_ = reactor_->add_timer(RTP_TICK_MS, [this]() { on_tick(); });
+
+    BLOG_INFO("RTSP session %s established (RTP port %d)",
+              session_id_.c_str(), client_rtp_port_);
+    return true;
+}
+
+void RtspUdpHandler::disconnect()
+{
+    // A connect() holding the lock gives up instead of running out its timeouts
+    connect_stop_.stop();
+    std::lock_guard<std::mutex> lock(control_mutex_);
+    connect_stop_.reset();
+
+    // No callback is running or will run once this returns
+    unwatch();
+
+    bool was_connected = connected_.exchange(false);
+    if (was_connected) {
+        BLOG_INFO("Disconnecting RTSP (UDP)");
+        send_teardown();
+
+        RtpStreamStats stats = depacketizer_->get_stats();
+        BLOG_INFO("RTP stats: %llu packets, %llu lost, %llu reordered, %llu frames (%llu corrupt), jitter %.2fms",
+                  static_cast<unsigned long long>(stats.packets_received),
+                  static_cast<unsigned long long>(stats.packets_lost),
+                  static_cast<unsigned long long>(stats.packets_reordered),
+                  static_cast<unsigned long long>(stats.frames_completed),
+                  static_cast<unsigned long long>(stats.frames_corrupt),
+                  stats.jitter_ms);
+
+        UdpReceiveStats rx = udp_receiver_->get_stats();
+        BLOG_INFO("UDP receive: %llu packets in %llu syscalls (max batch %u), %llu kernel drops",
+                  static_cast<unsigned long long>(rx.packets),
+                  static_cast<unsigned long long>(rx.syscalls),
+                  rx.max_batch,
+                  static_cast<unsigned long long>(rx.kernel_drops));
+
+        RtcpStats rtcp = rtcp_session_->get_stats();
+        BLOG_INFO("RTCP: %llu receiver reports sent, %llu sender reports received, "
+                  "cumulative loss %d, RTT %.1fms",
+                  static_cast<unsigned long long>(rtcp.receiver_reports),
+                  static_cast<unsigned long long>(rtcp.sender_reports),
+                  rtcp.cumulative_lost, rtcp.rtt_ms);
+    }
+
+    close_sockets();
+    frame_queue_.clear();
+}
+
+void RtspUdpHandler::interrupt()
+{
+    connect_stop_.stop();
+}
+
+bool RtspUdpHandler::is_connected() const
+{
+    return connected_;
+}
+
+bool RtspUdpHandler::receive_frame(VideoFrame& frame)
+{
+    if (!frame_queue_.pop(frame)) {
+        return false;
+    }
+
+    uint8_t* pooled = frame.data;
+    frame.data = new (std::nothrow) uint8_t[frame.size];
+    if (!frame.data) {
+        BLOG_ERROR("Failed to allocate memory for RTP frame (%zu bytes)", frame.size);
+        frame_pool_->release(pooled);
+        return false;
+    }
+    memcpy(frame.data, pooled, frame.size);
+    frame_pool_->release(pooled);
+    return true;
+}
+
+bool RtspUdpHandler::receive_shared(VideoFrame& frame, std::shared_ptr<uint8_t>& data)
+{
+    if (!frame_queue_.pop(frame)) {
+        return false;
+    }
+    data = frame_pool_->lend(frame.data);
+    return true;
+}
+
+RtpStreamStats RtspUdpHandler::get_stats() const
+{
+    return depacketizer_->get_stats();
+}
+
+UdpReceiveStats RtspUdpHandler::get_receive_stats() const
+{
+    return udp_receiver_->get_stats();
+}
+
+RtcpStats RtspUdpHandler::get_rtcp_stats() const
+{
+    return rtcp_session_->get_stats();
+}
+
+void RtspUdpHandler::set_network_profile(const NetworkProfile& profile)
+{
+    std::lock_guard<std::mutex> lock(tuning_mutex_);
+    profile_ = profile;
+}
+
+SocketTuning RtspUdpHandler::get_socket_tuning() const
+{
+    std::lock_guard<std::mutex> lock(tuning_mutex_);
+    return tuning_;
+}
+
+bool RtspUdpHandler::open_control_connection()
+{
+    addrinfo hints = {};
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* address = nullptr;
+    if (getaddrinfo(host_.c_str(), std::to_string(port_).c_str(), &hints, &address) != 0 || !address) {
+        BLOG_ERROR("Cannot resolve RTSP server %s", host_.c_str());
+        return false;
+    }
+
+    struct sockaddr_in server_addr;
+    memcpy(&server_addr, address->ai_addr, sizeof(server_addr));
+    freeaddrinfo(address);
+    {
+        // Receiver reports go to the same host
+        std::lock_guard<std::mutex> lock(io_mutex_);
+        server_addr_ = server_addr;
+    }
+
+    rtsp_socket_ = socket(AF_INET, SOCK_STREAM, 0);
+    if (rtsp_socket_ < 0) {
+        BLOG_ERROR("Failed to create RTSP socket");
+        return false;
+    }
+
+    // Non-blocking connect so an absent device cannot hang us for minutes
+    int flags = fcntl(rtsp_socket_, F_GETFL, 0);
+    fcntl(rtsp_socket_, F_SETFL, flags | O_NONBLOCK);
+
+    int ret = ::connect(rtsp_socket_, reinterpret_cast<struct sockaddr*>(&server_addr),
+                        sizeof(server_addr));
+    if (ret < 0 && errno != EINPROGRESS) {
+        BLOG_ERROR("Failed to connect to RTSP server: %s", strerror(errno));
+        return false;
+    }
+
+    if (ret < 0) {
+        int ready = connect_stop_.wait(rtsp_socket_, POLLOUT, RTSP_IO_TIMEOUT_MS);
+        if (ready <= 0) {
+            if (ready == 0) {
+                BLOG_ERROR("RTSP connection timeout");
+            }
+            return false;
+        }
+
+        int error = 0;
+        socklen_t len = sizeof(error);
+        getsockopt(rtsp_socket_, SOL_SOCKET, SO_ERROR, &error, &len);
+        if (error != 0) {
+            BLOG_ERROR("Failed to connect to RTSP server: %s", strerror(error));
+            return false;
+        }
+    }
+
+    fcntl(rtsp_socket_, F_SETFL, flags);
+
+    struct timeval tv;
+    tv.tv_sec = RTSP_IO_TIMEOUT_MS / 1000;
+    tv.tv_usec = 0;
+    setsockopt(rtsp_socket_, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(rtsp_socket_, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+    BLOG_INFO("Connected to RTSP server");
+    return true;
+}
+
+bool RtspUdpHandler::bind_media_sockets()
+{
+    // RTP needs an even port with RTCP on the next odd one (RFC 3550 section 11)
+    for (int attempt = 0; attempt < RTP_PORT_ATTEMPTS; attempt++) {
+        int rtp_port = RTP_PORT_BASE + attempt * 2;
+
+        int rtp = socket(AF_INET, SOCK_DGRAM, 0);
+        int rtcp = socket(AF_INET, SOCK_DGRAM, 0);
+        if (rtp < 0 || rtcp < 0) {
+            if (rtp >= 0) close(rtp);
+            if (rtcp >= 0) close(rtcp);
+            return false;
+        }
+
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_ANY);
+
+        addr.sin_port = htons(rtp_port);
+        bool ok = bind(rtp, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) == 0;
+        if (ok) {
+            addr.sin_port = htons(rtp_port + 1);
+            ok = bind(rtcp, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) == 0;
+        }
+
+        if (ok) {
+            rtp_socket_ = rtp;
+            rtcp_socket_ = rtcp;
+            client_rtp_port_ = rtp_port;
+            return true;
+        }
+
+        close(rtp);
+        close(rtcp);
+    }
+
+    return false;
+}
+
+bool RtspUdpHandler::send_request(const char* method, const std::string& uri,
+                                  const std::string& extra_headers, std::string& response)
+{
+    std::string request = std::string(method) + " " + uri + " RTSP/1.0\r\n" +
+                          "CSeq: " + std::to_string(cseq_++) + "\r\n" +
+                          "User-Agent: BerryStreamCam/1.0\r\n";
+    if (!session_id_.empty()) {
+        request += "Session: " + session_id_ + "\r\n";
+    }
+    request += extra_headers + "\r\n";
+
+    if (send(rtsp_socket_, request.data(), request.size(), MSG_NOSIGNAL) < 0) {
+        BLOG_ERROR("RTSP %s send failed: %s", method, strerror(errno));
+        return false;
+    }
+
+    // Read headers, then the body announced by Content-Length
+    response.clear();
+    char buffer[4096];
+    size_t header_end = std::string::npos;
+    size_t content_length = 0;
+
+    while (true) {
+        if (header_end == std::string::npos) {
+            header_end = response.find("\r\n\r\n");
+            if (header_end != std::string::npos) {
+                std::string length = header_value(response, "Content-Length");
+                content_length = length.empty() ? 0 : std::stoul(length);
+            }
+        }
+
+        if (header_end != std::string::npos &&
+            response.size() >= header_end + 4 + content_length) {
+            break;
+        }
+
+        // SO_RCVTIMEO alone would keep an interrupted connect() waiting it out
+        if (connect_stop_.wait(rtsp_socket_, POLLIN, RTSP_IO_TIMEOUT_MS) <= 0) {
+            BLOG_ERROR("RTSP %s: no response", method);
+            return false;
+        }
+        ssize_t received = recv(rtsp_socket_, buffer, sizeof(buffer), 0);
+        if (received <= 0) {
+            BLOG_ERROR("RTSP %s: no response", method);
+            return false;
+        }
+        rearm_quickack(rtsp_socket_, active_profile_);
+        response.append(buffer, received);
+    }
+
+    if (response.compare(0, 12, "RTSP/1.0 200") != 0) {
+        BLOG_ERROR("RTSP %s failed: %s", method,
+                   response.substr(0, response.find("\r\n")).c_str());
+        return false;
+    }
+
+    return true;
+}
+
+bool RtspUdpHandler::send_options()
+{
+    std::string response;
+    return send_request("OPTIONS", url_, "", response);
+}
+
+bool RtspUdpHandler::send_describe()
+{
+    std::string response;
+    if (!send_request("DESCRIBE", url_, "Accept: application/sdp\r\n", response)) {
+        return false;
+    }
+
+    size_t body = response.find("\r\n\r\n");
+    std::string content_base = header_value(response, "Content-Base");
+    parse_sdp(response.substr(body + 4), content_base);
+
+    BLOG_DEBUG("RTSP DESCRIBE completed, media control: %s", control_url_.c_str());
+    return true;
+}
+
+bool RtspUdpHandler::send_setup()
+{
+    std::string transport = "Transport: RTP/AVP;unicast;client_port=" +
+                            std::to_string(client_rtp_port_) + "-" +
+                            std::to_string(client_rtp_port_ + 1) + "\r\n";
+
+    std::string response;
+    if (!send_request("SETUP", control_url_, transport, response)) {
+        return false;
+    }
+
+    // Session: <id>[;timeout=<seconds>]
+    std::string session = header_value(response, "Session");
+    size_t semicolon = session.find(';');
+    session_id_ = session.substr(0, semicolon);
+    if (semicolon != std::string::npos) {
+        size_t timeout = session.find("timeout=", semicolon);
+        if (timeout != std::string::npos) {
+            session_timeout_s_ = std::max(10, atoi(session.c_str() + timeout + 8));
+        }
+    }
+
+    if (session_id_.empty()) {
+        BLOG_ERROR("RTSP SETUP response carries no session");
+        return false;
+    }
+
+    // Transport: ...;server_port=<rtp>-<rtcp>; RTCP goes to the odd port
+    std::string reply_transport = header_value(response, "Transport");
+    size_t server_port = reply_transport.find("server_port=");
+    int server_rtp_port = 0;
+    if (server_port != std::string::npos) {
+        const char* ports = reply_transport.c_str() + server_port + 12;
+        const char* dash = strchr(ports, '-');
+        server_rtp_port = atoi(ports);
+        server_rtcp_port_ = dash ? atoi(dash + 1) : server_rtp_port + 1;
+    }
+
+    BLOG_DEBUG("RTSP Session ID: %s (timeout %ds, server RTCP port %d)",
+               session_id_.c_str(), session_timeout_s_, server_rtcp_port_);
+    return connect_media_sockets(server_rtp_port);
+}
+
+bool RtspUdpHandler::connect_media_sockets(int server_rtp_port)
+{
+    // The media comes from the host we hold the control connection to
+    struct sockaddr_in addr;
+    socklen_t addr_len = sizeof(addr);
+    if (getpeername(rtsp_socket_, reinterpret_cast<struct sockaddr*>(&addr), &addr_len) < 0) {
+        BLOG_ERROR("Failed to get RTSP server address: %s", strerror(errno));
+        return false;
+    }
+
+    // Connected UDP sockets drop datagrams from anywhere else. Without a
+    // server_port the port stays 0, which the kernel treats as any port
+    // on that host; RTCP then learns it from the first report.
+    addr.sin_port = htons(server_rtp_port);
+    if (::connect(rtp_socket_, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) < 0) {
+        BLOG_ERROR("Failed to connect RTP socket: %s", strerror(errno));
+        return false;
+    }
+
+    addr.sin_port = htons(server_rtcp_port_);
+    if (::connect(rtcp_socket_, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) < 0) {
+        BLOG_ERROR("Failed to connect RTCP socket: %s", strerror(errno));
+        return false;
+    }
+
+    if (server_rtp_port == 0) {
+        BLOG_WARNING("RTSP server announced no server_port, accepting media from any port on it");
+    }
+    return true;
+}
+
+bool RtspUdpHandler::send_play()
+{
+    std::string response;
+    return send_request("PLAY", url_, "Range: npt=0.000-\r\n", response);
+}
+
+void RtspUdpHandler::send_teardown()
+{
+    if (rtsp_socket_ < 0 || session_id_.empty()) {
+        return;
+    }
+
+    // Best effort and not waited for; the server times the session out otherwise
+    std::string request = "TEARDOWN " + url_ + " RTSP/1.0\r\n"
+                          "CSeq: " + std::to_string(cseq_++) + "\r\n"
+                          "Session: " + session_id_ + "\r\n\r\n";
+    send(rtsp_socket_, request.data(), request.size(), MSG_NOSIGNAL | MSG_DONTWAIT);
+    session_id_.clear();
+}
+
+void RtspUdpHandler::parse_sdp(const std::string& sdp, const std::string& content_base)
+{
+    std::string base = content_base.empty() ? url_ : content_base;
+    bool in_video = false;
+
+    size_t pos = 0;
+    while (pos < sdp.size()) {
+        size_t end = sdp.find('\n', pos);
+        std::string line = sdp.substr(pos, end == std::string::npos ? std::string::npos : end - pos);
+        pos = end == std::string::npos ? sdp.size() : end + 1;
+
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+
+        if (line.compare(0, 2, "m=") == 0) {
+            in_video = line.compare(0, 8, "m=video ") == 0;
+            continue;
+        }
+
+        if (!in_video) {
+            continue;
+        }
+
+        if (line.compare(0, 10, "a=control:") == 0) {
+            std::string control = line.substr(10);
+            if (control == "*") {
+                control_url_ = base;
+            } else if (control.compare(0, 7, "rtsp://") == 0) {
+                control_url_ = control;
+            } else {
+                control_url_ = base + (base.back() == '/' ? "" : "/") + control;
+            }
+        } else if (line.compare(0, 7, "a=fmtp:") == 0) {
+            size_t sets = line.find("sprop-parameter-sets=");
+            if (sets == std::string::npos) {
+                continue;
+            }
+            sets += 21;
+            std::string value = line.substr(sets, line.find(';', sets) - sets);
+
+            // Comma-separated base64 NAL units; keep them in Annex-B form
+            std::vector<uint8_t> annexb;
+            size_t start = 0;
+            while (start <= value.size()) {
+                size_t comma = value.find(',', start);
+                std::vector<uint8_t> nal = decode_base64(
+                    value.substr(start, comma == std::string::npos ? std::string::npos : comma - start));
+                if (!nal.empty()) {
+                    const uint8_t start_code[4] = { 0x00, 0x00, 0x00, 0x01 };
+                    annexb.insert(annexb.end(), start_code, start_code + 4);
+                    annexb.insert(annexb.end(), nal.begin(), nal.end());
+                }
+                if (comma == std::string::npos) break;
+                start = comma + 1;
+            }
+
+            if (!annexb.empty()) {
+                depacketizer_->set_parameter_sets(annexb);
+                BLOG_DEBUG("SDP carries %zu bytes of SPS/PPS", annexb.size());
+            }
+        }
+    }
+}
+
+void RtspUdpHandler::on_rtp_readable()
+{
+    std::lock_guard<std::mutex> lock(io_mutex_);
+
+    // One recvmmsg() per batch; keep going while batches come back full
+    size_t count;
+    do {
+        count = udp_receiver_->receive();
+        for (size_t i = 0; i < count; i++) {
+            const UdpPacket& packet = udp_receiver_->packet(i);
+            depacketizer_->push_packet(packet.data, packet.size, packet.arrival_us);
+        }
+    } while (count == UdpBatchReceiver::DEFAULT_BATCH_SIZE);
+}
+
+void RtspUdpHandler::on_rtcp_readable()
+{
+    std::lock_guard<std::mutex> lock(io_mutex_);
+
+    uint8_t datagram[RTCP_MAX_DATAGRAM];
+    struct sockaddr_in from;
+    socklen_t from_len = sizeof(from);
+    ssize_t received;
+    while ((received = recvfrom(rtcp_socket_, datagram, sizeof(datagram), MSG_DONTWAIT,
+                                reinterpret_cast<struct sockaddr*>(&from), &from_len)) > 0) {
+        if (rtcp_session_->process_packet(datagram, received, UdpBatchReceiver::now_us()) &&
+            server_rtcp_port_ == 0) {
+            // Server omitted server_port; answer wherever its reports come from
+            server_rtcp_port_ = ntohs(from.sin_port);
+        }
+        from_len = sizeof(from);
+    }
+}
+
+void RtspUdpHandler::on_control_readable()
+{
+    std::lock_guard<std::mutex> lock(io_mutex_);
+
+    // Keep-alive replies; a closed control connection ends the session
+    uint8_t buffer[RTCP_MAX_DATAGRAM];
+    ssize_t received = recv(rtsp_socket_, buffer, sizeof(buffer), MSG_DONTWAIT);
+    if (received == 0) {
+        BLOG_WARNING("RTSP control connection closed by server");
+        connected_ = false;
+        reactor_->remove(control_watch_);   // A hangup would stay readable
+        return;
+    }
+    if (received > 0) {
+        rearm_quickack(rtsp_socket_, active_profile_);
+    }
+    if (received > 0 && keepalive_pending_) {
+        // Control channel round trip stands in until the camera answers XR
+        keepalive_pending_ = false;
+        std::chrono::duration<double, std::milli> rtt =
+            std::chrono::steady_clock::now() - keepalive_sent_;
+        rtcp_session_->set_fallback_rtt(rtt.count());
+    }
+}
+
+void RtspUdpHandler::on_tick()
+{
+    std::lock_guard<std::mutex> lock(io_mutex_);
+
+    depacketizer_->poll(UdpBatchReceiver::now_us());
+
+    if (!connected_) {
+        return;
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    if (now - last_report_ > std::chrono::milliseconds(RTCP_REPORT_INTERVAL_MS)) {
+        send_receiver_report();
+        last_report_ = now;
+    }
+
+    // Keep the session alive at half the server's timeout. disconnect() holds
+    // control_mutex_ while it waits for this callback, so never block on it.
+    if (now - last_keepalive_ > std::chrono::seconds(session_timeout_s_ / 2)) {
+        std::unique_lock<std::mutex> control_lock(control_mutex_, std::try_to_lock);
+        if (!control_lock.owns_lock()) {
+            return;
+        }
+        std::string request = "GET_PARAMETER " + url_ + " RTSP/1.0\r\n"
+                              "CSeq: " + std::to_string(cseq_++) + "\r\n"
+                              "Session: " + session_id_ + "\r\n\r\n";
+        send(rtsp_socket_, request.data(), request.size(), MSG_NOSIGNAL);
+        last_keepalive_ = now;
+        keepalive_sent_ = now;
+        keepalive_pending_ = true;
+    }
+}
+
+void RtspUdpHandler::unwatch()
+{
+    for (std::atomic<NetworkReactor::Id>* watch : { &rtp_watch_, &rtcp_watch_, &control_watch_, &tick_timer_ }) {
+        NetworkReactor::Id id = watch->exchange(0);
+        if (id != 0) {
+            reactor_->remove(id);
+        }
+    }
+}
+
+void RtspUdpHandler::send_receiver_report()
+{
+    if (server_rtcp_port_ <= 0) {
+        return;
+    }
+
+    uint8_t report[RtcpSession::MAX_REPORT_SIZE];
+    size_t length = rtcp_session_->build_receiver_report(
+        depacketizer_->get_stats(), UdpBatchReceiver::now_us(), report, sizeof(report));
+    if (length == 0) {
+        return;
+    }
+
+    struct sockaddr_in addr = server_addr_;
+    addr.sin_port = htons(server_rtcp_port_);
+    sendto(rtcp_socket_, report, length, 0, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr));
+}
+
+void RtspUdpHandler::close_sockets()
+{
+    if (rtsp_socket_ >= 0) {
+        close(rtsp_socket_);
+        rtsp_socket_ = -1;
+    }
+
+    if (rtp_socket_ >= 0) {
+        close(rtp_socket_);
+        rtp_socket_ = -1;
+    }
+
+    if (rtcp_socket_ >= 0) {
+        close(rtcp_socket_);
+        rtcp_socket_ = -1;
+    }
+}
+
+} // namespace berrystreamcam
@@ -0,0 +1,138 @@
+#pragma once
+
+#include "../common.hpp"
+#include "frame-queue.hpp"
+#include "rtp-depacketizer.hpp"
+#include "rtcp-session.hpp"
+#include "udp-batch-receiver.hpp"
+#include "socket-tuning.hpp"
+#include "network-reactor.hpp"
+#include "../discovery/stop-signal.hpp"
+#include <chrono>
+#include <string>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <netinet/in.h>
+
+namespace berrystreamcam {
+
+/**
+ * Native RTSP client with RTP over UDP.
+ *
+ * The RTSP control session runs over TCP; media arrives on a bound
+ * RTP/RTCP port pair, is pulled in batches by UdpBatchReceiver and is
+ * depacketized by RtpDepacketizer. The sockets are watched by the shared
+ * NetworkReactor instead of a thread per handler, and a reactor timer
+ * flushes the reorder buffer and exchanges RTCP with the camera through
+ * RtcpSession. This avoids the TCP interleaving used by the FFmpeg-based
+ * RtspHandler, so a lost packet costs one frame instead of stalling the
+ * stream.
+ */
+class RtspUdpHandler {
+public:
+    RtspUdpHandler();
+    ~RtspUdpHandler();
+
+    bool connect(const std::string& url);
+    void disconnect();
+    bool is_connected() const;
+
+    /**
+     * Make connect() give up; never blocks. Cleared by disconnect().
+     */
+    void interrupt();
+
+    /**
+     * Caller owns frame.data (delete[]); costs a copy out of the pool.
+     */
+    bool receive_frame(VideoFrame& frame);
+
+    /**
+     * Hands out the depacketizer's buffer itself; it goes back to the
+     * pool once the last reference is dropped.
+     */
+    bool receive_shared(VideoFrame& frame, std::shared_ptr<uint8_t>& data);
+
+    /**
+     * Socket options for the next connect(). TCP options go on the RTSP
+     * control connection; the RTP socket gets at least the default
+     * batch receive buffer whatever the profile asks for.
+     */
+    void set_network_profile(const NetworkProfile& profile);
+    SocketTuning get_socket_tuning() const;
+
+    RtpStreamStats get_stats() const;
+    UdpReceiveStats get_receive_stats() const;
+    RtcpStats get_rtcp_stats() const;
+
+private:
+    bool open_control_connection();
+    bool bind_media_sockets();
+    bool send_request(const char* method, const std::string& uri,
+                      const std::string& extra_headers, std::string& response);
+
+    bool send_options();
+    bool send_describe();
+    bool send_setup();
+    bool connect_media_sockets(int server_rtp_port);
+    bool send_play();
+    void send_teardown();
+    void parse_sdp(const std::string& sdp, const std::string& content_base);
+
+    // Reactor callbacks, serialized by io_mutex_
+    void on_rtp_readable();
+    void on_rtcp_readable();
+    void on_control_readable();
+    void on_tick();
+    void unwatch();
+
+    void send_receiver_report();
+    void close_sockets();
+
+    std::string url_;
+    std::string host_;
+    std::string path_;
+    std::string control_url_;
+    std::string session_id_;
+    int port_;
+    int cseq_;
+    int session_timeout_s_;
+
+    int rtsp_socket_;
+    int rtp_socket_;
+    int rtcp_socket_;
+    int client_rtp_port_;
+    int server_rtcp_port_;
+    struct sockaddr_in server_addr_;  // Resolved host_ (io_mutex_ once the session runs)
+
+    std::atomic<bool> connected_;
+    std::mutex control_mutex_;
+    StopSignal connect_stop_;         // Wakes connect()'s waits, see interrupt()
+
+    std::shared_ptr<NetworkReactor> reactor_;
+    std::atomic<NetworkReactor::Id> rtp_watch_;
+    std::atomic<NetworkReactor::Id> rtcp_watch_;
+    std::atomic<NetworkReactor::Id> control_watch_;   // Its callback also removes it on hangup
+    std::atomic<NetworkReactor::Id> tick_timer_;
+    std::mutex io_mutex_;             // One callback at a time; they share the state below
+
+    // Session upkeep, reactor callbacks only
+    std::chrono::steady_clock::time_point last_keepalive_;
+    std::chrono::steady_clock::time_point last_report_;
+    std::chrono::steady_clock::time_point keepalive_sent_;
+    bool keepalive_pending_;
+
+    NetworkProfile profile_;          // Next connect (guarded by tuning_mutex_)
+    NetworkProfile active_profile_;   // Current connection (connect and reactor callbacks only)
+    SocketTuning tuning_;
+    mutable std::mutex tuning_mutex_;
+
+    std::shared_ptr<FramePool> frame_pool_;
+    FrameQueue frame_queue_;          // Holds frame_pool_ buffers
+    std::unique_ptr<RtpDepacketizer> depacketizer_;
+    std::unique_ptr<UdpBatchReceiver> udp_receiver_;
+    std::unique_ptr<RtcpSession> rtcp_session_;
+};
+
+} // namespace berrystreamcam
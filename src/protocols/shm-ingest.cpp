@@ -0,0 +1,351 @@
+#include "shm-ingest.hpp"
+#include "fd-handoff.hpp"
+#include <cstring>
+#include <set>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <errno.h>
+
+namespace berrystreamcam {
+
+namespace {
+
+constexpr const char* SOCKET_PREFIX = "berrystreamcam-ingest/";
+constexpr const char* URL_SCHEME = "shm://";
+constexpr int HANDSHAKE_TIMEOUT_MS = 1000;
+
+} // namespace
+
+/**
+ * Which slots frames handed out still hold. The oldest of them, or the
+ * cursor if there is none, is what the producer may write up to.
+ */
+struct ShmIngestTransport::Leases {
+    std::shared_ptr<ShmRing> ring;     // Also keeps the mapping alive for frames
+    std::mutex mutex;
+    std::set<uint64_t> held;
+    uint64_t next;                     // The cursor; skipped slots before it are free
+    bool detached;                     // Another connection owns the releases now
+
+    void release_free()
+    {
+        if (!detached) {
+            ring->release(held.empty() ? next : *held.begin());
+        }
+    }
+};
+
+std::unique_ptr<ShmIngestProducer> ShmIngestProducer::create(const std::string& name, uint32_t slot_count,
+                                                             uint32_t slot_size)
+{
+#ifdef __linux__
+    int fd = listen_abstract(SOCKET_PREFIX + name);
+    if (fd < 0) {
+        BLOG_WARNING("Failed to listen for shared memory ingest %s: %s", name.c_str(), strerror(errno));
+        return nullptr;
+    }
+
+    std::unique_ptr<ShmRing> ring = ShmRing::create(SOCKET_PREFIX + name, slot_count, slot_size, true);
+    if (!ring) {
+        close(fd);
+        return nullptr;
+    }
+
+    std::unique_ptr<ShmIngestProducer> producer(new ShmIngestProducer(name, fd, std::move(ring)));
+    producer->listen_watch_ = producer->reactor_->add(fd, [raw = producer.get()]() { raw->on_accept(); });
+    if (producer->listen_watch_ == 0) {
+        return nullptr;
+    }
+
+    BLOG_INFO("Shared memory ingest %s waiting for a consumer", name.c_str());
+    return producer;
+#else
+    BLOG_WARNING("Shared memory ingest is not supported on this platform (%s)", name.c_str());
+    (void)slot_count;
+    (void)slot_size;
+    return nullptr;
+#endif
+}
+
+ShmIngestProducer::ShmIngestProducer(const std::string& name, int listen_fd, std::unique_ptr<ShmRing> ring)
+    : name_(name)
+    , listen_fd_(listen_fd)
+    , ring_(std::move(ring))
+    , reactor_(NetworkReactor::acquire())
+    , listen_watch_(0)
+    , consumer_fd_(-1)
+    , consumer_watch_(0)
+{
+}
+
+ShmIngestProducer::~ShmIngestProducer()
+{
+    ring_->close();
+
+    if (listen_watch_ != 0) {
+        reactor_->remove(listen_watch_);
+    }
+    close(listen_fd_);
+
+    // Removed outside the lock, since a running callback wants it
+    int consumer = -1;
+    NetworkReactor::Id watch = 0;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::swap(consumer, consumer_fd_);
+        std::swap(watch, consumer_watch_);
+    }
+    if (watch != 0) {
+        reactor_->remove(watch);
+    }
+    if (consumer >= 0) {
+        close(consumer);
+    }
+}
+
+uint8_t* ShmIngestProducer::reserve(size_t size, bool keyframe)
+{
+    return ring_->reserve(size, keyframe);
+}
+
+void ShmIngestProducer::commit(const VideoFrame& frame)
+{
+    ring_->commit(frame);
+}
+
+bool ShmIngestProducer::write(const VideoFrame& frame)
+{
+    return ring_->write(frame);
+}
+
+bool ShmIngestProducer::has_consumer() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return consumer_fd_ >= 0;
+}
+
+ShmIngestStats ShmIngestProducer::stats() const
+{
+    ShmRingStats ring = ring_->stats();
+
+    ShmIngestStats stats = {};
+    stats.frames = ring.frames;
+    stats.bytes = ring.bytes;
+    stats.dropped = ring.dropped;
+    return stats;
+}
+
+void ShmIngestProducer::on_accept()
+{
+#ifdef __linux__
+    for (;;) {
+        int fd = accept4(listen_fd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                BLOG_WARNING("Shared memory ingest accept failed: %s", strerror(errno));
+            }
+            return;
+        }
+
+        // The ring has room for one reader's releases
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (consumer_fd_ >= 0 || !peer_is_same_user(fd) || !send_fd(fd, ring_->fd())) {
+            close(fd);
+            continue;
+        }
+
+        consumer_watch_ = reactor_->add(fd, [this]() { on_consumer(); });
+        if (consumer_watch_ == 0) {
+            close(fd);
+            continue;
+        }
+        consumer_fd_ = fd;
+        BLOG_INFO("Consumer attached to shared memory ingest %s", name_.c_str());
+    }
+#endif
+}
+
+void ShmIngestProducer::on_consumer()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (consumer_fd_ < 0) {
+        return;   // The destructor has it
+    }
+
+    char buffer[64];
+    for (;;) {
+        ssize_t received = recv(consumer_fd_, buffer, sizeof(buffer), MSG_DONTWAIT);
+        if (received > 0) {
+            continue;   // Consumers have nothing to say
+        }
+        if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+            return;
+        }
+        break;
+    }
+
+    reactor_->remove(consumer_watch_);
+    close(consumer_fd_);
+    consumer_fd_ = -1;
+    consumer_watch_ = 0;
+    BLOG_INFO("Consumer detached from shared memory ingest %s", name_.c_str());
+}
+
+ShmIngestTransport::ShmIngestTransport()
+    : socket_(-1)
+    , cursor_{}
+    , bytes_(0)
+{
+}
+
+ShmIngestTransport::~ShmIngestTransport()
+{
+    disconnect();
+}
+
+ProtocolType ShmIngestTransport::protocol() const
+{
+    return ProtocolType::SHM_INGEST;
+}
+
+bool ShmIngestTransport::connect(const std::string& url)
+{
+    std::string name = url.compare(0, strlen(URL_SCHEME), URL_SCHEME) == 0 ? url.substr(strlen(URL_SCHEME)) : url;
+
+    int fd = connect_abstract(SOCKET_PREFIX + name);
+    if (fd < 0) {
+        BLOG_DEBUG("No shared memory producer named %s", name.c_str());
+        return false;
+    }
+
+    std::unique_ptr<ShmRing> ring = ShmRing::attach(receive_fd(fd, HANDSHAKE_TIMEOUT_MS));
+    if (!ring || !ring->acknowledged()) {
+        BLOG_WARNING("Shared memory producer %s did not hand over an ingest ring", name.c_str());
+        close(fd);
+        return false;
+    }
+
+    auto leases = std::make_shared<Leases>();
+    leases->ring = std::move(ring);
+    leases->next = 0;
+    leases->detached = false;
+
+    disconnect();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    socket_ = fd;
+    bytes_ = 0;
+
+    // Whatever an earlier consumer held is free again
+    cursor_ = leases->ring->start_at_keyframe();
+    leases->next = cursor_.next;
+    leases->release_free();
+    leases_ = std::move(leases);
+
+    BLOG_INFO("Attached to shared memory producer %s", name.c_str());
+    return true;
+}
+
+void ShmIngestTransport::disconnect()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (leases_) {
+        BLOG_INFO("Detaching from shared memory producer (%llu frames, %llu overruns)",
+                  static_cast<unsigned long long>(cursor_.frames),
+                  static_cast<unsigned long long>(cursor_.overruns));
+
+        // Frames still out keep the mapping, but no longer move the producer on
+        std::lock_guard<std::mutex> leases_lock(leases_->mutex);
+        leases_->detached = true;
+    }
+    leases_.reset();
+    if (socket_ >= 0) {
+        close(socket_);
+        socket_ = -1;
+    }
+}
+
+bool ShmIngestTransport::is_connected() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return leases_ && !leases_->ring->closed();
+}
+
+bool ShmIngestTransport::take(VideoFrame& frame, uint64_t& sequence)
+{
+    const ShmRing& ring = *leases_->ring;
+
+    // Sleep on the ring briefly rather than leave a new frame to the next poll
+    bool received = ring.acquire(cursor_, frame, sequence);
+    if (!received && !ring.closed() && ring.wait(cursor_, RECEIVE_WAIT_MS)) {
+        received = ring.acquire(cursor_, frame, sequence);
+    }
+
+    std::lock_guard<std::mutex> lock(leases_->mutex);
+    if (received) {
+        leases_->held.insert(sequence);
+        bytes_ += frame.size;
+    }
+    leases_->next = cursor_.next;
+    leases_->release_free();
+    return received;
+}
+
+bool ShmIngestTransport::receive_frame(VideoFrame& frame)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    VideoFrame view = {};
+    uint64_t sequence = 0;
+    if (!leases_ || !take(view, sequence)) {
+        return false;
+    }
+
+    frame = view;
+    frame.data = new uint8_t[view.size];
+    memcpy(frame.data, view.data, view.size);
+
+    std::lock_guard<std::mutex> leases_lock(leases_->mutex);
+    leases_->held.erase(sequence);
+    leases_->release_free();
+    return true;
+}
+
+bool ShmIngestTransport::receive_shared(VideoFrame& frame, std::shared_ptr<uint8_t>& data)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    VideoFrame view = {};
+    uint64_t sequence = 0;
+    if (!leases_ || !take(view, sequence)) {
+        return false;
+    }
+
+    // Dropping the last reference hands the slot back
+    std::shared_ptr<Leases> leases = leases_;
+    data = std::shared_ptr<uint8_t>(view.data, [leases, sequence](uint8_t*) {
+        std::lock_guard<std::mutex> lock(leases->mutex);
+        leases->held.erase(sequence);
+        leases->release_free();
+    });
+    frame = view;
+    return true;
+}
+
+ShmIngestStats ShmIngestTransport::stats() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    ShmIngestStats stats = {};
+    stats.frames = cursor_.frames;
+    stats.bytes = bytes_;
+    if (leases_) {
+        std::lock_guard<std::mutex> leases_lock(leases_->mutex);
+        stats.in_flight = leases_->held.size();
+        stats.dropped = leases_->ring->stats().dropped;
+    }
+    return stats;
+}
+
+} // namespace berrystreamcam
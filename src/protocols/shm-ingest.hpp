@@ -0,0 +1,106 @@
+#pragma once
+
+#include "../common.hpp"
+#include "network-reactor.hpp"
+#include "shm-ring.hpp"
+#include "transport.hpp"
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace berrystreamcam {
+
+struct ShmIngestStats {
+    uint64_t frames;          // Written, or received by this transport
+    uint64_t bytes;
+    uint64_t dropped;         // Frames the producer found no free slot for
+    uint64_t in_flight;       // Slots this transport's frames still hold
+};
+
+/**
+ * Producer side of shared-memory ingest, for tools on this host that make
+ * the stream themselves, like the desktop capture companion or an emulator
+ * under test, so they need not go through a loopback WebSocket.
+ *
+ * Listens on the abstract Unix socket "berrystreamcam-ingest/<name>" and
+ * hands an acknowledged ShmRing to whoever connects, if it runs as the
+ * same user; one consumer at a time. Frames are encoded straight into the
+ * ring with reserve() and commit(), or copied in with write(). While the
+ * consumer holds every slot, frames are dropped up to the next keyframe.
+ */
+class ShmIngestProducer {
+public:
+    static std::unique_ptr<ShmIngestProducer> create(const std::string& name,
+                                                     uint32_t slot_count = ShmRing::DEFAULT_SLOT_COUNT,
+                                                     uint32_t slot_size = ShmRing::DEFAULT_SLOT_SIZE);
+
+    ~ShmIngestProducer();
+
+    ShmIngestProducer(const ShmIngestProducer&) = delete;
+    ShmIngestProducer& operator=(const ShmIngestProducer&) = delete;
+
+    /**
+     * See ShmRing::reserve() and commit(). Only one thread may write.
+     */
+    uint8_t* reserve(size_t size, bool keyframe);
+    void commit(const VideoFrame& frame);
+    bool write(const VideoFrame& frame);
+
+    bool has_consumer() const;
+    ShmIngestStats stats() const;
+
+private:
+    ShmIngestProducer(const std::string& name, int listen_fd, std::unique_ptr<ShmRing> ring);
+
+    void on_accept();
+    void on_consumer();
+
+    std::string name_;
+    int listen_fd_;
+    std::unique_ptr<ShmRing> ring_;
+    std::shared_ptr<NetworkReactor> reactor_;
+    NetworkReactor::Id listen_watch_;
+
+    mutable std::mutex mutex_;
+    int consumer_fd_;
+    NetworkReactor::Id consumer_watch_;
+};
+
+/**
+ * Reads what a ShmIngestProducer writes; the URL is "shm://<name>".
+ *
+ * receive_shared() hands out frames that point into the ring, so the
+ * decoder reads the bytes the producer wrote. Each slot goes back to the
+ * producer once the last reference to its frame is dropped; in between
+ * the producer writes around it. receive_frame() copies, for the race.
+ */
+class ShmIngestTransport : public Transport {
+public:
+    // How long a receive sleeps on the ring for the next frame
+    static constexpr int RECEIVE_WAIT_MS = 1;
+
+    ShmIngestTransport();
+    ~ShmIngestTransport() override;
+
+    ProtocolType protocol() const override;
+    bool connect(const std::string& url) override;
+    void disconnect() override;
+    bool is_connected() const override;
+    bool receive_frame(VideoFrame& frame) override;
+    bool receive_shared(VideoFrame& frame, std::shared_ptr<uint8_t>& data) override;
+
+    ShmIngestStats stats() const;
+
+private:
+    struct Leases;
+
+    bool take(VideoFrame& frame, uint64_t& sequence);
+
+    mutable std::mutex mutex_;
+    int socket_;                        // Held open so the producer knows we are here
+    std::shared_ptr<Leases> leases_;    // The ring, shared with the frames handed out
+    ShmCursor cursor_;
+    uint64_t bytes_;
+};
+
+} // namespace berrystreamcam
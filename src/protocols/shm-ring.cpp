@@ -0,0 +1,542 @@
+#include "shm-ring.hpp"
+#include <chrono>
+#include <climits>
+#include <cstring>
+#include <thread>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <errno.h>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+namespace berrystreamcam {
+
+namespace {
+
+constexpr uint32_t RING_MAGIC = 0x42534d52;   // "BSMR"
+constexpr uint32_t RING_VERSION = 1;
+constexpr size_t HEADER_SIZE = 128;
+constexpr size_t SLOT_HEADER_SIZE = 64;
+constexpr uint32_t MAX_SLOT_COUNT = 4096;
+constexpr uint32_t MAX_SLOT_SIZE = 64 * 1024 * 1024;
+
+constexpr uint32_t SLOT_KEYFRAME = 1;
+constexpr uint32_t SLOT_CORRUPT = 2;
+constexpr uint32_t SLOT_GAP = 4;       // A frame was lost here; wait for a keyframe
+
+constexpr uint32_t RING_ACKNOWLEDGED = 1;   // The writer waits for release(), see acquire()
+
+size_t round_up(size_t value, size_t alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+size_t ring_size(uint32_t slot_count, size_t slot_stride)
+{
+    return HEADER_SIZE + static_cast<size_t>(slot_count) * slot_stride;
+}
+
+#ifdef __linux__
+// Not FUTEX_PRIVATE: the word is shared with other processes
+void futex_wait(std::atomic<uint32_t>* word, uint32_t expected, int timeout_ms)
+{
+    struct timespec timeout;
+    timeout.tv_sec = timeout_ms / 1000;
+    timeout.tv_nsec = static_cast<long>(timeout_ms % 1000) * 1000000;
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAIT, expected, &timeout, nullptr, 0);
+}
+
+void futex_wake_all(std::atomic<uint32_t>* word)
+{
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+}
+#endif
+
+} // namespace
+
+// Both live in the shared file, so only fixed-size fields and lock-free atomics
+struct ShmRing::Header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t slot_count;
+    uint32_t slot_size;
+    uint64_t slot_stride;
+    std::atomic<uint32_t> futex;       // Bumped after every frame
+    std::atomic<uint32_t> waiters;     // Readers asleep on futex
+    std::atomic<uint32_t> closed;
+    uint32_t flags;
+    std::atomic<uint64_t> written;     // Frames written so far
+    std::atomic<uint64_t> keyframe;    // Newest intact keyframe + 1, 0 before the first
+    std::atomic<uint64_t> bytes;
+    std::atomic<uint64_t> oversized;
+    std::atomic<uint64_t> released;    // Acknowledged rings: slots before this are free again
+    std::atomic<uint64_t> dropped;     // Acknowledged rings: frames with no free slot
+};
+
+struct ShmRing::Slot {
+    std::atomic<uint64_t> lock;        // 2n+1 while frame n is written, 2n+2 once complete
+    uint32_t size;
+    uint32_t flags;
+    int64_t timestamp;
+    int64_t pts;
+    int64_t dts;
+    int32_t width;
+    int32_t height;
+};
+
+std::unique_ptr<ShmRing> ShmRing::create(const std::string& name, uint32_t slot_count, uint32_t slot_size,
+                                         bool acknowledged)
+{
+    static_assert(std::atomic<uint64_t>::is_always_lock_free, "ring atomics must be address-free");
+    static_assert(sizeof(Header) <= HEADER_SIZE, "ring header outgrew its space");
+    static_assert(sizeof(Slot) <= SLOT_HEADER_SIZE, "slot header outgrew its space");
+
+    if (slot_count == 0 || slot_count > MAX_SLOT_COUNT || slot_size == 0 || slot_size > MAX_SLOT_SIZE) {
+        BLOG_ERROR("Invalid shared memory ring geometry %u x %u", slot_count, slot_size);
+        return nullptr;
+    }
+
+#ifdef __linux__
+    int fd = memfd_create(name.c_str(), MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fd < 0) {
+        BLOG_ERROR("Failed to create shared memory for %s: %s", name.c_str(), strerror(errno));
+        return nullptr;
+    }
+
+    size_t stride = SLOT_HEADER_SIZE + round_up(slot_size, 64);
+    size_t size = ring_size(slot_count, stride);
+
+    // Sealed at its size, so a reader can never have the mapping shrink under it
+    if (ftruncate(fd, static_cast<off_t>(size)) != 0 ||
+        fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) != 0) {
+        BLOG_ERROR("Failed to size shared memory for %s: %s", name.c_str(), strerror(errno));
+        ::close(fd);
+        return nullptr;
+    }
+
+    void* base = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) {
+        BLOG_ERROR("Failed to map shared memory for %s: %s", name.c_str(), strerror(errno));
+        ::close(fd);
+        return nullptr;
+    }
+
+    // A fresh file is zeroed, which is what every counter starts at
+    Header* header = static_cast<Header*>(base);
+    header->version = RING_VERSION;
+    header->slot_count = slot_count;
+    header->slot_size = slot_size;
+    header->slot_stride = stride;
+    header->flags = acknowledged ? RING_ACKNOWLEDGED : 0;
+    header->magic = RING_MAGIC;
+
+    return std::unique_ptr<ShmRing>(new ShmRing(fd, static_cast<uint8_t*>(base), size));
+#else
+    BLOG_WARNING("Shared memory rings are not supported on this platform (%s)", name.c_str());
+    return nullptr;
+#endif
+}
+
+std::unique_ptr<ShmRing> ShmRing::attach(int fd)
+{
+#ifdef __linux__
+    struct stat info;
+    if (fd < 0 || fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) < HEADER_SIZE) {
+        BLOG_WARNING("Shared memory ring is missing or too small");
+        if (fd >= 0) {
+            ::close(fd);
+        }
+        return nullptr;
+    }
+
+    // An unsealed file could be truncated by its owner while we read it
+    int seals = fcntl(fd, F_GET_SEALS);
+    if (seals < 0 || !(seals & F_SEAL_SHRINK)) {
+        BLOG_WARNING("Shared memory ring is not sealed against shrinking");
+        ::close(fd);
+        return nullptr;
+    }
+
+    size_t size = static_cast<size_t>(info.st_size);
+    void* base = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) {
+        BLOG_WARNING("Failed to map shared memory ring: %s", strerror(errno));
+        ::close(fd);
+        return nullptr;
+    }
+
+    const Header* header = static_cast<const Header*>(base);
+    bool valid = header->magic == RING_MAGIC && header->version == RING_VERSION &&
+                 header->slot_count > 0 && header->slot_count <= MAX_SLOT_COUNT &&
+                 header->slot_size > 0 && header->slot_size <= MAX_SLOT_SIZE &&
+                 header->slot_stride == SLOT_HEADER_SIZE + round_up(header->slot_size, 64) &&
+                 ring_size(header->slot_count, header->slot_stride) <= size;
+    if (!valid) {
+        BLOG_WARNING("Shared memory file does not hold a frame ring");
+        munmap(base, size);
+        ::close(fd);
+        return nullptr;
+    }
+
+    return std::unique_ptr<ShmRing>(new ShmRing(fd, static_cast<uint8_t*>(base), size));
+#else
+    if (fd >= 0) {
+        ::close(fd);
+    }
+    return nullptr;
+#endif
+}
+
+ShmRing::ShmRing(int fd, uint8_t* base, size_t mapped_size)
+    : fd_(fd)
+    , base_(base)
+    , mapped_size_(mapped_size)
+    , header_(reinterpret_cast<Header*>(base))
+    , slot_count_(header_->slot_count)
+    , slot_size_(header_->slot_size)
+    , slot_stride_(header_->slot_stride)
+    , acknowledged_((header_->flags & RING_ACKNOWLEDGED) != 0)
+    , reserved_(false)
+    , writer_need_keyframe_(false)
+{
+}
+
+ShmRing::~ShmRing()
+{
+#ifdef __linux__
+    munmap(base_, mapped_size_);
+#endif
+    ::close(fd_);
+}
+
+int ShmRing::fd() const
+{
+    return fd_;
+}
+
+uint32_t ShmRing::slot_count() const
+{
+    return slot_count_;
+}
+
+uint32_t ShmRing::slot_size() const
+{
+    return slot_size_;
+}
+
+bool ShmRing::acknowledged() const
+{
+    return acknowledged_;
+}
+
+ShmRing::Slot* ShmRing::slot_at(uint64_t sequence) const
+{
+    return reinterpret_cast<Slot*>(base_ + HEADER_SIZE + (sequence % slot_count_) * slot_stride_);
+}
+
+ShmRing::Slot* ShmRing::begin_slot(bool keyframe, uint64_t& sequence)
+{
+    sequence = header_->written.load(std::memory_order_relaxed);
+
+    // Never overwrite what the reader of an acknowledged ring still holds.
+    // A frame with nowhere to go is dropped, and so is everything after it
+    // up to the next keyframe, so the reader never sees a broken chain.
+    if (acknowledged_) {
+        uint64_t released = header_->released.load(std::memory_order_acquire);
+        bool full = released <= sequence && sequence - released >= slot_count_;
+        if (full || (writer_need_keyframe_ && !keyframe)) {
+            writer_need_keyframe_ = true;
+            header_->dropped.fetch_add(1, std::memory_order_relaxed);
+            return nullptr;
+        }
+        writer_need_keyframe_ = false;
+    }
+
+    Slot* slot = slot_at(sequence);
+    slot->lock.store(sequence * 2 + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    return slot;
+}
+
+void ShmRing::end_slot(Slot* slot, uint64_t sequence, const VideoFrame& frame, bool fits)
+{
+    slot->size = fits ? static_cast<uint32_t>(frame.size) : 0;
+    slot->flags = fits ? 0 : SLOT_GAP;
+    if (frame.is_keyframe) {
+        slot->flags |= SLOT_KEYFRAME;
+    }
+    if (frame.is_corrupt) {
+        slot->flags |= SLOT_CORRUPT;
+    }
+    slot->timestamp = frame.timestamp;
+    slot->pts = frame.pts;
+    slot->dts = frame.dts;
+    slot->width = frame.width;
+    slot->height = frame.height;
+
+    slot->lock.store(sequence * 2 + 2, std::memory_order_release);
+
+    if (fits) {
+        header_->bytes.fetch_add(frame.size, std::memory_order_relaxed);
+        if (frame.is_keyframe && !frame.is_corrupt) {
+            header_->keyframe.store(sequence + 1, std::memory_order_release);
+        }
+    } else {
+        header_->oversized.fetch_add(1, std::memory_order_relaxed);
+        BLOG_WARNING("Frame of %zu bytes does not fit a %u byte ring slot", frame.size, slot_size_);
+    }
+
+    // Sequentially consistent with the waiter count, so a reader either sees
+    // the new frame before sleeping or is counted and woken
+    header_->written.store(sequence + 1);
+    header_->futex.fetch_add(1);
+#ifdef __linux__
+    if (header_->waiters.load() > 0) {
+        futex_wake_all(&header_->futex);
+    }
+#endif
+}
+
+bool ShmRing::write(const VideoFrame& frame)
+{
+    std::lock_guard<std::mutex> lock(write_mutex_);
+
+    uint64_t sequence = 0;
+    Slot* slot = reserved_ ? nullptr : begin_slot(frame.is_keyframe, sequence);
+    if (!slot) {
+        return false;
+    }
+
+    bool fits = frame.size <= slot_size_;
+    if (fits && frame.size > 0) {
+        memcpy(reinterpret_cast<uint8_t*>(slot) + SLOT_HEADER_SIZE, frame.data, frame.size);
+    }
+    end_slot(slot, sequence, frame, fits);
+    return fits;
+}
+
+uint8_t* ShmRing::reserve(size_t size, bool keyframe)
+{
+    std::lock_guard<std::mutex> lock(write_mutex_);
+
+    if (reserved_ || size > slot_size_) {
+        return nullptr;
+    }
+    uint64_t sequence = 0;
+    Slot* slot = begin_slot(keyframe, sequence);
+    if (!slot) {
+        return nullptr;
+    }
+    reserved_ = true;
+    return reinterpret_cast<uint8_t*>(slot) + SLOT_HEADER_SIZE;
+}
+
+void ShmRing::commit(const VideoFrame& frame)
+{
+    std::lock_guard<std::mutex> lock(write_mutex_);
+
+    if (!reserved_) {
+        return;
+    }
+    reserved_ = false;
+
+    // reserve() checked the size it was given; a larger one here would claim bytes never written
+    uint64_t sequence = header_->written.load(std::memory_order_relaxed);
+    end_slot(slot_at(sequence), sequence, frame, frame.size <= slot_size_);
+}
+
+void ShmRing::close()
+{
+    header_->closed.store(1);
+    header_->futex.fetch_add(1);
+#ifdef __linux__
+    futex_wake_all(&header_->futex);
+#endif
+}
+
+bool ShmRing::closed() const
+{
+    return header_->closed.load() != 0;
+}
+
+ShmRingStats ShmRing::stats() const
+{
+    ShmRingStats stats = {};
+    stats.frames = header_->written.load(std::memory_order_relaxed);
+    stats.bytes = header_->bytes.load(std::memory_order_relaxed);
+    stats.oversized = header_->oversized.load(std::memory_order_relaxed);
+    stats.dropped = header_->dropped.load(std::memory_order_relaxed);
+    return stats;
+}
+
+ShmCursor ShmRing::start_at_keyframe() const
+{
+    ShmCursor cursor = {};
+    cursor.next = header_->written.load(std::memory_order_acquire);
+    cursor.need_keyframe = true;
+
+    // Still in the ring unless the writer has lapped it
+    uint64_t keyframe = header_->keyframe.load(std::memory_order_acquire);
+    if (keyframe > 0 && cursor.next - (keyframe - 1) < slot_count_) {
+        cursor.next = keyframe - 1;
+    }
+    return cursor;
+}
+
+void ShmRing::resync(ShmCursor& cursor, uint64_t written) const
+{
+    cursor.overruns++;
+    cursor.need_keyframe = true;
+
+    // Jump forward to the newest keyframe if it is still there, else wait for the next one
+    uint64_t keyframe = header_->keyframe.load(std::memory_order_acquire);
+    if (keyframe > 0 && keyframe - 1 > cursor.next && written - (keyframe - 1) < slot_count_) {
+        cursor.next = keyframe - 1;
+    } else {
+        cursor.next = written;
+    }
+}
+
+bool ShmRing::read(ShmCursor& cursor, VideoFrame& frame) const
+{
+    for (;;) {
+        uint64_t written = header_->written.load(std::memory_order_acquire);
+        if (cursor.next >= written) {
+            return false;
+        }
+
+        // The oldest slot may already be taking the next frame
+        if (written - cursor.next >= slot_count_) {
+            resync(cursor, written);
+            continue;
+        }
+
+        Slot* slot = slot_at(cursor.next);
+        uint64_t expected = cursor.next * 2 + 2;
+        if (slot->lock.load(std::memory_order_acquire) != expected) {
+            resync(cursor, header_->written.load(std::memory_order_acquire));
+            continue;
+        }
+
+        uint32_t size = slot->size;
+        uint32_t flags = slot->flags;
+        VideoFrame copy = {};
+        copy.timestamp = slot->timestamp;
+        copy.pts = slot->pts;
+        copy.dts = slot->dts;
+        copy.width = slot->width;
+        copy.height = slot->height;
+        copy.is_keyframe = (flags & SLOT_KEYFRAME) != 0;
+        copy.is_corrupt = (flags & SLOT_CORRUPT) != 0;
+
+        // Inter frames are useless until the keyframe they depend on
+        bool wanted = !(flags & SLOT_GAP) && (!cursor.need_keyframe || copy.is_keyframe);
+        if (wanted && size > 0 && size <= slot_size_) {
+            copy.data = new uint8_t[size];
+            copy.size = size;
+            memcpy(copy.data, reinterpret_cast<const uint8_t*>(slot) + SLOT_HEADER_SIZE, size);
+        }
+
+        // Overwritten while we copied: what we have is torn
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot->lock.load(std::memory_order_relaxed) != expected) {
+            delete[] copy.data;
+            resync(cursor, header_->written.load(std::memory_order_acquire));
+            continue;
+        }
+
+        cursor.next++;
+        if (flags & SLOT_GAP) {
+            cursor.need_keyframe = true;
+            continue;
+        }
+        if (!wanted || !copy.data) {
+            continue;
+        }
+
+        cursor.need_keyframe = false;
+        cursor.frames++;
+        frame = copy;
+        return true;
+    }
+}
+
+bool ShmRing::acquire(ShmCursor& cursor, VideoFrame& frame, uint64_t& sequence) const
+{
+    if (!acknowledged_) {
+        return false;
+    }
+
+    for (;;) {
+        uint64_t written = header_->written.load(std::memory_order_acquire);
+        if (cursor.next >= written) {
+            return false;
+        }
+
+        // The writer stops a full ring short of the oldest slot not released,
+        // so only a reader releasing what it still reads ends up here
+        Slot* slot = slot_at(cursor.next);
+        if (written - cursor.next > slot_count_ ||
+            slot->lock.load(std::memory_order_acquire) != cursor.next * 2 + 2) {
+            resync(cursor, written);
+            continue;
+        }
+
+        uint32_t size = slot->size;
+        uint32_t flags = slot->flags;
+        sequence = cursor.next++;
+
+        if (flags & SLOT_GAP) {
+            cursor.need_keyframe = true;
+            continue;
+        }
+        bool keyframe = (flags & SLOT_KEYFRAME) != 0;
+        if ((cursor.need_keyframe && !keyframe) || size == 0 || size > slot_size_) {
+            continue;
+        }
+
+        VideoFrame view = {};
+        view.data = reinterpret_cast<uint8_t*>(slot) + SLOT_HEADER_SIZE;
+        view.size = size;
+        view.timestamp = slot->timestamp;
+        view.pts = slot->pts;
+        view.dts = slot->dts;
+        view.width = slot->width;
+        view.height = slot->height;
+        view.is_keyframe = keyframe;
+        view.is_corrupt = (flags & SLOT_CORRUPT) != 0;
+
+        cursor.need_keyframe = false;
+        cursor.frames++;
+        frame = view;
+        return true;
+    }
+}
+
+void ShmRing::release(uint64_t sequence) const
+{
+    header_->released.store(sequence, std::memory_order_release);
+}
+
+bool ShmRing::wait(const ShmCursor& cursor, int timeout_ms) const
+{
+#ifdef __linux__
+    header_->waiters.fetch_add(1);
+    uint32_t word = header_->futex.load();
+    bool ready = header_->written.load() > cursor.next || header_->closed.load() != 0;
+    if (!ready) {
+        futex_wait(&header_->futex, word, timeout_ms);
+    }
+    header_->waiters.fetch_sub(1);
+#else
+    std::this_thread::sleep_for(std::chrono::milliseconds(timeout_ms));
+#endif
+    return header_->written.load(std::memory_order_acquire) > cursor.next;
+}
+
+} // namespace berrystreamcam
@@ -0,0 +1,166 @@
+#pragma once
+
+#include "../common.hpp"
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace berrystreamcam {
+
+/**
+ * Where a reader is in a ShmRing. After falling behind the writer it skips
+ * ahead and drops inter frames until the next keyframe.
+ */
+struct ShmCursor {
+    uint64_t next;            // Sequence number of the next frame to read
+    bool need_keyframe;
+    uint64_t frames;          // Frames read
+    uint64_t overruns;        // Times the writer lapped this reader
+};
+
+struct ShmRingStats {
+    uint64_t frames;          // Frames written
+    uint64_t bytes;
+    uint64_t oversized;       // Frames too large for a slot, written as a gap
+    uint64_t dropped;         // Acknowledged rings: frames the reader left no slot for
+};
+
+/**
+ * Single-writer, many-reader ring of compressed frames in a shared memory
+ * file (memfd on Linux), so processes on the same host can pass a stream
+ * around without sockets in between.
+ *
+ * The file holds a header followed by fixed-size slots; frame n lives in
+ * slot n % slot_count. Each slot carries a sequence lock, so a reader
+ * never blocks the writer and notices when the slot it copied from was
+ * overwritten meanwhile. Readers sleep on a futex in the header that the
+ * writer bumps with every frame; the wake-up syscall is only made while
+ * someone is waiting.
+ *
+ * Slots are touched only as frames are written, so an idle ring costs
+ * address space rather than memory.
+ *
+ * An acknowledged ring has a single reader that reads frames in place
+ * with acquire() and hands slots back with release(); the writer never
+ * overwrites a slot not yet released, and drops frames instead. Neither
+ * side makes a syscall per frame while frames keep coming.
+ */
+class ShmRing {
+public:
+    static constexpr uint32_t DEFAULT_SLOT_COUNT = 64;
+    static constexpr uint32_t DEFAULT_SLOT_SIZE = 1024 * 1024;
+
+    /**
+     * A new, empty ring; name only labels the file. nullptr on failure or
+     * where shared memory files are not supported.
+     */
+    static std::unique_ptr<ShmRing> create(const std::string& name,
+                                           uint32_t slot_count = DEFAULT_SLOT_COUNT,
+                                           uint32_t slot_size = DEFAULT_SLOT_SIZE,
+                                           bool acknowledged = false);
+
+    /**
+     * Map a ring another process created. Takes ownership of fd; nullptr
+     * if it does not hold a ring.
+     */
+    static std::unique_ptr<ShmRing> attach(int fd);
+
+    ~ShmRing();
+
+    ShmRing(const ShmRing&) = delete;
+    ShmRing& operator=(const ShmRing&) = delete;
+
+    /**
+     * The file behind the ring, to hand to another process. Stays owned
+     * by the ring.
+     */
+    int fd() const;
+
+    uint32_t slot_count() const;
+    uint32_t slot_size() const;
+    bool acknowledged() const;
+
+    /**
+     * Writer side. Copies frame into the next slot and wakes waiting
+     * readers. A frame larger than a slot is replaced by a gap, which
+     * sends readers on to the next keyframe; returns false then.
+     */
+    bool write(const VideoFrame& frame);
+
+    /**
+     * Writer side, in place: the next slot's payload, to fill with up to
+     * size bytes before commit(). nullptr if size exceeds a slot, or on an
+     * acknowledged ring while the reader holds every slot or since then no
+     * keyframe has come.
+     */
+    uint8_t* reserve(size_t size, bool keyframe);
+
+    /**
+     * Publish the frame reserve() made room for; frame.data is not used.
+     */
+    void commit(const VideoFrame& frame);
+
+    /**
+     * Tell readers no more frames will come.
+     */
+    void close();
+    bool closed() const;
+
+    ShmRingStats stats() const;
+
+    /**
+     * A cursor at the newest keyframe still in the ring, or at the next
+     * frame to be written, waiting for a keyframe, if there is none.
+     */
+    ShmCursor start_at_keyframe() const;
+
+    /**
+     * Next frame for cursor, if one is ready. On success the caller owns
+     * frame.data.
+     */
+    bool read(ShmCursor& cursor, VideoFrame& frame) const;
+
+    /**
+     * Acknowledged rings: the next frame for cursor without copying it.
+     * frame.data points into the ring and stays valid until release() is
+     * called with a sequence past the one returned.
+     */
+    bool acquire(ShmCursor& cursor, VideoFrame& frame, uint64_t& sequence) const;
+
+    /**
+     * Acknowledged rings: hand every slot before sequence back to the writer.
+     */
+    void release(uint64_t sequence) const;
+
+    /**
+     * Sleep until a frame past cursor is written, the ring is closed or
+     * timeout_ms passes. True if a frame may be ready.
+     */
+    bool wait(const ShmCursor& cursor, int timeout_ms) const;
+
+private:
+    struct Header;
+    struct Slot;
+
+    ShmRing(int fd, uint8_t* base, size_t mapped_size);
+
+    Slot* slot_at(uint64_t sequence) const;
+    Slot* begin_slot(bool keyframe, uint64_t& sequence);
+    void end_slot(Slot* slot, uint64_t sequence, const VideoFrame& frame, bool fits);
+    void resync(ShmCursor& cursor, uint64_t written) const;
+
+    int fd_;
+    uint8_t* base_;
+    size_t mapped_size_;
+    Header* header_;
+    uint32_t slot_count_;      // Copied once validated; the file is writable by others
+    uint32_t slot_size_;
+    size_t slot_stride_;
+    bool acknowledged_;
+    std::mutex write_mutex_;   // One writer per ring, also within a process
+    bool reserved_;            // Between reserve() and commit()
+    bool writer_need_keyframe_;
+};
+
+} // namespace berrystreamcam
@@ -0,0 +1,151 @@
+#include "socket-tuning.hpp"
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+typedef int socklen_t;
+#else
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/ip.h>
+#include <netinet/tcp.h>
+#endif
+
+namespace berrystreamcam {
+
+namespace {
+
+bool set_int(int fd, int level, int option, int value)
+{
+    return setsockopt(fd, level, option, reinterpret_cast<const char*>(&value), sizeof(value)) == 0;
+}
+
+int get_int(int fd, int level, int option, int fallback)
+{
+    int value = 0;
+    socklen_t len = sizeof(value);
+    if (getsockopt(fd, level, option, reinterpret_cast<char*>(&value), &len) != 0) {
+        return fallback;
+    }
+    return value;
+}
+
+} // namespace
+
+NetworkProfile network_profile_from_name(const std::string& name)
+{
+    NetworkProfile profile = {};
+
+    if (name == "default") {
+        return profile;  // Leave every socket as the OS created it
+    }
+
+    profile.tcp_nodelay = true;
+    profile.tcp_quickack = true;
+
+    if (name == "low_latency") {
+        profile.rcvbuf_bytes = 2 * 1024 * 1024;
+        profile.busy_poll_us = 50;
+        profile.dscp = 34;
+    } else if (name == "congested_wifi") {
+        // Room for several keyframes stalled behind a retransmission
+        profile.rcvbuf_bytes = 16 * 1024 * 1024;
+        profile.dscp = 34;
+    } else {
+        profile.rcvbuf_bytes = 4 * 1024 * 1024;
+    }
+
+    return profile;
+}
+
+SocketTuning requested_tuning(const NetworkProfile& profile)
+{
+    SocketTuning tuning = {};
+    tuning.applied = true;
+    tuning.verified = false;
+    tuning.tcp_nodelay = profile.tcp_nodelay;
+    tuning.tcp_quickack = profile.tcp_quickack;
+    tuning.rcvbuf_bytes = profile.rcvbuf_bytes;
+    tuning.busy_poll_us = profile.busy_poll_us;
+    tuning.dscp = profile.dscp;
+    return tuning;
+}
+
+SocketTuning apply_network_profile(int fd, const NetworkProfile& profile, bool is_tcp)
+{
+    SocketTuning tuning = {};
+    if (fd < 0) {
+        return tuning;
+    }
+
+    if (profile.rcvbuf_bytes > 0) {
+        // SO_RCVBUFFORCE ignores rmem_max but needs CAP_NET_ADMIN
+        bool forced = false;
+#ifdef SO_RCVBUFFORCE
+        forced = set_int(fd, SOL_SOCKET, SO_RCVBUFFORCE, profile.rcvbuf_bytes);
+#endif
+        if (!forced) {
+            set_int(fd, SOL_SOCKET, SO_RCVBUF, profile.rcvbuf_bytes);
+        }
+    }
+
+    if (is_tcp && profile.tcp_nodelay) {
+        set_int(fd, IPPROTO_TCP, TCP_NODELAY, 1);
+    }
+
+#ifdef TCP_QUICKACK
+    if (is_tcp && profile.tcp_quickack) {
+        set_int(fd, IPPROTO_TCP, TCP_QUICKACK, 1);
+    }
+#endif
+
+#ifdef SO_BUSY_POLL
+    if (profile.busy_poll_us > 0 && !set_int(fd, SOL_SOCKET, SO_BUSY_POLL, profile.busy_poll_us)) {
+        BLOG_DEBUG("SO_BUSY_POLL rejected (needs CAP_NET_ADMIN above net.core.busy_read)");
+    }
+#endif
+
+    if (profile.dscp > 0) {
+        set_int(fd, IPPROTO_IP, IP_TOS, profile.dscp << 2);
+    }
+
+    // Read back what the kernel actually granted
+    tuning.applied = true;
+    tuning.verified = true;
+    tuning.rcvbuf_bytes = get_int(fd, SOL_SOCKET, SO_RCVBUF, 0);
+#ifdef __linux__
+    tuning.rcvbuf_bytes /= 2;  // Linux reports double to account for bookkeeping
+#endif
+    if (is_tcp) {
+        tuning.tcp_nodelay = get_int(fd, IPPROTO_TCP, TCP_NODELAY, 0) != 0;
+#ifdef TCP_QUICKACK
+        tuning.tcp_quickack = get_int(fd, IPPROTO_TCP, TCP_QUICKACK, 0) != 0;
+#endif
+    }
+#ifdef SO_BUSY_POLL
+    tuning.busy_poll_us = get_int(fd, SOL_SOCKET, SO_BUSY_POLL, 0);
+#endif
+    tuning.dscp = get_int(fd, IPPROTO_IP, IP_TOS, 0) >> 2;
+
+    if (profile.rcvbuf_bytes > 0 && tuning.rcvbuf_bytes < profile.rcvbuf_bytes) {
+        BLOG_WARNING("Receive buffer limited to %d bytes (requested %d); "
+                     "raise net.core.rmem_max to avoid keyframe drops",
+                     tuning.rcvbuf_bytes, profile.rcvbuf_bytes);
+    }
+
+    return tuning;
+}
+
+void rearm_quickack(int fd, const NetworkProfile& profile)
+{
+#ifdef TCP_QUICKACK
+    if (fd >= 0 && profile.tcp_quickack) {
+        set_int(fd, IPPROTO_TCP, TCP_QUICKACK, 1);
+    }
+#else
+    (void)fd;
+    (void)profile;
+#endif
+}
+
+} // namespace berrystreamcam
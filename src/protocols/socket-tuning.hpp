@@ -0,0 +1,60 @@
+#pragma once
+
+#include "../common.hpp"
+#include <string>
+
+namespace berrystreamcam {
+
+/**
+ * Per-source socket options, applied the same way by every transport.
+ *
+ * DSCP only marks what we send (ACKs, RTCP, requests); it lets a WMM
+ * access point put our upstream in the video queue. The camera has to
+ * mark its own media for the downstream direction.
+ */
+struct NetworkProfile {
+    bool tcp_nodelay;        // Disable Nagle on control and request channels
+    bool tcp_quickack;       // Ack immediately instead of delayed ACK (Linux)
+    int rcvbuf_bytes;        // 0 keeps the kernel default
+    int busy_poll_us;        // SO_BUSY_POLL; 0 disables (Linux, may need CAP_NET_ADMIN)
+    int dscp;                // 0 leaves the TOS byte alone; 34 = AF41 (video)
+};
+
+/**
+ * Values read back from the socket after tuning, or the requested ones
+ * when the transport does not expose its socket (verified == false).
+ */
+struct SocketTuning {
+    bool applied;
+    bool verified;
+    bool tcp_nodelay;
+    bool tcp_quickack;
+    int rcvbuf_bytes;
+    int busy_poll_us;
+    int dscp;
+};
+
+/**
+ * Named presets offered in the source properties:
+ * "default", "balanced", "low_latency" and "congested_wifi".
+ */
+NetworkProfile network_profile_from_name(const std::string& name);
+
+/**
+ * Apply profile to a connected or bound socket and read back what the
+ * kernel accepted. is_tcp selects whether TCP-level options are set.
+ */
+SocketTuning apply_network_profile(int fd, const NetworkProfile& profile, bool is_tcp);
+
+/**
+ * Re-arm TCP_QUICKACK; Linux clears it after a few segments, so
+ * callers that own their receive loop call this after each read.
+ */
+void rearm_quickack(int fd, const NetworkProfile& profile);
+
+/**
+ * What a transport reports when it could only request the options.
+ */
+SocketTuning requested_tuning(const NetworkProfile& profile);
+
+} // namespace berrystreamcam
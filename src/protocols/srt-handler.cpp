@@ -0,0 +1,580 @@
+#include "srt-handler.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <regex>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+
+#ifdef HAVE_LIBSRT
+#include <srt/srt.h>
+#endif
+
+namespace berrystreamcam {
+
+namespace {
+
+constexpr int RECEIVE_TIMEOUT_MS = 100;     // How often the receive thread looks at running_
+constexpr size_t MESSAGE_SIZE = 1500;       // Above the largest live-mode payload (1456)
+constexpr size_t MIN_PASSPHRASE = 10;
+constexpr size_t MAX_PASSPHRASE = 79;
+
+std::string percent_decode(const std::string& text)
+{
+    std::string decoded;
+    for (size_t i = 0; i < text.size(); i++) {
+        if (text[i] == '%' && i + 2 < text.size() && isxdigit(static_cast<unsigned char>(text[i + 1])) &&
+            isxdigit(static_cast<unsigned char>(text[i + 2]))) {
+            decoded += static_cast<char>(strtol(text.substr(i + 1, 2).c_str(), nullptr, 16));
+            i += 2;
+        } else {
+            decoded += text[i];
+        }
+    }
+    return decoded;
+}
+
+#ifdef HAVE_LIBSRT
+template <typename T>
+bool set_flag(SRTSOCKET socket, SRT_SOCKOPT option, T value)
+{
+    return srt_setsockflag(socket, option, &value, sizeof(value)) != SRT_ERROR;
+}
+
+bool set_flag(SRTSOCKET socket, SRT_SOCKOPT option, const std::string& value)
+{
+    return srt_setsockflag(socket, option, value.c_str(), static_cast<int>(value.size())) != SRT_ERROR;
+}
+
+template <typename T>
+T get_flag(SRTSOCKET socket, SRT_SOCKOPT option, T fallback)
+{
+    T value = fallback;
+    int size = sizeof(value);
+    if (srt_getsockflag(socket, option, &value, &size) == SRT_ERROR) {
+        return fallback;
+    }
+    return value;
+}
+
+/**
+ * Wait for events on socket, or for stop. 1 when the socket is ready, 0
+ * on timeout, -1 when stopped or libsrt fails.
+ */
+int wait_ready(SRTSOCKET socket, int events, const StopSignal& stop, int timeout_ms)
+{
+    if (stop.stopped()) {
+        return -1;
+    }
+    int epoll = srt_epoll_create();
+    if (epoll < 0) {
+        return -1;
+    }
+
+    int stop_events = SRT_EPOLL_IN;
+    int result = -1;
+    if (srt_epoll_add_usock(epoll, socket, &events) != SRT_ERROR &&
+        (stop.fd() < 0 || srt_epoll_add_ssock(epoll, stop.fd(), &stop_events) != SRT_ERROR)) {
+        SRTSOCKET readable[1];
+        SRTSOCKET writable[1];
+        SYSSOCKET woken[1];
+        int readable_count = 1;
+        int writable_count = 1;
+        int woken_count = 1;
+        int ready = srt_epoll_wait(epoll, readable, &readable_count, writable, &writable_count, timeout_ms,
+                                   woken, &woken_count, nullptr, nullptr);
+        if (stop.stopped()) {
+            result = -1;
+        } else if (ready > 0) {
+            result = 1;
+        } else if (srt_getlasterror(nullptr) == SRT_ETIMEOUT) {
+            result = 0;
+        }
+    }
+    srt_epoll_release(epoll);
+    return result;
+}
+#endif
+
+} // namespace
+
+SrtHandler::SrtHandler()
+    : connected_(false)
+    , running_(false)
+    , latency_ms_(DEFAULT_LATENCY_MS)
+    , profile_(network_profile_from_name("balanced"))
+    , tuning_{}
+    , settings_version_(0)
+    , listener_(-1)
+    , listener_version_(0)
+    , socket_(-1)
+    , demuxer_([this](VideoFrame&& frame) { frame_queue_.push(std::move(frame)); })
+    , stats_socket_(-1)
+    , agreed_latency_ms_(0)
+    , encrypted_(false)
+    , retransmitted_(0)
+    , demux_stats_{}
+{
+    BLOG_DEBUG("SRT handler created");
+}
+
+SrtHandler::~SrtHandler()
+{
+    disconnect();
+    stop_listening();
+}
+
+void SrtHandler::set_latency_ms(int latency_ms)
+{
+    std::lock_guard<std::mutex> lock(settings_mutex_);
+    latency_ms = std::clamp(latency_ms, MIN_LATENCY_MS, MAX_LATENCY_MS);
+    if (latency_ms != latency_ms_) {
+        latency_ms_ = latency_ms;
+        settings_version_++;
+    }
+}
+
+void SrtHandler::set_passphrase(const std::string& passphrase)
+{
+    std::lock_guard<std::mutex> lock(settings_mutex_);
+    if (passphrase != passphrase_) {
+        passphrase_ = passphrase;
+        settings_version_++;
+    }
+}
+
+void SrtHandler::set_network_profile(const NetworkProfile& profile)
+{
+    std::lock_guard<std::mutex> lock(settings_mutex_);
+    // Only these two reach libsrt's socket
+    if (profile.rcvbuf_bytes != profile_.rcvbuf_bytes || profile.dscp != profile_.dscp) {
+        settings_version_++;
+    }
+    profile_ = profile;
+}
+
+bool SrtHandler::connect(const std::string& url)
+{
+    std::lock_guard<std::mutex> lock(control_mutex_);
+
+    std::regex url_regex(R"((?:srt://)?([^:/?]*):(\d+)/?(?:\?(.*))?)");
+    std::smatch matches;
+    if (!std::regex_match(url, matches, url_regex)) {
+        BLOG_ERROR("Invalid SRT URL (srt://host:port): %s", url.c_str());
+        return false;
+    }
+    std::string host = matches[1].str();
+    std::string port = matches[2].str();
+
+    bool listener = false;
+    std::string stream_id;
+    std::string query = matches[3].str();
+    size_t start = 0;
+    while (start < query.size()) {
+        size_t end = query.find('&', start);
+        std::string pair = query.substr(start, end == std::string::npos ? std::string::npos : end - start);
+        start = end == std::string::npos ? query.size() : end + 1;
+
+        size_t equals = pair.find('=');
+        std::string key = pair.substr(0, equals);
+        std::string value = equals == std::string::npos ? "" : percent_decode(pair.substr(equals + 1));
+        if (key == "mode" && value == "listener") {
+            listener = true;
+        } else if (key == "mode" && value != "caller") {
+            BLOG_ERROR("SRT mode %s is not supported; use caller or listener", value.c_str());
+            return false;
+        } else if (key == "streamid") {
+            stream_id = value;
+        }
+    }
+    if (!listener && host.empty()) {
+        BLOG_ERROR("SRT URL has no host to call: %s", url.c_str());
+        return false;
+    }
+
+    {
+        std::lock_guard<std::mutex> settings_lock(settings_mutex_);
+        if (!passphrase_.empty() &&
+            (passphrase_.size() < MIN_PASSPHRASE || passphrase_.size() > MAX_PASSPHRASE)) {
+            BLOG_ERROR("SRT passphrase must be %zu to %zu characters", MIN_PASSPHRASE, MAX_PASSPHRASE);
+            return false;
+        }
+    }
+
+#ifdef HAVE_LIBSRT
+    srt_startup();
+
+    int socket = listener ? open_listener(host, port) : open_caller(host, port, stream_id);
+    if (socket < 0) {
+        srt_cleanup();
+        return false;
+    }
+
+    bool encrypted = get_flag<int>(socket, SRTO_RCVKMSTATE, SRT_KM_S_UNSECURED) == SRT_KM_S_SECURED;
+    bool want_encryption = false;
+    {
+        std::lock_guard<std::mutex> settings_lock(settings_mutex_);
+        want_encryption = !passphrase_.empty();
+    }
+    if (want_encryption && !encrypted) {
+        BLOG_ERROR("SRT sender at %s:%s is not encrypted with our passphrase", host.c_str(), port.c_str());
+        srt_close(socket);
+        srt_cleanup();
+        return false;
+    }
+    int latency = get_flag<int>(socket, SRTO_RCVLATENCY, 0);
+
+    // A session already running ends here; the new one is up
+    close_session();
+
+    demuxer_.reset();
+    frame_queue_.clear();
+    {
+        std::lock_guard<std::mutex> stats_lock(stats_mutex_);
+        stats_socket_ = socket;
+        agreed_latency_ms_ = latency;
+        encrypted_ = encrypted;
+        retransmitted_ = 0;
+        demux_stats_ = {};
+    }
+    socket_ = socket;
+    running_ = true;
+    connected_ = true;
+    receive_thread_ = std::thread(&SrtHandler::receive_loop, this);
+
+    BLOG_INFO("SRT session with %s:%s: %d ms latency, %s", host.empty() ? "*" : host.c_str(), port.c_str(),
+              latency, encrypted ? "encrypted" : "unencrypted");
+    return true;
+#else
+    BLOG_WARNING("Cannot open %s: built without libsrt", url.c_str());
+    (void)stream_id;
+    return false;
+#endif
+}
+
+bool SrtHandler::configure(int socket, const std::string& stream_id)
+{
+#ifdef HAVE_LIBSRT
+    std::lock_guard<std::mutex> lock(settings_mutex_);
+
+    bool ok = set_flag(socket, SRTO_TRANSTYPE, SRTT_LIVE);
+    ok = ok && set_flag(socket, SRTO_LATENCY, latency_ms_);
+    ok = ok && set_flag(socket, SRTO_CONNTIMEO, CONNECT_TIMEOUT_MS);
+    ok = ok && set_flag(socket, SRTO_RCVSYN, true);
+    ok = ok && set_flag(socket, SRTO_RCVTIMEO, RECEIVE_TIMEOUT_MS);
+    if (ok && !passphrase_.empty()) {
+        ok = set_flag(socket, SRTO_PASSPHRASE, passphrase_);
+    }
+    if (ok && !stream_id.empty()) {
+        ok = set_flag(socket, SRTO_STREAMID, stream_id);
+    }
+
+    // Our UDP socket is libsrt's; the profile is passed on where it has a say
+    if (ok && profile_.rcvbuf_bytes > 0) {
+        ok = set_flag(socket, SRTO_UDP_RCVBUF, profile_.rcvbuf_bytes);
+    }
+    if (ok && profile_.dscp > 0) {
+        ok = set_flag(socket, SRTO_IPTOS, profile_.dscp << 2);
+    }
+    if (!ok) {
+        BLOG_ERROR("Failed to set SRT socket options: %s", srt_getlasterror_str());
+        return false;
+    }
+
+    tuning_ = requested_tuning(profile_);
+    tuning_.tcp_nodelay = false;
+    tuning_.tcp_quickack = false;
+    tuning_.busy_poll_us = 0;
+    return true;
+#else
+    (void)socket;
+    (void)stream_id;
+    return false;
+#endif
+}
+
+int SrtHandler::open_caller(const std::string& host, const std::string& port, const std::string& stream_id)
+{
+#ifdef HAVE_LIBSRT
+    addrinfo hints = {};
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_DGRAM;
+    addrinfo* address = nullptr;
+    if (getaddrinfo(host.c_str(), port.c_str(), &hints, &address) != 0 || !address) {
+        BLOG_ERROR("Cannot resolve SRT sender %s", host.c_str());
+        return -1;
+    }
+
+    SRTSOCKET socket = srt_create_socket();
+    if (socket == SRT_INVALID_SOCK) {
+        BLOG_ERROR("Failed to create SRT socket: %s", srt_getlasterror_str());
+        freeaddrinfo(address);
+        return -1;
+    }
+
+    // Connect without blocking so interrupt() can cut the handshake short
+    bool ok = configure(socket, stream_id) && set_flag(socket, SRTO_RCVSYN, false);
+    if (ok && srt_connect(socket, address->ai_addr, static_cast<int>(address->ai_addrlen)) == SRT_ERROR) {
+        BLOG_ERROR("SRT connect to %s:%s failed: %s", host.c_str(), port.c_str(), srt_getlasterror_str());
+        ok = false;
+    }
+    freeaddrinfo(address);
+    if (ok) {
+        // SRTO_CONNTIMEO ends the handshake with an error event; the wait only bounds it
+        int ready = wait_ready(socket, SRT_EPOLL_OUT | SRT_EPOLL_ERR, connect_stop_, CONNECT_TIMEOUT_MS + 500);
+        if (ready < 0 && connect_stop_.stopped()) {
+            BLOG_DEBUG("SRT connect to %s:%s abandoned", host.c_str(), port.c_str());
+            ok = false;
+        } else if (srt_getsockstate(socket) != SRTS_CONNECTED) {
+            BLOG_ERROR("SRT connect to %s:%s failed: %s", host.c_str(), port.c_str(),
+                       srt_rejectreason_str(srt_getrejectreason(socket)));
+            ok = false;
+        } else {
+            ok = set_flag(socket, SRTO_RCVSYN, true);
+        }
+    }
+    if (!ok) {
+        srt_close(socket);
+        return -1;
+    }
+    return socket;
+#else
+    (void)host;
+    (void)port;
+    (void)stream_id;
+    return -1;
+#endif
+}
+
+int SrtHandler::open_listener(const std::string& host, const std::string& port)
+{
+#ifdef HAVE_LIBSRT
+    // Accepted sockets inherit the listener's options; reopen it if they changed
+    std::string address = host + ":" + port;
+    uint64_t version = 0;
+    {
+        std::lock_guard<std::mutex> settings_lock(settings_mutex_);
+        version = settings_version_;
+    }
+    if (listener_ >= 0 && (listen_address_ != address || listener_version_ != version)) {
+        close_listener();
+    }
+
+    if (listener_ < 0) {
+        addrinfo hints = {};
+        hints.ai_family = AF_INET;
+        hints.ai_socktype = SOCK_DGRAM;
+        hints.ai_flags = AI_PASSIVE;
+        addrinfo* resolved = nullptr;
+        if (getaddrinfo(host.empty() ? nullptr : host.c_str(), port.c_str(), &hints, &resolved) != 0 || !resolved) {
+            BLOG_ERROR("Cannot resolve SRT listen address %s", host.c_str());
+            return -1;
+        }
+
+        SRTSOCKET listener = srt_create_socket();
+        if (listener == SRT_INVALID_SOCK) {
+            BLOG_ERROR("Failed to create SRT socket: %s", srt_getlasterror_str());
+            freeaddrinfo(resolved);
+            return -1;
+        }
+
+        bool ok = configure(listener, "") &&
+                  srt_bind(listener, resolved->ai_addr, static_cast<int>(resolved->ai_addrlen)) != SRT_ERROR &&
+                  srt_listen(listener, 1) != SRT_ERROR;
+        freeaddrinfo(resolved);
+        if (!ok) {
+            BLOG_ERROR("Failed to listen for SRT on port %s: %s", port.c_str(), srt_getlasterror_str());
+            srt_close(listener);
+            return -1;
+        }
+
+        // The listener's own libsrt reference, dropped by close_listener()
+        srt_startup();
+        listener_ = listener;
+        listen_address_ = address;
+        listener_version_ = version;
+        BLOG_INFO("Listening for SRT senders on port %s", port.c_str());
+    }
+
+    // One sender, and only for as long as a connect attempt may take; one
+    // that called in since the last attempt is already waiting
+    SRTSOCKET socket = SRT_INVALID_SOCK;
+    int ready = wait_ready(listener_, SRT_EPOLL_IN | SRT_EPOLL_ERR, connect_stop_, LISTEN_TIMEOUT_MS);
+    if (ready > 0) {
+        sockaddr_storage peer = {};
+        int peer_size = sizeof(peer);
+        socket = srt_accept(listener_, reinterpret_cast<sockaddr*>(&peer), &peer_size);
+
+        char name[INET_ADDRSTRLEN] = "?";
+        if (peer.ss_family == AF_INET) {
+            inet_ntop(AF_INET, &reinterpret_cast<sockaddr_in*>(&peer)->sin_addr, name, sizeof(name));
+        }
+        if (socket != SRT_INVALID_SOCK) {
+            BLOG_INFO("SRT sender %s called in on port %s", name, port.c_str());
+        }
+    } else if (ready == 0) {
+        BLOG_WARNING("No SRT sender called in on port %s within %d ms", port.c_str(), LISTEN_TIMEOUT_MS);
+    }
+
+    if (socket == SRT_INVALID_SOCK) {
+        return -1;
+    }
+
+    // Receive options are per socket; set them again in case they were not inherited
+    set_flag(socket, SRTO_RCVSYN, true);
+    set_flag(socket, SRTO_RCVTIMEO, RECEIVE_TIMEOUT_MS);
+    return socket;
+#else
+    (void)host;
+    (void)port;
+    return -1;
+#endif
+}
+
+void SrtHandler::close_listener()
+{
+    if (listener_ < 0) {
+        return;
+    }
+#ifdef HAVE_LIBSRT
+    srt_close(listener_);
+    srt_cleanup();
+#endif
+    BLOG_INFO("Stopped listening for SRT senders on %s", listen_address_.c_str());
+    listener_ = -1;
+    listen_address_.clear();
+}
+
+void SrtHandler::disconnect()
+{
+    // A connect() holding the lock gives up instead of running out its timeouts
+    connect_stop_.stop();
+    std::lock_guard<std::mutex> lock(control_mutex_);
+    connect_stop_.reset();
+    close_session();
+}
+
+void SrtHandler::interrupt()
+{
+    connect_stop_.stop();
+}
+
+void SrtHandler::stop_listening()
+{
+    connect_stop_.stop();
+    std::lock_guard<std::mutex> lock(control_mutex_);
+    connect_stop_.reset();
+    close_listener();
+}
+
+void SrtHandler::close_session()
+{
+    running_ = false;
+    connected_ = false;
+
+    if (receive_thread_.joinable()) {
+        try {
+            receive_thread_.join();
+        } catch (...) {
+            BLOG_WARNING("Exception while joining SRT receive thread");
+        }
+    }
+
+    if (socket_ < 0) {
+        return;
+    }
+
+    SrtStats stats = get_stats();
+    BLOG_INFO("SRT session closed: %llu packets, %llu lost, %llu retransmitted, %llu dropped, RTT %.1f ms",
+              static_cast<unsigned long long>(stats.packets_received),
+              static_cast<unsigned long long>(stats.packets_lost),
+              static_cast<unsigned long long>(stats.packets_retransmitted),
+              static_cast<unsigned long long>(stats.packets_dropped), stats.rtt_ms);
+
+    {
+        std::lock_guard<std::mutex> lock(stats_mutex_);
+        stats_socket_ = -1;
+    }
+#ifdef HAVE_LIBSRT
+    srt_close(socket_);
+    srt_cleanup();
+#endif
+    socket_ = -1;
+}
+
+bool SrtHandler::is_connected() const
+{
+    return connected_;
+}
+
+bool SrtHandler::receive_frame(VideoFrame& frame)
+{
+    return frame_queue_.pop(frame);
+}
+
+void SrtHandler::receive_loop()
+{
+#ifdef HAVE_LIBSRT
+    std::vector<char> message(MESSAGE_SIZE);
+
+    while (running_) {
+        int received = srt_recvmsg(socket_, message.data(), static_cast<int>(message.size()));
+        if (received > 0) {
+            demuxer_.feed(reinterpret_cast<const uint8_t*>(message.data()), static_cast<size_t>(received));
+            std::lock_guard<std::mutex> lock(stats_mutex_);
+            demux_stats_ = demuxer_.stats();
+            continue;
+        }
+        if (received == SRT_ERROR && srt_getlasterror(nullptr) == SRT_EASYNCRCV) {
+            continue;   // Nothing within RECEIVE_TIMEOUT_MS
+        }
+
+        if (running_) {
+            BLOG_WARNING("SRT connection lost: %s", srt_getlasterror_str());
+            connected_ = false;
+        }
+        break;
+    }
+#endif
+}
+
+SrtStats SrtHandler::get_stats() const
+{
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+
+    SrtStats stats = {};
+    stats.rtt_ms = -1;
+    stats.frames = demux_stats_.frames;
+    stats.frames_corrupt = demux_stats_.frames_corrupt;
+    if (stats_socket_ < 0) {
+        return stats;
+    }
+
+    stats.latency_ms = agreed_latency_ms_;
+    stats.encrypted = encrypted_;
+#ifdef HAVE_LIBSRT
+    // Cleared each time, so the receive rate covers the time since the last call
+    SRT_TRACEBSTATS perf = {};
+    if (srt_bistats(stats_socket_, &perf, 1, 1) != SRT_ERROR) {
+        retransmitted_ += static_cast<uint64_t>(std::max(perf.pktRcvRetrans, 0));
+        stats.rtt_ms = perf.msRTT;
+        stats.packets_received = static_cast<uint64_t>(perf.pktRecvTotal);
+        stats.packets_lost = static_cast<uint64_t>(perf.pktRcvLossTotal);
+        stats.packets_dropped = static_cast<uint64_t>(perf.pktRcvDropTotal);
+        stats.bytes_received = perf.byteRecvTotal;
+        stats.receive_mbps = perf.mbpsRecvRate;
+    }
+#endif
+    stats.packets_retransmitted = retransmitted_;
+    return stats;
+}
+
+SocketTuning SrtHandler::get_socket_tuning() const
+{
+    std::lock_guard<std::mutex> lock(settings_mutex_);
+    return tuning_;
+}
+
+} // namespace berrystreamcam
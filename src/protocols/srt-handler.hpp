@@ -0,0 +1,136 @@
+#pragma once
+
+#include "../common.hpp"
+#include "../discovery/stop-signal.hpp"
+#include "frame-queue.hpp"
+#include "socket-tuning.hpp"
+#include "ts-demuxer.hpp"
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace berrystreamcam {
+
+/**
+ * SRT receive counters, from libsrt's own statistics and the demuxer.
+ */
+struct SrtStats {
+    double rtt_ms;
+    int latency_ms;                 // Receive latency agreed with the sender
+    bool encrypted;
+    uint64_t packets_received;
+    uint64_t packets_lost;          // Found missing; most arrive again in time
+    uint64_t packets_retransmitted; // Retransmitted copies that arrived
+    uint64_t packets_dropped;       // Still missing when their play time came
+    uint64_t bytes_received;
+    double receive_mbps;
+    uint64_t frames;
+    uint64_t frames_corrupt;        // Played across a dropped packet
+};
+
+/**
+ * SRT receiver for contributors out on the internet.
+ *
+ * URLs are "srt://host:port" to call a sender, or "srt://[host]:port?mode=
+ * listener" to wait for one to call in; "streamid=" is passed on for
+ * servers that route by it. A listener stays bound from the first connect()
+ * until stop_listening(), so a sender calling in between connect attempts
+ * is queued rather than refused. libsrt retransmits what is lost (ARQ) for as
+ * long as the latency window allows and plays packets out on the sender's
+ * clock, so frames arrive late by a constant latency rather than whenever
+ * the network recovers. A packet still missing at its play time is
+ * dropped and the access unit around it is marked corrupt.
+ *
+ * The payload is MPEG-TS, as srt-live-transmit, OBS and ffmpeg send it. A
+ * receive thread demuxes it into the frame queue; frames are H.264
+ * Annex-B access units with 90 kHz timestamps.
+ *
+ * Needs libsrt at build time; without it connect() always fails.
+ */
+class SrtHandler {
+public:
+    static constexpr int DEFAULT_LATENCY_MS = 120;   // libsrt's default; about 4x the RTT is usual
+    static constexpr int MIN_LATENCY_MS = 20;
+    static constexpr int MAX_LATENCY_MS = 8000;
+    static constexpr int CONNECT_TIMEOUT_MS = 3000;
+    static constexpr int LISTEN_TIMEOUT_MS = 5000;
+
+    SrtHandler();
+    ~SrtHandler();
+
+    /**
+     * All three take effect on the next connect(). An empty passphrase
+     * turns encryption off; otherwise it must be 10 to 79 characters.
+     */
+    void set_latency_ms(int latency_ms);
+    void set_passphrase(const std::string& passphrase);
+    void set_network_profile(const NetworkProfile& profile);
+
+    bool connect(const std::string& url);
+    void disconnect();
+
+    /**
+     * Make connect() give up; never blocks. Cleared by disconnect().
+     */
+    void interrupt();
+
+    /**
+     * Close the listening socket kept between connects; for when the
+     * source stops streaming. A session already accepted is not touched.
+     */
+    void stop_listening();
+
+    bool is_connected() const;
+
+    bool receive_frame(VideoFrame& frame);
+
+    SrtStats get_stats() const;
+
+    /**
+     * What was asked of libsrt's UDP socket; libsrt keeps the socket to
+     * itself, so nothing is read back.
+     */
+    SocketTuning get_socket_tuning() const;
+
+private:
+    bool configure(int socket, const std::string& stream_id);
+    int open_caller(const std::string& host, const std::string& port, const std::string& stream_id);
+    int open_listener(const std::string& host, const std::string& port);
+    void close_listener();
+    void receive_loop();
+    void close_session();
+
+    std::atomic<bool> connected_;
+    std::atomic<bool> running_;
+    std::thread receive_thread_;
+    std::mutex control_mutex_;          // connect() and disconnect()
+    StopSignal connect_stop_;           // Wakes connect()'s waits, see interrupt()
+
+    // Next connect (guarded by settings_mutex_)
+    int latency_ms_;
+    std::string passphrase_;
+    NetworkProfile profile_;
+    SocketTuning tuning_;
+    uint64_t settings_version_;         // Bumped by changes; a stale listener is reopened
+    mutable std::mutex settings_mutex_;
+
+    // Kept bound between connects (guarded by control_mutex_)
+    int listener_;                      // SRTSOCKET; -1 while not listening
+    std::string listen_address_;
+    uint64_t listener_version_;         // settings_version_ when it was opened
+
+    int socket_;                        // SRTSOCKET; -1 while disconnected
+    TsDemuxer demuxer_;                 // Owned by the receive thread
+    FrameQueue frame_queue_;
+
+    // The socket as get_stats() sees it, and what it has added up
+    mutable std::mutex stats_mutex_;
+    int stats_socket_;
+    int agreed_latency_ms_;
+    bool encrypted_;
+    mutable uint64_t retransmitted_;    // libsrt only counts these per interval
+    TsDemuxerStats demux_stats_;
+};
+
+} // namespace berrystreamcam
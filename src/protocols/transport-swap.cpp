@@ -0,0 +1,217 @@
+#include "transport-swap.hpp"
+#include <algorithm>
+
+namespace berrystreamcam {
+
+TransportSwap::TransportSwap()
+    : winner_(nullptr)
+{
+}
+
+TransportSwap::~TransportSwap()
+{
+    cancel();
+    settle();
+}
+
+void TransportSwap::begin(Transport* next, const std::string& url, int timeout_ms)
+{
+    begin({ { next, url } }, STAGGER_MS, timeout_ms);
+}
+
+void TransportSwap::begin(const std::vector<SwapCandidate>& candidates, int stagger_ms, int timeout_ms)
+{
+    cancel();
+    winner_ = nullptr;
+
+    auto now = std::chrono::steady_clock::now();
+    deadline_ = now + std::chrono::milliseconds(timeout_ms);
+
+    for (const auto& candidate : candidates) {
+        bool duplicate = std::any_of(attempts_.begin(), attempts_.end(),
+            [&candidate](const Attempt& attempt) { return attempt.transport == candidate.transport; });
+        if (!candidate.transport || duplicate) {
+            continue;
+        }
+
+        // A candidate an earlier swap is still taking down has to finish going first
+        for (auto it = teardowns_.begin(); it != teardowns_.end();) {
+            if (it->transport == candidate.transport) {
+                it->thread.join();
+                it = teardowns_.erase(it);
+            } else {
+                ++it;
+            }
+        }
+
+        auto start_at = now + std::chrono::milliseconds(stagger_ms * static_cast<int>(attempts_.size()));
+        attempts_.push_back({ candidate.transport, candidate.url, start_at, false, std::thread(), nullptr });
+    }
+
+    if (!attempts_.empty()) {
+        launch(attempts_.front());
+    }
+}
+
+bool TransportSwap::in_progress() const
+{
+    return !attempts_.empty();
+}
+
+Transport* TransportSwap::incoming() const
+{
+    return attempts_.empty() ? nullptr : attempts_.front().transport;
+}
+
+Transport* TransportSwap::winner() const
+{
+    return winner_;
+}
+
+TransportSwap::Progress TransportSwap::poll(VideoFrame& keyframe)
+{
+    if (attempts_.empty()) {
+        return Progress::IDLE;
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    bool alive = false;
+
+    for (size_t i = 0; i < attempts_.size(); i++) {
+        Attempt& attempt = attempts_[i];
+
+        if (!attempt.started) {
+            if (now < attempt.start_at) {
+                alive = true;
+                continue;
+            }
+            launch(attempt);
+        }
+
+        int state = *attempt.state;
+        if (state == CONNECTING) {
+            alive = true;
+            continue;
+        }
+
+        if (state == CONNECT_FAILED) {
+            // Don't make the next candidate sit out the rest of its stagger
+            for (size_t j = i + 1; j < attempts_.size(); j++) {
+                if (!attempts_[j].started) {
+                    attempts_[j].start_at = std::min(attempts_[j].start_at, now);
+                    break;
+                }
+            }
+            continue;
+        }
+
+        // Inter frames are useless without the keyframe before them
+        VideoFrame frame = {};
+        while (attempt.transport->receive_frame(frame)) {
+            if (frame.is_keyframe && !frame.is_corrupt) {
+                keyframe = frame;
+                winner_ = attempt.transport;
+                attempt.connector.join();
+                attempt.started = false;   // Not discarded with the losers
+                end_swap();
+                return Progress::CUTOVER;
+            }
+            delete[] frame.data;
+            frame = {};
+        }
+        alive = true;
+    }
+
+    if (!alive || now >= deadline_) {
+        end_swap();
+        return Progress::FAILED;
+    }
+
+    return Progress::PENDING;
+}
+
+void TransportSwap::retire(Transport* old)
+{
+    disconnect_later(old, std::thread());
+}
+
+void TransportSwap::cancel()
+{
+    end_swap();
+}
+
+void TransportSwap::settle()
+{
+    for (auto& teardown : teardowns_) {
+        teardown.thread.join();
+    }
+    teardowns_.clear();
+}
+
+void TransportSwap::launch(Attempt& attempt)
+{
+    attempt.started = true;
+    attempt.state = std::make_shared<std::atomic<int>>(CONNECTING);
+
+    Transport* transport = attempt.transport;
+    std::string url = attempt.url;
+    auto state = attempt.state;
+    attempt.connector = std::thread([transport, url, state]() {
+        bool connected = false;
+        try {
+            connected = transport->connect(url);
+        } catch (const std::exception& e) {
+            BLOG_WARNING("Exception while connecting %s: %s", protocol_to_string(transport->protocol()), e.what());
+        }
+        *state = connected ? CONNECTED : CONNECT_FAILED;
+    });
+}
+
+void TransportSwap::discard(Attempt& attempt)
+{
+    // Never started means never touched; leave it alone
+    if (attempt.started) {
+        // The connect gives up rather than running out its timeouts before the join
+        attempt.transport->interrupt();
+        disconnect_later(attempt.transport, std::move(attempt.connector));
+        attempt.started = false;
+    }
+}
+
+void TransportSwap::end_swap()
+{
+    for (auto& attempt : attempts_) {
+        discard(attempt);
+    }
+    attempts_.clear();
+}
+
+void TransportSwap::disconnect_later(Transport* transport, std::thread connector)
+{
+    // Reap teardowns that have already finished
+    for (auto it = teardowns_.begin(); it != teardowns_.end();) {
+        if (*it->done) {
+            it->thread.join();
+            it = teardowns_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    // A connect still in flight has to return before the disconnect can run
+    auto done = std::make_shared<std::atomic<bool>>(false);
+    std::thread thread([transport, done, connector = std::move(connector)]() mutable {
+        if (connector.joinable()) {
+            connector.join();
+        }
+        try {
+            transport->disconnect();
+        } catch (const std::exception& e) {
+            BLOG_WARNING("Exception while disconnecting %s: %s", protocol_to_string(transport->protocol()), e.what());
+        }
+        *done = true;
+    });
+    teardowns_.push_back({ transport, std::move(thread), done });
+}
+
+} // namespace berrystreamcam
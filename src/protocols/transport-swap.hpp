@@ -0,0 +1,133 @@
+#pragma once
+
+#include "../common.hpp"
+#include "transport.hpp"
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace berrystreamcam {
+
+/**
+ * A transport to try and the URL to open it with.
+ */
+struct SwapCandidate {
+    Transport* transport;
+    std::string url;
+};
+
+/**
+ * Make-before-break transport change for the streaming thread.
+ *
+ * begin() connects one or more candidate transports on helper threads
+ * while the caller keeps decoding whatever it has. poll() throws away what
+ * the candidates deliver until one of them produces an intact keyframe and
+ * hands that keyframe back, so the decoder can cut over without a gap. The
+ * losers, and the transport that was cut away from (via retire()), are
+ * disconnected in the background.
+ *
+ * With several candidates this is a staggered race: the first starts at
+ * once and each later one after another stagger interval, or as soon as
+ * an earlier one fails to connect.
+ *
+ * All methods are for the streaming thread only.
+ */
+class TransportSwap {
+public:
+    static constexpr int CUTOVER_TIMEOUT_MS = 5000;
+    static constexpr int STAGGER_MS = 250;
+
+    enum class Progress {
+        IDLE,       // No swap in progress
+        PENDING,    // Connecting, or waiting for the first keyframe
+        CUTOVER,    // keyframe holds the first keyframe of winner()
+        FAILED      // Nothing connected or no keyframe in time
+    };
+
+    TransportSwap();
+    ~TransportSwap();
+
+    TransportSwap(const TransportSwap&) = delete;
+    TransportSwap& operator=(const TransportSwap&) = delete;
+
+    /**
+     * Start connecting next. A swap already in progress is abandoned. Only
+     * blocks if next itself is still being disconnected by an earlier
+     * retire() or cancel().
+     */
+    void begin(Transport* next, const std::string& url, int timeout_ms = CUTOVER_TIMEOUT_MS);
+
+    /**
+     * Race candidates, most preferred first; the first intact keyframe
+     * wins. Duplicates and null transports are skipped.
+     */
+    void begin(const std::vector<SwapCandidate>& candidates,
+               int stagger_ms = STAGGER_MS, int timeout_ms = CUTOVER_TIMEOUT_MS);
+
+    bool in_progress() const;
+
+    /**
+     * The most preferred candidate of the swap in progress, or nullptr.
+     */
+    Transport* incoming() const;
+
+    /**
+     * Never blocks on the network. On CUTOVER the caller owns
+     * keyframe.data, winner() names the transport it came from, and the
+     * swap is over.
+     */
+    Progress poll(VideoFrame& keyframe);
+
+    Transport* winner() const;
+
+    /**
+     * Disconnect the transport that was cut away from, off this thread.
+     */
+    void retire(Transport* old);
+
+    /**
+     * Abandon a swap in progress; candidates already connecting are
+     * interrupted and disconnected in the background.
+     */
+    void cancel();
+
+    /**
+     * Wait for background disconnects, e.g. before reconnecting a
+     * transport that may still be going down. Connects cut short by
+     * cancel() return promptly, so this does not wait out their timeouts.
+     */
+    void settle();
+
+private:
+    enum ConnectState { CONNECTING, CONNECTED, CONNECT_FAILED };
+
+    struct Attempt {
+        Transport* transport;
+        std::string url;
+        std::chrono::steady_clock::time_point start_at;
+        bool started;
+        std::thread connector;
+        std::shared_ptr<std::atomic<int>> state;   // An abandoned connector may still write it
+    };
+
+    struct Teardown {
+        Transport* transport;
+        std::thread thread;
+        std::shared_ptr<std::atomic<bool>> done;
+    };
+
+    void launch(Attempt& attempt);
+    void discard(Attempt& attempt);
+    void disconnect_later(Transport* transport, std::thread connector);
+    void end_swap();
+
+    std::vector<Attempt> attempts_;
+    Transport* winner_;
+    std::chrono::steady_clock::time_point deadline_;
+    std::vector<Teardown> teardowns_;        // Background disconnects, joined by settle()
+};
+
+} // namespace berrystreamcam
@@ -0,0 +1,191 @@
+#include "transport.hpp"
+#include "websocket-handler.hpp"
+#include "rtsp-udp-handler.hpp"
+#include "http-handler.hpp"
+#include "dash-handler.hpp"
+#include "srt-handler.hpp"
+
+namespace berrystreamcam {
+
+WebSocketTransport::WebSocketTransport(WebSocketHandler& handler)
+    : handler_(handler)
+{
+}
+
+ProtocolType WebSocketTransport::protocol() const
+{
+    return ProtocolType::WEBSOCKET_OBS_DROID;
+}
+
+bool WebSocketTransport::connect(const std::string& url)
+{
+    return handler_.connect_to_server(url);
+}
+
+void WebSocketTransport::disconnect()
+{
+    handler_.disconnect_from_server();
+}
+
+bool WebSocketTransport::is_connected() const
+{
+    return handler_.is_connected();
+}
+
+void WebSocketTransport::interrupt()
+{
+    handler_.interrupt_connect();
+}
+
+bool WebSocketTransport::receive_frame(VideoFrame& frame)
+{
+    return handler_.receive_frame(frame);
+}
+
+RtspTransport::RtspTransport(RtspUdpHandler& handler)
+    : handler_(handler)
+{
+}
+
+ProtocolType RtspTransport::protocol() const
+{
+    return ProtocolType::RTSP;
+}
+
+bool RtspTransport::connect(const std::string& url)
+{
+    return handler_.connect(url);
+}
+
+void RtspTransport::disconnect()
+{
+    handler_.disconnect();
+}
+
+bool RtspTransport::is_connected() const
+{
+    return handler_.is_connected();
+}
+
+void RtspTransport::interrupt()
+{
+    handler_.interrupt();
+}
+
+bool RtspTransport::receive_frame(VideoFrame& frame)
+{
+    return handler_.receive_frame(frame);
+}
+
+bool RtspTransport::receive_shared(VideoFrame& frame, std::shared_ptr<uint8_t>& data)
+{
+    return handler_.receive_shared(frame, data);
+}
+
+HttpTransport::HttpTransport(HttpHandler& handler, ProtocolType type)
+    : handler_(handler)
+    , type_(type)
+{
+}
+
+ProtocolType HttpTransport::protocol() const
+{
+    return type_;
+}
+
+bool HttpTransport::connect(const std::string& url)
+{
+    return handler_.connect(url, type_);
+}
+
+void HttpTransport::disconnect()
+{
+    handler_.disconnect();
+}
+
+bool HttpTransport::is_connected() const
+{
+    return handler_.is_connected();
+}
+
+void HttpTransport::interrupt()
+{
+    handler_.interrupt();
+}
+
+bool HttpTransport::receive_frame(VideoFrame& frame)
+{
+    return handler_.receive_frame(frame);
+}
+
+DashTransport::DashTransport(DashHandler& handler)
+    : handler_(handler)
+{
+}
+
+ProtocolType DashTransport::protocol() const
+{
+    return ProtocolType::HTTP_DASH;
+}
+
+bool DashTransport::connect(const std::string& url)
+{
+    return handler_.connect(url);
+}
+
+void DashTransport::disconnect()
+{
+    handler_.disconnect();
+}
+
+bool DashTransport::is_connected() const
+{
+    return handler_.is_connected();
+}
+
+void DashTransport::interrupt()
+{
+    handler_.interrupt();
+}
+
+bool DashTransport::receive_frame(VideoFrame& frame)
+{
+    return handler_.receive_frame(frame);
+}
+
+SrtTransport::SrtTransport(SrtHandler& handler)
+    : handler_(handler)
+{
+}
+
+ProtocolType SrtTransport::protocol() const
+{
+    return ProtocolType::SRT;
+}
+
+bool SrtTransport::connect(const std::string& url)
+{
+    return handler_.connect(url);
+}
+
+void SrtTransport::disconnect()
+{
+    handler_.disconnect();
+}
+
+bool SrtTransport::is_connected() const
+{
+    return handler_.is_connected();
+}
+
+void SrtTransport::interrupt()
+{
+    handler_.interrupt();
+}
+
+bool SrtTransport::receive_frame(VideoFrame& frame)
+{
+    return handler_.receive_frame(frame);
+}
+
+} // namespace berrystreamcam
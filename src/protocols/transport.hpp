@@ -0,0 +1,141 @@
+#pragma once
+
+#include "../common.hpp"
+#include <memory>
+#include <string>
+
+namespace berrystreamcam {
+
+class WebSocketHandler;
+class RtspUdpHandler;
+class HttpHandler;
+class DashHandler;
+class SrtHandler;
+
+/**
+ * One way of getting frames from the device, independent of the handler
+ * behind it. The streaming thread reads from one Transport and can bring
+ * up a second one in parallel when the protocol changes.
+ *
+ * Implementations only forward to a handler the source owns; they must
+ * not outlive it.
+ */
+class Transport {
+public:
+    virtual ~Transport() = default;
+
+    virtual ProtocolType protocol() const = 0;
+    virtual bool connect(const std::string& url) = 0;
+    virtual void disconnect() = 0;
+    virtual bool is_connected() const = 0;
+
+    /**
+     * Make a connect() in progress on another thread, or one that starts
+     * before the next disconnect(), give up within milliseconds instead of
+     * running out its timeouts. Never blocks; disconnect() clears it.
+     * Transports whose connect() is already short need not override it.
+     */
+    virtual void interrupt() {}
+
+    /**
+     * Caller owns frame.data on success.
+     */
+    virtual bool receive_frame(VideoFrame& frame) = 0;
+
+    /**
+     * Like receive_frame(), but data holds the bytes for as long as anyone
+     * keeps a reference and frame.data points into it. By default takes
+     * over what receive_frame() returns; a transport that can lend out its
+     * own buffers overrides this to skip the copy.
+     */
+    virtual bool receive_shared(VideoFrame& frame, std::shared_ptr<uint8_t>& data)
+    {
+        if (!receive_frame(frame)) {
+            return false;
+        }
+        data.reset(frame.data, std::default_delete<uint8_t[]>());
+        return true;
+    }
+};
+
+class WebSocketTransport : public Transport {
+public:
+    explicit WebSocketTransport(WebSocketHandler& handler);
+
+    ProtocolType protocol() const override;
+    bool connect(const std::string& url) override;
+    void disconnect() override;
+    bool is_connected() const override;
+    void interrupt() override;
+    bool receive_frame(VideoFrame& frame) override;
+
+private:
+    WebSocketHandler& handler_;
+};
+
+class RtspTransport : public Transport {
+public:
+    explicit RtspTransport(RtspUdpHandler& handler);
+
+    ProtocolType protocol() const override;
+    bool connect(const std::string& url) override;
+    void disconnect() override;
+    bool is_connected() const override;
+    void interrupt() override;
+    bool receive_frame(VideoFrame& frame) override;
+    bool receive_shared(VideoFrame& frame, std::shared_ptr<uint8_t>& data) override;
+
+private:
+    RtspUdpHandler& handler_;
+};
+
+/**
+ * Raw H.264 or MJPEG over HTTP; type picks which.
+ */
+class HttpTransport : public Transport {
+public:
+    HttpTransport(HttpHandler& handler, ProtocolType type);
+
+    ProtocolType protocol() const override;
+    bool connect(const std::string& url) override;
+    void disconnect() override;
+    bool is_connected() const override;
+    void interrupt() override;
+    bool receive_frame(VideoFrame& frame) override;
+
+private:
+    HttpHandler& handler_;
+    ProtocolType type_;
+};
+
+class DashTransport : public Transport {
+public:
+    explicit DashTransport(DashHandler& handler);
+
+    ProtocolType protocol() const override;
+    bool connect(const std::string& url) override;
+    void disconnect() override;
+    bool is_connected() const override;
+    void interrupt() override;
+    bool receive_frame(VideoFrame& frame) override;
+
+private:
+    DashHandler& handler_;
+};
+
+class SrtTransport : public Transport {
+public:
+    explicit SrtTransport(SrtHandler& handler);
+
+    ProtocolType protocol() const override;
+    bool connect(const std::string& url) override;
+    void disconnect() override;
+    bool is_connected() const override;
+    void interrupt() override;
+    bool receive_frame(VideoFrame& frame) override;
+
+private:
+    SrtHandler& handler_;
+};
+
+} // namespace berrystreamcam
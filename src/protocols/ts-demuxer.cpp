@@ -0,0 +1,359 @@
+#include "ts-demuxer.hpp"
+#include <algorithm>
+#include <cstring>
+
+namespace berrystreamcam {
+
+namespace {
+
+constexpr uint8_t SYNC_BYTE = 0x47;
+constexpr int PAT_PID = 0x0000;
+constexpr uint8_t TABLE_PAT = 0x00;
+constexpr uint8_t TABLE_PMT = 0x02;
+constexpr uint8_t STREAM_TYPE_H264 = 0x1B;
+constexpr uint8_t NAL_IDR = 5;
+
+// CRC-32/MPEG-2; over a whole section, CRC included, it comes out 0
+uint32_t crc32_mpeg(const uint8_t* data, size_t size)
+{
+    uint32_t crc = 0xFFFFFFFF;
+    for (size_t i = 0; i < size; i++) {
+        crc ^= static_cast<uint32_t>(data[i]) << 24;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x80000000) ? (crc << 1) ^ 0x04C11DB7 : crc << 1;
+        }
+    }
+    return crc;
+}
+
+int64_t read_timestamp(const uint8_t* p)
+{
+    return (static_cast<int64_t>((p[0] >> 1) & 0x07) << 30) |
+           (static_cast<int64_t>(p[1]) << 22) |
+           (static_cast<int64_t>(p[2] >> 1) << 15) |
+           (static_cast<int64_t>(p[3]) << 7) |
+           (static_cast<int64_t>(p[4] >> 1));
+}
+
+bool contains_idr(const std::vector<uint8_t>& au)
+{
+    for (size_t i = 0; i + 3 < au.size(); i++) {
+        if (au[i] == 0x00 && au[i + 1] == 0x00 && au[i + 2] == 0x01 && (au[i + 3] & 0x1F) == NAL_IDR) {
+            return true;
+        }
+    }
+    return false;
+}
+
+} // namespace
+
+TsDemuxer::TsDemuxer(FrameCallback on_frame)
+    : on_frame_(std::move(on_frame))
+{
+    reset();
+}
+
+void TsDemuxer::reset()
+{
+    buffer_.clear();
+    synced_ = false;
+    pmt_pid_ = -1;
+    video_pid_ = -1;
+    last_cc_ = -1;
+    in_pes_ = false;
+    au_.clear();
+    pes_remaining_ = SIZE_MAX;
+    pts_ = 0;
+    dts_ = 0;
+    random_access_ = false;
+    au_corrupt_ = false;
+    au_oversized_ = false;
+    stats_ = {};
+}
+
+void TsDemuxer::feed(const uint8_t* data, size_t size)
+{
+    buffer_.insert(buffer_.end(), data, data + size);
+
+    size_t pos = 0;
+    while (buffer_.size() - pos >= PACKET_SIZE) {
+        if (buffer_[pos] != SYNC_BYTE) {
+            if (synced_) {
+                synced_ = false;
+                stats_.resyncs++;
+                au_corrupt_ = au_corrupt_ || in_pes_;
+            }
+            pos++;
+            continue;
+        }
+
+        // A lone 0x47 in garbage is not enough; the next packet must start one on
+        if (!synced_) {
+            if (buffer_.size() - pos < 2 * PACKET_SIZE) {
+                break;
+            }
+            if (buffer_[pos + PACKET_SIZE] != SYNC_BYTE) {
+                pos++;
+                continue;
+            }
+            synced_ = true;
+        }
+
+        handle_packet(&buffer_[pos]);
+        pos += PACKET_SIZE;
+    }
+
+    buffer_.erase(buffer_.begin(), buffer_.begin() + pos);
+}
+
+void TsDemuxer::finish()
+{
+    if (in_pes_) {
+        emit_frame();
+    }
+}
+
+int TsDemuxer::video_pid() const
+{
+    return video_pid_;
+}
+
+TsDemuxerStats TsDemuxer::stats() const
+{
+    return stats_;
+}
+
+void TsDemuxer::handle_packet(const uint8_t* packet)
+{
+    stats_.packets++;
+
+    int pid = ((packet[1] & 0x1F) << 8) | packet[2];
+    bool error = (packet[1] & 0x80) != 0;
+    bool unit_start = (packet[1] & 0x40) != 0;
+    int adaptation = (packet[3] >> 4) & 0x03;
+    int cc = packet[3] & 0x0F;
+
+    if (error) {
+        if (pid == video_pid_ && in_pes_) {
+            au_corrupt_ = true;
+        }
+        return;
+    }
+
+    size_t offset = 4;
+    bool discontinuity = false;
+    bool random_access = false;
+    if (adaptation & 0x02) {
+        size_t length = packet[4];
+        if (length > PACKET_SIZE - 5) {
+            return;
+        }
+        if (length > 0) {
+            discontinuity = (packet[5] & 0x80) != 0;
+            random_access = (packet[5] & 0x40) != 0;
+        }
+        offset = 5 + length;
+    }
+    if (!(adaptation & 0x01) || offset >= PACKET_SIZE) {
+        return;   // No payload; the counter does not advance either
+    }
+
+    const uint8_t* payload = packet + offset;
+    size_t size = PACKET_SIZE - offset;
+
+    if (pid == PAT_PID) {
+        handle_section(payload, size, unit_start, true);
+    } else if (pid == pmt_pid_) {
+        handle_section(payload, size, unit_start, false);
+    } else if (pid == video_pid_) {
+        if (last_cc_ >= 0 && !discontinuity) {
+            if (cc == last_cc_) {
+                return;   // Sent twice on purpose; the copy adds nothing
+            }
+            if (cc != ((last_cc_ + 1) & 0x0F)) {
+                stats_.continuity_errors++;
+                au_corrupt_ = au_corrupt_ || in_pes_;
+            }
+        }
+        last_cc_ = cc;
+        handle_video(payload, size, unit_start, random_access);
+    }
+}
+
+void TsDemuxer::handle_section(const uint8_t* payload, size_t size, bool unit_start, bool is_pat)
+{
+    // PAT and PMT for one program fit in a packet; longer tables are not followed
+    if (!unit_start) {
+        return;
+    }
+
+    size_t pointer = payload[0];
+    if (1 + pointer + 3 > size) {
+        return;
+    }
+    const uint8_t* section = payload + 1 + pointer;
+    size_t left = size - 1 - pointer;
+
+    size_t length = 3 + (((section[1] & 0x0F) << 8) | section[2]);
+    if (length > left || length < 16 || crc32_mpeg(section, length) != 0) {
+        return;
+    }
+
+    if (is_pat) {
+        handle_pat(section, length);
+    } else {
+        handle_pmt(section, length);
+    }
+}
+
+void TsDemuxer::handle_pat(const uint8_t* section, size_t size)
+{
+    if (section[0] != TABLE_PAT) {
+        return;
+    }
+
+    // The first program; number 0 points at the network table instead
+    for (size_t i = 8; i + 4 <= size - 4; i += 4) {
+        int program = (section[i] << 8) | section[i + 1];
+        int pid = ((section[i + 2] & 0x1F) << 8) | section[i + 3];
+        if (program != 0) {
+            pmt_pid_ = pid;
+            return;
+        }
+    }
+}
+
+void TsDemuxer::handle_pmt(const uint8_t* section, size_t size)
+{
+    if (section[0] != TABLE_PMT) {
+        return;
+    }
+
+    size_t i = 12 + (((section[10] & 0x0F) << 8) | section[11]);
+    while (i + 5 <= size - 4) {
+        uint8_t type = section[i];
+        int pid = ((section[i + 1] & 0x1F) << 8) | section[i + 2];
+        size_t info_length = ((section[i + 3] & 0x0F) << 8) | section[i + 4];
+
+        if (type == STREAM_TYPE_H264) {
+            if (pid != video_pid_) {
+                BLOG_INFO("MPEG-TS: H.264 on PID %d", pid);
+                in_pes_ = false;
+                au_.clear();
+                video_pid_ = pid;
+                last_cc_ = -1;
+            }
+            return;
+        }
+        i += 5 + info_length;
+    }
+
+    if (video_pid_ < 0) {
+        BLOG_DEBUG("MPEG-TS program carries no H.264 stream");
+    }
+}
+
+void TsDemuxer::handle_video(const uint8_t* payload, size_t size, bool unit_start, bool random_access)
+{
+    if (unit_start) {
+        if (in_pes_) {
+            emit_frame();
+        }
+        size_t header_size = 0;
+        if (!start_pes(payload, size, header_size)) {
+            return;
+        }
+        random_access_ = random_access;
+        payload += header_size;
+        size -= header_size;
+    } else if (!in_pes_) {
+        return;   // Joined mid-packet; wait for the next one to start
+    }
+
+    size_t take = std::min(size, pes_remaining_);
+    append(payload, take);
+    if (pes_remaining_ != SIZE_MAX) {
+        pes_remaining_ -= take;
+        if (pes_remaining_ == 0) {
+            emit_frame();
+        }
+    }
+}
+
+bool TsDemuxer::start_pes(const uint8_t* payload, size_t size, size_t& header_size)
+{
+    in_pes_ = false;
+    if (size < 9 || payload[0] != 0x00 || payload[1] != 0x00 || payload[2] != 0x01 ||
+        (payload[6] & 0xC0) != 0x80) {
+        return false;
+    }
+
+    size_t pes_length = (payload[4] << 8) | payload[5];
+    int flags = payload[7] >> 6;
+    size_t extension = payload[8];
+    header_size = 9 + extension;
+    if (header_size > size || (pes_length != 0 && pes_length < 3 + extension)) {
+        return false;
+    }
+
+    pts_ = 0;
+    if ((flags & 0x02) && extension >= 5) {
+        pts_ = read_timestamp(payload + 9);
+    }
+    dts_ = pts_;
+    if (flags == 0x03 && extension >= 10) {
+        dts_ = read_timestamp(payload + 14);
+    }
+
+    pes_remaining_ = pes_length != 0 ? pes_length - 3 - extension : SIZE_MAX;
+    au_.clear();
+    au_corrupt_ = false;
+    au_oversized_ = false;
+    in_pes_ = true;
+    return true;
+}
+
+void TsDemuxer::append(const uint8_t* data, size_t size)
+{
+    if (au_oversized_) {
+        return;
+    }
+    if (au_.size() + size > MAX_FRAME_BYTES) {
+        au_oversized_ = true;
+        au_.clear();
+        return;
+    }
+    au_.insert(au_.end(), data, data + size);
+}
+
+void TsDemuxer::emit_frame()
+{
+    in_pes_ = false;
+    if (au_oversized_) {
+        stats_.frames_dropped++;
+        return;
+    }
+    if (au_.empty()) {
+        return;
+    }
+
+    VideoFrame frame = {};
+    frame.data = new uint8_t[au_.size()];
+    memcpy(frame.data, au_.data(), au_.size());
+    frame.size = au_.size();
+    frame.timestamp = pts_;
+    frame.pts = pts_;
+    frame.dts = dts_;
+    frame.is_keyframe = random_access_ || contains_idr(au_);
+    frame.is_corrupt = au_corrupt_;
+
+    stats_.frames++;
+    if (au_corrupt_) {
+        stats_.frames_corrupt++;
+    }
+    au_.clear();
+
+    on_frame_(std::move(frame));
+}
+
+} // namespace berrystreamcam
@@ -0,0 +1,85 @@
+#pragma once
+
+#include "../common.hpp"
+#include <functional>
+#include <vector>
+
+namespace berrystreamcam {
+
+struct TsDemuxerStats {
+    uint64_t packets;
+    uint64_t frames;
+    uint64_t frames_corrupt;      // Collected across a continuity gap
+    uint64_t frames_dropped;      // Larger than MAX_FRAME_BYTES
+    uint64_t continuity_errors;
+    uint64_t resyncs;             // Lost packet alignment and searched for it again
+};
+
+/**
+ * Incremental MPEG transport stream demuxer for the H.264 stream that SRT
+ * senders carry (srt-live-transmit, OBS, ffmpeg -f mpegts).
+ *
+ * Bytes are fed in as they arrive, in pieces of any size. The PAT and PMT
+ * pick the first H.264 stream of the first program. Its PES packets are
+ * handed out as Annex-B access units, with the PES PTS/DTS (90 kHz) and a
+ * keyframe flag from the IDR NAL units inside or the random access
+ * indicator. A continuity counter gap marks the access unit being
+ * collected as corrupt, as the RTP depacketizer does after a loss. Other
+ * streams are skipped.
+ *
+ * Not thread-safe; feed it from one thread.
+ */
+class TsDemuxer {
+public:
+    using FrameCallback = std::function<void(VideoFrame&& frame)>;
+
+    static constexpr size_t PACKET_SIZE = 188;
+    static constexpr size_t MAX_FRAME_BYTES = FRAME_BUFFER_SIZE;
+
+    explicit TsDemuxer(FrameCallback on_frame);
+
+    void feed(const uint8_t* data, size_t size);
+
+    /**
+     * The stream ended: hand over the access unit still open.
+     */
+    void finish();
+
+    void reset();
+
+    int video_pid() const;
+    TsDemuxerStats stats() const;
+
+private:
+    void handle_packet(const uint8_t* packet);
+    void handle_section(const uint8_t* payload, size_t size, bool unit_start, bool is_pat);
+    void handle_pat(const uint8_t* section, size_t size);
+    void handle_pmt(const uint8_t* section, size_t size);
+    void handle_video(const uint8_t* payload, size_t size, bool unit_start, bool random_access);
+    bool start_pes(const uint8_t* payload, size_t size, size_t& header_size);
+    void append(const uint8_t* data, size_t size);
+    void emit_frame();
+
+    FrameCallback on_frame_;
+
+    std::vector<uint8_t> buffer_;   // Bytes not yet cut into packets
+    bool synced_;
+
+    int pmt_pid_;
+    int video_pid_;
+    int last_cc_;                   // -1 until the video PID's first packet
+
+    // PES packet under assembly
+    bool in_pes_;
+    std::vector<uint8_t> au_;
+    size_t pes_remaining_;          // SIZE_MAX when the PES length is unbounded
+    int64_t pts_;
+    int64_t dts_;
+    bool random_access_;
+    bool au_corrupt_;
+    bool au_oversized_;
+
+    TsDemuxerStats stats_;
+};
+
+} // namespace berrystreamcam
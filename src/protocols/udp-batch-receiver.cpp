@@ -0,0 +1,230 @@
+#include "udp-batch-receiver.hpp"
+#include <chrono>
+#include <cstring>
+#include <errno.h>
+#include <time.h>
+
+namespace berrystreamcam {
+
+namespace {
+
+// Room for one timestamp and one drop counter per datagram
+constexpr size_t CONTROL_SIZE = CMSG_SPACE(sizeof(struct timespec)) +
+                                CMSG_SPACE(sizeof(struct timeval)) +
+                                CMSG_SPACE(sizeof(uint32_t));
+
+} // namespace
+
+UdpBatchReceiver::UdpBatchReceiver(size_t batch_size, size_t slot_size)
+    : batch_size_(batch_size > 0 ? batch_size : 1)
+    , slot_size_(slot_size)
+    , fd_(-1)
+    , syscalls_(0)
+    , packet_count_(0)
+    , byte_count_(0)
+    , kernel_drops_(0)
+    , max_batch_(0)
+    , rcvbuf_bytes_(0)
+{
+    storage_.resize(batch_size_ * slot_size_);
+    control_.resize(batch_size_ * CONTROL_SIZE);
+    packets_.resize(batch_size_);
+    iovecs_.resize(batch_size_);
+    headers_.resize(batch_size_);
+
+    for (size_t i = 0; i < batch_size_; i++) {
+        iovecs_[i].iov_base = storage_.data() + i * slot_size_;
+        iovecs_[i].iov_len = slot_size_;
+
+#ifdef __linux__
+        struct msghdr& msg = headers_[i].msg_hdr;
+#else
+        struct msghdr& msg = headers_[i];
+#endif
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &iovecs_[i];
+        msg.msg_iovlen = 1;
+        msg.msg_control = control_.data() + i * CONTROL_SIZE;
+        msg.msg_controllen = CONTROL_SIZE;
+    }
+}
+
+UdpBatchReceiver::~UdpBatchReceiver()
+{
+}
+
+int64_t UdpBatchReceiver::now_us()
+{
+    // Kernel timestamps are CLOCK_REALTIME, so deadlines must use it too
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+bool UdpBatchReceiver::attach(int fd, int rcvbuf_bytes)
+{
+    fd_ = fd;
+    if (fd_ < 0) {
+        return false;
+    }
+
+    syscalls_ = 0;
+    packet_count_ = 0;
+    byte_count_ = 0;
+    kernel_drops_ = 0;
+    max_batch_ = 0;
+
+    // Keyframe bursts arrive faster than we drain; size the queue for them.
+    // SO_RCVBUFFORCE ignores rmem_max but needs CAP_NET_ADMIN.
+    bool forced = false;
+#ifdef SO_RCVBUFFORCE
+    forced = setsockopt(fd_, SOL_SOCKET, SO_RCVBUFFORCE, &rcvbuf_bytes, sizeof(rcvbuf_bytes)) == 0;
+#endif
+    if (!forced) {
+        setsockopt(fd_, SOL_SOCKET, SO_RCVBUF, &rcvbuf_bytes, sizeof(rcvbuf_bytes));
+    }
+
+    socklen_t len = sizeof(rcvbuf_bytes_);
+    getsockopt(fd_, SOL_SOCKET, SO_RCVBUF, &rcvbuf_bytes_, &len);
+
+#ifdef __linux__
+    // Linux reports twice the usable size to account for bookkeeping
+    if (rcvbuf_bytes_ / 2 < rcvbuf_bytes) {
+        BLOG_WARNING("UDP receive buffer limited to %d bytes (requested %d); "
+                     "raise net.core.rmem_max to avoid keyframe drops",
+                     rcvbuf_bytes_ / 2, rcvbuf_bytes);
+    }
+#endif
+
+    int on = 1;
+#ifdef SO_TIMESTAMPNS
+    setsockopt(fd_, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on));
+#else
+    setsockopt(fd_, SOL_SOCKET, SO_TIMESTAMP, &on, sizeof(on));
+#endif
+#ifdef SO_RXQ_OVFL
+    setsockopt(fd_, SOL_SOCKET, SO_RXQ_OVFL, &on, sizeof(on));
+#endif
+
+    BLOG_DEBUG("UDP batch receiver attached (fd=%d, batch=%zu, rcvbuf=%d)",
+               fd_, batch_size_, rcvbuf_bytes_);
+    return true;
+}
+
+size_t UdpBatchReceiver::receive()
+{
+    if (fd_ < 0) {
+        return 0;
+    }
+
+    size_t received = 0;
+
+#ifdef __linux__
+    for (size_t i = 0; i < batch_size_; i++) {
+        headers_[i].msg_hdr.msg_controllen = CONTROL_SIZE;
+        headers_[i].msg_hdr.msg_flags = 0;
+    }
+
+    int result = recvmmsg(fd_, headers_.data(), static_cast<unsigned int>(batch_size_),
+                          MSG_DONTWAIT, nullptr);
+    syscalls_++;
+    if (result <= 0) {
+        return 0;
+    }
+    received = static_cast<size_t>(result);
+#else
+    while (received < batch_size_) {
+        headers_[received].msg_controllen = CONTROL_SIZE;
+        headers_[received].msg_flags = 0;
+        ssize_t len = recvmsg(fd_, &headers_[received], MSG_DONTWAIT);
+        syscalls_++;
+        if (len <= 0) {
+            break;
+        }
+        packets_[received].size = static_cast<size_t>(len);
+        received++;
+    }
+    if (received == 0) {
+        return 0;
+    }
+#endif
+
+    int64_t fallback_time = 0;
+    size_t count = 0;
+    uint64_t bytes = 0;
+
+    for (size_t i = 0; i < received; i++) {
+#ifdef __linux__
+        struct msghdr& msg = headers_[i].msg_hdr;
+        size_t length = headers_[i].msg_len;
+#else
+        struct msghdr& msg = headers_[i];
+        size_t length = packets_[i].size;
+#endif
+
+        if (msg.msg_flags & MSG_TRUNC) {
+            // Larger than a slot; a partial RTP packet is worse than none
+            continue;
+        }
+
+        int64_t arrival_us = 0;
+        for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+            if (cmsg->cmsg_level != SOL_SOCKET) {
+                continue;
+            }
+#ifdef SCM_TIMESTAMPNS
+            if (cmsg->cmsg_type == SCM_TIMESTAMPNS) {
+                struct timespec ts;
+                memcpy(&ts, CMSG_DATA(cmsg), sizeof(ts));
+                arrival_us = int64_t(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+            }
+#endif
+            if (cmsg->cmsg_type == SCM_TIMESTAMP) {
+                struct timeval tv;
+                memcpy(&tv, CMSG_DATA(cmsg), sizeof(tv));
+                arrival_us = int64_t(tv.tv_sec) * 1000000 + tv.tv_usec;
+            }
+#ifdef SO_RXQ_OVFL
+            if (cmsg->cmsg_type == SO_RXQ_OVFL) {
+                uint32_t drops;
+                memcpy(&drops, CMSG_DATA(cmsg), sizeof(drops));
+                kernel_drops_ = drops;
+            }
+#endif
+        }
+
+        if (arrival_us == 0) {
+            if (fallback_time == 0) {
+                fallback_time = now_us();
+            }
+            arrival_us = fallback_time;
+        }
+
+        packets_[count].data = storage_.data() + i * slot_size_;
+        packets_[count].size = length;
+        packets_[count].arrival_us = arrival_us;
+        bytes += length;
+        count++;
+    }
+
+    packet_count_ += count;
+    byte_count_ += bytes;
+    if (received > max_batch_) {
+        max_batch_ = static_cast<uint32_t>(received);
+    }
+
+    return count;
+}
+
+UdpReceiveStats UdpBatchReceiver::get_stats() const
+{
+    UdpReceiveStats stats = {};
+    stats.syscalls = syscalls_;
+    stats.packets = packet_count_;
+    stats.bytes = byte_count_;
+    stats.kernel_drops = kernel_drops_;
+    stats.max_batch = max_batch_;
+    stats.rcvbuf_bytes = rcvbuf_bytes_;
+    return stats;
+}
+
+} // namespace berrystreamcam
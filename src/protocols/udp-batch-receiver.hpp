@@ -0,0 +1,96 @@
+#pragma once
+
+#include "../common.hpp"
+#include <vector>
+#include <atomic>
+
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+namespace berrystreamcam {
+
+/**
+ * One datagram from the receive ring.
+ * data points into a preallocated slot and is valid until the next receive().
+ */
+struct UdpPacket {
+    const uint8_t* data;
+    size_t size;
+    int64_t arrival_us;   // Kernel receive time (CLOCK_REALTIME), see now_us()
+};
+
+struct UdpReceiveStats {
+    uint64_t syscalls;
+    uint64_t packets;
+    uint64_t bytes;
+    uint64_t kernel_drops;   // Socket queue overflows reported by SO_RXQ_OVFL
+    uint32_t max_batch;
+    int rcvbuf_bytes;        // Effective SO_RCVBUF as reported by the kernel
+};
+
+/**
+ * Batched UDP receive for high packet-rate media.
+ *
+ * Pulls up to batch_size datagrams per recvmmsg() call into a ring of
+ * preallocated slots, each stamped with its kernel arrival time from
+ * SO_TIMESTAMPNS. On platforms without recvmmsg the same interface falls
+ * back to one recvmsg() per datagram.
+ */
+class UdpBatchReceiver {
+public:
+    static constexpr size_t DEFAULT_BATCH_SIZE = 64;
+    static constexpr size_t DEFAULT_SLOT_SIZE = 2048;
+    static constexpr int DEFAULT_RCVBUF_BYTES = 8 * 1024 * 1024;
+
+    explicit UdpBatchReceiver(size_t batch_size = DEFAULT_BATCH_SIZE,
+                              size_t slot_size = DEFAULT_SLOT_SIZE);
+    ~UdpBatchReceiver();
+
+    UdpBatchReceiver(const UdpBatchReceiver&) = delete;
+    UdpBatchReceiver& operator=(const UdpBatchReceiver&) = delete;
+
+    /**
+     * Configure a bound socket: receive buffer size, kernel timestamps
+     * and drop counters. The socket stays owned by the caller.
+     */
+    bool attach(int fd, int rcvbuf_bytes = DEFAULT_RCVBUF_BYTES);
+
+    /**
+     * Receive whatever is queued, without blocking.
+     * Returns the number of packets now available through packet().
+     */
+    size_t receive();
+
+    const UdpPacket& packet(size_t index) const { return packets_[index]; }
+
+    UdpReceiveStats get_stats() const;
+
+    /**
+     * Current time on the clock used for arrival_us.
+     */
+    static int64_t now_us();
+
+private:
+    size_t batch_size_;
+    size_t slot_size_;
+    int fd_;
+
+    std::vector<uint8_t> storage_;
+    std::vector<UdpPacket> packets_;
+    std::vector<struct iovec> iovecs_;
+    std::vector<uint8_t> control_;
+#ifdef __linux__
+    std::vector<struct mmsghdr> headers_;
+#else
+    std::vector<struct msghdr> headers_;
+#endif
+
+    std::atomic<uint64_t> syscalls_;
+    std::atomic<uint64_t> packet_count_;
+    std::atomic<uint64_t> byte_count_;
+    std::atomic<uint64_t> kernel_drops_;
+    std::atomic<uint32_t> max_batch_;
+    int rcvbuf_bytes_;
+};
+
+} // namespace berrystreamcam
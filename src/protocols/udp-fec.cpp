@@ -0,0 +1,1062 @@
+#include "udp-fec.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <regex>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <poll.h>
+#include <unistd.h>
+#include <errno.h>
+
+namespace berrystreamcam {
+
+namespace {
+
+constexpr uint8_t MAGIC = 'B';
+constexpr uint8_t VERSION = 1;
+
+enum PacketType : uint8_t {
+    HELLO = 1,       // Receiver: what it can do
+    ACCEPT = 2,      // Sender: what it picked
+    DATA = 3,
+    PARITY = 4,
+    NACK = 5,        // Receiver: sequence numbers to send again
+    KEEPALIVE = 6,
+    KEYFRAME = 7,    // Receiver: the picture is broken until the next keyframe
+    BYE = 8,
+};
+
+// HELLO byte 3 and ACCEPT byte 3
+constexpr uint8_t FEC_XOR = 1;
+
+// HELLO and ACCEPT byte 5
+constexpr uint8_t OPTION_NACK = 1;
+
+// DATA byte 3
+constexpr uint8_t FLAG_KEYFRAME = 1;
+constexpr uint8_t FLAG_RETRANSMIT = 2;
+
+/*
+ * HELLO / ACCEPT: magic, version, type, fec, group size, options,
+ *                 latency ms (16), payload size (16), reserved (16), nonce (32)
+ *                 ACCEPT adds the next DATA sequence (32) and frame (32)
+ * DATA:           magic, version, type, flags, sequence (32), frame (32),
+ *                 index (16), count (16), pts (64), payload
+ * PARITY:         magic, version, type, count, first sequence (32),
+ *                 XOR of the lengths (16), reserved (16), XOR of the packets
+ * NACK:           magic, version, type, count, count sequences (32)
+ * Others:         magic, version, type, 0
+ */
+constexpr size_t HELLO_SIZE = 16;
+constexpr size_t ACCEPT_SIZE = 24;
+constexpr size_t DATA_HEADER_SIZE = 24;
+constexpr size_t PARITY_HEADER_SIZE = 12;
+constexpr size_t CONTROL_SIZE = 4;
+constexpr size_t MAX_NACK_ENTRIES = 255;
+
+constexpr uint8_t MAX_GROUP_SIZE = 16;
+constexpr size_t MIN_PAYLOAD_SIZE = 256;
+constexpr size_t MAX_PAYLOAD_SIZE = 1400;
+constexpr size_t MAX_DATAGRAM = DATA_HEADER_SIZE + MAX_PAYLOAD_SIZE + PARITY_HEADER_SIZE;
+
+constexpr int HANDSHAKE_ATTEMPTS = 5;
+constexpr int HANDSHAKE_RETRY_MS = 200;
+
+// Receive window for FEC and NACKs; far more than a latency window holds at our bitrates
+constexpr size_t WINDOW_PACKETS = 2048;
+constexpr size_t MAX_PENDING_FRAMES = 64;
+constexpr size_t MAX_FRAGMENTS = FRAME_BUFFER_SIZE / MIN_PAYLOAD_SIZE;
+
+// A gap younger than this is more likely reordering, or parity still on its way
+constexpr int64_t NACK_HOLD_US = 3000;
+constexpr int64_t MIN_NACK_RETRY_US = 5000;
+
+constexpr int64_t KEEPALIVE_INTERVAL_US = 1000 * 1000;
+constexpr int64_t SENDER_TIMEOUT_US = 3000 * 1000;
+constexpr int SNDBUF_BYTES = 4 * 1024 * 1024;
+
+void put_u16(uint8_t* p, uint16_t value)
+{
+    p[0] = static_cast<uint8_t>(value >> 8);
+    p[1] = static_cast<uint8_t>(value);
+}
+
+void put_u32(uint8_t* p, uint32_t value)
+{
+    put_u16(p, static_cast<uint16_t>(value >> 16));
+    put_u16(p + 2, static_cast<uint16_t>(value));
+}
+
+void put_u64(uint8_t* p, uint64_t value)
+{
+    put_u32(p, static_cast<uint32_t>(value >> 32));
+    put_u32(p + 4, static_cast<uint32_t>(value));
+}
+
+uint16_t get_u16(const uint8_t* p)
+{
+    return static_cast<uint16_t>((p[0] << 8) | p[1]);
+}
+
+uint32_t get_u32(const uint8_t* p)
+{
+    return (static_cast<uint32_t>(get_u16(p)) << 16) | get_u16(p + 2);
+}
+
+uint64_t get_u64(const uint8_t* p)
+{
+    return (static_cast<uint64_t>(get_u32(p)) << 32) | get_u32(p + 4);
+}
+
+bool is_packet(const uint8_t* packet, size_t size, uint8_t type)
+{
+    return size >= CONTROL_SIZE && packet[0] == MAGIC && packet[1] == VERSION && packet[2] == type;
+}
+
+// The 32-bit value on the wire, taken as the 64-bit one nearest to reference
+uint64_t extend(uint32_t value, uint64_t reference)
+{
+    return reference + static_cast<int32_t>(value - static_cast<uint32_t>(reference));
+}
+
+} // namespace
+
+std::unique_ptr<UdpFecSender> UdpFecSender::create(int port, uint8_t max_group_size, size_t payload_size)
+{
+    if (payload_size < MIN_PAYLOAD_SIZE || payload_size > MAX_PAYLOAD_SIZE) {
+        BLOG_WARNING("UDP FEC payload size %zu outside %zu-%zu", payload_size, MIN_PAYLOAD_SIZE, MAX_PAYLOAD_SIZE);
+        return nullptr;
+    }
+
+    int fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return nullptr;
+    }
+
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(static_cast<uint16_t>(port));
+    socklen_t length = sizeof(addr);
+    if (bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 ||
+        getsockname(fd, reinterpret_cast<sockaddr*>(&addr), &length) != 0) {
+        BLOG_WARNING("Failed to bind UDP FEC port %d: %s", port, strerror(errno));
+        close(fd);
+        return nullptr;
+    }
+
+    // A keyframe goes out in one burst
+    int sndbuf = SNDBUF_BYTES;
+    setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+
+    std::unique_ptr<UdpFecSender> sender(new UdpFecSender(fd, ntohs(addr.sin_port),
+                                                          std::min(max_group_size, MAX_GROUP_SIZE), payload_size));
+    sender->watch_ = sender->reactor_->add(fd, [raw = sender.get()]() { raw->on_readable(); });
+    if (sender->watch_ == 0) {
+        return nullptr;
+    }
+
+    BLOG_INFO("UDP FEC sender on port %d", sender->port_);
+    return sender;
+}
+
+UdpFecSender::UdpFecSender(int fd, int port, uint8_t max_group_size, size_t max_payload_size)
+    : fd_(fd)
+    , port_(port)
+    , max_group_size_(max_group_size)
+    , max_payload_size_(max_payload_size)
+    , reactor_(NetworkReactor::acquire())
+    , watch_(0)
+    , receiver_{}
+    , has_receiver_(false)
+    , last_heard_us_(0)
+    , group_size_(0)
+    , payload_size_(max_payload_size)
+    , nack_(false)
+    , latency_ms_(UdpFecTransport::DEFAULT_LATENCY_MS)
+    , keyframe_requested_(false)
+    , sequence_(0)
+    , frame_id_(0)
+    , history_(HISTORY_PACKETS)
+    , group_base_(0)
+    , group_count_(0)
+    , group_length_xor_(0)
+    , stats_{}
+{
+}
+
+UdpFecSender::~UdpFecSender()
+{
+    if (watch_ != 0) {
+        reactor_->remove(watch_);
+    }
+    close(fd_);
+}
+
+bool UdpFecSender::send(const VideoFrame& frame)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    int64_t now = UdpBatchReceiver::now_us();
+    if (has_receiver_ && now - last_heard_us_ > RECEIVER_TIMEOUT_MS * 1000LL) {
+        BLOG_INFO("UDP FEC receiver went quiet");
+        has_receiver_ = false;
+    }
+    if (!has_receiver_) {
+        return false;
+    }
+
+    size_t count = std::max<size_t>(1, (frame.size + payload_size_ - 1) / payload_size_);
+    if (count > MAX_FRAGMENTS) {
+        BLOG_WARNING("Frame of %zu bytes too large for UDP FEC", frame.size);
+        return false;
+    }
+
+    uint32_t frame_id = frame_id_++;
+    for (size_t index = 0; index < count; index++) {
+        size_t offset = index * payload_size_;
+        size_t length = std::min(payload_size_, frame.size - std::min(frame.size, offset));
+
+        Sent& sent = history_[sequence_ % HISTORY_PACKETS];
+        sent.packet.resize(DATA_HEADER_SIZE + length);
+        sent.sequence = sequence_;
+        sent.sent_us = now;
+
+        uint8_t* packet = sent.packet.data();
+        packet[0] = MAGIC;
+        packet[1] = VERSION;
+        packet[2] = DATA;
+        packet[3] = frame.is_keyframe ? FLAG_KEYFRAME : 0;
+        put_u32(packet + 4, static_cast<uint32_t>(sequence_));
+        put_u32(packet + 8, frame_id);
+        put_u16(packet + 12, static_cast<uint16_t>(index));
+        put_u16(packet + 14, static_cast<uint16_t>(count));
+        put_u64(packet + 16, static_cast<uint64_t>(frame.pts));
+        if (length > 0) {
+            memcpy(packet + DATA_HEADER_SIZE, frame.data + offset, length);
+        }
+        send_packet(packet, sent.packet.size());
+        stats_.packets++;
+
+        if (group_size_ > 0) {
+            if (group_count_ == 0) {
+                group_base_ = sequence_;
+            }
+            if (parity_.size() < sent.packet.size()) {
+                parity_.resize(sent.packet.size(), 0);
+            }
+            for (size_t i = 0; i < sent.packet.size(); i++) {
+                parity_[i] ^= packet[i];
+            }
+            group_length_xor_ ^= static_cast<uint16_t>(sent.packet.size());
+            if (++group_count_ == group_size_) {
+                close_group();
+            }
+        }
+        sequence_++;
+    }
+
+    // Parity goes out with the frame rather than waiting for the next one
+    if (group_count_ > 0) {
+        close_group();
+    }
+    stats_.frames++;
+    return true;
+}
+
+bool UdpFecSender::has_receiver() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return has_receiver_;
+}
+
+bool UdpFecSender::take_keyframe_request()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    bool requested = keyframe_requested_;
+    keyframe_requested_ = false;
+    return requested;
+}
+
+UdpFecSenderStats UdpFecSender::stats() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+void UdpFecSender::close_group()
+{
+    std::vector<uint8_t> packet(PARITY_HEADER_SIZE + parity_.size());
+    packet[0] = MAGIC;
+    packet[1] = VERSION;
+    packet[2] = PARITY;
+    packet[3] = group_count_;
+    put_u32(packet.data() + 4, static_cast<uint32_t>(group_base_));
+    put_u16(packet.data() + 8, group_length_xor_);
+    memcpy(packet.data() + PARITY_HEADER_SIZE, parity_.data(), parity_.size());
+    send_packet(packet.data(), packet.size());
+    stats_.parity_packets++;
+
+    std::fill(parity_.begin(), parity_.end(), 0);
+    group_count_ = 0;
+    group_length_xor_ = 0;
+}
+
+void UdpFecSender::send_packet(const uint8_t* packet, size_t size)
+{
+    // A full socket buffer loses the packet like the network would
+    sendto(fd_, packet, size, 0, reinterpret_cast<const sockaddr*>(&receiver_), sizeof(receiver_));
+}
+
+void UdpFecSender::on_readable()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    uint8_t packet[MAX_DATAGRAM];
+    for (;;) {
+        sockaddr_in from;
+        socklen_t from_length = sizeof(from);
+        ssize_t received = recvfrom(fd_, packet, sizeof(packet), 0,
+                                    reinterpret_cast<sockaddr*>(&from), &from_length);
+        if (received < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return;
+        }
+
+        size_t size = static_cast<size_t>(received);
+        if (is_packet(packet, size, HELLO)) {
+            handle_hello(packet, size, from);
+            continue;
+        }
+
+        // Everything else only from the receiver we stream to
+        if (!has_receiver_ || from.sin_addr.s_addr != receiver_.sin_addr.s_addr ||
+            from.sin_port != receiver_.sin_port) {
+            continue;
+        }
+        last_heard_us_ = UdpBatchReceiver::now_us();
+
+        if (is_packet(packet, size, NACK)) {
+            handle_nack(packet, size);
+        } else if (is_packet(packet, size, KEYFRAME)) {
+            keyframe_requested_ = true;
+            stats_.keyframe_requests++;
+        } else if (is_packet(packet, size, BYE)) {
+            BLOG_INFO("UDP FEC receiver said goodbye");
+            has_receiver_ = false;
+        }
+    }
+}
+
+void UdpFecSender::handle_hello(const uint8_t* packet, size_t size, const sockaddr_in& from)
+{
+    if (size < HELLO_SIZE) {
+        return;
+    }
+
+    bool same = has_receiver_ && from.sin_addr.s_addr == receiver_.sin_addr.s_addr &&
+                from.sin_port == receiver_.sin_port;
+
+    // Both sides must do XOR parity and NACKs for either to be used
+    uint8_t group = (packet[3] & FEC_XOR) ? std::min(packet[4], max_group_size_) : 0;
+    bool nack = (packet[5] & OPTION_NACK) != 0;
+    int latency = std::max<int>(UdpFecTransport::MIN_LATENCY_MS,
+                                std::min<int>(UdpFecTransport::MAX_LATENCY_MS, get_u16(packet + 6)));
+    size_t payload = std::min<size_t>(get_u16(packet + 8), max_payload_size_);
+    if (payload < MIN_PAYLOAD_SIZE) {
+        return;
+    }
+
+    if (!same) {
+        // A partly sent group means nothing to the new receiver, and it needs a keyframe
+        std::fill(parity_.begin(), parity_.end(), 0);
+        group_count_ = 0;
+        group_length_xor_ = 0;
+        keyframe_requested_ = true;
+
+        char address[INET_ADDRSTRLEN] = "";
+        inet_ntop(AF_INET, &from.sin_addr, address, sizeof(address));
+        BLOG_INFO("UDP FEC receiver %s:%d (group %u, NACK %s, %d ms)", address, ntohs(from.sin_port),
+                  group, nack ? "on" : "off", latency);
+    }
+
+    receiver_ = from;
+    has_receiver_ = true;
+    last_heard_us_ = UdpBatchReceiver::now_us();
+    if (same && group != group_size_) {
+        group_count_ = 0;
+        group_length_xor_ = 0;
+        std::fill(parity_.begin(), parity_.end(), 0);
+    }
+    group_size_ = group;
+    payload_size_ = payload;
+    nack_ = nack;
+    latency_ms_ = latency;
+
+    uint8_t accept[ACCEPT_SIZE] = {};
+    accept[0] = MAGIC;
+    accept[1] = VERSION;
+    accept[2] = ACCEPT;
+    accept[3] = group > 0 ? FEC_XOR : 0;
+    accept[4] = group;
+    accept[5] = nack ? OPTION_NACK : 0;
+    put_u16(accept + 6, static_cast<uint16_t>(latency));
+    put_u16(accept + 8, static_cast<uint16_t>(payload));
+    memcpy(accept + 12, packet + 12, 4);
+    put_u32(accept + 16, static_cast<uint32_t>(sequence_));
+    put_u32(accept + 20, frame_id_);
+    send_packet(accept, sizeof(accept));
+}
+
+void UdpFecSender::handle_nack(const uint8_t* packet, size_t size)
+{
+    if (!nack_) {
+        return;
+    }
+
+    size_t count = std::min<size_t>(packet[3], (size - CONTROL_SIZE) / 4);
+    int64_t now = UdpBatchReceiver::now_us();
+    for (size_t i = 0; i < count; i++) {
+        uint64_t sequence = extend(get_u32(packet + CONTROL_SIZE + i * 4), sequence_);
+        if (sequence >= sequence_ || sequence_ - sequence > HISTORY_PACKETS) {
+            continue;
+        }
+
+        Sent& sent = history_[sequence % HISTORY_PACKETS];
+        if (sent.sequence != sequence || sent.packet.empty()) {
+            continue;
+        }
+
+        // The receiver has given up on it by now
+        if (now - sent.sent_us > latency_ms_ * 1000LL) {
+            stats_.retransmits_expired++;
+            continue;
+        }
+
+        sent.packet[3] |= FLAG_RETRANSMIT;
+        send_packet(sent.packet.data(), sent.packet.size());
+        sent.packet[3] &= ~FLAG_RETRANSMIT;
+        stats_.retransmitted++;
+    }
+}
+
+UdpFecTransport::UdpFecTransport()
+    : reactor_(NetworkReactor::acquire())
+    , watch_(0)
+    , tick_timer_(0)
+    , connected_(false)
+    , profile_(network_profile_from_name("balanced"))
+    , latency_setting_ms_(DEFAULT_LATENCY_MS)
+    , tuning_{}
+    , socket_(-1)
+    , group_size_(0)
+    , nack_(false)
+    , latency_ms_(DEFAULT_LATENCY_MS)
+    , payload_size_(UdpFecSender::DEFAULT_PAYLOAD_SIZE)
+    , rtt_ms_(-1)
+    , first_sequence_(0)
+    , first_frame_(0)
+    , window_(WINDOW_PACKETS)
+    , highest_(0)
+    , next_frame_(0)
+    , need_keyframe_(true)
+    , last_keyframe_request_us_(0)
+    , last_keepalive_us_(0)
+    , last_packet_us_(0)
+    , stats_{}
+{
+}
+
+UdpFecTransport::~UdpFecTransport()
+{
+    disconnect();
+}
+
+ProtocolType UdpFecTransport::protocol() const
+{
+    return ProtocolType::UDP_FEC;
+}
+
+bool UdpFecTransport::connect(const std::string& url)
+{
+    std::lock_guard<std::mutex> lock(control_mutex_);
+
+    std::regex url_regex(R"((?:udpfec://)?([^:/?]+)(?::(\d+))?/?(?:\?group=(\d+))?)");
+    std::smatch matches;
+    if (!std::regex_match(url, matches, url_regex)) {
+        BLOG_ERROR("Invalid UDP FEC URL: %s", url.c_str());
+        return false;
+    }
+    std::string host = matches[1].str();
+    std::string port = matches[2].matched ? matches[2].str() : std::to_string(UDP_FEC_PORT);
+    uint8_t max_group_size = matches[3].matched
+        ? static_cast<uint8_t>(std::min<long>(std::strtol(matches[3].str().c_str(), nullptr, 10), MAX_GROUP_SIZE))
+        : MAX_GROUP_SIZE;
+
+    addrinfo hints = {};
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_DGRAM;
+    addrinfo* address = nullptr;
+    if (getaddrinfo(host.c_str(), port.c_str(), &hints, &address) != 0 || !address) {
+        BLOG_ERROR("Cannot resolve UDP FEC sender %s", host.c_str());
+        return false;
+    }
+
+    // Connected, so the kernel only lets the sender's packets through
+    int fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    bool ok = fd >= 0 && ::connect(fd, address->ai_addr, address->ai_addrlen) == 0;
+    freeaddrinfo(address);
+    if (!ok) {
+        BLOG_ERROR("Failed to open UDP FEC socket: %s", strerror(errno));
+        if (fd >= 0) {
+            close(fd);
+        }
+        return false;
+    }
+
+    // A session already running ends here, without a BYE: the sender moves to this one
+    close_session(false);
+
+    {
+        std::lock_guard<std::mutex> settings_lock(settings_mutex_);
+        latency_ms_ = latency_setting_ms_;
+
+        // The batch receiver sizes the buffer; the profile adds busy-poll and DSCP
+        NetworkProfile media_profile = profile_;
+        udp_receiver_.attach(fd, std::max(profile_.rcvbuf_bytes, UdpBatchReceiver::DEFAULT_RCVBUF_BYTES));
+        media_profile.rcvbuf_bytes = 0;
+        tuning_ = apply_network_profile(fd, media_profile, false);
+        tuning_.rcvbuf_bytes = udp_receiver_.get_stats().rcvbuf_bytes;
+    }
+
+    if (!handshake(fd, host, max_group_size)) {
+        close(fd);
+        return false;
+    }
+
+    {
+        std::lock_guard<std::mutex> io_lock(io_mutex_);
+        socket_ = fd;
+        reset_state();
+    }
+    frame_queue_.clear();
+    connected_ = true;
+    watch_ = reactor_->add(fd, [this]() { on_readable(); });
+    tick_timer_ = reactor_->add_timer(TICK_MS, [this]() { on_tick(); });
+
+    BLOG_INFO("UDP FEC session with %s: group %u, NACK %s, %d ms window, RTT %.1f ms",
+              host.c_str(), group_size_, nack_ ? "on" : "off", latency_ms_, rtt_ms_);
+    return true;
+}
+
+void UdpFecTransport::disconnect()
+{
+    // A handshake holding the lock gives up instead of running out its retries
+    connect_stop_.stop();
+    std::lock_guard<std::mutex> lock(control_mutex_);
+    connect_stop_.reset();
+    close_session(true);
+}
+
+void UdpFecTransport::interrupt()
+{
+    connect_stop_.stop();
+}
+
+void UdpFecTransport::close_session(bool say_bye)
+{
+    // No callback is running or will run once this returns
+    unwatch();
+
+    if (connected_.exchange(false) || socket_ >= 0) {
+        if (say_bye && socket_ >= 0) {
+            send_control(BYE);
+        }
+
+        std::lock_guard<std::mutex> io_lock(io_mutex_);
+        if (stats_.packets_received > 0) {
+            BLOG_INFO("UDP FEC: %llu packets, %llu rebuilt from parity, %llu retransmitted, "
+                      "%llu unrecoverable, %llu frames (%llu dropped)",
+                      static_cast<unsigned long long>(stats_.packets_received),
+                      static_cast<unsigned long long>(stats_.packets_recovered),
+                      static_cast<unsigned long long>(stats_.packets_retransmitted),
+                      static_cast<unsigned long long>(stats_.packets_unrecoverable),
+                      static_cast<unsigned long long>(stats_.frames_completed),
+                      static_cast<unsigned long long>(stats_.frames_dropped));
+        }
+        frames_.clear();
+        if (socket_ >= 0) {
+            close(socket_);
+            socket_ = -1;
+        }
+    }
+    frame_queue_.clear();
+}
+
+bool UdpFecTransport::is_connected() const
+{
+    return connected_;
+}
+
+bool UdpFecTransport::receive_frame(VideoFrame& frame)
+{
+    return frame_queue_.pop(frame);
+}
+
+void UdpFecTransport::set_latency_ms(int latency_ms)
+{
+    std::lock_guard<std::mutex> lock(settings_mutex_);
+    latency_setting_ms_ = std::max(MIN_LATENCY_MS, std::min(MAX_LATENCY_MS, latency_ms));
+}
+
+void UdpFecTransport::set_network_profile(const NetworkProfile& profile)
+{
+    std::lock_guard<std::mutex> lock(settings_mutex_);
+    profile_ = profile;
+}
+
+SocketTuning UdpFecTransport::get_socket_tuning() const
+{
+    std::lock_guard<std::mutex> lock(settings_mutex_);
+    return tuning_;
+}
+
+UdpFecStats UdpFecTransport::stats() const
+{
+    std::lock_guard<std::mutex> lock(io_mutex_);
+    return stats_;
+}
+
+bool UdpFecTransport::handshake(int fd, const std::string& host, uint8_t max_group_size)
+{
+    uint8_t hello[HELLO_SIZE] = {};
+    hello[0] = MAGIC;
+    hello[1] = VERSION;
+    hello[2] = HELLO;
+    hello[3] = max_group_size > 0 ? FEC_XOR : 0;
+    hello[4] = max_group_size;
+    hello[5] = OPTION_NACK;
+    put_u16(hello + 6, static_cast<uint16_t>(latency_ms_));
+    put_u16(hello + 8, static_cast<uint16_t>(MAX_PAYLOAD_SIZE));
+    uint32_t nonce = std::random_device()();
+    put_u32(hello + 12, nonce);
+
+    uint8_t answer[MAX_DATAGRAM];
+    for (int attempt = 0; attempt < HANDSHAKE_ATTEMPTS; attempt++) {
+        int64_t sent_us = UdpBatchReceiver::now_us();
+        send(fd, hello, sizeof(hello), 0);
+
+        // Stream packets from an earlier session may still be on their way
+        int64_t deadline_us = sent_us + HANDSHAKE_RETRY_MS * 1000LL;
+        for (int64_t now = sent_us; now < deadline_us; now = UdpBatchReceiver::now_us()) {
+            int ready = connect_stop_.wait(fd, POLLIN, static_cast<int>((deadline_us - now + 999) / 1000));
+            if (ready < 0) {
+                return false;
+            }
+            if (ready == 0) {
+                break;
+            }
+            ssize_t received = recv(fd, answer, sizeof(answer), 0);
+            if (received < static_cast<ssize_t>(ACCEPT_SIZE) ||
+                !is_packet(answer, static_cast<size_t>(received), ACCEPT) || get_u32(answer + 12) != nonce) {
+                continue;
+            }
+
+            size_t payload = get_u16(answer + 8);
+            if (answer[4] > MAX_GROUP_SIZE || payload < MIN_PAYLOAD_SIZE || payload > MAX_PAYLOAD_SIZE) {
+                BLOG_WARNING("UDP FEC sender %s accepted with unusable settings", host.c_str());
+                return false;
+            }
+
+            std::lock_guard<std::mutex> io_lock(io_mutex_);
+            group_size_ = (answer[3] & FEC_XOR) ? answer[4] : 0;
+            nack_ = (answer[5] & OPTION_NACK) != 0;
+            payload_size_ = payload;
+            rtt_ms_ = (UdpBatchReceiver::now_us() - sent_us) / 1000.0;
+            first_sequence_ = get_u32(answer + 16);
+            first_frame_ = get_u32(answer + 20);
+            return true;
+        }
+    }
+
+    BLOG_WARNING("No UDP FEC sender answered at %s", host.c_str());
+    return false;
+}
+
+void UdpFecTransport::reset_state()
+{
+    for (Held& held : window_) {
+        held.present = false;
+    }
+
+    // Known from ACCEPT, so even the first packets sent can be missed and asked for.
+    // Far enough from zero for the 32-bit numbers on the wire to go either way.
+    highest_ = static_cast<uint64_t>(first_sequence_) + (1ULL << 32) - 1;
+    next_frame_ = static_cast<uint64_t>(first_frame_) + (1ULL << 32);
+    missing_.clear();
+    parities_.clear();
+    frames_.clear();
+    need_keyframe_ = true;
+    last_keyframe_request_us_ = 0;
+    last_keepalive_us_ = UdpBatchReceiver::now_us();
+    last_packet_us_ = last_keepalive_us_;
+
+    double rtt_ms = rtt_ms_;
+    stats_ = {};
+    stats_.group_size = group_size_;
+    stats_.nack = nack_;
+    stats_.latency_ms = latency_ms_;
+    stats_.rtt_ms = rtt_ms;
+}
+
+uint64_t UdpFecTransport::extend_sequence(uint32_t sequence) const
+{
+    return extend(sequence, highest_);
+}
+
+void UdpFecTransport::on_readable()
+{
+    std::lock_guard<std::mutex> lock(io_mutex_);
+
+    int64_t now = UdpBatchReceiver::now_us();
+    size_t count;
+    do {
+        count = udp_receiver_.receive();
+        for (size_t i = 0; i < count; i++) {
+            const UdpPacket& packet = udp_receiver_.packet(i);
+            if (is_packet(packet.data, packet.size, DATA)) {
+                handle_data(packet.data, packet.size, now, false);
+            } else if (is_packet(packet.data, packet.size, PARITY)) {
+                handle_parity(packet.data, packet.size, now);
+            } else {
+                continue;
+            }
+            last_packet_us_ = now;
+        }
+    } while (count == UdpBatchReceiver::DEFAULT_BATCH_SIZE);
+
+    deliver(now);
+    send_nacks(now);
+}
+
+void UdpFecTransport::on_tick()
+{
+    std::lock_guard<std::mutex> lock(io_mutex_);
+
+    int64_t now = UdpBatchReceiver::now_us();
+    int64_t window_us = latency_ms_ * 1000LL;
+
+    // Given up on: too old to be worth asking for, or out of the receive window
+    for (auto it = missing_.begin(); it != missing_.end();) {
+        if (now - it->second.since_us >= window_us || it->first + WINDOW_PACKETS <= highest_) {
+            stats_.packets_unrecoverable++;
+            it = missing_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    for (auto it = parities_.begin(); it != parities_.end();) {
+        it = now - it->second.arrival_us >= window_us ? parities_.erase(it) : std::next(it);
+    }
+
+    deliver(now);
+    send_nacks(now);
+
+    if (now - last_keepalive_us_ >= KEEPALIVE_INTERVAL_US) {
+        send_control(KEEPALIVE);
+        last_keepalive_us_ = now;
+    }
+
+    if (connected_ && now - last_packet_us_ > SENDER_TIMEOUT_US) {
+        BLOG_WARNING("UDP FEC sender stopped sending");
+        connected_ = false;
+    }
+}
+
+void UdpFecTransport::handle_data(const uint8_t* packet, size_t size, int64_t now_us, bool recovered)
+{
+    if (size < DATA_HEADER_SIZE || size > DATA_HEADER_SIZE + payload_size_) {
+        return;
+    }
+
+    uint64_t sequence = extend_sequence(get_u32(packet + 4));
+    if (sequence + WINDOW_PACKETS <= highest_) {
+        return;   // Far too late to be of use
+    }
+
+    Held& held = window_[sequence % WINDOW_PACKETS];
+    if (held.present && held.sequence == sequence) {
+        stats_.packets_duplicate++;
+        return;
+    }
+
+    if (sequence > highest_) {
+        if (sequence - highest_ > WINDOW_PACKETS) {
+            // The sender jumped ahead; what lies between is out of reach
+            stats_.packets_unrecoverable += missing_.size();
+            missing_.clear();
+        } else {
+            for (uint64_t lost = highest_ + 1; lost < sequence; lost++) {
+                missing_[lost] = { now_us, 0 };
+            }
+        }
+        highest_ = sequence;
+    } else {
+        // Filling a hole, unless it was given up on already
+        auto it = missing_.find(sequence);
+        if (it == missing_.end()) {
+            return;
+        }
+        if (!recovered && (packet[3] & FLAG_RETRANSMIT)) {
+            stats_.packets_retransmitted++;
+        }
+        missing_.erase(it);
+    }
+
+    held.packet.assign(packet, packet + size);
+    held.packet[3] &= ~FLAG_RETRANSMIT;
+    held.sequence = sequence;
+    held.present = true;
+    if (recovered) {
+        stats_.packets_recovered++;
+    } else {
+        stats_.packets_received++;
+    }
+
+    // Into its frame, unless that frame is already out or given up on
+    uint64_t frame_id = extend(get_u32(packet + 8), next_frame_);
+    uint16_t index = get_u16(packet + 12);
+    uint16_t count = get_u16(packet + 14);
+    size_t length = size - DATA_HEADER_SIZE;
+    bool fits = count > 0 && index < count && count <= MAX_FRAGMENTS &&
+                (index == count - 1 ? length <= payload_size_ : length == payload_size_);
+    if (frame_id >= next_frame_ && fits) {
+        Assembly& frame = frames_[frame_id];
+        if (!frame.data) {
+            frame.data.reset(new uint8_t[count * payload_size_]);
+            frame.have.assign(count, false);
+            frame.count = count;
+            frame.received = 0;
+            frame.size = 0;
+            frame.pts = static_cast<int64_t>(get_u64(packet + 16));
+            frame.keyframe = (packet[3] & FLAG_KEYFRAME) != 0;
+            frame.first_us = now_us;
+        }
+        if (frame.count == count && !frame.have[index]) {
+            memcpy(frame.data.get() + index * payload_size_, packet + DATA_HEADER_SIZE, length);
+            frame.have[index] = true;
+            frame.received++;
+            if (index == count - 1) {
+                frame.size = index * payload_size_ + length;
+            }
+        }
+    }
+
+    // This may be the last piece its parity group was waiting for
+    auto parity = parities_.upper_bound(sequence);
+    if (parity != parities_.begin()) {
+        --parity;
+        if (sequence < parity->first + parity->second.count) {
+            try_recover(parity->first, now_us);
+        }
+    }
+}
+
+void UdpFecTransport::handle_parity(const uint8_t* packet, size_t size, int64_t now_us)
+{
+    if (size < PARITY_HEADER_SIZE || packet[3] == 0 ||
+        size > PARITY_HEADER_SIZE + DATA_HEADER_SIZE + payload_size_) {
+        return;
+    }
+
+    uint64_t base = extend_sequence(get_u32(packet + 4));
+    uint64_t last = base + packet[3] - 1;
+    if (last + WINDOW_PACKETS <= highest_ || parities_.count(base) > 0) {
+        return;
+    }
+
+    // Losses at the end of a group show up here first
+    if (last > highest_ && last - highest_ <= WINDOW_PACKETS) {
+        for (uint64_t lost = highest_ + 1; lost <= last; lost++) {
+            missing_[lost] = { now_us, 0 };
+        }
+        highest_ = last;
+    }
+
+    Parity& parity = parities_[base];
+    parity.bytes.assign(packet + PARITY_HEADER_SIZE, packet + size);
+    parity.length_xor = get_u16(packet + 8);
+    parity.count = packet[3];
+    parity.arrival_us = now_us;
+    try_recover(base, now_us);
+}
+
+void UdpFecTransport::try_recover(uint64_t base, int64_t now_us)
+{
+    auto it = parities_.find(base);
+    if (it == parities_.end()) {
+        return;
+    }
+
+    size_t lost_count = 0;
+    uint64_t lost = 0;
+    for (uint64_t sequence = base; sequence < base + it->second.count; sequence++) {
+        const Held& held = window_[sequence % WINDOW_PACKETS];
+        if (!held.present || held.sequence != sequence) {
+            lost_count++;
+            lost = sequence;
+        }
+    }
+    if (lost_count > 1) {
+        return;   // Needs a NACK answered first
+    }
+
+    Parity parity = std::move(it->second);
+    parities_.erase(it);
+    if (lost_count == 0 || missing_.count(lost) == 0) {
+        return;
+    }
+
+    // The one packet missing is the XOR of the parity with all the others
+    std::vector<uint8_t> rebuilt = std::move(parity.bytes);
+    uint16_t length = parity.length_xor;
+    for (uint64_t sequence = base; sequence < base + parity.count; sequence++) {
+        if (sequence == lost) {
+            continue;
+        }
+        const std::vector<uint8_t>& packet = window_[sequence % WINDOW_PACKETS].packet;
+        if (packet.size() > rebuilt.size()) {
+            return;
+        }
+        for (size_t i = 0; i < packet.size(); i++) {
+            rebuilt[i] ^= packet[i];
+        }
+        length ^= static_cast<uint16_t>(packet.size());
+    }
+
+    if (length > rebuilt.size() || !is_packet(rebuilt.data(), length, DATA) || length < DATA_HEADER_SIZE ||
+        extend_sequence(get_u32(rebuilt.data() + 4)) != lost) {
+        return;
+    }
+    handle_data(rebuilt.data(), length, now_us, true);
+}
+
+void UdpFecTransport::deliver(int64_t now_us)
+{
+    int64_t window_us = latency_ms_ * 1000LL;
+
+    while (!frames_.empty()) {
+        auto it = frames_.begin();
+        Assembly& frame = it->second;
+
+        // Wait for the next frame in order; a frame none of whose packets came
+        // yet is waited for as long as the one after it
+        bool complete = it->first == next_frame_ && frame.received == frame.count;
+        if (!complete) {
+            if (now_us - frame.first_us < window_us && frames_.size() <= MAX_PENDING_FRAMES) {
+                break;
+            }
+            drop_frame(now_us);
+            continue;
+        }
+
+        if (need_keyframe_ && !frame.keyframe) {
+            stats_.frames_dropped++;
+        } else {
+            need_keyframe_ = false;
+
+            VideoFrame out = {};
+            out.data = frame.data.release();
+            out.size = frame.size;
+            out.timestamp = frame.pts;
+            out.pts = frame.pts;
+            out.dts = frame.pts;
+            out.is_keyframe = frame.keyframe;
+            frame_queue_.push(std::move(out));
+            stats_.frames_completed++;
+        }
+        frames_.erase(it);
+        next_frame_++;
+    }
+}
+
+void UdpFecTransport::drop_frame(int64_t now_us)
+{
+    if (!frames_.empty() && frames_.begin()->first == next_frame_) {
+        frames_.erase(frames_.begin());
+    }
+    next_frame_++;
+    stats_.frames_dropped++;
+
+    // Later frames reference the one lost; ask for a fresh start, once per window
+    if (!need_keyframe_ || now_us - last_keyframe_request_us_ >= latency_ms_ * 1000LL) {
+        send_control(KEYFRAME);
+        stats_.keyframe_requests++;
+        last_keyframe_request_us_ = now_us;
+    }
+    need_keyframe_ = true;
+}
+
+void UdpFecTransport::send_nacks(int64_t now_us)
+{
+    if (!nack_ || missing_.empty()) {
+        return;
+    }
+
+    // Asked again after a round trip or so; not at all once the answer would come too late
+    int64_t rtt_us = static_cast<int64_t>(std::max(0.0, rtt_ms_) * 1000);
+    int64_t retry_us = std::max(MIN_NACK_RETRY_US, 2 * rtt_us);
+    int64_t window_us = latency_ms_ * 1000LL;
+
+    uint8_t packet[CONTROL_SIZE + MAX_NACK_ENTRIES * 4];
+    packet[0] = MAGIC;
+    packet[1] = VERSION;
+    packet[2] = NACK;
+    size_t count = 0;
+
+    for (auto& [sequence, missing] : missing_) {
+        int64_t age = now_us - missing.since_us;
+        if (age < NACK_HOLD_US || age + rtt_us > window_us ||
+            (missing.nacked_us != 0 && now_us - missing.nacked_us < retry_us)) {
+            continue;
+        }
+        put_u32(packet + CONTROL_SIZE + count * 4, static_cast<uint32_t>(sequence));
+        missing.nacked_us = now_us;
+        stats_.nacks_sent++;
+
+        if (++count == MAX_NACK_ENTRIES) {
+            packet[3] = static_cast<uint8_t>(count);
+            send(socket_, packet, CONTROL_SIZE + count * 4, 0);
+            count = 0;
+        }
+    }
+
+    if (count > 0) {
+        packet[3] = static_cast<uint8_t>(count);
+        send(socket_, packet, CONTROL_SIZE + count * 4, 0);
+    }
+}
+
+void UdpFecTransport::send_control(uint8_t type)
+{
+    uint8_t packet[CONTROL_SIZE] = { MAGIC, VERSION, type, 0 };
+    send(socket_, packet, sizeof(packet), 0);
+}
+
+void UdpFecTransport::unwatch()
+{
+    for (std::atomic<NetworkReactor::Id>* watch : { &watch_, &tick_timer_ }) {
+        NetworkReactor::Id id = watch->exchange(0);
+        if (id != 0) {
+            reactor_->remove(id);
+        }
+    }
+}
+
+} // namespace berrystreamcam
@@ -0,0 +1,271 @@
+#pragma once
+
+#include "../common.hpp"
+#include "frame-queue.hpp"
+#include "network-reactor.hpp"
+#include "socket-tuning.hpp"
+#include "transport.hpp"
+#include "udp-batch-receiver.hpp"
+#include "../discovery/stop-signal.hpp"
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <netinet/in.h>
+
+namespace berrystreamcam {
+
+/**
+ * Low-latency media over plain UDP, for Wi-Fi where TCP stalls on every
+ * lost segment. Frames are cut into DATA packets with one sequence space;
+ * after each group of up to group_size packets, and at the end of every
+ * frame, the sender adds a PARITY packet holding the XOR of the group, so
+ * any one loss per group is rebuilt on arrival. What FEC cannot rebuild
+ * the receiver asks for again with a NACK, but only while the answer can
+ * still arrive inside the latency window; after that the packet counts as
+ * unrecoverable and the frame is dropped up to the next keyframe.
+ *
+ * Packets start with magic 'B', version and type. The receiver opens the
+ * session with HELLO, carrying what it can do (XOR FEC, largest group,
+ * NACK, latency window, largest payload); the sender answers ACCEPT with
+ * what it picked, or nothing if it speaks another version.
+ */
+
+struct UdpFecStats {
+    uint64_t packets_received;      // DATA packets that arrived, retransmits included
+    uint64_t packets_recovered;     // Rebuilt from parity
+    uint64_t packets_retransmitted; // Holes filled by an answered NACK
+    uint64_t packets_unrecoverable; // Still missing when the latency window ran out
+    uint64_t packets_duplicate;
+    uint64_t nacks_sent;            // Sequence numbers asked for, counting repeats
+    uint64_t frames_completed;
+    uint64_t frames_dropped;        // Incomplete in time, or waiting for a keyframe
+    uint64_t keyframe_requests;
+    uint32_t group_size;            // Negotiated; 0 without FEC
+    bool nack;
+    int latency_ms;
+    double rtt_ms;                  // From the handshake, or -1
+};
+
+struct UdpFecSenderStats {
+    uint64_t frames;
+    uint64_t packets;
+    uint64_t parity_packets;
+    uint64_t retransmitted;
+    uint64_t retransmits_expired;   // Asked for after the latency window, not sent
+    uint64_t keyframe_requests;
+};
+
+/**
+ * Sending side, for the app and for tools on this network. Binds a UDP
+ * port and streams to whichever receiver said HELLO last; a receiver that
+ * stops sending keepalives is dropped after RECEIVER_TIMEOUT_MS.
+ * send() is called from one thread; NACKs are answered on the shared
+ * NetworkReactor from a history of recent packets.
+ */
+class UdpFecSender {
+public:
+    static constexpr uint8_t DEFAULT_GROUP_SIZE = 8;
+    static constexpr size_t DEFAULT_PAYLOAD_SIZE = 1200;
+    static constexpr size_t HISTORY_PACKETS = 4096;
+    static constexpr int RECEIVER_TIMEOUT_MS = 3000;
+
+    /**
+     * port 0 picks a free one. max_group_size 0 sends no parity.
+     */
+    static std::unique_ptr<UdpFecSender> create(int port = 0,
+                                                uint8_t max_group_size = DEFAULT_GROUP_SIZE,
+                                                size_t payload_size = DEFAULT_PAYLOAD_SIZE);
+
+    ~UdpFecSender();
+
+    UdpFecSender(const UdpFecSender&) = delete;
+    UdpFecSender& operator=(const UdpFecSender&) = delete;
+
+    int port() const { return port_; }
+
+    /**
+     * False if no receiver is listening.
+     */
+    bool send(const VideoFrame& frame);
+
+    bool has_receiver() const;
+
+    /**
+     * True once per request from the receiver for a fresh keyframe.
+     */
+    bool take_keyframe_request();
+
+    UdpFecSenderStats stats() const;
+
+private:
+    struct Sent {
+        std::vector<uint8_t> packet;
+        uint64_t sequence;
+        int64_t sent_us;
+    };
+
+    UdpFecSender(int fd, int port, uint8_t max_group_size, size_t max_payload_size);
+
+    void on_readable();
+    void handle_hello(const uint8_t* packet, size_t size, const sockaddr_in& from);
+    void handle_nack(const uint8_t* packet, size_t size);
+    void send_packet(const uint8_t* packet, size_t size);
+    void close_group();
+
+    int fd_;
+    int port_;
+    uint8_t max_group_size_;
+    size_t max_payload_size_;
+    std::shared_ptr<NetworkReactor> reactor_;
+    NetworkReactor::Id watch_;
+
+    mutable std::mutex mutex_;
+    sockaddr_in receiver_;
+    bool has_receiver_;
+    int64_t last_heard_us_;
+    uint8_t group_size_;        // Negotiated with the current receiver
+    size_t payload_size_;
+    bool nack_;
+    int latency_ms_;
+    bool keyframe_requested_;
+
+    uint64_t sequence_;
+    uint32_t frame_id_;
+    std::vector<Sent> history_;
+
+    // Parity of the group being sent
+    std::vector<uint8_t> parity_;
+    uint64_t group_base_;
+    uint8_t group_count_;
+    uint16_t group_length_xor_;
+
+    UdpFecSenderStats stats_;
+};
+
+/**
+ * Receiving side; the URL is "udpfec://host[:port][?group=N]", where N caps
+ * the parity group asked for in HELLO (0 asks for no FEC), e.g. to match
+ * what the app offered in its WebSocket hello. Datagrams are pulled
+ * in batches by UdpBatchReceiver on the shared NetworkReactor, which also
+ * ticks the NACK and deadline logic every TICK_MS. Frames are handed out
+ * whole and in order, from the first keyframe on.
+ */
+class UdpFecTransport : public Transport {
+public:
+    static constexpr int DEFAULT_LATENCY_MS = 80;
+    static constexpr int MIN_LATENCY_MS = 20;
+    static constexpr int MAX_LATENCY_MS = 1000;
+    static constexpr int TICK_MS = 5;
+
+    UdpFecTransport();
+    ~UdpFecTransport() override;
+
+    ProtocolType protocol() const override;
+    bool connect(const std::string& url) override;
+    void disconnect() override;
+    bool is_connected() const override;
+    void interrupt() override;
+    bool receive_frame(VideoFrame& frame) override;
+
+    /**
+     * Both take effect on the next connect().
+     */
+    void set_latency_ms(int latency_ms);
+    void set_network_profile(const NetworkProfile& profile);
+
+    SocketTuning get_socket_tuning() const;
+    UdpFecStats stats() const;
+
+private:
+    struct Held {
+        std::vector<uint8_t> packet;   // As first sent, without the retransmit flag
+        uint64_t sequence;
+        bool present;
+    };
+
+    struct Missing {
+        int64_t since_us;
+        int64_t nacked_us;
+    };
+
+    struct Parity {
+        std::vector<uint8_t> bytes;
+        uint16_t length_xor;
+        uint8_t count;
+        int64_t arrival_us;
+    };
+
+    struct Assembly {
+        std::unique_ptr<uint8_t[]> data;
+        std::vector<bool> have;
+        uint16_t count;
+        uint16_t received;
+        size_t size;
+        int64_t pts;
+        bool keyframe;
+        int64_t first_us;
+    };
+
+    bool handshake(int fd, const std::string& host, uint8_t max_group_size);
+    void close_session(bool say_bye);
+
+    // Reactor callbacks and their helpers; io_mutex_ held
+    void on_readable();
+    void on_tick();
+    void handle_data(const uint8_t* packet, size_t size, int64_t now_us, bool recovered);
+    void handle_parity(const uint8_t* packet, size_t size, int64_t now_us);
+    void try_recover(uint64_t base, int64_t now_us);
+    void deliver(int64_t now_us);
+    void drop_frame(int64_t now_us);
+    void send_nacks(int64_t now_us);
+    void send_control(uint8_t type);
+    void unwatch();
+    void reset_state();
+
+    uint64_t extend_sequence(uint32_t sequence) const;
+
+    std::shared_ptr<NetworkReactor> reactor_;
+    std::atomic<NetworkReactor::Id> watch_;
+    std::atomic<NetworkReactor::Id> tick_timer_;
+    std::atomic<bool> connected_;
+    std::mutex control_mutex_;         // connect() and disconnect()
+    StopSignal connect_stop_;          // Wakes the handshake, see interrupt()
+
+    NetworkProfile profile_;           // Next connect (guarded by settings_mutex_)
+    int latency_setting_ms_;
+    SocketTuning tuning_;
+    mutable std::mutex settings_mutex_;
+
+    int socket_;
+    UdpBatchReceiver udp_receiver_;
+    FrameQueue frame_queue_;
+
+    // Negotiated in the handshake
+    uint8_t group_size_;
+    bool nack_;
+    int latency_ms_;
+    size_t payload_size_;
+    double rtt_ms_;
+    uint32_t first_sequence_;
+    uint32_t first_frame_;
+
+    // Reactor callbacks, and connect() before they start
+    mutable std::mutex io_mutex_;
+    std::vector<Held> window_;
+    uint64_t highest_;
+    std::map<uint64_t, Missing> missing_;
+    std::map<uint64_t, Parity> parities_;      // By the group's first sequence
+    std::map<uint64_t, Assembly> frames_;
+    uint64_t next_frame_;
+    bool need_keyframe_;
+    int64_t last_keyframe_request_us_;
+    int64_t last_keepalive_us_;
+    int64_t last_packet_us_;
+    UdpFecStats stats_;
+};
+
+} // namespace berrystreamcam
@@ -2,31 +2,61 @@
 #include <QUrl>
 #include <QJsonArray>
 #include <QMetaObject>
+#include <QAbstractSocket>
 #include <cstring>
 #include <chrono>
 #include <thread>
 
 namespace berrystreamcam {
 
+namespace {
+
+// Every WebSocket in the process shares one Qt event loop; the last handler to go stops it
+std::mutex socket_thread_mutex;
+std::weak_ptr<QThread> socket_thread;
+
+std::shared_ptr<QThread> acquire_socket_thread()
+{
+    std::lock_guard<std::mutex> lock(socket_thread_mutex);
+
+    std::shared_ptr<QThread> thread = socket_thread.lock();
+    if (!thread) {
+        thread = std::shared_ptr<QThread>(new QThread(), [](QThread* t) {
+            t->quit();
+            if (!t->wait(2000)) {
+                BLOG_ERROR("WebSocket thread did not stop within timeout");
+            }
+            delete t;
+        });
+        thread->setObjectName("berrystreamcam-websocket");
+        thread->start();
+        socket_thread = thread;
+        BLOG_INFO("WebSocket thread started");
+    }
+    return thread;
+}
+
+} // namespace
+
 WebSocketHandler::WebSocketHandler()
     : websocket_(nullptr)
-    , worker_thread_(nullptr)
+    , socket_thread_(acquire_socket_thread())
     , connected_(false)
     , connection_attempted_(false)
+    , connect_interrupted_(false)
     , cleanup_started_(false)
     , frame_count_(0)
     , keyframe_count_(0)
+    , profile_(network_profile_from_name("balanced"))
+    , tuning_{}
 {
     BLOG_INFO("WebSocket handler created in thread %p", QThread::currentThread());
 
     // Create websocket in main thread context
     websocket_ = new QWebSocket();
 
-    // Create worker thread
-    worker_thread_ = new QThread(this);
-
-    // Move websocket to worker thread
-    websocket_->moveToThread(worker_thread_);
+    // Move websocket to the shared socket thread
+    websocket_->moveToThread(socket_thread_.get());
 
     // Connect cross-thread signals (queued connections for thread safety)
     QObject::connect(this, &WebSocketHandler::connectRequested,
@@ -54,10 +84,8 @@ WebSocketHandler::WebSocketHandler()
                      this, &WebSocketHandler::onError,
                      Qt::QueuedConnection);
 
-    // Start worker thread with event loop
-    worker_thread_->start();
-
-    BLOG_INFO("WebSocket worker thread started");
+    BLOG_DEBUG("WebSocket handler joined shared socket thread (%ld users)",
+               static_cast<long>(socket_thread_.use_count() - 1));
 }
 
 WebSocketHandler::~WebSocketHandler()
@@ -69,29 +97,26 @@ WebSocketHandler::~WebSocketHandler()
     connected_.store(false);
 
     try {
-        // Request disconnect from worker thread
-        emit disconnectRequested();
-
-        // Wait for worker thread to finish (with timeout)
-        if (worker_thread_ && worker_thread_->isRunning()) {
-            BLOG_DEBUG("Waiting for worker thread to stop...");
-            if (!worker_thread_->wait(2000)) {
-                BLOG_WARNING("Worker thread did not stop within timeout, forcing quit");
-                worker_thread_->quit();
-                if (!worker_thread_->wait(1000)) {
-                    BLOG_ERROR("Worker thread still running after forced quit");
-                }
+        // Other handlers keep the socket thread running: close this socket
+        // on it and let its event loop delete it
+        if (websocket_) {
+            QWebSocket* socket = websocket_;
+            websocket_ = nullptr;
+            socket->disconnect(this);
+            if (socket_thread_->isRunning() && QThread::currentThread() != socket_thread_.get()) {
+                QMetaObject::invokeMethod(socket, [socket]() { socket->abort(); },
+                                          Qt::BlockingQueuedConnection);
+            } else {
+                socket->abort();
             }
+            socket->deleteLater();
         }
 
         // Clear frame queue
         frame_queue_.clear();
 
-        // Delete WebSocket (safe now that thread is stopped)
-        if (websocket_) {
-            delete websocket_;
-            websocket_ = nullptr;
-        }
+        // Last handler out stops the thread, which deletes anything still pending
+        socket_thread_.reset();
 
         BLOG_INFO("WebSocket handler destroyed");
 
@@ -99,7 +124,7 @@ WebSocketHandler::~WebSocketHandler()
         // Suppress all exceptions in destructor
         BLOG_ERROR("Exception in WebSocketHandler destructor");
         if (websocket_) {
-            delete websocket_;
+            websocket_->deleteLater();
             websocket_ = nullptr;
         }
     }
@@ -121,6 +146,16 @@ bool WebSocketHandler::connect_to_server(const std::string& url)
         return false;
     }
 
+    {
+        // An offer from another device says nothing about this one
+        std::lock_guard<std::mutex> lock(offer_mutex_);
+        std::string host = qurl.host().toStdString();
+        if (host != device_host_) {
+            device_host_ = host;
+            udp_fec_url_.clear();
+        }
+    }
+
     connection_attempted_.store(false);
     connected_.store(false);
 
@@ -133,11 +168,15 @@ bool WebSocketHandler::connect_to_server(const std::string& url)
     int elapsed_ms = 0;
     int poll_interval_ms = 50;
 
-    while (elapsed_ms < timeout_ms && !connection_attempted_.load()) {
+    while (elapsed_ms < timeout_ms && !connection_attempted_.load() && !connect_interrupted_.load()) {
         std::this_thread::sleep_for(std::chrono::milliseconds(poll_interval_ms));
         elapsed_ms += poll_interval_ms;
     }
 
+    if (connect_interrupted_.load()) {
+        BLOG_DEBUG("WebSocket connect to %s abandoned", url.c_str());
+        return false;
+    }
     if (!connected_.load()) {
         BLOG_ERROR("WebSocket connection timeout or failed");
     }
@@ -145,6 +184,11 @@ bool WebSocketHandler::connect_to_server(const std::string& url)
     return connected_.load();
 }
 
+void WebSocketHandler::interrupt_connect()
+{
+    connect_interrupted_.store(true);
+}
+
 void WebSocketHandler::process_events()
 {
     if (cleanup_started_.load()) {
@@ -157,6 +201,7 @@ void WebSocketHandler::process_events()
 
 void WebSocketHandler::disconnect_from_server()
 {
+    connect_interrupted_.store(false);
     if (cleanup_started_.load()) return;
 
     BLOG_INFO("Disconnecting WebSocket");
@@ -208,6 +253,18 @@ bool WebSocketHandler::receive_frame(VideoFrame& frame)
     return frame_queue_.pop(frame);
 }
 
+void WebSocketHandler::set_network_profile(const NetworkProfile& profile)
+{
+    std::lock_guard<std::mutex> lock(tuning_mutex_);
+    profile_ = profile;
+}
+
+SocketTuning WebSocketHandler::get_socket_tuning() const
+{
+    std::lock_guard<std::mutex> lock(tuning_mutex_);
+    return tuning_;
+}
+
 void WebSocketHandler::doConnect(const QString& url)
 {
     if (cleanup_started_.load()) {
@@ -249,6 +306,16 @@ void WebSocketHandler::onConnected()
     }
 
     BLOG_INFO("WebSocket connected successfully");
+
+    // QWebSocket parents its QTcpSocket to itself; tune the descriptor underneath
+    QAbstractSocket* socket = websocket_->findChild<QAbstractSocket*>();
+    if (socket && socket->socketDescriptor() >= 0) {
+        std::lock_guard<std::mutex> lock(tuning_mutex_);
+        tuning_ = apply_network_profile(static_cast<int>(socket->socketDescriptor()), profile_, true);
+    } else {
+        BLOG_DEBUG("WebSocket transport socket not reachable, network profile not applied");
+    }
+
     connected_.store(true);
     connection_attempted_.store(true);
     emit connectionStateChanged(true);
@@ -378,9 +445,35 @@ void WebSocketHandler::handle_hello_message(const QJsonObject& json)
         BLOG_INFO("  Max resolution: %s",
                   caps["maxResolution"].toString().toStdString().c_str());
         BLOG_INFO("  Max framerate: %d", caps["maxFramerate"].toInt());
+
+        // Newer app builds also stream over UDP with parity and NACKs; the
+        // next race dials that port and asks for no more parity than offered
+        int fec_port = 0;
+        int fec_group = -1;
+        if (caps.contains("udpFec")) {
+            QJsonObject fec = caps["udpFec"].toObject();
+            fec_port = fec["port"].toInt(UDP_FEC_PORT);
+            fec_group = fec["group"].toInt(-1);
+            BLOG_INFO("  UDP + FEC: port %d, group %d", fec_port, fec_group);
+        }
+
+        std::lock_guard<std::mutex> lock(offer_mutex_);
+        udp_fec_url_.clear();
+        if (fec_port > 0 && fec_port <= 65535 && !device_host_.empty()) {
+            udp_fec_url_ = "udpfec://" + device_host_ + ":" + std::to_string(fec_port);
+            if (fec_group >= 0) {
+                udp_fec_url_ += "?group=" + std::to_string(fec_group);
+            }
+        }
     }
 }
 
+std::string WebSocketHandler::udp_fec_url(const std::string& host) const
+{
+    std::lock_guard<std::mutex> lock(offer_mutex_);
+    return host == device_host_ ? udp_fec_url_ : std::string();
+}
+
 void WebSocketHandler::handle_video_frame(const QJsonObject& json)
 {
     if (cleanup_started_.load()) {
@@ -2,6 +2,7 @@
 
 #include "../common.hpp"
 #include "frame-queue.hpp"
+#include "socket-tuning.hpp"
 #include <QWebSocket>
 #include <QJsonDocument>
 #include <QJsonObject>
@@ -12,6 +13,7 @@
 #include <string>
 #include <memory>
 #include <atomic>
+#include <mutex>
 
 namespace berrystreamcam {
 
@@ -26,9 +28,29 @@ public:
     void disconnect_from_server();
     bool is_connected() const;
 
+    /**
+     * Stop connect_to_server() waiting for the worker; cleared by
+     * disconnect_from_server().
+     */
+    void interrupt_connect();
+
     bool receive_frame(VideoFrame& frame);
     void process_events(); // Process Qt events in the streaming thread
 
+    /**
+     * Applied to the QWebSocket's TCP socket once it connects. Qt owns
+     * the reads, so TCP_QUICKACK is set once and not re-armed.
+     */
+    void set_network_profile(const NetworkProfile& profile);
+    SocketTuning get_socket_tuning() const;
+
+    /**
+     * The UDP + FEC stream host's app offered in its last hello, as a
+     * UdpFecTransport URL with its port and parity group; empty if it
+     * offered none or host is not the device this handler talks to.
+     */
+    std::string udp_fec_url(const std::string& host) const;
+
 signals:
     // Signals for cross-thread communication
     void connectRequested(const QString& url);
@@ -38,7 +60,7 @@ signals:
     void errorOccurred(const QString& error);
 
 private slots:
-    // Slots executed in WebSocket worker thread
+    // Slots for the socket on the shared WebSocket thread
     void doConnect(const QString& url);
     void doDisconnect();
     void onConnected();
@@ -53,14 +75,24 @@ private:
     QByteArray decode_base64(const QString& base64_str);
 
     QWebSocket* websocket_;              // Created in main thread, moved to worker
-    QThread* worker_thread_;             // Dedicated thread for Qt event loop
+    std::shared_ptr<QThread> socket_thread_;   // Qt event loop shared by all handlers
     std::string url_;
 
     std::atomic<bool> connected_;
     std::atomic<bool> connection_attempted_;
+    std::atomic<bool> connect_interrupted_;
     std::atomic<bool> cleanup_started_;
     FrameQueue frame_queue_;             // Thread-safe frame queue
 
+    NetworkProfile profile_;
+    SocketTuning tuning_;
+    mutable std::mutex tuning_mutex_;    // Set in worker thread, read for stats
+
+    // The device being talked to and its hello's UDP + FEC offer
+    std::string device_host_;
+    std::string udp_fec_url_;
+    mutable std::mutex offer_mutex_;
+
     int frame_count_;
     int keyframe_count_;
 };
@@ -0,0 +1,165 @@
+#include "source-lifecycle.hpp"
+
+namespace berrystreamcam {
+
+SourceLifecycle::SourceLifecycle(LifecycleActions actions)
+    : actions_(std::move(actions))
+    , want_active_(false)
+    , want_visible_(true)
+    , want_restart_(false)
+    , want_swap_(false)
+    , pending_(false)
+    , busy_(false)
+    , shutting_down_(false)
+    , running_(false)
+    , paused_(false)
+{
+    worker_ = std::thread(&SourceLifecycle::worker_loop, this);
+}
+
+SourceLifecycle::~SourceLifecycle()
+{
+    shutdown();
+}
+
+void SourceLifecycle::set_active(bool active)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (shutting_down_) {
+        return;
+    }
+    want_active_ = active;
+    pending_ = true;
+    cv_.notify_one();
+}
+
+void SourceLifecycle::set_visible(bool visible)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (shutting_down_) {
+        return;
+    }
+    want_visible_ = visible;
+    pending_ = true;
+    cv_.notify_one();
+}
+
+void SourceLifecycle::request_restart()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (shutting_down_) {
+        return;
+    }
+    want_restart_ = true;
+    pending_ = true;
+    cv_.notify_one();
+}
+
+void SourceLifecycle::request_swap()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (shutting_down_) {
+        return;
+    }
+    want_swap_ = true;
+    pending_ = true;
+    cv_.notify_one();
+}
+
+void SourceLifecycle::wait_idle()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    idle_cv_.wait(lock, [this]() {
+        return (!pending_ && !busy_) || shutting_down_;
+    });
+}
+
+void SourceLifecycle::shutdown()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        shutting_down_ = true;
+    }
+    cv_.notify_one();
+    idle_cv_.notify_all();
+
+    if (worker_.joinable()) {
+        worker_.join();
+    }
+}
+
+void SourceLifecycle::worker_loop()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    while (true) {
+        cv_.wait(lock, [this]() { return pending_ || shutting_down_; });
+        if (shutting_down_) {
+            break;
+        }
+
+        // Take the latest wanted state; anything queued meanwhile folds into the next pass
+        bool active = want_active_;
+        bool visible = want_visible_;
+        bool restart = want_restart_;
+        bool swap = want_swap_ && !restart;
+        want_restart_ = false;
+        want_swap_ = false;
+        pending_ = false;
+        busy_ = true;
+
+        lock.unlock();
+        apply(active, visible, restart, swap);
+        lock.lock();
+
+        busy_ = false;
+        if (!pending_) {
+            idle_cv_.notify_all();
+        }
+    }
+
+    lock.unlock();
+
+    if (running_) {
+        actions_.stop();
+        running_ = false;
+    }
+}
+
+void SourceLifecycle::apply(bool active, bool visible, bool restart, bool swap)
+{
+    // A stream that cannot switch in place is restarted instead
+    if (swap && active && running_ && !actions_.swap()) {
+        restart = true;
+    }
+
+    if (restart && !active) {
+        BLOG_DEBUG("Source not active, skipping restart");
+    } else if (restart) {
+        BLOG_INFO("Restarting stream");
+        if (running_) {
+            actions_.stop();
+            running_ = false;
+        }
+    }
+
+    if (active && !running_) {
+        // A fresh stream starts out unpaused
+        running_ = actions_.start();
+        paused_ = false;
+    } else if (!active && running_) {
+        actions_.stop();
+        running_ = false;
+    }
+
+    if (running_ && paused_ == visible) {
+        if (visible) {
+            actions_.resume();
+        } else {
+            actions_.pause();
+        }
+        paused_ = !visible;
+    }
+}
+
+} // namespace berrystreamcam
@@ -0,0 +1,92 @@
+#pragma once
+
+#include "common.hpp"
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+namespace berrystreamcam {
+
+/**
+ * Connect/disconnect work a source hands to its lifecycle thread. They all
+ * run on that thread only, one at a time.
+ */
+struct LifecycleActions {
+    std::function<bool()> start;    // Returns false if nothing was started
+    std::function<void()> stop;
+    std::function<void()> pause;
+    std::function<void()> resume;
+    std::function<bool()> swap;     // Switch a running stream in place; false to restart instead
+};
+
+/**
+ * Per-source state machine that keeps stream start/stop off the OBS thread.
+ *
+ * The OBS callbacks only record the state they want (active, visible, or a
+ * restart) and return; a worker thread then drives the stream towards the
+ * latest wanted state. Requests that arrive while the worker is busy are
+ * merged, so a hide/show or deactivate/activate pair that cancels out costs
+ * nothing and a burst of restarts becomes one.
+ */
+class SourceLifecycle {
+public:
+    explicit SourceLifecycle(LifecycleActions actions);
+    ~SourceLifecycle();
+
+    SourceLifecycle(const SourceLifecycle&) = delete;
+    SourceLifecycle& operator=(const SourceLifecycle&) = delete;
+
+    void set_active(bool active);
+    void set_visible(bool visible);
+
+    /**
+     * Stop and start again. Ignored while the source is inactive.
+     */
+    void request_restart();
+
+    /**
+     * Move a running stream to the current config without stopping it,
+     * e.g. after a protocol change. Falls back to a restart if the swap
+     * action declines; a pending restart wins over a swap.
+     */
+    void request_swap();
+
+    /**
+     * Block until the worker has caught up with every request so far.
+     */
+    void wait_idle();
+
+    /**
+     * Finish the transition in progress, stop the stream and end the
+     * worker. Later requests are ignored.
+     */
+    void shutdown();
+
+private:
+    void worker_loop();
+    void apply(bool active, bool visible, bool restart, bool swap);
+
+    LifecycleActions actions_;
+
+    std::mutex mutex_;
+    std::condition_variable cv_;         // Wakes the worker on a new request
+    std::condition_variable idle_cv_;    // Wakes wait_idle() once caught up
+
+    // Wanted state, written by the OBS callbacks under mutex_
+    bool want_active_;
+    bool want_visible_;
+    bool want_restart_;
+    bool want_swap_;
+    bool pending_;
+    bool busy_;
+    bool shutting_down_;
+
+    // Applied state, touched by the worker only
+    bool running_;
+    bool paused_;
+
+    std::thread worker_;
+};
+
+} // namespace berrystreamcam
@@ -1,24 +1,35 @@
 #include "device-list-widget.hpp"
+#include "../discovery/capability-probe.hpp"
 #include <QVBoxLayout>
 #include <QHBoxLayout>
 #include <QGroupBox>
+#include <QMetaObject>
 
 namespace berrystreamcam {
 
 DeviceListWidget::DeviceListWidget(QWidget* parent)
     : QWidget(parent)
+    , discovery_(DiscoveryService::acquire())
+    , discovery_subscription_(0)
+    , table_version_(0)
     , selected_device_index_(-1)
 {
     setup_ui();
 
-    // Auto-refresh every 5 seconds
-    auto_refresh_timer_ = new QTimer(this);
-    connect(auto_refresh_timer_, &QTimer::timeout, this, &DeviceListWidget::on_refresh_clicked);
-    auto_refresh_timer_->start(5000);
+    // Follow the shared device table instead of polling; hop to the GUI thread
+    discovery_subscription_ = discovery_->subscribe([this](const DeviceTable& table) {
+        QMetaObject::invokeMethod(this, [this, table]() {
+            if (table.version > table_version_) {
+                table_version_ = table.version;
+                update_device_list(table.devices);
+            }
+        }, Qt::QueuedConnection);
+    });
 }
 
 DeviceListWidget::~DeviceListWidget()
 {
+    discovery_->unsubscribe(discovery_subscription_);
 }
 
 void DeviceListWidget::setup_ui()
@@ -112,6 +123,11 @@ void DeviceListWidget::update_device_list(const std::vector<StreamDevice>& devic
             item_text += QString(" - %1 protocol(s)")
                 .arg(device.available_protocols.size());
         }
+        if (device.capabilities_known && device.width > 0 && device.height > 0) {
+            item_text += QString(", %1x%2@%3, %4 viewer(s)")
+                .arg(device.width).arg(device.height).arg(device.fps)
+                .arg(device.connected_clients);
+        }
 
         device_list_->addItem(item_text);
     }
@@ -121,7 +137,9 @@ void DeviceListWidget::update_device_list(const std::vector<StreamDevice>& devic
 
 void DeviceListWidget::on_refresh_clicked()
 {
-    status_label_->setText("Scanning for devices...");
+    // The list only changes if the rescan finds something different
+    status_label_->setText(QString("Rescanning... %1 device(s) known").arg(current_devices_.size()));
+    discovery_->request_scan();
     emit refresh_requested();
 }
 
@@ -185,6 +203,12 @@ void DeviceListWidget::on_device_selection_changed()
             );
         }
 
+        // Start from the protocol the device's capabilities favour
+        if (const ProtocolInfo* best = best_protocol(device)) {
+            protocol_combo_->setCurrentIndex(
+                protocol_combo_->findData(static_cast<int>(best->type)));
+        }
+
         protocol_combo_->setEnabled(true);
         connect_button_->setEnabled(true);
 
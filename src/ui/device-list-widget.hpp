@@ -5,9 +5,9 @@
 #include <QPushButton>
 #include <QComboBox>
 #include <QLabel>
-#include <QTimer>
 #include "../common.hpp"
-#include "../discovery/device-discovery.hpp"
+#include "../discovery/discovery-service.hpp"
+#include <memory>
 
 namespace berrystreamcam {
 
@@ -38,7 +38,10 @@ private:
     QPushButton* refresh_button_;
     QPushButton* connect_button_;
     QLabel* status_label_;
-    QTimer* auto_refresh_timer_;
+
+    std::shared_ptr<DiscoveryService> discovery_;
+    DiscoveryService::SubscriptionId discovery_subscription_;
+    uint64_t table_version_;
 
     std::vector<StreamDevice> current_devices_;
     int selected_device_index_;
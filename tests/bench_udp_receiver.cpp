@@ -0,0 +1,143 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <thread>
+#include <time.h>
+#include <poll.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include "../src/protocols/udp-batch-receiver.hpp"
+
+using namespace berrystreamcam;
+
+// Loopback sender/receiver benchmark for the batched RTP receive path.
+// Sends RTP-sized datagrams in 1 ms bursts at a fixed bitrate and reports
+// how many packets each receive syscall returned and the receiver's CPU time.
+class UdpReceiveBenchmark : public ::testing::Test {
+protected:
+    struct Result {
+        uint64_t sent;
+        uint64_t received;
+        uint64_t syscalls;
+        uint64_t kernel_drops;
+        double cpu_ms;
+    };
+
+    static constexpr size_t PACKET_SIZE = 1400;
+    static constexpr int DURATION_MS = 2000;
+
+    Result run(int mbps, size_t batch_size) {
+        int rx = socket(AF_INET, SOCK_DGRAM, 0);
+        int tx = socket(AF_INET, SOCK_DGRAM, 0);
+
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = 0;
+        bind(rx, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr));
+
+        socklen_t len = sizeof(addr);
+        getsockname(rx, reinterpret_cast<struct sockaddr*>(&addr), &len);
+        ::connect(tx, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr));
+
+        UdpBatchReceiver receiver(batch_size);
+        receiver.attach(rx);
+
+        std::atomic<bool> sending(true);
+        Result result = {};
+
+        std::thread receiver_thread([&]() {
+            struct timespec start, end;
+            clock_gettime(CLOCK_THREAD_CPUTIME_ID, &start);
+
+            struct pollfd pfd = { rx, POLLIN, 0 };
+            int idle_polls = 0;
+            while (sending || idle_polls < 5) {
+                if (poll(&pfd, 1, 20) <= 0) {
+                    idle_polls++;
+                    continue;
+                }
+                idle_polls = 0;
+                while (receiver.receive() == batch_size) {
+                }
+            }
+
+            clock_gettime(CLOCK_THREAD_CPUTIME_ID, &end);
+            result.cpu_ms = (end.tv_sec - start.tv_sec) * 1000.0 +
+                            (end.tv_nsec - start.tv_nsec) / 1e6;
+        });
+
+        // Pace in 1 ms bursts, the way an encoder flushes a frame's packets
+        uint8_t payload[PACKET_SIZE] = { 0x80, 0x60 };
+        double packets_per_ms = mbps * 1e6 / 8.0 / PACKET_SIZE / 1000.0;
+        double credit = 0.0;
+        auto start = std::chrono::steady_clock::now();
+        auto next = start;
+
+        while (std::chrono::steady_clock::now() - start < std::chrono::milliseconds(DURATION_MS)) {
+            credit += packets_per_ms;
+            while (credit >= 1.0) {
+                if (send(tx, payload, sizeof(payload), 0) == static_cast<ssize_t>(sizeof(payload))) {
+                    result.sent++;
+                }
+                credit -= 1.0;
+            }
+            next += std::chrono::milliseconds(1);
+            std::this_thread::sleep_until(next);
+        }
+
+        sending = false;
+        receiver_thread.join();
+
+        UdpReceiveStats stats = receiver.get_stats();
+        result.received = stats.packets;
+        result.syscalls = stats.syscalls;
+        result.kernel_drops = stats.kernel_drops;
+
+        close(tx);
+        close(rx);
+        return result;
+    }
+
+    void report(int mbps) {
+        Result single = run(mbps, 1);
+        Result batched = run(mbps, UdpBatchReceiver::DEFAULT_BATCH_SIZE);
+
+        for (const Result* r : { &single, &batched }) {
+            printf("  %3d Mbps %-8s sent=%llu recv=%llu drops=%llu syscalls=%llu "
+                   "pkts/syscall=%.1f cpu=%.1fms\n",
+                   mbps, r == &single ? "single" : "batched",
+                   static_cast<unsigned long long>(r->sent),
+                   static_cast<unsigned long long>(r->received),
+                   static_cast<unsigned long long>(r->kernel_drops),
+                   static_cast<unsigned long long>(r->syscalls),
+                   r->syscalls ? double(r->received) / r->syscalls : 0.0,
+                   r->cpu_ms);
+        }
+
+        EXPECT_GT(batched.received, 0u);
+        EXPECT_LE(batched.received, batched.sent);
+        EXPECT_LT(batched.syscalls, single.syscalls);
+    }
+};
+
+TEST_F(UdpReceiveBenchmark, Loopback50Mbps) {
+    report(50);
+}
+
+TEST_F(UdpReceiveBenchmark, Loopback100Mbps) {
+    report(100);
+}
+
+TEST_F(UdpReceiveBenchmark, Loopback200Mbps) {
+    report(200);
+}
+
+int main(int argc, char** argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,194 @@
+#include <gtest/gtest.h>
+#include "../src/discovery/capability-probe.hpp"
+
+using namespace berrystreamcam;
+
+class CapabilityProbeTest : public ::testing::Test {
+protected:
+    static constexpr const char* PHONE = "192.168.1.20";
+
+    static StreamDevice empty_device() {
+        StreamDevice dev;
+        dev.is_active = false;
+        dev.last_seen = 0;
+        dev.capabilities_known = false;
+        dev.width = 0;
+        dev.height = 0;
+        dev.fps = 0;
+        dev.connected_clients = 0;
+        return dev;
+    }
+
+    static const ProtocolInfo* find(const StreamDevice& dev, ProtocolType type) {
+        for (const auto& proto : dev.available_protocols) {
+            if (proto.type == type) {
+                return &proto;
+            }
+        }
+        return nullptr;
+    }
+};
+
+// Test 1: A full document fills the device and every protocol
+TEST_F(CapabilityProbeTest, ParsesFullDocument) {
+    const std::string json = R"({
+        "name": "Pixel 8",
+        "codecs": ["H264", "mjpeg"],
+        "width": 1920, "height": 1080, "fps": 30,
+        "clients": 2,
+        "protocols": [
+            { "type": "websocket", "clients": 1 },
+            { "type": "rtsp", "port": 8554, "path": "/stream", "clients": 1 },
+            { "type": "http_h264" },
+            { "type": "mjpeg" },
+            { "type": "dash" }
+        ]
+    })";
+
+    StreamDevice dev = empty_device();
+    ASSERT_TRUE(parse_capability_document(json, PHONE, dev));
+
+    EXPECT_TRUE(dev.is_active);
+    EXPECT_TRUE(dev.capabilities_known);
+    EXPECT_EQ(dev.name, "Pixel 8");
+    EXPECT_EQ(dev.ip_address, PHONE);
+    EXPECT_EQ(dev.codecs, (std::vector<std::string>{ "h264", "mjpeg" }));
+    EXPECT_EQ(dev.width, 1920);
+    EXPECT_EQ(dev.height, 1080);
+    EXPECT_EQ(dev.fps, 30);
+    EXPECT_EQ(dev.connected_clients, 2);
+    ASSERT_EQ(dev.available_protocols.size(), 5u);
+
+    const ProtocolInfo* ws = find(dev, ProtocolType::WEBSOCKET_OBS_DROID);
+    ASSERT_NE(ws, nullptr);
+    EXPECT_EQ(ws->url, "ws://192.168.1.20:8080/stream");
+    EXPECT_EQ(ws->connected_clients, 1);
+
+    const ProtocolInfo* dash = find(dev, ProtocolType::HTTP_DASH);
+    ASSERT_NE(dash, nullptr);
+    EXPECT_EQ(dash->url, "http://192.168.1.20:8081/dash/manifest.mpd");
+    EXPECT_EQ(dash->port, HTTP_PORT);
+}
+
+// Test 2: Advertised ports and paths override the defaults
+TEST_F(CapabilityProbeTest, UsesAdvertisedPortAndPath) {
+    const std::string json = R"({
+        "protocols": [
+            { "type": "rtsp", "port": 9554, "path": "/live" },
+            { "type": "http_h264", "port": 70000, "path": "no-slash" },
+            { "type": "srt", "port": 9000 },
+            { "type": "rtsp", "port": 1234 }
+        ]
+    })";
+
+    StreamDevice dev = empty_device();
+    ASSERT_TRUE(parse_capability_document(json, PHONE, dev));
+
+    // Unknown types and duplicates are dropped, bad values fall back
+    ASSERT_EQ(dev.available_protocols.size(), 2u);
+    EXPECT_EQ(dev.name, "Streamberry-192.168.1.20");
+    EXPECT_EQ(dev.available_protocols[0].url, "rtsp://192.168.1.20:9554/live");
+    EXPECT_EQ(dev.available_protocols[0].port, 9554);
+    EXPECT_EQ(dev.available_protocols[1].url, "http://192.168.1.20:8081/stream.h264");
+}
+
+// Test 3: Plain-text health answers from older app builds are rejected
+TEST_F(CapabilityProbeTest, RejectsNonDocuments) {
+    StreamDevice dev = empty_device();
+    EXPECT_FALSE(parse_capability_document("", PHONE, dev));
+    EXPECT_FALSE(parse_capability_document("OK", PHONE, dev));
+    EXPECT_FALSE(parse_capability_document("[1, 2]", PHONE, dev));
+    EXPECT_FALSE(parse_capability_document(R"({"status": "ok"})", PHONE, dev));
+    EXPECT_FALSE(parse_capability_document(R"({"protocols": [)", PHONE, dev));
+    EXPECT_FALSE(dev.capabilities_known);
+    EXPECT_TRUE(dev.available_protocols.empty());
+}
+
+// Test 4: The lowest latency advertised protocol wins
+TEST_F(CapabilityProbeTest, PicksBestProtocol) {
+    StreamDevice dev = empty_device();
+    ASSERT_TRUE(parse_capability_document(
+        R"({"protocols": [{"type": "mjpeg"}, {"type": "websocket"}, {"type": "rtsp"}]})", PHONE, dev));
+    const ProtocolInfo* best = best_protocol(dev);
+    ASSERT_NE(best, nullptr);
+    EXPECT_EQ(best->type, ProtocolType::RTSP);
+
+    ASSERT_TRUE(parse_capability_document(
+        R"({"protocols": [{"type": "mjpeg"}, {"type": "dash"}, {"type": "http_h264"}]})", PHONE, dev));
+    best = best_protocol(dev);
+    ASSERT_NE(best, nullptr);
+    EXPECT_EQ(best->type, ProtocolType::HTTP_RAW_H264);
+
+    ASSERT_TRUE(parse_capability_document(R"({"protocols": []})", PHONE, dev));
+    EXPECT_FALSE(dev.is_active);
+    EXPECT_EQ(best_protocol(dev), nullptr);
+}
+
+// Test 5: A device without H.264 only gets MJPEG
+TEST_F(CapabilityProbeTest, RespectsCodecs) {
+    StreamDevice dev = empty_device();
+    ASSERT_TRUE(parse_capability_document(
+        R"({"codecs": ["mjpeg"], "protocols": [{"type": "rtsp"}, {"type": "mjpeg"}]})", PHONE, dev));
+    const ProtocolInfo* best = best_protocol(dev);
+    ASSERT_NE(best, nullptr);
+    EXPECT_EQ(best->type, ProtocolType::HTTP_MJPEG);
+
+    ASSERT_TRUE(parse_capability_document(
+        R"({"codecs": ["mjpeg"], "protocols": [{"type": "rtsp"}]})", PHONE, dev));
+    EXPECT_EQ(best_protocol(dev), nullptr);
+}
+
+// Test 6: Fallback order follows the same preference, minus unusable codecs
+TEST_F(CapabilityProbeTest, RanksAllProtocols) {
+    StreamDevice dev = empty_device();
+    ASSERT_TRUE(parse_capability_document(
+        R"({"protocols": [{"type": "mjpeg"}, {"type": "dash"}, {"type": "websocket"}, {"type": "rtsp"}]})",
+        PHONE, dev));
+    auto ranked = ranked_protocols(dev);
+    ASSERT_EQ(ranked.size(), 4u);
+    EXPECT_EQ(ranked[0]->type, ProtocolType::RTSP);
+    EXPECT_EQ(ranked[1]->type, ProtocolType::WEBSOCKET_OBS_DROID);
+    EXPECT_EQ(ranked[2]->type, ProtocolType::HTTP_DASH);
+    EXPECT_EQ(ranked[3]->type, ProtocolType::HTTP_MJPEG);
+    EXPECT_EQ(ranked[0], best_protocol(dev));
+
+    dev.codecs = { "mjpeg" };
+    ranked = ranked_protocols(dev);
+    ASSERT_EQ(ranked.size(), 1u);
+    EXPECT_EQ(ranked[0]->type, ProtocolType::HTTP_MJPEG);
+}
+
+// Test 7: Setting names map to protocol types
+TEST_F(CapabilityProbeTest, MapsProtocolNames) {
+    EXPECT_EQ(protocol_from_name("websocket"), ProtocolType::WEBSOCKET_OBS_DROID);
+    EXPECT_EQ(protocol_from_name("rtsp"), ProtocolType::RTSP);
+    EXPECT_EQ(protocol_from_name("http_h264"), ProtocolType::HTTP_RAW_H264);
+    EXPECT_EQ(protocol_from_name("mjpeg"), ProtocolType::HTTP_MJPEG);
+    EXPECT_EQ(protocol_from_name("dash"), ProtocolType::HTTP_DASH);
+    EXPECT_EQ(protocol_from_name("udp_fec"), ProtocolType::UDP_FEC);
+    EXPECT_EQ(protocol_from_name("auto"), ProtocolType::UNKNOWN);
+
+    ProtocolInfo rtsp = default_protocol_info(ProtocolType::RTSP, PHONE);
+    EXPECT_EQ(rtsp.url, "rtsp://192.168.1.20:8554/stream");
+    EXPECT_TRUE(rtsp.is_available);
+    EXPECT_EQ(default_protocol_info(ProtocolType::UDP_FEC, PHONE).url, "udpfec://192.168.1.20:8556");
+    EXPECT_FALSE(default_protocol_info(ProtocolType::UNKNOWN, PHONE).is_available);
+}
+
+// Test 8: UDP with FEC, where the device offers it, goes ahead of RTSP
+TEST_F(CapabilityProbeTest, PrefersUdpFec) {
+    StreamDevice dev = empty_device();
+    ASSERT_TRUE(parse_capability_document(
+        R"({"protocols": [{"type": "rtsp"}, {"type": "websocket"}, {"type": "udp_fec", "port": 9556}]})",
+        PHONE, dev));
+    auto ranked = ranked_protocols(dev);
+    ASSERT_EQ(ranked.size(), 3u);
+    EXPECT_EQ(ranked[0]->type, ProtocolType::UDP_FEC);
+    EXPECT_EQ(ranked[0]->url, "udpfec://192.168.1.20:9556");
+    EXPECT_EQ(ranked[1]->type, ProtocolType::RTSP);
+}
+
+int main(int argc, char** argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,105 @@
+#include <gtest/gtest.h>
+#include <string>
+#include "../src/protocols/dash-manifest.hpp"
+
+using namespace berrystreamcam;
+
+class DashManifestTest : public ::testing::Test {
+protected:
+    static constexpr const char* MANIFEST_URL = "http://192.168.1.20:8081/dash/manifest.mpd";
+
+    // 2024-05-01T12:00:00Z
+    static constexpr int64_t AVAILABILITY_START_MS = 1714564800000LL;
+
+    const std::string live_mpd =
+        "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+        "<MPD xmlns=\"urn:mpeg:dash:schema:mpd:2011\" type=\"dynamic\"\n"
+        "     availabilityStartTime=\"2024-05-01T14:00:00+02:00\"\n"
+        "     suggestedPresentationDelay=\"PT2.5S\" minimumUpdatePeriod=\"PT10S\">\n"
+        "  <!-- <Representation id=\"commented\" bandwidth=\"99999999\"/> -->\n"
+        "  <Period id=\"0\" start=\"PT0S\">\n"
+        "    <AdaptationSet contentType=\"audio\" mimeType=\"audio/mp4\">\n"
+        "      <SegmentTemplate media=\"audio_$Number$.m4s\" duration=\"96000\" timescale=\"48000\"/>\n"
+        "      <Representation id=\"a\" bandwidth=\"128000000\"/>\n"
+        "    </AdaptationSet>\n"
+        "    <AdaptationSet mimeType=\"video/mp4\" segmentAlignment=\"true\">\n"
+        "      <SegmentTemplate initialization=\"init_$RepresentationID$.mp4\"\n"
+        "                       media=\"chunk_$RepresentationID$_$Number%05d$.m4s\"\n"
+        "                       timescale=\"90000\" duration=\"180000\" startNumber=\"5\"\n"
+        "                       availabilityTimeOffset=\"1.5\"/>\n"
+        "      <Representation id=\"low\" bandwidth=\"1500000\" width=\"1280\" height=\"720\"/>\n"
+        "      <Representation id=\"high\" bandwidth=\"6000000\" width=\"1920\" height=\"1080\"/>\n"
+        "    </AdaptationSet>\n"
+        "  </Period>\n"
+        "</MPD>\n";
+};
+
+// Test 1: Highest-bandwidth video representation and its inherited template
+TEST_F(DashManifestTest, PicksBestVideoRepresentation) {
+    DashManifest manifest;
+    ASSERT_TRUE(parse_dash_manifest(live_mpd, MANIFEST_URL, manifest));
+
+    EXPECT_TRUE(manifest.is_dynamic);
+    EXPECT_EQ(manifest.representation_id, "high");
+    EXPECT_EQ(manifest.width, 1920);
+    EXPECT_EQ(manifest.height, 1080);
+    EXPECT_EQ(manifest.timescale, 90000u);
+    EXPECT_EQ(manifest.duration, 180000u);
+    EXPECT_EQ(manifest.start_number, 5u);
+    EXPECT_EQ(manifest.availability_offset_ms, 1500);
+    EXPECT_EQ(manifest.suggested_delay_ms, 2500);
+    EXPECT_EQ(manifest.availability_start_ms, AVAILABILITY_START_MS);
+    EXPECT_EQ(dash_segment_duration_ms(manifest), 2000);
+}
+
+// Test 2: Template identifiers expand against the manifest directory
+TEST_F(DashManifestTest, SegmentUrls) {
+    DashManifest manifest;
+    ASSERT_TRUE(parse_dash_manifest(live_mpd, MANIFEST_URL, manifest));
+
+    EXPECT_EQ(dash_init_url(manifest), "http://192.168.1.20:8081/dash/init_high.mp4");
+    EXPECT_EQ(dash_segment_url(manifest, 42), "http://192.168.1.20:8081/dash/chunk_high_00042.m4s");
+}
+
+// Test 3: Live edge follows wall clock minus the target latency
+TEST_F(DashManifestTest, LiveEdge) {
+    DashManifest manifest;
+    ASSERT_TRUE(parse_dash_manifest(live_mpd, MANIFEST_URL, manifest));
+
+    int64_t now = AVAILABILITY_START_MS + 10000;
+    EXPECT_EQ(dash_live_edge_number(manifest, now, 3000), 5u + 3);   // 7 s into the stream
+    EXPECT_EQ(dash_live_edge_number(manifest, now, 0), 5u + 5);
+    EXPECT_EQ(dash_live_edge_number(manifest, now, 20000), 5u);      // Before the start
+}
+
+// Test 4: Host-relative BaseURL and SegmentTemplate on the Representation
+TEST_F(DashManifestTest, BaseUrlAndRepresentationTemplate) {
+    const std::string mpd =
+        "<MPD type=\"static\"><BaseURL>/media/</BaseURL><Period><AdaptationSet contentType=\"video\">"
+        "<Representation id=\"v\" bandwidth=\"1000\">"
+        "<SegmentTemplate media=\"$Number$.m4s\" duration=\"2\" startNumber=\"0\"/>"
+        "</Representation></AdaptationSet></Period></MPD>";
+
+    DashManifest manifest;
+    ASSERT_TRUE(parse_dash_manifest(mpd, MANIFEST_URL, manifest));
+    EXPECT_FALSE(manifest.is_dynamic);
+    EXPECT_EQ(dash_segment_url(manifest, 7), "http://192.168.1.20:8081/media/7.m4s");
+    EXPECT_EQ(dash_live_edge_number(manifest, AVAILABILITY_START_MS, 0), 0u);
+}
+
+// Test 5: SegmentTimeline addressing is rejected rather than misread
+TEST_F(DashManifestTest, RejectsSegmentTimeline) {
+    const std::string mpd =
+        "<MPD type=\"dynamic\"><Period><AdaptationSet mimeType=\"video/mp4\">"
+        "<SegmentTemplate media=\"$Time$.m4s\" timescale=\"1000\">"
+        "<SegmentTimeline><S t=\"0\" d=\"2000\" r=\"10\"/></SegmentTimeline></SegmentTemplate>"
+        "<Representation id=\"v\" bandwidth=\"1000\"/></AdaptationSet></Period></MPD>";
+
+    DashManifest manifest;
+    EXPECT_FALSE(parse_dash_manifest(mpd, MANIFEST_URL, manifest));
+}
+
+int main(int argc, char** argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,148 @@
+#include <gtest/gtest.h>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "../src/decoder/decode-budget.hpp"
+
+using namespace berrystreamcam;
+
+namespace {
+
+void sleep_ms(int ms)
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+DecodeBudget::ConsumerId start_source(DecodeBudget& budget, int width, int height,
+                                      DecodePriority priority = DecodePriority::PROGRAM)
+{
+    DecodeBudget::ConsumerId id = budget.add();
+    budget.set_priority(id, priority);
+    budget.set_format(id, width, height);
+    budget.set_running(id, true);
+    return id;
+}
+
+} // namespace
+
+// Test 1: Sources share one governor budgeted to the machine
+TEST(DecodeBudgetTest, SharedBudgetSizedToMachine) {
+    auto first = DecodeBudget::acquire();
+    auto second = DecodeBudget::acquire();
+    EXPECT_EQ(first.get(), second.get());
+
+    int cores = static_cast<int>(std::thread::hardware_concurrency());
+    if (cores > 0) {
+        EXPECT_EQ(first->stats().budget_cores, cores);
+    }
+}
+
+// Test 2: A lone source gets as many threads as its resolution can use
+TEST(DecodeBudgetTest, LoneSourceCappedByResolution) {
+    DecodeBudget budget(16);
+    DecodeBudget::ConsumerId hd = start_source(budget, 1920, 1080);
+    EXPECT_EQ(budget.grant(hd).threads, 1080 / DecodeBudget::ROWS_PER_THREAD);
+
+    DecodeBudget big(16);
+    DecodeBudget::ConsumerId uhd = start_source(big, 3840, 2160);
+    EXPECT_EQ(big.grant(uhd).threads, DecodeBudget::MAX_THREADS_PER_SOURCE);
+}
+
+// Test 3: Spare cores favour more pixels and higher priority
+TEST(DecodeBudgetTest, SpareThreadsFollowPixelsAndPriority) {
+    DecodeBudget budget(5);
+    DecodeBudget::ConsumerId small = start_source(budget, 1280, 720, DecodePriority::PREVIEW);
+    DecodeBudget::ConsumerId program = start_source(budget, 1920, 1080, DecodePriority::PROGRAM);
+
+    EXPECT_GT(budget.grant(program).threads, budget.grant(small).threads);
+    EXPECT_EQ(budget.stats().granted_threads, 5);
+}
+
+// Test 4: More sources than cores leaves everyone with exactly one thread
+TEST(DecodeBudgetTest, AddingSourcesTakesBackExtraThreads) {
+    DecodeBudget budget(8);
+    std::vector<DecodeBudget::ConsumerId> sources;
+    for (int i = 0; i < 4; i++) {
+        sources.push_back(start_source(budget, 1920, 1080));
+    }
+    EXPECT_EQ(budget.stats().granted_threads, 8);
+    EXPECT_EQ(budget.grant(sources[0]).threads, 2);
+
+    for (int i = 0; i < 6; i++) {
+        sources.push_back(start_source(budget, 1920, 1080));
+    }
+    DecodeBudgetStats stats = budget.stats();
+    EXPECT_EQ(stats.sources, 10u);
+    EXPECT_EQ(stats.granted_threads, 10);   // The pool job each cannot go below
+    for (DecodeBudget::ConsumerId id : sources) {
+        EXPECT_EQ(budget.grant(id).threads, 1);
+    }
+
+    // Stopping sources hands their cores back
+    for (int i = 1; i < 10; i++) {
+        budget.set_running(sources[i], false);
+    }
+    EXPECT_EQ(budget.grant(sources[0]).threads, 1080 / DecodeBudget::ROWS_PER_THREAD);
+}
+
+// Test 5: A resolution change rebalances
+TEST(DecodeBudgetTest, ResolutionChangeRebalances) {
+    DecodeBudget budget(8);
+    DecodeBudget::ConsumerId id = budget.add();
+    budget.set_running(id, true);
+    EXPECT_EQ(budget.grant(id).threads, 1);   // Nothing decoded yet
+
+    budget.set_format(id, 1920, 1080);
+    EXPECT_EQ(budget.grant(id).threads, 4);
+
+    uint64_t rebalances = budget.stats().rebalances;
+    budget.set_format(id, 1920, 1080);
+    EXPECT_EQ(budget.stats().rebalances, rebalances);   // Unchanged format is free
+
+    budget.set_format(id, 320, 240);
+    EXPECT_EQ(budget.grant(id).threads, 1);
+
+    budget.remove(id);
+    EXPECT_EQ(budget.stats().sources, 0u);
+}
+
+// Test 6: Over budget, hidden and then preview sources shed frames; the program never does
+TEST(DecodeBudgetTest, ShedsLowPriorityWorkWhileOverBudget) {
+    DecodeBudget budget(1, 20);
+    DecodeBudget::ConsumerId program = start_source(budget, 1280, 720, DecodePriority::PROGRAM);
+    DecodeBudget::ConsumerId preview = start_source(budget, 1280, 720, DecodePriority::PREVIEW);
+    DecodeBudget::ConsumerId hidden = start_source(budget, 1280, 720, DecodePriority::HIDDEN);
+
+    // Each source busy twice as long as the window
+    for (int window = 0; window < 4; window++) {
+        sleep_ms(25);
+        for (DecodeBudget::ConsumerId id : { program, preview, hidden }) {
+            budget.record(id, std::chrono::milliseconds(50));
+        }
+        if (window == 0) {
+            EXPECT_EQ(budget.stats().shed_level, 1);
+            EXPECT_TRUE(budget.grant(hidden).skip_nonref);
+            EXPECT_FALSE(budget.grant(preview).skip_nonref);
+        }
+    }
+
+    DecodeBudgetStats stats = budget.stats();
+    EXPECT_EQ(stats.shed_level, 2);
+    EXPECT_GT(stats.load_cores, 1.0);
+    EXPECT_GT(budget.load_cores(program), 0.0);
+    EXPECT_TRUE(budget.grant(preview).skip_nonref);
+    EXPECT_FALSE(budget.grant(program).skip_nonref);
+
+    // Quiet again: one level back per window, after the one still holding busy time
+    for (int window = 0; window < 3; window++) {
+        sleep_ms(25);
+        budget.record(program, std::chrono::milliseconds(1));
+    }
+    EXPECT_EQ(budget.stats().shed_level, 0);
+    EXPECT_FALSE(budget.grant(hidden).skip_nonref);
+}
+
+int main(int argc, char** argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,330 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+#include "../src/decoder/decode-pool.hpp"
+
+using namespace berrystreamcam;
+
+namespace {
+
+bool wait_for(const std::function<bool()>& condition, int timeout_ms)
+{
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+    while (!condition()) {
+        if (std::chrono::steady_clock::now() > deadline) {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+}
+
+void sleep_ms(int ms)
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+} // namespace
+
+// Test 1: Sources share one pool sized to the machine
+TEST(DecodePoolTest, SharedPoolSizedToMachine) {
+    auto first = DecodePool::acquire();
+    auto second = DecodePool::acquire();
+    EXPECT_EQ(first.get(), second.get());
+
+    size_t cores = std::thread::hardware_concurrency();
+    if (cores > 0) {
+        EXPECT_EQ(first->worker_count(), cores);
+    }
+}
+
+// Test 2: A lane runs its jobs in order and never two at once
+TEST(DecodePoolTest, LaneIsSerialAndOrdered) {
+    DecodePool pool(4);
+    DecodePool::LaneId lane = pool.open_lane();
+
+    std::mutex mutex;
+    std::vector<int> order;
+    std::atomic<int> inside{0};
+    std::atomic<bool> overlapped{false};
+
+    for (int i = 0; i < 200; i++) {
+        ASSERT_TRUE(pool.submit(lane, [&, i]() {
+            if (inside.fetch_add(1) != 0) {
+                overlapped = true;
+            }
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                order.push_back(i);
+            }
+            inside--;
+        }));
+    }
+
+    ASSERT_TRUE(wait_for([&]() { return pool.lane_stats(lane).jobs == 200; }, 5000));
+    EXPECT_FALSE(overlapped.load());
+    for (int i = 0; i < 200; i++) {
+        EXPECT_EQ(order[i], i);
+    }
+    pool.close_lane(lane);
+}
+
+// Test 3: A quiet lane keeps running on one worker
+TEST(DecodePoolTest, LaneStaysOnItsWorker) {
+    DecodePool pool(4);
+    DecodePool::LaneId lane = pool.open_lane();
+
+    std::mutex mutex;
+    std::set<std::thread::id> runners;
+    for (int i = 0; i < 20; i++) {
+        std::atomic<bool> done{false};
+        pool.submit(lane, [&]() {
+            std::lock_guard<std::mutex> lock(mutex);
+            runners.insert(std::this_thread::get_id());
+            done = true;
+        });
+        ASSERT_TRUE(wait_for([&]() { return done.load(); }, 1000));
+    }
+
+    EXPECT_EQ(runners.size(), 1u);
+    EXPECT_EQ(pool.lane_stats(lane).stolen, 0u);
+    pool.close_lane(lane);
+}
+
+// Test 4: Lanes stuck behind a busy worker are stolen by idle ones
+TEST(DecodePoolTest, IdleWorkersStealQueuedLanes) {
+    DecodePool pool(2);
+
+    // Lanes get homes round-robin: 0, 1, 0
+    DecodePool::LaneId busy = pool.open_lane();
+    DecodePool::LaneId other = pool.open_lane();
+    DecodePool::LaneId waiting = pool.open_lane();
+
+    std::atomic<bool> release{false};
+    std::atomic<bool> busy_started{false};
+    pool.submit(busy, [&]() {
+        busy_started = true;
+        while (!release) {
+            sleep_ms(1);
+        }
+    });
+    ASSERT_TRUE(wait_for([&]() { return busy_started.load(); }, 1000));
+
+    // Homed on the blocked worker, so only a thief can run it
+    std::atomic<bool> ran{false};
+    pool.submit(waiting, [&]() { ran = true; });
+    EXPECT_TRUE(wait_for([&]() { return ran.load(); }, 1000));
+    EXPECT_EQ(pool.lane_stats(waiting).stolen, 1u);
+
+    release = true;
+    pool.close_lane(busy);
+    pool.close_lane(other);
+    pool.close_lane(waiting);
+}
+
+// Test 5: Queueing delay is measured from submit to start
+TEST(DecodePoolTest, ReportsQueueingDelay) {
+    DecodePool pool(1);
+    DecodePool::LaneId slow = pool.open_lane();
+    DecodePool::LaneId lane = pool.open_lane();
+
+    std::atomic<bool> started{false};
+    pool.submit(slow, [&]() {
+        started = true;
+        sleep_ms(60);
+    });
+    ASSERT_TRUE(wait_for([&]() { return started.load(); }, 1000));
+
+    pool.submit(lane, []() {});
+    ASSERT_TRUE(wait_for([&]() { return pool.lane_stats(lane).jobs == 1; }, 1000));
+
+    DecodeLaneStats stats = pool.lane_stats(lane);
+    EXPECT_GE(stats.last_queue_delay_ms, 40.0);
+    EXPECT_GE(stats.max_queue_delay_ms, stats.last_queue_delay_ms);
+    EXPECT_DOUBLE_EQ(stats.queue_delay_ms, stats.last_queue_delay_ms);   // First sample
+
+    pool.close_lane(slow);
+    pool.close_lane(lane);
+}
+
+// Test 6: cancel() drops queued jobs and waits for the running one
+TEST(DecodePoolTest, CancelDropsQueuedAndWaitsForRunning) {
+    DecodePool pool(2);
+    DecodePool::LaneId lane = pool.open_lane();
+
+    std::atomic<bool> started{false};
+    std::atomic<bool> finished{false};
+    std::atomic<int> later{0};
+    pool.submit(lane, [&]() {
+        started = true;
+        sleep_ms(50);
+        finished = true;
+    });
+    for (int i = 0; i < 5; i++) {
+        pool.submit(lane, [&]() { later++; });
+    }
+    ASSERT_TRUE(wait_for([&]() { return started.load(); }, 1000));
+
+    pool.cancel(lane);
+    EXPECT_TRUE(finished.load());
+    EXPECT_EQ(pool.pending(lane), 0u);
+    EXPECT_EQ(pool.lane_stats(lane).discarded, 5u);
+
+    // Still open afterwards
+    std::atomic<bool> ran{false};
+    EXPECT_TRUE(pool.submit(lane, [&]() { ran = true; }));
+    EXPECT_TRUE(wait_for([&]() { return ran.load(); }, 1000));
+    EXPECT_EQ(later.load(), 0);
+
+    pool.close_lane(lane);
+    EXPECT_FALSE(pool.submit(lane, []() {}));
+}
+
+// Test 7: Sixteen busy sources finish on four workers without starving any
+TEST(DecodePoolTest, SpreadsManySourcesOverWorkers) {
+    DecodePool pool(4);
+
+    std::vector<DecodePool::LaneId> lanes;
+    std::vector<std::unique_ptr<std::atomic<int>>> done;
+    for (int i = 0; i < 16; i++) {
+        lanes.push_back(pool.open_lane());
+        done.push_back(std::make_unique<std::atomic<int>>(0));
+    }
+
+    for (int frame = 0; frame < 10; frame++) {
+        for (int i = 0; i < 16; i++) {
+            std::atomic<int>* counter = done[i].get();
+            pool.submit(lanes[i], [counter]() {
+                sleep_ms(1);
+                (*counter)++;
+            });
+        }
+    }
+
+    ASSERT_TRUE(wait_for([&]() {
+        for (auto& counter : done) {
+            if (*counter != 10) {
+                return false;
+            }
+        }
+        return true;
+    }, 5000));
+
+    for (DecodePool::LaneId lane : lanes) {
+        pool.close_lane(lane);
+    }
+}
+
+// Test 8: A saturated pool runs the program first and hidden sources last
+TEST(DecodePoolTest, RunsProgramBeforePreviewBeforeHidden) {
+    DecodePool pool(1);
+    DecodePool::LaneId blocker = pool.open_lane();
+    DecodePool::LaneId hidden = pool.open_lane(DecodePriority::HIDDEN);
+    DecodePool::LaneId preview = pool.open_lane(DecodePriority::PREVIEW);
+    DecodePool::LaneId program = pool.open_lane(DecodePriority::HIDDEN);
+    pool.set_lane_priority(program, DecodePriority::PROGRAM);
+
+    std::atomic<bool> release{false};
+    std::atomic<bool> started{false};
+    pool.submit(blocker, [&]() {
+        started = true;
+        while (!release) {
+            sleep_ms(1);
+        }
+    });
+    ASSERT_TRUE(wait_for([&]() { return started.load(); }, 1000));
+
+    // Submitted least important first, with the earliest deadlines
+    std::mutex mutex;
+    std::vector<DecodePool::LaneId> order;
+    for (DecodePool::LaneId lane : { hidden, preview, program }) {
+        pool.submit(lane, [&, lane]() {
+            std::lock_guard<std::mutex> lock(mutex);
+            order.push_back(lane);
+        }, 1000);
+    }
+    release = true;
+
+    ASSERT_TRUE(wait_for([&]() { return pool.lane_stats(hidden).jobs == 1; }, 1000));
+    ASSERT_EQ(order.size(), 3u);
+    EXPECT_EQ(order[0], program);
+    EXPECT_EQ(order[1], preview);
+    EXPECT_EQ(order[2], hidden);
+    EXPECT_EQ(pool.lane_stats(program).priority, DecodePriority::PROGRAM);
+
+    for (DecodePool::LaneId lane : { blocker, hidden, preview, program }) {
+        pool.close_lane(lane);
+    }
+}
+
+// Test 9: Within a class the job due first runs first
+TEST(DecodePoolTest, EarliestDeadlineFirstWithinClass) {
+    DecodePool pool(1);
+    DecodePool::LaneId blocker = pool.open_lane();
+    DecodePool::LaneId relaxed = pool.open_lane();
+    DecodePool::LaneId urgent = pool.open_lane();
+
+    std::atomic<bool> release{false};
+    std::atomic<bool> started{false};
+    pool.submit(blocker, [&]() {
+        started = true;
+        while (!release) {
+            sleep_ms(1);
+        }
+    });
+    ASSERT_TRUE(wait_for([&]() { return started.load(); }, 1000));
+
+    std::mutex mutex;
+    std::vector<DecodePool::LaneId> order;
+    pool.submit(relaxed, [&]() {
+        std::lock_guard<std::mutex> lock(mutex);
+        order.push_back(relaxed);
+    }, 1000);
+    pool.submit(urgent, [&]() {
+        std::lock_guard<std::mutex> lock(mutex);
+        order.push_back(urgent);
+    }, 100);
+    release = true;
+
+    ASSERT_TRUE(wait_for([&]() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return order.size() == 2;
+    }, 1000));
+    EXPECT_EQ(order[0], urgent);
+    EXPECT_EQ(order[1], relaxed);
+
+    pool.close_lane(blocker);
+    pool.close_lane(relaxed);
+    pool.close_lane(urgent);
+}
+
+// Test 10: Late jobs are counted per lane and per priority class
+TEST(DecodePoolTest, CountsDeadlineMissesByPriority) {
+    DecodePool pool(1);
+    DecodePool::LaneId program = pool.open_lane(DecodePriority::PROGRAM);
+    DecodePool::LaneId hidden = pool.open_lane(DecodePriority::HIDDEN);
+
+    pool.submit(program, []() {}, 1000);
+    pool.submit(hidden, []() { sleep_ms(20); }, 1);
+    ASSERT_TRUE(wait_for([&]() { return pool.lane_stats(hidden).jobs == 1 && pool.pending(hidden) == 0; }, 1000));
+    ASSERT_TRUE(wait_for([&]() { return pool.priority_stats(DecodePriority::HIDDEN).jobs == 1; }, 1000));
+
+    EXPECT_EQ(pool.lane_stats(program).deadline_misses, 0u);
+    EXPECT_EQ(pool.lane_stats(hidden).deadline_misses, 1u);
+    EXPECT_EQ(pool.priority_stats(DecodePriority::PROGRAM).jobs, 1u);
+    EXPECT_EQ(pool.priority_stats(DecodePriority::PROGRAM).deadline_misses, 0u);
+    EXPECT_EQ(pool.priority_stats(DecodePriority::HIDDEN).deadline_misses, 1u);
+    EXPECT_EQ(pool.priority_stats(DecodePriority::PREVIEW).jobs, 0u);
+
+    pool.close_lane(program);
+    pool.close_lane(hidden);
+}
+
+int main(int argc, char** argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,121 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include "../src/discovery/device-cache.hpp"
+
+using namespace berrystreamcam;
+
+class DeviceCacheTest : public ::testing::Test {
+protected:
+    static constexpr const char* PHONE = "192.168.1.20";
+    static constexpr const char* PRINTER = "192.168.1.30";
+
+    static StreamDevice device(const std::string& ip, std::vector<ProtocolType> types) {
+        StreamDevice dev;
+        dev.ip_address = ip;
+        dev.name = "Streamberry-" + ip;
+        dev.is_active = true;
+        dev.last_seen = 0;
+        dev.capabilities_known = false;
+        dev.width = 0;
+        dev.height = 0;
+        dev.fps = 0;
+        dev.connected_clients = 0;
+        for (ProtocolType type : types) {
+            dev.available_protocols.push_back({ type, "", 0, true, 0 });
+        }
+        return dev;
+    }
+
+    static bool contains(const std::vector<std::string>& list, const std::string& ip) {
+        return std::find(list.begin(), list.end(), ip) != list.end();
+    }
+
+    const std::vector<ProtocolType> all_protocols = {
+        ProtocolType::WEBSOCKET_OBS_DROID, ProtocolType::HTTP_RAW_H264, ProtocolType::RTSP
+    };
+};
+
+// Test 1: New candidates are due at once, then wait for their timer
+TEST_F(DeviceCacheTest, NewAddressesProbedImmediately) {
+    DeviceCache cache;
+    auto due = cache.due_for_probe({ PHONE, PHONE }, 0);
+    ASSERT_EQ(due.size(), 1u);
+
+    EXPECT_TRUE(cache.record_probe(PHONE, true, device(PHONE, all_protocols), 0));
+    EXPECT_EQ(cache.devices().size(), 1u);
+
+    EXPECT_FALSE(contains(cache.due_for_probe({ PHONE }, 1000), PHONE));
+    EXPECT_TRUE(contains(cache.due_for_probe({}, DeviceCache::MIN_PROBE_INTERVAL_MS), PHONE));
+}
+
+// Test 2: Stable devices back off exponentially up to the cap
+TEST_F(DeviceCacheTest, StableDeviceBacksOff) {
+    DeviceCache cache;
+    int64_t now = 0;
+    cache.record_probe(PHONE, true, device(PHONE, all_protocols), now);
+    EXPECT_EQ(cache.find(PHONE)->probe_interval_ms, DeviceCache::MIN_PROBE_INTERVAL_MS);
+
+    for (int i = 0; i < 10; i++) {
+        now = cache.find(PHONE)->next_probe_ms;
+        EXPECT_FALSE(cache.record_probe(PHONE, true, device(PHONE, all_protocols), now));
+    }
+    EXPECT_EQ(cache.find(PHONE)->probe_interval_ms, DeviceCache::MAX_PROBE_INTERVAL_MS);
+    EXPECT_EQ(cache.next_probe_ms(), now + DeviceCache::MAX_PROBE_INTERVAL_MS);
+}
+
+// Test 3: A protocol must miss twice before it disappears; the device three times
+TEST_F(DeviceCacheTest, HealthHysteresis) {
+    DeviceCache cache;
+    cache.record_probe(PHONE, true, device(PHONE, all_protocols), 0);
+
+    StreamDevice no_rtsp = device(PHONE, { ProtocolType::WEBSOCKET_OBS_DROID, ProtocolType::HTTP_RAW_H264 });
+    EXPECT_FALSE(cache.record_probe(PHONE, true, no_rtsp, 1000));
+    EXPECT_EQ(cache.devices()[0].available_protocols.size(), 3u);
+    EXPECT_TRUE(cache.record_probe(PHONE, true, no_rtsp, 2000));
+    EXPECT_EQ(cache.devices()[0].available_protocols.size(), 2u);
+    EXPECT_EQ(cache.find(PHONE)->probe_interval_ms, DeviceCache::MIN_PROBE_INTERVAL_MS);
+
+    StreamDevice none;
+    EXPECT_FALSE(cache.record_probe(PHONE, false, none, 3000));
+    EXPECT_FALSE(cache.record_probe(PHONE, false, none, 4000));
+    EXPECT_EQ(cache.find(PHONE)->probe_interval_ms, DeviceCache::MIN_PROBE_INTERVAL_MS);
+    EXPECT_TRUE(cache.record_probe(PHONE, false, none, 5000));
+    EXPECT_TRUE(cache.devices().empty());
+}
+
+// Test 4: Hosts that are not Streamberry devices are negatively cached
+TEST_F(DeviceCacheTest, NonDevicesBackOff) {
+    DeviceCache cache;
+    StreamDevice none;
+    cache.record_probe(PRINTER, false, none, 0);
+    EXPECT_FALSE(contains(cache.due_for_probe({ PRINTER }, 1000), PRINTER));
+
+    int64_t now = cache.find(PRINTER)->next_probe_ms;
+    cache.record_probe(PRINTER, false, none, now);
+    EXPECT_EQ(cache.find(PRINTER)->probe_interval_ms, 2 * DeviceCache::MIN_PROBE_INTERVAL_MS);
+
+    // An mDNS announcement cuts the back-off short
+    cache.expedite(PRINTER, now + 1);
+    EXPECT_TRUE(contains(cache.due_for_probe({}, now + 1), PRINTER));
+}
+
+// Test 5: The sweep interval follows churn
+TEST_F(DeviceCacheTest, AdaptiveScanInterval) {
+    DeviceCache cache;
+    EXPECT_EQ(cache.scan_interval_ms(), DeviceCache::INITIAL_SCAN_INTERVAL_MS);
+
+    for (int i = 0; i < 10; i++) {
+        cache.record_scan(false);
+    }
+    EXPECT_EQ(cache.scan_interval_ms(), DeviceCache::MAX_SCAN_INTERVAL_MS);
+
+    for (int i = 0; i < 10; i++) {
+        cache.record_scan(true);
+    }
+    EXPECT_EQ(cache.scan_interval_ms(), DeviceCache::MIN_SCAN_INTERVAL_MS);
+}
+
+int main(int argc, char** argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,191 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include <vector>
+#include "../src/device-session.hpp"
+
+using namespace berrystreamcam;
+
+namespace {
+
+PictureRef make_picture(uint32_t width, uint32_t height)
+{
+    auto picture = std::make_shared<DecodedPicture>();
+    picture->rgba.reset(new uint8_t[static_cast<size_t>(width) * height * 4]());
+    picture->width = width;
+    picture->height = height;
+    return picture;
+}
+
+// A member that counts what the registry hands it
+struct Probe {
+    std::atomic<int> pictures{0};
+    std::atomic<int> role_changes{0};
+    PictureRef last;
+
+    DeviceSessionManager::MemberId join(DeviceSessionManager& sessions)
+    {
+        return sessions.join(
+            [this](const PictureRef& picture) {
+                pictures++;
+                last = picture;
+            },
+            [this]() { role_changes++; });
+    }
+};
+
+} // namespace
+
+// Test 1: Sources share one registry; keys name device and protocol
+TEST(DeviceSessionTest, SharedRegistryAndKeys) {
+    auto first = DeviceSessionManager::acquire();
+    auto second = DeviceSessionManager::acquire();
+    EXPECT_EQ(first.get(), second.get());
+
+    EXPECT_EQ(DeviceSessionManager::key_for("192.168.1.20", ProtocolType::RTSP),
+              DeviceSessionManager::key_for("192.168.1.20", ProtocolType::RTSP));
+    EXPECT_NE(DeviceSessionManager::key_for("192.168.1.20", ProtocolType::RTSP),
+              DeviceSessionManager::key_for("192.168.1.20", ProtocolType::HTTP_MJPEG));
+    EXPECT_TRUE(DeviceSessionManager::key_for("", ProtocolType::RTSP).empty());
+}
+
+// Test 2: The first source streaming a device publishes, the others receive
+TEST(DeviceSessionTest, FirstStreamingMemberPublishes) {
+    DeviceSessionManager sessions;
+    std::string key = DeviceSessionManager::key_for("10.0.0.5", ProtocolType::RTSP);
+
+    Probe a, b, c, other;
+    auto id_a = a.join(sessions);
+    auto id_b = b.join(sessions);
+    auto id_c = c.join(sessions);
+    auto id_other = other.join(sessions);
+
+    for (auto id : { id_a, id_b, id_c }) {
+        sessions.set_key(id, key);
+    }
+    sessions.set_key(id_other, DeviceSessionManager::key_for("10.0.0.6", ProtocolType::RTSP));
+
+    sessions.set_streaming(id_a, true);
+    sessions.set_streaming(id_b, true);
+    sessions.set_streaming(id_other, true);
+
+    EXPECT_TRUE(sessions.is_publisher(id_a));
+    EXPECT_FALSE(sessions.is_publisher(id_b));
+    EXPECT_TRUE(sessions.is_publisher(id_other));
+    EXPECT_EQ(sessions.audience(id_a), 1u);   // c is not streaming
+
+    // One decoded picture, the same buffer everywhere
+    PictureRef picture = make_picture(64, 32);
+    sessions.publish(id_a, picture);
+    EXPECT_EQ(b.pictures.load(), 1);
+    EXPECT_EQ(b.last.get(), picture.get());
+    EXPECT_EQ(a.pictures.load(), 0);
+    EXPECT_EQ(c.pictures.load(), 0);
+    EXPECT_EQ(other.pictures.load(), 0);
+
+    // Only the publisher may publish
+    sessions.publish(id_b, picture);
+    EXPECT_EQ(a.pictures.load(), 0);
+
+    DeviceSessionStats stats = sessions.stats(id_a);
+    EXPECT_EQ(stats.key, key);
+    EXPECT_EQ(stats.members, 2u);
+    EXPECT_TRUE(stats.publisher);
+    EXPECT_EQ(stats.published, 1u);
+    EXPECT_EQ(sessions.stats(id_b).received, 1u);
+}
+
+// Test 3: When the publisher stops, the next streaming member takes over
+TEST(DeviceSessionTest, NextMemberTakesOverWhenPublisherStops) {
+    DeviceSessionManager sessions;
+    std::string key = DeviceSessionManager::key_for("10.0.0.5", ProtocolType::WEBSOCKET_OBS_DROID);
+
+    Probe a, b, c;
+    auto id_a = a.join(sessions);
+    auto id_b = b.join(sessions);
+    auto id_c = c.join(sessions);
+    for (auto id : { id_a, id_b, id_c }) {
+        sessions.set_key(id, key);
+        sessions.set_streaming(id, true);
+    }
+    int b_roles = b.role_changes;
+
+    sessions.set_streaming(id_a, false);
+    EXPECT_TRUE(sessions.is_publisher(id_b));
+    EXPECT_FALSE(sessions.is_publisher(id_c));
+    EXPECT_GT(b.role_changes.load(), b_roles);
+
+    // Back again it queues behind the others
+    sessions.set_streaming(id_a, true);
+    EXPECT_TRUE(sessions.is_publisher(id_b));
+
+    sessions.leave(id_b);
+    EXPECT_TRUE(sessions.is_publisher(id_c));
+    sessions.publish(id_c, make_picture(16, 16));
+    EXPECT_EQ(a.pictures.load(), 1);
+    EXPECT_EQ(b.pictures.load(), 0);   // Gone
+}
+
+// Test 4: Changing protocol moves a source to another session
+TEST(DeviceSessionTest, RekeyMovesMemberBetweenSessions) {
+    DeviceSessionManager sessions;
+    std::string rtsp = DeviceSessionManager::key_for("10.0.0.5", ProtocolType::RTSP);
+    std::string mjpeg = DeviceSessionManager::key_for("10.0.0.5", ProtocolType::HTTP_MJPEG);
+
+    Probe a, b;
+    auto id_a = a.join(sessions);
+    auto id_b = b.join(sessions);
+    sessions.set_key(id_a, rtsp);
+    sessions.set_key(id_b, rtsp);
+    sessions.set_streaming(id_a, true);
+    sessions.set_streaming(id_b, true);
+    EXPECT_FALSE(sessions.is_publisher(id_b));
+
+    sessions.set_key(id_b, mjpeg);
+    EXPECT_TRUE(sessions.is_publisher(id_a));
+    EXPECT_TRUE(sessions.is_publisher(id_b));
+    EXPECT_EQ(sessions.audience(id_a), 0u);
+
+    // Without a device a source decides for itself
+    sessions.set_key(id_b, "");
+    EXPECT_TRUE(sessions.is_publisher(id_b));
+    EXPECT_EQ(sessions.audience(id_b), 0u);
+}
+
+// Test 5: Crop and output size per source
+TEST(DeviceSessionTest, LayoutCropsAndScales) {
+    PictureLayout none = {};
+    PictureRegion full = layout_picture(none, 1920, 1080);
+    EXPECT_EQ(full.x, 0u);
+    EXPECT_EQ(full.width, 1920u);
+    EXPECT_EQ(full.output_height, 1080u);
+
+    PictureLayout crop = { 100, 50, 20, 30, 0, 0 };
+    PictureRegion cropped = layout_picture(crop, 1920, 1080);
+    EXPECT_EQ(cropped.x, 100u);
+    EXPECT_EQ(cropped.y, 50u);
+    EXPECT_EQ(cropped.width, 1800u);
+    EXPECT_EQ(cropped.height, 1000u);
+    EXPECT_EQ(cropped.output_width, 1800u);
+
+    PictureLayout scale = { 0, 0, 0, 0, 960, 0 };
+    PictureRegion scaled = layout_picture(scale, 1920, 1080);
+    EXPECT_EQ(scaled.width, 1920u);
+    EXPECT_EQ(scaled.output_width, 960u);
+    EXPECT_EQ(scaled.output_height, 540u);   // Aspect kept
+
+    PictureLayout both = { 0, 0, 0, 0, 640, 640 };
+    PictureRegion stretched = layout_picture(both, 1920, 1080);
+    EXPECT_EQ(stretched.output_width, 640u);
+    EXPECT_EQ(stretched.output_height, 640u);
+
+    // A crop wider than the picture is ignored
+    PictureLayout too_much = { 1000, 0, 1000, 0, 0, 0 };
+    PictureRegion ignored = layout_picture(too_much, 1920, 1080);
+    EXPECT_EQ(ignored.x, 0u);
+    EXPECT_EQ(ignored.width, 1920u);
+}
+
+int main(int argc, char** argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
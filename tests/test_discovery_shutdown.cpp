@@ -0,0 +1,111 @@
+#include <gtest/gtest.h>
+#include <chrono>
+#include <thread>
+#include <poll.h>
+#include "../src/discovery/stop-signal.hpp"
+#include "../src/discovery/mdns-scanner.hpp"
+#include "../src/discovery/device-discovery.hpp"
+#include "../src/discovery/discovery-service.hpp"
+
+using namespace berrystreamcam;
+
+class DiscoveryShutdownTest : public ::testing::Test {
+protected:
+    static int64_t elapsed_ms(std::chrono::steady_clock::time_point since) {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - since).count();
+    }
+
+    static int64_t between_ms(std::chrono::steady_clock::time_point from,
+                              std::chrono::steady_clock::time_point to) {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(to - from).count();
+    }
+};
+
+// Test 1: stop() makes the descriptor readable; reset() clears it
+TEST_F(DiscoveryShutdownTest, StopSignalWakesPoll) {
+    StopSignal stop;
+    ASSERT_GE(stop.fd(), 0);
+
+    struct pollfd pfd = { stop.fd(), POLLIN, 0 };
+    EXPECT_EQ(poll(&pfd, 1, 0), 0);
+
+    std::thread stopper([&stop] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        stop.stop();
+    });
+    auto start = std::chrono::steady_clock::now();
+    EXPECT_EQ(poll(&pfd, 1, 5000), 1);
+    EXPECT_LT(elapsed_ms(start), 1000);
+    stopper.join();
+    EXPECT_TRUE(stop.stopped());
+
+    stop.reset();
+    EXPECT_FALSE(stop.stopped());
+    EXPECT_EQ(poll(&pfd, 1, 0), 0);
+}
+
+// Test 2: Cancelling the mDNS browser wakes a scan() waiting for answers
+TEST_F(DiscoveryShutdownTest, MdnsCancelWakesScan) {
+    MdnsScanner scanner;
+
+    std::chrono::steady_clock::time_point finished;
+    std::thread scan([&] {
+        scanner.scan();
+        finished = std::chrono::steady_clock::now();
+    });
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    auto cancelled = std::chrono::steady_clock::now();
+    scanner.cancel();
+    scan.join();
+
+    EXPECT_LT(between_ms(cancelled, finished), 50);
+    EXPECT_FALSE(scanner.is_running());
+    EXPECT_FALSE(scanner.start());
+}
+
+// Test 3: cancel() cuts a subnet sweep short
+TEST_F(DiscoveryShutdownTest, DeviceDiscoveryCancelIsImmediate) {
+    DeviceDiscovery discovery;
+
+    std::chrono::steady_clock::time_point finished;
+    std::thread sweep([&] {
+        discovery.get_local_subnet_ips();
+        finished = std::chrono::steady_clock::now();
+    });
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    auto cancelled = std::chrono::steady_clock::now();
+    discovery.cancel();
+    sweep.join();
+
+    // Either the sweep was already over or it stopped at once
+    EXPECT_LT(between_ms(cancelled, finished), 50);
+
+    StreamDevice device;
+    auto start = std::chrono::steady_clock::now();
+    EXPECT_FALSE(discovery.probe_device("192.0.2.1", device));
+    EXPECT_LT(elapsed_ms(start), 50);
+}
+
+// Test 4: Dropping the last reference mid-scan, as a source destructor
+// does, returns in under 50 ms
+TEST_F(DiscoveryShutdownTest, ReleaseDuringScanUnder50ms) {
+    auto service = DiscoveryService::acquire();
+    auto id = service->subscribe([](const DeviceTable&) {});
+    service->request_scan();
+
+    // Let the first sweep get under way
+    std::this_thread::sleep_for(std::chrono::milliseconds(150));
+
+    auto start = std::chrono::steady_clock::now();
+    service->unsubscribe(id);
+    service.reset();
+    EXPECT_LT(elapsed_ms(start), 50);
+}
+
+int main(int argc, char** argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
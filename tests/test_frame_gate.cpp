@@ -0,0 +1,129 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <vector>
+#include "../src/decoder/frame-gate.hpp"
+#include "../src/protocols/rtp-depacketizer.hpp"
+
+using namespace berrystreamcam;
+
+namespace {
+
+VideoFrame make_frame(uint64_t pts, bool keyframe, bool corrupt = false)
+{
+    VideoFrame frame = {};
+    frame.pts = pts;
+    frame.is_keyframe = keyframe;
+    frame.is_corrupt = corrupt;
+    return frame;
+}
+
+// The PTS of every frame the gate lets through
+std::vector<uint64_t> decoded(FrameGate& gate, const std::vector<VideoFrame>& frames)
+{
+    std::vector<uint64_t> out;
+    for (const VideoFrame& frame : frames) {
+        if (gate.admit(frame)) {
+            out.push_back(frame.pts);
+        }
+    }
+    return out;
+}
+
+std::vector<uint8_t> rtp(uint16_t seq, uint32_t ts, bool marker, std::vector<uint8_t> payload)
+{
+    std::vector<uint8_t> pkt = {
+        0x80, static_cast<uint8_t>(96 | (marker ? 0x80 : 0)),
+        static_cast<uint8_t>(seq >> 8), static_cast<uint8_t>(seq),
+        static_cast<uint8_t>(ts >> 24), static_cast<uint8_t>(ts >> 16),
+        static_cast<uint8_t>(ts >> 8), static_cast<uint8_t>(ts),
+        0x12, 0x34, 0x56, 0x78
+    };
+    pkt.insert(pkt.end(), payload.begin(), payload.end());
+    return pkt;
+}
+
+} // namespace
+
+// Test 1: An intact stream passes untouched
+TEST(FrameGateTest, IntactStreamPasses) {
+    FrameGate gate;
+    std::vector<VideoFrame> frames = {
+        make_frame(1, true), make_frame(2, false), make_frame(3, false), make_frame(4, true)
+    };
+
+    EXPECT_EQ(decoded(gate, frames), (std::vector<uint64_t>{ 1, 2, 3, 4 }));
+    EXPECT_FALSE(gate.waiting_for_keyframe());
+}
+
+// Test 2: A corrupt P-frame and the frames predicted from it are held back until a keyframe
+TEST(FrameGateTest, CorruptPFrameNotDecoded) {
+    FrameGate gate;
+    std::vector<VideoFrame> frames = {
+        make_frame(1, true), make_frame(2, false), make_frame(3, false, true),
+        make_frame(4, false), make_frame(5, false), make_frame(6, true), make_frame(7, false)
+    };
+
+    EXPECT_EQ(decoded(gate, frames), (std::vector<uint64_t>{ 1, 2, 6, 7 }));
+    EXPECT_FALSE(gate.waiting_for_keyframe());
+}
+
+// Test 3: A corrupt keyframe does not end the wait
+TEST(FrameGateTest, CorruptKeyframeKeepsWaiting) {
+    FrameGate gate;
+    std::vector<VideoFrame> frames = {
+        make_frame(1, false, true), make_frame(2, true, true), make_frame(3, false), make_frame(4, true)
+    };
+
+    EXPECT_EQ(decoded(gate, frames), (std::vector<uint64_t>{ 4 }));
+}
+
+// Test 4: reset() starts over, as on a cutover keyframe from another transport
+TEST(FrameGateTest, ResetClearsWait) {
+    FrameGate gate;
+    EXPECT_FALSE(gate.admit(make_frame(1, false, true)));
+    EXPECT_TRUE(gate.waiting_for_keyframe());
+
+    gate.reset();
+    EXPECT_TRUE(gate.admit(make_frame(2, false)));
+}
+
+// Test 5: A P-frame that lost a fragment on the wire never reaches the decoder
+TEST(FrameGateTest, DepacketizedLossNotDecoded) {
+    FrameGate gate;
+    std::vector<uint32_t> decoder;
+    std::unique_ptr<RtpDepacketizer> depacketizer;
+    depacketizer = std::make_unique<RtpDepacketizer>([&](VideoFrame&& frame) {
+        if (gate.admit(frame)) {
+            decoder.push_back(frame.timestamp);
+        }
+        depacketizer->pool()->release(frame.data);
+    }, 4, 1000000);
+
+    auto push = [&](const std::vector<uint8_t>& pkt) {
+        depacketizer->push_packet(pkt.data(), pkt.size(), 1);
+    };
+
+    push(rtp(1, 3000, true, { 0x65, 0x01 }));            // IDR
+    push(rtp(2, 6000, false, { 0x5C, 0x81, 0x02 }));     // P, FU-A start
+    // seq 3, the middle fragment, never arrives
+    push(rtp(4, 6000, true, { 0x5C, 0x41, 0x04 }));      // P, FU-A end
+    push(rtp(5, 9000, true, { 0x41, 0x05 }));            // P predicted from the broken one
+    push(rtp(6, 12000, true, { 0x65, 0x06 }));           // IDR
+    push(rtp(7, 15000, true, { 0x41, 0x07 }));
+    push(rtp(8, 18000, true, { 0x41, 0x08 }));
+    push(rtp(9, 21000, true, { 0x41, 0x09 }));
+    push(rtp(10, 24000, true, { 0x41, 0x0A }));
+    push(rtp(11, 27000, true, { 0x41, 0x0B }));
+
+    ASSERT_GE(depacketizer->get_stats().frames_corrupt, 1u);
+    ASSERT_GE(decoder.size(), 2u);
+    EXPECT_EQ(decoder[0], 3000u);
+    EXPECT_EQ(decoder[1], 12000u);
+    EXPECT_EQ(std::count(decoder.begin(), decoder.end(), 6000u), 0);
+    EXPECT_EQ(std::count(decoder.begin(), decoder.end(), 9000u), 0);
+}
+
+int main(int argc, char** argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,238 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <unistd.h>
+#include "../src/discovery/http-prober.hpp"
+
+using namespace berrystreamcam;
+
+/**
+ * Minimal keep-alive HTTP/1.1 server on loopback. Counts accepted
+ * connections so tests can tell whether the prober reused them.
+ */
+class HttpProberTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        listen_fd_ = socket(AF_INET, SOCK_STREAM, 0);
+        ASSERT_GE(listen_fd_, 0);
+
+        int one = 1;
+        setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = 0;
+        ASSERT_EQ(bind(listen_fd_, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)), 0);
+        ASSERT_EQ(listen(listen_fd_, 64), 0);
+
+        socklen_t len = sizeof(addr);
+        getsockname(listen_fd_, reinterpret_cast<struct sockaddr*>(&addr), &len);
+        port_ = ntohs(addr.sin_port);
+
+        running_ = true;
+        server_ = std::thread([this] { serve(); });
+    }
+
+    void TearDown() override {
+        running_ = false;
+        server_.join();
+        close(listen_fd_);
+    }
+
+    std::string url(const std::string& path) const {
+        return "http://127.0.0.1:" + std::to_string(port_) + path;
+    }
+
+    static HttpProbe probe(const std::string& url, bool head = false) {
+        return { url, head, false, 0, "" };
+    }
+
+    std::atomic<int> accepted_{0};
+    uint16_t port_ = 0;
+
+private:
+    // Empty response means "never answer"
+    static std::string respond(const std::string& request) {
+        bool head = request.compare(0, 5, "HEAD ") == 0;
+        std::string path = request.substr(request.find(' ') + 1);
+        path = path.substr(0, path.find(' '));
+
+        std::string status = "200 OK";
+        std::string body;
+        if (path == "/health") {
+            body = R"({"protocols": [{"type": "websocket"}]})";
+        } else if (path == "/hang") {
+            return "";
+        } else if (path == "/big") {
+            body.assign(HttpProber::MAX_BODY_BYTES + 1024, 'x');
+        } else if (path != "/") {
+            status = "404 Not Found";
+        }
+
+        std::string response = "HTTP/1.1 " + status + "\r\nContent-Length: " +
+            std::to_string(body.size()) + "\r\nConnection: keep-alive\r\n\r\n";
+        return head ? response : response + body;
+    }
+
+    void serve() {
+        std::vector<struct pollfd> fds = { { listen_fd_, POLLIN, 0 } };
+        std::vector<std::string> buffers = { "" };
+
+        while (running_) {
+            if (poll(fds.data(), fds.size(), 20) <= 0) {
+                continue;
+            }
+
+            for (size_t i = fds.size(); i-- > 1;) {
+                if (!(fds[i].revents & (POLLIN | POLLHUP | POLLERR))) {
+                    continue;
+                }
+                char chunk[4096];
+                ssize_t n = recv(fds[i].fd, chunk, sizeof(chunk), 0);
+                if (n <= 0) {
+                    close(fds[i].fd);
+                    fds.erase(fds.begin() + i);
+                    buffers.erase(buffers.begin() + i);
+                    continue;
+                }
+                buffers[i].append(chunk, n);
+                size_t end;
+                while ((end = buffers[i].find("\r\n\r\n")) != std::string::npos) {
+                    std::string response = respond(buffers[i].substr(0, end));
+                    buffers[i].erase(0, end + 4);
+                    if (!response.empty()) {
+                        send(fds[i].fd, response.data(), response.size(), MSG_NOSIGNAL);
+                    }
+                }
+            }
+
+            if (fds[0].revents & POLLIN) {
+                int fd = accept(listen_fd_, nullptr, nullptr);
+                if (fd >= 0) {
+                    accepted_++;
+                    fds.push_back({ fd, POLLIN, 0 });
+                    buffers.push_back("");
+                }
+            }
+        }
+
+        for (size_t i = 1; i < fds.size(); i++) {
+            close(fds[i].fd);
+        }
+    }
+
+    int listen_fd_ = -1;
+    std::atomic<bool> running_{false};
+    std::thread server_;
+};
+
+// Test 1: GET bodies, HEAD and status codes come back per probe
+TEST_F(HttpProberTest, ReportsStatusAndBody) {
+    HttpProber prober;
+    std::vector<HttpProbe> probes = {
+        probe(url("/health")),
+        probe(url("/"), true),
+        probe(url("/missing")),
+    };
+    prober.run(probes, 2000);
+
+    EXPECT_TRUE(probes[0].reachable);
+    EXPECT_EQ(probes[0].status, 200);
+    EXPECT_EQ(probes[0].body, R"({"protocols": [{"type": "websocket"}]})");
+
+    EXPECT_TRUE(probes[1].reachable);
+    EXPECT_EQ(probes[1].status, 200);
+    EXPECT_TRUE(probes[1].body.empty());
+
+    EXPECT_TRUE(probes[2].reachable);
+    EXPECT_EQ(probes[2].status, 404);
+}
+
+// Test 2: A closed port is unreachable; an oversized body is dropped
+TEST_F(HttpProberTest, HandlesFailures) {
+    HttpProber prober;
+    std::vector<HttpProbe> probes = {
+        probe("http://127.0.0.1:1/health"),
+        probe(url("/big")),
+    };
+    prober.run(probes, 2000);
+
+    EXPECT_FALSE(probes[0].reachable);
+    EXPECT_EQ(probes[0].status, 0);
+
+    EXPECT_TRUE(probes[1].reachable);
+    EXPECT_EQ(probes[1].status, 200);
+    EXPECT_TRUE(probes[1].body.empty());
+}
+
+// Test 3: Later batches reuse the kept-alive connection
+TEST_F(HttpProberTest, ReusesConnections) {
+    HttpProber prober;
+    for (int batch = 0; batch < 5; batch++) {
+        std::vector<HttpProbe> probes = { probe(url("/health")) };
+        prober.run(probes, 2000);
+        ASSERT_EQ(probes[0].status, 200);
+    }
+    EXPECT_EQ(accepted_.load(), 1);
+}
+
+// Test 4: A batch runs concurrently, not one request after another
+TEST_F(HttpProberTest, RunsBatchConcurrently) {
+    HttpProber prober;
+
+    // Unroutable targets each hit the full timeout
+    std::vector<HttpProbe> probes;
+    for (int i = 0; i < 8; i++) {
+        probes.push_back(probe("http://192.0.2." + std::to_string(200 + i) + ":8080/health"));
+    }
+    probes.push_back(probe(url("/health")));
+
+    auto start = std::chrono::steady_clock::now();
+    prober.run(probes, 300);
+    auto elapsed = std::chrono::steady_clock::now() - start;
+
+    EXPECT_LT(std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count(), 1500);
+    EXPECT_EQ(probes.back().status, 200);
+}
+
+// Test 5: A stop signal ends a batch at once instead of after the timeout
+TEST_F(HttpProberTest, StopAbandonsBatch) {
+    HttpProber prober;
+    StopSignal stop;
+    prober.set_stop_signal(&stop);
+
+    std::vector<HttpProbe> probes = { probe(url("/hang")), probe(url("/hang")) };
+    std::chrono::steady_clock::time_point finished;
+    std::thread runner([&] {
+        prober.run(probes, 5000);
+        finished = std::chrono::steady_clock::now();
+    });
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    auto stopped = std::chrono::steady_clock::now();
+    stop.stop();
+    runner.join();
+
+    EXPECT_LT(std::chrono::duration_cast<std::chrono::milliseconds>(finished - stopped).count(), 50);
+    EXPECT_FALSE(probes[0].reachable);
+
+    // Later batches return without touching the network
+    std::vector<HttpProbe> later = { probe(url("/health")) };
+    prober.run(later, 5000);
+    EXPECT_FALSE(later[0].reachable);
+}
+
+int main(int argc, char** argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
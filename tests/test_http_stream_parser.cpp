@@ -0,0 +1,251 @@
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "../src/protocols/http-stream-parser.hpp"
+
+using namespace berrystreamcam;
+
+namespace {
+
+using Bytes = std::vector<uint8_t>;
+
+Bytes bytes(const std::string& text)
+{
+    return Bytes(text.begin(), text.end());
+}
+
+Bytes concat(std::initializer_list<Bytes> parts)
+{
+    Bytes out;
+    for (const Bytes& part : parts) {
+        out.insert(out.end(), part.begin(), part.end());
+    }
+    return out;
+}
+
+Bytes nal(std::initializer_list<uint8_t> payload, bool four_byte_start = true)
+{
+    Bytes out = four_byte_start ? Bytes{ 0x00, 0x00, 0x00, 0x01 } : Bytes{ 0x00, 0x00, 0x01 };
+    out.insert(out.end(), payload);
+    return out;
+}
+
+// The same NAL as it comes out of the parser, always with a 4-byte start code
+Bytes annexb(std::initializer_list<Bytes> nals)
+{
+    Bytes out;
+    for (const Bytes& unit : nals) {
+        size_t skip = unit[2] == 0x01 ? 3 : 4;
+        out.insert(out.end(), { 0x00, 0x00, 0x00, 0x01 });
+        out.insert(out.end(), unit.begin() + skip, unit.end());
+    }
+    return out;
+}
+
+// Chunked transfer encoding with the given chunk size
+Bytes chunked(const Bytes& body, size_t chunk)
+{
+    Bytes out;
+    for (size_t pos = 0; pos < body.size(); pos += chunk) {
+        size_t take = std::min(chunk, body.size() - pos);
+        char line[32];
+        snprintf(line, sizeof(line), "%zx;ext=1\r\n", take);
+        Bytes head = bytes(line);
+        out.insert(out.end(), head.begin(), head.end());
+        out.insert(out.end(), body.begin() + pos, body.begin() + pos + take);
+        out.push_back('\r');
+        out.push_back('\n');
+    }
+    Bytes tail = bytes("0\r\n\r\n");
+    out.insert(out.end(), tail.begin(), tail.end());
+    return out;
+}
+
+// Minimal JPEG: APP0, optional APP1 holding a complete thumbnail, DQT, SOS with scan data
+Bytes jpeg(uint8_t fill, bool thumbnail = false)
+{
+    Bytes out = { 0xFF, 0xD8, 0xFF, 0xE0, 0x00, 0x06, 'J', 'F', 'I', 'F' };
+    if (thumbnail) {
+        Bytes inner = { 0xFF, 0xD8, 0xFF, 0xDA, 0x00, 0x02, 0x11, 0x22, 0xFF, 0xD9 };
+        out.insert(out.end(), { 0xFF, 0xE1, 0x00, static_cast<uint8_t>(2 + inner.size()) });
+        out.insert(out.end(), inner.begin(), inner.end());
+    }
+    out.insert(out.end(), { 0xFF, 0xDB, 0x00, 0x04, 0x00, 0x01 });
+    // Scan data with a stuffed 0xFF00 and a restart marker in it
+    out.insert(out.end(), { 0xFF, 0xDA, 0x00, 0x02, fill, 0xFF, 0x00, fill, 0xFF, 0xD3, fill });
+    out.insert(out.end(), { 0xFF, 0xD9 });
+    return out;
+}
+
+const std::string OK_HEADER = "HTTP/1.1 200 OK\r\nContent-Type: video/h264\r\n\r\n";
+
+} // namespace
+
+class HttpStreamParserTest : public ::testing::Test {
+protected:
+    void TearDown() override {
+        for (VideoFrame& frame : frames) {
+            delete[] frame.data;
+        }
+    }
+
+    HttpStreamParser make(ProtocolType type) {
+        return HttpStreamParser(type, [this](VideoFrame&& frame) { frames.push_back(frame); });
+    }
+
+    Bytes payload(size_t index) const {
+        return Bytes(frames[index].data, frames[index].data + frames[index].size);
+    }
+
+    std::vector<VideoFrame> frames;
+};
+
+// Test 1: A non-200 response is rejected with the status
+TEST_F(HttpStreamParserTest, RejectsErrorStatus) {
+    HttpStreamParser parser = make(ProtocolType::HTTP_RAW_H264);
+    Bytes response = bytes("HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n");
+
+    EXPECT_FALSE(parser.feed(response.data(), response.size()));
+    EXPECT_EQ(parser.status(), 404);
+    EXPECT_NE(parser.error().find("404"), std::string::npos);
+}
+
+// Test 2: Headers that never end are cut off
+TEST_F(HttpStreamParserTest, RejectsOversizedHeader) {
+    HttpStreamParser parser = make(ProtocolType::HTTP_RAW_H264);
+    Bytes start = bytes("HTTP/1.1 200 OK\r\n");
+    ASSERT_TRUE(parser.feed(start.data(), start.size()));
+
+    Bytes filler = bytes("X-Filler: " + std::string(1000, 'a') + "\r\n");
+    bool ok = true;
+    for (int i = 0; i < 32 && ok; i++) {
+        ok = parser.feed(filler.data(), filler.size());
+    }
+    EXPECT_FALSE(ok);
+    EXPECT_FALSE(parser.headers_complete());
+}
+
+// Test 3: Access units split on first_mb_in_slice and parameter sets; IDR marks keyframes
+TEST_F(HttpStreamParserTest, SplitsH264AccessUnits) {
+    HttpStreamParser parser = make(ProtocolType::HTTP_RAW_H264);
+
+    Bytes sps = nal({ 0x67, 0x42, 0x00, 0x1F });
+    Bytes pps = nal({ 0x68, 0xCE, 0x3C, 0x80 });
+    Bytes idr = nal({ 0x65, 0x88, 0x84, 0x00, 0x21 });         // first_mb_in_slice = 0
+    Bytes idr_slice2 = nal({ 0x65, 0x44, 0x20 }, false);        // Second slice of the same picture
+    Bytes p1 = nal({ 0x41, 0x9A, 0x02, 0x80 });
+    Bytes p2 = nal({ 0x41, 0x9A, 0x04 }, false);
+
+    Bytes stream = concat({ bytes(OK_HEADER), sps, pps, idr, idr_slice2, p1, p2 });
+
+    // One byte at a time: start codes and headers split at every position
+    for (uint8_t byte : stream) {
+        ASSERT_TRUE(parser.feed(&byte, 1));
+    }
+    // p1 only ends once the next picture's first slice is complete
+    ASSERT_EQ(frames.size(), 1u);
+    parser.finish();
+    ASSERT_EQ(frames.size(), 3u);
+
+    EXPECT_TRUE(frames[0].is_keyframe);
+    EXPECT_EQ(payload(0), annexb({ sps, pps, idr, idr_slice2 }));
+    EXPECT_FALSE(frames[1].is_keyframe);
+    EXPECT_EQ(payload(1), annexb({ p1 }));
+    EXPECT_FALSE(frames[2].is_keyframe);
+    EXPECT_EQ(payload(2), annexb({ p2 }));
+    EXPECT_EQ(parser.frames(), 3u);
+}
+
+// Test 4: Chunked encoding is undone, with chunk borders cutting through NALs
+TEST_F(HttpStreamParserTest, DecodesChunkedBody) {
+    HttpStreamParser parser = make(ProtocolType::HTTP_RAW_H264);
+
+    Bytes sps = nal({ 0x67, 0x42, 0x00, 0x1F });
+    Bytes idr = nal({ 0x65, 0x88, 0x84, 0x00, 0x00, 0x03, 0x01 });   // Emulation prevention kept as is
+    Bytes aud = nal({ 0x09, 0xF0 });
+    Bytes p1 = nal({ 0x41, 0x9A, 0x02 });
+
+    Bytes header = bytes("HTTP/1.1 200 OK\r\nTransfer-Encoding: Chunked\r\n\r\n");
+    Bytes stream = concat({ header, chunked(concat({ sps, idr, aud, p1 }), 5) });
+
+    ASSERT_TRUE(parser.feed(stream.data(), stream.size()));
+    parser.finish();
+
+    ASSERT_EQ(frames.size(), 2u);
+    EXPECT_TRUE(frames[0].is_keyframe);
+    EXPECT_EQ(payload(0), annexb({ sps, idr }));
+    EXPECT_EQ(payload(1), annexb({ aud, p1 }));
+}
+
+// Test 5: A bad chunk size is fatal
+TEST_F(HttpStreamParserTest, RejectsMalformedChunk) {
+    HttpStreamParser parser = make(ProtocolType::HTTP_RAW_H264);
+    Bytes stream = bytes("HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\nzz\r\n");
+
+    EXPECT_FALSE(parser.feed(stream.data(), stream.size()));
+    EXPECT_TRUE(parser.headers_complete());
+    EXPECT_FALSE(parser.error().empty());
+}
+
+// Test 6: Multipart MJPEG yields whole images; a thumbnail's EOI does not end one
+TEST_F(HttpStreamParserTest, SplitsMultipartJpeg) {
+    HttpStreamParser parser = make(ProtocolType::HTTP_MJPEG);
+
+    Bytes first = jpeg(0x11, true);
+    Bytes second = jpeg(0x22);
+    Bytes part = bytes("--frame\r\nContent-Type: image/jpeg\r\n\r\n");
+    Bytes stream = concat({ bytes("HTTP/1.0 200 OK\r\nContent-Type: multipart/x-mixed-replace;boundary=frame\r\n\r\n"),
+                            part, first, bytes("\r\n"), part, second, bytes("\r\n"), part });
+
+    // Uneven reads
+    size_t pos = 0;
+    size_t step = 1;
+    while (pos < stream.size()) {
+        size_t take = std::min(step, stream.size() - pos);
+        ASSERT_TRUE(parser.feed(stream.data() + pos, take));
+        pos += take;
+        step = step % 7 + 1;
+    }
+
+    ASSERT_EQ(frames.size(), 2u);
+    EXPECT_EQ(payload(0), first);
+    EXPECT_EQ(payload(1), second);
+    EXPECT_TRUE(frames[0].is_keyframe);
+    EXPECT_EQ(parser.frames_dropped(), 0u);
+}
+
+// Test 7: Garbage after an SOI is dropped and the parser resyncs on the next image
+TEST_F(HttpStreamParserTest, ResyncsAfterBrokenJpeg) {
+    HttpStreamParser parser = make(ProtocolType::HTTP_MJPEG);
+
+    Bytes good = jpeg(0x33);
+    Bytes stream = concat({ bytes("HTTP/1.1 200 OK\r\n\r\n"), Bytes{ 0xFF, 0xD8, 0x12, 0x34 }, good });
+
+    ASSERT_TRUE(parser.feed(stream.data(), stream.size()));
+    ASSERT_EQ(frames.size(), 1u);
+    EXPECT_EQ(payload(0), good);
+    EXPECT_EQ(parser.frames_dropped(), 1u);
+}
+
+// Test 8: URL splitting
+TEST(HttpStreamUrl, SplitsUrl) {
+    std::string host, path;
+    int port = 0;
+
+    ASSERT_TRUE(split_http_url("http://192.168.1.20:8080/video.h264", host, port, path));
+    EXPECT_EQ(host, "192.168.1.20");
+    EXPECT_EQ(port, 8080);
+    EXPECT_EQ(path, "/video.h264");
+
+    ASSERT_TRUE(split_http_url("http://10.0.0.5", host, port, path));
+    EXPECT_EQ(port, 80);
+    EXPECT_EQ(path, "/");
+
+    EXPECT_FALSE(split_http_url("rtsp://10.0.0.5/stream", host, port, path));
+}
+
+int main(int argc, char** argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
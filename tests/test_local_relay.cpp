@@ -0,0 +1,312 @@
+#include <gtest/gtest.h>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "../src/protocols/shm-ring.hpp"
+#include "../src/protocols/local-relay.hpp"
+
+using namespace berrystreamcam;
+
+namespace {
+
+// Payload bytes derive from the sequence number, so a torn copy shows
+std::vector<uint8_t> payload(uint32_t sequence, size_t size)
+{
+    std::vector<uint8_t> bytes(size);
+    for (size_t i = 0; i < size; i++) {
+        bytes[i] = static_cast<uint8_t>(sequence * 7 + i);
+    }
+    return bytes;
+}
+
+bool write_frame(ShmRing& ring, uint32_t sequence, size_t size, bool keyframe)
+{
+    std::vector<uint8_t> bytes = payload(sequence, size);
+    VideoFrame frame = {};
+    frame.data = bytes.data();
+    frame.size = bytes.size();
+    frame.pts = sequence;
+    frame.is_keyframe = keyframe;
+    frame.width = 1280;
+    frame.height = 720;
+    return ring.write(frame);
+}
+
+bool intact(const VideoFrame& frame)
+{
+    return frame.size > 0 && payload(static_cast<uint32_t>(frame.pts), frame.size) ==
+        std::vector<uint8_t>(frame.data, frame.data + frame.size);
+}
+
+std::string unique_key(const char* name)
+{
+    return std::string("test/") + name + "/" + std::to_string(getpid());
+}
+
+} // namespace
+
+// Test 1: Frames come back in order, with their metadata, from the newest keyframe
+TEST(ShmRingTest, RoundTripFromKeyframe) {
+    auto ring = ShmRing::create("test-ring", 8, 4096);
+    ASSERT_NE(ring, nullptr);
+
+    ShmCursor before = ring->start_at_keyframe();   // Nothing written yet
+
+    write_frame(*ring, 0, 100, false);   // Unusable without a keyframe
+    write_frame(*ring, 1, 2000, true);
+    write_frame(*ring, 2, 300, false);
+
+    ShmCursor cursor = ring->start_at_keyframe();
+    VideoFrame frame = {};
+    ASSERT_TRUE(ring->read(cursor, frame));
+    EXPECT_EQ(frame.pts, 1);
+    EXPECT_TRUE(frame.is_keyframe);
+    EXPECT_EQ(frame.width, 1280);
+    EXPECT_TRUE(intact(frame));
+    delete[] frame.data;
+
+    ASSERT_TRUE(ring->read(cursor, frame));
+    EXPECT_EQ(frame.pts, 2);
+    EXPECT_TRUE(intact(frame));
+    delete[] frame.data;
+    EXPECT_FALSE(ring->read(cursor, frame));
+
+    // A reader that started early skips the inter frame before the keyframe
+    ASSERT_TRUE(ring->read(before, frame));
+    EXPECT_EQ(frame.pts, 1);
+    delete[] frame.data;
+
+    ShmRingStats stats = ring->stats();
+    EXPECT_EQ(stats.frames, 3u);
+    EXPECT_EQ(stats.bytes, 2400u);
+}
+
+// Test 2: A reader the writer laps skips ahead to the newest keyframe
+TEST(ShmRingTest, LappedReaderResyncsOnKeyframe) {
+    auto ring = ShmRing::create("test-ring", 4, 256);
+    ASSERT_NE(ring, nullptr);
+
+    write_frame(*ring, 0, 64, true);
+    ShmCursor cursor = ring->start_at_keyframe();
+
+    for (uint32_t i = 1; i <= 9; i++) {
+        write_frame(*ring, i, 64, i == 8);
+    }
+
+    VideoFrame frame = {};
+    ASSERT_TRUE(ring->read(cursor, frame));
+    EXPECT_EQ(frame.pts, 8);
+    EXPECT_TRUE(frame.is_keyframe);
+    delete[] frame.data;
+    EXPECT_EQ(cursor.overruns, 1u);
+
+    ASSERT_TRUE(ring->read(cursor, frame));
+    EXPECT_EQ(frame.pts, 9);
+    delete[] frame.data;
+}
+
+// Test 3: A frame too large for a slot leaves a gap readers wait out until a keyframe
+TEST(ShmRingTest, OversizedFrameBecomesGap) {
+    auto ring = ShmRing::create("test-ring", 8, 256);
+    ASSERT_NE(ring, nullptr);
+
+    write_frame(*ring, 0, 64, true);
+    ShmCursor cursor = ring->start_at_keyframe();
+    EXPECT_FALSE(write_frame(*ring, 1, 1000, false));
+    write_frame(*ring, 2, 64, false);   // Depends on the lost frame
+    write_frame(*ring, 3, 64, true);
+
+    std::vector<int64_t> seen;
+    VideoFrame frame = {};
+    while (ring->read(cursor, frame)) {
+        seen.push_back(frame.pts);
+        delete[] frame.data;
+    }
+    EXPECT_EQ(seen, (std::vector<int64_t>{ 0, 3 }));
+    EXPECT_EQ(ring->stats().oversized, 1u);
+}
+
+// Test 4: Only sealed files laid out as a ring are attached
+TEST(ShmRingTest, AttachValidatesFile) {
+    auto ring = ShmRing::create("test-ring", 8, 256);
+    ASSERT_NE(ring, nullptr);
+    write_frame(*ring, 0, 64, true);
+
+    auto attached = ShmRing::attach(dup(ring->fd()));
+    ASSERT_NE(attached, nullptr);
+    EXPECT_EQ(attached->slot_count(), 8u);
+    ShmCursor cursor = attached->start_at_keyframe();
+    VideoFrame frame = {};
+    ASSERT_TRUE(attached->read(cursor, frame));
+    EXPECT_TRUE(intact(frame));
+    delete[] frame.data;
+
+    // Sealed but not a ring
+    int other = memfd_create("not-a-ring", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    ASSERT_GE(other, 0);
+    ASSERT_EQ(ftruncate(other, 1 << 16), 0);
+    ASSERT_EQ(fcntl(other, F_ADD_SEALS, F_SEAL_SHRINK), 0);
+    EXPECT_EQ(ShmRing::attach(other), nullptr);
+
+    // Could be truncated under us
+    int unsealed = memfd_create("unsealed", MFD_CLOEXEC);
+    ASSERT_GE(unsealed, 0);
+    ASSERT_EQ(ftruncate(unsealed, 1 << 16), 0);
+    EXPECT_EQ(ShmRing::attach(unsealed), nullptr);
+
+    EXPECT_EQ(ShmRing::attach(-1), nullptr);
+}
+
+// Test 5: Another process writes, this one reads every frame intact, woken by the futex
+TEST(ShmRingTest, CrossProcessWriterAndReader) {
+    auto ring = ShmRing::create("test-ring", 64, 64 * 1024);
+    ASSERT_NE(ring, nullptr);
+    auto reader = ShmRing::attach(dup(ring->fd()));
+    ASSERT_NE(reader, nullptr);
+    ShmCursor cursor = reader->start_at_keyframe();
+
+    constexpr uint32_t FRAMES = 300;
+    pid_t child = fork();
+    ASSERT_GE(child, 0);
+    if (child == 0) {
+        for (uint32_t i = 0; i < FRAMES; i++) {
+            write_frame(*ring, i, 1000 + (i * 97) % 30000, i % 30 == 0);
+            usleep(500);
+        }
+        ring->close();
+        _exit(0);
+    }
+
+    uint32_t received = 0;
+    uint32_t torn = 0;
+    int64_t last = -1;
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while (std::chrono::steady_clock::now() < deadline) {
+        VideoFrame frame = {};
+        if (reader->read(cursor, frame)) {
+            received++;
+            if (!intact(frame) || frame.pts <= last) {
+                torn++;
+            }
+            last = frame.pts;
+            delete[] frame.data;
+            continue;
+        }
+        if (reader->closed()) {
+            break;
+        }
+        reader->wait(cursor, 50);
+    }
+
+    int status = 0;
+    waitpid(child, &status, 0);
+    EXPECT_TRUE(WIFEXITED(status));
+    EXPECT_TRUE(reader->closed());
+    EXPECT_EQ(torn, 0u);
+    // Falling behind would skip to a keyframe; a reader this close keeps up
+    EXPECT_EQ(cursor.overruns, 0u);
+    EXPECT_EQ(received, FRAMES);
+    EXPECT_EQ(last, static_cast<int64_t>(FRAMES - 1));
+}
+
+// Test 6: The first publisher of a key wins; consumers read its frames from shared memory
+TEST(LocalRelayTest, PublishAndConsume) {
+    std::string key = unique_key("publish");
+    EXPECT_FALSE(RelayTransport::available(key));
+
+    auto publisher = RelayPublisher::create(key);
+    ASSERT_NE(publisher, nullptr);
+    EXPECT_EQ(RelayPublisher::create(key), nullptr);   // Someone already does
+    EXPECT_TRUE(RelayTransport::available(key));
+
+    std::vector<uint8_t> keyframe = payload(0, 5000);
+    VideoFrame frame = {};
+    frame.data = keyframe.data();
+    frame.size = keyframe.size();
+    frame.is_keyframe = true;
+    publisher->publish(frame);
+
+    RelayTransport transport;
+    EXPECT_EQ(transport.protocol(), ProtocolType::LOCAL_RELAY);
+    ASSERT_TRUE(transport.connect(key));
+    EXPECT_TRUE(transport.is_connected());
+
+    // The keyframe already in the ring comes first, so a race is won at once
+    VideoFrame received = {};
+    ASSERT_TRUE(transport.receive_frame(received));
+    EXPECT_TRUE(received.is_keyframe);
+    EXPECT_TRUE(intact(received));
+    delete[] received.data;
+
+    std::vector<uint8_t> inter = payload(1, 700);
+    frame.data = inter.data();
+    frame.size = inter.size();
+    frame.pts = 1;
+    frame.is_keyframe = false;
+    publisher->publish(frame);
+    ASSERT_TRUE(transport.receive_frame(received));
+    EXPECT_EQ(received.pts, 1);
+    EXPECT_TRUE(intact(received));
+    delete[] received.data;
+    EXPECT_FALSE(transport.receive_frame(received));
+
+    // The consumer keeps its socket open and is counted
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+    while (publisher->stats().consumers != 1 && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    RelayStats stats = publisher->stats();
+    EXPECT_EQ(stats.consumers, 1u);
+    EXPECT_EQ(stats.frames, 2u);
+    EXPECT_EQ(stats.bytes, 5700u);
+    EXPECT_EQ(transport.stats().frames, 2u);
+
+    // The consumer sees the publisher go and the key is free again
+    publisher.reset();
+    EXPECT_FALSE(transport.is_connected());
+    EXPECT_FALSE(transport.receive_frame(received));
+    EXPECT_FALSE(RelayTransport::available(key));
+    transport.disconnect();
+}
+
+// Test 7: A consumer attaching mid-stream starts at the newest keyframe
+TEST(LocalRelayTest, LateConsumerStartsAtNewestKeyframe) {
+    std::string key = unique_key("late");
+    auto publisher = RelayPublisher::create(key);
+    ASSERT_NE(publisher, nullptr);
+
+    for (uint32_t i = 0; i < 10; i++) {
+        std::vector<uint8_t> bytes = payload(i, 200);
+        VideoFrame frame = {};
+        frame.data = bytes.data();
+        frame.size = bytes.size();
+        frame.pts = i;
+        frame.is_keyframe = i == 0 || i == 6;
+        publisher->publish(frame);
+    }
+
+    RelayTransport transport;
+    ASSERT_TRUE(transport.connect(key));
+    std::vector<int64_t> seen;
+    VideoFrame frame = {};
+    while (transport.receive_frame(frame)) {
+        seen.push_back(frame.pts);
+        delete[] frame.data;
+    }
+    EXPECT_EQ(seen, (std::vector<int64_t>{ 6, 7, 8, 9 }));
+
+    // Nothing to attach to under another key
+    RelayTransport other;
+    EXPECT_FALSE(other.connect(unique_key("nobody")));
+    EXPECT_FALSE(other.is_connected());
+}
+
+int main(int argc, char** argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,198 @@
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+#include "../src/discovery/mdns-records.hpp"
+
+using namespace berrystreamcam;
+
+class MdnsRecordsTest : public ::testing::Test {
+protected:
+    static constexpr const char* SERVICE = "_streamberry._tcp.local";
+    static constexpr const char* INSTANCE = "streamberry-phone._streamberry._tcp.local";
+    static constexpr uint32_t PHONE_IP = 0xC0A80114;   // 192.168.1.20
+    static constexpr uint32_t SOURCE_IP = 0xC0A80115;  // 192.168.1.21
+
+    static void put_u16(std::vector<uint8_t>& p, uint16_t v) {
+        p.push_back(v >> 8);
+        p.push_back(v & 0xFF);
+    }
+
+    static void put_u32(std::vector<uint8_t>& p, uint32_t v) {
+        put_u16(p, v >> 16);
+        put_u16(p, v & 0xFFFF);
+    }
+
+    static void put_name(std::vector<uint8_t>& p, const std::string& name) {
+        size_t start = 0;
+        while (start < name.size()) {
+            size_t dot = name.find('.', start);
+            if (dot == std::string::npos) dot = name.size();
+            p.push_back(static_cast<uint8_t>(dot - start));
+            p.insert(p.end(), name.begin() + start, name.begin() + dot);
+            start = dot + 1;
+        }
+        p.push_back(0);
+    }
+
+    static void put_header(std::vector<uint8_t>& p, uint16_t answers, uint16_t additional) {
+        put_u16(p, 0);        // ID
+        put_u16(p, 0x8400);   // Response, authoritative
+        put_u16(p, 0);
+        put_u16(p, answers);
+        put_u16(p, 0);
+        put_u16(p, additional);
+    }
+
+    // PTR + SRV answers and an A record in the additional section, with compression
+    std::vector<uint8_t> announcement(uint32_t ttl, bool with_address = true) {
+        std::vector<uint8_t> p;
+        put_header(p, 2, with_address ? 1 : 0);
+
+        size_t service_offset = p.size();
+        put_name(p, "_Streamberry._tcp.local");   // Mixed case on the wire
+        put_u16(p, MDNS_TYPE_PTR);
+        put_u16(p, 1);
+        put_u32(p, ttl);
+        std::vector<uint8_t> rdata;
+        rdata.push_back(17);
+        std::string label = "Streamberry-phone";
+        rdata.insert(rdata.end(), label.begin(), label.end());
+        rdata.push_back(0xC0);
+        rdata.push_back(static_cast<uint8_t>(service_offset));
+        put_u16(p, static_cast<uint16_t>(rdata.size()));
+        size_t instance_offset = p.size();
+        p.insert(p.end(), rdata.begin(), rdata.end());
+
+        p.push_back(0xC0);                       // SRV owner: pointer to the instance
+        p.push_back(static_cast<uint8_t>(instance_offset));
+        put_u16(p, MDNS_TYPE_SRV);
+        put_u16(p, 0x8001);                      // Cache-flush, IN
+        put_u32(p, ttl);
+        std::vector<uint8_t> srv;
+        put_u16(srv, 0);
+        put_u16(srv, 0);
+        put_u16(srv, 8080);
+        put_name(srv, "phone.local");
+        put_u16(p, static_cast<uint16_t>(srv.size()));
+        p.insert(p.end(), srv.begin(), srv.end());
+
+        if (with_address) {
+            put_name(p, "phone.local");
+            put_u16(p, MDNS_TYPE_A);
+            put_u16(p, 0x8001);
+            put_u32(p, ttl);
+            put_u16(p, 4);
+            put_u32(p, PHONE_IP);
+        }
+        return p;
+    }
+
+    std::vector<MdnsRecord> parse(const std::vector<uint8_t>& packet) {
+        std::vector<MdnsRecord> records;
+        EXPECT_TRUE(parse_mdns_response(packet.data(), packet.size(), records));
+        return records;
+    }
+};
+
+// Test 1: Compressed names, cache-flush class and lowercasing
+TEST_F(MdnsRecordsTest, ParsesAnnouncement) {
+    auto records = parse(announcement(120));
+    ASSERT_EQ(records.size(), 3u);
+
+    EXPECT_EQ(records[0].type, MDNS_TYPE_PTR);
+    EXPECT_EQ(records[0].name, SERVICE);
+    EXPECT_EQ(records[0].target, INSTANCE);
+    EXPECT_EQ(records[0].ttl, 120u);
+
+    EXPECT_EQ(records[1].type, MDNS_TYPE_SRV);
+    EXPECT_EQ(records[1].name, INSTANCE);
+    EXPECT_EQ(records[1].target, "phone.local");
+    EXPECT_EQ(records[1].port, 8080);
+
+    EXPECT_EQ(records[2].type, MDNS_TYPE_A);
+    EXPECT_EQ(records[2].address, PHONE_IP);
+}
+
+// Test 2: Queries, truncated packets and pointer loops are handled
+TEST_F(MdnsRecordsTest, RejectsMalformed) {
+    std::vector<MdnsRecord> records;
+    auto query = build_mdns_query(SERVICE);
+    EXPECT_FALSE(parse_mdns_response(query.data(), query.size(), records));
+
+    auto packet = announcement(120);
+    packet.resize(packet.size() - 3);
+    EXPECT_TRUE(parse_mdns_response(packet.data(), packet.size(), records));
+    EXPECT_EQ(records.size(), 2u);   // The truncated A record is dropped
+
+    std::vector<uint8_t> loop;
+    put_header(loop, 1, 0);
+    loop.push_back(0xC0);
+    loop.push_back(12);              // Points at itself
+    records.clear();
+    EXPECT_TRUE(parse_mdns_response(loop.data(), loop.size(), records));
+    EXPECT_TRUE(records.empty());
+}
+
+// Test 3: Query wire format
+TEST_F(MdnsRecordsTest, BuildsQuery) {
+    auto query = build_mdns_query(SERVICE);
+    ASSERT_EQ(query.size(), 12u + 25 + 4);
+    EXPECT_EQ(query[5], 1);          // One question
+    EXPECT_EQ(query[12], 12);        // "_streamberry"
+    EXPECT_EQ(query[25], 4);         // "_tcp"
+    EXPECT_EQ(query[query.size() - 3], MDNS_TYPE_PTR);
+    EXPECT_EQ(query[query.size() - 1], 1);
+}
+
+// Test 4: Records resolve into a service and lapse with their TTL
+TEST_F(MdnsRecordsTest, TableResolvesAndExpires) {
+    MdnsServiceTable table(SERVICE);
+    EXPECT_TRUE(table.apply(parse(announcement(120)), SOURCE_IP, 1000));
+
+    auto services = table.services(1000);
+    ASSERT_EQ(services.size(), 1u);
+    EXPECT_EQ(services[0].instance, INSTANCE);
+    EXPECT_EQ(services[0].address, PHONE_IP);
+    EXPECT_EQ(services[0].port, 8080);
+
+    // Re-announcing the same thing is not a change
+    EXPECT_FALSE(table.apply(parse(announcement(120)), SOURCE_IP, 2000));
+
+    EXPECT_FALSE(table.expire(2000 + 119000));
+    EXPECT_TRUE(table.expire(2000 + 120000));
+    EXPECT_TRUE(table.services(2000 + 120000).empty());
+}
+
+// Test 5: Goodbye removes immediately; missing A falls back to the sender
+TEST_F(MdnsRecordsTest, GoodbyeAndSourceFallback) {
+    MdnsServiceTable table(SERVICE);
+    EXPECT_TRUE(table.apply(parse(announcement(120, false)), SOURCE_IP, 0));
+    ASSERT_EQ(table.services(0).size(), 1u);
+    EXPECT_EQ(table.services(0)[0].address, SOURCE_IP);
+
+    EXPECT_TRUE(table.apply(parse(announcement(0, false)), SOURCE_IP, 10));
+    EXPECT_TRUE(table.services(10).empty());
+}
+
+// Test 6: Refresh queries at 80/85/90/95% of the PTR lifetime
+TEST_F(MdnsRecordsTest, RefreshSchedule) {
+    MdnsServiceTable table(SERVICE);
+    table.apply(parse(announcement(100)), SOURCE_IP, 0);
+
+    EXPECT_FALSE(table.take_refresh(79999));
+    EXPECT_TRUE(table.take_refresh(80000));
+    EXPECT_FALSE(table.take_refresh(84999));
+    EXPECT_TRUE(table.take_refresh(85000));
+    EXPECT_TRUE(table.take_refresh(90000));
+    EXPECT_TRUE(table.take_refresh(95000));
+    EXPECT_FALSE(table.take_refresh(99999));
+
+    // An answer restarts the schedule
+    table.apply(parse(announcement(100)), SOURCE_IP, 96000);
+    EXPECT_FALSE(table.take_refresh(97000));
+}
+
+int main(int argc, char** argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
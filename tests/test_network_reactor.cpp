@@ -0,0 +1,322 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include <vector>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#include "../src/protocols/network-reactor.hpp"
+
+using namespace berrystreamcam;
+
+namespace {
+
+int thread_count()
+{
+    DIR* dir = opendir("/proc/self/task");
+    if (!dir) {
+        return -1;
+    }
+    int count = 0;
+    while (struct dirent* entry = readdir(dir)) {
+        if (entry->d_name[0] != '.') {
+            count++;
+        }
+    }
+    closedir(dir);
+    return count;
+}
+
+double process_cpu_seconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * Non-blocking socket pair standing in for one camera connection: the
+ * test writes to writer, the reactor watches reader.
+ */
+struct FakeSource {
+    int reader = -1;
+    int writer = -1;
+    std::atomic<int> reads{0};
+    std::atomic<size_t> bytes{0};
+    NetworkReactor::Id id = 0;
+
+    FakeSource() {
+        int fds[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0) {
+            reader = fds[0];
+            writer = fds[1];
+            fcntl(reader, F_SETFL, fcntl(reader, F_GETFL, 0) | O_NONBLOCK);
+        }
+    }
+
+    ~FakeSource() {
+        close(reader);
+        close(writer);
+    }
+
+    void drain() {
+        uint8_t buffer[4096];
+        ssize_t received;
+        while ((received = recv(reader, buffer, sizeof(buffer), MSG_DONTWAIT)) > 0) {
+            bytes += received;
+        }
+        reads++;
+    }
+};
+
+bool wait_for(const std::function<bool()>& condition, int timeout_ms)
+{
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+    while (!condition()) {
+        if (std::chrono::steady_clock::now() > deadline) {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    }
+    return true;
+}
+
+} // namespace
+
+class NetworkReactorTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        reactor = NetworkReactor::acquire();
+        ASSERT_TRUE(reactor);
+    }
+
+    std::shared_ptr<NetworkReactor> reactor;
+};
+
+// Test 1: Handlers share one reactor, and its workers go when the last one does
+TEST(NetworkReactorLifetime, SharedAndReleased) {
+    // Runtimes such as sanitizers add a helper thread on the first spawn
+    std::thread([]() {}).join();
+    int before = thread_count();
+
+    {
+        auto first = NetworkReactor::acquire();
+        auto second = NetworkReactor::acquire();
+        EXPECT_EQ(first.get(), second.get());
+        EXPECT_EQ(first->worker_count(), NetworkReactor::WORKER_COUNT);
+        EXPECT_EQ(thread_count(), before + static_cast<int>(NetworkReactor::WORKER_COUNT));
+    }
+
+    EXPECT_EQ(thread_count(), before);
+}
+
+// Test 2: A readable descriptor runs its callback, and runs it again on new data
+TEST_F(NetworkReactorTest, DispatchesReadable) {
+    FakeSource source;
+    source.id = reactor->add(source.reader, [&source]() { source.drain(); });
+    ASSERT_NE(source.id, 0u);
+
+    ASSERT_EQ(send(source.writer, "abc", 3, 0), 3);
+    ASSERT_TRUE(wait_for([&]() { return source.bytes == 3; }, 1000));
+
+    ASSERT_EQ(send(source.writer, "defg", 4, 0), 4);
+    ASSERT_TRUE(wait_for([&]() { return source.bytes == 7; }, 1000));
+
+    reactor->remove(source.id);
+    EXPECT_EQ(reactor->registration_count(), 0u);
+}
+
+// Test 3: Timers fire at their interval on the same workers
+TEST_F(NetworkReactorTest, TimerFires) {
+    std::atomic<int> ticks{0};
+    NetworkReactor::Id id = reactor->add_timer(10, [&ticks]() { ticks++; });
+    ASSERT_NE(id, 0u);
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    reactor->remove(id);
+    int seen = ticks;
+
+    EXPECT_GE(seen, 5);
+    EXPECT_LE(seen, 21);
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    EXPECT_EQ(ticks.load(), seen);
+}
+
+// Test 4: remove() waits for a running callback
+TEST_F(NetworkReactorTest, RemoveWaitsForRunningCallback) {
+    FakeSource source;
+    std::atomic<bool> inside{false};
+    std::atomic<bool> finished{false};
+    source.id = reactor->add(source.reader, [&]() {
+        inside = true;
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        source.drain();
+        finished = true;
+    });
+
+    ASSERT_EQ(send(source.writer, "x", 1, 0), 1);
+    ASSERT_TRUE(wait_for([&]() { return inside.load(); }, 1000));
+
+    reactor->remove(source.id);
+    EXPECT_TRUE(finished.load());
+
+    // Nothing runs after remove() has returned
+    int reads = source.reads;
+    ASSERT_EQ(send(source.writer, "y", 1, 0), 1);
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    EXPECT_EQ(source.reads.load(), reads);
+}
+
+// Test 5: A callback can drop its own registration, e.g. on end of stream
+TEST_F(NetworkReactorTest, CallbackRemovesItself) {
+    FakeSource source;
+    std::atomic<NetworkReactor::Id> id{0};
+    std::atomic<int> calls{0};
+    id = reactor->add(source.reader, [&]() {
+        calls++;
+        source.drain();
+        reactor->remove(id);
+    });
+
+    ASSERT_EQ(send(source.writer, "x", 1, 0), 1);
+    ASSERT_TRUE(wait_for([&]() { return reactor->registration_count() == 0; }, 1000));
+
+    ASSERT_EQ(send(source.writer, "y", 1, 0), 1);
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    EXPECT_EQ(calls.load(), 1);
+}
+
+// Test 6: A slow callback on one descriptor does not hold up another
+TEST_F(NetworkReactorTest, SlowCallbackDoesNotBlockOthers) {
+    if (NetworkReactor::WORKER_COUNT < 2) {
+        GTEST_SKIP() << "single worker";
+    }
+
+    FakeSource slow;
+    FakeSource fast;
+    std::atomic<bool> release{false};
+    slow.id = reactor->add(slow.reader, [&]() {
+        slow.drain();
+        while (!release) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    });
+    fast.id = reactor->add(fast.reader, [&]() { fast.drain(); });
+
+    ASSERT_EQ(send(slow.writer, "s", 1, 0), 1);
+    ASSERT_TRUE(wait_for([&]() { return slow.reads > 0; }, 1000));
+
+    ASSERT_EQ(send(fast.writer, "f", 1, 0), 1);
+    EXPECT_TRUE(wait_for([&]() { return fast.bytes == 1; }, 1000));
+
+    release = true;
+    reactor->remove(slow.id);
+    reactor->remove(fast.id);
+}
+
+// Test 7: Thread count and CPU stay flat from 1 to 16 sources at 30 fps
+TEST_F(NetworkReactorTest, ScalesWithoutThreadPerSource) {
+    constexpr int FRAME_INTERVAL_MS = 33;
+    constexpr int RUN_MS = 1000;
+    constexpr size_t FRAME_BYTES = 16 * 1024;
+
+    std::vector<uint8_t> frame(FRAME_BYTES, 0x5a);
+    int baseline = thread_count();
+    ASSERT_GT(baseline, 0);
+
+    for (int sources : { 1, 4, 16 }) {
+        std::vector<std::unique_ptr<FakeSource>> fakes;
+        for (int i = 0; i < sources; i++) {
+            auto fake = std::make_unique<FakeSource>();
+            FakeSource* raw = fake.get();
+            fake->id = reactor->add(fake->reader, [raw]() { raw->drain(); });
+            ASSERT_NE(fake->id, 0u);
+            fakes.push_back(std::move(fake));
+        }
+
+        double cpu_start = process_cpu_seconds();
+        auto start = std::chrono::steady_clock::now();
+        int peak_threads = 0;
+        int frames_sent = 0;
+
+        // One paced writer on this thread plays every camera
+        auto next = start;
+        while (std::chrono::steady_clock::now() - start < std::chrono::milliseconds(RUN_MS)) {
+            for (auto& fake : fakes) {
+                size_t sent = 0;
+                while (sent < frame.size()) {
+                    ssize_t n = send(fake->writer, frame.data() + sent, frame.size() - sent, 0);
+                    ASSERT_GT(n, 0);
+                    sent += n;
+                }
+            }
+            frames_sent++;
+            peak_threads = std::max(peak_threads, thread_count());
+            next += std::chrono::milliseconds(FRAME_INTERVAL_MS);
+            std::this_thread::sleep_until(next);
+        }
+
+        size_t expected = static_cast<size_t>(frames_sent) * FRAME_BYTES;
+        ASSERT_TRUE(wait_for([&]() {
+            for (auto& fake : fakes) {
+                if (fake->bytes != expected) {
+                    return false;
+                }
+            }
+            return true;
+        }, 2000));
+
+        double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        double cpu = process_cpu_seconds() - cpu_start;
+
+        for (auto& fake : fakes) {
+            reactor->remove(fake->id);
+        }
+
+        printf("  %2d sources: %d threads, %.1f%% CPU, %d frames each\n",
+               sources, peak_threads, 100.0 * cpu / wall, frames_sent);
+
+        // No thread per source, and reading is a small fraction of one core
+        EXPECT_EQ(peak_threads, baseline);
+        EXPECT_LT(cpu / wall, 0.5);
+    }
+}
+
+// Test 8: The last reference dropped inside a callback stops the reactor from another thread
+TEST(NetworkReactorLifetime, LastReferenceDroppedInCallback) {
+    std::thread([]() {}).join();
+    int before = thread_count();
+
+    FakeSource source;
+    std::shared_ptr<NetworkReactor> held = NetworkReactor::acquire();
+    std::weak_ptr<NetworkReactor> weak = held;
+    std::atomic<NetworkReactor::Id> id{0};
+    std::atomic<bool> dropped{false};
+    id = held->add(source.reader, [&]() {
+        source.drain();
+        NetworkReactor* reactor = held.get();
+        reactor->remove(id);
+        held.reset();
+        dropped = true;
+    });
+    ASSERT_NE(id.load(), 0u);
+
+    ASSERT_EQ(send(source.writer, "x", 1, 0), 1);
+    ASSERT_TRUE(wait_for([&]() { return dropped.load(); }, 1000));
+    EXPECT_TRUE(weak.expired());
+    EXPECT_TRUE(wait_for([&]() { return thread_count() == before; }, 1000));
+
+    // A new holder gets a fresh reactor
+    auto fresh = NetworkReactor::acquire();
+    EXPECT_EQ(fresh->registration_count(), 0u);
+}
+
+int main(int argc, char** argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,382 @@
+#include <gtest/gtest.h>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <unistd.h>
+#include "../src/protocols/restream-server.hpp"
+
+using namespace berrystreamcam;
+
+namespace {
+
+int connect_to(int port, int receive_buffer = 0)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (receive_buffer > 0) {
+        setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &receive_buffer, sizeof(receive_buffer));
+    }
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(static_cast<uint16_t>(port));
+    if (connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+void send_text(int fd, const std::string& text)
+{
+    ASSERT_EQ(send(fd, text.data(), text.size(), MSG_NOSIGNAL), static_cast<ssize_t>(text.size()));
+}
+
+// Appends to buffer until it holds at least size bytes or the peer goes quiet
+bool receive_at_least(int fd, std::string& buffer, size_t size, int idle_ms = 2000)
+{
+    char chunk[65536];
+    while (buffer.size() < size) {
+        pollfd pfd = { fd, POLLIN, 0 };
+        if (poll(&pfd, 1, idle_ms) <= 0) {
+            return false;
+        }
+        ssize_t received = recv(fd, chunk, sizeof(chunk), 0);
+        if (received <= 0) {
+            return false;
+        }
+        buffer.append(chunk, static_cast<size_t>(received));
+    }
+    return true;
+}
+
+// One response: status line and headers, plus a body if it has a length
+std::string receive_response(int fd, std::string& buffer)
+{
+    size_t end;
+    while ((end = buffer.find("\r\n\r\n")) == std::string::npos) {
+        if (!receive_at_least(fd, buffer, buffer.size() + 1)) {
+            return "";
+        }
+    }
+    size_t length = 0;
+    size_t field = buffer.find("Content-Length: ");
+    if (field != std::string::npos && field < end) {
+        length = std::stoul(buffer.substr(field + 16));
+    }
+    receive_at_least(fd, buffer, end + 4 + length);
+    std::string response = buffer.substr(0, end + 4 + length);
+    buffer.erase(0, end + 4 + length);
+    return response;
+}
+
+bool wait_for_clients(RestreamServer& server, RestreamServer::StreamId id, uint64_t clients)
+{
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+    while (server.stats(id).clients != clients) {
+        if (std::chrono::steady_clock::now() > deadline) {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    }
+    return true;
+}
+
+std::shared_ptr<const uint8_t> share(const std::vector<uint8_t>& bytes)
+{
+    std::shared_ptr<uint8_t> data(new uint8_t[bytes.size()], std::default_delete<uint8_t[]>());
+    memcpy(data.get(), bytes.data(), bytes.size());
+    return data;
+}
+
+void publish(RestreamServer& server, RestreamServer::StreamId id, const std::vector<uint8_t>& bytes,
+             bool keyframe)
+{
+    VideoFrame frame = {};
+    frame.size = bytes.size();
+    frame.is_keyframe = keyframe;
+    server.publish(id, frame, share(bytes));
+}
+
+// Test payload carrying its index and keyframe flag, without anything that looks like a start code
+std::vector<uint8_t> numbered(uint32_t index, bool keyframe, size_t size)
+{
+    std::vector<uint8_t> bytes(size, static_cast<uint8_t>(0x40 + index % 64));
+    memcpy(bytes.data(), &index, sizeof(index));
+    bytes[4] = keyframe ? 0xAA : 0x55;
+    return bytes;
+}
+
+} // namespace
+
+// Test 1: An HTTP client gets Annex-B from the next keyframe on
+TEST(RestreamServerTest, HttpH264StartsAtKeyframe) {
+    auto server = RestreamServer::create(0, false);
+    ASSERT_NE(server, nullptr);
+    auto id = server->open_stream("cam");
+    ASSERT_NE(id, 0u);
+
+    int fd = connect_to(server->port());
+    ASSERT_GE(fd, 0);
+    send_text(fd, "GET /cam/stream.h264 HTTP/1.1\r\nHost: localhost\r\n\r\n");
+    ASSERT_TRUE(wait_for_clients(*server, id, 1));
+
+    std::vector<uint8_t> inter = { 0, 0, 0, 1, 0x41, 1, 2, 3 };
+    std::vector<uint8_t> key = { 0, 0, 0, 1, 0x65, 9, 8, 7, 6 };
+    publish(*server, id, inter, false);   // Nothing to decode it against
+    publish(*server, id, key, true);
+    publish(*server, id, inter, false);
+
+    std::string buffer;
+    std::string head = receive_response(fd, buffer);
+    EXPECT_NE(head.find("200 OK"), std::string::npos);
+    EXPECT_NE(head.find("video/h264"), std::string::npos);
+
+    std::string expected(key.begin(), key.end());
+    expected.append(inter.begin(), inter.end());
+    ASSERT_TRUE(receive_at_least(fd, buffer, expected.size()));
+    EXPECT_EQ(buffer, expected);
+
+    RestreamStats stats = server->stats(id);
+    EXPECT_EQ(stats.frames, 3u);
+    EXPECT_EQ(stats.frames_dropped, 1u);
+    close(fd);
+}
+
+// Test 2: JPEG frames go out as multipart parts; H.264 does not reach MJPEG clients
+TEST(RestreamServerTest, MjpegMultipart) {
+    auto server = RestreamServer::create(0, false);
+    ASSERT_NE(server, nullptr);
+    auto id = server->open_stream("cam");
+
+    int fd = connect_to(server->port());
+    send_text(fd, "GET /cam/mjpeg HTTP/1.1\r\n\r\n");
+    ASSERT_TRUE(wait_for_clients(*server, id, 1));
+
+    std::vector<uint8_t> jpeg = { 0xFF, 0xD8, 1, 2, 3, 0xFF, 0xD9 };
+    publish(*server, id, { 0, 0, 0, 1, 0x65, 1 }, true);
+    publish(*server, id, jpeg, false);
+    publish(*server, id, jpeg, false);
+
+    std::string buffer;
+    std::string head = receive_response(fd, buffer);
+    EXPECT_NE(head.find("multipart/x-mixed-replace; boundary=berrystreamcam"), std::string::npos);
+
+    std::string part = "--berrystreamcam\r\nContent-Type: image/jpeg\r\nContent-Length: 7\r\n\r\n" +
+        std::string(jpeg.begin(), jpeg.end()) + "\r\n";
+    ASSERT_TRUE(receive_at_least(fd, buffer, 2 * part.size()));
+    EXPECT_EQ(buffer, part + part);
+    close(fd);
+}
+
+// Test 3: RTSP over TCP: describe, set up, play, and NAL units rebuilt from FU-A
+TEST(RestreamServerTest, RtspInterleavedPlayback) {
+    auto server = RestreamServer::create(0, false);
+    ASSERT_NE(server, nullptr);
+    auto id = server->open_stream("cam");
+    std::string url = "rtsp://127.0.0.1:" + std::to_string(server->port()) + "/cam";
+
+    int fd = connect_to(server->port());
+    std::string buffer;
+
+    send_text(fd, "OPTIONS " + url + " RTSP/1.0\r\nCSeq: 1\r\n\r\n");
+    std::string response = receive_response(fd, buffer);
+    EXPECT_NE(response.find("RTSP/1.0 200 OK"), std::string::npos);
+    EXPECT_NE(response.find("CSeq: 1"), std::string::npos);
+
+    send_text(fd, "DESCRIBE " + url + " RTSP/1.0\r\nCSeq: 2\r\nAccept: application/sdp\r\n\r\n");
+    response = receive_response(fd, buffer);
+    EXPECT_NE(response.find("a=rtpmap:96 H264/90000"), std::string::npos);
+    EXPECT_NE(response.find("a=control:track1"), std::string::npos);
+
+    send_text(fd, "SETUP " + url + "/track1 RTSP/1.0\r\nCSeq: 3\r\n"
+              "Transport: RTP/AVP;unicast;client_port=5000-5001\r\n\r\n");
+    EXPECT_NE(receive_response(fd, buffer).find("461"), std::string::npos);
+
+    send_text(fd, "SETUP " + url + "/track1 RTSP/1.0\r\nCSeq: 4\r\n"
+              "Transport: RTP/AVP/TCP;unicast;interleaved=2-3\r\n\r\n");
+    response = receive_response(fd, buffer);
+    EXPECT_NE(response.find("interleaved=2-3"), std::string::npos);
+    size_t field = response.find("Session: ");
+    ASSERT_NE(field, std::string::npos);
+    std::string session = response.substr(field + 9, 16);
+
+    send_text(fd, "PLAY " + url + " RTSP/1.0\r\nCSeq: 5\r\nSession: " + session + "\r\n\r\n");
+    EXPECT_NE(receive_response(fd, buffer).find("200 OK"), std::string::npos);
+    ASSERT_TRUE(wait_for_clients(*server, id, 1));
+
+    std::vector<uint8_t> sps = { 0x67, 0x42, 0x00, 0x1F };
+    std::vector<uint8_t> idr(5000);
+    idr[0] = 0x65;
+    for (size_t i = 1; i < idr.size(); i++) {
+        idr[i] = static_cast<uint8_t>(i % 251 + 1);
+    }
+    std::vector<uint8_t> access_unit = { 0, 0, 0, 1 };
+    access_unit.insert(access_unit.end(), sps.begin(), sps.end());
+    access_unit.insert(access_unit.end(), { 0, 0, 0, 1 });
+    access_unit.insert(access_unit.end(), idr.begin(), idr.end());
+    publish(*server, id, access_unit, true);
+
+    // Read packets up to the marker bit, rebuilding NAL units
+    std::vector<std::vector<uint8_t>> units;
+    std::vector<uint8_t> fragment;
+    int packets = 0;
+    bool marker = false;
+    while (!marker) {
+        ASSERT_TRUE(receive_at_least(fd, buffer, 4));
+        ASSERT_EQ(buffer[0], '$');
+        EXPECT_EQ(buffer[1], 2);
+        size_t length = (static_cast<uint8_t>(buffer[2]) << 8) | static_cast<uint8_t>(buffer[3]);
+        ASSERT_TRUE(receive_at_least(fd, buffer, 4 + length));
+        std::vector<uint8_t> packet(buffer.begin() + 4, buffer.begin() + 4 + length);
+        buffer.erase(0, 4 + length);
+        packets++;
+
+        ASSERT_GE(packet.size(), 13u);
+        EXPECT_EQ(packet[0], 0x80);
+        EXPECT_EQ(packet[1] & 0x7F, 96);
+        EXPECT_LE(packet.size(), 12 + RestreamServer::RTP_PAYLOAD_SIZE);
+        marker = (packet[1] & 0x80) != 0;
+
+        uint8_t type = packet[12] & 0x1F;
+        if (type == 28) {
+            uint8_t header = packet[13];
+            if (header & 0x80) {
+                fragment = { static_cast<uint8_t>((packet[12] & 0xE0) | (header & 0x1F)) };
+            }
+            fragment.insert(fragment.end(), packet.begin() + 14, packet.end());
+            if (header & 0x40) {
+                units.push_back(fragment);
+            }
+        } else {
+            units.emplace_back(packet.begin() + 12, packet.end());
+        }
+    }
+
+    ASSERT_EQ(units.size(), 2u);
+    EXPECT_EQ(units[0], sps);
+    EXPECT_EQ(units[1], idr);
+    EXPECT_EQ(packets, 1 + 4);   // SPS whole, IDR in four fragments
+
+    send_text(fd, "TEARDOWN " + url + " RTSP/1.0\r\nCSeq: 6\r\nSession: " + session + "\r\n\r\n");
+    EXPECT_NE(receive_response(fd, buffer).find("200 OK"), std::string::npos);
+    EXPECT_TRUE(wait_for_clients(*server, id, 0));
+    close(fd);
+}
+
+// Test 4: A client that stops reading loses frames, then resumes at a keyframe; buffers are shared
+TEST(RestreamServerTest, SlowClientDropsToKeyframe) {
+    auto server = RestreamServer::create(0, false);
+    ASSERT_NE(server, nullptr);
+    auto id = server->open_stream("cam");
+
+    int slow = connect_to(server->port(), 16 * 1024);
+    int fast = connect_to(server->port());
+    send_text(slow, "GET /cam/stream.h264 HTTP/1.1\r\n\r\n");
+    send_text(fast, "GET /cam/stream.h264 HTTP/1.1\r\n\r\n");
+    ASSERT_TRUE(wait_for_clients(*server, id, 2));
+
+    // The fast client reads along on its own thread
+    std::string fast_buffer;
+    std::thread reader([&]() { receive_at_least(fast, fast_buffer, SIZE_MAX, 500); });
+
+    constexpr uint32_t FRAMES = 150;
+    constexpr size_t FRAME_SIZE = 200 * 1024;
+    std::shared_ptr<const uint8_t> last;
+    for (uint32_t i = 0; i < FRAMES; i++) {
+        bool keyframe = i % 10 == 0 || i == FRAMES - 1;
+        VideoFrame frame = {};
+        frame.size = FRAME_SIZE;
+        frame.is_keyframe = keyframe;
+        last = share(numbered(i, keyframe, FRAME_SIZE));
+        server->publish(id, frame, last);
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+    }
+
+    // Still queued for the slow client: held by reference, not copied
+    EXPECT_GT(last.use_count(), 1);
+    EXPECT_GT(server->stats(id).frames_dropped, 0u);
+
+    std::string buffer;
+    receive_response(slow, buffer);
+    receive_at_least(slow, buffer, SIZE_MAX, 500);
+    reader.join();
+
+    auto check = [&](const std::string& bytes, bool expect_gaps) {
+        ASSERT_EQ(bytes.size() % FRAME_SIZE, 0u);
+        int64_t previous = -1;
+        bool gaps = false;
+        for (size_t offset = 0; offset < bytes.size(); offset += FRAME_SIZE) {
+            uint32_t index;
+            memcpy(&index, bytes.data() + offset, sizeof(index));
+            bool keyframe = static_cast<uint8_t>(bytes[offset + 4]) == 0xAA;
+            ASSERT_GT(static_cast<int64_t>(index), previous);
+            if (static_cast<int64_t>(index) != previous + 1) {
+                gaps = true;
+                EXPECT_TRUE(keyframe) << "frame " << index << " follows a gap";
+            }
+            previous = index;
+        }
+        EXPECT_EQ(previous, static_cast<int64_t>(FRAMES - 1));
+        if (expect_gaps) {
+            EXPECT_TRUE(gaps);
+        }
+    };
+    check(buffer, true);
+
+    size_t end = fast_buffer.find("\r\n\r\n");
+    ASSERT_NE(end, std::string::npos);
+    check(fast_buffer.substr(end + 4), false);
+
+    close(slow);
+    close(fast);
+}
+
+// Test 5: Unknown streams, duplicate names and closing a stream
+TEST(RestreamServerTest, StreamLifecycle) {
+    auto server = RestreamServer::create(0, false);
+    ASSERT_NE(server, nullptr);
+    auto id = server->open_stream("cam");
+    EXPECT_EQ(server->open_stream("cam"), 0u);
+
+    std::string buffer;
+    int fd = connect_to(server->port());
+    send_text(fd, "GET /other/stream.h264 HTTP/1.1\r\n\r\n");
+    EXPECT_NE(receive_response(fd, buffer).find("404"), std::string::npos);
+    close(fd);
+
+    fd = connect_to(server->port());
+    send_text(fd, "GET / HTTP/1.1\r\n\r\n");
+    EXPECT_NE(receive_response(fd, buffer).find("/cam/mjpeg"), std::string::npos);
+    close(fd);
+
+    fd = connect_to(server->port());
+    send_text(fd, "GET /cam/stream.h264 HTTP/1.1\r\n\r\n");
+    ASSERT_TRUE(wait_for_clients(*server, id, 1));
+    receive_response(fd, buffer);
+
+    server->close_stream(id);
+    char byte;
+    pollfd pfd = { fd, POLLIN, 0 };
+    ASSERT_EQ(poll(&pfd, 1, 2000), 1);
+    EXPECT_EQ(recv(fd, &byte, 1, 0), 0);   // Disconnected
+    close(fd);
+
+    // The name is free again, and the process-wide server is shared
+    EXPECT_NE(server->open_stream("cam"), 0u);
+    auto shared = RestreamServer::acquire(server->port() + 1, false);
+    if (shared) {
+        EXPECT_EQ(RestreamServer::acquire(server->port() + 1, false), shared);
+    }
+}
+
+int main(int argc, char** argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,138 @@
+#include <gtest/gtest.h>
+#include <vector>
+#include "../src/protocols/rtcp-session.hpp"
+
+using namespace berrystreamcam;
+
+class RtcpSessionTest : public ::testing::Test {
+protected:
+    static constexpr int64_t START_US = 1700000000LL * 1000000;
+    static constexpr uint64_t NTP_UNIX_OFFSET = 2208988800ULL;
+
+    static uint32_t read32(const uint8_t* p) {
+        return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | p[3];
+    }
+
+    static void put32(std::vector<uint8_t>& out, uint32_t value) {
+        out.push_back(static_cast<uint8_t>(value >> 24));
+        out.push_back(static_cast<uint8_t>(value >> 16));
+        out.push_back(static_cast<uint8_t>(value >> 8));
+        out.push_back(static_cast<uint8_t>(value));
+    }
+
+    static uint32_t ntp_middle(int64_t us) {
+        uint32_t seconds = static_cast<uint32_t>(us / 1000000 + NTP_UNIX_OFFSET);
+        uint32_t fraction = static_cast<uint32_t>((uint64_t(us % 1000000) << 32) / 1000000);
+        return (seconds << 16) | (fraction >> 16);
+    }
+
+    static RtpStreamStats rtp_stats(uint32_t base, uint32_t highest, uint64_t received) {
+        RtpStreamStats stats = {};
+        stats.ssrc = 0xCAFEBABE;
+        stats.base_sequence = base;
+        stats.extended_highest_sequence = highest;
+        stats.packets_received = received;
+        stats.jitter = 450;
+        stats.jitter_ms = 5.0;
+        return stats;
+    }
+
+    size_t build(const RtpStreamStats& stats, int64_t now_us) {
+        report.assign(RtcpSession::MAX_REPORT_SIZE, 0);
+        return session.build_receiver_report(stats, now_us, report.data(), report.size());
+    }
+
+    RtcpSession session;
+    std::vector<uint8_t> report;
+};
+
+// Test 1: Compound packet is RR with one block, then SDES, then XR RRTR
+TEST_F(RtcpSessionTest, ReportLayout) {
+    size_t length = build(rtp_stats(100, 199, 90), START_US);
+
+    ASSERT_GT(length, 32u);
+    EXPECT_EQ(length % 4, 0u);
+    EXPECT_EQ(report[0], 0x81);   // V=2, RC=1
+    EXPECT_EQ(report[1], 201);
+    EXPECT_EQ(read32(&report[4]), session.local_ssrc());
+
+    const uint8_t* block = &report[8];
+    EXPECT_EQ(read32(block), 0xCAFEBABEu);
+    EXPECT_EQ(read32(block + 4) & 0xFFFFFF, 10u);   // Cumulative lost
+    EXPECT_EQ(read32(block + 8), 199u);
+    EXPECT_EQ(read32(block + 12), 450u);
+
+    EXPECT_EQ(report[33], 202);   // SDES
+    size_t sdes_length = (size_t((report[34] << 8) | report[35]) + 1) * 4;
+    EXPECT_EQ(report[32 + sdes_length + 1], 207);   // XR
+    EXPECT_EQ(32 + sdes_length + 20, length);
+}
+
+// Test 2: Fraction lost covers only the interval since the last report
+TEST_F(RtcpSessionTest, IntervalLossFraction) {
+    build(rtp_stats(0, 99, 90), START_US);
+    EXPECT_EQ(report[12], 25);   // 10 of 100 -> 25/256
+    EXPECT_EQ(session.get_stats().cumulative_lost, 10);
+
+    build(rtp_stats(0, 199, 190), START_US + 1000000);
+    EXPECT_EQ(report[12], 0);    // No new loss in this interval
+    EXPECT_EQ(session.get_stats().cumulative_lost, 10);
+    EXPECT_EQ(session.get_stats().receiver_reports, 2u);
+}
+
+// Test 3: LSR/DLSR echo the last sender report
+TEST_F(RtcpSessionTest, SenderReportTiming) {
+    std::vector<uint8_t> sr = { 0x80, 200, 0x00, 0x06 };
+    put32(sr, 0xCAFEBABE);
+    put32(sr, 0x12345678);   // NTP seconds
+    put32(sr, 0x9ABCDEF0);   // NTP fraction
+    put32(sr, 0);            // RTP timestamp
+    put32(sr, 10);           // Packet count
+    put32(sr, 1000);         // Octet count
+
+    ASSERT_TRUE(session.process_packet(sr.data(), sr.size(), START_US));
+    build(rtp_stats(0, 9, 10), START_US + 500000);
+
+    EXPECT_EQ(read32(&report[24]), 0x56789ABCu);
+    EXPECT_EQ(read32(&report[28]), 32768u);   // 0.5 s in 1/65536 s
+    EXPECT_EQ(session.get_stats().sender_reports, 1u);
+}
+
+// Test 4: XR DLRR answering our RRTR yields the round-trip time
+TEST_F(RtcpSessionTest, RoundTripFromDlrr) {
+    EXPECT_LT(session.get_stats().rtt_ms, 0.0);
+    build(rtp_stats(0, 9, 10), START_US);
+
+    std::vector<uint8_t> xr = { 0x80, 207, 0x00, 0x05 };
+    put32(xr, 0xCAFEBABE);
+    xr.insert(xr.end(), { 5, 0, 0x00, 0x03 });
+    put32(xr, session.local_ssrc());
+    put32(xr, ntp_middle(START_US));
+    put32(xr, 6554);   // Camera held it ~100 ms
+
+    ASSERT_TRUE(session.process_packet(xr.data(), xr.size(), START_US + 150000));
+
+    RtcpStats stats = session.get_stats();
+    EXPECT_TRUE(stats.rtt_from_rtcp);
+    EXPECT_NEAR(stats.rtt_ms, 50.0, 1.0);
+
+    // Keepalive timing no longer overrides a measured RTCP round trip
+    session.set_fallback_rtt(200.0);
+    EXPECT_NEAR(session.get_stats().rtt_ms, 50.0, 1.0);
+}
+
+// Test 5: Non-RTCP datagrams are rejected
+TEST_F(RtcpSessionTest, RejectsGarbage) {
+    std::vector<uint8_t> garbage = { 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07 };
+    EXPECT_FALSE(session.process_packet(garbage.data(), garbage.size(), START_US));
+
+    std::vector<uint8_t> bye = { 0x81, 203, 0x00, 0x01 };
+    put32(bye, 0xCAFEBABE);
+    EXPECT_TRUE(session.process_packet(bye.data(), bye.size(), START_US));
+    EXPECT_TRUE(session.get_stats().bye_received);
+}
+
+int main(int argc, char** argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,189 @@
+#include <gtest/gtest.h>
+#include <vector>
+#include "../src/protocols/rtp-depacketizer.hpp"
+
+using namespace berrystreamcam;
+
+class RtpDepacketizerTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        depacketizer = std::make_unique<RtpDepacketizer>(
+            [this](VideoFrame&& frame) {
+                frames.emplace_back(frame.data, frame.data + frame.size);
+                keyframes.push_back(frame.is_keyframe);
+                corrupt.push_back(frame.is_corrupt);
+                depacketizer->pool()->release(frame.data);
+            },
+            8, 1000000);
+    }
+
+    // Build an RTP packet around an H.264 payload
+    static std::vector<uint8_t> rtp(uint16_t seq, uint32_t ts, bool marker,
+                                    std::vector<uint8_t> payload) {
+        std::vector<uint8_t> pkt = {
+            0x80, static_cast<uint8_t>(96 | (marker ? 0x80 : 0)),
+            static_cast<uint8_t>(seq >> 8), static_cast<uint8_t>(seq),
+            static_cast<uint8_t>(ts >> 24), static_cast<uint8_t>(ts >> 16),
+            static_cast<uint8_t>(ts >> 8), static_cast<uint8_t>(ts),
+            0x12, 0x34, 0x56, 0x78
+        };
+        pkt.insert(pkt.end(), payload.begin(), payload.end());
+        return pkt;
+    }
+
+    void push(const std::vector<uint8_t>& pkt) {
+        depacketizer->push_packet(pkt.data(), pkt.size(), 1);
+    }
+
+    std::unique_ptr<RtpDepacketizer> depacketizer;
+    std::vector<std::vector<uint8_t>> frames;
+    std::vector<bool> keyframes;
+    std::vector<bool> corrupt;
+};
+
+// Test 1: Single NAL unit per packet
+TEST_F(RtpDepacketizerTest, SingleNalUnit) {
+    push(rtp(1, 3000, true, { 0x65, 0xAA, 0xBB }));
+
+    ASSERT_EQ(frames.size(), 1u);
+    EXPECT_EQ(frames[0], (std::vector<uint8_t>{ 0, 0, 0, 1, 0x65, 0xAA, 0xBB }));
+    EXPECT_TRUE(keyframes[0]);
+    EXPECT_FALSE(corrupt[0]);
+}
+
+// Test 2: STAP-A carrying SPS and PPS
+TEST_F(RtpDepacketizerTest, StapAggregation) {
+    push(rtp(1, 3000, false, { 0x18, 0x00, 0x02, 0x67, 0x01, 0x00, 0x02, 0x68, 0x02 }));
+    push(rtp(2, 3000, true, { 0x41, 0x03 }));
+
+    ASSERT_EQ(frames.size(), 1u);
+    EXPECT_EQ(frames[0], (std::vector<uint8_t>{ 0, 0, 0, 1, 0x67, 0x01,
+                                                0, 0, 0, 1, 0x68, 0x02,
+                                                0, 0, 0, 1, 0x41, 0x03 }));
+}
+
+// Test 3: FU-A fragments delivered out of order are reassembled in order
+TEST_F(RtpDepacketizerTest, FragmentReorder) {
+    push(rtp(10, 3000, false, { 0x7C, 0x85, 0x01 }));  // start, IDR
+    push(rtp(12, 3000, true,  { 0x7C, 0x45, 0x03 }));  // end
+    push(rtp(11, 3000, false, { 0x7C, 0x05, 0x02 }));  // middle
+
+    ASSERT_EQ(frames.size(), 1u);
+    EXPECT_EQ(frames[0], (std::vector<uint8_t>{ 0, 0, 0, 1, 0x65, 0x01, 0x02, 0x03 }));
+    EXPECT_TRUE(keyframes[0]);
+    EXPECT_FALSE(corrupt[0]);
+
+    RtpStreamStats stats = depacketizer->get_stats();
+    EXPECT_EQ(stats.packets_reordered, 1u);
+    EXPECT_EQ(stats.packets_lost, 0u);
+}
+
+// Test 4: A lost middle fragment marks the access unit corrupt
+TEST_F(RtpDepacketizerTest, LossMarksFrameCorrupt) {
+    push(rtp(20, 3000, false, { 0x7C, 0x85, 0x01 }));
+    // seq 21 never arrives
+    for (uint16_t seq = 22; seq < 32; seq++) {
+        push(rtp(seq, 6000 + seq, true, { 0x41, static_cast<uint8_t>(seq) }));
+    }
+
+    ASSERT_FALSE(frames.empty());
+    EXPECT_TRUE(corrupt[0]);
+
+    RtpStreamStats stats = depacketizer->get_stats();
+    EXPECT_EQ(stats.packets_lost, 1u);
+    EXPECT_GE(stats.frames_corrupt, 1u);
+}
+
+// Test 5: Duplicates are counted and dropped
+TEST_F(RtpDepacketizerTest, DuplicatePacket) {
+    push(rtp(1, 3000, false, { 0x41, 0x01 }));
+    push(rtp(3, 3000, true, { 0x41, 0x03 }));
+    push(rtp(3, 3000, true, { 0x41, 0x03 }));
+    push(rtp(2, 3000, false, { 0x41, 0x02 }));
+
+    RtpStreamStats stats = depacketizer->get_stats();
+    EXPECT_EQ(stats.packets_duplicate, 1u);
+    ASSERT_EQ(frames.size(), 1u);
+}
+
+// Test 6: Sequence numbers wrap around without loss
+TEST_F(RtpDepacketizerTest, SequenceWrap) {
+    push(rtp(65534, 3000, true, { 0x41, 0x01 }));
+    push(rtp(0, 6000, true, { 0x41, 0x03 }));
+    push(rtp(65535, 4500, true, { 0x41, 0x02 }));
+
+    EXPECT_EQ(frames.size(), 3u);
+
+    RtpStreamStats stats = depacketizer->get_stats();
+    EXPECT_EQ(stats.packets_lost, 0u);
+    EXPECT_EQ(stats.base_sequence, 65534u);
+    EXPECT_EQ(stats.extended_highest_sequence, 65536u);
+}
+
+// Test 7: Jitter from wall-clock arrival times, as kernel timestamps give them
+TEST_F(RtpDepacketizerTest, JitterOnWallClock) {
+    const int64_t base_us = 1760000000LL * 1000000;   // Late 2025, in microseconds
+    for (uint16_t seq = 0; seq < 10; seq++) {
+        auto pkt = rtp(seq, 9000u * seq, true, { 0x41, static_cast<uint8_t>(seq) });
+        depacketizer->push_packet(pkt.data(), pkt.size(), base_us + 100000LL * seq);
+    }
+    EXPECT_EQ(depacketizer->get_stats().jitter, 0u);
+
+    // One packet 1 ms (90 ticks) late moves the estimate by 90/16
+    auto late = rtp(10, 90000, true, { 0x41, 0x0A });
+    depacketizer->push_packet(late.data(), late.size(), base_us + 1000000 + 1000);
+
+    RtpStreamStats stats = depacketizer->get_stats();
+    EXPECT_EQ(stats.jitter, 5u);
+    EXPECT_NEAR(stats.jitter_ms, 90.0 / 16 / 90, 0.001);
+}
+
+// Test 8: The frame callback may read the stats without deadlocking
+TEST_F(RtpDepacketizerTest, CallbackReadsStats) {
+    std::vector<uint64_t> completed;
+    RtpDepacketizer reader([&](VideoFrame&& frame) {
+        completed.push_back(reader.get_stats().frames_completed);
+        reader.pool()->release(frame.data);
+    });
+
+    for (uint16_t seq = 1; seq <= 3; seq++) {
+        auto pkt = rtp(seq, 3000u * seq, true, { 0x41, static_cast<uint8_t>(seq) });
+        reader.push_packet(pkt.data(), pkt.size(), 1);
+    }
+    EXPECT_EQ(completed, (std::vector<uint64_t>{ 1, 2, 3 }));
+}
+
+// Test 9: Frames are assembled in recycled pool buffers
+TEST_F(RtpDepacketizerTest, PoolRecyclesBuffers) {
+    for (uint16_t seq = 1; seq <= 50; seq++) {
+        push(rtp(seq, 3000u * seq, true, { 0x41, static_cast<uint8_t>(seq) }));
+    }
+
+    ASSERT_EQ(frames.size(), 50u);
+    FramePoolStats stats = depacketizer->pool()->stats();
+    EXPECT_LE(stats.allocations, 2u);
+    EXPECT_GE(stats.reuses, 48u);
+    EXPECT_EQ(stats.lent, 0u);
+}
+
+// Test 10: SDP parameter sets go in front of an IDR slice sent without them
+TEST_F(RtpDepacketizerTest, ParameterSetsBeforeIdr) {
+    depacketizer->set_parameter_sets({ 0, 0, 0, 1, 0x67, 0x01, 0, 0, 0, 1, 0x68, 0x02 });
+
+    push(rtp(1, 3000, false, { 0x06, 0x05 }));           // SEI
+    push(rtp(2, 3000, false, { 0x7C, 0x85, 0x01 }));     // FU-A start, IDR
+    push(rtp(3, 3000, true,  { 0x7C, 0x45, 0x02 }));     // end
+    push(rtp(4, 6000, true,  { 0x41, 0x03 }));
+
+    ASSERT_EQ(frames.size(), 2u);
+    EXPECT_EQ(frames[0], (std::vector<uint8_t>{ 0, 0, 0, 1, 0x06, 0x05,
+                                                0, 0, 0, 1, 0x67, 0x01,
+                                                0, 0, 0, 1, 0x68, 0x02,
+                                                0, 0, 0, 1, 0x65, 0x01, 0x02 }));
+    EXPECT_EQ(frames[1], (std::vector<uint8_t>{ 0, 0, 0, 1, 0x41, 0x03 }));
+}
+
+int main(int argc, char** argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,294 @@
+#include <gtest/gtest.h>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "../src/protocols/shm-ring.hpp"
+#include "../src/protocols/shm-ingest.hpp"
+
+using namespace berrystreamcam;
+
+namespace {
+
+// Payload bytes derive from the pts, so a torn or stale frame shows
+void fill(uint8_t* data, int64_t pts, size_t size)
+{
+    for (size_t i = 0; i < size; i++) {
+        data[i] = static_cast<uint8_t>(pts * 13 + i);
+    }
+}
+
+bool intact(const VideoFrame& frame)
+{
+    for (size_t i = 0; i < frame.size; i++) {
+        if (frame.data[i] != static_cast<uint8_t>(frame.pts * 13 + i)) {
+            return false;
+        }
+    }
+    return frame.size > 0;
+}
+
+// Encoded in place, the way a producer avoids its own copy
+bool produce(ShmIngestProducer& producer, int64_t pts, size_t size, bool keyframe)
+{
+    uint8_t* slot = producer.reserve(size, keyframe);
+    if (!slot) {
+        return false;
+    }
+    fill(slot, pts, size);
+
+    VideoFrame frame = {};
+    frame.size = size;
+    frame.pts = pts;
+    frame.is_keyframe = keyframe;
+    producer.commit(frame);
+    return true;
+}
+
+std::string unique_name(const char* name)
+{
+    return std::string("test/") + name + "/" + std::to_string(getpid());
+}
+
+bool wait_for_consumer(ShmIngestProducer& producer, bool attached)
+{
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+    while (producer.has_consumer() != attached) {
+        if (std::chrono::steady_clock::now() > deadline) {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    }
+    return true;
+}
+
+} // namespace
+
+// Test 1: Frames written in place arrive without a copy; shared slots show the producer's writes
+TEST(ShmIngestTest, ZeroCopyReceive) {
+    std::string name = unique_name("zero-copy");
+    auto producer = ShmIngestProducer::create(name, 8, 64 * 1024);
+    ASSERT_NE(producer, nullptr);
+
+    ShmIngestTransport transport;
+    EXPECT_EQ(transport.protocol(), ProtocolType::SHM_INGEST);
+    ASSERT_TRUE(transport.connect("shm://" + name));
+    EXPECT_TRUE(transport.is_connected());
+    ASSERT_TRUE(wait_for_consumer(*producer, true));
+
+    ASSERT_TRUE(produce(*producer, 0, 5000, true));
+    ASSERT_TRUE(produce(*producer, 1, 700, false));
+
+    VideoFrame frame = {};
+    std::shared_ptr<uint8_t> data;
+    ASSERT_TRUE(transport.receive_shared(frame, data));
+    EXPECT_EQ(frame.data, data.get());
+    EXPECT_EQ(frame.pts, 0);
+    EXPECT_TRUE(frame.is_keyframe);
+    EXPECT_TRUE(intact(frame));
+    EXPECT_EQ(transport.stats().in_flight, 1u);
+
+    // Copied by receive_frame(), whose slot goes straight back
+    VideoFrame copy = {};
+    ASSERT_TRUE(transport.receive_frame(copy));
+    EXPECT_EQ(copy.pts, 1);
+    EXPECT_TRUE(intact(copy));
+    delete[] copy.data;
+    EXPECT_EQ(transport.stats().in_flight, 1u);
+
+    data.reset();
+    EXPECT_EQ(transport.stats().in_flight, 0u);
+    EXPECT_FALSE(transport.receive_shared(frame, data));
+
+    ShmIngestStats stats = transport.stats();
+    EXPECT_EQ(stats.frames, 2u);
+    EXPECT_EQ(stats.bytes, 5700u);
+
+    // Relay rings are overwritten under their readers, so never lent out
+    auto relay_ring = ShmRing::create("test-ring", 8, 4096);
+    ASSERT_NE(relay_ring, nullptr);
+    VideoFrame keyframe = {};
+    std::vector<uint8_t> bytes(64, 1);
+    keyframe.data = bytes.data();
+    keyframe.size = bytes.size();
+    keyframe.is_keyframe = true;
+    relay_ring->write(keyframe);
+    ShmCursor cursor = relay_ring->start_at_keyframe();
+    uint64_t sequence = 0;
+    EXPECT_FALSE(relay_ring->acquire(cursor, frame, sequence));
+}
+
+// Test 2: Slots still held are never overwritten; the producer drops up to the next keyframe
+TEST(ShmIngestTest, HeldSlotsHoldBackTheProducer) {
+    std::string name = unique_name("held");
+    auto producer = ShmIngestProducer::create(name, 4, 4096);
+    ASSERT_NE(producer, nullptr);
+    ShmIngestTransport transport;
+    ASSERT_TRUE(transport.connect(name));
+
+    std::vector<std::shared_ptr<uint8_t>> held;
+    std::vector<VideoFrame> frames;
+    ASSERT_TRUE(produce(*producer, 0, 100, true));
+    for (int64_t pts = 1; pts < 4; pts++) {
+        ASSERT_TRUE(produce(*producer, pts, 100, false));
+    }
+    for (int i = 0; i < 4; i++) {
+        VideoFrame frame = {};
+        std::shared_ptr<uint8_t> data;
+        ASSERT_TRUE(transport.receive_shared(frame, data));
+        frames.push_back(frame);
+        held.push_back(data);
+    }
+
+    // Every slot is held: nothing is written over them
+    EXPECT_FALSE(produce(*producer, 4, 100, false));
+    EXPECT_FALSE(produce(*producer, 5, 100, true));
+    for (const VideoFrame& frame : frames) {
+        EXPECT_TRUE(intact(frame));
+    }
+
+    // Released, but the chain was broken: inter frames wait for a keyframe
+    held.clear();
+    EXPECT_FALSE(produce(*producer, 6, 100, false));
+    EXPECT_TRUE(produce(*producer, 7, 100, true));
+    EXPECT_TRUE(produce(*producer, 8, 100, false));
+    EXPECT_EQ(producer->stats().dropped, 3u);
+
+    std::vector<int64_t> seen;
+    VideoFrame frame = {};
+    std::shared_ptr<uint8_t> data;
+    while (transport.receive_shared(frame, data)) {
+        EXPECT_TRUE(intact(frame));
+        seen.push_back(frame.pts);
+    }
+    EXPECT_EQ(seen, (std::vector<int64_t>{ 7, 8 }));
+}
+
+// Test 3: One consumer at a time; the next starts at the newest keyframe and frees what the last held
+TEST(ShmIngestTest, ConsumerTakeover) {
+    std::string name = unique_name("takeover");
+    auto producer = ShmIngestProducer::create(name, 4, 4096);
+    ASSERT_NE(producer, nullptr);
+
+    auto first = std::make_unique<ShmIngestTransport>();
+    ASSERT_TRUE(first->connect(name));
+    ASSERT_TRUE(wait_for_consumer(*producer, true));
+
+    ShmIngestTransport second;
+    EXPECT_FALSE(second.connect(name));
+
+    ASSERT_TRUE(produce(*producer, 0, 100, true));
+    VideoFrame frame = {};
+    std::shared_ptr<uint8_t> held;
+    ASSERT_TRUE(first->receive_shared(frame, held));
+    ASSERT_TRUE(produce(*producer, 1, 100, false));
+    ASSERT_TRUE(produce(*producer, 2, 100, true));
+    ASSERT_TRUE(produce(*producer, 3, 100, false));
+
+    first.reset();
+    ASSERT_TRUE(wait_for_consumer(*producer, false));
+    EXPECT_TRUE(intact(frame));   // The old frame's mapping outlives its transport
+
+    ASSERT_TRUE(second.connect(name));
+    std::vector<int64_t> seen;
+    std::shared_ptr<uint8_t> data;
+    while (second.receive_shared(frame, data)) {
+        seen.push_back(frame.pts);
+    }
+    EXPECT_EQ(seen, (std::vector<int64_t>{ 2, 3 }));
+
+    // The slot the first consumer still holds no longer holds the producer back
+    data.reset();
+    for (int64_t pts = 4; pts < 8; pts++) {
+        EXPECT_TRUE(produce(*producer, pts, 100, pts == 4));
+    }
+    held.reset();
+
+    // The producer going away ends the stream
+    producer.reset();
+    EXPECT_FALSE(second.is_connected());
+}
+
+// Test 4: A producer in another process; every frame that arrives is intact and decodable
+TEST(ShmIngestTest, CrossProcessProducer) {
+    std::string name = unique_name("fork");
+    int ready[2];
+    ASSERT_EQ(pipe(ready), 0);
+
+    constexpr int64_t FRAMES = 300;
+    pid_t child = fork();
+    ASSERT_GE(child, 0);
+    if (child == 0) {
+        close(ready[0]);
+        auto producer = ShmIngestProducer::create(name, 16, 64 * 1024);
+        char byte = producer ? 1 : 0;
+        (void)!write(ready[1], &byte, 1);
+        if (!producer || !wait_for_consumer(*producer, true)) {
+            _exit(1);
+        }
+        for (int64_t pts = 0; pts < FRAMES; pts++) {
+            bool keyframe = pts % 30 == 0 || pts == FRAMES - 1;
+            size_t size = 1000 + (pts * 97) % 30000;
+            // Keyframes are worth waiting for; inter frames are dropped when full
+            while (!produce(*producer, pts, size, keyframe) && keyframe) {
+                usleep(100);
+            }
+            usleep(200);
+        }
+        usleep(100 * 1000);
+        _exit(0);
+    }
+
+    close(ready[1]);
+    char byte = 0;
+    ASSERT_EQ(read(ready[0], &byte, 1), 1);
+    close(ready[0]);
+    ASSERT_EQ(byte, 1);
+
+    ShmIngestTransport transport;
+    ASSERT_TRUE(transport.connect(name));
+
+    // Hold a few frames at a time, as queued decode jobs would
+    std::vector<std::shared_ptr<uint8_t>> queued;
+    uint64_t received = 0;
+    uint64_t torn = 0;
+    uint64_t broken = 0;
+    int64_t last = -1;
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while (last != FRAMES - 1 && std::chrono::steady_clock::now() < deadline) {
+        VideoFrame frame = {};
+        std::shared_ptr<uint8_t> data;
+        if (!transport.receive_shared(frame, data)) {
+            continue;
+        }
+        received++;
+        if (!intact(frame)) {
+            torn++;
+        }
+        if (last >= 0 && frame.pts != last + 1 && !frame.is_keyframe) {
+            broken++;
+        }
+        last = frame.pts;
+        queued.push_back(data);
+        if (queued.size() > 3) {
+            queued.erase(queued.begin());
+        }
+    }
+
+    int status = 0;
+    waitpid(child, &status, 0);
+    EXPECT_TRUE(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    EXPECT_EQ(last, FRAMES - 1);
+    EXPECT_GT(received, 0u);
+    EXPECT_EQ(torn, 0u);
+    EXPECT_EQ(broken, 0u);
+}
+
+int main(int argc, char** argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
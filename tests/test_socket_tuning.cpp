@@ -0,0 +1,71 @@
+#include <gtest/gtest.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <unistd.h>
+#include "../src/protocols/socket-tuning.hpp"
+
+using namespace berrystreamcam;
+
+// Test 1: Presets and the fallback for unknown names
+TEST(SocketTuningTest, Presets) {
+    NetworkProfile none = network_profile_from_name("default");
+    EXPECT_FALSE(none.tcp_nodelay);
+    EXPECT_EQ(none.rcvbuf_bytes, 0);
+    EXPECT_EQ(none.dscp, 0);
+
+    NetworkProfile low = network_profile_from_name("low_latency");
+    EXPECT_TRUE(low.tcp_nodelay);
+    EXPECT_TRUE(low.tcp_quickack);
+    EXPECT_GT(low.busy_poll_us, 0);
+    EXPECT_EQ(low.dscp, 34);
+
+    NetworkProfile wifi = network_profile_from_name("congested_wifi");
+    EXPECT_GT(wifi.rcvbuf_bytes, low.rcvbuf_bytes);
+
+    NetworkProfile unknown = network_profile_from_name("something_else");
+    NetworkProfile balanced = network_profile_from_name("balanced");
+    EXPECT_EQ(unknown.rcvbuf_bytes, balanced.rcvbuf_bytes);
+    EXPECT_TRUE(unknown.tcp_nodelay);
+}
+
+// Test 2: TCP options are read back from the socket
+TEST(SocketTuningTest, AppliesToTcpSocket) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    ASSERT_GE(fd, 0);
+
+    NetworkProfile profile = network_profile_from_name("balanced");
+    profile.rcvbuf_bytes = 64 * 1024;  // Below the default rmem_max
+    profile.dscp = 34;
+
+    SocketTuning tuning = apply_network_profile(fd, profile, true);
+    EXPECT_TRUE(tuning.applied);
+    EXPECT_TRUE(tuning.verified);
+    EXPECT_TRUE(tuning.tcp_nodelay);
+    EXPECT_GE(tuning.rcvbuf_bytes, profile.rcvbuf_bytes);
+    EXPECT_EQ(tuning.dscp, 34);
+
+    close(fd);
+}
+
+// Test 3: UDP sockets skip TCP options; invalid descriptors are reported unapplied
+TEST(SocketTuningTest, UdpAndInvalidSocket) {
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    ASSERT_GE(fd, 0);
+
+    SocketTuning tuning = apply_network_profile(fd, network_profile_from_name("balanced"), false);
+    EXPECT_TRUE(tuning.applied);
+    EXPECT_FALSE(tuning.tcp_nodelay);
+    close(fd);
+
+    SocketTuning invalid = apply_network_profile(-1, network_profile_from_name("balanced"), true);
+    EXPECT_FALSE(invalid.applied);
+
+    SocketTuning requested = requested_tuning(network_profile_from_name("balanced"));
+    EXPECT_TRUE(requested.applied);
+    EXPECT_FALSE(requested.verified);
+}
+
+int main(int argc, char** argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,191 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include "../src/source-lifecycle.hpp"
+
+using namespace berrystreamcam;
+
+/**
+ * Counts the calls the lifecycle thread makes; start/stop can be made
+ * slow to stand in for a connect or a 3 s thread join.
+ */
+class SourceLifecycleTest : public ::testing::Test {
+protected:
+    LifecycleActions actions() {
+        return {
+            [this]() { starts_++; std::this_thread::sleep_for(start_delay_); return start_result_.load(); },
+            [this]() { stops_++; std::this_thread::sleep_for(stop_delay_); },
+            [this]() { pauses_++; },
+            [this]() { resumes_++; },
+            [this]() { swaps_++; return swap_result_.load(); },
+        };
+    }
+
+    static int64_t elapsed_us(std::chrono::steady_clock::time_point since) {
+        return std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - since).count();
+    }
+
+    std::atomic<int> starts_{0};
+    std::atomic<int> stops_{0};
+    std::atomic<int> pauses_{0};
+    std::atomic<int> resumes_{0};
+    std::atomic<int> swaps_{0};
+    std::atomic<bool> start_result_{true};
+    std::atomic<bool> swap_result_{true};
+    std::chrono::milliseconds start_delay_{0};
+    std::chrono::milliseconds stop_delay_{0};
+};
+
+// Test 1: Requests return at once even while a slow stop is running
+TEST_F(SourceLifecycleTest, RequestsDoNotBlock) {
+    stop_delay_ = std::chrono::milliseconds(300);
+    SourceLifecycle lifecycle(actions());
+    lifecycle.set_active(true);
+    lifecycle.wait_idle();
+
+    auto start = std::chrono::steady_clock::now();
+    lifecycle.set_active(false);
+    lifecycle.set_visible(false);
+    lifecycle.set_active(true);
+    lifecycle.request_restart();
+    lifecycle.set_visible(true);
+    EXPECT_LT(elapsed_us(start), 5000);
+
+    lifecycle.wait_idle();
+    EXPECT_GE(starts_.load(), 2);
+}
+
+// Test 2: hide/show pairs queued behind a busy worker cancel out
+TEST_F(SourceLifecycleTest, CoalescesVisibilityToggles) {
+    start_delay_ = std::chrono::milliseconds(100);
+    SourceLifecycle lifecycle(actions());
+    lifecycle.set_active(true);
+
+    // Worker is inside the slow start
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    for (int i = 0; i < 100; i++) {
+        lifecycle.set_visible(false);
+        lifecycle.set_visible(true);
+    }
+    lifecycle.wait_idle();
+
+    EXPECT_EQ(starts_.load(), 1);
+    EXPECT_EQ(pauses_.load(), 0);
+    EXPECT_EQ(resumes_.load(), 0);
+
+    // Ending hidden applies exactly one pause, once the restart is through
+    lifecycle.request_restart();
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    for (int i = 0; i < 10; i++) {
+        lifecycle.set_visible(true);
+        lifecycle.set_visible(false);
+    }
+    lifecycle.wait_idle();
+    EXPECT_EQ(starts_.load(), 2);
+    EXPECT_EQ(pauses_.load(), 1);
+    EXPECT_EQ(resumes_.load(), 0);
+}
+
+// Test 3: A burst of restarts becomes one stop and one start
+TEST_F(SourceLifecycleTest, CoalescesRestarts) {
+    start_delay_ = std::chrono::milliseconds(100);
+    SourceLifecycle lifecycle(actions());
+    lifecycle.set_active(true);
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    for (int i = 0; i < 50; i++) {
+        lifecycle.request_restart();
+    }
+    lifecycle.wait_idle();
+
+    EXPECT_EQ(starts_.load(), 2);
+    EXPECT_EQ(stops_.load(), 1);
+}
+
+// Test 4: Restarts are ignored while inactive; a hidden source starts paused
+TEST_F(SourceLifecycleTest, FollowsWantedState) {
+    SourceLifecycle lifecycle(actions());
+    lifecycle.request_restart();
+    lifecycle.set_visible(false);
+    lifecycle.wait_idle();
+    EXPECT_EQ(starts_.load(), 0);
+    EXPECT_EQ(stops_.load(), 0);
+
+    lifecycle.set_active(true);
+    lifecycle.wait_idle();
+    EXPECT_EQ(starts_.load(), 1);
+    EXPECT_EQ(pauses_.load(), 1);
+
+    // No resume for a stream that is already gone
+    lifecycle.set_active(false);
+    lifecycle.set_visible(true);
+    lifecycle.wait_idle();
+    EXPECT_EQ(stops_.load(), 1);
+    EXPECT_EQ(resumes_.load(), 0);
+
+    // A failed start is retried on the next request
+    start_result_ = false;
+    lifecycle.set_active(true);
+    lifecycle.wait_idle();
+    start_result_ = true;
+    lifecycle.set_visible(true);
+    lifecycle.wait_idle();
+    EXPECT_EQ(starts_.load(), 3);
+}
+
+// Test 5: shutdown() stops a running stream once and ignores later requests
+TEST_F(SourceLifecycleTest, ShutdownStopsStream) {
+    SourceLifecycle lifecycle(actions());
+    lifecycle.set_active(true);
+    lifecycle.wait_idle();
+
+    lifecycle.shutdown();
+    EXPECT_EQ(stops_.load(), 1);
+
+    lifecycle.set_active(false);
+    lifecycle.set_active(true);
+    lifecycle.wait_idle();
+    EXPECT_EQ(starts_.load(), 1);
+    EXPECT_EQ(stops_.load(), 1);
+}
+
+// Test 6: A swap keeps the stream running; a declined swap or a pending restart restarts it
+TEST_F(SourceLifecycleTest, SwapAvoidsRestart) {
+    SourceLifecycle lifecycle(actions());
+    lifecycle.request_swap();
+    lifecycle.wait_idle();
+    EXPECT_EQ(swaps_.load(), 0);
+
+    lifecycle.set_active(true);
+    lifecycle.wait_idle();
+    lifecycle.request_swap();
+    lifecycle.wait_idle();
+    EXPECT_EQ(swaps_.load(), 1);
+    EXPECT_EQ(starts_.load(), 1);
+    EXPECT_EQ(stops_.load(), 0);
+
+    swap_result_ = false;
+    lifecycle.request_swap();
+    lifecycle.wait_idle();
+    EXPECT_EQ(swaps_.load(), 2);
+    EXPECT_EQ(starts_.load(), 2);
+    EXPECT_EQ(stops_.load(), 1);
+
+    // Queued behind a slow start, restart and swap merge into one restart
+    start_delay_ = std::chrono::milliseconds(100);
+    lifecycle.request_restart();
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    lifecycle.request_swap();
+    lifecycle.request_restart();
+    lifecycle.wait_idle();
+    EXPECT_EQ(swaps_.load(), 2);
+    EXPECT_EQ(starts_.load(), 4);
+    EXPECT_EQ(stops_.load(), 3);
+}
+
+int main(int argc, char** argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,516 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <srt/srt.h>
+#include "../src/protocols/srt-handler.hpp"
+
+using namespace berrystreamcam;
+
+namespace {
+
+constexpr int PMT_PID = 0x1000;
+constexpr int VIDEO_PID = 0x0100;
+constexpr size_t MESSAGE_SIZE = 7 * 188;   // What srt-live-transmit and OBS send per message
+constexpr int FRAME_COUNT = 60;
+
+sockaddr_in loopback(int port)
+{
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(static_cast<uint16_t>(port));
+    return addr;
+}
+
+uint32_t crc32_mpeg(const std::vector<uint8_t>& data)
+{
+    uint32_t crc = 0xFFFFFFFF;
+    for (uint8_t byte : data) {
+        crc ^= static_cast<uint32_t>(byte) << 24;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x80000000) ? (crc << 1) ^ 0x04C11DB7 : crc << 1;
+        }
+    }
+    return crc;
+}
+
+// PAT, PMT and one H.264 stream, as a live encoder muxes it
+class TsWriter {
+public:
+    std::vector<uint8_t> tables()
+    {
+        std::vector<uint8_t> out;
+        section(out, 0, { 0x00, 0x00, 0x01, 0xC1, 0x00, 0x00, 0x00, 0x01,
+                          static_cast<uint8_t>(0xE0 | (PMT_PID >> 8)), static_cast<uint8_t>(PMT_PID) });
+        section(out, PMT_PID, { 0x02, 0x00, 0x01, 0xC1, 0x00, 0x00,
+                                static_cast<uint8_t>(0xE0 | (VIDEO_PID >> 8)), static_cast<uint8_t>(VIDEO_PID),
+                                0xF0, 0x00, 0x1B, static_cast<uint8_t>(0xE0 | (VIDEO_PID >> 8)),
+                                static_cast<uint8_t>(VIDEO_PID), 0xF0, 0x00 });
+        return out;
+    }
+
+    std::vector<uint8_t> pes(int64_t pts, const std::vector<uint8_t>& data)
+    {
+        std::vector<uint8_t> pes = {
+            0x00, 0x00, 0x01, 0xE0, 0x00, 0x00, 0x80, 0x80, 0x05,
+            static_cast<uint8_t>(0x21 | ((pts >> 29) & 0x0E)),
+            static_cast<uint8_t>(pts >> 22),
+            static_cast<uint8_t>(((pts >> 14) & 0xFE) | 1),
+            static_cast<uint8_t>(pts >> 7),
+            static_cast<uint8_t>(((pts << 1) & 0xFE) | 1),
+        };
+        pes.insert(pes.end(), data.begin(), data.end());
+
+        std::vector<uint8_t> out;
+        for (size_t offset = 0; offset < pes.size();) {
+            size_t left = pes.size() - offset;
+            size_t stuffing = left < 184 ? 184 - left : 0;
+            size_t take = std::min<size_t>(left, 184);
+
+            out.insert(out.end(), { 0x47, static_cast<uint8_t>((offset == 0 ? 0x40 : 0) | (VIDEO_PID >> 8)),
+                                    static_cast<uint8_t>(VIDEO_PID),
+                                    static_cast<uint8_t>((stuffing ? 0x30 : 0x10) | (cc_++ & 0x0F)) });
+            if (stuffing > 0) {
+                out.push_back(static_cast<uint8_t>(stuffing - 1));
+                if (stuffing > 1) {
+                    out.push_back(0x00);
+                    out.insert(out.end(), stuffing - 2, 0xFF);
+                }
+            }
+            out.insert(out.end(), pes.begin() + offset, pes.begin() + offset + take);
+            offset += take;
+        }
+        return out;
+    }
+
+private:
+    void section(std::vector<uint8_t>& out, int pid, std::vector<uint8_t> body)
+    {
+        size_t length = body.size() - 1 + 4;
+        std::vector<uint8_t> section = { body[0], static_cast<uint8_t>(0xB0 | (length >> 8)),
+                                         static_cast<uint8_t>(length) };
+        section.insert(section.end(), body.begin() + 1, body.end());
+        uint32_t crc = crc32_mpeg(section);
+        section.insert(section.end(), { static_cast<uint8_t>(crc >> 24), static_cast<uint8_t>(crc >> 16),
+                                        static_cast<uint8_t>(crc >> 8), static_cast<uint8_t>(crc) });
+
+        size_t start = out.size();
+        out.insert(out.end(), { 0x47, static_cast<uint8_t>(0x40 | (pid >> 8)), static_cast<uint8_t>(pid), 0x10,
+                                0x00 });
+        out.insert(out.end(), section.begin(), section.end());
+        out.resize(start + 188, 0xFF);
+    }
+
+    int cc_ = 0;
+};
+
+// Frame n: an IDR every 30, slices otherwise; bytes never form a start code
+std::vector<uint8_t> access_unit(int n)
+{
+    std::vector<uint8_t> au = { 0x00, 0x00, 0x00, 0x01, static_cast<uint8_t>(n % 30 == 0 ? 0x65 : 0x41) };
+    size_t size = n % 30 == 0 ? 20000 : 3000 + (n % 7) * 500;
+    for (size_t i = au.size(); i < size; i++) {
+        au.push_back(static_cast<uint8_t>(0x10 + (n + i) % 0xE0));
+    }
+    return au;
+}
+
+/**
+ * Stands in for srt-live-transmit on loopback: a libsrt live-mode socket,
+ * listening or calling, that sends MPEG-TS in 1316-byte messages.
+ */
+class SrtSender {
+public:
+    explicit SrtSender(const std::string& passphrase = "")
+        : listener_(SRT_INVALID_SOCK)
+        , socket_(SRT_INVALID_SOCK)
+        , passphrase_(passphrase)
+    {
+        srt_startup();
+    }
+
+    ~SrtSender()
+    {
+        if (socket_ != SRT_INVALID_SOCK) {
+            srt_close(socket_);
+        }
+        if (listener_ != SRT_INVALID_SOCK) {
+            srt_close(listener_);
+        }
+        srt_cleanup();
+    }
+
+    // Returns the port to call
+    int listen()
+    {
+        listener_ = create();
+        sockaddr_in addr = loopback(0);
+        srt_bind(listener_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+        srt_listen(listener_, 1);
+
+        int length = sizeof(addr);
+        srt_getsockname(listener_, reinterpret_cast<sockaddr*>(&addr), &length);
+        return ntohs(addr.sin_port);
+    }
+
+    bool accept()
+    {
+        sockaddr_storage peer;
+        int length = sizeof(peer);
+        socket_ = srt_accept(listener_, reinterpret_cast<sockaddr*>(&peer), &length);
+        return socket_ != SRT_INVALID_SOCK;
+    }
+
+    // The receiver may not be listening yet; keep calling for a while
+    bool call(int port, const std::string& stream_id)
+    {
+        sockaddr_in addr = loopback(port);
+        for (int attempt = 0; attempt < 20; attempt++) {
+            socket_ = create();
+            srt_setsockflag(socket_, SRTO_STREAMID, stream_id.c_str(), static_cast<int>(stream_id.size()));
+            if (srt_connect(socket_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != SRT_ERROR) {
+                return true;
+            }
+            srt_close(socket_);
+            socket_ = SRT_INVALID_SOCK;
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+        return false;
+    }
+
+    void send(const std::vector<uint8_t>& ts)
+    {
+        for (size_t offset = 0; offset < ts.size(); offset += MESSAGE_SIZE) {
+            size_t size = std::min(MESSAGE_SIZE, ts.size() - offset);
+            srt_sendmsg(socket_, reinterpret_cast<const char*>(ts.data() + offset), static_cast<int>(size), -1, 1);
+        }
+    }
+
+private:
+    SRTSOCKET create()
+    {
+        SRTSOCKET socket = srt_create_socket();
+        SRT_TRANSTYPE live = SRTT_LIVE;
+        srt_setsockflag(socket, SRTO_TRANSTYPE, &live, sizeof(live));
+        if (!passphrase_.empty()) {
+            srt_setsockflag(socket, SRTO_PASSPHRASE, passphrase_.c_str(), static_cast<int>(passphrase_.size()));
+        }
+        return socket;
+    }
+
+    SRTSOCKET listener_;
+    SRTSOCKET socket_;
+    std::string passphrase_;
+};
+
+/**
+ * Passes SRT between receiver and sender on loopback, losing every
+ * nth data packet on the way to the receiver; control packets and
+ * everything the receiver sends go through.
+ */
+class LossyLink {
+public:
+    LossyLink(int sender_port, int drop_every)
+        : drop_every_(drop_every)
+        , running_(true)
+        , data_packets_(0)
+        , dropped_(0)
+        , has_receiver_(false)
+    {
+        front_ = socket(AF_INET, SOCK_DGRAM, 0);
+        back_ = socket(AF_INET, SOCK_DGRAM, 0);
+
+        sockaddr_in addr = loopback(0);
+        bind(front_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+        socklen_t length = sizeof(addr);
+        getsockname(front_, reinterpret_cast<sockaddr*>(&addr), &length);
+        port_ = ntohs(addr.sin_port);
+
+        sockaddr_in sender = loopback(sender_port);
+        connect(back_, reinterpret_cast<sockaddr*>(&sender), sizeof(sender));
+
+        thread_ = std::thread([this]() { run(); });
+    }
+
+    ~LossyLink()
+    {
+        running_ = false;
+        thread_.join();
+        close(front_);
+        close(back_);
+    }
+
+    int port() const { return port_; }
+    uint64_t dropped() const { return dropped_; }
+
+private:
+    void run()
+    {
+        uint8_t buffer[2048];
+        sockaddr_in receiver = {};
+        while (running_) {
+            pollfd fds[2] = { { front_, POLLIN, 0 }, { back_, POLLIN, 0 } };
+            if (poll(fds, 2, 10) <= 0) {
+                continue;
+            }
+
+            if (fds[0].revents & POLLIN) {
+                socklen_t length = sizeof(receiver);
+                ssize_t size = recvfrom(front_, buffer, sizeof(buffer), 0,
+                                        reinterpret_cast<sockaddr*>(&receiver), &length);
+                if (size > 0) {
+                    has_receiver_ = true;
+                    send(back_, buffer, size, 0);
+                }
+            }
+
+            if (fds[1].revents & POLLIN) {
+                ssize_t size = recv(back_, buffer, sizeof(buffer), 0);
+                if (size <= 0 || !has_receiver_) {
+                    continue;
+                }
+                // The top bit of an SRT header is clear on data packets
+                if ((buffer[0] & 0x80) == 0 && ++data_packets_ % drop_every_ == 0) {
+                    dropped_++;
+                    continue;
+                }
+                sendto(front_, buffer, size, 0, reinterpret_cast<sockaddr*>(&receiver), sizeof(receiver));
+            }
+        }
+    }
+
+    int drop_every_;
+    std::atomic<bool> running_;
+    uint64_t data_packets_;
+    std::atomic<uint64_t> dropped_;
+    bool has_receiver_;
+    int front_;
+    int back_;
+    int port_;
+    std::thread thread_;
+};
+
+struct Received {
+    std::vector<int64_t> pts;
+    uint64_t corrupt = 0;
+    uint64_t mismatched = 0;
+    uint64_t keyframes = 0;
+};
+
+void drain(SrtHandler& handler, Received& received)
+{
+    VideoFrame frame = {};
+    while (handler.receive_frame(frame)) {
+        int n = static_cast<int>(frame.pts / 3000);
+        std::vector<uint8_t> expected = access_unit(n);
+        if (frame.size != expected.size() || memcmp(frame.data, expected.data(), frame.size) != 0) {
+            received.mismatched++;
+        }
+        if (frame.is_corrupt) {
+            received.corrupt++;
+        }
+        if (frame.is_keyframe) {
+            received.keyframes++;
+        }
+        received.pts.push_back(frame.pts);
+        delete[] frame.data;
+    }
+}
+
+// 30 fps timestamps, sent a few milliseconds apart; the last frame is closed by the next unit start
+Received stream(SrtSender& sender, SrtHandler& handler)
+{
+    TsWriter writer;
+    Received received;
+    sender.send(writer.tables());
+    for (int n = 0; n <= FRAME_COUNT; n++) {
+        sender.send(writer.pes(n * 3000, access_unit(n)));
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        drain(handler, received);
+    }
+
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+    while (std::chrono::steady_clock::now() < deadline &&
+           (received.pts.empty() || received.pts.back() != (FRAME_COUNT - 1) * 3000)) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        drain(handler, received);
+    }
+    return received;
+}
+
+void expect_in_order(const Received& received)
+{
+    ASSERT_EQ(received.pts.size(), static_cast<size_t>(FRAME_COUNT));
+    for (int n = 0; n < FRAME_COUNT; n++) {
+        EXPECT_EQ(received.pts[n], n * 3000);
+    }
+    EXPECT_EQ(received.mismatched, 0u);
+    EXPECT_EQ(received.keyframes, static_cast<uint64_t>((FRAME_COUNT + 29) / 30));
+}
+
+} // namespace
+
+// Test 1: Calling a listening sender delivers every access unit in order, on an agreed latency
+TEST(SrtHandlerTest, CallerReceivesInOrder) {
+    SrtSender sender;
+    int port = sender.listen();
+
+    SrtHandler handler;
+    handler.set_latency_ms(200);
+    std::thread accept([&sender]() { EXPECT_TRUE(sender.accept()); });
+    ASSERT_TRUE(handler.connect("srt://127.0.0.1:" + std::to_string(port)));
+    accept.join();
+    EXPECT_TRUE(handler.is_connected());
+
+    Received received = stream(sender, handler);
+    expect_in_order(received);
+    EXPECT_EQ(received.corrupt, 0u);
+
+    SrtStats stats = handler.get_stats();
+    EXPECT_GE(stats.latency_ms, 200);
+    EXPECT_FALSE(stats.encrypted);
+    EXPECT_GE(stats.rtt_ms, 0.0);
+    EXPECT_GT(stats.packets_received, 0u);
+    EXPECT_GT(stats.bytes_received, 0u);
+    EXPECT_EQ(stats.packets_dropped, 0u);
+    EXPECT_EQ(stats.frames, static_cast<uint64_t>(FRAME_COUNT));
+
+    handler.disconnect();
+    EXPECT_FALSE(handler.is_connected());
+    EXPECT_LT(handler.get_stats().rtt_ms, 0.0);
+}
+
+// Test 2: A shared passphrase encrypts the session; a wrong or short one never connects
+TEST(SrtHandlerTest, Passphrase) {
+    SrtSender sender("correct horse battery");
+    int port = sender.listen();
+    std::string url = "srt://127.0.0.1:" + std::to_string(port);
+
+    SrtHandler handler;
+    handler.set_passphrase("too short");
+    EXPECT_FALSE(handler.connect(url));
+
+    handler.set_passphrase("wrong horse battery");
+    EXPECT_FALSE(handler.connect(url));
+    EXPECT_FALSE(handler.is_connected());
+
+    handler.set_passphrase("correct horse battery");
+    std::thread accept([&sender]() { EXPECT_TRUE(sender.accept()); });
+    ASSERT_TRUE(handler.connect(url));
+    accept.join();
+    EXPECT_TRUE(handler.get_stats().encrypted);
+
+    Received received = stream(sender, handler);
+    expect_in_order(received);
+}
+
+// Test 3: In listener mode the sender calls in, passing its stream id
+TEST(SrtHandlerTest, ListenerMode) {
+    // A free port for the handler to listen on
+    int probe = socket(AF_INET, SOCK_DGRAM, 0);
+    sockaddr_in addr = loopback(0);
+    bind(probe, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+    socklen_t length = sizeof(addr);
+    getsockname(probe, reinterpret_cast<sockaddr*>(&addr), &length);
+    int port = ntohs(addr.sin_port);
+    close(probe);
+
+    SrtSender sender;
+    std::thread call([&sender, port]() { EXPECT_TRUE(sender.call(port, "#!::r=live/cam1")); });
+
+    SrtHandler handler;
+    ASSERT_TRUE(handler.connect("srt://127.0.0.1:" + std::to_string(port) + "?mode=listener"));
+    call.join();
+
+    Received received = stream(sender, handler);
+    expect_in_order(received);
+    EXPECT_EQ(received.corrupt, 0u);
+}
+
+// Test 4: A listener stays bound between connects; a sender calling in meanwhile is queued
+TEST(SrtHandlerTest, ListenerQueuesCallsBetweenConnects) {
+    int probe = socket(AF_INET, SOCK_DGRAM, 0);
+    sockaddr_in addr = loopback(0);
+    bind(probe, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+    socklen_t length = sizeof(addr);
+    getsockname(probe, reinterpret_cast<sockaddr*>(&addr), &length);
+    int port = ntohs(addr.sin_port);
+    close(probe);
+    std::string url = "srt://127.0.0.1:" + std::to_string(port) + "?mode=listener";
+
+    // Nobody calls during the first attempt; it is cut short like a race abandoned
+    SrtHandler handler;
+    std::thread interrupt([&handler]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        handler.interrupt();
+    });
+    auto start = std::chrono::steady_clock::now();
+    EXPECT_FALSE(handler.connect(url));
+    EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(2));
+    interrupt.join();
+    handler.disconnect();
+
+    // The sender calls while no connect() is running, as during a retry backoff
+    SrtSender sender;
+    ASSERT_TRUE(sender.call(port, ""));
+    ASSERT_TRUE(handler.connect(url));
+
+    Received received = stream(sender, handler);
+    expect_in_order(received);
+
+    // Stopping frees the port
+    handler.disconnect();
+    handler.stop_listening();
+    int rebind = socket(AF_INET, SOCK_DGRAM, 0);
+    addr = loopback(port);
+    EXPECT_EQ(bind(rebind, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)), 0);
+    close(rebind);
+}
+
+// Test 5: Losses are retransmitted inside the latency window; nothing is dropped or corrupt
+TEST(SrtHandlerTest, RetransmitsWithinLatency) {
+    SrtSender sender;
+    LossyLink link(sender.listen(), 20);
+
+    SrtHandler handler;
+    handler.set_latency_ms(250);
+    std::thread accept([&sender]() { EXPECT_TRUE(sender.accept()); });
+    ASSERT_TRUE(handler.connect("srt://127.0.0.1:" + std::to_string(link.port())));
+    accept.join();
+
+    Received received = stream(sender, handler);
+    expect_in_order(received);
+    EXPECT_EQ(received.corrupt, 0u);
+    EXPECT_GT(link.dropped(), 0u);
+
+    SrtStats stats = handler.get_stats();
+    EXPECT_GT(stats.packets_lost, 0u);
+    EXPECT_GT(stats.packets_retransmitted, 0u);
+    EXPECT_EQ(stats.packets_dropped, 0u);
+    EXPECT_EQ(stats.frames_corrupt, 0u);
+}
+
+// Test 6: Malformed URLs and unsupported modes fail without touching the network
+TEST(SrtHandlerTest, RejectsBadUrls) {
+    SrtHandler handler;
+    EXPECT_FALSE(handler.connect("srt://no-port"));
+    EXPECT_FALSE(handler.connect("srt://:9000"));
+    EXPECT_FALSE(handler.connect("srt://127.0.0.1:9000?mode=rendezvous"));
+    EXPECT_FALSE(handler.is_connected());
+}
+
+int main(int argc, char** argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
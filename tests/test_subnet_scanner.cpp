@@ -0,0 +1,173 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <thread>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include "../src/discovery/subnet-scanner.hpp"
+
+using namespace berrystreamcam;
+
+class SubnetScannerTest : public ::testing::Test {
+protected:
+    static uint32_t ip(const char* text) {
+        struct in_addr addr;
+        inet_pton(AF_INET, text, &addr);
+        return ntohl(addr.s_addr);
+    }
+
+    void SetUp() override {
+        listen_fd_ = socket(AF_INET, SOCK_STREAM, 0);
+        ASSERT_GE(listen_fd_, 0);
+
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = 0;
+        ASSERT_EQ(bind(listen_fd_, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)), 0);
+        ASSERT_EQ(listen(listen_fd_, 16), 0);
+
+        socklen_t len = sizeof(addr);
+        getsockname(listen_fd_, reinterpret_cast<struct sockaddr*>(&addr), &len);
+        port_ = ntohs(addr.sin_port);
+    }
+
+    void TearDown() override {
+        if (listen_fd_ >= 0) {
+            close(listen_fd_);
+        }
+    }
+
+    int listen_fd_ = -1;
+    uint16_t port_ = 0;
+};
+
+// Test 1: Only resolved neighbours are taken from the ARP table
+TEST_F(SubnetScannerTest, ParseArpTable) {
+    const std::string arp =
+        "IP address       HW type     Flags       HW address            Mask     Device\n"
+        "172.16.4.20      0x1         0x2         3c:28:6d:11:22:33     *        wlan0\n"
+        "172.16.4.21      0x1         0x0         00:00:00:00:00:00     *        wlan0\n"
+        "172.16.9.7       0x1         0x6         3c:28:6d:44:55:66     *        wlan0\n"
+        "garbage\n";
+
+    auto neighbors = parse_arp_table(arp);
+    ASSERT_EQ(neighbors.size(), 2u);
+    EXPECT_EQ(neighbors[0], ip("172.16.4.20"));
+    EXPECT_EQ(neighbors[1], ip("172.16.9.7"));
+}
+
+// Test 2: Neighbours first, then the interface's /24 without ourselves or .0/.255
+TEST_F(SubnetScannerTest, CandidatesRankNeighboursFirst) {
+    std::vector<LocalInterface> interfaces = { { "eth0", ip("192.168.1.50"), ip("255.255.255.0") } };
+    std::vector<uint32_t> neighbors = { ip("192.168.1.77"), ip("10.0.0.5") };
+
+    auto candidates = build_scan_candidates(interfaces, neighbors, 4);
+    ASSERT_EQ(candidates.size(), 253u);
+    EXPECT_EQ(candidates[0], ip("192.168.1.77"));
+    EXPECT_EQ(std::count(candidates.begin(), candidates.end(), ip("192.168.1.77")), 1);
+    EXPECT_EQ(std::count(candidates.begin(), candidates.end(), ip("192.168.1.50")), 0);
+    EXPECT_EQ(std::count(candidates.begin(), candidates.end(), ip("192.168.1.0")), 0);
+    EXPECT_EQ(std::count(candidates.begin(), candidates.end(), ip("192.168.1.255")), 0);
+    EXPECT_EQ(std::count(candidates.begin(), candidates.end(), ip("10.0.0.5")), 0);
+}
+
+// Test 3: A /16 is swept only around our address and known neighbours
+TEST_F(SubnetScannerTest, WideNetmaskSweepsNeighbourSubnets) {
+    std::vector<LocalInterface> interfaces = { { "wlan0", ip("172.16.0.10"), ip("255.255.0.0") } };
+    std::vector<uint32_t> neighbors = { ip("172.16.4.20"), ip("172.16.4.21"), ip("172.16.9.7") };
+
+    auto candidates = build_scan_candidates(interfaces, neighbors, 4);
+    EXPECT_EQ(candidates.size(), 3u * 254 - 1);
+    EXPECT_EQ(candidates[0], ip("172.16.4.20"));
+    EXPECT_EQ(candidates[2], ip("172.16.9.7"));
+
+    auto capped = build_scan_candidates(interfaces, neighbors, 1);
+    EXPECT_EQ(capped.size(), 3u + 253);
+}
+
+// Test 4: A full /24 on three ports completes well under two seconds
+TEST_F(SubnetScannerTest, LoopbackSweepUnderTwoSeconds) {
+    std::vector<uint32_t> hosts;
+    for (uint32_t host = 1; host < 255; host++) {
+        hosts.push_back(ip("127.0.0.0") | host);
+    }
+
+    SubnetScanner scanner;
+    auto start = std::chrono::steady_clock::now();
+    auto hits = scanner.scan(hosts, { 1, port_, 2 });
+    auto elapsed = std::chrono::steady_clock::now() - start;
+
+    EXPECT_LT(std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count(), 2000);
+
+    // The listener is bound to 127.0.0.1 only
+    ASSERT_EQ(hits.size(), 1u);
+    EXPECT_EQ(hits[0].address, ip("127.0.0.1"));
+    EXPECT_EQ(hits[0].port, port_);
+}
+
+// Test 5: Probes that never complete are abandoned at the connect timeout
+TEST_F(SubnetScannerTest, SilentHostsTimeOut) {
+    // TEST-NET-1 is never routed; depending on the sandbox it either fails fast or hangs
+    std::vector<uint32_t> hosts;
+    for (uint32_t host = 1; host < 65; host++) {
+        hosts.push_back(ip("192.0.2.0") | host);
+    }
+
+    SubnetScanner scanner(16, 200);
+    auto start = std::chrono::steady_clock::now();
+    auto hits = scanner.scan(hosts, { 9 });
+    auto elapsed = std::chrono::steady_clock::now() - start;
+
+    EXPECT_TRUE(hits.empty());
+    EXPECT_LT(std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count(), 1500);
+}
+
+// Test 6: Interface enumeration skips loopback
+TEST_F(SubnetScannerTest, EnumeratesInterfaces) {
+    // Whatever remains must be sane
+    for (const auto& iface : enumerate_interfaces()) {
+        EXPECT_FALSE(iface.name.empty());
+        EXPECT_NE(iface.address, ip("127.0.0.1"));
+        EXPECT_NE(iface.netmask, 0u);
+    }
+}
+
+// Test 7: A stop signal ends the sweep without waiting out the timeouts
+TEST_F(SubnetScannerTest, StopAbandonsScan) {
+    std::vector<uint32_t> hosts;
+    for (uint32_t host = 1; host < 65; host++) {
+        hosts.push_back(ip("192.0.2.0") | host);
+    }
+
+    StopSignal stop;
+    SubnetScanner scanner(16, 2000);
+    scanner.set_stop_signal(&stop);
+
+    std::chrono::steady_clock::time_point finished;
+    std::thread sweep([&] {
+        scanner.scan(hosts, { 9 });
+        finished = std::chrono::steady_clock::now();
+    });
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    auto stopped = std::chrono::steady_clock::now();
+    stop.stop();
+    sweep.join();
+
+    // Either it already failed fast or it stopped at once
+    EXPECT_LT(std::chrono::duration_cast<std::chrono::milliseconds>(finished - stopped).count(), 50);
+
+    // Even an open port is not probed once stopped
+    auto hits = scanner.scan({ ip("127.0.0.1") }, { port_ });
+    EXPECT_TRUE(hits.empty());
+}
+
+int main(int argc, char** argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,338 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include "../src/protocols/transport-swap.hpp"
+
+using namespace berrystreamcam;
+
+/**
+ * Transport fed by the test. connect() and disconnect() can be made slow
+ * to stand in for a handshake or a handler thread join; a slow connect
+ * gives up on interrupt() like the real handlers do.
+ */
+class FakeTransport : public Transport {
+public:
+    explicit FakeTransport(ProtocolType type) : type_(type) {}
+
+    ProtocolType protocol() const override { return type_; }
+
+    bool connect(const std::string& url) override {
+        connects++;
+        last_url = url;
+        bool result = connect_result;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            interrupt_cv_.wait_for(lock, connect_delay, [this]() { return interrupted_; });
+            result = result && !interrupted_;
+        }
+        connected_ = result;
+        return result;
+    }
+
+    void disconnect() override {
+        std::this_thread::sleep_for(disconnect_delay);
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            interrupted_ = false;
+        }
+        connected_ = false;
+        disconnects++;
+    }
+
+    void interrupt() override {
+        std::lock_guard<std::mutex> lock(mutex_);
+        interrupted_ = true;
+        interrupt_cv_.notify_all();
+    }
+
+    bool is_connected() const override { return connected_; }
+
+    bool receive_frame(VideoFrame& frame) override {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (frames_.empty()) {
+            return false;
+        }
+        frame = frames_.front();
+        frames_.pop_front();
+        return true;
+    }
+
+    void push(bool keyframe, uint8_t tag, bool corrupt = false) {
+        VideoFrame frame = {};
+        frame.data = new uint8_t[1] { tag };
+        frame.size = 1;
+        frame.is_keyframe = keyframe;
+        frame.is_corrupt = corrupt;
+        std::lock_guard<std::mutex> lock(mutex_);
+        frames_.push_back(frame);
+    }
+
+    ~FakeTransport() override {
+        for (auto& frame : frames_) {
+            delete[] frame.data;
+        }
+    }
+
+    std::atomic<int> connects{0};
+    std::atomic<int> disconnects{0};
+    std::atomic<bool> connect_result{true};
+    std::chrono::milliseconds connect_delay{0};
+    std::chrono::milliseconds disconnect_delay{0};
+    std::string last_url;
+
+private:
+    ProtocolType type_;
+    std::atomic<bool> connected_{false};
+    std::mutex mutex_;
+    std::condition_variable interrupt_cv_;
+    bool interrupted_ = false;
+    std::deque<VideoFrame> frames_;
+};
+
+class TransportSwapTest : public ::testing::Test {
+protected:
+    // Poll until the swap leaves PENDING or the wait runs out
+    static TransportSwap::Progress poll_until_done(TransportSwap& swap, VideoFrame& keyframe, int max_ms) {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(max_ms);
+        TransportSwap::Progress progress;
+        while ((progress = swap.poll(keyframe)) == TransportSwap::Progress::PENDING &&
+               std::chrono::steady_clock::now() < deadline) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        return progress;
+    }
+
+    static int64_t elapsed_ms(std::chrono::steady_clock::time_point since) {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - since).count();
+    }
+};
+
+// Test 1: Inter frames before the first keyframe are dropped; the keyframe is handed over
+TEST_F(TransportSwapTest, CutsOverOnFirstKeyframe) {
+    FakeTransport next(ProtocolType::RTSP);
+    next.push(false, 1);
+    next.push(false, 2);
+    next.push(true, 3);
+    next.push(false, 4);
+
+    TransportSwap swap;
+    swap.begin(&next, "rtsp://device/stream");
+    EXPECT_TRUE(swap.in_progress());
+    EXPECT_EQ(swap.incoming(), &next);
+
+    VideoFrame keyframe = {};
+    ASSERT_EQ(poll_until_done(swap, keyframe, 1000), TransportSwap::Progress::CUTOVER);
+    ASSERT_NE(keyframe.data, nullptr);
+    EXPECT_EQ(keyframe.data[0], 3);
+    EXPECT_TRUE(keyframe.is_keyframe);
+    delete[] keyframe.data;
+
+    EXPECT_FALSE(swap.in_progress());
+    EXPECT_EQ(swap.poll(keyframe), TransportSwap::Progress::IDLE);
+    EXPECT_EQ(next.last_url, "rtsp://device/stream");
+    EXPECT_EQ(next.disconnects.load(), 0);
+
+    // Frames after the keyframe are left for the caller
+    VideoFrame after = {};
+    ASSERT_TRUE(next.receive_frame(after));
+    EXPECT_EQ(after.data[0], 4);
+    delete[] after.data;
+}
+
+// Test 2: A slow connect never blocks poll()
+TEST_F(TransportSwapTest, PollDoesNotWaitForConnect) {
+    FakeTransport next(ProtocolType::WEBSOCKET_OBS_DROID);
+    next.connect_delay = std::chrono::milliseconds(200);
+
+    TransportSwap swap;
+    auto start = std::chrono::steady_clock::now();
+    swap.begin(&next, "ws://device/stream");
+
+    VideoFrame keyframe = {};
+    EXPECT_EQ(swap.poll(keyframe), TransportSwap::Progress::PENDING);
+    EXPECT_LT(elapsed_ms(start), 50);
+
+    next.push(true, 7);
+    ASSERT_EQ(poll_until_done(swap, keyframe, 2000), TransportSwap::Progress::CUTOVER);
+    delete[] keyframe.data;
+}
+
+// Test 3: A failed connect or a missing keyframe gives up and disconnects the newcomer
+TEST_F(TransportSwapTest, FailsAndCleansUp) {
+    FakeTransport refused(ProtocolType::HTTP_DASH);
+    refused.connect_result = false;
+
+    VideoFrame keyframe = {};
+    {
+        TransportSwap swap;
+        swap.begin(&refused, "http://device/dash");
+        EXPECT_EQ(poll_until_done(swap, keyframe, 1000), TransportSwap::Progress::FAILED);
+        EXPECT_FALSE(swap.in_progress());
+    }
+    EXPECT_EQ(refused.disconnects.load(), 1);
+
+    FakeTransport silent(ProtocolType::HTTP_MJPEG);
+    silent.push(false, 1);
+    {
+        TransportSwap swap;
+        auto start = std::chrono::steady_clock::now();
+        swap.begin(&silent, "http://device/mjpeg", 100);
+        EXPECT_EQ(poll_until_done(swap, keyframe, 1000), TransportSwap::Progress::FAILED);
+        EXPECT_GE(elapsed_ms(start), 100);
+    }
+    EXPECT_EQ(silent.disconnects.load(), 1);
+}
+
+// Test 4: retire() and cancel() disconnect in the background
+TEST_F(TransportSwapTest, DisconnectsOffThread) {
+    FakeTransport old(ProtocolType::HTTP_RAW_H264);
+    old.disconnect_delay = std::chrono::milliseconds(200);
+    FakeTransport next(ProtocolType::RTSP);
+    next.connect_delay = std::chrono::milliseconds(100);
+
+    TransportSwap swap;
+    auto start = std::chrono::steady_clock::now();
+    swap.retire(&old);
+    swap.begin(&next, "rtsp://device/stream");
+    swap.cancel();
+    EXPECT_LT(elapsed_ms(start), 50);
+    EXPECT_FALSE(swap.in_progress());
+
+    swap.settle();
+    EXPECT_EQ(old.disconnects.load(), 1);
+    EXPECT_EQ(next.connects.load(), 1);
+    EXPECT_EQ(next.disconnects.load(), 1);
+    EXPECT_FALSE(next.is_connected());
+}
+
+// Test 5: Switching back to a transport that is still going down waits for it first
+TEST_F(TransportSwapTest, BeginWaitsForTeardownOfSameTransport) {
+    FakeTransport old(ProtocolType::WEBSOCKET_OBS_DROID);
+    old.disconnect_delay = std::chrono::milliseconds(100);
+
+    TransportSwap swap;
+    swap.retire(&old);
+    swap.begin(&old, "ws://device/stream");
+
+    old.push(true, 9);
+    VideoFrame keyframe = {};
+    ASSERT_EQ(poll_until_done(swap, keyframe, 1000), TransportSwap::Progress::CUTOVER);
+    delete[] keyframe.data;
+
+    // Reconnected after the disconnect, not before it
+    EXPECT_EQ(old.disconnects.load(), 1);
+    EXPECT_TRUE(old.is_connected());
+}
+
+// Test 6: The first candidate with a keyframe wins, even if it started later
+TEST_F(TransportSwapTest, RaceKeepsFirstKeyframe) {
+    FakeTransport preferred(ProtocolType::WEBSOCKET_OBS_DROID);
+    preferred.push(false, 1);
+    FakeTransport fallback(ProtocolType::RTSP);
+    fallback.push(true, 2);
+
+    TransportSwap swap;
+    swap.begin({ { &preferred, "ws://device/stream" }, { &fallback, "rtsp://device/stream" } }, 20, 1000);
+    EXPECT_EQ(swap.incoming(), &preferred);
+
+    VideoFrame keyframe = {};
+    ASSERT_EQ(poll_until_done(swap, keyframe, 1000), TransportSwap::Progress::CUTOVER);
+    EXPECT_EQ(keyframe.data[0], 2);
+    EXPECT_EQ(swap.winner(), &fallback);
+    delete[] keyframe.data;
+
+    swap.settle();
+    EXPECT_EQ(preferred.disconnects.load(), 1);
+    EXPECT_EQ(fallback.disconnects.load(), 0);
+    EXPECT_TRUE(fallback.is_connected());
+}
+
+// Test 7: A refused candidate brings the next one forward instead of waiting out the stagger
+TEST_F(TransportSwapTest, FailedCandidateSkipsStagger) {
+    FakeTransport refused(ProtocolType::HTTP_DASH);
+    refused.connect_result = false;
+    FakeTransport fallback(ProtocolType::HTTP_MJPEG);
+    fallback.push(true, 5);
+
+    TransportSwap swap;
+    auto start = std::chrono::steady_clock::now();
+    swap.begin({ { &refused, "http://device/dash" }, { &fallback, "http://device/mjpeg" } }, 1000, 5000);
+
+    VideoFrame keyframe = {};
+    ASSERT_EQ(poll_until_done(swap, keyframe, 2000), TransportSwap::Progress::CUTOVER);
+    EXPECT_LT(elapsed_ms(start), 500);
+    EXPECT_EQ(swap.winner(), &fallback);
+    delete[] keyframe.data;
+}
+
+// Test 8: A keyframe assembled across a loss does not count
+TEST_F(TransportSwapTest, IgnoresCorruptKeyframe) {
+    FakeTransport next(ProtocolType::RTSP);
+    next.push(true, 1, true);
+    next.push(true, 2);
+
+    TransportSwap swap;
+    swap.begin(&next, "rtsp://device/stream");
+
+    VideoFrame keyframe = {};
+    ASSERT_EQ(poll_until_done(swap, keyframe, 1000), TransportSwap::Progress::CUTOVER);
+    EXPECT_EQ(keyframe.data[0], 2);
+    delete[] keyframe.data;
+}
+
+// Test 9: Candidates that never got their turn are left untouched
+TEST_F(TransportSwapTest, UnstartedCandidatesUntouched) {
+    FakeTransport preferred(ProtocolType::WEBSOCKET_OBS_DROID);
+    preferred.push(true, 1);
+    FakeTransport fallback(ProtocolType::RTSP);
+
+    {
+        TransportSwap swap;
+        swap.begin({ { &preferred, "ws://device/stream" }, { &fallback, "rtsp://device/stream" } }, 1000, 5000);
+
+        VideoFrame keyframe = {};
+        ASSERT_EQ(poll_until_done(swap, keyframe, 500), TransportSwap::Progress::CUTOVER);
+        EXPECT_EQ(swap.winner(), &preferred);
+        delete[] keyframe.data;
+    }
+
+    EXPECT_EQ(fallback.connects.load(), 0);
+    EXPECT_EQ(fallback.disconnects.load(), 0);
+}
+
+// Test 10: Abandoning a swap cuts a hung connect short instead of waiting it out
+TEST_F(TransportSwapTest, CancelInterruptsHungConnect) {
+    FakeTransport hung(ProtocolType::SRT);
+    hung.connect_delay = std::chrono::seconds(10);
+
+    auto start = std::chrono::steady_clock::now();
+    {
+        TransportSwap swap;
+        swap.begin(&hung, "srt://device:9000");
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+    EXPECT_LT(elapsed_ms(start), 500);
+    EXPECT_EQ(hung.connects.load(), 1);
+    EXPECT_EQ(hung.disconnects.load(), 1);
+    EXPECT_FALSE(hung.is_connected());
+
+    // The disconnect cleared the interrupt; the next race connects normally
+    hung.connect_delay = std::chrono::milliseconds(0);
+    hung.push(true, 3);
+    TransportSwap swap;
+    swap.begin(&hung, "srt://device:9000");
+    VideoFrame keyframe = {};
+    ASSERT_EQ(poll_until_done(swap, keyframe, 1000), TransportSwap::Progress::CUTOVER);
+    EXPECT_TRUE(hung.is_connected());
+    delete[] keyframe.data;
+}
+
+int main(int argc, char** argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,322 @@
+#include <gtest/gtest.h>
+#include <vector>
+#include "../src/protocols/ts-demuxer.hpp"
+
+using namespace berrystreamcam;
+
+namespace {
+
+constexpr int PMT_PID = 0x1000;
+constexpr int VIDEO_PID = 0x0100;
+constexpr int AUDIO_PID = 0x0101;
+
+uint32_t crc32_mpeg(const std::vector<uint8_t>& data)
+{
+    uint32_t crc = 0xFFFFFFFF;
+    for (uint8_t byte : data) {
+        crc ^= static_cast<uint32_t>(byte) << 24;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x80000000) ? (crc << 1) ^ 0x04C11DB7 : crc << 1;
+        }
+    }
+    return crc;
+}
+
+// Just enough of a muxer to stand in for an SRT sender's output
+class TsWriter {
+public:
+    std::vector<std::vector<uint8_t>> packets;
+
+    void pat()
+    {
+        section(0, { 0x00, 0x00, 0x01, 0xC1, 0x00, 0x00,
+                     0x00, 0x01, static_cast<uint8_t>(0xE0 | (PMT_PID >> 8)), static_cast<uint8_t>(PMT_PID) });
+    }
+
+    void pmt(bool with_audio = false)
+    {
+        std::vector<uint8_t> body = { 0x02, 0x00, 0x01, 0xC1, 0x00, 0x00,
+                                      static_cast<uint8_t>(0xE0 | (VIDEO_PID >> 8)), static_cast<uint8_t>(VIDEO_PID),
+                                      0xF0, 0x00 };
+        if (with_audio) {
+            body.insert(body.end(), { 0x0F, static_cast<uint8_t>(0xE0 | (AUDIO_PID >> 8)),
+                                      static_cast<uint8_t>(AUDIO_PID), 0xF0, 0x00 });
+        }
+        body.insert(body.end(), { 0x1B, static_cast<uint8_t>(0xE0 | (VIDEO_PID >> 8)),
+                                  static_cast<uint8_t>(VIDEO_PID), 0xF0, 0x00 });
+        section(PMT_PID, body);
+    }
+
+    // bounded writes PES_packet_length; senders leave it 0 for video
+    void pes(int pid, int64_t pts, const std::vector<uint8_t>& data, bool random_access = false,
+             bool bounded = false)
+    {
+        std::vector<uint8_t> pes = {
+            0x00, 0x00, 0x01, 0xE0, 0x00, 0x00, 0x80, 0x80, 0x05,
+            static_cast<uint8_t>(0x21 | ((pts >> 29) & 0x0E)),
+            static_cast<uint8_t>(pts >> 22),
+            static_cast<uint8_t>(((pts >> 14) & 0xFE) | 1),
+            static_cast<uint8_t>(pts >> 7),
+            static_cast<uint8_t>(((pts << 1) & 0xFE) | 1),
+        };
+        if (bounded) {
+            size_t length = data.size() + 8;
+            pes[4] = static_cast<uint8_t>(length >> 8);
+            pes[5] = static_cast<uint8_t>(length);
+        }
+        pes.insert(pes.end(), data.begin(), data.end());
+
+        size_t offset = 0;
+        bool first = true;
+        while (offset < pes.size()) {
+            size_t room = 184;
+            bool flag = first && random_access;
+            size_t adaptation = flag ? 2 : 0;
+            size_t left = pes.size() - offset;
+            if (left < room - adaptation) {
+                adaptation = room - left;   // Stuff the last packet
+            }
+            size_t take = std::min(left, room - adaptation);
+
+            std::vector<uint8_t> packet = { 0x47, static_cast<uint8_t>((first ? 0x40 : 0) | (pid >> 8)),
+                                            static_cast<uint8_t>(pid),
+                                            static_cast<uint8_t>((adaptation ? 0x30 : 0x10) | next_cc(pid)) };
+            if (adaptation > 0) {
+                packet.push_back(static_cast<uint8_t>(adaptation - 1));
+                if (adaptation > 1) {
+                    packet.push_back(flag ? 0x40 : 0x00);
+                    packet.insert(packet.end(), adaptation - 2, 0xFF);
+                }
+            }
+            packet.insert(packet.end(), pes.begin() + offset, pes.begin() + offset + take);
+            packets.push_back(packet);
+            offset += take;
+            first = false;
+        }
+    }
+
+    std::vector<uint8_t> bytes() const
+    {
+        std::vector<uint8_t> out;
+        for (const auto& packet : packets) {
+            out.insert(out.end(), packet.begin(), packet.end());
+        }
+        return out;
+    }
+
+private:
+    int next_cc(int pid)
+    {
+        return cc_[pid]++ & 0x0F;
+    }
+
+    void section(int pid, std::vector<uint8_t> body)
+    {
+        size_t length = body.size() - 1 + 4;   // After the length field, CRC included
+        std::vector<uint8_t> section = { body[0], static_cast<uint8_t>(0xB0 | (length >> 8)),
+                                         static_cast<uint8_t>(length) };
+        section.insert(section.end(), body.begin() + 1, body.end());
+        uint32_t crc = crc32_mpeg(section);
+        section.insert(section.end(), { static_cast<uint8_t>(crc >> 24), static_cast<uint8_t>(crc >> 16),
+                                        static_cast<uint8_t>(crc >> 8), static_cast<uint8_t>(crc) });
+
+        std::vector<uint8_t> packet = { 0x47, static_cast<uint8_t>(0x40 | (pid >> 8)), static_cast<uint8_t>(pid),
+                                        static_cast<uint8_t>(0x10 | next_cc(pid)), 0x00 };
+        packet.insert(packet.end(), section.begin(), section.end());
+        packet.resize(188, 0xFF);
+        packets.push_back(packet);
+    }
+
+    int cc_[8192] = {};
+};
+
+// An access unit of the given size whose bytes never form a start code
+std::vector<uint8_t> access_unit(uint8_t nal_type, size_t size, uint8_t seed)
+{
+    std::vector<uint8_t> au = { 0x00, 0x00, 0x00, 0x01, static_cast<uint8_t>(0x60 | nal_type) };
+    for (size_t i = au.size(); i < size; i++) {
+        au.push_back(static_cast<uint8_t>(0x10 + (seed + i) % 0xE0));
+    }
+    return au;
+}
+
+struct Collected {
+    std::vector<std::vector<uint8_t>> data;
+    std::vector<int64_t> pts;
+    std::vector<bool> keyframe;
+    std::vector<bool> corrupt;
+};
+
+TsDemuxer::FrameCallback collect(Collected& out)
+{
+    return [&out](VideoFrame&& frame) {
+        out.data.emplace_back(frame.data, frame.data + frame.size);
+        out.pts.push_back(frame.pts);
+        out.keyframe.push_back(frame.is_keyframe);
+        out.corrupt.push_back(frame.is_corrupt);
+        delete[] frame.data;
+    };
+}
+
+} // namespace
+
+// Test 1: Access units come out whole from pieces of any size; IDR NAL units mark keyframes
+TEST(TsDemuxerTest, AccessUnitsFromAnyChunking) {
+    TsWriter writer;
+    writer.pat();
+    writer.pmt();
+    std::vector<std::vector<uint8_t>> units = {
+        access_unit(5, 5000, 1), access_unit(1, 900, 2), access_unit(1, 184, 3), access_unit(1, 10, 4),
+    };
+    for (size_t i = 0; i < units.size(); i++) {
+        writer.pes(VIDEO_PID, 3000 * static_cast<int64_t>(i) + (1LL << 32), units[i]);
+    }
+    std::vector<uint8_t> stream = writer.bytes();
+
+    for (size_t chunk : { size_t(1), size_t(7), size_t(1316), stream.size() }) {
+        Collected out;
+        TsDemuxer demuxer(collect(out));
+        for (size_t offset = 0; offset < stream.size(); offset += chunk) {
+            demuxer.feed(stream.data() + offset, std::min(chunk, stream.size() - offset));
+        }
+
+        // An unbounded PES ends when the next one starts
+        EXPECT_EQ(out.data.size(), units.size() - 1) << "chunk " << chunk;
+        demuxer.finish();
+        ASSERT_EQ(out.data.size(), units.size()) << "chunk " << chunk;
+        EXPECT_EQ(out.data, units);
+        EXPECT_EQ(out.pts, (std::vector<int64_t>{ (1LL << 32), (1LL << 32) + 3000,
+                                                  (1LL << 32) + 6000, (1LL << 32) + 9000 }));
+        EXPECT_EQ(out.keyframe, (std::vector<bool>{ true, false, false, false }));
+        EXPECT_EQ(out.corrupt, (std::vector<bool>{ false, false, false, false }));
+        EXPECT_EQ(demuxer.video_pid(), VIDEO_PID);
+
+        TsDemuxerStats stats = demuxer.stats();
+        EXPECT_EQ(stats.frames, units.size());
+        EXPECT_EQ(stats.continuity_errors, 0u);
+        EXPECT_EQ(stats.resyncs, 0u);
+    }
+}
+
+// Test 2: A bounded PES is handed out as soon as it is complete
+TEST(TsDemuxerTest, BoundedPesWithoutWaiting) {
+    Collected out;
+    TsDemuxer demuxer(collect(out));
+    TsWriter writer;
+    writer.pat();
+    writer.pmt();
+    writer.pes(VIDEO_PID, 9000, access_unit(1, 3000, 7), true, true);
+    std::vector<uint8_t> stream = writer.bytes();
+    demuxer.feed(stream.data(), stream.size());
+
+    ASSERT_EQ(out.data.size(), 1u);
+    EXPECT_EQ(out.data[0], access_unit(1, 3000, 7));
+    EXPECT_EQ(out.pts[0], 9000);
+    EXPECT_TRUE(out.keyframe[0]);   // From the random access indicator alone
+}
+
+// Test 3: A continuity gap marks only the access unit it hit; repeated packets are ignored
+TEST(TsDemuxerTest, ContinuityGapMarksCorrupt) {
+    TsWriter writer;
+    writer.pat();
+    writer.pmt();
+    writer.pes(VIDEO_PID, 0, access_unit(5, 2000, 1));
+    size_t second = writer.packets.size();
+    writer.pes(VIDEO_PID, 3000, access_unit(1, 2000, 2));
+    writer.pes(VIDEO_PID, 6000, access_unit(1, 2000, 3));
+    writer.pes(VIDEO_PID, 9000, access_unit(1, 10, 4));
+
+    // Lose a packet from the middle of the second unit; send the first packet twice
+    writer.packets.erase(writer.packets.begin() + second + 3);
+    writer.packets.insert(writer.packets.begin() + 2, writer.packets[2]);
+
+    Collected out;
+    TsDemuxer demuxer(collect(out));
+    std::vector<uint8_t> stream = writer.bytes();
+    demuxer.feed(stream.data(), stream.size());
+
+    ASSERT_EQ(out.data.size(), 3u);
+    EXPECT_EQ(out.data[0], access_unit(5, 2000, 1));
+    EXPECT_EQ(out.data[1].size(), 2000u - 184u);
+    EXPECT_EQ(out.data[2], access_unit(1, 2000, 3));
+    EXPECT_EQ(out.corrupt, (std::vector<bool>{ false, true, false }));
+
+    TsDemuxerStats stats = demuxer.stats();
+    EXPECT_EQ(stats.continuity_errors, 1u);
+    EXPECT_EQ(stats.frames_corrupt, 1u);
+}
+
+// Test 4: Garbage between packets, even with sync bytes in it, is skipped
+TEST(TsDemuxerTest, ResyncAfterGarbage) {
+    TsWriter writer;
+    writer.pat();
+    writer.pmt();
+    writer.pes(VIDEO_PID, 0, access_unit(5, 1000, 1));
+    size_t cut = writer.packets.size() - 2;
+    writer.pes(VIDEO_PID, 3000, access_unit(1, 1000, 2));
+    writer.pes(VIDEO_PID, 6000, access_unit(1, 10, 3));
+
+    std::vector<uint8_t> stream;
+    for (size_t i = 0; i < writer.packets.size(); i++) {
+        if (i == cut) {
+            // Part of a packet, then noise that looks like a sync byte every 100 bytes
+            stream.insert(stream.end(), writer.packets[i].begin(), writer.packets[i].begin() + 50);
+            for (int n = 0; n < 500; n++) {
+                stream.push_back(n % 100 == 0 ? 0x47 : 0x11);
+            }
+            continue;
+        }
+        stream.insert(stream.end(), writer.packets[i].begin(), writer.packets[i].end());
+    }
+
+    Collected out;
+    TsDemuxer demuxer(collect(out));
+    demuxer.feed(stream.data(), stream.size());
+    demuxer.finish();
+
+    ASSERT_EQ(out.data.size(), 3u);
+    EXPECT_EQ(out.corrupt, (std::vector<bool>{ true, false, false }));
+    EXPECT_EQ(out.data[1], access_unit(1, 1000, 2));
+    EXPECT_EQ(out.data[2], access_unit(1, 10, 3));
+    EXPECT_EQ(demuxer.stats().resyncs, 1u);
+}
+
+// Test 5: Only the H.264 stream is followed; tables with a bad CRC and oversized units are dropped
+TEST(TsDemuxerTest, TablesAndLimits) {
+    Collected out;
+    TsDemuxer demuxer(collect(out));
+
+    // A damaged PAT leaves the demuxer waiting for the next one
+    TsWriter broken;
+    broken.pat();
+    broken.packets[0][10] ^= 0x01;
+    broken.pmt();
+    broken.pes(VIDEO_PID, 0, access_unit(5, 500, 1));
+    std::vector<uint8_t> stream = broken.bytes();
+    demuxer.feed(stream.data(), stream.size());
+    demuxer.finish();
+    EXPECT_EQ(demuxer.video_pid(), -1);
+    EXPECT_TRUE(out.data.empty());
+
+    TsWriter writer;
+    writer.pat();
+    writer.pmt(true);
+    writer.pes(AUDIO_PID, 0, std::vector<uint8_t>(400, 0x22));
+    writer.pes(VIDEO_PID, 0, access_unit(5, 500, 1));
+    writer.pes(VIDEO_PID, 3000, access_unit(1, TsDemuxer::MAX_FRAME_BYTES + 1, 2));
+    writer.pes(VIDEO_PID, 6000, access_unit(1, 500, 3));
+    writer.pes(VIDEO_PID, 9000, access_unit(1, 10, 4));
+    stream = writer.bytes();
+    demuxer.feed(stream.data(), stream.size());
+
+    EXPECT_EQ(demuxer.video_pid(), VIDEO_PID);
+    ASSERT_EQ(out.data.size(), 2u);
+    EXPECT_EQ(out.data[0], access_unit(5, 500, 1));
+    EXPECT_EQ(out.data[1], access_unit(1, 500, 3));
+    EXPECT_EQ(demuxer.stats().frames_dropped, 1u);
+}
+
+int main(int argc, char** argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,392 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "../src/protocols/udp-fec.hpp"
+
+using namespace berrystreamcam;
+
+namespace {
+
+/**
+ * Stands between receiver and sender on loopback. Everything the receiver
+ * sends goes through; what the sender sends is passed to drop() first,
+ * numbered from 0, and lost if it says so.
+ */
+class LossyLink {
+public:
+    using DropFilter = std::function<bool(uint64_t index)>;
+
+    LossyLink(int sender_port, DropFilter drop)
+        : drop_(std::move(drop))
+        , running_(true)
+        , forwarded_(0)
+        , dropped_(0)
+        , has_receiver_(false)
+    {
+        front_ = socket(AF_INET, SOCK_DGRAM, 0);
+        back_ = socket(AF_INET, SOCK_DGRAM, 0);
+
+        sockaddr_in addr = loopback(0);
+        bind(front_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+        socklen_t length = sizeof(addr);
+        getsockname(front_, reinterpret_cast<sockaddr*>(&addr), &length);
+        port_ = ntohs(addr.sin_port);
+
+        sockaddr_in sender = loopback(sender_port);
+        connect(back_, reinterpret_cast<sockaddr*>(&sender), sizeof(sender));
+
+        thread_ = std::thread([this]() { run(); });
+    }
+
+    ~LossyLink()
+    {
+        running_ = false;
+        thread_.join();
+        close(front_);
+        close(back_);
+    }
+
+    int port() const { return port_; }
+    uint64_t dropped() const { return dropped_; }
+
+    void set_filter(DropFilter drop)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        drop_ = std::move(drop);
+    }
+
+private:
+    static sockaddr_in loopback(int port)
+    {
+        sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = htons(static_cast<uint16_t>(port));
+        return addr;
+    }
+
+    void run()
+    {
+        uint8_t buffer[2048];
+        while (running_) {
+            pollfd fds[2] = { { front_, POLLIN, 0 }, { back_, POLLIN, 0 } };
+            if (poll(fds, 2, 10) <= 0) {
+                continue;
+            }
+
+            if (fds[0].revents & POLLIN) {
+                socklen_t length = sizeof(receiver_);
+                ssize_t size = recvfrom(front_, buffer, sizeof(buffer), 0,
+                                        reinterpret_cast<sockaddr*>(&receiver_), &length);
+                if (size > 0) {
+                    has_receiver_ = true;
+                    send(back_, buffer, size, 0);
+                }
+            }
+
+            if (fds[1].revents & POLLIN) {
+                ssize_t size = recv(back_, buffer, sizeof(buffer), 0);
+                if (size <= 0 || !has_receiver_) {
+                    continue;
+                }
+                bool drop;
+                {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    drop = drop_ && drop_(forwarded_ + dropped_);
+                }
+                if (drop) {
+                    dropped_++;
+                    continue;
+                }
+                forwarded_++;
+                sendto(front_, buffer, size, 0, reinterpret_cast<sockaddr*>(&receiver_), sizeof(receiver_));
+            }
+        }
+    }
+
+    std::mutex mutex_;
+    DropFilter drop_;
+    std::atomic<bool> running_;
+    uint64_t forwarded_;
+    std::atomic<uint64_t> dropped_;
+    bool has_receiver_;
+    sockaddr_in receiver_;
+    int front_;
+    int back_;
+    int port_;
+    std::thread thread_;
+};
+
+// Payload bytes derive from the pts, so a wrongly rebuilt packet shows
+std::vector<uint8_t> payload(int64_t pts, size_t size)
+{
+    std::vector<uint8_t> data(size);
+    for (size_t i = 0; i < size; i++) {
+        data[i] = static_cast<uint8_t>(pts * 7 + i / 3);
+    }
+    return data;
+}
+
+bool intact(const VideoFrame& frame)
+{
+    std::vector<uint8_t> expected = payload(frame.pts, frame.size);
+    return frame.size > 0 && memcmp(frame.data, expected.data(), frame.size) == 0;
+}
+
+// Keyframes every 30, sizes from one packet to a few dozen
+size_t frame_size(int64_t pts)
+{
+    return pts % 30 == 0 ? 40000 : 500 + (pts * 1931) % 9000;
+}
+
+bool send_frame(UdpFecSender& sender, int64_t pts)
+{
+    std::vector<uint8_t> data = payload(pts, frame_size(pts));
+    VideoFrame frame = {};
+    frame.data = data.data();
+    frame.size = data.size();
+    frame.pts = pts;
+    frame.is_keyframe = pts % 30 == 0;
+    return sender.send(frame);
+}
+
+struct Received {
+    std::vector<int64_t> pts;
+    uint64_t corrupt = 0;
+};
+
+void drain(UdpFecTransport& transport, Received& received)
+{
+    VideoFrame frame = {};
+    while (transport.receive_frame(frame)) {
+        if (!intact(frame)) {
+            received.corrupt++;
+        }
+        received.pts.push_back(frame.pts);
+        delete[] frame.data;
+    }
+}
+
+// A frame every few milliseconds, reading as we go, then whatever is still on its way
+Received stream(UdpFecSender& sender, UdpFecTransport& transport, int64_t first, int64_t count)
+{
+    Received received;
+    for (int64_t pts = first; pts < first + count; pts++) {
+        send_frame(sender, pts);
+        std::this_thread::sleep_for(std::chrono::milliseconds(4));
+        drain(transport, received);
+    }
+
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(500);
+    while (std::chrono::steady_clock::now() < deadline &&
+           (received.pts.empty() || received.pts.back() != first + count - 1)) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        drain(transport, received);
+    }
+    return received;
+}
+
+std::vector<int64_t> sequence(int64_t first, int64_t count)
+{
+    std::vector<int64_t> pts;
+    for (int64_t i = first; i < first + count; i++) {
+        pts.push_back(i);
+    }
+    return pts;
+}
+
+std::string url(int port)
+{
+    return "udpfec://127.0.0.1:" + std::to_string(port);
+}
+
+} // namespace
+
+// Test 1: The handshake settles FEC and NACKs; a clean link delivers every frame intact
+TEST(UdpFecTest, HandshakeAndCleanDelivery) {
+    auto sender = UdpFecSender::create(0, 6);
+    ASSERT_NE(sender, nullptr);
+
+    UdpFecTransport transport;
+    EXPECT_EQ(transport.protocol(), ProtocolType::UDP_FEC);
+    transport.set_latency_ms(250);
+    ASSERT_TRUE(transport.connect(url(sender->port())));
+    EXPECT_TRUE(transport.is_connected());
+    EXPECT_TRUE(sender->has_receiver());
+    EXPECT_TRUE(sender->take_keyframe_request());   // A new receiver starts at a keyframe
+    EXPECT_FALSE(sender->take_keyframe_request());
+
+    UdpFecStats stats = transport.stats();
+    EXPECT_EQ(stats.group_size, 6u);
+    EXPECT_TRUE(stats.nack);
+    EXPECT_EQ(stats.latency_ms, 250);
+    EXPECT_GE(stats.rtt_ms, 0.0);
+
+    Received received = stream(*sender, transport, 0, 60);
+    EXPECT_EQ(received.pts, sequence(0, 60));
+    EXPECT_EQ(received.corrupt, 0u);
+
+    stats = transport.stats();
+    EXPECT_EQ(stats.packets_recovered, 0u);
+    EXPECT_EQ(stats.packets_unrecoverable, 0u);
+    EXPECT_EQ(stats.frames_completed, 60u);
+    EXPECT_GT(sender->stats().parity_packets, 0u);
+
+    // Nobody at the far end
+    UdpFecTransport nobody;
+    auto closed = UdpFecSender::create();
+    ASSERT_NE(closed, nullptr);
+    int port = closed->port();
+    closed.reset();
+    EXPECT_FALSE(nobody.connect(url(port)));
+    EXPECT_FALSE(nobody.is_connected());
+
+    transport.disconnect();
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+    while (sender->has_receiver() && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    EXPECT_FALSE(sender->has_receiver());
+}
+
+// Test 2: Scattered single losses are rebuilt from parity, with no round trip
+TEST(UdpFecTest, ParityRebuildsScatteredLoss) {
+    auto sender = UdpFecSender::create(0, 8);
+    ASSERT_NE(sender, nullptr);
+
+    // Every 13th packet, which never takes two from one group of 8 plus parity
+    LossyLink link(sender->port(), [](uint64_t index) { return index > 0 && index % 13 == 0; });
+    UdpFecTransport transport;
+    transport.set_latency_ms(250);
+    ASSERT_TRUE(transport.connect(url(link.port())));
+
+    Received received = stream(*sender, transport, 0, 90);
+    EXPECT_EQ(received.pts, sequence(0, 90));
+    EXPECT_EQ(received.corrupt, 0u);
+    EXPECT_GT(link.dropped(), 20u);
+
+    UdpFecStats stats = transport.stats();
+    EXPECT_GT(stats.packets_recovered, 0u);
+    EXPECT_EQ(stats.packets_unrecoverable, 0u);
+    EXPECT_EQ(stats.frames_dropped, 0u);
+}
+
+// Test 3: Bursts too long for parity are asked for again and arrive in time
+TEST(UdpFecTest, NackRecoversBursts) {
+    auto sender = UdpFecSender::create(0, 8);
+    ASSERT_NE(sender, nullptr);
+
+    // Four in a row out of every 50, retransmissions included
+    LossyLink link(sender->port(), [](uint64_t index) { return index > 0 && index % 50 < 4; });
+    UdpFecTransport transport;
+    transport.set_latency_ms(250);
+    ASSERT_TRUE(transport.connect(url(link.port())));
+
+    Received received = stream(*sender, transport, 0, 90);
+    EXPECT_EQ(received.pts, sequence(0, 90));
+    EXPECT_EQ(received.corrupt, 0u);
+
+    UdpFecStats stats = transport.stats();
+    EXPECT_GT(stats.nacks_sent, 0u);
+    EXPECT_GT(stats.packets_retransmitted, 0u);
+    EXPECT_EQ(stats.packets_unrecoverable, 0u);
+    EXPECT_GT(sender->stats().retransmitted, 0u);
+}
+
+// Test 4: An outage longer than the window is given up on; the stream resumes at a keyframe
+TEST(UdpFecTest, OutageBeyondDeadline) {
+    auto sender = UdpFecSender::create(0, 8);
+    ASSERT_NE(sender, nullptr);
+
+    LossyLink link(sender->port(), nullptr);
+    UdpFecTransport transport;
+    transport.set_latency_ms(150);
+    ASSERT_TRUE(transport.connect(url(link.port())));
+    sender->take_keyframe_request();
+
+    Received before = stream(*sender, transport, 0, 10);
+    EXPECT_EQ(before.pts, sequence(0, 10));
+
+    // Frames 10 to 19 and every retransmission of them are lost, for well over the window
+    link.set_filter([](uint64_t) { return true; });
+    for (int64_t pts = 10; pts < 20; pts++) {
+        send_frame(*sender, pts);
+        std::this_thread::sleep_for(std::chrono::milliseconds(40));
+    }
+    link.set_filter(nullptr);
+
+    // Inter frames after the hole are dropped until the keyframe the receiver asks for
+    Received after = stream(*sender, transport, 20, 5);
+    EXPECT_TRUE(after.pts.empty());
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+    bool requested = false;
+    while (!(requested = sender->take_keyframe_request()) && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    EXPECT_TRUE(requested);
+
+    Received resumed = stream(*sender, transport, 30, 10);
+    EXPECT_EQ(resumed.pts, sequence(30, 10));
+    EXPECT_EQ(resumed.corrupt, 0u);
+
+    UdpFecStats stats = transport.stats();
+    EXPECT_GT(stats.packets_unrecoverable, 0u);
+    EXPECT_GE(stats.frames_dropped, 15u);
+    EXPECT_GT(stats.keyframe_requests, 0u);
+}
+
+// Test 5: A sender without FEC is taken as it is; losses are left to NACKs alone
+TEST(UdpFecTest, SenderWithoutParity) {
+    auto sender = UdpFecSender::create(0, 0);
+    ASSERT_NE(sender, nullptr);
+
+    LossyLink link(sender->port(), [](uint64_t index) { return index > 0 && index % 17 == 0; });
+    UdpFecTransport transport;
+    transport.set_latency_ms(250);
+    ASSERT_TRUE(transport.connect(url(link.port())));
+    EXPECT_EQ(transport.stats().group_size, 0u);
+
+    Received received = stream(*sender, transport, 0, 60);
+    EXPECT_EQ(received.pts, sequence(0, 60));
+    EXPECT_EQ(received.corrupt, 0u);
+
+    UdpFecStats stats = transport.stats();
+    EXPECT_EQ(stats.packets_recovered, 0u);
+    EXPECT_GT(stats.packets_retransmitted, 0u);
+    EXPECT_EQ(sender->stats().parity_packets, 0u);
+}
+
+// Test 6: The URL's group caps the parity asked for, as offered in the app's hello; 0 asks for none
+TEST(UdpFecTest, UrlGroupCapsParity) {
+    auto sender = UdpFecSender::create(0, 8);
+    ASSERT_NE(sender, nullptr);
+
+    UdpFecTransport transport;
+    ASSERT_TRUE(transport.connect(url(sender->port()) + "?group=4"));
+    EXPECT_EQ(transport.stats().group_size, 4u);
+
+    ASSERT_TRUE(transport.connect(url(sender->port()) + "?group=0"));
+    EXPECT_EQ(transport.stats().group_size, 0u);
+
+    Received received = stream(*sender, transport, 0, 30);
+    EXPECT_EQ(received.pts, sequence(0, 30));
+    EXPECT_EQ(sender->stats().parity_packets, 0u);
+}
+
+int main(int argc, char** argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}